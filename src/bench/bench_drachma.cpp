@@ -0,0 +1,485 @@
+//
+// ===============================================================
+//  bench_drachma
+// ===============================================================
+//
+//  Runs the benchmark and load harnesses that live next to the
+//  code they measure, prints what each one reports and exits
+//  non-zero when any of them fails or reports a bad outcome:
+//  a session that verifies when it must not, a lost pong, a block
+//  that did not reconstruct, a transaction that never reached a
+//  node, a refused signing batch.
+//
+//    bench_drachma [-quick] [-filter=<name>] [-list]
+//
+//  -quick runs each harness on small settings (seconds, not
+//  minutes); that is what the ctest entries use. Without it the
+//  harnesses run on their own defaults.
+//
+// ===============================================================
+//
+
+#include "../core/chain/headerindexbench.h"
+#include "../core/chain/reorgbench.h"
+#include "../core/crypto/musig2driver.h"
+#include "../core/network/compactblockbench.h"
+#include "../core/network/reactorload.h"
+#include "../core/network/txrelaysim.h"
+#include "../core/network/v2transportbench.h"
+#include "../core/node/scheduler.h"
+#include "../core/script/sighashbench.h"
+#include "../core/storage/blockfilterbench.h"
+#include "../core/wallet/coinselectionbench.h"
+#include "../core/wallet/keystorebench.h"
+#include "../core/wallet/signingload.h"
+#include "../core/wallet/signingservice.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <unistd.h>
+
+static bool SetReason(std::string* reason, const std::string& text)
+{
+    if (reason)
+        *reason = text;
+    return false;
+}
+
+// A fresh directory under $TMPDIR, removed again by the destructor
+class TempDir
+{
+public:
+    TempDir()
+    {
+        const char* tmp = std::getenv("TMPDIR");
+        std::string pattern = std::string(tmp && *tmp ? tmp : "/tmp") + "/drachma_bench_XXXXXX";
+        if (mkdtemp(&pattern[0]))
+            path = pattern;
+    }
+
+    ~TempDir()
+    {
+        std::error_code ec;
+        if (!path.empty())
+            std::filesystem::remove_all(path, ec);
+    }
+
+    TempDir(const TempDir&) = delete;
+    TempDir& operator=(const TempDir&) = delete;
+
+    bool IsValid() const { return !path.empty(); }
+    const std::string& Path() const { return path; }
+
+private:
+    std::string path;
+};
+
+//
+// ================================================================
+//  Harnesses
+// ================================================================
+static bool BenchMuSig2(bool, std::string* reason)
+{
+    if (!MuSig2SessionDriver::SelfTest(reason))
+        return false;
+
+    MuSig2SessionDriver::Options opts;
+    opts.signers = 16;
+
+    MuSig2SessionDriver::Report r;
+    if (!MuSig2SessionDriver::Run(opts, r, reason))
+        return false;
+
+    std::printf("  %zu signers: keyagg %.0f us, nonces %.0f us, sign %.0f us, partial verify %.0f us, "
+                "aggregate %.0f us, verify %.0f us (ECDSA x%zu: %.0f us)\n",
+                opts.signers, r.keyAggMicros, r.nonceMicros, r.signMicros, r.partialVerifyMicros,
+                r.aggregateMicros, r.verifyMicros, opts.signers, r.ecdsaVerifyMicros);
+
+    if (!r.verified || !r.badPartials.empty() || !r.nonceReuseRefused)
+        return SetReason(reason, "honest 16-of-16 session did not verify cleanly");
+    return true;
+}
+
+static bool BenchSighash(bool quick, std::string* reason)
+{
+    SighashBenchmark::Options opts;
+    if (quick)
+    {
+        opts.inputs = {1, 10, 100};
+        opts.minHashes = 2000;
+        opts.legacyMaxInputs = 100;
+    }
+
+    std::vector<SighashBenchmark::Report> reports;
+    if (!SighashBenchmark::Run(opts, reports, reason))
+        return false;
+
+    for (const SighashBenchmark::Report& r : reports)
+        std::printf("  %5zu inputs: legacy %.0f ns, uncached %.0f ns, precomputed %.0f ns per input "
+                    "(setup %.0f ns, %.1f us per tx)\n",
+                    r.inputs, r.legacyNs, r.uncachedNs, r.precomputedNs, r.setupNs, r.txMicros);
+    return true;
+}
+
+static bool BenchHeaderIndex(bool quick, std::string* reason)
+{
+    HeaderIndexBenchmark::Options opts;
+    if (quick)
+    {
+        opts.headers = 20000;
+        opts.forks = 50;
+        opts.queries = 20000;
+        opts.walkQueries = 100;
+    }
+
+    HeaderIndexBenchmark::Report r;
+    if (!HeaderIndexBenchmark::Run(opts, r, reason))
+        return false;
+
+    std::printf("  %zu headers: add %.0f ns, %.1f bytes each; ancestor %.0f ns (walk %.0f ns), "
+                "common ancestor %.0f ns, locator %.0f ns\n",
+                r.headers, r.addNs, r.bytesPerHeader, r.ancestorNs, r.parentWalkNs,
+                r.commonAncestorNs, r.locatorNs);
+    return true;
+}
+
+static bool BenchReorg(bool quick, std::string* reason)
+{
+    TempDir dir;
+    if (!dir.IsValid())
+        return SetReason(reason, "cannot create a temporary directory");
+
+    ReorgBenchmark::Options opts;
+    opts.dir = dir.Path();
+    if (quick)
+    {
+        opts.blocks = 160;              // coinbases mature after 100
+        opts.txs = 50;
+        opts.depths = {1, 5, 25};
+    }
+
+    Scheduler scheduler;
+    ReorgBenchmark::Summary s;
+    if (!ReorgBenchmark::Run(scheduler, opts, s, reason))
+        return false;
+
+    std::printf("  sync %.2f s\n", s.syncSeconds);
+    for (const ReorgBenchmark::Report& r : s.reorgs)
+        std::printf("  depth %3u: reorg %.1f ms, back %.1f ms, undo %.0f bytes per block%s\n",
+                    r.depth, r.reorgMs, r.backMs, r.undoBytesPerBlock, r.flushed ? ", flushed" : "");
+
+    if (s.reorgs.size() != opts.depths.size())
+        return SetReason(reason, "not every reorg depth ran");
+    return true;
+}
+
+static bool BenchBlockFilter(bool quick, std::string* reason)
+{
+    TempDir dir;
+    if (!dir.IsValid())
+        return SetReason(reason, "cannot create a temporary directory");
+
+    BlockFilterBenchmark::Options opts;
+    opts.dir = dir.Path();
+    if (quick)
+    {
+        opts.blocks = 100;
+        opts.txs = 100;
+        opts.walletScripts = 100;
+        opts.walletHits = 10;
+    }
+
+    Scheduler scheduler;
+    BlockFilterBenchmark::Report r;
+    if (!BlockFilterBenchmark::Run(scheduler, opts, r, reason))
+        return false;
+
+    std::printf("  %llu blocks: %.0f blocks/s, %.0f bytes per filter, %.1f bits per element; match p50 %.1f us, "
+                "p99 %.1f us; rescan %.0f blocks/s, %llu matched, %llu false positives\n",
+                (unsigned long long)r.blocks, r.blocksPerSecond, r.filterBytesPerBlock, r.bitsPerElement,
+                r.matchP50Micros, r.matchP99Micros, r.rescanBlocksPerSecond,
+                (unsigned long long)r.matchedBlocks, (unsigned long long)r.falsePositives);
+
+    if (r.blocks != opts.blocks)
+        return SetReason(reason, "index holds " + std::to_string(r.blocks) + " of " +
+                                 std::to_string(opts.blocks) + " filters");
+    return true;
+}
+
+static bool BenchV2Transport(bool quick, std::string* reason)
+{
+    V2TransportBenchmark::Options opts;
+    if (quick)
+    {
+        opts.payloads = {64, 4096, 65536};
+        opts.bytes = 8u << 20;
+    }
+
+    V2TransportBenchmark::Summary s;
+    if (!V2TransportBenchmark::Run(opts, s, reason))
+        return false;
+
+    std::printf("  handshake %.0f us\n", s.handshakeMicros);
+    for (const V2TransportBenchmark::Report& r : s.sizes)
+        std::printf("  %7zu bytes: plain %.2f s/GB, v2 %.2f s/GB (encrypt %.2f, decrypt %.2f); "
+                    "overhead %zu vs %zu bytes\n",
+                    r.payload, r.plainSecPerGB, r.v2SecPerGB, r.encryptSecPerGB, r.decryptSecPerGB,
+                    r.plainOverhead, r.v2Overhead);
+    return true;
+}
+
+static bool BenchReactorLoad(bool quick, std::string* reason)
+{
+    ReactorLoadGenerator::Options opts;
+    if (quick)
+    {
+        opts.peers = 64;
+        opts.clients = 2;
+        opts.duration = std::chrono::seconds(1);
+    }
+
+    ReactorLoadGenerator::Report r;
+    if (!ReactorLoadGenerator::Run(opts, r, reason))
+        return false;
+
+    std::printf("  %zu peers: %.0f msg/s, p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, max %.2f ms; "
+                "%.2f reads and %.2f sends per message\n",
+                r.peers, r.MessagesPerSecond(), r.p50Ms, r.p90Ms, r.p99Ms, r.maxMs,
+                r.readCallsPerMessage, r.sendCallsPerMessage);
+
+    if (r.failures != 0)
+        return SetReason(reason, std::to_string(r.failures) + " wrong or missing pongs");
+    if (r.messages == 0)
+        return SetReason(reason, "no round trip completed");
+    return true;
+}
+
+static bool BenchCompactBlock(bool quick, std::string* reason)
+{
+    CompactBlockBenchmark::Options opts;
+    if (quick)
+    {
+        opts.blocks = 3;
+        opts.txs = 300;
+        opts.mempoolShares = {1.0, 0.5};
+    }
+
+    std::vector<CompactBlockBenchmark::Report> reports;
+    if (!CompactBlockBenchmark::Run(opts, reports, reason))
+        return false;
+
+    for (const CompactBlockBenchmark::Report& r : reports)
+        std::printf("  mempool %3.0f%%: hit rate %.3f, %llu reconstructed, %llu round trips, %llu full; "
+                    "p50 %.2f ms, max %.2f ms; %.0f of %.0f bytes on the wire\n",
+                    100 * r.mempoolShare, r.hitRate, (unsigned long long)r.reconstructed,
+                    (unsigned long long)r.roundTrips, (unsigned long long)r.fullBlocks,
+                    r.p50Ms, r.maxMs, r.wireBytes, r.blockBytes);
+
+    for (const CompactBlockBenchmark::Report& r : reports)
+    {
+        if (r.mempoolShare >= 1.0 && r.reconstructed != r.blocks)
+            return SetReason(reason, "a block with every transaction in the mempool needed a round trip");
+    }
+    return true;
+}
+
+static bool BenchTxRelay(bool quick, std::string* reason)
+{
+    TxRelaySimulation::Options opts;
+    if (quick)
+    {
+        opts.nodes = 8;
+        opts.outbound = 3;
+        opts.txs = 100;
+        opts.txRate = 500;
+    }
+
+    std::vector<TxRelaySimulation::Report> reports;
+    if (!TxRelaySimulation::Run(opts, reports, reason))
+        return false;
+
+    for (const TxRelaySimulation::Report& r : reports)
+        std::printf("  %s: %.1f bytes per tx per connection (inv %llu, recon %llu), %llu flooded, "
+                    "%llu reconciled, %llu rounds (%llu failed), %.2f s\n",
+                    r.reconcile ? "reconciliation" : "flooding", r.bytesPerTxPerConnection,
+                    (unsigned long long)r.invBytes, (unsigned long long)r.reconBytes,
+                    (unsigned long long)r.invsFlooded, (unsigned long long)r.invsReconciled,
+                    (unsigned long long)r.reconRounds, (unsigned long long)r.reconFailed, r.seconds);
+
+    for (const TxRelaySimulation::Report& r : reports)
+    {
+        if (r.missing != 0)
+            return SetReason(reason, std::string(r.reconcile ? "reconciliation" : "flooding") + " left " +
+                                     std::to_string(r.missing) + " transactions undelivered");
+    }
+    return true;
+}
+
+static bool BenchCoinSelection(bool quick, std::string* reason)
+{
+    CoinSelectionBenchmark::Options opts;
+    if (quick)
+    {
+        opts.sizes = {10000};
+        opts.updates = 1000;
+        opts.payments = 100;
+    }
+
+    std::vector<CoinSelectionBenchmark::Report> reports;
+    if (!CoinSelectionBenchmark::Run(opts, reports, reason))
+        return false;
+
+    for (const CoinSelectionBenchmark::Report& r : reports)
+        std::printf("  %9zu coins: load %.2f s, %.1f bytes each, update %.2f us; p50 %.3f ms, p99 %.3f ms; "
+                    "bnb %llu, knapsack %llu, largest %llu, failed %llu\n",
+                    r.coins, r.loadSeconds, r.bytesPerCoin, r.updateMicros, r.p50Ms, r.p99Ms,
+                    (unsigned long long)r.bnb, (unsigned long long)r.knapsack,
+                    (unsigned long long)r.largest, (unsigned long long)r.failed);
+
+    for (const CoinSelectionBenchmark::Report& r : reports)
+    {
+        if (r.failed != 0)
+            return SetReason(reason, std::to_string(r.failed) + " payments found no selection");
+    }
+    return true;
+}
+
+static bool BenchKeyStore(bool quick, std::string* reason)
+{
+    TempDir dir;
+    if (!dir.IsValid())
+        return SetReason(reason, "cannot create a temporary directory");
+
+    KeyStoreBenchmark::Options opts;
+    opts.path = dir.Path() + "/keys.dat";
+    if (quick)
+    {
+        opts.keys = 20000;
+        opts.lookups = 20000;
+    }
+
+    Scheduler scheduler;
+    KeyStoreBenchmark::Report r;
+    if (!KeyStoreBenchmark::Run(scheduler, opts, r, reason))
+        return false;
+
+    std::printf("  %llu keys (%llu records): fill %.2f s, open %.1f ms, compact %.1f ms, "
+                "open compacted %.1f ms; %.1f table and %.1f file bytes per key; %.0f lookups/s\n",
+                (unsigned long long)r.keys, (unsigned long long)r.records, r.fillSeconds, r.openMs,
+                r.compactMs, r.openCompactedMs, r.tableBytesPerKey, r.fileBytesPerKey,
+                r.lookupsPerSecond);
+
+    if (r.keys != opts.keys)
+        return SetReason(reason, "store reopened with " + std::to_string(r.keys) + " of " +
+                                 std::to_string(opts.keys) + " keys");
+    return true;
+}
+
+static bool BenchSigningLoad(bool quick, std::string* reason)
+{
+    SigningLoadGenerator::Options opts;
+    opts.verify = true;
+    if (quick)
+    {
+        opts.clients = 2;
+        opts.batchSize = 64;
+        opts.keys = 16;
+        opts.duration = std::chrono::seconds(1);
+    }
+
+    Scheduler scheduler;
+    SigningService service(scheduler);
+    SigningLoadGenerator::Report r;
+    if (!SigningLoadGenerator::Run(service, opts, r, reason))
+        return false;
+
+    std::printf("  %llu batches, %.0f items/s; p50 %.2f ms, p99 %.2f ms, max %.2f ms\n",
+                (unsigned long long)r.batches, r.ItemsPerSecond(), r.p50Ms, r.p99Ms, r.maxMs);
+
+    if (r.failures != 0)
+        return SetReason(reason, std::to_string(r.failures) + " batches refused or signatures not verified");
+    if (r.items == 0)
+        return SetReason(reason, "no batch completed");
+    return true;
+}
+
+//
+// ================================================================
+//  Driver
+// ================================================================
+struct Bench
+{
+    const char* name;
+    bool (*run)(bool quick, std::string* reason);
+};
+
+static const Bench benches[] = {
+    { "musig2", BenchMuSig2 },
+    { "sighash", BenchSighash },
+    { "headerindex", BenchHeaderIndex },
+    { "reorg", BenchReorg },
+    { "blockfilter", BenchBlockFilter },
+    { "v2transport", BenchV2Transport },
+    { "reactorload", BenchReactorLoad },
+    { "compactblock", BenchCompactBlock },
+    { "txrelay", BenchTxRelay },
+    { "coinselection", BenchCoinSelection },
+    { "keystore", BenchKeyStore },
+    { "signingload", BenchSigningLoad },
+};
+
+int main(int argc, char** argv)
+{
+    bool quick = false;
+    std::string filter;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* arg = argv[i];
+        if (std::strcmp(arg, "-quick") == 0)
+            quick = true;
+        else if (std::strncmp(arg, "-filter=", 8) == 0)
+            filter = arg + 8;
+        else if (std::strcmp(arg, "-list") == 0)
+        {
+            for (const Bench& b : benches)
+                std::printf("%s\n", b.name);
+            return 0;
+        }
+        else
+        {
+            std::fprintf(stderr, "usage: %s [-quick] [-filter=<name>] [-list]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    size_t ran = 0;
+    size_t failed = 0;
+    for (const Bench& b : benches)
+    {
+        if (!filter.empty() && filter != b.name)
+            continue;
+
+        std::printf("%s\n", b.name);
+        std::fflush(stdout);
+
+        std::string reason;
+        if (!b.run(quick, &reason))
+        {
+            std::printf("  FAILED: %s\n", reason.c_str());
+            failed++;
+        }
+        std::fflush(stdout);
+        ran++;
+    }
+
+    if (ran == 0)
+    {
+        std::fprintf(stderr, "no benchmark named '%s'\n", filter.c_str());
+        return 2;
+    }
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,91 @@
+#ifndef DRACHMA_UTILS_BOUNDEDQUEUE_H
+#define DRACHMA_UTILS_BOUNDEDQUEUE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+//
+// BoundedQueue – blocking multi-producer / multi-consumer FIFO
+// ---------------------------------------------------------------
+// Push() blocks while the queue is full, which is what gives a
+// pipeline its backpressure. Close() wakes everybody: pending
+// items can still be popped, further pushes fail.
+//
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t cap) : capacity(cap ? cap : 1), closed(false), peak(0) {}
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    bool Push(T item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [this] { return closed || items.size() < capacity; });
+
+        if (closed)
+            return false;
+
+        items.push_back(std::move(item));
+        if (items.size() > peak)
+            peak = items.size();
+
+        notEmpty.notify_one();
+        return true;
+    }
+
+    // Returns false once the queue is closed and drained
+    bool Pop(T& out)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [this] { return closed || !items.empty(); });
+
+        if (items.empty())
+            return false;
+
+        out = std::move(items.front());
+        items.pop_front();
+
+        notFull.notify_one();
+        return true;
+    }
+
+    void Close()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        notFull.notify_all();
+        notEmpty.notify_all();
+    }
+
+    size_t Size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return items.size();
+    }
+
+    size_t Capacity() const { return capacity; }
+
+    // Highest fill level seen, to tell which stage is the bottleneck
+    size_t Peak() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return peak;
+    }
+
+private:
+    const size_t capacity;
+    bool closed;
+    size_t peak;
+
+    std::deque<T> items;
+    mutable std::mutex mutex;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+};
+
+#endif // DRACHMA_UTILS_BOUNDEDQUEUE_H
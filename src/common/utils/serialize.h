@@ -0,0 +1,338 @@
+#ifndef DRACHMA_UTILS_SERIALIZE_H
+#define DRACHMA_UTILS_SERIALIZE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include "span.h"
+
+//
+// ===============================================================
+//  Little-endian / CompactSize serialization helpers
+// ===============================================================
+//
+//  Wire format follows Bitcoin: fixed-width integers are little
+//  endian, lengths use CompactSize (1, 3, 5 or 9 bytes).
+//
+// ===============================================================
+//
+
+// Largest length prefix accepted when reading (same as Bitcoin)
+static const uint64_t MAX_SERIALIZED_SIZE = 0x02000000;
+
+inline uint16_t ReadLE16(const uint8_t* p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+inline uint32_t ReadLE32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+           ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+inline uint64_t ReadLE64(const uint8_t* p)
+{
+    return (uint64_t)ReadLE32(p) | ((uint64_t)ReadLE32(p + 4) << 32);
+}
+
+inline void WriteLE16(uint8_t* p, uint16_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+}
+
+inline void WriteLE32(uint8_t* p, uint32_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = (v >> 24) & 0xFF;
+}
+
+inline void WriteLE64(uint8_t* p, uint64_t v)
+{
+    WriteLE32(p, (uint32_t)v);
+    WriteLE32(p + 4, (uint32_t)(v >> 32));
+}
+
+// ---- Appending writers ----
+inline void AppendU8(std::vector<uint8_t>& out, uint8_t v)
+{
+    out.push_back(v);
+}
+
+inline void AppendU16(std::vector<uint8_t>& out, uint16_t v)
+{
+    size_t n = out.size();
+    out.resize(n + 2);
+    WriteLE16(&out[n], v);
+}
+
+inline void AppendU32(std::vector<uint8_t>& out, uint32_t v)
+{
+    size_t n = out.size();
+    out.resize(n + 4);
+    WriteLE32(&out[n], v);
+}
+
+inline void AppendU64(std::vector<uint8_t>& out, uint64_t v)
+{
+    size_t n = out.size();
+    out.resize(n + 8);
+    WriteLE64(&out[n], v);
+}
+
+inline void AppendBytes(std::vector<uint8_t>& out, const uint8_t* data, size_t len)
+{
+    out.insert(out.end(), data, data + len);
+}
+
+inline size_t CompactSizeLen(uint64_t n)
+{
+    if (n < 253) return 1;
+    if (n <= 0xFFFF) return 3;
+    if (n <= 0xFFFFFFFF) return 5;
+    return 9;
+}
+
+// Into a caller's buffer of at least 9 bytes; returns the length
+inline size_t WriteCompactSize(uint8_t* p, uint64_t n)
+{
+    if (n < 253)
+    {
+        p[0] = (uint8_t)n;
+        return 1;
+    }
+    if (n <= 0xFFFF)
+    {
+        p[0] = 253;
+        WriteLE16(p + 1, (uint16_t)n);
+        return 3;
+    }
+    if (n <= 0xFFFFFFFF)
+    {
+        p[0] = 254;
+        WriteLE32(p + 1, (uint32_t)n);
+        return 5;
+    }
+    p[0] = 255;
+    WriteLE64(p + 1, n);
+    return 9;
+}
+
+inline void AppendCompactSize(std::vector<uint8_t>& out, uint64_t n)
+{
+    if (n < 253)
+    {
+        out.push_back((uint8_t)n);
+    }
+    else if (n <= 0xFFFF)
+    {
+        out.push_back(253);
+        AppendU16(out, (uint16_t)n);
+    }
+    else if (n <= 0xFFFFFFFF)
+    {
+        out.push_back(254);
+        AppendU32(out, (uint32_t)n);
+    }
+    else
+    {
+        out.push_back(255);
+        AppendU64(out, n);
+    }
+}
+
+// CompactSize length followed by the bytes
+inline void AppendVarBytes(std::vector<uint8_t>& out, const uint8_t* data, size_t len)
+{
+    AppendCompactSize(out, len);
+    AppendBytes(out, data, len);
+}
+
+// Bitcoin's VARINT (MSB base-128, one byte per 7 bits with the
+// redundancy removed). Denser than CompactSize for small values;
+// used in on-disk formats only.
+inline void AppendVarInt(std::vector<uint8_t>& out, uint64_t n)
+{
+    uint8_t tmp[10];
+    int len = 0;
+
+    for (;;)
+    {
+        tmp[len] = (n & 0x7F) | (len ? 0x80 : 0x00);
+        if (n <= 0x7F)
+            break;
+        n = (n >> 7) - 1;
+        len++;
+    }
+
+    do
+    {
+        out.push_back(tmp[len]);
+    } while (len--);
+}
+
+//
+// ===============================================================
+//  SpanReader – bounds-checked cursor over a ByteSpan
+// ===============================================================
+//
+//  Every Read*() returns false (and leaves the cursor unspecified)
+//  when the input is too short or non-canonical.
+//
+class SpanReader
+{
+public:
+    explicit SpanReader(ByteSpan s) : span(s), pos(0) {}
+
+    size_t Position() const { return pos; }
+    size_t Remaining() const { return span.size - pos; }
+    bool Empty() const { return pos == span.size; }
+    const uint8_t* Cursor() const { return span.data + pos; }
+
+    bool Skip(size_t n)
+    {
+        if (Remaining() < n) return false;
+        pos += n;
+        return true;
+    }
+
+    bool ReadBytes(uint8_t* out, size_t n)
+    {
+        if (Remaining() < n) return false;
+        std::memcpy(out, span.data + pos, n);
+        pos += n;
+        return true;
+    }
+
+    // Zero-copy: out points into the underlying buffer
+    bool ReadSpan(size_t n, ByteSpan& out)
+    {
+        if (Remaining() < n) return false;
+        out = ByteSpan(span.data + pos, n);
+        pos += n;
+        return true;
+    }
+
+    bool ReadU8(uint8_t& v)
+    {
+        if (Remaining() < 1) return false;
+        v = span.data[pos++];
+        return true;
+    }
+
+    bool ReadU16(uint16_t& v)
+    {
+        if (Remaining() < 2) return false;
+        v = ReadLE16(span.data + pos);
+        pos += 2;
+        return true;
+    }
+
+    bool ReadU32(uint32_t& v)
+    {
+        if (Remaining() < 4) return false;
+        v = ReadLE32(span.data + pos);
+        pos += 4;
+        return true;
+    }
+
+    bool ReadU64(uint64_t& v)
+    {
+        if (Remaining() < 8) return false;
+        v = ReadLE64(span.data + pos);
+        pos += 8;
+        return true;
+    }
+
+    bool ReadI32(int32_t& v)
+    {
+        uint32_t u;
+        if (!ReadU32(u)) return false;
+        v = (int32_t)u;
+        return true;
+    }
+
+    bool ReadI64(int64_t& v)
+    {
+        uint64_t u;
+        if (!ReadU64(u)) return false;
+        v = (int64_t)u;
+        return true;
+    }
+
+    bool ReadCompactSize(uint64_t& n, bool rangeCheck = true)
+    {
+        uint8_t tag;
+        if (!ReadU8(tag)) return false;
+
+        if (tag < 253)
+        {
+            n = tag;
+        }
+        else if (tag == 253)
+        {
+            uint16_t v;
+            if (!ReadU16(v) || v < 253) return false;
+            n = v;
+        }
+        else if (tag == 254)
+        {
+            uint32_t v;
+            if (!ReadU32(v) || v <= 0xFFFF) return false;
+            n = v;
+        }
+        else
+        {
+            uint64_t v;
+            if (!ReadU64(v) || v <= 0xFFFFFFFF) return false;
+            n = v;
+        }
+
+        return !rangeCheck || n <= MAX_SERIALIZED_SIZE;
+    }
+
+    bool ReadVarInt(uint64_t& n)
+    {
+        n = 0;
+        for (;;)
+        {
+            uint8_t ch;
+            if (!ReadU8(ch)) return false;
+
+            if (n > (UINT64_MAX >> 7)) return false;
+            n = (n << 7) | (ch & 0x7F);
+
+            if (!(ch & 0x80))
+                return true;
+
+            if (n == UINT64_MAX) return false;
+            n++;
+        }
+    }
+
+    // CompactSize length + bytes, zero-copy
+    bool ReadVarSpan(ByteSpan& out)
+    {
+        uint64_t n;
+        return ReadCompactSize(n) && ReadSpan((size_t)n, out);
+    }
+
+    bool ReadVarBytes(std::vector<uint8_t>& out)
+    {
+        ByteSpan s;
+        if (!ReadVarSpan(s)) return false;
+        out.assign(s.begin(), s.end());
+        return true;
+    }
+
+private:
+    ByteSpan span;
+    size_t pos;
+};
+
+#endif // DRACHMA_UTILS_SERIALIZE_H
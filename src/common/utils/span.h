@@ -0,0 +1,37 @@
+#ifndef DRACHMA_UTILS_SPAN_H
+#define DRACHMA_UTILS_SPAN_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+//
+// ByteSpan – non-owning view of a contiguous byte range
+// ---------------------------------------------------------------
+// Used to hand out memory-mapped or network-buffer data without
+// copying it into a std::vector. The owner of the memory decides
+// how long a span stays valid.
+//
+struct ByteSpan
+{
+    const uint8_t* data;
+    size_t size;
+
+    ByteSpan() : data(nullptr), size(0) {}
+    ByteSpan(const uint8_t* d, size_t n) : data(d), size(n) {}
+    ByteSpan(const std::vector<uint8_t>& v) : data(v.data()), size(v.size()) {}
+
+    bool empty() const { return size == 0; }
+
+    const uint8_t* begin() const { return data; }
+    const uint8_t* end() const { return data + size; }
+
+    uint8_t operator[](size_t i) const { return data[i]; }
+
+    ByteSpan Sub(size_t offset, size_t len) const { return ByteSpan(data + offset, len); }
+    ByteSpan Sub(size_t offset) const { return ByteSpan(data + offset, size - offset); }
+
+    std::vector<uint8_t> ToVector() const { return std::vector<uint8_t>(data, data + size); }
+};
+
+#endif // DRACHMA_UTILS_SPAN_H
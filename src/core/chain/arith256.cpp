@@ -0,0 +1,208 @@
+#include "arith256.h"
+#include "block.h"
+
+#include <cstring>
+#include <mutex>
+
+ArithUint256 ArithUint256::FromLE(const uint8_t bytes[32])
+{
+    ArithUint256 r;
+    for (int i = 0; i < 4; ++i)
+        r.limbs[i] = ReadLE64(bytes + 8 * i);
+    return r;
+}
+
+ArithUint256 ArithUint256::FromLE(const std::array<uint8_t,32>& bytes)
+{
+    return FromLE(bytes.data());
+}
+
+void ArithUint256::ToLE(uint8_t out[32]) const
+{
+    for (int i = 0; i < 4; ++i)
+        WriteLE64(out + 8 * i, limbs[i]);
+}
+
+std::array<uint8_t,32> ArithUint256::ToLE() const
+{
+    std::array<uint8_t,32> out;
+    ToLE(out.data());
+    return out;
+}
+
+bool ArithUint256::SetCompact(uint32_t bits)
+{
+    std::array<uint8_t,32> target;
+    if (!BlockHeader::DecodeTarget(bits, target))
+    {
+        *this = ArithUint256();
+        return false;
+    }
+    *this = FromLE(target);
+    return true;
+}
+
+ArithUint256 ArithUint256::GetBlockProof(uint32_t bits)
+{
+    // Headers of one chain share a handful of targets; remember the
+    // last one rather than divide for every header
+    static std::mutex cacheMutex;
+    static uint32_t cachedBits = 0;
+    static ArithUint256 cachedProof;
+
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        if (bits == cachedBits && bits != 0)
+            return cachedProof;
+    }
+
+    ArithUint256 target;
+    if (!target.SetCompact(bits))
+        return ArithUint256();
+
+    // 2^256 does not fit; 2^256 / (t + 1) = (~t / (t + 1)) + 1
+    ArithUint256 one(1);
+    ArithUint256 proof = (~target / (target + one)) + one;
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    cachedBits = bits;
+    cachedProof = proof;
+    return proof;
+}
+
+unsigned ArithUint256::Bits() const
+{
+    for (int i = 3; i >= 0; --i)
+        if (limbs[i])
+            return 64 * i + (64 - __builtin_clzll(limbs[i]));
+    return 0;
+}
+
+double ArithUint256::GetDouble() const
+{
+    double r = 0.0;
+    for (int i = 3; i >= 0; --i)
+        r = r * 18446744073709551616.0 + (double)limbs[i];
+    return r;
+}
+
+std::string ArithUint256::ToHex() const
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string s(64, '0');
+    for (int i = 0; i < 64; ++i)
+    {
+        const uint64_t limb = limbs[3 - i / 16];
+        s[i] = digits[(limb >> (60 - 4 * (i % 16))) & 0xF];
+    }
+    return s;
+}
+
+ArithUint256 ArithUint256::operator~() const
+{
+    ArithUint256 r;
+    for (int i = 0; i < 4; ++i)
+        r.limbs[i] = ~limbs[i];
+    return r;
+}
+
+ArithUint256& ArithUint256::operator+=(const ArithUint256& b)
+{
+    unsigned __int128 carry = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        carry += (unsigned __int128)limbs[i] + b.limbs[i];
+        limbs[i] = (uint64_t)carry;
+        carry >>= 64;
+    }
+    return *this;
+}
+
+ArithUint256& ArithUint256::operator-=(const ArithUint256& b)
+{
+    uint64_t borrow = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        const uint64_t d = limbs[i] - b.limbs[i];
+        const uint64_t next = (limbs[i] < b.limbs[i]) | (d < borrow);
+        limbs[i] = d - borrow;
+        borrow = next;
+    }
+    return *this;
+}
+
+ArithUint256& ArithUint256::operator<<=(unsigned shift)
+{
+    if (shift >= 256)
+        return *this = ArithUint256();
+
+    const unsigned words = shift / 64, bits = shift % 64;
+    for (int i = 3; i >= 0; --i)
+    {
+        uint64_t v = 0;
+        if (i - (int)words >= 0)
+        {
+            v = limbs[i - words] << bits;
+            if (bits && i - (int)words - 1 >= 0)
+                v |= limbs[i - words - 1] >> (64 - bits);
+        }
+        limbs[i] = v;
+    }
+    return *this;
+}
+
+ArithUint256& ArithUint256::operator>>=(unsigned shift)
+{
+    if (shift >= 256)
+        return *this = ArithUint256();
+
+    const unsigned words = shift / 64, bits = shift % 64;
+    for (int i = 0; i < 4; ++i)
+    {
+        uint64_t v = 0;
+        if (i + words < 4)
+        {
+            v = limbs[i + words] >> bits;
+            if (bits && i + words + 1 < 4)
+                v |= limbs[i + words + 1] << (64 - bits);
+        }
+        limbs[i] = v;
+    }
+    return *this;
+}
+
+ArithUint256& ArithUint256::operator/=(const ArithUint256& divisor)
+{
+    if (divisor.IsZero())
+        return *this = ArithUint256();
+
+    // Shift-and-subtract long division
+    const unsigned numBits = Bits(), divBits = divisor.Bits();
+    ArithUint256 num = *this, div = divisor, quotient;
+    if (divBits > numBits)
+        return *this = ArithUint256();
+
+    int shift = (int)(numBits - divBits);
+    div <<= shift;
+    while (shift >= 0)
+    {
+        if (num >= div)
+        {
+            num -= div;
+            quotient.limbs[shift / 64] |= 1ULL << (shift % 64);
+        }
+        div >>= 1;
+        shift--;
+    }
+    return *this = quotient;
+}
+
+int ArithUint256::CompareTo(const ArithUint256& b) const
+{
+    for (int i = 3; i >= 0; --i)
+    {
+        if (limbs[i] < b.limbs[i]) return -1;
+        if (limbs[i] > b.limbs[i]) return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,79 @@
+#ifndef DRACHMA_CHAIN_ARITH256_H
+#define DRACHMA_CHAIN_ARITH256_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+//
+// ===============================================================
+//  CLASS: ArithUint256
+// ===============================================================
+//
+//  Unsigned 256-bit integer in four little-endian 64-bit limbs,
+//  wrapping modulo 2^256. Just what targets and chainwork need:
+//  add, subtract, compare, shift, complement and divide.
+//
+//  Byte conversions use the little-endian order of hashes and
+//  BlockHeader::DecodeTarget().
+//
+// ===============================================================
+//
+class ArithUint256
+{
+public:
+    ArithUint256() { limbs[0] = limbs[1] = limbs[2] = limbs[3] = 0; }
+    explicit ArithUint256(uint64_t v) { limbs[0] = v; limbs[1] = limbs[2] = limbs[3] = 0; }
+
+    static ArithUint256 FromLE(const std::array<uint8_t,32>& bytes);
+    static ArithUint256 FromLE(const uint8_t bytes[32]);
+    void ToLE(uint8_t out[32]) const;
+    std::array<uint8_t,32> ToLE() const;
+
+    // Expanded compact "nBits"; false for encodings DecodeTarget()
+    // rejects
+    bool SetCompact(uint32_t bits);
+
+    // Work represented by a target: 2^256 / (target + 1), i.e. the
+    // expected number of hashes to meet it. Zero for invalid bits.
+    static ArithUint256 GetBlockProof(uint32_t bits);
+
+    bool IsZero() const { return (limbs[0] | limbs[1] | limbs[2] | limbs[3]) == 0; }
+    uint64_t Low64() const { return limbs[0]; }
+
+    // Index of the highest set bit plus one (0 for zero)
+    unsigned Bits() const;
+
+    // Approximate value (for logs and work-rate arithmetic)
+    double GetDouble() const;
+
+    std::string ToHex() const;
+
+    ArithUint256 operator~() const;
+
+    ArithUint256& operator+=(const ArithUint256& b);
+    ArithUint256& operator-=(const ArithUint256& b);
+    ArithUint256& operator<<=(unsigned shift);
+    ArithUint256& operator>>=(unsigned shift);
+    ArithUint256& operator/=(const ArithUint256& divisor);   // x / 0 = 0
+
+    friend ArithUint256 operator+(ArithUint256 a, const ArithUint256& b) { return a += b; }
+    friend ArithUint256 operator-(ArithUint256 a, const ArithUint256& b) { return a -= b; }
+    friend ArithUint256 operator/(ArithUint256 a, const ArithUint256& b) { return a /= b; }
+    friend ArithUint256 operator<<(ArithUint256 a, unsigned s) { return a <<= s; }
+    friend ArithUint256 operator>>(ArithUint256 a, unsigned s) { return a >>= s; }
+
+    int CompareTo(const ArithUint256& b) const;
+
+    friend bool operator==(const ArithUint256& a, const ArithUint256& b) { return a.CompareTo(b) == 0; }
+    friend bool operator!=(const ArithUint256& a, const ArithUint256& b) { return a.CompareTo(b) != 0; }
+    friend bool operator<(const ArithUint256& a, const ArithUint256& b) { return a.CompareTo(b) < 0; }
+    friend bool operator>(const ArithUint256& a, const ArithUint256& b) { return a.CompareTo(b) > 0; }
+    friend bool operator<=(const ArithUint256& a, const ArithUint256& b) { return a.CompareTo(b) <= 0; }
+    friend bool operator>=(const ArithUint256& a, const ArithUint256& b) { return a.CompareTo(b) >= 0; }
+
+private:
+    uint64_t limbs[4];
+};
+
+#endif // DRACHMA_CHAIN_ARITH256_H
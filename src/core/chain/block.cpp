@@ -0,0 +1,243 @@
+#include "block.h"
+#include "../crypto/hash.h"
+
+#include <cstring>
+
+//
+// ================================================================
+//  BlockHeader
+// ================================================================
+BlockHeader::BlockHeader()
+{
+    version = 0;
+    prevHash.fill(0);
+    merkleRoot.fill(0);
+    time = 0;
+    bits = 0;
+    nonce = 0;
+}
+
+void BlockHeader::Serialize(uint8_t out[SIZE]) const
+{
+    WriteLE32(out, (uint32_t)version);
+    std::memcpy(out + 4, prevHash.data(), 32);
+    std::memcpy(out + 36, merkleRoot.data(), 32);
+    WriteLE32(out + 68, time);
+    WriteLE32(out + 72, bits);
+    WriteLE32(out + 76, nonce);
+}
+
+void BlockHeader::Serialize(std::vector<uint8_t>& out) const
+{
+    size_t n = out.size();
+    out.resize(n + SIZE);
+    Serialize(&out[n]);
+}
+
+bool BlockHeader::Deserialize(const uint8_t data[SIZE])
+{
+    version = (int32_t)ReadLE32(data);
+    std::memcpy(prevHash.data(), data + 4, 32);
+    std::memcpy(merkleRoot.data(), data + 36, 32);
+    time = ReadLE32(data + 68);
+    bits = ReadLE32(data + 72);
+    nonce = ReadLE32(data + 76);
+    return true;
+}
+
+bool BlockHeader::Deserialize(SpanReader& in)
+{
+    if (in.Remaining() < SIZE)
+        return false;
+
+    Deserialize(in.Cursor());
+    return in.Skip(SIZE);
+}
+
+std::array<uint8_t,32> BlockHeader::GetHash() const
+{
+    uint8_t buf[SIZE];
+    Serialize(buf);
+
+    std::array<uint8_t,32> out;
+    Hash::SHA256D(buf, SIZE, out.data());
+    return out;
+}
+
+bool BlockHeader::IsGenesis() const
+{
+    for (uint8_t b : prevHash)
+        if (b != 0) return false;
+    return true;
+}
+
+bool BlockHeader::DecodeTarget(uint32_t compact, std::array<uint8_t,32>& target)
+{
+    target.fill(0);
+
+    int exponent = compact >> 24;
+    uint32_t mantissa = compact & 0x007FFFFF;
+
+    // Sign bit set on a non-zero mantissa: negative target
+    if ((compact & 0x00800000) && mantissa != 0)
+        return false;
+
+    if (mantissa == 0)
+        return false;
+
+    if (exponent <= 3)
+    {
+        mantissa >>= 8 * (3 - exponent);
+        target[0] = mantissa & 0xFF;
+        target[1] = (mantissa >> 8) & 0xFF;
+        target[2] = (mantissa >> 16) & 0xFF;
+        return mantissa != 0;
+    }
+
+    // target = mantissa * 256^(exponent - 3)
+    for (int i = 0; i < 3; ++i)
+    {
+        uint8_t b = (mantissa >> (8 * i)) & 0xFF;
+        int pos = exponent - 3 + i;
+
+        if (pos >= 32)
+        {
+            if (b != 0)
+                return false;   // overflow
+            continue;
+        }
+        target[pos] = b;
+    }
+
+    return true;
+}
+
+bool BlockHeader::CheckProofOfWork(const std::array<uint8_t,32>& hash, uint32_t compact)
+{
+    std::array<uint8_t,32> target;
+    if (!DecodeTarget(compact, target))
+        return false;
+
+    // Both little-endian 256-bit numbers: compare from the top byte
+    for (int i = 31; i >= 0; --i)
+    {
+        if (hash[i] < target[i]) return true;
+        if (hash[i] > target[i]) return false;
+    }
+    return true;
+}
+
+bool BlockHeader::CheckProofOfWork() const
+{
+    return CheckProofOfWork(GetHash(), bits);
+}
+
+//
+// ================================================================
+//  Block
+// ================================================================
+bool Block::Deserialize(ByteSpan data)
+{
+    SpanReader in(data);
+    vtx.clear();
+
+    if (!header.Deserialize(in))
+        return false;
+
+    uint64_t count;
+    if (!in.ReadCompactSize(count) || count == 0 || count > in.Remaining() / 60)
+        return false;
+
+    vtx.resize((size_t)count);
+    for (Transaction& tx : vtx)
+        if (!tx.Deserialize(in))
+            return false;
+
+    return in.Empty();
+}
+
+void Block::Serialize(std::vector<uint8_t>& out) const
+{
+    header.Serialize(out);
+    AppendCompactSize(out, vtx.size());
+    for (const Transaction& tx : vtx)
+        tx.Serialize(out, true);
+}
+
+std::array<uint8_t,32> Block::ComputeMerkleRoot(bool* mutated) const
+{
+    std::vector<std::array<uint8_t,32>> leaves;
+    leaves.reserve(vtx.size());
+
+    for (const Transaction& tx : vtx)
+        leaves.push_back(tx.GetTxid());
+
+    return ::ComputeMerkleRoot(std::move(leaves), mutated);
+}
+
+bool BlockView::Parse(ByteSpan data)
+{
+    SpanReader in(data);
+    vtx.clear();
+
+    if (!header.Deserialize(in))
+        return false;
+
+    uint64_t count;
+    if (!in.ReadCompactSize(count) || count == 0 || count > in.Remaining() / 60)
+        return false;
+
+    vtx.resize((size_t)count);
+    for (TransactionView& tx : vtx)
+        if (!tx.Parse(in))
+            return false;
+
+    return in.Empty();
+}
+
+std::array<uint8_t,32> BlockView::ComputeMerkleRoot(bool* mutated) const
+{
+    std::vector<std::array<uint8_t,32>> leaves;
+    leaves.reserve(vtx.size());
+
+    for (const TransactionView& tx : vtx)
+        leaves.push_back(tx.GetTxid());
+
+    return ::ComputeMerkleRoot(std::move(leaves), mutated);
+}
+
+std::array<uint8_t,32> ComputeMerkleRoot(std::vector<std::array<uint8_t,32>> level, bool* mutated)
+{
+    bool mut = false;
+
+    std::array<uint8_t,32> root;
+    root.fill(0);
+
+    if (level.empty())
+    {
+        if (mutated) *mutated = false;
+        return root;
+    }
+
+    uint8_t pair[64];
+    while (level.size() > 1)
+    {
+        for (size_t i = 0; i + 1 < level.size(); i += 2)
+            if (level[i] == level[i + 1])
+                mut = true;
+
+        if (level.size() & 1)
+            level.push_back(level.back());
+
+        for (size_t i = 0; i < level.size() / 2; ++i)
+        {
+            std::memcpy(pair, level[2 * i].data(), 32);
+            std::memcpy(pair + 32, level[2 * i + 1].data(), 32);
+            Hash::SHA256D(pair, 64, level[i].data());
+        }
+        level.resize(level.size() / 2);
+    }
+
+    if (mutated) *mutated = mut;
+    return level[0];
+}
@@ -0,0 +1,100 @@
+#ifndef DRACHMA_CHAIN_BLOCK_H
+#define DRACHMA_CHAIN_BLOCK_H
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "../tx/transaction.h"
+#include "../tx/txview.h"
+#include "../../common/utils/serialize.h"
+
+//
+// ===============================================================
+//  CLASS: BlockHeader (80 bytes, Bitcoin layout)
+// ===============================================================
+//
+//    version | prevHash | merkleRoot | time | bits | nonce
+//
+//  Hashes are kept in internal byte order; the block hash is
+//  SHA256D of the 80 serialized bytes.
+//
+// ===============================================================
+//
+class BlockHeader
+{
+public:
+    static constexpr size_t SIZE = 80;
+
+    int32_t version;
+    std::array<uint8_t,32> prevHash;
+    std::array<uint8_t,32> merkleRoot;
+    uint32_t time;
+    uint32_t bits;
+    uint32_t nonce;
+
+    BlockHeader();
+
+    void Serialize(uint8_t out[SIZE]) const;
+    void Serialize(std::vector<uint8_t>& out) const;
+    bool Deserialize(SpanReader& in);
+    bool Deserialize(const uint8_t data[SIZE]);
+
+    std::array<uint8_t,32> GetHash() const;
+
+    bool IsGenesis() const;
+
+    // hash <= target(bits)
+    bool CheckProofOfWork() const;
+    static bool CheckProofOfWork(const std::array<uint8_t,32>& hash, uint32_t bits);
+
+    // Expand compact "nBits" into a 256-bit little-endian target.
+    // Fails for negative or overflowing encodings.
+    static bool DecodeTarget(uint32_t bits, std::array<uint8_t,32>& target);
+};
+
+//
+// ===============================================================
+//  CLASS: Block
+// ===============================================================
+//
+class Block
+{
+public:
+    BlockHeader header;
+    std::vector<Transaction> vtx;
+
+    bool Deserialize(ByteSpan data);
+    void Serialize(std::vector<uint8_t>& out) const;
+
+    // Merkle root over the txids. *mutated is set when two identical
+    // siblings were hashed (CVE-2012-2459 style malleation).
+    std::array<uint8_t,32> ComputeMerkleRoot(bool* mutated = nullptr) const;
+};
+
+//
+// ===============================================================
+//  CLASS: BlockView
+// ===============================================================
+//
+//  Zero-copy counterpart of Block: transactions are parsed in
+//  place as TransactionViews over the source buffer, which must
+//  outlive the view.
+//
+class BlockView
+{
+public:
+    BlockHeader header;
+    std::vector<TransactionView> vtx;
+
+    bool Parse(ByteSpan data);
+
+    // Same as Block::ComputeMerkleRoot(); caches the txids
+    std::array<uint8_t,32> ComputeMerkleRoot(bool* mutated = nullptr) const;
+};
+
+// Bitcoin merkle tree: odd levels duplicate their last entry
+std::array<uint8_t,32> ComputeMerkleRoot(std::vector<std::array<uint8_t,32>> leaves,
+                                         bool* mutated = nullptr);
+
+#endif // DRACHMA_CHAIN_BLOCK_H
@@ -0,0 +1,284 @@
+#include "chainstate.h"
+#include "../storage/blockfilter.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+static bool SetReason(std::string* reason, const std::string& text)
+{
+    if (reason)
+        *reason = text;
+    return false;
+}
+
+// OP_RETURN outputs never enter the UTXO set
+static bool IsUnspendable(const TxOutView& out)
+{
+    return !out.script.empty() && out.script[0] == 0x6a;
+}
+
+ChainState::ChainState(HeaderIndex& h, BlockStore& b, BlockStore& u, UTXOStore& c,
+                       BlockValidator& v)
+    : headers(h), blocks(b), undoStore(u), utxo(c), validator(v)
+{
+    filters = nullptr;
+    tip = HeaderIndex::NONE;
+    std::memset(&stats, 0, sizeof(stats));
+}
+
+bool ChainState::Load(std::string* reason)
+{
+    const std::array<uint8_t,32> best = utxo.GetBestBlock();
+
+    bool empty = true;
+    for (uint8_t b : best)
+        if (b != 0) empty = false;
+
+    if (empty)
+    {
+        tip = HeaderIndex::NONE;
+        return true;
+    }
+
+    tip = headers.Find(best);
+    if (tip == HeaderIndex::NONE)
+        return SetReason(reason, "UTXO best block not in header index");
+    return true;
+}
+
+//
+// ================================================================
+//  Block application
+// ================================================================
+//
+// Undo the transactions of `block`, last first; undo.txs[i - 1]
+// belongs to transaction i. Outputs spent within the block come
+// back with their spender's inputs and go again with their own
+// transaction's outputs.
+static void DisconnectTxs(UTXOStore& utxo, const BlockView& block, const BlockUndo& undo,
+                          uint64_t& unclean)
+{
+    for (size_t i = block.vtx.size(); i-- > 0;)
+    {
+        const TransactionView& tx = block.vtx[i];
+
+        for (uint32_t k = 0; k < tx.Outputs().size(); ++k)
+        {
+            if (IsUnspendable(tx.Outputs()[k]))
+                continue;
+            if (!utxo.SpendCoin(OutPoint(tx.GetTxid(), k)))
+                unclean++;
+        }
+
+        if (i == 0)
+            continue;
+
+        const std::vector<Coin>& coins = undo.txs[i - 1].spent;
+        for (size_t j = coins.size(); j-- > 0;)
+        {
+            const OutPoint prevout = tx.Inputs()[j].GetPrevout();
+
+            // Only there if the set disagrees with the undo data
+            const bool overwrite = utxo.HaveCoin(prevout);
+            if (overwrite)
+                unclean++;
+
+            utxo.AddCoin(prevout, coins[j], overwrite);
+        }
+    }
+}
+
+bool ChainState::DisconnectBlock(const BlockView& block, const BlockUndo& undo, std::string* reason)
+{
+    if (undo.txs.size() + 1 != block.vtx.size())
+        return SetReason(reason, "undo data does not match block");
+
+    for (size_t i = 1; i < block.vtx.size(); ++i)
+        if (undo.txs[i - 1].spent.size() != block.vtx[i].Inputs().size())
+            return SetReason(reason, "undo data does not match block");
+
+    DisconnectTxs(utxo, block, undo, stats.uncleanDisconnects);
+    return true;
+}
+
+bool ChainState::ReadBlock(HeaderIndex::Pos pos, BlockView& block, std::string* reason) const
+{
+    const HeaderIndex::Hash256& hash = headers.GetBlockHash(pos);
+
+    ByteSpan data;
+    if (!blocks.ReadBlock(hash, data))
+        return SetReason(reason, "block not stored");
+
+    if (!block.Parse(data) || block.vtx.empty())
+        return SetReason(reason, "block does not parse");
+
+    if (block.header.GetHash() != hash)
+        return SetReason(reason, "stored block has a different hash");
+
+    bool mutated = false;
+    if (block.ComputeMerkleRoot(&mutated) != block.header.merkleRoot || mutated)
+        return SetReason(reason, "bad merkle root");
+
+    // Malleated witness data fails here too, so it never gets to
+    // the validator and rules out a block whose header is fine
+    if (!CheckWitnessCommitment(block, reason))
+        return false;
+
+    return true;
+}
+
+//
+// ================================================================
+//  Tip movement
+// ================================================================
+bool ChainState::ConnectTip(HeaderIndex::Pos pos, std::string* reason, bool* invalid)
+{
+    if (invalid)
+        *invalid = false;
+
+    if (headers.GetParent(pos) != tip)
+        return SetReason(reason, "block does not extend the tip");
+
+    BlockView block;
+    if (!ReadBlock(pos, block, reason))
+        return false;
+
+    const HeaderIndex::Pos parent = headers.GetParent(pos);
+
+    BlockContext ctx;
+    ctx.height = (uint32_t)headers.GetHeight(pos);
+    ctx.medianTimePast = headers.GetMedianTimePast(parent);
+    ctx.medianTimeAt = [this, parent](uint32_t height) {
+        return headers.GetMedianTimePast(headers.GetAncestor(parent, (int)height));
+    };
+
+    BlockUndo undo;
+    if (!validator.ConnectBlock(block, ctx, utxo, undo, reason))
+    {
+        if (invalid)
+            *invalid = true;
+        return false;
+    }
+
+    // Reconnecting a block disconnected earlier finds its undo
+    // record already there
+    const HeaderIndex::Hash256& hash = headers.GetBlockHash(pos);
+    if (!undoStore.HaveBlock(hash))
+    {
+        std::vector<uint8_t> raw;
+        undo.Serialize(raw);
+
+        if (!undoStore.WriteBlock(hash, raw.data(), raw.size()))
+        {
+            DisconnectBlock(block, undo, nullptr);
+            return SetReason(reason, "undo data write failed");
+        }
+        stats.undoBytes += raw.size();
+    }
+
+    if (filters && !filters->AddBlock(hash, block, undo))
+        stats.filterErrors++;
+
+    headers.SetHaveData(pos);
+    tip = pos;
+    stats.blocksConnected++;
+    return true;
+}
+
+bool ChainState::DisconnectTip(std::string* reason)
+{
+    if (tip == HeaderIndex::NONE)
+        return SetReason(reason, "no tip to disconnect");
+
+    BlockView block;
+    if (!ReadBlock(tip, block, reason))
+        return false;
+
+    ByteSpan data;
+    BlockUndo undo;
+    if (!undoStore.ReadBlock(headers.GetBlockHash(tip), data) || !undo.Deserialize(data))
+        return SetReason(reason, "undo data missing or corrupt");
+
+    if (!DisconnectBlock(block, undo, reason))
+        return false;
+
+    tip = headers.GetParent(tip);
+    stats.blocksDisconnected++;
+    return true;
+}
+
+bool ChainState::ActivateChain(HeaderIndex::Pos target, std::string* reason)
+{
+    if (target == HeaderIndex::NONE || target == tip)
+        return true;
+
+    const HeaderIndex::Pos fork = tip == HeaderIndex::NONE ? HeaderIndex::NONE
+                                                           : headers.LastCommonAncestor(tip, target);
+
+    // Blocks to leave, tip first, and to enter, fork side first
+    std::vector<HeaderIndex::Pos> leave, enter;
+    for (HeaderIndex::Pos p = tip; p != fork; p = headers.GetParent(p))
+        leave.push_back(p);
+    for (HeaderIndex::Pos p = target; p != fork; p = headers.GetParent(p))
+        enter.push_back(p);
+    std::reverse(enter.begin(), enter.end());
+
+    for (size_t i = 0; i < leave.size(); ++i)
+        if (!DisconnectTip(reason))
+            return false;
+
+    if (!leave.empty())
+    {
+        stats.reorgs++;
+        stats.deepestReorg = std::max(stats.deepestReorg, (uint32_t)leave.size());
+    }
+
+    for (HeaderIndex::Pos pos : enter)
+    {
+        std::string why;
+        bool invalid = false;
+        if (ConnectTip(pos, &why, &invalid))
+            continue;
+
+        // Go back to where we were; only a consensus failure rules
+        // the branch out for good
+        if (invalid)
+            headers.MarkFailed(pos);
+        SetReason(reason, why);
+
+        while (tip != fork)
+            if (!DisconnectTip(nullptr))
+                return false;
+        for (size_t i = leave.size(); i-- > 0;)
+            if (!ConnectTip(leave[i], nullptr))
+                return false;
+        return false;
+    }
+
+    if (utxo.NeedsFlush() && !Flush())
+        return SetReason(reason, "UTXO flush failed");
+
+    return true;
+}
+
+bool ChainState::Flush()
+{
+    // Undo data has to be durable before a UTXO set that needs it
+    if (!blocks.Sync() || !undoStore.Sync())
+        return false;
+
+    if (filters && !filters->Sync())
+        stats.filterErrors++;
+
+    std::array<uint8_t,32> best;
+    best.fill(0);
+    if (tip != HeaderIndex::NONE)
+        best = headers.GetBlockHash(tip);
+
+    if (!utxo.Flush(best))
+        return false;
+
+    stats.flushes++;
+    return true;
+}
@@ -0,0 +1,118 @@
+#ifndef DRACHMA_CHAIN_CHAINSTATE_H
+#define DRACHMA_CHAIN_CHAINSTATE_H
+
+#include <cstdint>
+#include <string>
+
+#include "headerindex.h"
+#include "undo.h"
+#include "../consensus/blockvalidator.h"
+#include "../storage/blockstore.h"
+#include "../storage/utxostore.h"
+
+class BlockFilterIndex;
+
+//
+// ===============================================================
+//  CLASS: ChainState
+// ===============================================================
+//
+//  The active chain: which header the UTXO set is at, and moving
+//  it to another one, reorganizations included.
+//
+//  Connecting a block goes through the BlockValidator, which
+//  checks it and applies it to the UTXOStore cache; the coins it
+//  spent are written as a BlockUndo to the undo store (a
+//  BlockStore with prefix "rev", next to the blocks).
+//  Disconnecting one reads that record back: its outputs are spent
+//  and the coins restored, with no replay from an older state.
+//  With a BlockFilterIndex attached every connected block is also
+//  indexed from the same BlockUndo. The index never stops the
+//  chain: a block it cannot take (e.g. its parent is not indexed
+//  because the index is behind) is counted in `filterErrors`, and
+//  BlockFilterIndex::Build() closes such gaps.
+//
+//  ActivateChain() walks from the tip to the fork point with the
+//  target and up its branch, every step in the cache. Nothing is
+//  flushed per block: the UTXO set is only written (after syncing
+//  blocks and undo data) once the cache outgrows its limit or the
+//  caller asks for it with Flush(), so a 100-block reorg costs one
+//  flush at most. Until then the disk holds an older, consistent
+//  tip. Filters are synced with the undo data.
+//
+//  When a block fails to connect the old chain is restored. Only
+//  a block that breaks a consensus rule is marked failed in the
+//  header index (with its descendants); one that is not stored
+//  yet or cannot be read, whose transactions or witness data do
+//  not match its header's commitments, or a disk error, leaves the
+//  branch eligible for a later attempt.
+//
+//  Not thread-safe.
+//
+// ===============================================================
+//
+class ChainState
+{
+public:
+    struct Stats
+    {
+        uint64_t blocksConnected;
+        uint64_t blocksDisconnected;
+        uint64_t reorgs;                // activations that disconnected
+        uint32_t deepestReorg;          // blocks disconnected
+        uint64_t undoBytes;             // undo records written
+        uint64_t uncleanDisconnects;    // UTXO set disagreed with undo data
+        uint64_t flushes;
+        uint64_t filterErrors;          // blocks the filter index did not take
+    };
+
+    ChainState(HeaderIndex& headers, BlockStore& blocks, BlockStore& undo, UTXOStore& utxo,
+               BlockValidator& validator);
+
+    ChainState(const ChainState&) = delete;
+    ChainState& operator=(const ChainState&) = delete;
+
+    // Picks up the UTXO store's best block as the tip; it must be
+    // in the header index (or the store empty)
+    bool Load(std::string* reason = nullptr);
+
+    // Index connected blocks (null: stop); the index must be open
+    void SetFilterIndex(BlockFilterIndex* index) { filters = index; }
+
+    // NONE while not even genesis is connected
+    HeaderIndex::Pos Tip() const { return tip; }
+
+    // Make `target` the tip. Its blocks must be in the block store.
+    bool ActivateChain(HeaderIndex::Pos target, std::string* reason = nullptr);
+
+    // Undo the tip block (cache only)
+    bool DisconnectTip(std::string* reason = nullptr);
+
+    // Sync blocks and undo data, then flush the UTXO set at the tip
+    bool Flush();
+
+    Stats GetStats() const { return stats; }
+
+private:
+    // Connect `pos`, a child of the tip (cache only). *invalid is
+    // set when the block breaks a consensus rule, rather than being
+    // missing or unreadable or the write of its undo data failing.
+    bool ConnectTip(HeaderIndex::Pos pos, std::string* reason, bool* invalid = nullptr);
+
+    bool DisconnectBlock(const BlockView& block, const BlockUndo& undo, std::string* reason);
+
+    bool ReadBlock(HeaderIndex::Pos pos, BlockView& block, std::string* reason) const;
+
+    HeaderIndex& headers;
+    BlockStore& blocks;
+    BlockStore& undoStore;
+    UTXOStore& utxo;
+    BlockValidator& validator;
+    BlockFilterIndex* filters;
+
+    HeaderIndex::Pos tip;
+
+    Stats stats;
+};
+
+#endif // DRACHMA_CHAIN_CHAINSTATE_H
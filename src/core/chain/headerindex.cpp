@@ -0,0 +1,322 @@
+#include "headerindex.h"
+#include "../crypto/sha256.h"
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+
+//
+// Skip heights (Bitcoin Core): clear the lowest set bit, twice for
+// odd heights, so that a walk alternates long and short jumps
+//
+static inline int InvertLowestOne(int n)
+{
+    return n & (n - 1);
+}
+
+static inline int GetSkipHeight(int height)
+{
+    if (height < 2)
+        return 0;
+    return (height & 1) ? InvertLowestOne(InvertLowestOne(height - 1)) + 1
+                        : InvertLowestOne(height);
+}
+
+static void SetReason(std::string* reason, const char* text)
+{
+    if (reason)
+        *reason = text;
+}
+
+HeaderIndex::HeaderIndex()
+{
+    std::random_device rd;
+    tableSalt = ((uint64_t)rd() << 32) | rd();
+    table.assign(1024, NONE);
+    bestHeader = NONE;
+}
+
+size_t HeaderIndex::Slot(const Hash256& hash) const
+{
+    // The low bytes of a block hash are the random ones (the high
+    // ones are zeros from proof of work)
+    const uint64_t key = (ReadLE64(hash.data()) ^ tableSalt) * 0x9E3779B97F4A7C15ULL;
+    const size_t mask = table.size() - 1;
+
+    size_t i = (size_t)(key >> 32) & mask;
+    while (table[i] != NONE && hashes[table[i]] != hash)
+        i = (i + 1) & mask;
+    return i;
+}
+
+HeaderIndex::Pos HeaderIndex::Find(const Hash256& hash) const
+{
+    return table[Slot(hash)];
+}
+
+void HeaderIndex::Reserve(size_t headers)
+{
+    hashes.reserve(headers);
+    merkleRoots.reserve(headers);
+    versions.reserve(headers);
+    times.reserve(headers);
+    bitsColumn.reserve(headers);
+    nonces.reserve(headers);
+    links.reserve(headers);
+    heights.reserve(headers);
+    status.reserve(headers);
+    chainWork.reserve(headers);
+
+    size_t slots = table.size();
+    while (headers * 2 > slots)
+        slots *= 2;
+    if (slots != table.size())
+        Rehash(slots);
+}
+
+void HeaderIndex::Rehash(size_t slotCount)
+{
+    table.assign(slotCount, NONE);
+    for (Pos pos = 0; pos < (Pos)hashes.size(); ++pos)
+        table[Slot(hashes[pos])] = pos;
+}
+
+void HeaderIndex::Insert(Pos pos)
+{
+    if (hashes.size() * 2 > table.size())
+        Rehash(table.size() * 2);
+    table[Slot(hashes[pos])] = pos;
+}
+
+bool HeaderIndex::AddHeaders(const BlockHeader* headers, size_t count,
+                             std::string* reason, Pos* last)
+{
+    if (last)
+        *last = NONE;
+
+    // Hash the whole batch up front
+    std::vector<uint8_t> raw(count * BlockHeader::SIZE);
+    for (size_t i = 0; i < count; ++i)
+        headers[i].Serialize(&raw[i * BlockHeader::SIZE]);
+
+    std::vector<Hash256> batch(count);
+    SHA256D80(batch.empty() ? nullptr : batch[0].data(), raw.data(), count);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const BlockHeader& header = headers[i];
+        const Hash256& hash = batch[i];
+
+        Pos known = Find(hash);
+        if (known != NONE)
+        {
+            if (last)
+                *last = known;
+            continue;
+        }
+
+        Pos parent = NONE;
+        if (header.IsGenesis())
+        {
+            if (!hashes.empty())
+            {
+                SetReason(reason, "bad-genesis");
+                return false;
+            }
+        }
+        else
+        {
+            parent = Find(header.prevHash);
+            if (parent == NONE)
+            {
+                SetReason(reason, "prev-blk-not-found");
+                return false;
+            }
+            if (status[parent] & (STATUS_FAILED | STATUS_FAILED_PARENT))
+            {
+                SetReason(reason, "bad-prevblk");
+                return false;
+            }
+        }
+
+        if (!BlockHeader::CheckProofOfWork(hash, header.bits))
+        {
+            SetReason(reason, "high-hash");
+            return false;
+        }
+
+        if (hashes.size() >= NONE)
+        {
+            SetReason(reason, "index-full");
+            return false;
+        }
+
+        const Pos pos = (Pos)hashes.size();
+        const int height = parent == NONE ? 0 : heights[parent] + 1;
+
+        ArithUint256 work = ArithUint256::GetBlockProof(header.bits);
+        if (parent != NONE)
+            work += chainWork[parent];
+
+        hashes.push_back(hash);
+        merkleRoots.push_back(header.merkleRoot);
+        versions.push_back(header.version);
+        times.push_back(header.time);
+        bitsColumn.push_back(header.bits);
+        nonces.push_back(header.nonce);
+        heights.push_back(height);
+        status.push_back(0);
+        chainWork.push_back(work);
+
+        Links link;
+        link.parent = parent;
+        link.skip = parent == NONE ? NONE : GetAncestor(parent, GetSkipHeight(height));
+        links.push_back(link);
+
+        Insert(pos);
+
+        if (bestHeader == NONE || work > chainWork[bestHeader])
+            bestHeader = pos;
+
+        if (last)
+            *last = pos;
+    }
+
+    return true;
+}
+
+BlockHeader HeaderIndex::GetHeader(Pos pos) const
+{
+    BlockHeader header;
+    header.version = versions[pos];
+    if (links[pos].parent != NONE)
+        header.prevHash = hashes[links[pos].parent];
+    header.merkleRoot = merkleRoots[pos];
+    header.time = times[pos];
+    header.bits = bitsColumn[pos];
+    header.nonce = nonces[pos];
+    return header;
+}
+
+void HeaderIndex::MarkFailed(Pos pos)
+{
+    status[pos] |= STATUS_FAILED;
+
+    // Children come after their parents: one pass spreads the flag
+    for (Pos i = pos + 1; i < (Pos)status.size(); ++i)
+        if (status[links[i].parent] & (STATUS_FAILED | STATUS_FAILED_PARENT))
+            status[i] |= STATUS_FAILED_PARENT;
+
+    if (bestHeader == NONE || !(status[bestHeader] & (STATUS_FAILED | STATUS_FAILED_PARENT)))
+        return;
+
+    bestHeader = NONE;
+    for (Pos i = 0; i < (Pos)status.size(); ++i)
+    {
+        if (status[i] & (STATUS_FAILED | STATUS_FAILED_PARENT))
+            continue;
+        if (bestHeader == NONE || chainWork[i] > chainWork[bestHeader])
+            bestHeader = i;
+    }
+}
+
+HeaderIndex::Pos HeaderIndex::GetAncestor(Pos pos, int height) const
+{
+    if (pos == NONE || height < 0 || height > heights[pos])
+        return NONE;
+
+    int walkHeight = heights[pos];
+    while (walkHeight > height)
+    {
+        // Take the skip unless it overshoots, or unless the parent's
+        // skip would land closer for a shorter one
+        const int skipHeight = GetSkipHeight(walkHeight);
+        const int skipHeightPrev = GetSkipHeight(walkHeight - 1);
+
+        const Links& link = links[pos];
+        if (link.skip != NONE &&
+            (skipHeight == height ||
+             (skipHeight > height && !(skipHeightPrev < skipHeight - 2 && skipHeightPrev >= height))))
+        {
+            pos = link.skip;
+            walkHeight = skipHeight;
+        }
+        else
+        {
+            pos = link.parent;
+            walkHeight--;
+        }
+    }
+    return pos;
+}
+
+int64_t HeaderIndex::GetMedianTimePast(Pos pos) const
+{
+    uint32_t window[11];
+    size_t n = 0;
+
+    for (; pos != NONE && n < 11; pos = links[pos].parent)
+        window[n++] = times[pos];
+
+    if (n == 0)
+        return 0;
+
+    std::sort(window, window + n);
+    return window[n / 2];
+}
+
+HeaderIndex::Pos HeaderIndex::LastCommonAncestor(Pos a, Pos b) const
+{
+    if (a == NONE || b == NONE)
+        return NONE;
+
+    if (heights[a] > heights[b])
+        a = GetAncestor(a, heights[b]);
+    else if (heights[b] > heights[a])
+        b = GetAncestor(b, heights[a]);
+
+    while (a != b && a != NONE && b != NONE)
+    {
+        a = links[a].parent;
+        b = links[b].parent;
+    }
+    return a == b ? a : NONE;
+}
+
+std::vector<HeaderIndex::Hash256> HeaderIndex::GetLocator(Pos pos) const
+{
+    std::vector<Hash256> locator;
+    if (pos == NONE)
+        return locator;
+
+    locator.reserve(32);
+    int step = 1;
+    while (pos != NONE)
+    {
+        locator.push_back(hashes[pos]);
+
+        const int height = heights[pos];
+        if (height == 0)
+            break;
+
+        pos = GetAncestor(pos, std::max(height - step, 0));
+        if (locator.size() > 10)
+            step *= 2;
+    }
+    return locator;
+}
+
+size_t HeaderIndex::MemoryUsage() const
+{
+    return table.capacity() * sizeof(Pos) +
+           hashes.capacity() * sizeof(Hash256) +
+           merkleRoots.capacity() * sizeof(Hash256) +
+           versions.capacity() * sizeof(int32_t) +
+           times.capacity() * sizeof(uint32_t) +
+           bitsColumn.capacity() * sizeof(uint32_t) +
+           nonces.capacity() * sizeof(uint32_t) +
+           links.capacity() * sizeof(Links) +
+           heights.capacity() * sizeof(int32_t) +
+           status.capacity() * sizeof(uint8_t) +
+           chainWork.capacity() * sizeof(ArithUint256);
+}
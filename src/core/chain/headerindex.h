@@ -0,0 +1,152 @@
+#ifndef DRACHMA_CHAIN_HEADERINDEX_H
+#define DRACHMA_CHAIN_HEADERINDEX_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "arith256.h"
+#include "block.h"
+
+//
+// ===============================================================
+//  CLASS: HeaderIndex
+// ===============================================================
+//
+//  Every known block header, for header sync, locators and fork
+//  detection, laid out to stay small at millions of entries:
+//
+//    - headers are numbered in insertion order (a Pos) and stored
+//      column by column (hash, merkle root, the four header words,
+//      parent and skip links, height, status, chainwork): 125
+//      bytes each, and a walk over ancestors or heights touches
+//      only those columns
+//    - links are 32-bit positions instead of pointers; a parent
+//      always has a lower position than its children
+//    - lookups by hash go through an open-addressing table of
+//      positions
+//    - cumulative chainwork is an ArithUint256 per header
+//
+//  Each header also has a skip pointer to an ancestor at a height
+//  chosen as in Bitcoin Core (clearing low bits of its own), which
+//  makes GetAncestor() O(log n) on any branch.
+//
+//  AddHeaders() hashes its batch with SHA256D80(), eight headers
+//  at a time where AVX2 is available, and checks each header's
+//  proof of work against its own bits and that its parent is
+//  known and not failed. Contextual rules (difficulty schedule,
+//  timestamps) are the caller's.
+//
+//  Not thread-safe.
+//
+// ===============================================================
+//
+class HeaderIndex
+{
+public:
+    typedef uint32_t Pos;
+    typedef std::array<uint8_t,32> Hash256;
+
+    static constexpr Pos NONE = 0xFFFFFFFF;
+
+    enum Status : uint8_t
+    {
+        STATUS_HAVE_DATA     = 1,       // block body stored
+        STATUS_FAILED        = 2,       // block failed validation
+        STATUS_FAILED_PARENT = 4,       // descends from a failed block
+    };
+
+    HeaderIndex();
+
+    // Appends the headers in order, each one's parent being known
+    // by then (the genesis header only into an empty index); ones
+    // already known are skipped. Stops at the first invalid header,
+    // keeping those before it. `*last` is the position of the last
+    // header accepted or found, NONE if none was.
+    bool AddHeaders(const BlockHeader* headers, size_t count,
+                    std::string* reason = nullptr, Pos* last = nullptr);
+
+    Pos Find(const Hash256& hash) const;
+
+    // Room for `headers` in total, for a sync that knows roughly
+    // how many to expect
+    void Reserve(size_t headers);
+
+    size_t Size() const { return heights.size(); }
+
+    Pos Genesis() const { return heights.empty() ? NONE : 0; }
+
+    // Most chainwork among headers not failed; first seen on ties
+    Pos GetBestHeader() const { return bestHeader; }
+
+    const Hash256& GetBlockHash(Pos pos) const { return hashes[pos]; }
+    BlockHeader GetHeader(Pos pos) const;
+    Pos GetParent(Pos pos) const { return links[pos].parent; }
+    int GetHeight(Pos pos) const { return heights[pos]; }
+    uint32_t GetTime(Pos pos) const { return times[pos]; }
+    uint32_t GetBits(Pos pos) const { return bitsColumn[pos]; }
+    const ArithUint256& GetChainWork(Pos pos) const { return chainWork[pos]; }
+
+    uint8_t GetStatus(Pos pos) const { return status[pos]; }
+    void SetHaveData(Pos pos) { status[pos] |= STATUS_HAVE_DATA; }
+
+    // Marks `pos` failed and its descendants FAILED_PARENT, and
+    // moves the best header off them
+    void MarkFailed(Pos pos);
+
+    // Ancestor of `pos` at `height` (pos itself at its own height);
+    // NONE when height is out of range
+    Pos GetAncestor(Pos pos, int height) const;
+
+    // Median of the timestamps of `pos` and its ten ancestors
+    // (BIP113); 0 for NONE
+    int64_t GetMedianTimePast(Pos pos) const;
+
+    // Fork point of two headers
+    Pos LastCommonAncestor(Pos a, Pos b) const;
+
+    // Block locator from `pos`: the last 10 hashes one by one, then
+    // exponentially sparser back to genesis
+    std::vector<Hash256> GetLocator(Pos pos) const;
+
+    // Bytes held by the columns and the hash table
+    size_t MemoryUsage() const;
+
+private:
+    // Position of `hash` in the table, or of the empty slot where
+    // it would go
+    size_t Slot(const Hash256& hash) const;
+
+    void Insert(Pos pos);
+    void Rehash(size_t slotCount);
+
+    // Hash-indexed slots (power of two, NONE = empty), at most half
+    // full
+    std::vector<Pos> table;
+    uint64_t tableSalt;
+
+    std::vector<Hash256> hashes;
+    std::vector<Hash256> merkleRoots;
+    std::vector<int32_t> versions;
+    std::vector<uint32_t> times;
+    std::vector<uint32_t> bitsColumn;
+    std::vector<uint32_t> nonces;
+
+    // Parent and skip side by side: an ancestor walk reads both
+    struct Links
+    {
+        Pos parent;
+        Pos skip;
+    };
+
+    std::vector<Links> links;
+    std::vector<int32_t> heights;
+    std::vector<uint8_t> status;
+    std::vector<ArithUint256> chainWork;
+
+    Pos bestHeader;
+};
+
+#endif // DRACHMA_CHAIN_HEADERINDEX_H
@@ -0,0 +1,167 @@
+#include "headerindexbench.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static double NanosSince(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+static bool SetReason(std::string* reason, const std::string& text)
+{
+    if (reason)
+        *reason = text;
+    return false;
+}
+
+// Next header on top of `prevHash`, mined at minimum difficulty
+static BlockHeader MineHeader(std::mt19937_64& rng, const HeaderIndex::Hash256& prevHash, uint32_t height)
+{
+    BlockHeader header;
+    header.version = 1;
+    header.prevHash = prevHash;
+    for (size_t i = 0; i < header.merkleRoot.size(); i += 8)
+    {
+        const uint64_t r = rng();
+        std::memcpy(header.merkleRoot.data() + i, &r, 8);
+    }
+    header.time = 1600000000 + height * 600;
+    header.bits = 0x207fffff;
+    while (!header.CheckProofOfWork())
+        header.nonce++;
+    return header;
+}
+
+// Mines `count` headers on top of `prevHash` and adds them `batch`
+// at a time, timing only AddHeaders()
+static bool AddChain(HeaderIndex& index, std::mt19937_64& rng, HeaderIndex::Hash256 prevHash,
+                     uint32_t height, size_t count, size_t batch, double& addNs, std::string* reason)
+{
+    std::vector<BlockHeader> headers;
+    headers.reserve(batch);
+
+    while (count > 0)
+    {
+        const size_t n = std::min(count, batch);
+        headers.clear();
+        for (size_t i = 0; i < n; ++i)
+        {
+            headers.push_back(MineHeader(rng, prevHash, height++));
+            prevHash = headers.back().GetHash();
+        }
+
+        const Clock::time_point start = Clock::now();
+        if (!index.AddHeaders(headers.data(), n, reason))
+            return false;
+        addNs += NanosSince(start);
+
+        count -= n;
+    }
+    return true;
+}
+
+// GetAncestor() without the skips
+static HeaderIndex::Pos WalkParents(const HeaderIndex& index, HeaderIndex::Pos pos, int height)
+{
+    while (pos != HeaderIndex::NONE && index.GetHeight(pos) > height)
+        pos = index.GetParent(pos);
+    return pos;
+}
+
+bool HeaderIndexBenchmark::Run(const Options& opts, Report& report, std::string* reason)
+{
+    report = Report();
+
+    if (opts.headers < 2 || opts.batch == 0 || opts.queries == 0)
+        return SetReason(reason, "headers, batch and queries must be set");
+
+    std::mt19937_64 rng(std::random_device{}());
+
+    HeaderIndex index;
+    index.Reserve(opts.headers + opts.forks * opts.forkLength);
+
+    // Main chain, genesis included
+    double addNs = 0;
+    if (!AddChain(index, rng, HeaderIndex::Hash256(), 0, opts.headers, opts.batch, addNs, reason))
+        return false;
+
+    const HeaderIndex::Pos mainTip = index.GetBestHeader();
+    const int mainHeight = index.GetHeight(mainTip);
+
+    // Side branches, each shorter than what is left above its fork
+    std::vector<HeaderIndex::Pos> branchTips;
+    for (size_t f = 0; f < opts.forks && opts.forkLength > 0; ++f)
+    {
+        const int forkHeight = (int)(rng() % (uint64_t)mainHeight);
+        const HeaderIndex::Pos fork = index.GetAncestor(mainTip, forkHeight);
+        const size_t length = std::min(opts.forkLength, (size_t)(mainHeight - forkHeight));
+
+        if (!AddChain(index, rng, index.GetBlockHash(fork), (uint32_t)forkHeight + 1, length,
+                      opts.batch, addNs, reason))
+            return false;
+        branchTips.push_back((HeaderIndex::Pos)index.Size() - 1);
+    }
+
+    if (index.GetBestHeader() != mainTip)
+        return SetReason(reason, "a branch overtook the main chain");
+
+    report.headers = index.Size();
+    report.addNs = addNs / report.headers;
+    report.bytesPerHeader = (double)index.MemoryUsage() / report.headers;
+
+    // The queries, drawn up front so that only the lookups are timed
+    std::vector<std::pair<HeaderIndex::Pos,int>> queries(opts.queries);
+    for (auto& q : queries)
+    {
+        q.first = (HeaderIndex::Pos)(rng() % index.Size());
+        q.second = (int)(rng() % (uint64_t)(index.GetHeight(q.first) + 1));
+    }
+
+    volatile HeaderIndex::Pos sink = 0;         // keeps the lookups observable
+
+    Clock::time_point start = Clock::now();
+    for (const auto& q : queries)
+        sink = sink ^ index.GetAncestor(q.first, q.second);
+    report.ancestorNs = NanosSince(start) / queries.size();
+
+    const size_t walks = std::min(opts.walkQueries, queries.size());
+    if (walks > 0)
+    {
+        start = Clock::now();
+        for (size_t i = 0; i < walks; ++i)
+        {
+            const HeaderIndex::Pos pos = WalkParents(index, queries[i].first, queries[i].second);
+            if (pos != index.GetAncestor(queries[i].first, queries[i].second))
+                return SetReason(reason, "GetAncestor() disagrees with the parent walk");
+            sink = sink ^ pos;
+        }
+        // The check above ran GetAncestor() once more per walk
+        report.parentWalkNs = NanosSince(start) / walks - report.ancestorNs;
+    }
+
+    if (!branchTips.empty())
+    {
+        start = Clock::now();
+        for (size_t i = 0; i < opts.queries; ++i)
+            sink = sink ^ index.LastCommonAncestor(branchTips[i % branchTips.size()], mainTip);
+        report.commonAncestorNs = NanosSince(start) / opts.queries;
+    }
+
+    const size_t locators = std::max<size_t>(1, opts.queries / 100);
+    start = Clock::now();
+    for (size_t i = 0; i < locators; ++i)
+    {
+        const std::vector<HeaderIndex::Hash256> locator =
+            index.GetLocator(index.GetAncestor(mainTip, queries[i % queries.size()].second));
+        sink = sink ^ (HeaderIndex::Pos)locator.size();
+    }
+    report.locatorNs = NanosSince(start) / locators;
+
+    return true;
+}
@@ -0,0 +1,67 @@
+#ifndef DRACHMA_CHAIN_HEADERINDEXBENCH_H
+#define DRACHMA_CHAIN_HEADERINDEXBENCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "headerindex.h"
+
+//
+// ===============================================================
+//  CLASS: HeaderIndexBenchmark
+// ===============================================================
+//
+//  What HeaderIndex costs at sync scale: a chain of `headers`
+//  headers (minimum difficulty, mined up front) is fed to
+//  AddHeaders() `batch` at a time, the way header sync delivers
+//  them, then `forks` side branches of `forkLength` headers each
+//  are added off random heights.
+//
+//  Then, on the finished index, `queries` random lookups of each
+//  kind are timed:
+//
+//    GetAncestor()         – random header, random height below it
+//    parent walk           – the same queries by parent links only,
+//                            the O(n) baseline the skips replace
+//                            (capped at `walkQueries`)
+//    LastCommonAncestor()  – random branch tip against the main tip
+//    GetLocator()          – from random main chain headers
+//
+//  Report: AddHeaders() per header (hashing and proof of work
+//  included), MemoryUsage() per header and nanoseconds per query.
+//
+// ===============================================================
+//
+class HeaderIndexBenchmark
+{
+public:
+    struct Options
+    {
+        size_t headers;
+        size_t batch;
+        size_t forks;
+        size_t forkLength;
+        size_t queries;
+        size_t walkQueries;
+
+        Options()
+            : headers(1000000), batch(2000), forks(1000), forkLength(20),
+              queries(1000000), walkQueries(1000) {}
+    };
+
+    struct Report
+    {
+        size_t headers;                 // in the index, branches included
+        double addNs;                   // AddHeaders() per header
+        double bytesPerHeader;          // MemoryUsage() / Size()
+        double ancestorNs;
+        double parentWalkNs;
+        double commonAncestorNs;
+        double locatorNs;
+    };
+
+    static bool Run(const Options& opts, Report& report, std::string* reason = nullptr);
+};
+
+#endif // DRACHMA_CHAIN_HEADERINDEXBENCH_H
@@ -0,0 +1,226 @@
+#include "reorgbench.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <random>
+
+typedef std::chrono::steady_clock Clock;
+
+static double MillisSince(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static bool SetReason(std::string* reason, const std::string& text)
+{
+    if (reason)
+        *reason = text;
+    return false;
+}
+
+// Coins a branch can spend as of some height
+struct CoinPool
+{
+    struct Entry
+    {
+        OutPoint out;
+        int64_t amount;
+        uint32_t height;
+    };
+
+    std::vector<Entry> spendable;
+    std::deque<Entry> immature;         // coinbase outputs, oldest first
+};
+
+static std::vector<uint8_t> RandomScript(std::mt19937_64& rng)
+{
+    std::vector<uint8_t> s(22);
+    s[0] = 0x00;
+    s[1] = 20;
+    for (size_t i = 2; i < s.size(); ++i)
+        s[i] = (uint8_t)rng();
+    return s;
+}
+
+static Block MakeBlock(std::mt19937_64& rng, const std::array<uint8_t,32>& prevHash, uint32_t height,
+                       size_t txs, CoinPool& pool)
+{
+    static const int64_t FEE = 1000;
+
+    while (!pool.immature.empty() && height - pool.immature.front().height >= COINBASE_MATURITY)
+    {
+        pool.spendable.push_back(pool.immature.front());
+        pool.immature.pop_front();
+    }
+
+    Block block;
+    block.vtx.resize(1);
+
+    std::vector<CoinPool::Entry> created;
+    int64_t fees = 0;
+
+    for (size_t t = 0; t < txs && pool.spendable.size() >= 2; ++t)
+    {
+        Transaction tx;
+        int64_t in = 0;
+        for (int j = 0; j < 2; ++j)
+        {
+            const size_t r = rng() % pool.spendable.size();
+            TxIn input;
+            input.prevout = pool.spendable[r].out;
+            tx.vin.push_back(input);
+            in += pool.spendable[r].amount;
+
+            pool.spendable[r] = pool.spendable.back();
+            pool.spendable.pop_back();
+        }
+
+        const int64_t half = (in - FEE) / 2;
+        tx.vout.push_back(TxOut(half, RandomScript(rng)));
+        tx.vout.push_back(TxOut(in - FEE - half, RandomScript(rng)));
+        fees += FEE;
+
+        const std::array<uint8_t,32> txid = tx.GetTxid();
+        for (uint32_t k = 0; k < 2; ++k)
+            created.push_back({ OutPoint(txid, k), tx.vout[k].amount, height });
+        block.vtx.push_back(std::move(tx));
+    }
+
+    // Coinbase: the height and some noise keep its txid unique
+    Transaction& coinbase = block.vtx[0];
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig = { 4, (uint8_t)height, (uint8_t)(height >> 8), (uint8_t)(height >> 16),
+                                  (uint8_t)rng() };
+
+    const int64_t value = GetBlockSubsidy(height) + fees;
+    for (int k = 0; k < 4; ++k)
+        coinbase.vout.push_back(TxOut(k < 3 ? value / 4 : value - 3 * (value / 4), RandomScript(rng)));
+
+    const std::array<uint8_t,32> cbid = coinbase.GetTxid();
+    for (uint32_t k = 0; k < 4; ++k)
+        pool.immature.push_back({ OutPoint(cbid, k), coinbase.vout[k].amount, height });
+
+    pool.spendable.insert(pool.spendable.end(), created.begin(), created.end());
+
+    block.header.version = 1;
+    block.header.prevHash = prevHash;
+    block.header.merkleRoot = block.ComputeMerkleRoot();
+    block.header.time = 1600000000 + height * 600;
+    block.header.bits = 0x207fffff;
+    while (!block.header.CheckProofOfWork())
+        block.header.nonce++;
+
+    return block;
+}
+
+static bool StoreBlock(BlockStore& blocks, HeaderIndex& headers, const Block& block, std::string* reason)
+{
+    std::vector<uint8_t> raw;
+    block.Serialize(raw);
+
+    if (!blocks.WriteBlock(block.header.GetHash(), raw.data(), raw.size()))
+        return SetReason(reason, "block write failed");
+    return headers.AddHeaders(&block.header, 1, reason);
+}
+
+bool ReorgBenchmark::Run(Scheduler& scheduler, const Options& opts, Summary& summary, std::string* reason)
+{
+    summary = Summary();
+
+    const uint32_t maxDepth = opts.depths.empty() ? 0
+                              : *std::max_element(opts.depths.begin(), opts.depths.end());
+    if (opts.dir.empty() || opts.blocks < (size_t)maxDepth + 2)
+        return SetReason(reason, "dir must be set and the chain longer than the deepest reorg");
+
+    BlockStore blocks;
+    BlockStore undo;
+    BlockStore::Options undoOpts;
+    undoOpts.filePrefix = "rev";
+    UTXOStore utxo;
+
+    if (!blocks.Open(opts.dir) || !undo.Open(opts.dir, undoOpts) || !utxo.Open(opts.dir))
+        return SetReason(reason, "cannot open the stores in " + opts.dir);
+    if (blocks.GetBlockCount() != 0)
+        return SetReason(reason, opts.dir + " already holds a chain");
+
+    HeaderIndex headers;
+    BlockValidator validator(scheduler);
+    ChainState chain(headers, blocks, undo, utxo, validator);
+    if (!chain.Load(reason))
+        return false;
+
+    std::mt19937_64 rng(std::random_device{}());
+
+    // Main chain, keeping the coin pools a fork may start from
+    const size_t firstFork = opts.blocks - maxDepth - 1;
+
+    CoinPool pool;
+    std::vector<CoinPool> poolAt;               // before block firstFork + i
+    std::vector<std::array<uint8_t,32>> hashes;
+    std::array<uint8_t,32> prev = {};
+
+    for (size_t h = 0; h < opts.blocks; ++h)
+    {
+        if (h >= firstFork)
+            poolAt.push_back(pool);
+
+        const Block block = MakeBlock(rng, prev, (uint32_t)h, opts.txs, pool);
+        if (!StoreBlock(blocks, headers, block, reason))
+            return false;
+
+        prev = block.header.GetHash();
+        hashes.push_back(prev);
+    }
+
+    const HeaderIndex::Pos mainTip = headers.Find(prev);
+
+    Clock::time_point start = Clock::now();
+    if (!chain.ActivateChain(mainTip, reason))
+        return false;
+    summary.syncSeconds = MillisSince(start) / 1000.0;
+
+    // Reorgs
+    for (uint32_t depth : opts.depths)
+    {
+        const size_t fork = opts.blocks - 1 - depth;
+
+        CoinPool branchPool = poolAt[fork + 1 - firstFork];
+        std::array<uint8_t,32> tipHash = hashes[fork];
+
+        for (size_t k = 0; k <= depth; ++k)
+        {
+            const Block block = MakeBlock(rng, tipHash, (uint32_t)(fork + 1 + k), opts.txs, branchPool);
+            if (!StoreBlock(blocks, headers, block, reason))
+                return false;
+            tipHash = block.header.GetHash();
+        }
+        const HeaderIndex::Pos branchTip = headers.Find(tipHash);
+
+        Report report;
+        report.depth = depth;
+
+        const ChainState::Stats before = chain.GetStats();
+
+        start = Clock::now();
+        if (!chain.ActivateChain(branchTip, reason))
+            return false;
+        report.reorgMs = MillisSince(start);
+
+        const ChainState::Stats after = chain.GetStats();
+
+        start = Clock::now();
+        if (!chain.ActivateChain(mainTip, reason))
+            return false;
+        report.backMs = MillisSince(start);
+
+        if (chain.Tip() != mainTip)
+            return SetReason(reason, "did not return to the main chain");
+
+        report.undoBytesPerBlock = (double)(after.undoBytes - before.undoBytes) / (depth + 1);
+        report.flushed = chain.GetStats().flushes != before.flushes;
+        summary.reorgs.push_back(report);
+    }
+    return true;
+}
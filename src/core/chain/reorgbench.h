@@ -0,0 +1,62 @@
+#ifndef DRACHMA_CHAIN_REORGBENCH_H
+#define DRACHMA_CHAIN_REORGBENCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "chainstate.h"
+
+//
+// ===============================================================
+//  CLASS: ReorgBenchmark
+// ===============================================================
+//
+//  What a reorganization costs ChainState: a synthetic chain of
+//  `blocks` blocks (coinbase plus `txs` two-in two-out P2WPKH
+//  transactions each, consensus-valid, scripts not checked) is
+//  stored in `dir`, which must not hold a chain yet, and
+//  connected. Then for every depth in `depths` a branch forking
+//  `depth` blocks below the tip and one block longer is stored,
+//  activated (timed) and the old tip activated again (timed).
+//
+//  Report per depth: both activations, the undo bytes written per
+//  branch block and whether the UTXO set was flushed (it should
+//  not be: reorgs stay in the cache).
+//
+// ===============================================================
+//
+class ReorgBenchmark
+{
+public:
+    struct Options
+    {
+        std::string dir;
+        size_t blocks;
+        size_t txs;
+        std::vector<uint32_t> depths;
+
+        Options() : blocks(300), txs(200), depths({1, 2, 5, 10, 25, 50, 100}) {}
+    };
+
+    struct Report
+    {
+        uint32_t depth;
+        double reorgMs;                 // to the branch
+        double backMs;                  // to the old tip again
+        double undoBytesPerBlock;
+        bool flushed;
+    };
+
+    struct Summary
+    {
+        double syncSeconds;             // connecting the initial chain
+        std::vector<Report> reorgs;
+    };
+
+    static bool Run(Scheduler& scheduler, const Options& opts, Summary& summary,
+                    std::string* reason = nullptr);
+};
+
+#endif // DRACHMA_CHAIN_REORGBENCH_H
@@ -0,0 +1,203 @@
+#include "undo.h"
+#include "../tx/transaction.h"
+#include "../../common/utils/serialize.h"
+
+#include <initializer_list>
+
+enum UndoScript : uint8_t
+{
+    SCRIPT_P2PKH  = 0,
+    SCRIPT_P2SH   = 1,
+    SCRIPT_P2WPKH = 2,
+    SCRIPT_P2WSH  = 3,
+    SCRIPT_P2TR   = 4,
+    SCRIPT_RAW    = 5       // + script length
+};
+
+// Largest transaction count a block can need undo for
+static const uint64_t MAX_UNDO_ENTRIES = MAX_SERIALIZED_SIZE / 41;
+
+uint64_t CompressAmount(uint64_t n)
+{
+    if (n == 0)
+        return 0;
+
+    int e = 0;
+    while ((n % 10) == 0 && e < 9)
+    {
+        n /= 10;
+        e++;
+    }
+
+    if (e < 9)
+    {
+        const int d = (int)(n % 10);
+        n /= 10;
+        return 1 + (n * 9 + d - 1) * 10 + e;
+    }
+    return 1 + (n - 1) * 10 + 9;
+}
+
+uint64_t DecompressAmount(uint64_t x)
+{
+    if (x == 0)
+        return 0;
+
+    x--;
+    int e = (int)(x % 10);
+    x /= 10;
+
+    uint64_t n;
+    if (e < 9)
+    {
+        const int d = (int)(x % 9) + 1;
+        x /= 9;
+        n = x * 10 + d;
+    }
+    else
+    {
+        n = x + 1;
+    }
+
+    while (e--)
+        n *= 10;
+    return n;
+}
+
+static void EncodeScript(const std::vector<uint8_t>& s, std::vector<uint8_t>& out)
+{
+    if (s.size() == 25 && s[0] == 0x76 && s[1] == 0xa9 && s[2] == 0x14 &&
+        s[23] == 0x88 && s[24] == 0xac)
+    {
+        AppendVarInt(out, SCRIPT_P2PKH);
+        AppendBytes(out, &s[3], 20);
+    }
+    else if (s.size() == 23 && s[0] == 0xa9 && s[1] == 0x14 && s[22] == 0x87)
+    {
+        AppendVarInt(out, SCRIPT_P2SH);
+        AppendBytes(out, &s[2], 20);
+    }
+    else if (s.size() == 22 && s[0] == 0x00 && s[1] == 0x14)
+    {
+        AppendVarInt(out, SCRIPT_P2WPKH);
+        AppendBytes(out, &s[2], 20);
+    }
+    else if (s.size() == 34 && s[0] == 0x00 && s[1] == 0x20)
+    {
+        AppendVarInt(out, SCRIPT_P2WSH);
+        AppendBytes(out, &s[2], 32);
+    }
+    else if (s.size() == 34 && s[0] == 0x51 && s[1] == 0x20)
+    {
+        AppendVarInt(out, SCRIPT_P2TR);
+        AppendBytes(out, &s[2], 32);
+    }
+    else
+    {
+        AppendVarInt(out, SCRIPT_RAW + (uint64_t)s.size());
+        AppendBytes(out, s.data(), s.size());
+    }
+}
+
+// Script with `prefix` in front of `len` bytes read from `r`
+static bool ReadTemplate(SpanReader& r, std::vector<uint8_t>& s,
+                         std::initializer_list<uint8_t> prefix, size_t len)
+{
+    ByteSpan body;
+    if (!r.ReadSpan(len, body))
+        return false;
+
+    s.assign(prefix);
+    s.insert(s.end(), body.begin(), body.end());
+    return true;
+}
+
+static bool DecodeScript(SpanReader& r, std::vector<uint8_t>& s)
+{
+    uint64_t kind;
+    if (!r.ReadVarInt(kind))
+        return false;
+
+    switch (kind)
+    {
+        case SCRIPT_P2PKH:
+            if (!ReadTemplate(r, s, { 0x76, 0xa9, 0x14 }, 20)) return false;
+            s.push_back(0x88);
+            s.push_back(0xac);
+            return true;
+
+        case SCRIPT_P2SH:
+            if (!ReadTemplate(r, s, { 0xa9, 0x14 }, 20)) return false;
+            s.push_back(0x87);
+            return true;
+
+        case SCRIPT_P2WPKH:
+            return ReadTemplate(r, s, { 0x00, 0x14 }, 20);
+
+        case SCRIPT_P2WSH:
+            return ReadTemplate(r, s, { 0x00, 0x20 }, 32);
+
+        case SCRIPT_P2TR:
+            return ReadTemplate(r, s, { 0x51, 0x20 }, 32);
+    }
+
+    if (kind - SCRIPT_RAW > MAX_SERIALIZED_SIZE)
+        return false;
+
+    return ReadTemplate(r, s, {}, (size_t)(kind - SCRIPT_RAW));
+}
+
+void BlockUndo::Serialize(std::vector<uint8_t>& out) const
+{
+    AppendCompactSize(out, txs.size());
+    for (const TxUndo& tx : txs)
+    {
+        AppendCompactSize(out, tx.spent.size());
+        for (const Coin& coin : tx.spent)
+        {
+            AppendVarInt(out, (uint64_t)coin.height * 2 + (coin.coinbase ? 1 : 0));
+            AppendVarInt(out, CompressAmount((uint64_t)coin.amount));
+            EncodeScript(coin.script, out);
+        }
+    }
+}
+
+bool BlockUndo::Deserialize(ByteSpan data)
+{
+    SpanReader r(data);
+    txs.clear();
+
+    uint64_t txCount;
+    if (!r.ReadCompactSize(txCount) || txCount > MAX_UNDO_ENTRIES)
+        return false;
+
+    txs.resize((size_t)txCount);
+    for (TxUndo& tx : txs)
+    {
+        uint64_t coinCount;
+        if (!r.ReadCompactSize(coinCount) || coinCount > r.Remaining() / 3)
+            return false;
+
+        tx.spent.resize((size_t)coinCount);
+        for (Coin& coin : tx.spent)
+        {
+            uint64_t code, amount;
+            if (!r.ReadVarInt(code) || (code >> 1) > UINT32_MAX ||
+                !r.ReadVarInt(amount))
+                return false;
+
+            amount = DecompressAmount(amount);
+            if (amount > (uint64_t)MAX_MONEY)
+                return false;
+
+            coin.height = (uint32_t)(code >> 1);
+            coin.coinbase = (code & 1) != 0;
+            coin.amount = (int64_t)amount;
+
+            if (!DecodeScript(r, coin.script))
+                return false;
+        }
+    }
+
+    return r.Empty();
+}
@@ -0,0 +1,55 @@
+#ifndef DRACHMA_CHAIN_UNDO_H
+#define DRACHMA_CHAIN_UNDO_H
+
+#include <cstdint>
+#include <vector>
+
+#include "../storage/coin.h"
+#include "../../common/utils/span.h"
+
+//
+// Coins spent by one transaction, in input order
+//
+struct TxUndo
+{
+    std::vector<Coin> spent;
+};
+
+//
+// ===============================================================
+//  CLASS: BlockUndo
+// ===============================================================
+//
+//  What disconnecting a block needs to put back: the coins its
+//  transactions spent. One TxUndo per transaction but the
+//  coinbase, in block order. The outpoints are not stored; they
+//  are the inputs of the block itself.
+//
+//  Serialized:
+//    compact size tx count, then per transaction
+//      compact size coin count, then per coin
+//        VARINT height*2+coinbase | VARINT CompressAmount(amount)
+//        | VARINT kind | script
+//    kind 0/1/2 = P2PKH/P2SH/P2WPKH followed by the 20-byte hash,
+//    3/4 = P2WSH/P2TR followed by the 32-byte program, n >= 5 =
+//    raw script of n-5 bytes
+//
+//  A typical spent coin takes 25-30 bytes.
+//
+// ===============================================================
+//
+class BlockUndo
+{
+public:
+    std::vector<TxUndo> txs;
+
+    void Serialize(std::vector<uint8_t>& out) const;
+    bool Deserialize(ByteSpan data);
+};
+
+// Bitcoin Core's amount compression: trailing decimal zeros folded
+// into the low digit, so round amounts take a byte or two as VARINT
+uint64_t CompressAmount(uint64_t amount);
+uint64_t DecompressAmount(uint64_t x);
+
+#endif // DRACHMA_CHAIN_UNDO_H
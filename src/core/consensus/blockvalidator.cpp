@@ -0,0 +1,407 @@
+#include "blockvalidator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+static const uint32_t NO_PARENT = 0xFFFFFFFF;
+
+typedef std::array<uint8_t,32> Hash256;
+
+namespace
+{
+    struct TxidHasher
+    {
+        SaltedOutPointHasher salt;
+        size_t operator()(const Hash256& h) const { return salt.Hash(h.data(), 0); }
+    };
+
+    // First failure in block order, whichever thread finds it
+    class FirstFailure
+    {
+    public:
+        FirstFailure() : tx(std::numeric_limits<size_t>::max()) {}
+
+        void Set(size_t i, const char* why)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (i < tx.load())
+            {
+                tx = i;
+                reason = why;
+            }
+        }
+
+        // A transaction before `i` already failed: no point checking i
+        bool Before(size_t i) const { return tx.load(std::memory_order_relaxed) < i; }
+
+        bool Any() const { return tx.load() != std::numeric_limits<size_t>::max(); }
+        size_t Tx() const { return tx.load(); }
+        const std::string& Reason() const { return reason; }
+
+    private:
+        std::mutex mutex;
+        std::atomic<size_t> tx;
+        std::string reason;
+    };
+}
+
+typedef std::chrono::steady_clock Clock;
+
+static double Seconds(Clock::time_point since)
+{
+    return std::chrono::duration<double>(Clock::now() - since).count();
+}
+
+// OP_RETURN outputs never enter the UTXO set
+static bool IsUnspendable(const TxOutView& out)
+{
+    return !out.script.empty() && out.script[0] == 0x6a;
+}
+
+static bool Fail(std::string* reason, const std::string& why, uint32_t height)
+{
+    if (reason)
+        *reason = why + " at height " + std::to_string(height);
+    return false;
+}
+
+BlockValidator::BlockValidator(Scheduler& sched, const Options& o)
+    : scheduler(sched), opts(o)
+{
+    if (opts.inputsPerTask == 0)
+        opts.inputsPerTask = 1;
+    if (opts.txsPerTask == 0)
+        opts.txsPerTask = 1;
+
+    std::memset(&stats, 0, sizeof(stats));
+}
+
+bool BlockValidator::ConnectBlock(const BlockView& block, const BlockContext& ctx, UTXOStore& utxo,
+                                  BlockUndo& undo, std::string* reason, int64_t* fees)
+{
+    const uint32_t height = ctx.height;
+    const std::vector<TransactionView>& vtx = block.vtx;
+    const size_t n = vtx.size();
+
+    undo.txs.clear();
+    if (n == 0)
+        return Fail(reason, "block without transactions", height);
+
+    stats.blocks++;
+
+    // ---- 1. txids ----
+    Clock::time_point t = Clock::now();
+    {
+        TaskGroup group(scheduler, TASK_CONSENSUS);
+        for (size_t b = 0; b < n; b += opts.txsPerTask * 4)
+        {
+            const size_t e = std::min(n, b + opts.txsPerTask * 4);
+            group.Run([&vtx, b, e] {
+                for (size_t i = b; i < e; ++i)
+                    vtx[i].GetTxid();
+            });
+        }
+        group.Wait();
+    }
+    stats.hashSeconds += Seconds(t);
+
+    // ---- 2. block limits and spend graph ----
+    t = Clock::now();
+
+    if (GetBlockWeight(block) > MAX_BLOCK_WEIGHT)
+    {
+        stats.failed++;
+        return Fail(reason, "block weight too high", height);
+    }
+
+    // Before any script sees the witnesses
+    std::string why;
+    if (!CheckWitnessCommitment(block, &why))
+    {
+        stats.failed++;
+        return Fail(reason, why, height);
+    }
+
+    std::vector<size_t> inputBegin(n + 1, 0), outputBegin(n + 1, 0);
+    std::unordered_map<Hash256, uint32_t, TxidHasher> position;
+    position.reserve(n);
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (vtx[i].IsCoinbase() != (i == 0))
+        {
+            stats.failed++;
+            return Fail(reason, "misplaced coinbase", height);
+        }
+
+        if (!position.emplace(vtx[i].GetTxid(), (uint32_t)i).second)
+        {
+            stats.failed++;
+            return Fail(reason, "duplicate transaction", height);
+        }
+
+        inputBegin[i + 1] = inputBegin[i] + (i == 0 ? 0 : vtx[i].Inputs().size());
+        outputBegin[i + 1] = outputBegin[i] + vtx[i].Outputs().size();
+    }
+
+    // parent[inputBegin[i] + j]: block position of the transaction
+    // input j of transaction i spends
+    std::vector<uint32_t> parent(inputBegin[n], NO_PARENT);
+    std::vector<uint8_t> spentInBlock(outputBegin[n], 0);
+    std::unordered_set<OutPoint, SaltedOutPointHasher> spends;
+    spends.reserve(inputBegin[n]);
+    uint64_t inBlock = 0;
+
+    for (size_t i = 1; i < n; ++i)
+    {
+        const std::vector<TxInView>& vin = vtx[i].Inputs();
+        for (size_t j = 0; j < vin.size(); ++j)
+        {
+            const OutPoint prevout = vin[j].GetPrevout();
+
+            if (!spends.insert(prevout).second)
+            {
+                stats.failed++;
+                return Fail(reason, "input spent twice", height);
+            }
+
+            auto it = position.find(prevout.txid);
+            if (it == position.end())
+                continue;
+
+            const uint32_t p = it->second;
+            if (p >= i)
+            {
+                stats.failed++;
+                return Fail(reason, "input spends a later transaction", height);
+            }
+
+            // Its own block's coinbase is as immature as it gets
+            if (p == 0)
+            {
+                stats.failed++;
+                return Fail(reason, "premature spend of coinbase", height);
+            }
+
+            const std::vector<TxOutView>& vout = vtx[p].Outputs();
+            if (prevout.index >= vout.size() || IsUnspendable(vout[prevout.index]))
+            {
+                stats.failed++;
+                return Fail(reason, "missing or spent input", height);
+            }
+
+            parent[inputBegin[i] + j] = p;
+            spentInBlock[outputBegin[p] + prevout.index] = 1;
+            inBlock++;
+        }
+    }
+    stats.graphSeconds += Seconds(t);
+
+    // ---- 3. contextual and script checks ----
+    t = Clock::now();
+
+    undo.txs.resize(n - 1);
+    std::vector<int64_t> txFees(n, 0);
+    std::vector<int64_t> txSigOps(n, 0);
+    std::vector<std::unique_ptr<PrecomputedTxData>> txdata(scriptCheck ? n : 0);
+    FirstFailure failure;
+
+    {
+        TaskGroup group(scheduler, TASK_CONSENSUS);
+
+        auto scripts = [&](size_t i, size_t first, size_t last) {
+            const std::vector<Coin>& spent = undo.txs[i - 1].spent;
+            for (size_t j = first; j < last && !failure.Before(i + 1); ++j)
+            {
+                ScriptCheck check;
+                check.tx = &vtx[i];
+                check.txdata = txdata[i].get();
+                check.input = (uint32_t)j;
+                check.coin = spent[j];
+
+                if (!scriptCheck(check))
+                    failure.Set(i, "script verification failed");
+            }
+        };
+
+        auto contextual = [&](size_t i) {
+            const TransactionView& tx = vtx[i];
+
+            const int64_t valueOut = tx.GetValueOut();
+            if (valueOut < 0)
+                return failure.Set(i, "output value out of range");
+
+            if (!IsFinalTx(tx, height, ctx.medianTimePast))
+                return failure.Set(i, "non-final transaction");
+
+            if (i == 0)
+            {
+                txSigOps[0] = GetTransactionSigOpCost(tx, std::vector<Coin>());
+                return;
+            }
+
+            const std::vector<TxInView>& vin = tx.Inputs();
+            std::vector<Coin>& spent = undo.txs[i - 1].spent;
+            spent.resize(vin.size());
+
+            int64_t valueIn = 0;
+            for (size_t j = 0; j < vin.size(); ++j)
+            {
+                const uint32_t p = parent[inputBegin[i] + j];
+                if (p == NO_PARENT)
+                {
+                    if (!utxo.GetCoin(vin[j].GetPrevout(), spent[j]))
+                        return failure.Set(i, "missing or spent input");
+
+                    if (spent[j].coinbase && height - spent[j].height < COINBASE_MATURITY)
+                        return failure.Set(i, "premature spend of coinbase");
+                }
+                else
+                {
+                    const TxOutView& out = vtx[p].Outputs()[vin[j].prevIndex];
+                    spent[j] = Coin(out.amount, height, false, out.script.ToVector());
+                }
+
+                valueIn += spent[j].amount;
+                if (!MoneyRange(valueIn))
+                    return failure.Set(i, "input value out of range");
+            }
+
+            if (valueIn < valueOut)
+                return failure.Set(i, "outputs exceed inputs");
+
+            if (!CheckSequenceLocks(tx, spent, ctx))
+                return failure.Set(i, "sequence lock not satisfied");
+            txFees[i] = valueIn - valueOut;
+            txSigOps[i] = GetTransactionSigOpCost(tx, spent);
+
+            if (!scriptCheck)
+                return;
+
+            txdata[i].reset(new PrecomputedTxData(tx));
+
+            // The first batch stays here; the rest go on this
+            // worker's deque for others to steal
+            const size_t per = opts.inputsPerTask;
+            for (size_t b = per; b < vin.size(); b += per)
+            {
+                const size_t e = std::min(vin.size(), b + per);
+                group.Run([&scripts, i, b, e] { scripts(i, b, e); });
+            }
+            scripts(i, 0, std::min(vin.size(), per));
+        };
+
+        for (size_t b = 0; b < n; b += opts.txsPerTask)
+        {
+            const size_t e = std::min(n, b + opts.txsPerTask);
+            group.Run([&contextual, &failure, b, e] {
+                for (size_t i = b; i < e && !failure.Before(i); ++i)
+                    contextual(i);
+            });
+        }
+        group.Wait();
+    }
+    stats.checkSeconds += Seconds(t);
+
+    if (failure.Any())
+    {
+        stats.failed++;
+        undo.txs.clear();
+        return Fail(reason, failure.Reason(), height);
+    }
+
+    int64_t totalFees = 0;
+    for (int64_t fee : txFees)
+    {
+        totalFees += fee;
+        if (!MoneyRange(totalFees))
+        {
+            stats.failed++;
+            undo.txs.clear();
+            return Fail(reason, "fees out of range", height);
+        }
+    }
+
+    int64_t sigOps = 0;
+    for (int64_t cost : txSigOps)
+        sigOps += cost;
+    if (sigOps > MAX_BLOCK_SIGOPS_COST)
+    {
+        stats.failed++;
+        undo.txs.clear();
+        return Fail(reason, "too many signature operations", height);
+    }
+
+    if (vtx[0].GetValueOut() > GetBlockSubsidy(height) + totalFees)
+    {
+        stats.failed++;
+        undo.txs.clear();
+        return Fail(reason, "coinbase pays more than subsidy and fees", height);
+    }
+
+    // ---- 4. apply, in block order ----
+    t = Clock::now();
+
+    // Spends first: none of them touches an output of this block,
+    // and if one fails the ones before it can be put back before
+    // anything else has been written
+    for (size_t i = 1; i < n; ++i)
+    {
+        const std::vector<TxInView>& vin = vtx[i].Inputs();
+        for (size_t j = 0; j < vin.size(); ++j)
+        {
+            if (parent[inputBegin[i] + j] != NO_PARENT)
+                continue;   // never added
+
+            // Checked above; only a concurrent writer could make
+            // this fail
+            if (utxo.SpendCoin(vin[j].GetPrevout()))
+                continue;
+
+            for (size_t ri = i; ri >= 1; --ri)
+            {
+                const std::vector<TxInView>& rvin = vtx[ri].Inputs();
+                for (size_t rj = (ri == i ? j : rvin.size()); rj-- > 0;)
+                {
+                    if (parent[inputBegin[ri] + rj] == NO_PARENT)
+                        utxo.AddCoin(rvin[rj].GetPrevout(), undo.txs[ri - 1].spent[rj]);
+                }
+            }
+
+            stats.failed++;
+            undo.txs.clear();
+            return Fail(reason, "UTXO set changed during validation", height);
+        }
+    }
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        const TransactionView& tx = vtx[i];
+        for (uint32_t k = 0; k < tx.Outputs().size(); ++k)
+        {
+            const TxOutView& out = tx.Outputs()[k];
+            if (IsUnspendable(out) || spentInBlock[outputBegin[i] + k])
+                continue;
+
+            // Duplicate coinbase txids (BIP30) may overwrite
+            utxo.AddCoin(OutPoint(tx.GetTxid(), k),
+                         Coin(out.amount, height, i == 0, out.script.ToVector()),
+                         i == 0);
+        }
+    }
+    stats.applySeconds += Seconds(t);
+
+    stats.txs += n;
+    stats.inputs += inputBegin[n];
+    stats.inBlockSpends += inBlock;
+
+    if (fees)
+        *fees = totalFees;
+    return true;
+}
@@ -0,0 +1,203 @@
+#include "consensus.h"
+#include "../crypto/hash.h"
+#include "../script/script.h"
+
+#include <algorithm>
+#include <cstring>
+
+int64_t GetBlockSubsidy(uint32_t height)
+{
+    const uint32_t halvings = height / SUBSIDY_HALVING_INTERVAL;
+    if (halvings >= 64)
+        return 0;
+
+    return (50 * COIN) >> halvings;
+}
+
+bool IsFinalTx(const TransactionView& tx, uint32_t height, int64_t lockTimeCutoff)
+{
+    const uint32_t lockTime = tx.GetLockTime();
+    if (lockTime == 0)
+        return true;
+
+    const int64_t limit = lockTime < LOCKTIME_THRESHOLD ? (int64_t)height : lockTimeCutoff;
+    if ((int64_t)lockTime < limit)
+        return true;
+
+    // A locktime not reached yet only binds with a non-final input
+    for (const TxInView& in : tx.Inputs())
+        if (in.sequence != SEQUENCE_FINAL)
+            return false;
+    return true;
+}
+
+bool CheckSequenceLocks(const TransactionView& tx, const std::vector<Coin>& spent,
+                        const BlockContext& ctx)
+{
+    if (tx.GetVersion() < 2 || tx.IsCoinbase())
+        return true;
+
+    // Last height / time at which the transaction is still locked
+    int64_t minHeight = -1;
+    int64_t minTime = -1;
+
+    const std::vector<TxInView>& vin = tx.Inputs();
+    for (size_t j = 0; j < vin.size(); ++j)
+    {
+        const uint32_t seq = vin[j].sequence;
+        if (seq & SEQUENCE_LOCKTIME_DISABLE_FLAG)
+            continue;
+
+        const int64_t value = seq & SEQUENCE_LOCKTIME_MASK;
+        const uint32_t coinHeight = spent[j].height;
+
+        if (seq & SEQUENCE_LOCKTIME_TYPE_FLAG)
+        {
+            // From the median time past of the block before the coin's
+            if (!ctx.medianTimeAt)
+                return false;
+            const int64_t coinTime = ctx.medianTimeAt(std::max<uint32_t>(coinHeight, 1) - 1);
+            minTime = std::max(minTime, coinTime + (value << SEQUENCE_LOCKTIME_GRANULARITY) - 1);
+        }
+        else
+        {
+            minHeight = std::max(minHeight, (int64_t)coinHeight + value - 1);
+        }
+    }
+
+    return minHeight < (int64_t)ctx.height && minTime < ctx.medianTimePast;
+}
+
+// Last push of a push-only scriptSig (the P2SH redeem script)
+static bool LastPush(ByteSpan scriptSig, ByteSpan& data)
+{
+    bool found = false;
+    uint8_t opcode;
+    ByteSpan push;
+    size_t pos = 0;
+
+    while (pos < scriptSig.size)
+    {
+        if (!GetScriptOp(scriptSig, pos, opcode, &push) || opcode > OP_16)
+            return false;
+        data = push;
+        found = true;
+    }
+    return found;
+}
+
+static int64_t WitnessSigOps(int version, ByteSpan program, const TransactionView& tx, uint32_t input)
+{
+    if (version != 0)
+        return 0;                       // taproot budgets per input instead
+
+    if (program.size == 20)
+        return 1;
+    if (program.size == 32 && tx.GetWitnessCount(input) > 0)
+        return GetSigOpCount(tx.GetWitness(input, (uint32_t)tx.GetWitnessCount(input) - 1), true);
+    return 0;
+}
+
+int64_t GetTransactionSigOpCost(const TransactionView& tx, const std::vector<Coin>& spent)
+{
+    int64_t legacy = 0;
+    for (const TxInView& in : tx.Inputs())
+        legacy += GetSigOpCount(in.scriptSig, false);
+    for (const TxOutView& out : tx.Outputs())
+        legacy += GetSigOpCount(out.script, false);
+
+    int64_t cost = legacy * WITNESS_SCALE_FACTOR;
+    if (tx.IsCoinbase())
+        return cost;
+
+    const std::vector<TxInView>& vin = tx.Inputs();
+    for (uint32_t j = 0; j < vin.size(); ++j)
+    {
+        const ByteSpan script(spent[j].script);
+        int version;
+        ByteSpan program;
+        ByteSpan redeem;
+
+        if (IsPayToScriptHash(script))
+        {
+            if (!LastPush(vin[j].scriptSig, redeem))
+                continue;
+
+            cost += (int64_t)GetSigOpCount(redeem, true) * WITNESS_SCALE_FACTOR;
+            if (IsWitnessProgram(redeem, version, program))
+                cost += WitnessSigOps(version, program, tx, j);
+        }
+        else if (IsWitnessProgram(script, version, program))
+        {
+            cost += WitnessSigOps(version, program, tx, j);
+        }
+    }
+    return cost;
+}
+
+uint64_t GetBlockWeight(const BlockView& block)
+{
+    uint64_t weight = (BlockHeader::SIZE + CompactSizeLen(block.vtx.size())) * WITNESS_SCALE_FACTOR;
+    for (const TransactionView& tx : block.vtx)
+        weight += tx.GetWeight();
+    return weight;
+}
+
+static bool SetReason(std::string* reason, const char* text)
+{
+    if (reason)
+        *reason = text;
+    return false;
+}
+
+bool CheckWitnessCommitment(const BlockView& block, std::string* reason)
+{
+    static const uint8_t HEADER[6] = { 0x6a, 0x24, 0xaa, 0x21, 0xa9, 0xed };
+
+    if (block.vtx.empty())
+        return SetReason(reason, "block without transactions");
+
+    const TransactionView& coinbase = block.vtx[0];
+    const std::vector<TxOutView>& vout = coinbase.Outputs();
+
+    size_t found = vout.size();
+    for (size_t k = vout.size(); k-- > 0;)
+    {
+        const ByteSpan& script = vout[k].script;
+        if (script.size >= 38 && std::memcmp(script.data, HEADER, sizeof(HEADER)) == 0)
+        {
+            found = k;
+            break;
+        }
+    }
+
+    if (found == vout.size())
+    {
+        for (const TransactionView& tx : block.vtx)
+            if (tx.HasWitness())
+                return SetReason(reason, "unexpected witness data");
+        return true;
+    }
+
+    if (coinbase.Inputs().size() != 1 || coinbase.GetWitnessCount(0) != 1 ||
+        coinbase.GetWitness(0, 0).size != 32)
+        return SetReason(reason, "bad witness reserved value");
+
+    // The coinbase's wtxid is taken as zero
+    std::vector<std::array<uint8_t,32>> leaves(block.vtx.size());
+    leaves[0].fill(0);
+    for (size_t i = 1; i < block.vtx.size(); ++i)
+        leaves[i] = block.vtx[i].GetWtxid();
+
+    uint8_t buf[64];
+    const std::array<uint8_t,32> root = ComputeMerkleRoot(std::move(leaves));
+    std::memcpy(buf, root.data(), 32);
+    std::memcpy(buf + 32, coinbase.GetWitness(0, 0).data, 32);
+
+    uint8_t commitment[32];
+    Hash::SHA256D(buf, sizeof(buf), commitment);
+    if (std::memcmp(vout[found].script.data + sizeof(HEADER), commitment, 32) != 0)
+        return SetReason(reason, "bad witness commitment");
+
+    return true;
+}
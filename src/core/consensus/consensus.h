@@ -0,0 +1,107 @@
+#ifndef DRACHMA_CONSENSUS_CONSENSUS_H
+#define DRACHMA_CONSENSUS_CONSENSUS_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "../chain/block.h"
+#include "../script/sighash.h"
+#include "../storage/coin.h"
+#include "../tx/txview.h"
+
+//
+// ===============================================================
+//  Consensus rules shared by every block connector
+// ===============================================================
+//
+//  BlockValidator applies these (IBDPipeline through it); the
+//  numbers are Bitcoin's (see MAX_MONEY). Locktimes are checked
+//  against the median time past (BIP113) and relative locktimes
+//  (BIP68) are enforced from genesis.
+//
+
+static const int64_t COIN = 100000000;
+
+// Blocks a coinbase output waits before it can be spent
+static const uint32_t COINBASE_MATURITY = 100;
+
+static const uint32_t SUBSIDY_HALVING_INTERVAL = 210000;
+
+// Block limits (BIP141): weight = base size * 3 + total size, and
+// legacy / P2SH signature operations count four times
+static const uint64_t MAX_BLOCK_WEIGHT = 4000000;
+static const int64_t MAX_BLOCK_SIGOPS_COST = 80000;
+static const int WITNESS_SCALE_FACTOR = 4;
+
+// nLockTime below this is a height, at or above a unix time
+static const uint32_t LOCKTIME_THRESHOLD = 500000000;
+
+// BIP68 nSequence fields
+static const uint32_t SEQUENCE_FINAL = 0xFFFFFFFF;
+static const uint32_t SEQUENCE_LOCKTIME_DISABLE_FLAG = 1u << 31;
+static const uint32_t SEQUENCE_LOCKTIME_TYPE_FLAG = 1u << 22;      // units of 512 s
+static const uint32_t SEQUENCE_LOCKTIME_MASK = 0x0000FFFF;
+static const int SEQUENCE_LOCKTIME_GRANULARITY = 9;
+
+// Median time past of the active-branch block at a height
+typedef std::function<int64_t(uint32_t height)> MedianTimeFn;
+
+//
+// Where a block is being connected
+//
+struct BlockContext
+{
+    uint32_t height;
+    int64_t medianTimePast;         // of the parent (0 for genesis)
+    MedianTimeFn medianTimeAt;      // for BIP68 time locks (without
+                                    // one they fail); may be called
+                                    // from several threads
+
+    BlockContext() : height(0), medianTimePast(0) {}
+};
+
+//
+// One input's script/signature check, run by whoever connects the
+// block (BlockValidator, IBDPipeline's check stage)
+//
+struct ScriptCheck
+{
+    const TransactionView* tx;
+    const PrecomputedTxData* txdata;    // shared by all inputs of `tx`
+    uint32_t input;
+    Coin coin;              // output being spent
+};
+
+typedef std::function<bool(const ScriptCheck& check)> ScriptCheckFn;
+
+// New coins per block at `height`
+int64_t GetBlockSubsidy(uint32_t height);
+
+// nLockTime satisfied in a block at `height` whose parent has
+// median time past `lockTimeCutoff`
+bool IsFinalTx(const TransactionView& tx, uint32_t height, int64_t lockTimeCutoff);
+
+// BIP68: `spent[j]` is the coin input j spends (its height is the
+// block's own for in-block parents)
+bool CheckSequenceLocks(const TransactionView& tx, const std::vector<Coin>& spent,
+                        const BlockContext& ctx);
+
+// Signature operation cost towards MAX_BLOCK_SIGOPS_COST; `spent`
+// as above (ignored for the coinbase)
+int64_t GetTransactionSigOpCost(const TransactionView& tx, const std::vector<Coin>& spent);
+
+// Weight of the whole serialized block, header and transaction
+// count included, towards MAX_BLOCK_WEIGHT
+uint64_t GetBlockWeight(const BlockView& block);
+
+// BIP141: the last coinbase output starting 6a24aa21a9ed commits
+// to SHA256D(witness merkle root || reserved value), the reserved
+// value being the coinbase input's only witness item (32 bytes).
+// Without such an output no transaction may carry witness data.
+// A failure means the block's witness data is not the data its
+// header commits to, not necessarily that the block is invalid.
+bool CheckWitnessCommitment(const BlockView& block, std::string* reason = nullptr);
+
+#endif // DRACHMA_CONSENSUS_CONSENSUS_H
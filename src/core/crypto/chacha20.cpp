@@ -0,0 +1,349 @@
+#include "chacha20.h"
+#include "../../common/utils/serialize.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CHACHA20_X86 1
+#endif
+
+static inline uint32_t ROTL32(uint32_t v, int c)
+{
+    return (v << c) | (v >> (32 - c));
+}
+
+static inline void QuarterRound(uint32_t x[16], int a, int b, int c, int d)
+{
+    x[a] += x[b]; x[d] = ROTL32(x[d] ^ x[a], 16);
+    x[c] += x[d]; x[b] = ROTL32(x[b] ^ x[c], 12);
+    x[a] += x[b]; x[d] = ROTL32(x[d] ^ x[a], 8);
+    x[c] += x[d]; x[b] = ROTL32(x[b] ^ x[c], 7);
+}
+
+//
+// ================================================================
+//  Kernels: `blocks` blocks from input[], counter advanced.
+//  in == nullptr writes the bare keystream.
+// ================================================================
+static void BlocksScalar(uint32_t input[16], const uint8_t* in, uint8_t* out, size_t blocks)
+{
+    while (blocks--)
+    {
+        uint32_t x[16];
+        std::memcpy(x, input, sizeof(x));
+
+        for (int i = 0; i < 10; ++i)
+        {
+            QuarterRound(x, 0, 4, 8, 12);
+            QuarterRound(x, 1, 5, 9, 13);
+            QuarterRound(x, 2, 6, 10, 14);
+            QuarterRound(x, 3, 7, 11, 15);
+            QuarterRound(x, 0, 5, 10, 15);
+            QuarterRound(x, 1, 6, 11, 12);
+            QuarterRound(x, 2, 7, 8, 13);
+            QuarterRound(x, 3, 4, 9, 14);
+        }
+
+        for (int i = 0; i < 16; ++i)
+        {
+            uint32_t w = x[i] + input[i];
+            if (in)
+                w ^= ReadLE32(in + 4 * i);
+            WriteLE32(out + 4 * i, w);
+        }
+
+        input[12]++;
+        if (in)
+            in += ChaCha20::BLOCKLEN;
+        out += ChaCha20::BLOCKLEN;
+    }
+}
+
+#ifdef CHACHA20_X86
+
+//
+// SSE2: four blocks side by side, one block per 32-bit lane
+//
+#define ROTL_SSE2(v, n) _mm_or_si128(_mm_slli_epi32(v, n), _mm_srli_epi32(v, 32 - (n)))
+
+#define QR_SSE2(a, b, c, d)                                             \
+    a = _mm_add_epi32(a, b); d = ROTL_SSE2(_mm_xor_si128(d, a), 16);    \
+    c = _mm_add_epi32(c, d); b = ROTL_SSE2(_mm_xor_si128(b, c), 12);    \
+    a = _mm_add_epi32(a, b); d = ROTL_SSE2(_mm_xor_si128(d, a), 8);     \
+    c = _mm_add_epi32(c, d); b = ROTL_SSE2(_mm_xor_si128(b, c), 7)
+
+static inline void Store128(const uint8_t* in, uint8_t* out, __m128i v)
+{
+    if (in)
+        v = _mm_xor_si128(v, _mm_loadu_si128((const __m128i*)in));
+    _mm_storeu_si128((__m128i*)out, v);
+}
+
+static void Blocks4SSE2(uint32_t input[16], const uint8_t* in, uint8_t* out)
+{
+    __m128i x[16], orig[16];
+    for (int i = 0; i < 16; ++i)
+        x[i] = _mm_set1_epi32((int)input[i]);
+    x[12] = _mm_add_epi32(x[12], _mm_set_epi32(3, 2, 1, 0));
+
+    for (int i = 0; i < 16; ++i)
+        orig[i] = x[i];
+
+    for (int i = 0; i < 10; ++i)
+    {
+        QR_SSE2(x[0], x[4], x[8], x[12]);
+        QR_SSE2(x[1], x[5], x[9], x[13]);
+        QR_SSE2(x[2], x[6], x[10], x[14]);
+        QR_SSE2(x[3], x[7], x[11], x[15]);
+        QR_SSE2(x[0], x[5], x[10], x[15]);
+        QR_SSE2(x[1], x[6], x[11], x[12]);
+        QR_SSE2(x[2], x[7], x[8], x[13]);
+        QR_SSE2(x[3], x[4], x[9], x[14]);
+    }
+
+    for (int i = 0; i < 16; ++i)
+        x[i] = _mm_add_epi32(x[i], orig[i]);
+
+    // Transpose each group of four words back into block order
+    for (int g = 0; g < 4; ++g)
+    {
+        const __m128i t0 = _mm_unpacklo_epi32(x[4 * g], x[4 * g + 1]);
+        const __m128i t1 = _mm_unpacklo_epi32(x[4 * g + 2], x[4 * g + 3]);
+        const __m128i t2 = _mm_unpackhi_epi32(x[4 * g], x[4 * g + 1]);
+        const __m128i t3 = _mm_unpackhi_epi32(x[4 * g + 2], x[4 * g + 3]);
+
+        const __m128i b[4] = {
+            _mm_unpacklo_epi64(t0, t1), _mm_unpackhi_epi64(t0, t1),
+            _mm_unpacklo_epi64(t2, t3), _mm_unpackhi_epi64(t2, t3)
+        };
+
+        for (int k = 0; k < 4; ++k)
+        {
+            const size_t off = 64 * k + 16 * g;
+            Store128(in ? in + off : nullptr, out + off, b[k]);
+        }
+    }
+
+    input[12] += 4;
+}
+
+//
+// AVX2: eight blocks; 16/8-bit rotations are byte shuffles
+//
+#define ROTL_AVX2(v, n) _mm256_or_si256(_mm256_slli_epi32(v, n), _mm256_srli_epi32(v, 32 - (n)))
+
+#define QR_AVX2(a, b, c, d)                                                     \
+    a = _mm256_add_epi32(a, b); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot16); \
+    c = _mm256_add_epi32(c, d); b = ROTL_AVX2(_mm256_xor_si256(b, c), 12);      \
+    a = _mm256_add_epi32(a, b); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot8);  \
+    c = _mm256_add_epi32(c, d); b = ROTL_AVX2(_mm256_xor_si256(b, c), 7)
+
+__attribute__((target("avx2")))
+static void Blocks8AVX2(uint32_t input[16], const uint8_t* in, uint8_t* out)
+{
+    const __m256i rot16 = _mm256_set_epi8(13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2,
+                                          13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2);
+    const __m256i rot8 = _mm256_set_epi8(14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3,
+                                         14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3);
+
+    __m256i x[16], orig[16];
+    for (int i = 0; i < 16; ++i)
+        x[i] = _mm256_set1_epi32((int)input[i]);
+    x[12] = _mm256_add_epi32(x[12], _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+
+    for (int i = 0; i < 16; ++i)
+        orig[i] = x[i];
+
+    for (int i = 0; i < 10; ++i)
+    {
+        QR_AVX2(x[0], x[4], x[8], x[12]);
+        QR_AVX2(x[1], x[5], x[9], x[13]);
+        QR_AVX2(x[2], x[6], x[10], x[14]);
+        QR_AVX2(x[3], x[7], x[11], x[15]);
+        QR_AVX2(x[0], x[5], x[10], x[15]);
+        QR_AVX2(x[1], x[6], x[11], x[12]);
+        QR_AVX2(x[2], x[7], x[8], x[13]);
+        QR_AVX2(x[3], x[4], x[9], x[14]);
+    }
+
+    for (int i = 0; i < 16; ++i)
+        x[i] = _mm256_add_epi32(x[i], orig[i]);
+
+    // Unpacks work per 128-bit half: the low half ends up holding
+    // blocks 0-3, the high half blocks 4-7
+    for (int g = 0; g < 4; ++g)
+    {
+        const __m256i t0 = _mm256_unpacklo_epi32(x[4 * g], x[4 * g + 1]);
+        const __m256i t1 = _mm256_unpacklo_epi32(x[4 * g + 2], x[4 * g + 3]);
+        const __m256i t2 = _mm256_unpackhi_epi32(x[4 * g], x[4 * g + 1]);
+        const __m256i t3 = _mm256_unpackhi_epi32(x[4 * g + 2], x[4 * g + 3]);
+
+        const __m256i b[4] = {
+            _mm256_unpacklo_epi64(t0, t1), _mm256_unpackhi_epi64(t0, t1),
+            _mm256_unpacklo_epi64(t2, t3), _mm256_unpackhi_epi64(t2, t3)
+        };
+
+        for (int k = 0; k < 4; ++k)
+        {
+            const size_t lo = 64 * k + 16 * g;
+            const size_t hi = lo + 4 * 64;
+            Store128(in ? in + lo : nullptr, out + lo, _mm256_castsi256_si128(b[k]));
+            Store128(in ? in + hi : nullptr, out + hi, _mm256_extracti128_si256(b[k], 1));
+        }
+    }
+
+    input[12] += 8;
+}
+
+static bool HaveAVX2()
+{
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+}
+
+#endif // CHACHA20_X86
+
+//
+// ================================================================
+//  ChaCha20
+// ================================================================
+ChaCha20::ChaCha20()
+{
+    std::memset(input, 0, sizeof(input));
+    bufferLeft = 0;
+}
+
+ChaCha20::ChaCha20(const uint8_t key[KEYLEN])
+{
+    SetKey(key);
+}
+
+ChaCha20::~ChaCha20()
+{
+    // Keep key material out of freed memory
+    volatile uint8_t* p = reinterpret_cast<volatile uint8_t*>(input);
+    for (size_t i = 0; i < sizeof(input); ++i)
+        p[i] = 0;
+    p = buffer;
+    for (size_t i = 0; i < sizeof(buffer); ++i)
+        p[i] = 0;
+}
+
+void ChaCha20::SetKey(const uint8_t key[KEYLEN])
+{
+    input[0] = 0x61707865;                  // "expand 32-byte k"
+    input[1] = 0x3320646e;
+    input[2] = 0x79622d32;
+    input[3] = 0x6b206574;
+    for (int i = 0; i < 8; ++i)
+        input[4 + i] = ReadLE32(key + 4 * i);
+    input[12] = 0;
+    input[13] = 0;
+    input[14] = 0;
+    input[15] = 0;
+    bufferLeft = 0;
+}
+
+void ChaCha20::Seek(uint32_t nonceLow, uint64_t nonceHigh, uint32_t block)
+{
+    input[12] = block;
+    input[13] = nonceLow;
+    input[14] = (uint32_t)nonceHigh;
+    input[15] = (uint32_t)(nonceHigh >> 32);
+    bufferLeft = 0;
+}
+
+const char* ChaCha20::GetImplementation()
+{
+#ifdef CHACHA20_X86
+    return HaveAVX2() ? "avx2" : "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+void ChaCha20::Blocks(const uint8_t* in, uint8_t* out, size_t blocks)
+{
+#ifdef CHACHA20_X86
+    if (HaveAVX2())
+    {
+        while (blocks >= 8)
+        {
+            Blocks8AVX2(input, in, out);
+            if (in) in += 8 * BLOCKLEN;
+            out += 8 * BLOCKLEN;
+            blocks -= 8;
+        }
+    }
+
+    while (blocks >= 4)
+    {
+        Blocks4SSE2(input, in, out);
+        if (in) in += 4 * BLOCKLEN;
+        out += 4 * BLOCKLEN;
+        blocks -= 4;
+    }
+#endif
+
+    BlocksScalar(input, in, out, blocks);
+}
+
+void ChaCha20::Keystream(uint8_t* out, size_t len)
+{
+    if (bufferLeft)
+    {
+        const size_t n = len < bufferLeft ? len : bufferLeft;
+        std::memcpy(out, buffer + BLOCKLEN - bufferLeft, n);
+        bufferLeft -= n;
+        out += n;
+        len -= n;
+    }
+
+    const size_t whole = len / BLOCKLEN;
+    if (whole)
+    {
+        Blocks(nullptr, out, whole);
+        out += whole * BLOCKLEN;
+        len -= whole * BLOCKLEN;
+    }
+
+    if (len)
+    {
+        Blocks(nullptr, buffer, 1);
+        std::memcpy(out, buffer, len);
+        bufferLeft = BLOCKLEN - len;
+    }
+}
+
+void ChaCha20::Crypt(const uint8_t* in, uint8_t* out, size_t len)
+{
+    if (bufferLeft)
+    {
+        const size_t n = len < bufferLeft ? len : bufferLeft;
+        const uint8_t* ks = buffer + BLOCKLEN - bufferLeft;
+        for (size_t i = 0; i < n; ++i)
+            out[i] = in[i] ^ ks[i];
+        bufferLeft -= n;
+        in += n;
+        out += n;
+        len -= n;
+    }
+
+    const size_t whole = len / BLOCKLEN;
+    if (whole)
+    {
+        Blocks(in, out, whole);
+        in += whole * BLOCKLEN;
+        out += whole * BLOCKLEN;
+        len -= whole * BLOCKLEN;
+    }
+
+    if (len)
+    {
+        Blocks(nullptr, buffer, 1);
+        for (size_t i = 0; i < len; ++i)
+            out[i] = in[i] ^ buffer[i];
+        bufferLeft = BLOCKLEN - len;
+    }
+}
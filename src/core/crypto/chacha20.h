@@ -0,0 +1,52 @@
+#ifndef DRACHMA_CRYPTO_CHACHA20_H
+#define DRACHMA_CRYPTO_CHACHA20_H
+
+#include <cstdint>
+#include <cstddef>
+
+//
+// ===============================================================
+//  CLASS: ChaCha20 (RFC 8439: 96-bit nonce, 32-bit block counter)
+// ===============================================================
+//
+//  Whole blocks go through the widest kernel the CPU has: AVX2
+//  (8 blocks per pass), SSE2 (4 blocks), else scalar. Partial
+//  blocks are buffered, so Crypt() / Keystream() calls of any
+//  length continue one stream.
+//
+//  Nonces are (u32, u64) pairs as in BIP324, serialized LE32 then
+//  LE64 into the RFC 8439 nonce words.
+//
+// ===============================================================
+//
+class ChaCha20
+{
+public:
+    static constexpr size_t KEYLEN = 32;
+    static constexpr size_t BLOCKLEN = 64;
+
+    ChaCha20();
+    explicit ChaCha20(const uint8_t key[KEYLEN]);
+    ~ChaCha20();
+
+    // Also resets the nonce and counter to zero
+    void SetKey(const uint8_t key[KEYLEN]);
+    void Seek(uint32_t nonceLow, uint64_t nonceHigh, uint32_t block);
+
+    void Keystream(uint8_t* out, size_t len);
+
+    // out = in ^ keystream; in == out is allowed
+    void Crypt(const uint8_t* in, uint8_t* out, size_t len);
+
+    // Kernel in use: "avx2", "sse2" or "scalar"
+    static const char* GetImplementation();
+
+private:
+    void Blocks(const uint8_t* in, uint8_t* out, size_t blocks);
+
+    uint32_t input[16];
+    uint8_t buffer[BLOCKLEN];
+    size_t bufferLeft;                  // unused keystream at the end of buffer
+};
+
+#endif
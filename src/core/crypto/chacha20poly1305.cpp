@@ -0,0 +1,157 @@
+#include "chacha20poly1305.h"
+#include "../../common/utils/serialize.h"
+
+#include <cstring>
+
+static const uint8_t ZEROES[16] = {0};
+
+static bool TagEqual(const uint8_t* a, const uint8_t* b)
+{
+    uint8_t diff = 0;
+    for (size_t i = 0; i < Poly1305::TAGLEN; ++i)
+        diff |= a[i] ^ b[i];
+    return diff == 0;
+}
+
+//
+// ================================================================
+//  AEADChaCha20Poly1305
+// ================================================================
+AEADChaCha20Poly1305::AEADChaCha20Poly1305(const uint8_t key[KEYLEN])
+    : chacha(key)
+{
+}
+
+void AEADChaCha20Poly1305::SetKey(const uint8_t key[KEYLEN])
+{
+    chacha.SetKey(key);
+}
+
+void AEADChaCha20Poly1305::ComputeTag(const uint8_t* cipher, size_t len,
+                                      const uint8_t* aad, size_t aadLen,
+                                      uint8_t tag[EXPANSION])
+{
+    // One-time key: the first half of block 0 (chacha is seeked to
+    // block 0 of the nonce by the caller)
+    uint8_t polyKey[ChaCha20::BLOCKLEN];
+    chacha.Keystream(polyKey, sizeof(polyKey));
+
+    Poly1305 poly(polyKey);
+    std::memset(polyKey, 0, sizeof(polyKey));
+
+    poly.Update(aad, aadLen);
+    poly.Update(ZEROES, (16 - aadLen % 16) % 16);
+    poly.Update(cipher, len);
+    poly.Update(ZEROES, (16 - len % 16) % 16);
+
+    uint8_t lengths[16];
+    WriteLE64(lengths, aadLen);
+    WriteLE64(lengths + 8, len);
+    poly.Update(lengths, sizeof(lengths));
+
+    poly.Final(tag);
+}
+
+void AEADChaCha20Poly1305::Encrypt(uint8_t* data, size_t len, const uint8_t* aad, size_t aadLen,
+                                   uint32_t nonceLow, uint64_t nonceHigh, uint8_t tag[EXPANSION])
+{
+    chacha.Seek(nonceLow, nonceHigh, 1);
+    chacha.Crypt(data, data, len);
+
+    chacha.Seek(nonceLow, nonceHigh, 0);
+    ComputeTag(data, len, aad, aadLen, tag);
+}
+
+bool AEADChaCha20Poly1305::Decrypt(uint8_t* data, size_t len, const uint8_t* aad, size_t aadLen,
+                                   uint32_t nonceLow, uint64_t nonceHigh, const uint8_t tag[EXPANSION])
+{
+    uint8_t expected[EXPANSION];
+    chacha.Seek(nonceLow, nonceHigh, 0);
+    ComputeTag(data, len, aad, aadLen, expected);
+
+    if (!TagEqual(expected, tag))
+        return false;
+
+    chacha.Seek(nonceLow, nonceHigh, 1);
+    chacha.Crypt(data, data, len);
+    return true;
+}
+
+void AEADChaCha20Poly1305::Keystream(uint32_t nonceLow, uint64_t nonceHigh, uint8_t* out, size_t len)
+{
+    chacha.Seek(nonceLow, nonceHigh, 0);
+    chacha.Keystream(out, len);
+}
+
+//
+// ================================================================
+//  FSChaCha20
+// ================================================================
+FSChaCha20::FSChaCha20(const uint8_t key[ChaCha20::KEYLEN], uint32_t interval)
+    : chacha(key)
+{
+    rekeyInterval = interval;
+    chunkCounter = 0;
+    rekeyCounter = 0;
+}
+
+void FSChaCha20::Crypt(const uint8_t* in, uint8_t* out, size_t len)
+{
+    chacha.Crypt(in, out, len);
+
+    if (++chunkCounter == rekeyInterval)
+    {
+        uint8_t key[ChaCha20::KEYLEN];
+        chacha.Keystream(key, sizeof(key));
+        chacha.SetKey(key);
+        std::memset(key, 0, sizeof(key));
+
+        chunkCounter = 0;
+        rekeyCounter++;
+        chacha.Seek(0, rekeyCounter, 0);
+    }
+}
+
+//
+// ================================================================
+//  FSChaCha20Poly1305
+// ================================================================
+FSChaCha20Poly1305::FSChaCha20Poly1305(const uint8_t key[AEADChaCha20Poly1305::KEYLEN], uint32_t interval)
+    : aead(key)
+{
+    rekeyInterval = interval;
+    packetCounter = 0;
+    rekeyCounter = 0;
+}
+
+void FSChaCha20Poly1305::NextPacket()
+{
+    if (++packetCounter == rekeyInterval)
+    {
+        // A whole block, though only the first 32 bytes become the key
+        uint8_t block[ChaCha20::BLOCKLEN];
+        aead.Keystream(0xFFFFFFFF, rekeyCounter, block, sizeof(block));
+        aead.SetKey(block);
+        std::memset(block, 0, sizeof(block));
+
+        packetCounter = 0;
+        rekeyCounter++;
+    }
+}
+
+void FSChaCha20Poly1305::Encrypt(uint8_t* data, size_t len, const uint8_t* aad, size_t aadLen,
+                                 uint8_t tag[EXPANSION])
+{
+    aead.Encrypt(data, len, aad, aadLen, packetCounter, rekeyCounter, tag);
+    NextPacket();
+}
+
+bool FSChaCha20Poly1305::Decrypt(uint8_t* data, size_t len, const uint8_t* aad, size_t aadLen,
+                                 const uint8_t tag[EXPANSION])
+{
+    // The counter moves on even for a bad packet; the session is
+    // dropped on failure anyway
+    const bool ok = aead.Decrypt(data, len, aad, aadLen, packetCounter, rekeyCounter, tag);
+    NextPacket();
+    return ok;
+}
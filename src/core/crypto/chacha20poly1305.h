@@ -0,0 +1,88 @@
+#ifndef DRACHMA_CRYPTO_CHACHA20POLY1305_H
+#define DRACHMA_CRYPTO_CHACHA20POLY1305_H
+
+#include <cstdint>
+#include <cstddef>
+
+#include "chacha20.h"
+#include "poly1305.h"
+
+//
+// ===============================================================
+//  CLASS: AEADChaCha20Poly1305 (RFC 8439)
+// ===============================================================
+//
+//  Works in place: the caller's buffer is encrypted / decrypted
+//  where it lies and the 16-byte tag is kept separately, so packet
+//  buffers need no second copy.
+//
+// ===============================================================
+//
+class AEADChaCha20Poly1305
+{
+public:
+    static constexpr size_t KEYLEN = 32;
+    static constexpr size_t EXPANSION = Poly1305::TAGLEN;
+
+    explicit AEADChaCha20Poly1305(const uint8_t key[KEYLEN]);
+
+    void SetKey(const uint8_t key[KEYLEN]);
+
+    void Encrypt(uint8_t* data, size_t len, const uint8_t* aad, size_t aadLen,
+                 uint32_t nonceLow, uint64_t nonceHigh, uint8_t tag[EXPANSION]);
+
+    // Checks the tag first; on failure `data` is left untouched
+    bool Decrypt(uint8_t* data, size_t len, const uint8_t* aad, size_t aadLen,
+                 uint32_t nonceLow, uint64_t nonceHigh, const uint8_t tag[EXPANSION]);
+
+    // Raw keystream from block 0 of the nonce (used for rekeying)
+    void Keystream(uint32_t nonceLow, uint64_t nonceHigh, uint8_t* out, size_t len);
+
+private:
+    void ComputeTag(const uint8_t* cipher, size_t len, const uint8_t* aad, size_t aadLen,
+                    uint8_t tag[EXPANSION]);
+
+    ChaCha20 chacha;
+};
+
+//
+// BIP324 forward-secure wrappers: every `rekeyInterval` uses the
+// key is replaced by keystream derived from itself.
+//
+
+// Length cipher: one continuous ChaCha20 stream per key
+class FSChaCha20
+{
+public:
+    FSChaCha20(const uint8_t key[ChaCha20::KEYLEN], uint32_t rekeyInterval);
+
+    void Crypt(const uint8_t* in, uint8_t* out, size_t len);
+
+private:
+    ChaCha20 chacha;
+    uint32_t rekeyInterval;
+    uint32_t chunkCounter;
+    uint64_t rekeyCounter;
+};
+
+// Packet cipher: nonce = (packet counter, rekey counter)
+class FSChaCha20Poly1305
+{
+public:
+    static constexpr size_t EXPANSION = AEADChaCha20Poly1305::EXPANSION;
+
+    FSChaCha20Poly1305(const uint8_t key[AEADChaCha20Poly1305::KEYLEN], uint32_t rekeyInterval);
+
+    void Encrypt(uint8_t* data, size_t len, const uint8_t* aad, size_t aadLen, uint8_t tag[EXPANSION]);
+    bool Decrypt(uint8_t* data, size_t len, const uint8_t* aad, size_t aadLen, const uint8_t tag[EXPANSION]);
+
+private:
+    void NextPacket();
+
+    AEADChaCha20Poly1305 aead;
+    uint32_t rekeyInterval;
+    uint32_t packetCounter;
+    uint64_t rekeyCounter;
+};
+
+#endif
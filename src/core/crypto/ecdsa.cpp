@@ -3,19 +3,22 @@
 #include "hash.h"
 
 #include "secp256k1/secp256k1.h"
+#include "secp256k1/secp256k1_ellswift.h"
 
 #include <cstring>
+#include <mutex>
 #include <random>
 #include <cassert>
 
 static secp256k1_context* secpCtx = nullptr;
+static std::once_flag secpOnce;
 
 static void InitSecp()
 {
-    if (!secpCtx)
-    {
+    // Network threads reach this concurrently (BIP324 handshakes)
+    std::call_once(secpOnce, [] {
         secpCtx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN | SECP256K1_CONTEXT_VERIFY);
-    }
+    });
 }
 
 //
@@ -33,9 +36,11 @@ std::vector<uint8_t> Signature::ToDER() const
     std::vector<uint8_t> ri(r.begin(), r.end());
     std::vector<uint8_t> si(s.begin(), s.end());
 
-    // Trim leading zeros
+    // Trim leading zeros, then keep both integers positive
     while (ri.size() > 1 && ri[0] == 0) ri.erase(ri.begin());
     while (si.size() > 1 && si[0] == 0) si.erase(si.begin());
+    if (ri[0] & 0x80) ri.insert(ri.begin(), 0x00);
+    if (si[0] & 0x80) si.insert(si.begin(), 0x00);
 
     size_t len = 2 + ri.size() + 2 + si.size();
     out.push_back(len);
@@ -55,30 +60,40 @@ std::vector<uint8_t> Signature::ToDER() const
 
 bool Signature::FromDER(const std::vector<uint8_t>& der, Signature& out)
 {
-    if (der.size() < 8) return false;
-    if (der[0] != 0x30) return false;
-
-    size_t p = 2; // skip sequence header
-
-    if (der[p++] != 0x02) return false;
-    int rlen = der[p++];
-    if (rlen <= 0 || p + rlen > der.size()) return false;
-
-    std::vector<uint8_t> rv(32, 0);
-    std::memcpy(rv.data() + (32 - rlen), &der[p], rlen);
-    p += rlen;
-
-    if (der[p++] != 0x02) return false;
-    int slen = der[p++];
-    if (slen <= 0 || p + slen > der.size()) return false;
+    return FromDER(der.data(), der.size(), out);
+}
 
-    std::vector<uint8_t> sv(32, 0);
-    std::memcpy(sv.data() + (32 - slen), &der[p], slen);
+bool Signature::FromDER(const uint8_t* der, size_t size, Signature& out)
+{
+    // Strict DER as BIP66 has it: the sequence length covers exactly
+    // the rest of the input
+    if (size < 8 || size > 72) return false;
+    if (der[0] != 0x30 || der[1] != size - 2) return false;
 
-    std::memcpy(out.r.data(), rv.data(), 32);
-    std::memcpy(out.s.data(), sv.data(), 32);
+    size_t p = 2; // skip sequence header
 
-    return true;
+    // INTEGER: 0x02 len value, positive and minimally encoded, at
+    // most 32 bytes once a sign-padding zero is dropped
+    auto readInt = [der, size, &p](std::array<uint8_t,32>& v) -> bool
+    {
+        if (p + 2 > size || der[p] != 0x02) return false;
+        size_t len = der[p + 1];
+        p += 2;
+        if (len == 0 || p + len > size) return false;
+
+        const uint8_t* d = &der[p];
+        p += len;
+        if (d[0] & 0x80) return false;
+        if (len > 1 && d[0] == 0x00 && !(d[1] & 0x80)) return false;
+        if (len > 1 && d[0] == 0x00) { ++d; --len; }
+        if (len > 32) return false;
+
+        v.fill(0);
+        std::memcpy(v.data() + (32 - len), d, len);
+        return true;
+    };
+
+    return readInt(out.r) && readInt(out.s) && p == size;
 }
 
 //
@@ -288,11 +303,50 @@ bool PublicKey::Verify(const std::array<uint8_t,32>& msgHash, const Signature& s
     std::memcpy(tmp.data(), sig.r.data(), 32);
     std::memcpy(tmp.data()+32, sig.s.data(), 32);
 
-    secp256k1_ecdsa_signature_parse_compact(secpCtx, &secpSig, tmp.data());
+    if (!secp256k1_ecdsa_signature_parse_compact(secpCtx, &secpSig, tmp.data()))
+        return false;
+
+    // libsecp256k1 only accepts low-S; high-S signatures are valid
+    // in consensus, so normalize first
+    secp256k1_ecdsa_signature_normalize(secpCtx, &secpSig, &secpSig);
 
     return secp256k1_ecdsa_verify(secpCtx, &secpSig, msgHash.data(), &pub);
 }
 
+//
+// ================================================================
+//  EllSwift
+// ================================================================
+bool EllSwift::Encode(const PrivateKey& priv, const std::array<uint8_t,32>& entropy,
+                      std::array<uint8_t,64>& out)
+{
+    if (!priv.IsValid())
+        return false;
+
+    InitSecp();
+    return secp256k1_ellswift_create(secpCtx, out.data(), priv.GetBytes().data(), entropy.data()) == 1;
+}
+
+bool EllSwift::ECDH(const PrivateKey& priv,
+                    const std::array<uint8_t,64>& ours,
+                    const std::array<uint8_t,64>& theirs,
+                    bool initiator,
+                    std::array<uint8_t,32>& secret)
+{
+    if (!priv.IsValid())
+        return false;
+
+    InitSecp();
+
+    // Party A is the initiator; its encoding is hashed first
+    const uint8_t* a = initiator ? ours.data() : theirs.data();
+    const uint8_t* b = initiator ? theirs.data() : ours.data();
+
+    return secp256k1_ellswift_xdh(secpCtx, secret.data(), a, b, priv.GetBytes().data(),
+                                  initiator ? 0 : 1,
+                                  secp256k1_ellswift_xdh_hash_function_bip324, nullptr) == 1;
+}
+
 //
 // ================================================================
 //  ECDSA class (wrappers)
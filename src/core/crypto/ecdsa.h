@@ -39,8 +39,9 @@ struct Signature
     // DER encode
     std::vector<uint8_t> ToDER() const;
 
-    // From DER
+    // From strict DER (BIP66, without the hash type byte)
     static bool FromDER(const std::vector<uint8_t>& der, Signature& out);
+    static bool FromDER(const uint8_t* der, size_t len, Signature& out);
 };
 
 
@@ -109,6 +110,30 @@ private:
 };
 
 
+//
+// ===============================================================
+//  CLASS: EllSwift - ElligatorSwift ECDH (BIP324 key exchange)
+// ===============================================================
+//
+//  Public keys travel as 64 bytes indistinguishable from random.
+//  ECDH() hashes the x-only shared point together with both
+//  encodings (BIP324 tagged hash), initiator's first.
+//
+class EllSwift
+{
+public:
+    // `entropy` randomizes which of the many encodings is picked
+    static bool Encode(const PrivateKey& priv, const std::array<uint8_t,32>& entropy,
+                       std::array<uint8_t,64>& out);
+
+    static bool ECDH(const PrivateKey& priv,
+                     const std::array<uint8_t,64>& ours,
+                     const std::array<uint8_t,64>& theirs,
+                     bool initiator,
+                     std::array<uint8_t,32>& secret);
+};
+
+
 //
 // ===============================================================
 //  CLASS: ECDSA - Core SECP256K1 Math
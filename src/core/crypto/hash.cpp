@@ -13,6 +13,18 @@ std::vector<uint8_t> Hash::SHA256D(const uint8_t* data, size_t len)
     return SHA256D(v);
 }
 
+void Hash::SHA256D(const uint8_t* data, size_t len, uint8_t out[32])
+{
+    // Allocation-free variant for hot paths (checksums, txids)
+    ::SHA256 ctx;
+    ctx.Update(data, len);
+    ctx.Final(out);
+
+    ctx.Reset();
+    ctx.Update(out, 32);
+    ctx.Final(out);
+}
+
 std::vector<uint8_t> Hash::Hash160(const std::vector<uint8_t>& data)
 {
     auto sha = SHA256(data);
@@ -25,9 +37,22 @@ std::vector<uint8_t> Hash::Hash160(const uint8_t* data, size_t len)
     return Hash160(v);
 }
 
+void Hash::Hash160(const uint8_t* data, size_t len, uint8_t out[20])
+{
+    // Allocation-free variant for script checks
+    uint8_t sha[32];
+    ::SHA256 ctx;
+    ctx.Update(data, len);
+    ctx.Final(sha);
+
+    RIPEMD160 rmd;
+    rmd.Update(sha, 32);
+    rmd.Final(out);
+}
+
 std::vector<uint8_t> Hash::SHA256(const std::vector<uint8_t>& data)
 {
-    SHA256 ctx;
+    ::SHA256 ctx;
     ctx.Update(data);
     return ctx.Final();
 }
@@ -14,12 +14,14 @@ public:
     //
     static std::vector<uint8_t> SHA256D(const std::vector<uint8_t>& data);
     static std::vector<uint8_t> SHA256D(const uint8_t* data, size_t len);
+    static void SHA256D(const uint8_t* data, size_t len, uint8_t out[32]);
 
     //
     // HASH160 = RIPEMD160(SHA256(data))
     //
     static std::vector<uint8_t> Hash160(const std::vector<uint8_t>& data);
     static std::vector<uint8_t> Hash160(const uint8_t* data, size_t len);
+    static void Hash160(const uint8_t* data, size_t len, uint8_t out[20]);
 
     //
     // HMAC-SHA256
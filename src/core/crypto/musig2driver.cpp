@@ -0,0 +1,190 @@
+#include "musig2driver.h"
+#include "hash.h"
+
+#include <chrono>
+#include <cstring>
+#include <random>
+
+typedef std::chrono::steady_clock Clock;
+
+static double MicrosSince(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+static bool SetReason(std::string* reason, const std::string& text)
+{
+    if (reason)
+        *reason = text;
+    return false;
+}
+
+// BIP341 key-path-only tweak: tagged hash "TapTweak" of the key
+static std::array<uint8_t,32> TapTweak(const XOnlyPubKey& key)
+{
+    const std::string tag = "TapTweak";
+    const std::vector<uint8_t> tagHash = Hash::SHA256(std::vector<uint8_t>(tag.begin(), tag.end()));
+
+    std::vector<uint8_t> data(tagHash);
+    data.insert(data.end(), tagHash.begin(), tagHash.end());
+    data.insert(data.end(), key.GetBytes().begin(), key.GetBytes().end());
+
+    const std::vector<uint8_t> h = Hash::SHA256(data);
+    std::array<uint8_t,32> out;
+    std::memcpy(out.data(), h.data(), out.size());
+    return out;
+}
+
+bool MuSig2SessionDriver::Run(const Options& opts, Report& report, std::string* reason)
+{
+    report = Report();
+
+    const size_t n = opts.signers;
+    if (n == 0)
+        return SetReason(reason, "signers must be non-zero");
+    if (opts.tamperSigner != NO_SIGNER && opts.tamperSigner >= n)
+        return SetReason(reason, "tamperSigner is not a signer");
+
+    std::vector<PrivateKey> keys;
+    std::vector<PublicKey> pubs;
+    for (size_t i = 0; i < n; ++i)
+    {
+        keys.push_back(PrivateKey::Generate());
+        pubs.push_back(keys.back().GetPublicKey());
+    }
+
+    std::array<uint8_t,32> msg;
+    std::mt19937_64 rng(std::random_device{}());
+    for (size_t i = 0; i < msg.size(); i += 8)
+    {
+        const uint64_t r = rng();
+        std::memcpy(msg.data() + i, &r, 8);
+    }
+
+    // 1. Key aggregation
+    Clock::time_point start = Clock::now();
+    std::vector<PublicKey> sorted = pubs;
+    MuSig2::SortKeys(sorted);
+
+    MuSig2::KeyAgg keyagg;
+    if (!keyagg.Aggregate(sorted))
+        return SetReason(reason, "key aggregation failed");
+    if (opts.tweak && !keyagg.TweakXOnly(TapTweak(keyagg.GetAggregateKey())))
+        return SetReason(reason, "tweak failed");
+    report.keyAggMicros = MicrosSince(start);
+    report.aggregateKey = keyagg.GetAggregateKey();
+
+    // 2-3. Nonces and the session
+    start = Clock::now();
+    std::vector<MuSig2::SecNonce> secnonces(n);
+    std::vector<MuSig2::PubNonce> pubnonces(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (!MuSig2::NonceGen(keys[i], keyagg, &msg, secnonces[i], pubnonces[i]))
+            return SetReason(reason, "nonce generation failed for signer " + std::to_string(i));
+    }
+
+    MuSig2::AggNonce aggnonce;
+    MuSig2::Session session;
+    if (!MuSig2::NonceAgg(pubnonces, aggnonce))
+        return SetReason(reason, "nonce aggregation failed");
+    if (!session.Start(aggnonce, msg, keyagg))
+        return SetReason(reason, "session start failed");
+    report.nonceMicros = MicrosSince(start);
+
+    // 4. Partial signatures
+    start = Clock::now();
+    std::vector<MuSig2::PartialSig> partials(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (!MuSig2::PartialSign(keys[i], secnonces[i], keyagg, session, partials[i]))
+            return SetReason(reason, "partial signing failed for signer " + std::to_string(i));
+    }
+    report.signMicros = MicrosSince(start);
+
+    report.nonceReuseRefused = true;
+    for (size_t i = 0; i < n; ++i)
+    {
+        MuSig2::PartialSig again;
+        if (secnonces[i].IsUsable() || MuSig2::PartialSign(keys[i], secnonces[i], keyagg, session, again))
+            report.nonceReuseRefused = false;
+    }
+
+    if (opts.tamperSigner != NO_SIGNER)
+        partials[opts.tamperSigner][31] ^= 1;
+
+    // 5. Verification and aggregation
+    start = Clock::now();
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (!MuSig2::PartialVerify(partials[i], pubnonces[i], pubs[i], keyagg, session))
+            report.badPartials.push_back(i);
+    }
+    report.partialVerifyMicros = MicrosSince(start);
+
+    start = Clock::now();
+    if (!MuSig2::Aggregate(session, partials, report.signature))
+        return SetReason(reason, "signature aggregation failed");
+    report.aggregateMicros = MicrosSince(start);
+
+    start = Clock::now();
+    report.verified = report.aggregateKey.VerifySchnorr(msg, report.signature);
+    report.verifyMicros = MicrosSince(start);
+
+    // What the n-of-n policy costs with one ECDSA signature each
+    std::vector<Signature> ecdsa;
+    for (size_t i = 0; i < n; ++i)
+        ecdsa.push_back(keys[i].Sign(msg));
+
+    start = Clock::now();
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (!pubs[i].Verify(msg, ecdsa[i]))
+            return SetReason(reason, "ECDSA reference signature did not verify");
+    }
+    report.ecdsaVerifyMicros = MicrosSince(start);
+
+    return true;
+}
+
+bool MuSig2SessionDriver::SelfTest(std::string* reason)
+{
+    struct Case
+    {
+        const char* name;
+        size_t signers;
+        bool tweak;
+        size_t tamperSigner;
+    };
+
+    static const Case cases[] = {
+        { "2-of-2", 2, false, NO_SIGNER },
+        { "5-of-5", 5, false, NO_SIGNER },
+        { "tweaked 3-of-3", 3, true, NO_SIGNER },
+        { "3-of-3, tampered partial", 3, false, 0 },
+    };
+
+    for (const Case& c : cases)
+    {
+        Options opts;
+        opts.signers = c.signers;
+        opts.tweak = c.tweak;
+        opts.tamperSigner = c.tamperSigner;
+
+        Report report;
+        std::string why;
+        if (!Run(opts, report, &why))
+            return SetReason(reason, std::string(c.name) + ": " + why);
+
+        const bool honest = c.tamperSigner == NO_SIGNER;
+        if (report.verified != honest)
+            return SetReason(reason, std::string(c.name) + ": final signature " +
+                                     (honest ? "does not verify" : "verifies"));
+        if (honest ? !report.badPartials.empty()
+                   : report.badPartials != std::vector<size_t>(1, c.tamperSigner))
+            return SetReason(reason, std::string(c.name) + ": partial verification blamed the wrong signers");
+        if (!report.nonceReuseRefused)
+            return SetReason(reason, std::string(c.name) + ": a spent nonce signed again");
+    }
+    return true;
+}
@@ -0,0 +1,78 @@
+#ifndef DRACHMA_MUSIG2DRIVER_H
+#define DRACHMA_MUSIG2DRIVER_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "schnorr.h"
+
+//
+// ===============================================================
+//  CLASS: MuSig2SessionDriver
+// ===============================================================
+//
+//  Runs a whole MuSig2 signing session in one process, every
+//  signer played locally through the public API in the order
+//  the MuSig2 notes give: fresh keys, KeyAgg over the sorted
+//  keys (tweaked with the BIP341 key-path TapTweak when `tweak`),
+//  NonceGen per signer, NonceAgg, Session::Start, PartialSign per
+//  signer, then PartialVerify of every partial signature,
+//  Aggregate() and one VerifySchnorr() under the aggregate key.
+//
+//  `tamperSigner` flips a bit in that signer's partial signature
+//  before verification, as a cheating signer would; PartialVerify
+//  must name it and the final signature must not verify. Each
+//  signer also tries to sign a second time with its spent
+//  SecNonce, which must be refused.
+//
+//  Run() fails only when the API does (reason says where); what a
+//  session proved is in the Report, together with the time each
+//  step took for all signers and what n ECDSA verifications of the
+//  same message cost, the check one MuSig2 signature replaces.
+//
+//  SelfTest() runs the standard sessions (2-of-2, 5-of-5, tweaked
+//  3-of-3, 3-of-3 with a tampered partial) and checks each
+//  outcome.
+//
+// ===============================================================
+//
+class MuSig2SessionDriver
+{
+public:
+    static const size_t NO_SIGNER = (size_t)-1;
+
+    struct Options
+    {
+        size_t signers;
+        bool tweak;
+        size_t tamperSigner;            // NO_SIGNER: everyone honest
+
+        Options() : signers(3), tweak(false), tamperSigner(NO_SIGNER) {}
+    };
+
+    struct Report
+    {
+        XOnlyPubKey aggregateKey;
+        std::array<uint8_t,64> signature;
+        bool verified;                  // final signature under aggregateKey
+        std::vector<size_t> badPartials;// signers PartialVerify() rejected
+        bool nonceReuseRefused;         // by every signer
+
+        double keyAggMicros;
+        double nonceMicros;             // NonceGen for all, NonceAgg, Start
+        double signMicros;              // PartialSign for all
+        double partialVerifyMicros;
+        double aggregateMicros;
+        double verifyMicros;            // the one Schnorr verification
+        double ecdsaVerifyMicros;       // n ECDSA verifications instead
+    };
+
+    static bool Run(const Options& opts, Report& report, std::string* reason = nullptr);
+
+    static bool SelfTest(std::string* reason = nullptr);
+};
+
+#endif // DRACHMA_MUSIG2DRIVER_H
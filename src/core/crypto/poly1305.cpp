@@ -0,0 +1,156 @@
+#include "poly1305.h"
+#include "../../common/utils/serialize.h"
+
+#include <cstring>
+
+typedef unsigned __int128 uint128_t;
+
+static const uint64_t MASK44 = 0xfffffffffffULL;
+static const uint64_t MASK42 = 0x3ffffffffffULL;
+
+Poly1305::Poly1305(const uint8_t key[KEYLEN])
+{
+    const uint64_t t0 = ReadLE64(key);
+    const uint64_t t1 = ReadLE64(key + 8);
+
+    // r is clamped as the RFC requires
+    r[0] = t0 & 0xffc0fffffffULL;
+    r[1] = ((t0 >> 44) | (t1 << 20)) & 0xfffffc0ffffULL;
+    r[2] = (t1 >> 24) & 0x00ffffffc0fULL;
+
+    h[0] = h[1] = h[2] = 0;
+
+    pad[0] = ReadLE64(key + 16);
+    pad[1] = ReadLE64(key + 24);
+
+    leftover = 0;
+}
+
+Poly1305::~Poly1305()
+{
+    volatile uint64_t* p = r;
+    p[0] = p[1] = p[2] = 0;
+    p = pad;
+    p[0] = p[1] = 0;
+}
+
+void Poly1305::Blocks(const uint8_t* m, size_t bytes, uint64_t hibit)
+{
+    const uint64_t r0 = r[0], r1 = r[1], r2 = r[2];
+    const uint64_t s1 = r1 * (5 << 2);
+    const uint64_t s2 = r2 * (5 << 2);
+
+    uint64_t h0 = h[0], h1 = h[1], h2 = h[2];
+
+    while (bytes >= 16)
+    {
+        const uint64_t t0 = ReadLE64(m);
+        const uint64_t t1 = ReadLE64(m + 8);
+
+        h0 += t0 & MASK44;
+        h1 += ((t0 >> 44) | (t1 << 20)) & MASK44;
+        h2 += ((t1 >> 24) & MASK42) | hibit;
+
+        uint128_t d0 = (uint128_t)h0 * r0 + (uint128_t)h1 * s2 + (uint128_t)h2 * s1;
+        uint128_t d1 = (uint128_t)h0 * r1 + (uint128_t)h1 * r0 + (uint128_t)h2 * s2;
+        uint128_t d2 = (uint128_t)h0 * r2 + (uint128_t)h1 * r1 + (uint128_t)h2 * r0;
+
+        uint64_t c = (uint64_t)(d0 >> 44); h0 = (uint64_t)d0 & MASK44;
+        d1 += c; c = (uint64_t)(d1 >> 44); h1 = (uint64_t)d1 & MASK44;
+        d2 += c; c = (uint64_t)(d2 >> 42); h2 = (uint64_t)d2 & MASK42;
+        h0 += c * 5; c = h0 >> 44; h0 &= MASK44;
+        h1 += c;
+
+        m += 16;
+        bytes -= 16;
+    }
+
+    h[0] = h0;
+    h[1] = h1;
+    h[2] = h2;
+}
+
+void Poly1305::Update(const uint8_t* data, size_t len)
+{
+    if (len == 0)
+        return;
+
+    if (leftover)
+    {
+        size_t want = 16 - leftover;
+        if (want > len)
+            want = len;
+        std::memcpy(buffer + leftover, data, want);
+        leftover += want;
+        data += want;
+        len -= want;
+
+        if (leftover < 16)
+            return;
+        Blocks(buffer, 16, 1ULL << 40);
+        leftover = 0;
+    }
+
+    const size_t whole = len & ~(size_t)15;
+    if (whole)
+    {
+        Blocks(data, whole, 1ULL << 40);
+        data += whole;
+        len -= whole;
+    }
+
+    if (len)
+    {
+        std::memcpy(buffer, data, len);
+        leftover = len;
+    }
+}
+
+void Poly1305::Final(uint8_t tag[TAGLEN])
+{
+    // Last partial block: 0x01 terminator instead of the high bit
+    if (leftover)
+    {
+        buffer[leftover] = 1;
+        for (size_t i = leftover + 1; i < 16; ++i)
+            buffer[i] = 0;
+        Blocks(buffer, 16, 0);
+        leftover = 0;
+    }
+
+    uint64_t h0 = h[0], h1 = h[1], h2 = h[2];
+
+    // Fully carry h
+    uint64_t c = h1 >> 44; h1 &= MASK44;
+    h2 += c; c = h2 >> 42; h2 &= MASK42;
+    h0 += c * 5; c = h0 >> 44; h0 &= MASK44;
+    h1 += c; c = h1 >> 44; h1 &= MASK44;
+    h2 += c; c = h2 >> 42; h2 &= MASK42;
+    h0 += c * 5; c = h0 >> 44; h0 &= MASK44;
+    h1 += c;
+
+    // g = h + -p; select h if h < p, else g (constant time)
+    uint64_t g0 = h0 + 5; c = g0 >> 44; g0 &= MASK44;
+    uint64_t g1 = h1 + c; c = g1 >> 44; g1 &= MASK44;
+    uint64_t g2 = h2 + c - (1ULL << 42);
+
+    c = (g2 >> 63) - 1;
+    g0 &= c;
+    g1 &= c;
+    g2 &= c;
+    c = ~c;
+    h0 = (h0 & c) | g0;
+    h1 = (h1 & c) | g1;
+    h2 = (h2 & c) | g2;
+
+    // h + pad mod 2^128
+    const uint64_t t0 = pad[0];
+    const uint64_t t1 = pad[1];
+
+    h0 += t0 & MASK44; c = h0 >> 44; h0 &= MASK44;
+    h1 += (((t0 >> 44) | (t1 << 20)) & MASK44) + c; c = h1 >> 44; h1 &= MASK44;
+    h2 += ((t1 >> 24) & MASK42) + c; h2 &= MASK42;
+
+    WriteLE64(tag, h0 | (h1 << 44));
+    WriteLE64(tag + 8, (h1 >> 20) | (h2 << 24));
+}
@@ -0,0 +1,33 @@
+#ifndef DRACHMA_CRYPTO_POLY1305_H
+#define DRACHMA_CRYPTO_POLY1305_H
+
+#include <cstdint>
+#include <cstddef>
+
+//
+// Poly1305 one-time authenticator (RFC 8439), 44/44/42-bit limbs
+// with 64x64->128 multiplies. A key must never be used twice.
+//
+class Poly1305
+{
+public:
+    static constexpr size_t KEYLEN = 32;
+    static constexpr size_t TAGLEN = 16;
+
+    explicit Poly1305(const uint8_t key[KEYLEN]);
+    ~Poly1305();
+
+    void Update(const uint8_t* data, size_t len);
+    void Final(uint8_t tag[TAGLEN]);
+
+private:
+    void Blocks(const uint8_t* m, size_t bytes, uint64_t hibit);
+
+    uint64_t r[3];
+    uint64_t h[3];
+    uint64_t pad[2];
+    uint8_t buffer[16];
+    size_t leftover;
+};
+
+#endif
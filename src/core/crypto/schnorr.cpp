@@ -0,0 +1,432 @@
+#include "schnorr.h"
+
+#include "secp256k1/secp256k1.h"
+#include "secp256k1/secp256k1_extrakeys.h"
+#include "secp256k1/secp256k1_schnorrsig.h"
+#include "secp256k1/secp256k1_musig.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <random>
+
+static_assert(sizeof(secp256k1_musig_keyagg_cache) == MuSig2::KEYAGG_CACHE_SIZE, "keyagg cache size");
+static_assert(sizeof(secp256k1_musig_secnonce) == MuSig2::SECNONCE_SIZE, "secnonce size");
+static_assert(sizeof(secp256k1_musig_session) == MuSig2::SESSION_SIZE, "session size");
+
+static secp256k1_context* secpCtx = nullptr;
+static std::once_flag secpOnce;
+
+static void RandomBytes(uint8_t* out, size_t len)
+{
+    std::random_device rd;
+    std::uniform_int_distribution<uint32_t> dist(0, 0xFFFFFFFF);
+
+    for (size_t i = 0; i < len; i += 4)
+    {
+        const uint32_t r = dist(rd);
+        std::memcpy(out + i, &r, std::min<size_t>(4, len - i));
+    }
+}
+
+static void InitSecp()
+{
+    // Signers run sessions from RPC and wallet threads
+    std::call_once(secpOnce, [] {
+        secpCtx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN | SECP256K1_CONTEXT_VERIFY);
+
+        // Blinds the signing multiplications against side channels
+        uint8_t seed[32];
+        RandomBytes(seed, sizeof(seed));
+        secp256k1_context_randomize(secpCtx, seed);
+    });
+}
+
+static void Wipe(void* p, size_t len)
+{
+    volatile uint8_t* v = static_cast<volatile uint8_t*>(p);
+    while (len--)
+        *v++ = 0;
+}
+
+static bool ParsePubKey(const PublicKey& pub, secp256k1_pubkey& out)
+{
+    const std::vector<uint8_t>& b = pub.GetBytes();
+    return pub.IsValid() && secp256k1_ec_pubkey_parse(secpCtx, &out, b.data(), b.size());
+}
+
+static bool MakeKeyPair(const PrivateKey& key, secp256k1_keypair& out)
+{
+    return key.IsValid() && secp256k1_keypair_create(secpCtx, &out, key.GetBytes().data());
+}
+
+static std::array<uint8_t,33> CompressedBytes(const PublicKey& pub)
+{
+    std::array<uint8_t,33> out = {};
+
+    const std::vector<uint8_t>& b = pub.GetBytes();
+    if (b.size() == 33)
+    {
+        std::copy(b.begin(), b.end(), out.begin());
+        return out;
+    }
+
+    secp256k1_pubkey p;
+    if (ParsePubKey(pub, p))
+    {
+        size_t len = out.size();
+        secp256k1_ec_pubkey_serialize(secpCtx, out.data(), &len, &p, SECP256K1_EC_COMPRESSED);
+    }
+    return out;
+}
+
+//
+// ================================================================
+//  XOnlyPubKey
+// ================================================================
+XOnlyPubKey::XOnlyPubKey()
+{
+    valid = false;
+    key.fill(0);
+}
+
+XOnlyPubKey::XOnlyPubKey(const std::array<uint8_t,32>& bytes)
+{
+    InitSecp();
+    key = bytes;
+
+    secp256k1_xonly_pubkey x;
+    valid = secp256k1_xonly_pubkey_parse(secpCtx, &x, key.data()) == 1;
+}
+
+XOnlyPubKey::XOnlyPubKey(const PublicKey& pub)
+{
+    InitSecp();
+    valid = false;
+    key.fill(0);
+
+    secp256k1_pubkey p;
+    secp256k1_xonly_pubkey x;
+    if (ParsePubKey(pub, p) && secp256k1_xonly_pubkey_from_pubkey(secpCtx, &x, nullptr, &p))
+        valid = secp256k1_xonly_pubkey_serialize(secpCtx, key.data(), &x) == 1;
+}
+
+bool XOnlyPubKey::VerifySchnorr(const std::array<uint8_t,32>& msg, const std::array<uint8_t,64>& sig) const
+{
+    if (!valid)
+        return false;
+
+    InitSecp();
+
+    secp256k1_xonly_pubkey x;
+    if (!secp256k1_xonly_pubkey_parse(secpCtx, &x, key.data()))
+        return false;
+
+    return secp256k1_schnorrsig_verify(secpCtx, sig.data(), msg.data(), msg.size(), &x) == 1;
+}
+
+//
+// ================================================================
+//  Schnorr
+// ================================================================
+bool Schnorr::Sign(const PrivateKey& key, const std::array<uint8_t,32>& msg,
+                   std::array<uint8_t,64>& sig, const std::array<uint8_t,32>* aux)
+{
+    InitSecp();
+
+    secp256k1_keypair kp;
+    if (!MakeKeyPair(key, kp))
+        return false;
+
+    std::array<uint8_t,32> rand;
+    if (aux)
+        rand = *aux;
+    else
+        RandomBytes(rand.data(), rand.size());
+
+    const bool ok = secp256k1_schnorrsig_sign32(secpCtx, sig.data(), msg.data(), &kp, rand.data()) == 1;
+    Wipe(&kp, sizeof(kp));
+    return ok;
+}
+
+//
+// ================================================================
+//  MuSig2::KeyAgg
+// ================================================================
+MuSig2::KeyAgg::KeyAgg()
+{
+    valid = false;
+    signers = 0;
+    std::memset(cache, 0, sizeof(cache));
+}
+
+bool MuSig2::KeyAgg::Aggregate(const std::vector<PublicKey>& keys)
+{
+    InitSecp();
+    valid = false;
+    signers = 0;
+
+    if (keys.empty())
+        return false;
+
+    std::vector<secp256k1_pubkey> parsed(keys.size());
+    std::vector<const secp256k1_pubkey*> ptrs(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        if (!ParsePubKey(keys[i], parsed[i]))
+            return false;
+        ptrs[i] = &parsed[i];
+    }
+
+    secp256k1_musig_keyagg_cache c;
+    secp256k1_xonly_pubkey agg;
+    if (!secp256k1_musig_pubkey_agg(secpCtx, &agg, &c, ptrs.data(), ptrs.size()))
+        return false;
+
+    std::array<uint8_t,32> bytes;
+    secp256k1_xonly_pubkey_serialize(secpCtx, bytes.data(), &agg);
+
+    std::memcpy(cache, &c, sizeof(cache));
+    aggregate = XOnlyPubKey(bytes);
+    signers = keys.size();
+    valid = true;
+    return true;
+}
+
+bool MuSig2::KeyAgg::TweakXOnly(const std::array<uint8_t,32>& tweak)
+{
+    if (!valid)
+        return false;
+
+    InitSecp();
+
+    secp256k1_musig_keyagg_cache c;
+    std::memcpy(&c, cache, sizeof(c));
+
+    secp256k1_pubkey out;
+    secp256k1_xonly_pubkey x;
+    std::array<uint8_t,32> bytes;
+    if (!secp256k1_musig_pubkey_xonly_tweak_add(secpCtx, &out, &c, tweak.data()) ||
+        !secp256k1_xonly_pubkey_from_pubkey(secpCtx, &x, nullptr, &out) ||
+        !secp256k1_xonly_pubkey_serialize(secpCtx, bytes.data(), &x))
+        return false;
+
+    std::memcpy(cache, &c, sizeof(cache));
+    aggregate = XOnlyPubKey(bytes);
+    return true;
+}
+
+//
+// ================================================================
+//  MuSig2::SecNonce / Session
+// ================================================================
+MuSig2::SecNonce::SecNonce()
+{
+    usable = false;
+    std::memset(data, 0, sizeof(data));
+}
+
+MuSig2::SecNonce::~SecNonce()
+{
+    Wipe();
+}
+
+void MuSig2::SecNonce::Wipe()
+{
+    ::Wipe(data, sizeof(data));
+    usable = false;
+}
+
+MuSig2::Session::Session()
+{
+    valid = false;
+    std::memset(data, 0, sizeof(data));
+}
+
+bool MuSig2::Session::Start(const AggNonce& aggnonce, const std::array<uint8_t,32>& msg, const KeyAgg& keyagg)
+{
+    InitSecp();
+    valid = false;
+
+    if (!keyagg.IsValid())
+        return false;
+
+    secp256k1_musig_aggnonce an;
+    if (!secp256k1_musig_aggnonce_parse(secpCtx, &an, aggnonce.data()))
+        return false;
+
+    secp256k1_musig_keyagg_cache c;
+    std::memcpy(&c, keyagg.cache, sizeof(c));
+
+    secp256k1_musig_session s;
+    if (!secp256k1_musig_nonce_process(secpCtx, &s, &an, msg.data(), &c))
+        return false;
+
+    std::memcpy(data, &s, sizeof(data));
+    valid = true;
+    return true;
+}
+
+//
+// ================================================================
+//  MuSig2
+// ================================================================
+void MuSig2::SortKeys(std::vector<PublicKey>& keys)
+{
+    InitSecp();
+
+    std::vector<std::pair<std::array<uint8_t,33>, size_t>> order(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i)
+        order[i] = std::make_pair(CompressedBytes(keys[i]), i);
+    std::sort(order.begin(), order.end());
+
+    std::vector<PublicKey> sorted;
+    sorted.reserve(keys.size());
+    for (const auto& o : order)
+        sorted.push_back(keys[o.second]);
+    keys.swap(sorted);
+}
+
+bool MuSig2::NonceGen(const PrivateKey& key, const KeyAgg& keyagg, const std::array<uint8_t,32>* msg,
+                      SecNonce& secnonce, PubNonce& pubnonce)
+{
+    InitSecp();
+    secnonce.Wipe();
+
+    if (!key.IsValid() || !keyagg.IsValid())
+        return false;
+
+    secp256k1_pubkey pub;
+    if (!secp256k1_ec_pubkey_create(secpCtx, &pub, key.GetBytes().data()))
+        return false;
+
+    secp256k1_musig_keyagg_cache c;
+    std::memcpy(&c, keyagg.cache, sizeof(c));
+
+    // Must never repeat; the library zeroes it once used
+    uint8_t secrand[32];
+    RandomBytes(secrand, sizeof(secrand));
+
+    secp256k1_musig_secnonce sn;
+    secp256k1_musig_pubnonce pn;
+    const bool ok = secp256k1_musig_nonce_gen(secpCtx, &sn, &pn, secrand, key.GetBytes().data(), &pub,
+                                              msg ? msg->data() : nullptr, &c, nullptr) &&
+                    secp256k1_musig_pubnonce_serialize(secpCtx, pubnonce.data(), &pn);
+    ::Wipe(secrand, sizeof(secrand));
+
+    if (ok)
+    {
+        std::memcpy(secnonce.data, &sn, sizeof(secnonce.data));
+        secnonce.usable = true;
+    }
+    ::Wipe(&sn, sizeof(sn));
+    return ok;
+}
+
+bool MuSig2::NonceAgg(const std::vector<PubNonce>& pubnonces, AggNonce& out)
+{
+    InitSecp();
+
+    if (pubnonces.empty())
+        return false;
+
+    std::vector<secp256k1_musig_pubnonce> parsed(pubnonces.size());
+    std::vector<const secp256k1_musig_pubnonce*> ptrs(pubnonces.size());
+    for (size_t i = 0; i < pubnonces.size(); ++i)
+    {
+        if (!secp256k1_musig_pubnonce_parse(secpCtx, &parsed[i], pubnonces[i].data()))
+            return false;
+        ptrs[i] = &parsed[i];
+    }
+
+    secp256k1_musig_aggnonce an;
+    return secp256k1_musig_nonce_agg(secpCtx, &an, ptrs.data(), ptrs.size()) &&
+           secp256k1_musig_aggnonce_serialize(secpCtx, out.data(), &an);
+}
+
+bool MuSig2::PartialSign(const PrivateKey& key, SecNonce& secnonce, const KeyAgg& keyagg,
+                         const Session& session, PartialSig& out)
+{
+    InitSecp();
+
+    if (!secnonce.usable)
+        return false;
+
+    // Spent from here on, whatever happens
+    secp256k1_musig_secnonce sn;
+    std::memcpy(&sn, secnonce.data, sizeof(sn));
+    secnonce.Wipe();
+
+    if (!keyagg.IsValid() || !session.IsValid())
+    {
+        ::Wipe(&sn, sizeof(sn));
+        return false;
+    }
+
+    secp256k1_keypair kp;
+    if (!MakeKeyPair(key, kp))
+    {
+        ::Wipe(&sn, sizeof(sn));
+        return false;
+    }
+
+    secp256k1_musig_keyagg_cache c;
+    secp256k1_musig_session s;
+    std::memcpy(&c, keyagg.cache, sizeof(c));
+    std::memcpy(&s, session.data, sizeof(s));
+
+    secp256k1_musig_partial_sig ps;
+    const bool ok = secp256k1_musig_partial_sign(secpCtx, &ps, &sn, &kp, &c, &s) &&
+                    secp256k1_musig_partial_sig_serialize(secpCtx, out.data(), &ps);
+
+    ::Wipe(&sn, sizeof(sn));
+    ::Wipe(&kp, sizeof(kp));
+    return ok;
+}
+
+bool MuSig2::PartialVerify(const PartialSig& sig, const PubNonce& pubnonce, const PublicKey& pub,
+                           const KeyAgg& keyagg, const Session& session)
+{
+    InitSecp();
+
+    if (!keyagg.IsValid() || !session.IsValid())
+        return false;
+
+    secp256k1_musig_partial_sig ps;
+    secp256k1_musig_pubnonce pn;
+    secp256k1_pubkey pk;
+    if (!secp256k1_musig_partial_sig_parse(secpCtx, &ps, sig.data()) ||
+        !secp256k1_musig_pubnonce_parse(secpCtx, &pn, pubnonce.data()) ||
+        !ParsePubKey(pub, pk))
+        return false;
+
+    secp256k1_musig_keyagg_cache c;
+    secp256k1_musig_session s;
+    std::memcpy(&c, keyagg.cache, sizeof(c));
+    std::memcpy(&s, session.data, sizeof(s));
+
+    return secp256k1_musig_partial_sig_verify(secpCtx, &ps, &pn, &pk, &c, &s) == 1;
+}
+
+bool MuSig2::Aggregate(const Session& session, const std::vector<PartialSig>& sigs,
+                       std::array<uint8_t,64>& out)
+{
+    InitSecp();
+
+    if (!session.IsValid() || sigs.empty())
+        return false;
+
+    std::vector<secp256k1_musig_partial_sig> parsed(sigs.size());
+    std::vector<const secp256k1_musig_partial_sig*> ptrs(sigs.size());
+    for (size_t i = 0; i < sigs.size(); ++i)
+    {
+        if (!secp256k1_musig_partial_sig_parse(secpCtx, &parsed[i], sigs[i].data()))
+            return false;
+        ptrs[i] = &parsed[i];
+    }
+
+    secp256k1_musig_session s;
+    std::memcpy(&s, session.data, sizeof(s));
+
+    return secp256k1_musig_partial_sig_agg(secpCtx, out.data(), &s, ptrs.data(), ptrs.size()) == 1;
+}
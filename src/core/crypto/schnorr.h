@@ -0,0 +1,188 @@
+#ifndef DRACHMA_SCHNORR_H
+#define DRACHMA_SCHNORR_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "ecdsa.h"
+
+//
+// ===============================================================
+//  SECP256K1 - SCHNORR SIGNATURES AND MUSIG2
+// ===============================================================
+//
+//  Classes:
+//    - XOnlyPubKey: 32-byte BIP340 public key + verify()
+//    - Schnorr:     BIP340 signing
+//    - MuSig2:      BIP327 n-of-n multi-signatures
+//
+//  Notes:
+//    • libsecp256k1's extrakeys, schnorrsig and musig modules
+//    • A MuSig2 signature is an ordinary BIP340 signature under
+//      the aggregate key: n signers, one signature, one verify
+//
+// ===============================================================
+//
+
+//
+// ===============================================================
+//  CLASS: XOnlyPubKey
+// ===============================================================
+//
+class XOnlyPubKey
+{
+public:
+    XOnlyPubKey();
+    explicit XOnlyPubKey(const std::array<uint8_t,32>& bytes);
+
+    // The x coordinate of a full key (its parity is dropped)
+    explicit XOnlyPubKey(const PublicKey& pub);
+
+    bool IsValid() const { return valid; }
+    const std::array<uint8_t,32>& GetBytes() const { return key; }
+
+    // BIP340 signature over a 32-byte message
+    bool VerifySchnorr(const std::array<uint8_t,32>& msg, const std::array<uint8_t,64>& sig) const;
+
+    bool operator==(const XOnlyPubKey& o) const { return valid == o.valid && key == o.key; }
+    bool operator!=(const XOnlyPubKey& o) const { return !(*this == o); }
+
+private:
+    bool valid;
+    std::array<uint8_t,32> key;
+};
+
+//
+// ===============================================================
+//  CLASS: Schnorr - BIP340 signing
+// ===============================================================
+//
+class Schnorr
+{
+public:
+    // `aux` is fresh randomness for the nonce (BIP340 recommends it,
+    // it is not needed for safety); null draws it from the system
+    static bool Sign(const PrivateKey& key, const std::array<uint8_t,32>& msg,
+                     std::array<uint8_t,64>& sig, const std::array<uint8_t,32>* aux = nullptr);
+};
+
+//
+// ===============================================================
+//  CLASS: MuSig2 - BIP327 multi-signatures
+// ===============================================================
+//
+//  One signing session, every signer:
+//
+//    1. KeyAgg::Aggregate() over all signers' keys (same order
+//       everywhere; SortKeys() for the canonical one)
+//    2. NonceGen(): keeps the SecNonce, sends the PubNonce
+//    3. NonceAgg() over all PubNonces, Session::Start() with the
+//       message
+//    4. PartialSign(): sends the PartialSig
+//    5. anyone: PartialVerify() each (to name a cheating signer),
+//       then Aggregate() into the final signature
+//
+//  The result verifies with XOnlyPubKey::VerifySchnorr() under
+//  KeyAgg::GetAggregateKey().
+//
+//  A SecNonce signs once: PartialSign() wipes it and refuses a used
+//  one, and it cannot be copied. Reusing a nonce for two messages
+//  gives away the secret key.
+//
+// ===============================================================
+//
+class MuSig2
+{
+public:
+    typedef std::array<uint8_t,66> PubNonce;
+    typedef std::array<uint8_t,66> AggNonce;
+    typedef std::array<uint8_t,32> PartialSig;
+
+    // libsecp256k1's opaque structures, kept as bytes (checked
+    // against the library's in schnorr.cpp)
+    static constexpr size_t KEYAGG_CACHE_SIZE = 197;
+    static constexpr size_t SECNONCE_SIZE = 132;
+    static constexpr size_t SESSION_SIZE = 133;
+
+    class KeyAgg
+    {
+    public:
+        KeyAgg();
+
+        bool Aggregate(const std::vector<PublicKey>& keys);
+
+        // Taproot output key: adds tweak * G to the aggregate key
+        // (BIP341 TapTweak computed by the caller)
+        bool TweakXOnly(const std::array<uint8_t,32>& tweak);
+
+        bool IsValid() const { return valid; }
+        const XOnlyPubKey& GetAggregateKey() const { return aggregate; }
+        size_t Size() const { return signers; }
+
+    private:
+        friend class MuSig2;
+
+        bool valid;
+        size_t signers;
+        XOnlyPubKey aggregate;
+        alignas(8) uint8_t cache[KEYAGG_CACHE_SIZE];
+    };
+
+    class SecNonce
+    {
+    public:
+        SecNonce();
+        ~SecNonce();
+
+        SecNonce(const SecNonce&) = delete;
+        SecNonce& operator=(const SecNonce&) = delete;
+
+        bool IsUsable() const { return usable; }
+
+    private:
+        friend class MuSig2;
+
+        void Wipe();
+
+        bool usable;
+        alignas(8) uint8_t data[SECNONCE_SIZE];
+    };
+
+    class Session
+    {
+    public:
+        Session();
+
+        bool Start(const AggNonce& aggnonce, const std::array<uint8_t,32>& msg, const KeyAgg& keyagg);
+        bool IsValid() const { return valid; }
+
+    private:
+        friend class MuSig2;
+
+        bool valid;
+        alignas(8) uint8_t data[SESSION_SIZE];
+    };
+
+    // BIP327 KeySort: by compressed encoding
+    static void SortKeys(std::vector<PublicKey>& keys);
+
+    // `msg` may be unknown yet (null); knowing it hardens the nonce
+    static bool NonceGen(const PrivateKey& key, const KeyAgg& keyagg, const std::array<uint8_t,32>* msg,
+                         SecNonce& secnonce, PubNonce& pubnonce);
+
+    static bool NonceAgg(const std::vector<PubNonce>& pubnonces, AggNonce& out);
+
+    static bool PartialSign(const PrivateKey& key, SecNonce& secnonce, const KeyAgg& keyagg,
+                            const Session& session, PartialSig& out);
+
+    static bool PartialVerify(const PartialSig& sig, const PubNonce& pubnonce, const PublicKey& pub,
+                              const KeyAgg& keyagg, const Session& session);
+
+    // All signers' partial signatures, in any order
+    static bool Aggregate(const Session& session, const std::vector<PartialSig>& sigs,
+                          std::array<uint8_t,64>& out);
+};
+
+#endif // DRACHMA_SCHNORR_H
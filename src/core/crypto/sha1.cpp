@@ -0,0 +1,135 @@
+#include "sha1.h"
+#include <cstring>
+
+static inline uint32_t ROTL(uint32_t x, int n)
+{
+    return (x << n) | (x >> (32 - n));
+}
+
+SHA1::SHA1()
+{
+    Reset();
+}
+
+void SHA1::Reset()
+{
+    state[0]=0x67452301;
+    state[1]=0xefcdab89;
+    state[2]=0x98badcfe;
+    state[3]=0x10325476;
+    state[4]=0xc3d2e1f0;
+
+    bitlen = 0;
+    bufferLen = 0;
+}
+
+void SHA1::Update(const uint8_t* data, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        buffer[bufferLen++] = data[i];
+        if (bufferLen == 64)
+        {
+            Transform(buffer);
+            bitlen += 512;
+            bufferLen = 0;
+        }
+    }
+}
+
+void SHA1::Update(const std::vector<uint8_t>& data)
+{
+    Update(data.data(), data.size());
+}
+
+void SHA1::Update(const std::string& s)
+{
+    Update((const uint8_t*)s.data(), s.size());
+}
+
+void SHA1::Transform(const uint8_t block[64])
+{
+    uint32_t W[80];
+    for (int i = 0; i < 16; i++)
+    {
+        W[i] =
+            ((uint32_t)block[i*4] << 24) |
+            ((uint32_t)block[i*4+1] << 16) |
+            ((uint32_t)block[i*4+2] << 8) |
+            ((uint32_t)block[i*4+3]);
+    }
+    for (int i = 16; i < 80; i++)
+        W[i] = ROTL(W[i-3] ^ W[i-8] ^ W[i-14] ^ W[i-16], 1);
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+
+    for (int i = 0; i < 80; i++)
+    {
+        uint32_t f, k;
+        if (i < 20)      { f = (b & c) | (~b & d);          k = 0x5a827999; }
+        else if (i < 40) { f = b ^ c ^ d;                   k = 0x6ed9eba1; }
+        else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8f1bbcdc; }
+        else             { f = b ^ c ^ d;                   k = 0xca62c1d6; }
+
+        uint32_t T = ROTL(a, 5) + f + e + k + W[i];
+        e = d; d = c; c = ROTL(b, 30); b = a; a = T;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+void SHA1::Final(uint8_t out[20])
+{
+    bitlen += bufferLen * 8;
+
+    buffer[bufferLen++] = 0x80;
+
+    if (bufferLen > 56)
+    {
+        while (bufferLen < 64) buffer[bufferLen++] = 0;
+        Transform(buffer);
+        bufferLen = 0;
+    }
+
+    while (bufferLen < 56)
+        buffer[bufferLen++] = 0;
+
+    // Big-endian length, unlike RIPEMD-160
+    for (int i = 7; i >= 0; i--)
+        buffer[bufferLen++] = (bitlen >> (8*i)) & 0xFF;
+
+    Transform(buffer);
+
+    for (int i = 0; i < 5; i++)
+    {
+        out[i*4]   = (state[i] >> 24) & 0xFF;
+        out[i*4+1] = (state[i] >> 16) & 0xFF;
+        out[i*4+2] = (state[i] >> 8)  & 0xFF;
+        out[i*4+3] =  state[i]        & 0xFF;
+    }
+}
+
+std::vector<uint8_t> SHA1::Final()
+{
+    uint8_t out[20];
+    Final(out);
+    return std::vector<uint8_t>(out, out + 20);
+}
+
+std::vector<uint8_t> SHA1::Hash(const std::vector<uint8_t>& data)
+{
+    SHA1 ctx;
+    ctx.Update(data);
+    return ctx.Final();
+}
+
+std::vector<uint8_t> SHA1::Hash(const uint8_t* data, size_t len)
+{
+    SHA1 ctx;
+    ctx.Update(data, len);
+    return ctx.Final();
+}
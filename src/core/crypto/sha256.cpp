@@ -70,16 +70,38 @@ void SHA256::Reset()
 
 void SHA256::Update(const uint8_t* data, size_t len)
 {
-    for (size_t i = 0; i < len; i++)
+    // Top up a partially filled buffer first
+    if (bufferLen > 0)
     {
-        buffer[bufferLen++] = data[i];
-        if (bufferLen == 64)
-        {
-            Transform(buffer);
-            bitlen += 512;
-            bufferLen = 0;
-        }
+        size_t take = 64 - bufferLen;
+        if (take > len)
+            take = len;
+
+        std::memcpy(buffer + bufferLen, data, take);
+        bufferLen += take;
+        data += take;
+        len -= take;
+
+        if (bufferLen < 64)
+            return;
+
+        Transform(buffer);
+        bitlen += 512;
+        bufferLen = 0;
     }
+
+    // Whole blocks straight from the input
+    while (len >= 64)
+    {
+        Transform(data);
+        bitlen += 512;
+        data += 64;
+        len -= 64;
+    }
+
+    if (len)
+        std::memcpy(buffer, data, len);
+    bufferLen = len;
 }
 
 void SHA256::Update(const std::vector<uint8_t>& data)
@@ -193,3 +215,162 @@ std::vector<uint8_t> SHA256::Hash(const uint8_t* data, size_t len)
     ctx.Update(data, len);
     return ctx.Final();
 }
+
+//
+// ================================================================
+//  SHA256D80: batched double hash of block headers
+// ================================================================
+//
+//  Eight headers per kernel call, one per 32-bit AVX2 lane. The
+//  80 bytes take two compressions (the second block is the last
+//  16 bytes plus fixed padding for a 640-bit message) and the
+//  32-byte digest one more, padded for 256 bits. The remainder,
+//  and CPUs without AVX2, go through SHA256.
+//
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+static const uint32_t IV[8] =
+{
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static inline uint32_t ReadBE32(const uint8_t* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline void WriteBE32(uint8_t* p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+#define ROTR_AVX2(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+#define XOR3_AVX2(a, b, c) _mm256_xor_si256(_mm256_xor_si256(a, b), c)
+
+__attribute__((target("avx2")))
+static void TransformAVX2(__m256i s[8], const __m256i w[16])
+{
+    __m256i m[64];
+    for (int i = 0; i < 16; ++i)
+        m[i] = w[i];
+    for (int i = 16; i < 64; ++i)
+    {
+        const __m256i s0 = XOR3_AVX2(ROTR_AVX2(m[i - 15], 7), ROTR_AVX2(m[i - 15], 18),
+                                     _mm256_srli_epi32(m[i - 15], 3));
+        const __m256i s1 = XOR3_AVX2(ROTR_AVX2(m[i - 2], 17), ROTR_AVX2(m[i - 2], 19),
+                                     _mm256_srli_epi32(m[i - 2], 10));
+        m[i] = _mm256_add_epi32(_mm256_add_epi32(s1, m[i - 7]), _mm256_add_epi32(s0, m[i - 16]));
+    }
+
+    __m256i a = s[0], b = s[1], c = s[2], d = s[3];
+    __m256i e = s[4], f = s[5], g = s[6], h = s[7];
+
+    for (int i = 0; i < 64; ++i)
+    {
+        const __m256i S1 = XOR3_AVX2(ROTR_AVX2(e, 6), ROTR_AVX2(e, 11), ROTR_AVX2(e, 25));
+        const __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+        const __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(h, S1),
+                                            _mm256_add_epi32(ch, _mm256_add_epi32(_mm256_set1_epi32((int)K[i]), m[i])));
+        const __m256i S0 = XOR3_AVX2(ROTR_AVX2(a, 2), ROTR_AVX2(a, 13), ROTR_AVX2(a, 22));
+        const __m256i maj = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+        const __m256i t2 = _mm256_add_epi32(S0, maj);
+
+        h = g; g = f; f = e; e = _mm256_add_epi32(d, t1);
+        d = c; c = b; b = a; a = _mm256_add_epi32(t1, t2);
+    }
+
+    s[0] = _mm256_add_epi32(s[0], a); s[1] = _mm256_add_epi32(s[1], b);
+    s[2] = _mm256_add_epi32(s[2], c); s[3] = _mm256_add_epi32(s[3], d);
+    s[4] = _mm256_add_epi32(s[4], e); s[5] = _mm256_add_epi32(s[5], f);
+    s[6] = _mm256_add_epi32(s[6], g); s[7] = _mm256_add_epi32(s[7], h);
+}
+
+// Word `offset` of each of the eight inputs, one per lane
+__attribute__((target("avx2")))
+static inline __m256i Gather8(const uint8_t* in, size_t stride, size_t offset)
+{
+    return _mm256_set_epi32((int)ReadBE32(in + 7 * stride + offset), (int)ReadBE32(in + 6 * stride + offset),
+                            (int)ReadBE32(in + 5 * stride + offset), (int)ReadBE32(in + 4 * stride + offset),
+                            (int)ReadBE32(in + 3 * stride + offset), (int)ReadBE32(in + 2 * stride + offset),
+                            (int)ReadBE32(in + 1 * stride + offset), (int)ReadBE32(in + offset));
+}
+
+__attribute__((target("avx2")))
+static void SHA256D80x8AVX2(uint8_t* out, const uint8_t* in)
+{
+    __m256i s[8], w[16];
+    for (int i = 0; i < 8; ++i)
+        s[i] = _mm256_set1_epi32((int)IV[i]);
+
+    for (int i = 0; i < 16; ++i)
+        w[i] = Gather8(in, 80, 4 * i);
+    TransformAVX2(s, w);
+
+    for (int i = 0; i < 4; ++i)
+        w[i] = Gather8(in, 80, 64 + 4 * i);
+    w[4] = _mm256_set1_epi32((int)0x80000000);
+    for (int i = 5; i < 15; ++i)
+        w[i] = _mm256_setzero_si256();
+    w[15] = _mm256_set1_epi32(640);
+    TransformAVX2(s, w);
+
+    for (int i = 0; i < 8; ++i)
+        w[i] = s[i];
+    w[8] = _mm256_set1_epi32((int)0x80000000);
+    for (int i = 9; i < 15; ++i)
+        w[i] = _mm256_setzero_si256();
+    w[15] = _mm256_set1_epi32(256);
+    for (int i = 0; i < 8; ++i)
+        s[i] = _mm256_set1_epi32((int)IV[i]);
+    TransformAVX2(s, w);
+
+    for (int i = 0; i < 8; ++i)
+    {
+        alignas(32) uint32_t lanes[8];
+        _mm256_store_si256((__m256i*)lanes, s[i]);
+        for (int j = 0; j < 8; ++j)
+            WriteBE32(out + 32 * j + 4 * i, lanes[j]);
+    }
+}
+
+static bool HaveAVX2()
+{
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+}
+#endif
+
+void SHA256D80(uint8_t* out, const uint8_t* in, size_t count)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    if (HaveAVX2())
+    {
+        for (; count >= 8; count -= 8)
+        {
+            SHA256D80x8AVX2(out, in);
+            out += 8 * 32;
+            in += 8 * 80;
+        }
+    }
+#endif
+
+    for (; count; --count)
+    {
+        uint8_t first[32];
+        SHA256 inner;
+        inner.Update(in, 80);
+        inner.Final(first);
+
+        SHA256 outer;
+        outer.Update(first, 32);
+        outer.Final(out);
+
+        out += 32;
+        in += 80;
+    }
+}
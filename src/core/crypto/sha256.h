@@ -31,4 +31,9 @@ private:
     size_t bufferLen;
 };
 
+// Double SHA256 of `count` 80-byte inputs (block headers) stored
+// back to back; 32-byte digests to `out`. Eight at a time in AVX2
+// lanes where the CPU has it.
+void SHA256D80(uint8_t* out, const uint8_t* in, size_t count);
+
 #endif
@@ -0,0 +1,111 @@
+#include "siphash.h"
+#include "../../common/utils/serialize.h"
+
+static inline uint64_t ROTL64(uint64_t x, int b)
+{
+    return (x << b) | (x >> (64 - b));
+}
+
+static inline void SipRound(uint64_t& v0, uint64_t& v1, uint64_t& v2, uint64_t& v3)
+{
+    v0 += v1; v1 = ROTL64(v1, 13); v1 ^= v0; v0 = ROTL64(v0, 32);
+    v2 += v3; v3 = ROTL64(v3, 16); v3 ^= v2;
+    v0 += v3; v3 = ROTL64(v3, 21); v3 ^= v0;
+    v2 += v1; v1 = ROTL64(v1, 17); v1 ^= v2; v2 = ROTL64(v2, 32);
+}
+
+SipHasher::SipHasher(uint64_t k0, uint64_t k1)
+{
+    v[0] = 0x736f6d6570736575ULL ^ k0;
+    v[1] = 0x646f72616e646f6dULL ^ k1;
+    v[2] = 0x6c7967656e657261ULL ^ k0;
+    v[3] = 0x7465646279746573ULL ^ k1;
+    tmp = 0;
+    count = 0;
+}
+
+SipHasher& SipHasher::Write(uint64_t data)
+{
+    uint64_t v0 = v[0], v1 = v[1], v2 = v[2], v3 = v[3];
+
+    v3 ^= data;
+    SipRound(v0, v1, v2, v3);
+    SipRound(v0, v1, v2, v3);
+    v0 ^= data;
+
+    v[0] = v0; v[1] = v1; v[2] = v2; v[3] = v3;
+    count += 8;
+    return *this;
+}
+
+SipHasher& SipHasher::Write(const uint8_t* data, size_t len)
+{
+    uint64_t v0 = v[0], v1 = v[1], v2 = v[2], v3 = v[3];
+    uint64_t t = tmp;
+    size_t c = count;
+
+    while (len--)
+    {
+        t |= (uint64_t)(*data++) << (8 * (c % 8));
+        c++;
+        if ((c & 7) == 0)
+        {
+            v3 ^= t;
+            SipRound(v0, v1, v2, v3);
+            SipRound(v0, v1, v2, v3);
+            v0 ^= t;
+            t = 0;
+        }
+    }
+
+    v[0] = v0; v[1] = v1; v[2] = v2; v[3] = v3;
+    tmp = t;
+    count = c;
+    return *this;
+}
+
+uint64_t SipHasher::Finalize() const
+{
+    uint64_t v0 = v[0], v1 = v[1], v2 = v[2], v3 = v[3];
+    const uint64_t t = tmp | ((uint64_t)count << 56);
+
+    v3 ^= t;
+    SipRound(v0, v1, v2, v3);
+    SipRound(v0, v1, v2, v3);
+    v0 ^= t;
+    v2 ^= 0xFF;
+    SipRound(v0, v1, v2, v3);
+    SipRound(v0, v1, v2, v3);
+    SipRound(v0, v1, v2, v3);
+    SipRound(v0, v1, v2, v3);
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint8_t hash[32])
+{
+    uint64_t v0 = 0x736f6d6570736575ULL ^ k0;
+    uint64_t v1 = 0x646f72616e646f6dULL ^ k1;
+    uint64_t v2 = 0x6c7967656e657261ULL ^ k0;
+    uint64_t v3 = 0x7465646279746573ULL ^ k1;
+
+    for (int i = 0; i < 4; ++i)
+    {
+        const uint64_t d = ReadLE64(hash + 8 * i);
+        v3 ^= d;
+        SipRound(v0, v1, v2, v3);
+        SipRound(v0, v1, v2, v3);
+        v0 ^= d;
+    }
+
+    // Final block: no tail bytes, length 32
+    v3 ^= (uint64_t)32 << 56;
+    SipRound(v0, v1, v2, v3);
+    SipRound(v0, v1, v2, v3);
+    v0 ^= (uint64_t)32 << 56;
+    v2 ^= 0xFF;
+    SipRound(v0, v1, v2, v3);
+    SipRound(v0, v1, v2, v3);
+    SipRound(v0, v1, v2, v3);
+    SipRound(v0, v1, v2, v3);
+    return v0 ^ v1 ^ v2 ^ v3;
+}
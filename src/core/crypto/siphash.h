@@ -0,0 +1,32 @@
+#ifndef DRACHMA_CRYPTO_SIPHASH_H
+#define DRACHMA_CRYPTO_SIPHASH_H
+
+#include <cstdint>
+#include <cstddef>
+
+//
+// SipHash-2-4 – keyed 64-bit PRF (short IDs, hash-flooding
+// resistant table keys). Not a general purpose digest.
+//
+class SipHasher
+{
+public:
+    SipHasher(uint64_t k0, uint64_t k1);
+
+    // 8 bytes, little-endian. Only valid while the bytes written so
+    // far are a multiple of 8.
+    SipHasher& Write(uint64_t data);
+    SipHasher& Write(const uint8_t* data, size_t len);
+
+    uint64_t Finalize() const;
+
+private:
+    uint64_t v[4];
+    uint64_t tmp;
+    size_t count;
+};
+
+// SipHash-2-4 of a 32-byte hash, unrolled
+uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint8_t hash[32]);
+
+#endif
@@ -0,0 +1,133 @@
+#include "blockfilesource.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+namespace
+{
+    struct BlockHashHasher
+    {
+        size_t operator()(const std::array<uint8_t,32>& h) const
+        {
+            // Block hashes are PoW output; the low-order half is random
+            uint64_t v;
+            std::memcpy(&v, h.data(), 8);
+            return (size_t)v;
+        }
+    };
+
+    struct Node
+    {
+        BlockHeader header;
+        BlockPos pos;
+        int64_t parent;     // -1 = none stored
+        uint32_t depth;     // 0 = not (yet) known to reach `from`
+        bool done;
+    };
+}
+
+BlockFileSource::BlockFileSource(const BlockStore& s)
+    : store(s), next(0)
+{
+}
+
+bool BlockFileSource::Load(const std::array<uint8_t,32>& from)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    chain.clear();
+    next = 0;
+
+    std::vector<Node> nodes;
+    std::unordered_map<std::array<uint8_t,32>, int64_t, BlockHashHasher> byHash;
+
+    // Only the 80 header bytes of each record are touched here
+    for (uint32_t f = 0; f < store.GetFileCount(); ++f)
+    {
+        store.ScanFile(f, [&](const std::array<uint8_t,32>& hash, const BlockPos& pos, ByteSpan data)
+        {
+            if (data.size < BlockHeader::SIZE || byHash.count(hash))
+                return true;
+
+            Node n;
+            n.header.Deserialize(data.data);
+            n.pos = pos;
+            n.parent = -1;
+            n.depth = 0;
+            n.done = false;
+
+            byHash[hash] = (int64_t)nodes.size();
+            nodes.push_back(n);
+            return true;
+        }, false);
+    }
+
+    for (Node& n : nodes)
+    {
+        auto it = byHash.find(n.header.prevHash);
+        if (it != byHash.end())
+            n.parent = it->second;
+    }
+
+    // Depth above `from`, resolved iteratively (chains are long)
+    std::vector<int64_t> stack;
+    for (int64_t i = 0; i < (int64_t)nodes.size(); ++i)
+    {
+        int64_t cur = i;
+        while (cur >= 0 && !nodes[cur].done)
+        {
+            stack.push_back(cur);
+            if (nodes[cur].header.prevHash == from)
+                break;
+            cur = nodes[cur].parent;
+        }
+
+        uint32_t depth = (cur >= 0 && nodes[cur].done) ? nodes[cur].depth : 0;
+        while (!stack.empty())
+        {
+            Node& n = nodes[stack.back()];
+            stack.pop_back();
+
+            if (n.header.prevHash == from)
+                depth = 1;
+            else if (depth > 0)
+                depth++;
+
+            n.depth = depth;
+            n.done = true;
+        }
+    }
+
+    int64_t tip = -1;
+    for (int64_t i = 0; i < (int64_t)nodes.size(); ++i)
+        if (nodes[i].depth > 0 && (tip < 0 || nodes[i].depth > nodes[tip].depth))
+            tip = i;
+
+    for (int64_t cur = tip; cur >= 0; cur = (nodes[cur].header.prevHash == from) ? -1 : nodes[cur].parent)
+    {
+        Entry e;
+        e.header = nodes[cur].header;
+        e.pos = nodes[cur].pos;
+        chain.push_back(e);
+    }
+
+    std::reverse(chain.begin(), chain.end());
+    return true;
+}
+
+bool BlockFileSource::NextHeader(BlockHeader& header)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (next >= chain.size())
+        return false;
+
+    header = chain[next++].header;
+    return true;
+}
+
+bool BlockFileSource::FetchBlock(const std::array<uint8_t,32>& hash, ByteSpan& data)
+{
+    return store.ReadBlock(hash, data, true);
+}
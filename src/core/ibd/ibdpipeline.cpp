@@ -0,0 +1,566 @@
+#include "ibdpipeline.h"
+#include "../chain/undo.h"
+#include "../script/interpreter.h"
+#include "../storage/blockfilter.h"
+
+#include <algorithm>
+#include <limits>
+#include <thread>
+
+IBDPipeline::IBDPipeline(UTXOStore& u, Scheduler& sched, const Options& o)
+    : utxo(u), scheduler(sched), opts(o), validator(sched)
+{
+    undoStore = nullptr;
+    filters = nullptr;
+    nextConnect = 0;
+    fetchersRunning = 0;
+    outstanding = 0;
+    peakOutstanding = 0;
+    stopping = false;
+    startHeight = 0;
+    tipHash.fill(0);
+
+    statHeight = 0;
+    statBlocks = 0;
+    statTxs = 0;
+    statInputs = 0;
+    statFlushes = 0;
+    statUndoBytes = 0;
+    statFilterErrors = 0;
+    running = false;
+}
+
+IBDPipeline::~IBDPipeline()
+{
+    Stop();
+}
+
+//
+// ================================================================
+//  Run / Stop
+// ================================================================
+bool IBDPipeline::Run(IBDSource& source, uint32_t height)
+{
+    if (!utxo.IsOpen())
+        return false;
+
+    {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        error.clear();
+    }
+
+    stopping = false;
+    startHeight = height;
+    tipHash = utxo.GetBestBlock();
+    nextConnect = height;
+    pastTimes.clear();
+    outstanding = 0;
+    peakOutstanding = 0;
+    reorder.clear();
+    filterQueue.clear();
+
+    statHeight = height;
+    statBlocks = 0;
+    statTxs = 0;
+    statInputs = 0;
+    statFlushes = 0;
+    statUndoBytes = 0;
+    statFilterErrors = 0;
+
+    fetchQueue.reset(new BoundedQueue<ItemRef>(opts.fetchQueue));
+
+    unsigned nFetch = opts.fetchThreads ? opts.fetchThreads : 1;
+    if (opts.checkQueue == 0)
+        opts.checkQueue = 1;
+
+    // The reorder window must leave room for every fetcher, or the
+    // block the connect stage waits for could be stuck behind them.
+    if (opts.reorderWindow < nFetch)
+        opts.reorderWindow = nFetch;
+
+    fetchersRunning = nFetch;
+    started = std::chrono::steady_clock::now();
+    running = true;
+
+    std::vector<std::thread> threads;
+    threads.emplace_back(&IBDPipeline::HeaderStage, this, std::ref(source));
+    for (unsigned i = 0; i < nFetch; ++i)
+        threads.emplace_back(&IBDPipeline::FetchStage, this, std::ref(source));
+
+    ConnectStage();
+
+    // Connect stage is done (or failed); release anything blocked
+    fetchQueue->Close();
+    {
+        std::lock_guard<std::mutex> lock(reorderMutex);
+        reorderCv.notify_all();
+    }
+
+    for (std::thread& t : threads)
+        t.join();
+
+    // Check and filter tasks still queued on the scheduler point
+    // at this pipeline; after a stop they only count themselves out
+    {
+        std::unique_lock<std::mutex> lock(checkMutex);
+        checkCv.wait(lock, [this] { return outstanding == 0; });
+        filterQueue.clear();
+    }
+
+    // Blocks past the last flush may not have been checked (or did
+    // not pass); none of them may reach disk through a later Flush()
+    const bool ok = GetError().empty() && !stopping;
+    if (!ok)
+    {
+        utxo.DiscardCache();
+        tipHash = utxo.GetBestBlock();
+    }
+
+    finished = std::chrono::steady_clock::now();
+    running = false;
+
+    return ok;
+}
+
+void IBDPipeline::Stop()
+{
+    stopping = true;
+
+    if (fetchQueue) fetchQueue->Close();
+
+    {
+        std::lock_guard<std::mutex> lock(reorderMutex);
+        reorderCv.notify_all();
+    }
+    {
+        std::lock_guard<std::mutex> lock(checkMutex);
+        checkCv.notify_all();
+    }
+}
+
+void IBDPipeline::Fail(const std::string& why)
+{
+    {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        if (error.empty())
+            error = why;
+    }
+    Stop();
+}
+
+std::string IBDPipeline::GetError() const
+{
+    std::lock_guard<std::mutex> lock(errorMutex);
+    return error;
+}
+
+IBDPipeline::Stats IBDPipeline::GetStats() const
+{
+    Stats s;
+    s.height = statHeight;
+    s.blocks = statBlocks;
+    s.txs = statTxs;
+    s.inputs = statInputs;
+    s.flushes = statFlushes;
+    s.undoBytes = statUndoBytes;
+    s.filterErrors = statFilterErrors;
+
+    auto end = running ? std::chrono::steady_clock::now() : finished;
+    s.seconds = std::chrono::duration<double>(end - started).count();
+
+    s.peakFetchQueue = fetchQueue ? fetchQueue->Peak() : 0;
+    {
+        std::lock_guard<std::mutex> lock(checkMutex);
+        s.peakCheckQueue = peakOutstanding;
+    }
+    return s;
+}
+
+//
+// ================================================================
+//  Stage 1: headers
+// ================================================================
+void IBDPipeline::HeaderStage(IBDSource& source)
+{
+    std::array<uint8_t,32> prev = tipHash;
+    uint32_t height = startHeight;
+
+    // Times of the last 11 headers, oldest first
+    std::vector<uint32_t> recent;
+
+    BlockHeader header;
+    while (!stopping && source.NextHeader(header))
+    {
+        if (header.prevHash != prev)
+        {
+            Fail("header does not connect at height " + std::to_string(height));
+            break;
+        }
+
+        ItemRef item = std::make_shared<Item>();
+        item->height = height;
+        item->hash = header.GetHash();
+        item->header = header;
+
+        if (!recent.empty())
+        {
+            std::vector<uint32_t> sorted(recent);
+            std::sort(sorted.begin(), sorted.end());
+            item->medianTimePast = sorted[sorted.size() / 2];
+        }
+        if (recent.size() == 11)
+            recent.erase(recent.begin());
+        recent.push_back(header.time);
+
+        if (!BlockHeader::CheckProofOfWork(item->hash, header.bits))
+        {
+            Fail("bad proof of work at height " + std::to_string(height));
+            break;
+        }
+
+        prev = item->hash;
+        height++;
+
+        if (!fetchQueue->Push(std::move(item)))
+            break;
+    }
+
+    fetchQueue->Close();
+}
+
+//
+// ================================================================
+//  Stage 2: fetch / parse
+// ================================================================
+void IBDPipeline::FetchStage(IBDSource& source)
+{
+    ItemRef item;
+    while (!stopping && fetchQueue->Pop(item))
+    {
+        ByteSpan raw;
+        if (!source.FetchBlock(item->hash, raw))
+        {
+            Fail("block " + std::to_string(item->height) + " unavailable");
+            break;
+        }
+
+        if (!item->block.Parse(raw))
+        {
+            Fail("block " + std::to_string(item->height) + " does not parse");
+            break;
+        }
+
+        if (item->block.header.GetHash() != item->hash)
+        {
+            Fail("block " + std::to_string(item->height) + " header mismatch");
+            break;
+        }
+
+        // The views cache their txids, so the hashing for both the
+        // merkle check and connect happens here, off the serial path.
+        bool mutated = false;
+        if (item->block.ComputeMerkleRoot(&mutated) != item->block.header.merkleRoot || mutated)
+        {
+            Fail("bad merkle root at height " + std::to_string(item->height));
+            break;
+        }
+
+        // Input-independent sighash parts, also off the serial path
+        if (scriptCheck)
+        {
+            const std::vector<TransactionView>& vtx = item->block.vtx;
+            item->txdata.resize(vtx.size());
+            for (size_t i = 1; i < vtx.size(); ++i)
+                item->txdata[i].reset(new PrecomputedTxData(vtx[i]));
+        }
+
+        std::unique_lock<std::mutex> lock(reorderMutex);
+        reorderCv.wait(lock, [this, &item] {
+            return stopping || item->height < nextConnect + opts.reorderWindow;
+        });
+
+        if (stopping)
+            break;
+
+        reorder[item->height] = std::move(item);
+        reorderCv.notify_all();
+    }
+
+    std::lock_guard<std::mutex> lock(reorderMutex);
+    fetchersRunning--;
+    reorderCv.notify_all();
+}
+
+//
+// ================================================================
+//  Stage 3: in-order connect
+// ================================================================
+void IBDPipeline::ConnectStage()
+{
+    for (;;)
+    {
+        ItemRef item;
+        {
+            std::unique_lock<std::mutex> lock(reorderMutex);
+            reorderCv.wait(lock, [this] {
+                return stopping || reorder.count(nextConnect) || fetchersRunning == 0;
+            });
+
+            auto it = reorder.find(nextConnect);
+            if (stopping || it == reorder.end())
+                break;
+
+            item = std::move(it->second);
+            reorder.erase(it);
+            nextConnect++;
+            reorderCv.notify_all();
+        }
+
+        if (!ConnectBlock(item))
+            break;
+
+        if (filters)
+            WriteFilters();
+
+        tipHash = item->hash;
+        statHeight = item->height;
+        statBlocks++;
+
+        if (utxo.NeedsFlush() && !FlushValidated(tipHash))
+            break;
+    }
+
+    if (!stopping && GetError().empty())
+        FlushValidated(tipHash);
+}
+
+int64_t IBDPipeline::MedianTimeAt(uint32_t height) const
+{
+    if (medianTime)
+        return medianTime(height);
+
+    // pastTimes holds each block's parent; below the run's first
+    // block the time is unknown, which fails the lock
+    const uint64_t child = (uint64_t)height + 1;
+    if (child < startHeight || child - startHeight >= pastTimes.size())
+        return std::numeric_limits<int64_t>::max();
+    return pastTimes[child - startHeight];
+}
+
+bool IBDPipeline::ConnectBlock(const ItemRef& item)
+{
+    const std::vector<TransactionView>& vtx = item->block.vtx;
+
+    pastTimes.push_back(item->medianTimePast);
+
+    BlockContext ctx;
+    ctx.height = item->height;
+    ctx.medianTimePast = item->height ? MedianTimeAt(item->height - 1) : 0;
+    ctx.medianTimeAt = [this](uint32_t height) { return MedianTimeAt(height); };
+
+    // Every rule but the scripts, which the check stage runs
+    BlockUndo undo;
+    std::string why;
+    if (!validator.ConnectBlock(item->block, ctx, utxo, undo, &why))
+    {
+        Fail(why);
+        return false;
+    }
+
+    if (undoStore && !undoStore->HaveBlock(item->hash))
+    {
+        std::vector<uint8_t> raw;
+        undo.Serialize(raw);
+        if (!undoStore->WriteBlock(item->hash, raw.data(), raw.size()))
+        {
+            Fail("undo data write failed at height " + std::to_string(item->height));
+            return false;
+        }
+        statUndoBytes += raw.size();
+    }
+
+    uint64_t inputs = 0;
+    std::vector<ScriptCheck> checks;
+    for (size_t i = 1; i < vtx.size(); ++i)
+    {
+        std::vector<Coin>& spent = undo.txs[i - 1].spent;
+        inputs += spent.size();
+
+        if (!scriptCheck)
+            continue;
+
+        // The filter still needs the spent scripts
+        for (uint32_t j = 0; j < spent.size(); ++j)
+        {
+            ScriptCheck check;
+            check.tx = &vtx[i];
+            check.txdata = item->txdata.empty() ? nullptr : item->txdata[i].get();
+            check.input = j;
+            check.coin = filters ? spent[j] : std::move(spent[j]);
+            checks.push_back(std::move(check));
+        }
+    }
+
+    statTxs += vtx.size();
+    statInputs += inputs;
+
+    // Hand the checks to the scheduler in batches, and the filter
+    // build next to them
+    const size_t per = opts.checkBatch ? opts.checkBatch : 1;
+    const size_t batches = (checks.size() + per - 1) / per;
+
+    {
+        std::lock_guard<std::mutex> lock(checkMutex);
+        item->pending = batches + (filters ? 1 : 0);
+        if (filters)
+            filterQueue.push_back(item);
+    }
+
+    auto reserve = [this] {
+        std::unique_lock<std::mutex> lock(checkMutex);
+        checkCv.wait(lock, [this] { return stopping || outstanding < opts.checkQueue; });
+        if (stopping)
+            return false;
+        if (++outstanding > peakOutstanding)
+            peakOutstanding = outstanding;
+        return true;
+    };
+
+    if (filters)
+    {
+        item->undo = std::move(undo);
+        if (!reserve())
+            return false;
+        scheduler.Schedule(TASK_BACKGROUND, [this, item] { BuildFilter(item); });
+    }
+
+    for (size_t b = 0; b < batches; ++b)
+    {
+        std::shared_ptr<CheckBatch> batch = std::make_shared<CheckBatch>();
+        batch->item = item;
+
+        size_t first = b * per;
+        size_t last = std::min(checks.size(), first + per);
+        batch->checks.reserve(last - first);
+        for (size_t c = first; c < last; ++c)
+            batch->checks.push_back(std::move(checks[c]));
+
+        if (!reserve())
+            return false;
+        scheduler.Schedule(TASK_CONSENSUS, [this, batch] { RunChecks(*batch); });
+    }
+
+    return true;
+}
+
+bool IBDPipeline::FlushValidated(const std::array<uint8_t,32>& best)
+{
+    // Barrier: nothing unchecked may reach disk
+    {
+        std::unique_lock<std::mutex> lock(checkMutex);
+        checkCv.wait(lock, [this] { return stopping || outstanding == 0; });
+    }
+
+    if (stopping)
+        return false;
+
+    // Undo data has to be durable before a UTXO set that needs it
+    if (undoStore && !undoStore->Sync())
+    {
+        Fail("undo data sync failed");
+        return false;
+    }
+    if (filters)
+    {
+        WriteFilters();
+        if (!filters->Sync())
+            statFilterErrors++;
+    }
+
+    if (!utxo.Flush(best))
+    {
+        Fail("UTXO flush failed");
+        return false;
+    }
+
+    statFlushes++;
+    return true;
+}
+
+//
+// ================================================================
+//  Stage 4: script checks
+// ================================================================
+void IBDPipeline::RunChecks(const CheckBatch& batch)
+{
+    bool ok = !stopping;
+    if (ok)
+    {
+        for (const ScriptCheck& check : batch.checks)
+        {
+            if (!scriptCheck(check))
+            {
+                Fail("script verification failed at height " + std::to_string(batch.item->height));
+                ok = false;
+                break;
+            }
+        }
+    }
+
+    TaskDone(*batch.item, ok);
+}
+
+void IBDPipeline::BuildFilter(const ItemRef& item)
+{
+    const bool ok = !stopping;
+    if (ok)
+        item->filterElements = BlockFilterIndex::BuildFilter(item->hash, item->block, item->undo, item->filter);
+
+    TaskDone(*item, ok);
+}
+
+void IBDPipeline::TaskDone(Item& item, bool ok)
+{
+    // Wakes the connect stage (room for a task, flush barrier) and
+    // Run() waiting for the last task
+    std::lock_guard<std::mutex> lock(checkMutex);
+    if (!ok)
+        item.failed = true;
+    --item.pending;
+    --outstanding;
+    checkCv.notify_all();
+}
+
+// Connect stage only: the filter index has one writer
+void IBDPipeline::WriteFilters()
+{
+    for (;;)
+    {
+        ItemRef item;
+        {
+            std::lock_guard<std::mutex> lock(checkMutex);
+            if (filterQueue.empty() || filterQueue.front()->pending > 0 || filterQueue.front()->failed)
+                return;
+
+            item = std::move(filterQueue.front());
+            filterQueue.pop_front();
+        }
+
+        if (!filters->AddFilter(item->hash, item->header.prevHash, item->filter, item->filterElements))
+            statFilterErrors++;
+    }
+}
+
+ScriptCheckFn IBDPipeline::InterpreterCheck(uint32_t flags)
+{
+    return [flags](const ScriptCheck& check) {
+        if (!check.txdata)
+            return false;
+
+        thread_local ScriptArena arena;
+        arena.Reset();
+
+        return VerifyInput(*check.txdata, check.input, ByteSpan(check.coin.script),
+                           check.coin.amount, flags, arena, nullptr);
+    };
+}
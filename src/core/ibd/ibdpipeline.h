@@ -0,0 +1,273 @@
+#ifndef DRACHMA_IBD_IBDPIPELINE_H
+#define DRACHMA_IBD_IBDPIPELINE_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "../chain/block.h"
+#include "../chain/undo.h"
+#include "../consensus/blockvalidator.h"
+#include "../consensus/consensus.h"
+#include "../node/scheduler.h"
+#include "../script/sighash.h"
+#include "../storage/blockstore.h"
+#include "../storage/coin.h"
+#include "../storage/utxostore.h"
+#include "../../common/utils/boundedqueue.h"
+#include "../../common/utils/span.h"
+
+//
+// ===============================================================
+//  IBDSource – where the pipeline gets headers and blocks from
+// ===============================================================
+//
+//  NextHeader() yields headers in chain order. FetchBlock() may
+//  block (network download) and is called from several threads;
+//  the returned span must stay valid for the source's lifetime
+//  (e.g. a BlockStore mapping).
+//
+class IBDSource
+{
+public:
+    virtual ~IBDSource() {}
+
+    virtual bool NextHeader(BlockHeader& header) = 0;
+    virtual bool FetchBlock(const std::array<uint8_t,32>& hash, ByteSpan& data) = 0;
+};
+
+class BlockFilterIndex;
+
+//
+// ===============================================================
+//  CLASS: IBDPipeline
+// ===============================================================
+//
+//  Stages (bounded queues in between give backpressure; the
+//  connect stage stops at `checkQueue` batches in flight):
+//
+//    1. header   – 1 thread : linkage + proof of work
+//    2. fetch    – N threads: FetchBlock(), in-place parse,
+//                             txids, merkle root; results wait
+//                             in a reorder window of at most
+//                             `reorderWindow` blocks ahead of
+//                             the connect stage
+//    3. connect  – 1 thread : strictly in height order; a
+//                             BlockValidator without script
+//                             checks applies every other rule
+//                             (ChainState's, weight, sigops
+//                             and witness commitment included)
+//                             and the block to the UTXOStore
+//                             cache, then one ScriptCheck per
+//                             input is emitted from its undo
+//    4. check    – Scheduler: runs the ScriptCheckFn, one
+//                             TASK_CONSENSUS task per batch
+//
+//  Script checks need the coins being spent, so they run behind
+//  the connect stage rather than in front of it. Connected but
+//  unchecked blocks only ever live in the UTXO cache: before a
+//  flush the connect stage waits for the check stage to drain, so
+//  the flushed best block is always fully validated. When a run
+//  fails or is stopped the cache is discarded, so the store never
+//  holds a partly checked block afterwards.
+//
+//  With an undo store set, the connect stage writes every block's
+//  BlockUndo like ChainState does, so the chain can be unwound
+//  below the tip IBD leaves. This happens before the block's
+//  scripts are checked; the record of a block that later fails is
+//  harmless because it is keyed by its hash. Undo data is synced
+//  before every UTXO flush.
+//
+//  With a filter index set, every block's filter is built from the
+//  same BlockUndo by a TASK_BACKGROUND task next to its script
+//  checks. The connect stage writes filters (and so chains their
+//  headers) strictly in height order, each only once all of its
+//  block's checks have passed: after every block it writes those
+//  that are ready, and at the flush barrier all of them. Filter
+//  index errors are counted and do not stop the sync.
+//
+//  Locktimes use the median time past of the headers seen by the
+//  run, which is exact when syncing from genesis; a run resuming
+//  higher up needs SetMedianTimeSource() for the earlier blocks.
+//
+// ===============================================================
+//
+class IBDPipeline
+{
+public:
+    struct Options
+    {
+        unsigned fetchThreads;
+        size_t fetchQueue;          // headers waiting for fetch
+        size_t reorderWindow;       // fetched blocks ahead of connect
+        size_t checkQueue;          // check batches in flight
+        size_t checkBatch;          // inputs per check batch
+
+        Options()
+            : fetchThreads(4), fetchQueue(256),
+              reorderWindow(64), checkQueue(1024), checkBatch(64) {}
+    };
+
+    struct Stats
+    {
+        uint32_t height;            // last connected block
+        uint64_t blocks;
+        uint64_t txs;
+        uint64_t inputs;
+        uint64_t flushes;
+        uint64_t undoBytes;
+        uint64_t filterErrors;      // blocks the filter index did not take
+        double seconds;
+        size_t peakFetchQueue;
+        size_t peakCheckQueue;
+
+        double BlocksPerSecond() const { return seconds > 0 ? blocks / seconds : 0; }
+        double InputsPerSecond() const { return seconds > 0 ? inputs / seconds : 0; }
+    };
+
+    IBDPipeline(UTXOStore& utxo, Scheduler& scheduler, const Options& opts = Options());
+    ~IBDPipeline();
+
+    IBDPipeline(const IBDPipeline&) = delete;
+    IBDPipeline& operator=(const IBDPipeline&) = delete;
+
+    // Without a check function inputs are connected and counted but
+    // not script-verified (assumevalid-style replay).
+    void SetScriptCheck(ScriptCheckFn fn) { scriptCheck = std::move(fn); }
+
+    // Check function running the script interpreter with `flags`
+    // (SCRIPT_VERIFY_*); each scheduler worker reuses its own arena.
+    static ScriptCheckFn InterpreterCheck(uint32_t flags);
+
+    // Where undo data goes (prefix "rev", the store ChainState uses)
+    // and the filter index to feed; both optional, set before Run()
+    void SetUndoStore(BlockStore* undo) { undoStore = undo; }
+    void SetFilterIndex(BlockFilterIndex* index) { filters = index; }
+
+    // Median time past by height for the chain being synced (e.g.
+    // from the HeaderIndex); called from the connect stage only.
+    void SetMedianTimeSource(MedianTimeFn fn) { medianTime = std::move(fn); }
+
+    // Sync everything the source has, starting on top of the UTXO
+    // store's best block at height `startHeight`. Blocks until done;
+    // false on the first validation failure (see GetError()) or
+    // after Stop(), with the UTXO cache discarded: the store is left
+    // at its last flushed, fully validated best block.
+    bool Run(IBDSource& source, uint32_t startHeight = 0);
+
+    // Ask a running pipeline to wind down (thread-safe)
+    void Stop();
+
+    Stats GetStats() const;
+    std::string GetError() const;
+
+private:
+    struct Item
+    {
+        uint32_t height;
+        std::array<uint8_t,32> hash;
+        BlockHeader header;
+        int64_t medianTimePast;     // of the parent, from the headers seen
+        BlockView block;            // views into the source's buffer
+
+        // Sighash data per transaction (null for the coinbase); only
+        // built when scripts are checked
+        std::vector<std::unique_ptr<PrecomputedTxData>> txdata;
+
+        // With a filter index: the spent coins and the filter built
+        // from them, waiting to be written
+        BlockUndo undo;
+        std::vector<uint8_t> filter;
+        uint64_t filterElements;
+
+        // Check batches and filter task still to finish, and whether
+        // a check failed (checkMutex)
+        size_t pending;
+        bool failed;
+
+        Item() : height(0), medianTimePast(0), filterElements(0), pending(0), failed(false) {}
+    };
+
+    typedef std::shared_ptr<Item> ItemRef;
+
+    struct CheckBatch
+    {
+        ItemRef item;
+        std::vector<ScriptCheck> checks;
+    };
+
+    void HeaderStage(IBDSource& source);
+    void FetchStage(IBDSource& source);
+    void ConnectStage();
+    void RunChecks(const CheckBatch& batch);
+    void BuildFilter(const ItemRef& item);
+    void TaskDone(Item& item, bool ok);
+    void WriteFilters();
+
+    bool ConnectBlock(const ItemRef& item);
+    int64_t MedianTimeAt(uint32_t height) const;
+    bool FlushValidated(const std::array<uint8_t,32>& best);
+    void Fail(const std::string& why);
+
+    UTXOStore& utxo;
+    Scheduler& scheduler;
+    Options opts;
+    BlockValidator validator;
+    ScriptCheckFn scriptCheck;
+    MedianTimeFn medianTime;
+    BlockStore* undoStore;
+    BlockFilterIndex* filters;
+
+    std::unique_ptr<BoundedQueue<ItemRef>> fetchQueue;
+
+    // Reorder window between fetch and connect
+    std::mutex reorderMutex;
+    std::condition_variable reorderCv;
+    std::map<uint32_t, ItemRef> reorder;
+    uint32_t nextConnect;
+    unsigned fetchersRunning;
+
+    // Check batches and filter tasks in flight (backpressure and
+    // flush barrier)
+    mutable std::mutex checkMutex;
+    std::condition_variable checkCv;
+    uint64_t outstanding;
+    uint64_t peakOutstanding;
+
+    // Connected blocks whose filters are not written yet, in height
+    // order (checkMutex)
+    std::deque<ItemRef> filterQueue;
+
+    std::atomic<bool> stopping;
+    mutable std::mutex errorMutex;
+    std::string error;
+
+    uint32_t startHeight;
+    std::array<uint8_t,32> tipHash;
+
+    // Median time past of the parent of every block connected this
+    // run, by height - startHeight (connect stage only)
+    std::vector<int64_t> pastTimes;
+
+    std::atomic<uint32_t> statHeight;
+    std::atomic<uint64_t> statBlocks;
+    std::atomic<uint64_t> statTxs;
+    std::atomic<uint64_t> statInputs;
+    std::atomic<uint64_t> statFlushes;
+    std::atomic<uint64_t> statUndoBytes;
+    std::atomic<uint64_t> statFilterErrors;
+    std::chrono::steady_clock::time_point started;
+    std::chrono::steady_clock::time_point finished;
+    std::atomic<bool> running;
+};
+
+#endif // DRACHMA_IBD_IBDPIPELINE_H
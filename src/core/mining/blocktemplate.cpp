@@ -0,0 +1,537 @@
+#include "blocktemplate.h"
+#include "../crypto/hash.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <set>
+#include <unordered_set>
+
+typedef std::chrono::steady_clock Clock;
+
+static double MillisSince(Clock::time_point t)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - t).count();
+}
+
+// Topological order for a package: fewer in-pool ancestors first
+static void SortPackage(std::vector<const MempoolEntry*>& pkg)
+{
+    std::sort(pkg.begin(), pkg.end(), [](const MempoolEntry* a, const MempoolEntry* b)
+    {
+        if (a->GetCountWithAncestors() != b->GetCountWithAncestors())
+            return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+        return a->GetTxid() < b->GetTxid();
+    });
+}
+
+BlockTemplateBuilder::BlockTemplateBuilder(Mempool& p, const Options& o)
+    : pool(p), opts(o)
+{
+    haveTip = false;
+    height = 0;
+    removedCount = 0;
+    totalFees = 0;
+    totalVSize = 0;
+    totalWeight = 0;
+    totalSigOpCost = 0;
+    minPkgFees = 0;
+    minPkgVSize = 0;
+    dirtyFrom = SIZE_MAX;
+    stale = false;
+    changed = false;
+    nextId = 1;
+    std::memset(&stats, 0, sizeof(stats));
+
+    pool.SetNotifications(
+        [this](const MempoolEntry& e) { OnAdded(e); },
+        [this](const MempoolEntry& e, MempoolRemoval why) { OnRemoved(e, why); });
+}
+
+BlockTemplateBuilder::~BlockTemplateBuilder()
+{
+    pool.SetNotifications(nullptr, nullptr);
+}
+
+//
+// ================================================================
+//  Full build
+// ================================================================
+void BlockTemplateBuilder::NewTip(const std::array<uint8_t,32>& prevHash, uint32_t h,
+                                  uint32_t time, uint32_t bits)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    header = BlockHeader();
+    header.version = opts.version;
+    header.prevHash = prevHash;
+    header.time = time;
+    header.bits = bits;
+    height = h;
+    haveTip = true;
+
+    BuildLocked();
+}
+
+void BlockTemplateBuilder::Rebuild()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!haveTip)
+        return;
+
+    int64_t before = totalFees;
+    BuildLocked();
+    stats.lastRebuildGain = totalFees - before;
+}
+
+void BlockTemplateBuilder::BuildLocked()
+{
+    const Clock::time_point started = Clock::now();
+
+    items.clear();
+    positions.clear();
+    removedCount = 0;
+    totalFees = 0;
+    totalVSize = 0;
+    totalWeight = 0;
+    totalSigOpCost = 0;
+    minPkgFees = 0;
+    minPkgVSize = 0;
+
+    levels.assign(1, std::vector<Hash256>(1, Hash256()));
+    witnessLevels = levels;
+    dirtyFrom = 0;
+
+    // Packages whose ancestors were partly selected, re-scored
+    // without them (same idea as Bitcoin's mapModifiedTx)
+    struct Modified
+    {
+        int64_t fees;
+        uint64_t vsize;
+    };
+
+    std::unordered_map<const MempoolEntry*, Modified> modified;
+
+    std::function<bool(const MempoolEntry*, const MempoolEntry*)> byModifiedScore =
+        [&modified](const MempoolEntry* a, const MempoolEntry* b)
+    {
+        const Modified& ma = modified.at(a);
+        const Modified& mb = modified.at(b);
+        if (FeeRateLess(mb.fees, mb.vsize, ma.fees, ma.vsize)) return true;
+        if (FeeRateLess(ma.fees, ma.vsize, mb.fees, mb.vsize)) return false;
+        return a->GetTxid() < b->GetTxid();
+    };
+
+    std::set<const MempoolEntry*, std::function<bool(const MempoolEntry*, const MempoolEntry*)>>
+        modifiedSet(byModifiedScore);
+
+    std::unordered_set<const MempoolEntry*> inBlock;
+    std::unordered_set<const MempoolEntry*> failed;
+
+    const Mempool::AncestorIndex& index = pool.ByAncestorScore();
+    auto mi = index.begin();
+    unsigned consecutiveFailed = 0;
+
+    std::vector<const MempoolEntry*> pkg;
+    std::vector<const MempoolEntry*> related;
+
+    while (mi != index.end() || !modifiedSet.empty())
+    {
+        if (mi != index.end() &&
+            (inBlock.count(*mi) || failed.count(*mi) || modified.count(*mi)))
+        {
+            ++mi;
+            continue;
+        }
+
+        const MempoolEntry* e;
+        int64_t pkgFees;
+        uint64_t pkgVSize;
+        bool fromModified;
+
+        if (mi == index.end())
+        {
+            fromModified = true;
+        }
+        else if (modifiedSet.empty())
+        {
+            fromModified = false;
+        }
+        else
+        {
+            const Modified& best = modified.at(*modifiedSet.begin());
+            fromModified = FeeRateLess((*mi)->GetFeesWithAncestors(), (*mi)->GetVSizeWithAncestors(),
+                                       best.fees, best.vsize);
+        }
+
+        if (fromModified)
+        {
+            e = *modifiedSet.begin();
+            pkgFees = modified.at(e).fees;
+            pkgVSize = modified.at(e).vsize;
+        }
+        else
+        {
+            e = *mi++;
+            pkgFees = e->GetFeesWithAncestors();
+            pkgVSize = e->GetVSizeWithAncestors();
+        }
+
+        pkg.clear();
+        related.clear();
+        pool.CalculateAncestors(e, related);
+        for (const MempoolEntry* a : related)
+            if (!inBlock.count(a))
+                pkg.push_back(a);
+        pkg.push_back(e);
+
+        if (!Fits(pkg))
+        {
+            if (fromModified)
+            {
+                modifiedSet.erase(e);
+                modified.erase(e);
+            }
+            failed.insert(e);
+
+            // Nearly full and nothing fits any more
+            if (++consecutiveFailed > 1000 && totalWeight + 4000 > opts.maxBlockWeight)
+                break;
+            continue;
+        }
+
+        consecutiveFailed = 0;
+        SortPackage(pkg);
+
+        for (const MempoolEntry* p : pkg)
+        {
+            Append(*p);
+            inBlock.insert(p);
+            if (modified.count(p))
+            {
+                modifiedSet.erase(p);
+                modified.erase(p);
+            }
+        }
+
+        if (minPkgVSize == 0 || FeeRateLess(pkgFees, pkgVSize, minPkgFees, minPkgVSize))
+        {
+            minPkgFees = pkgFees;
+            minPkgVSize = pkgVSize;
+        }
+
+        // Descendants of what was just added now carry less baggage
+        for (const MempoolEntry* p : pkg)
+        {
+            related.clear();
+            pool.CalculateDescendants(p, related);
+            for (const MempoolEntry* d : related)
+            {
+                if (inBlock.count(d))
+                    continue;
+
+                auto it = modified.find(d);
+                if (it == modified.end())
+                {
+                    Modified m;
+                    m.fees = d->GetFeesWithAncestors();
+                    m.vsize = d->GetVSizeWithAncestors();
+                    it = modified.emplace(d, m).first;
+                }
+                else
+                {
+                    modifiedSet.erase(d);
+                }
+
+                it->second.fees -= p->GetFee();
+                it->second.vsize -= p->GetVSize();
+                modifiedSet.insert(d);
+            }
+        }
+    }
+
+    stale = false;
+    changed = true;
+    lastBuild = Clock::now();
+
+    stats.fullBuilds++;
+    stats.lastBuildMs = MillisSince(started);
+    stats.maxBuildMs = std::max(stats.maxBuildMs, stats.lastBuildMs);
+}
+
+bool BlockTemplateBuilder::Fits(const std::vector<const MempoolEntry*>& pkg) const
+{
+    uint64_t weight = 0;
+    int64_t sigOpCost = 0;
+    for (const MempoolEntry* p : pkg)
+    {
+        weight += p->GetWeight();
+        sigOpCost += p->GetSigOpCost();
+    }
+
+    return totalWeight + weight <= opts.maxBlockWeight &&
+           totalSigOpCost + sigOpCost <= opts.maxBlockSigOpsCost;
+}
+
+void BlockTemplateBuilder::Append(const MempoolEntry& entry)
+{
+    Item item;
+    item.tx = entry.GetTx();
+    item.txid = entry.GetTxid();
+    item.wtxid = entry.GetWtxid();
+    item.fee = entry.GetFee();
+    item.vsize = entry.GetVSize();
+    item.weight = entry.GetWeight();
+    item.sigOpCost = entry.GetSigOpCost();
+    item.removed = false;
+
+    positions[item.txid] = items.size();
+    items.push_back(item);
+
+    totalFees += item.fee;
+    totalVSize += item.vsize;
+    totalWeight += item.weight;
+    totalSigOpCost += item.sigOpCost;
+
+    // Leaf 0 is the coinbase
+    levels[0].push_back(item.txid);
+    witnessLevels[0].push_back(item.wtxid);
+    dirtyFrom = std::min(dirtyFrom, levels[0].size() - 1);
+}
+
+//
+// ================================================================
+//  Incremental updates (mempool notifications)
+// ================================================================
+void BlockTemplateBuilder::NoteUpdate(Clock::time_point started)
+{
+    stats.lastUpdateMs = MillisSince(started);
+    stats.maxUpdateMs = std::max(stats.maxUpdateMs, stats.lastUpdateMs);
+}
+
+void BlockTemplateBuilder::OnAdded(const MempoolEntry& entry)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!haveTip || positions.count(entry.GetTxid()))
+        return;
+
+    const Clock::time_point started = Clock::now();
+
+    std::vector<const MempoolEntry*> ancestors;
+    pool.CalculateAncestors(&entry, ancestors);
+
+    std::vector<const MempoolEntry*> pkg;
+    int64_t pkgFees = entry.GetFee();
+    uint64_t pkgVSize = entry.GetVSize();
+
+    for (const MempoolEntry* a : ancestors)
+    {
+        if (positions.count(a->GetTxid()))
+            continue;
+        pkg.push_back(a);
+        pkgFees += a->GetFee();
+        pkgVSize += a->GetVSize();
+    }
+    pkg.push_back(&entry);
+
+    if (Fits(pkg))
+    {
+        SortPackage(pkg);
+        for (const MempoolEntry* p : pkg)
+            Append(*p);
+
+        if (minPkgVSize == 0 || FeeRateLess(pkgFees, pkgVSize, minPkgFees, minPkgVSize))
+        {
+            minPkgFees = pkgFees;
+            minPkgVSize = pkgVSize;
+        }
+
+        changed = true;
+        stats.incrementalAdds++;
+    }
+    else if (FeeRateLess(minPkgFees, minPkgVSize, pkgFees, pkgVSize))
+    {
+        stale = true;
+    }
+
+    NoteUpdate(started);
+
+    // The pool is consistent here (unlike inside a removal), so this
+    // is where a stale template gets replaced.
+    if (stale && Clock::now() - lastBuild >= opts.rebuildInterval)
+    {
+        int64_t before = totalFees;
+        BuildLocked();
+        stats.lastRebuildGain = totalFees - before;
+    }
+}
+
+void BlockTemplateBuilder::OnRemoved(const MempoolEntry& entry, MempoolRemoval why)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = positions.find(entry.GetTxid());
+    if (it == positions.end())
+        return;
+
+    const Clock::time_point started = Clock::now();
+
+    Item& item = items[it->second];
+    item.removed = true;
+    item.tx.reset();
+    totalFees -= item.fee;
+    totalVSize -= item.vsize;
+    totalWeight -= item.weight;
+    totalSigOpCost -= item.sigOpCost;
+    removedCount++;
+
+    dirtyFrom = std::min(dirtyFrom, it->second + 1);
+    positions.erase(it);
+
+    // Freed space could hold something better. Confirmed
+    // transactions are followed by NewTip() anyway.
+    if (why != MempoolRemoval::BLOCK)
+        stale = true;
+
+    changed = true;
+    stats.incrementalRemoves++;
+    NoteUpdate(started);
+}
+
+//
+// ================================================================
+//  Merkle tree / publish
+// ================================================================
+void BlockTemplateBuilder::Compact()
+{
+    if (removedCount == 0)
+        return;
+
+    // Every removal lowered dirtyFrom to its leaf (leaf = item + 1)
+    const size_t start = dirtyFrom > 0 ? dirtyFrom - 1 : 0;
+    size_t out = start;
+    for (size_t i = start; i < items.size(); ++i)
+    {
+        if (items[i].removed)
+            continue;
+        if (i != out)
+            items[out] = std::move(items[i]);
+        positions[items[out].txid] = out;
+        out++;
+    }
+
+    items.resize(out);
+    levels[0].resize(items.size() + 1);
+    witnessLevels[0].resize(items.size() + 1);
+    for (size_t i = start; i < items.size(); ++i)
+    {
+        levels[0][i + 1] = items[i].txid;
+        witnessLevels[0][i + 1] = items[i].wtxid;
+    }
+
+    removedCount = 0;
+}
+
+void BlockTemplateBuilder::UpdateMerkle(MerkleLevels& levels, size_t from)
+{
+    uint8_t buf[64];
+    size_t lo = from;
+    size_t k = 0;
+
+    for (; levels[k].size() > 1; ++k)
+    {
+        if (levels.size() <= k + 1)
+            levels.emplace_back();
+
+        const std::vector<Hash256>& cur = levels[k];
+        const size_t n = cur.size();
+        std::vector<Hash256>& up = levels[k + 1];
+        up.resize((n + 1) / 2);
+
+        for (size_t p = lo / 2; p < up.size(); ++p)
+        {
+            const Hash256& left = cur[2 * p];
+            const Hash256& right = (2 * p + 1 < n) ? cur[2 * p + 1] : left;
+            std::memcpy(buf, left.data(), 32);
+            std::memcpy(buf + 32, right.data(), 32);
+            Hash::SHA256D(buf, 64, up[p].data());
+        }
+
+        lo /= 2;
+    }
+
+    levels.resize(k + 1);
+}
+
+BlockTemplateRef BlockTemplateBuilder::GetTemplate()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (!haveTip)
+        return BlockTemplateRef();
+
+    if (!changed && published)
+        return published;
+
+    const Clock::time_point started = Clock::now();
+
+    Compact();
+    if (dirtyFrom != SIZE_MAX)
+    {
+        UpdateMerkle(levels, dirtyFrom);
+        UpdateMerkle(witnessLevels, dirtyFrom);
+        dirtyFrom = SIZE_MAX;
+    }
+
+    std::shared_ptr<BlockTemplate> t = std::make_shared<BlockTemplate>();
+    t->id = nextId++;
+    t->header = header;
+    t->height = height;
+    t->totalFees = totalFees;
+    t->vsize = totalVSize;
+    t->weight = totalWeight;
+    t->sigOpCost = totalSigOpCost;
+
+    t->txs.reserve(items.size());
+    t->fees.reserve(items.size());
+    for (const Item& item : items)
+    {
+        t->txs.push_back(item.tx);
+        t->fees.push_back(item.fee);
+    }
+
+    // Siblings of the coinbase path never depend on the coinbase
+    for (size_t k = 0; k + 1 < levels.size(); ++k)
+        t->coinbaseBranch.push_back(levels[k][1]);
+
+    // Reserved value: 32 zero bytes
+    uint8_t buf[64] = {};
+    std::memcpy(buf, witnessLevels.back()[0].data(), 32);
+    Hash256 commitment;
+    Hash::SHA256D(buf, 64, commitment.data());
+
+    t->witnessCommitment = { 0x6a, 0x24, 0xaa, 0x21, 0xa9, 0xed };
+    t->witnessCommitment.insert(t->witnessCommitment.end(), commitment.begin(), commitment.end());
+
+    stats.lastFeeDelta = totalFees - (published ? published->totalFees : 0);
+    stats.publishes++;
+    stats.lastPublishMs = MillisSince(started);
+
+    published = t;
+    changed = false;
+    return published;
+}
+
+BlockTemplateBuilder::Stats BlockTemplateBuilder::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    Stats s = stats;
+    s.txs = items.size() - removedCount;
+    s.vsize = totalVSize;
+    s.weight = totalWeight;
+    s.sigOpCost = totalSigOpCost;
+    s.fees = totalFees;
+    s.stale = stale;
+    return s;
+}
@@ -0,0 +1,211 @@
+#ifndef DRACHMA_MINING_BLOCKTEMPLATE_H
+#define DRACHMA_MINING_BLOCKTEMPLATE_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "../chain/block.h"
+#include "../consensus/consensus.h"
+#include "../tx/mempool.h"
+
+//
+// Immutable snapshot handed to miners / the pool server
+//
+struct BlockTemplate
+{
+    uint64_t id;                                // increases with every publish
+    BlockHeader header;                         // merkleRoot / nonce left zero
+    uint32_t height;
+
+    std::vector<TransactionRef> txs;            // block order, coinbase excluded
+    std::vector<int64_t> fees;                  // per transaction
+    int64_t totalFees;
+    uint64_t vsize;                             // transactions only
+    uint64_t weight;                            // transactions only
+    int64_t sigOpCost;                          // transactions only
+
+    // Sibling hashes from the coinbase leaf up to the root: the
+    // merkle root is folded from SHA256D(coinbase) and these.
+    std::vector<std::array<uint8_t,32>> coinbaseBranch;
+
+    // BIP141 commitment output the coinbase must carry (OP_RETURN
+    // aa21a9ed + SHA256D(witness root, reserved value)), with the
+    // 32 zero bytes of the reserved value as its input's witness
+    std::vector<uint8_t> witnessCommitment;
+};
+
+typedef std::shared_ptr<const BlockTemplate> BlockTemplateRef;
+
+//
+// ===============================================================
+//  CLASS: BlockTemplateBuilder
+// ===============================================================
+//
+//  Keeps a block template current as the mempool changes instead
+//  of rebuilding it for every work update.
+//
+//  NewTip() runs a full build: ancestor-score packages from the
+//  mempool, with packages re-scored as their ancestors get
+//  selected. After that the builder follows the mempool's
+//  notifications:
+//
+//    added   – the package (missing ancestors + tx) is appended
+//              if it fits; the merkle trees are updated along one
+//              path only (O(log n) hashes)
+//    removed – the transaction is tombstoned; the tree is redone
+//              from the lowest removed position on the next publish
+//
+//  Two trees are kept: txids for the coinbase branch and wtxids
+//  (coinbase leaf zero) for the witness commitment. A package fits
+//  when the block stays within `maxBlockWeight` and
+//  `maxBlockSigOpsCost`, both net of what the coinbase needs.
+//
+//  Appending never displaces cheaper transactions, so a template
+//  can fall behind what a full build would pick. When a package
+//  does not fit but beats the cheapest selected package the
+//  template is marked stale and rebuilt at most once per
+//  `rebuildInterval`.
+//
+//  Threading: NewTip(), Rebuild() and the mempool callbacks read
+//  the mempool and must be serialized with other mempool access.
+//  GetTemplate() and GetStats() may be called from any thread;
+//  published templates are immutable.
+//
+// ===============================================================
+//
+class BlockTemplateBuilder
+{
+public:
+    struct Options
+    {
+        uint64_t maxBlockWeight;                // transactions only (coinbase reserved)
+        int64_t maxBlockSigOpsCost;             // likewise
+        int32_t version;
+        std::chrono::milliseconds rebuildInterval;
+
+        Options()
+            : maxBlockWeight(MAX_BLOCK_WEIGHT - 4000),
+              maxBlockSigOpsCost(MAX_BLOCK_SIGOPS_COST - 400), version(0x20000000),
+              rebuildInterval(1000) {}
+    };
+
+    struct Stats
+    {
+        uint64_t fullBuilds;
+        uint64_t incrementalAdds;               // packages appended
+        uint64_t incrementalRemoves;
+        uint64_t publishes;
+
+        double lastBuildMs;                     // full build
+        double maxBuildMs;
+        double lastUpdateMs;                    // one incremental add / remove
+        double maxUpdateMs;
+        double lastPublishMs;                   // merkle catch-up + snapshot
+
+        int64_t lastFeeDelta;                   // fees vs. previous published template
+        int64_t lastRebuildGain;                // fees a stale rebuild won back
+
+        size_t txs;
+        uint64_t vsize;
+        uint64_t weight;
+        int64_t sigOpCost;
+        int64_t fees;
+        bool stale;
+    };
+
+    explicit BlockTemplateBuilder(Mempool& pool, const Options& opts = Options());
+    ~BlockTemplateBuilder();
+
+    BlockTemplateBuilder(const BlockTemplateBuilder&) = delete;
+    BlockTemplateBuilder& operator=(const BlockTemplateBuilder&) = delete;
+
+    // New chain tip: full rebuild on top of it
+    void NewTip(const std::array<uint8_t,32>& prevHash, uint32_t height,
+                uint32_t time, uint32_t bits);
+
+    // Full rebuild on the current tip
+    void Rebuild();
+
+    // Current template; cheap when nothing changed since the last
+    // call. Null before the first NewTip().
+    BlockTemplateRef GetTemplate();
+
+    Stats GetStats() const;
+
+private:
+    struct Item
+    {
+        TransactionRef tx;
+        std::array<uint8_t,32> txid;
+        std::array<uint8_t,32> wtxid;
+        int64_t fee;
+        uint64_t vsize;
+        uint64_t weight;
+        int64_t sigOpCost;
+        bool removed;
+    };
+
+    typedef std::array<uint8_t,32> Hash256;
+
+    struct TxidHasher
+    {
+        SaltedOutPointHasher salt;
+        size_t operator()(const Hash256& h) const { return salt.Hash(h.data(), 0); }
+    };
+
+    void OnAdded(const MempoolEntry& entry);
+    void OnRemoved(const MempoolEntry& entry, MempoolRemoval why);
+
+    typedef std::vector<std::vector<Hash256>> MerkleLevels;
+
+    void BuildLocked();
+    bool Fits(const std::vector<const MempoolEntry*>& pkg) const;
+    void Append(const MempoolEntry& entry);
+    static void UpdateMerkle(MerkleLevels& levels, size_t from);
+    void Compact();
+    void NoteUpdate(std::chrono::steady_clock::time_point started);
+
+    Mempool& pool;
+    Options opts;
+
+    mutable std::mutex mutex;
+
+    bool haveTip;
+    BlockHeader header;
+    uint32_t height;
+
+    // Selected transactions (with tombstones) and their positions
+    std::vector<Item> items;
+    std::unordered_map<Hash256, size_t, TxidHasher> positions;
+    size_t removedCount;
+    int64_t totalFees;
+    uint64_t totalVSize;
+    uint64_t totalWeight;
+    int64_t totalSigOpCost;
+
+    // Cheapest package selected so far (stale detection)
+    int64_t minPkgFees;
+    uint64_t minPkgVSize;
+
+    // Merkle levels; leaf 0 is a placeholder for the coinbase (in
+    // the witness tree its wtxid, zero by definition)
+    MerkleLevels levels;
+    MerkleLevels witnessLevels;
+    size_t dirtyFrom;               // SIZE_MAX = trees up to date
+
+    bool stale;
+    bool changed;
+    std::chrono::steady_clock::time_point lastBuild;
+
+    BlockTemplateRef published;
+    uint64_t nextId;
+
+    Stats stats;
+};
+
+#endif // DRACHMA_MINING_BLOCKTEMPLATE_H
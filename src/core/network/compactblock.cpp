@@ -0,0 +1,801 @@
+#include "compactblock.h"
+#include "../crypto/sha256.h"
+#include "../crypto/siphash.h"
+
+#include <algorithm>
+#include <cstring>
+
+// Smallest serialized transaction the decoders accept per entry
+static const size_t MIN_TX_SIZE = 60;
+
+static bool ReadHash(SpanReader& in, std::array<uint8_t,32>& out)
+{
+    return in.ReadBytes(out.data(), 32);
+}
+
+//
+// ================================================================
+//  CompactBlock
+// ================================================================
+CompactBlock::CompactBlock()
+{
+    nonce = 0;
+    k0 = 0;
+    k1 = 0;
+}
+
+CompactBlock::CompactBlock(const Block& block, uint64_t n)
+{
+    header = block.header;
+    nonce = n;
+    ComputeKeys();
+
+    if (block.vtx.empty())
+        return;
+
+    PrefilledTransaction cb;
+    cb.index = 0;
+    cb.tx = block.vtx[0];
+    prefilled.push_back(std::move(cb));
+
+    shortIds.reserve(block.vtx.size() - 1);
+    for (size_t i = 1; i < block.vtx.size(); ++i)
+        shortIds.push_back(GetShortId(block.vtx[i].GetWtxid()));
+}
+
+void CompactBlock::ComputeKeys()
+{
+    uint8_t buf[BlockHeader::SIZE + 8];
+    header.Serialize(buf);
+    WriteLE64(buf + BlockHeader::SIZE, nonce);
+
+    uint8_t digest[32];
+    ::SHA256 sha;
+    sha.Update(buf, sizeof(buf));
+    sha.Final(digest);
+
+    k0 = ReadLE64(digest);
+    k1 = ReadLE64(digest + 8);
+}
+
+uint64_t CompactBlock::GetShortId(const std::array<uint8_t,32>& wtxid) const
+{
+    return SipHashUint256(k0, k1, wtxid.data()) & 0xffffffffffffULL;
+}
+
+void CompactBlock::Serialize(std::vector<uint8_t>& out) const
+{
+    header.Serialize(out);
+    AppendU64(out, nonce);
+
+    AppendCompactSize(out, shortIds.size());
+    for (uint64_t id : shortIds)
+    {
+        uint8_t b[8];
+        WriteLE64(b, id);
+        AppendBytes(out, b, SHORTTXID_SIZE);
+    }
+
+    // Indexes are differential: each is the gap after the previous
+    AppendCompactSize(out, prefilled.size());
+    uint32_t last = 0;
+    for (size_t i = 0; i < prefilled.size(); ++i)
+    {
+        const uint32_t index = prefilled[i].index;
+        AppendCompactSize(out, i == 0 ? index : index - last - 1);
+        prefilled[i].tx.Serialize(out, true);
+        last = index;
+    }
+}
+
+bool CompactBlock::Deserialize(ByteSpan data)
+{
+    SpanReader in(data);
+    shortIds.clear();
+    prefilled.clear();
+
+    if (!header.Deserialize(in) || !in.ReadU64(nonce))
+        return false;
+
+    uint64_t count;
+    if (!in.ReadCompactSize(count) || count > in.Remaining() / SHORTTXID_SIZE)
+        return false;
+
+    shortIds.resize((size_t)count);
+    for (uint64_t& id : shortIds)
+    {
+        uint8_t b[8] = {0};
+        if (!in.ReadBytes(b, SHORTTXID_SIZE))
+            return false;
+        id = ReadLE64(b);
+    }
+
+    if (!in.ReadCompactSize(count) || count > in.Remaining() / MIN_TX_SIZE)
+        return false;
+
+    if (shortIds.size() + count == 0 || shortIds.size() + count > MAX_CMPCT_BLOCK_TXS)
+        return false;
+
+    prefilled.resize((size_t)count);
+    uint64_t next = 0;
+    for (PrefilledTransaction& p : prefilled)
+    {
+        uint64_t delta;
+        if (!in.ReadCompactSize(delta) || delta > MAX_CMPCT_BLOCK_TXS)
+            return false;
+
+        // Strictly increasing, inside the block
+        const uint64_t index = next + delta;
+        if (index >= shortIds.size() + prefilled.size())
+            return false;
+
+        p.index = (uint32_t)index;
+        next = index + 1;
+
+        if (!p.tx.Deserialize(in))
+            return false;
+    }
+
+    if (!in.Empty())
+        return false;
+
+    ComputeKeys();
+    return true;
+}
+
+//
+// ================================================================
+//  BlockTxnRequest / BlockTxn
+// ================================================================
+void BlockTxnRequest::Serialize(std::vector<uint8_t>& out) const
+{
+    AppendBytes(out, blockHash.data(), 32);
+    AppendCompactSize(out, indexes.size());
+
+    uint32_t last = 0;
+    for (size_t i = 0; i < indexes.size(); ++i)
+    {
+        AppendCompactSize(out, i == 0 ? indexes[i] : indexes[i] - last - 1);
+        last = indexes[i];
+    }
+}
+
+bool BlockTxnRequest::Deserialize(ByteSpan data)
+{
+    SpanReader in(data);
+    indexes.clear();
+
+    uint64_t count;
+    if (!ReadHash(in, blockHash) || !in.ReadCompactSize(count) ||
+        count > in.Remaining() || count > MAX_CMPCT_BLOCK_TXS)
+        return false;
+
+    indexes.resize((size_t)count);
+    uint64_t next = 0;
+    for (uint32_t& index : indexes)
+    {
+        uint64_t delta;
+        if (!in.ReadCompactSize(delta) || delta > MAX_CMPCT_BLOCK_TXS)
+            return false;
+
+        const uint64_t i = next + delta;
+        if (i >= MAX_CMPCT_BLOCK_TXS)
+            return false;
+
+        index = (uint32_t)i;
+        next = i + 1;
+    }
+
+    return in.Empty();
+}
+
+void BlockTxn::Serialize(std::vector<uint8_t>& out) const
+{
+    AppendBytes(out, blockHash.data(), 32);
+    AppendCompactSize(out, txs.size());
+    for (const Transaction& tx : txs)
+        tx.Serialize(out, true);
+}
+
+bool BlockTxn::Deserialize(ByteSpan data)
+{
+    SpanReader in(data);
+    txs.clear();
+
+    uint64_t count;
+    if (!ReadHash(in, blockHash) || !in.ReadCompactSize(count) ||
+        count > in.Remaining() / MIN_TX_SIZE)
+        return false;
+
+    txs.resize((size_t)count);
+    for (Transaction& tx : txs)
+        if (!tx.Deserialize(in))
+            return false;
+
+    return in.Empty();
+}
+
+//
+// ================================================================
+//  PartialBlock
+// ================================================================
+PartialBlock::PartialBlock()
+{
+    prefilledCount = 0;
+    mempoolCount = 0;
+    extraCount = 0;
+}
+
+PartialBlock::Status PartialBlock::Init(const CompactBlock& cmpct, const Mempool& pool,
+                                        const std::vector<TransactionRef>& extra)
+{
+    header = cmpct.header;
+    txs.assign(cmpct.GetTxCount(), nullptr);
+    prefilledCount = 0;
+    mempoolCount = 0;
+    extraCount = 0;
+
+    if (txs.empty())
+        return Status::INVALID;
+
+    // Slots not prefilled, in block order, take the short IDs in turn
+    std::vector<bool> isPrefilled(txs.size(), false);
+    for (const PrefilledTransaction& p : cmpct.prefilled)
+    {
+        txs[p.index] = std::make_shared<const Transaction>(p.tx);
+        isPrefilled[p.index] = true;
+        prefilledCount++;
+    }
+
+    // Short ID -> slot. Short IDs are keyed SipHash output, so the
+    // identity hash spreads them fine.
+    std::unordered_map<uint64_t, uint32_t> slots;
+    slots.reserve(cmpct.shortIds.size());
+
+    size_t next = 0;
+    for (uint32_t i = 0; i < txs.size(); ++i)
+    {
+        if (isPrefilled[i])
+            continue;
+
+        // Two transactions with one short ID: no way to tell which
+        // the block meant without the full block
+        if (!slots.emplace(cmpct.shortIds[next++], i).second)
+            return Status::FAILED;
+    }
+
+    // A slot claimed twice is a collision; it stays empty and is
+    // requested, and never gets claimed again
+    enum : uint8_t { NONE, MEMPOOL, EXTRA, COLLIDED };
+    std::vector<uint8_t> source(txs.size(), NONE);
+    size_t unfilled = slots.size();
+
+    auto Claim = [&](const TransactionRef& tx, const std::array<uint8_t,32>& wtxid, uint8_t from)
+    {
+        auto it = slots.find(cmpct.GetShortId(wtxid));
+        if (it == slots.end())
+            return;
+
+        const uint32_t i = it->second;
+        if (source[i] == COLLIDED)
+            return;
+
+        if (source[i] != NONE)
+        {
+            // The extra pool may hold a transaction that is also pooled
+            if (txs[i]->GetWtxid() == wtxid)
+                return;
+
+            source[i] = COLLIDED;
+            txs[i].reset();
+            unfilled++;
+            return;
+        }
+
+        txs[i] = tx;
+        source[i] = from;
+        unfilled--;
+    };
+
+    for (const MempoolEntry* e : pool.ByAncestorScore())
+    {
+        Claim(e->GetTx(), e->GetWtxid(), MEMPOOL);
+        if (unfilled == 0)
+            break;
+    }
+
+    for (const TransactionRef& tx : extra)
+    {
+        if (unfilled == 0)
+            break;
+        Claim(tx, tx->GetWtxid(), EXTRA);
+    }
+
+    for (uint8_t from : source)
+    {
+        if (from == MEMPOOL)
+            mempoolCount++;
+        else if (from == EXTRA)
+            extraCount++;
+    }
+
+    return Status::OK;
+}
+
+void PartialBlock::GetMissing(std::vector<uint32_t>& out) const
+{
+    out.clear();
+    for (uint32_t i = 0; i < txs.size(); ++i)
+        if (!txs[i])
+            out.push_back(i);
+}
+
+PartialBlock::Status PartialBlock::Fill(const std::vector<Transaction>& missing, Block& out) const
+{
+    out.header = header;
+    out.vtx.clear();
+    out.vtx.reserve(txs.size());
+
+    size_t next = 0;
+    for (const TransactionRef& tx : txs)
+    {
+        if (tx)
+        {
+            out.vtx.push_back(*tx);
+            continue;
+        }
+
+        if (next == missing.size())
+            return Status::INVALID;
+        out.vtx.push_back(missing[next++]);
+    }
+
+    if (next != missing.size())
+        return Status::INVALID;
+
+    // A wrong short ID match shows up here
+    bool mutated = false;
+    if (out.ComputeMerkleRoot(&mutated) != header.merkleRoot || mutated)
+        return Status::FAILED;
+
+    return Status::OK;
+}
+
+//
+// ================================================================
+//  CompactBlockRelay
+// ================================================================
+CompactBlockRelay::CompactBlockRelay(NetReactor& n, Mempool& p, std::mutex& pm, const Options& o)
+    : net(n), pool(p), poolMutex(pm), opts(o)
+{
+    std::random_device rd;
+    rng.seed(((uint64_t)rd() << 32) | rd());
+
+    std::memset(&stats, 0, sizeof(stats));
+}
+
+void CompactBlockRelay::SetBlockHandler(BlockFn fn)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    onBlock = std::move(fn);
+}
+
+void CompactBlockRelay::PeerConnected(NetReactor::PeerId id)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        peerStates[id];
+    }
+
+    // Ask for cmpctblock announcements straight away
+    auto payload = std::make_shared<std::vector<uint8_t>>();
+    AppendU8(*payload, 1);
+    AppendU64(*payload, CMPCT_VERSION);
+    net.Send(id, "sendcmpct", payload);
+}
+
+void CompactBlockRelay::PeerDisconnected(NetReactor::PeerId id)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    peerStates.erase(id);
+}
+
+bool CompactBlockRelay::ProcessMessage(NetReactor::PeerId id, const NetMessage& msg)
+{
+    const char* cmd = msg.command;
+
+    if (std::strcmp(cmd, "sendcmpct") == 0)
+    {
+        OnSendCmpct(id, msg.payload);
+        return true;
+    }
+    if (std::strcmp(cmd, "cmpctblock") == 0)
+        return OnCmpctBlock(id, msg.payload);
+    if (std::strcmp(cmd, "getblocktxn") == 0)
+        return OnGetBlockTxn(id, msg.payload);
+    if (std::strcmp(cmd, "blocktxn") == 0)
+        return OnBlockTxn(id, msg.payload);
+    if (std::strcmp(cmd, "getdata") == 0)
+        return OnGetData(id, msg.payload);
+    if (std::strcmp(cmd, "block") == 0)
+        return OnBlock(id, msg.payload);
+
+    return false;
+}
+
+void CompactBlockRelay::OnSendCmpct(NetReactor::PeerId id, ByteSpan payload)
+{
+    SpanReader in(payload);
+    uint8_t announce;
+    uint64_t version;
+    if (!in.ReadU8(announce) || !in.ReadU64(version))
+        return;
+
+    // Only wtxid short IDs are spoken here
+    if (version != CMPCT_VERSION)
+        return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = peerStates.find(id);
+    if (it != peerStates.end())
+        it->second.announce = announce != 0;
+}
+
+bool CompactBlockRelay::OnCmpctBlock(NetReactor::PeerId id, ByteSpan payload)
+{
+    const Clock::time_point start = Clock::now();
+
+    CompactBlock cmpct;
+    if (!cmpct.Deserialize(payload) || !cmpct.header.CheckProofOfWork())
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.invalid++;
+        return true;
+    }
+
+    const std::array<uint8_t,32> hash = cmpct.header.GetHash();
+
+    std::vector<TransactionRef> extraCopy;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        // Already have it, or already working on it from this peer
+        if (FindRecent(hash))
+            return true;
+
+        auto it = peerStates.find(id);
+        if (it == peerStates.end())
+            return true;
+        if (it->second.pending && it->second.pending->hash == hash)
+            return true;
+
+        extraCopy.assign(extra.begin(), extra.end());
+        stats.received++;
+    }
+
+    std::unique_ptr<Pending> pending(new Pending);
+    pending->hash = hash;
+    pending->fullBlock = false;
+    pending->start = start;
+
+    PartialBlock::Status status;
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        status = pending->partial.Init(cmpct, pool, extraCopy);
+    }
+
+    if (status == PartialBlock::Status::INVALID)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.invalid++;
+        return true;
+    }
+
+    if (status == PartialBlock::Status::FAILED)
+    {
+        RequestFullBlock(id, hash, start);
+        return true;
+    }
+
+    pending->partial.GetMissing(pending->missing);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.txsPrefilled += pending->partial.GetPrefilledCount();
+        stats.txsFromMempool += pending->partial.GetMempoolCount();
+        stats.txsFromExtra += pending->partial.GetExtraCount();
+    }
+
+    if (pending->missing.empty())
+    {
+        std::shared_ptr<Block> block = std::make_shared<Block>();
+        status = pending->partial.Fill(std::vector<Transaction>(), *block);
+        if (status != PartialBlock::Status::OK)
+        {
+            RequestFullBlock(id, hash, start);
+            return true;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stats.reconstructed++;
+        }
+        Complete(id, block, start);
+        return true;
+    }
+
+    // One round trip for whatever the mempool did not have
+    BlockTxnRequest req;
+    req.blockHash = hash;
+    req.indexes = pending->missing;
+
+    auto msg = std::make_shared<std::vector<uint8_t>>();
+    req.Serialize(*msg);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = peerStates.find(id);
+        if (it == peerStates.end())
+            return true;
+
+        stats.roundTrips++;
+        stats.txsRequested += req.indexes.size();
+        it->second.pending = std::move(pending);
+    }
+
+    net.Send(id, "getblocktxn", msg);
+    return true;
+}
+
+bool CompactBlockRelay::OnGetBlockTxn(NetReactor::PeerId id, ByteSpan payload)
+{
+    BlockTxnRequest req;
+    if (!req.Deserialize(payload))
+        return true;
+
+    BlockRef block;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        block = FindRecent(req.blockHash);
+    }
+    if (!block)
+        return true;
+
+    BlockTxn resp;
+    resp.blockHash = req.blockHash;
+    resp.txs.reserve(req.indexes.size());
+    for (uint32_t index : req.indexes)
+    {
+        if (index >= block->vtx.size())
+            return true;
+        resp.txs.push_back(block->vtx[index]);
+    }
+
+    auto msg = std::make_shared<std::vector<uint8_t>>();
+    resp.Serialize(*msg);
+    net.Send(id, "blocktxn", msg);
+    return true;
+}
+
+bool CompactBlockRelay::OnBlockTxn(NetReactor::PeerId id, ByteSpan payload)
+{
+    BlockTxn resp;
+    if (!resp.Deserialize(payload))
+        return true;
+
+    std::unique_ptr<Pending> pending;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = peerStates.find(id);
+        if (it == peerStates.end() || !it->second.pending ||
+            it->second.pending->fullBlock || it->second.pending->hash != resp.blockHash)
+            return true;
+
+        pending = std::move(it->second.pending);
+    }
+
+    std::shared_ptr<Block> block = std::make_shared<Block>();
+    const PartialBlock::Status status = pending->partial.Fill(resp.txs, *block);
+
+    if (status == PartialBlock::Status::INVALID)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.invalid++;
+        return true;
+    }
+
+    if (status == PartialBlock::Status::FAILED)
+    {
+        RequestFullBlock(id, resp.blockHash, pending->start);
+        return true;
+    }
+
+    Complete(id, block, pending->start);
+    return true;
+}
+
+bool CompactBlockRelay::OnGetData(NetReactor::PeerId id, ByteSpan payload)
+{
+    SpanReader in(payload);
+    uint64_t count;
+    if (!in.ReadCompactSize(count) || count != in.Remaining() / 36 || in.Remaining() % 36)
+        return false;
+
+    // Only whole-block requests are ours; leave mixed ones to the node
+    std::vector<std::array<uint8_t,32>> hashes;
+    hashes.reserve((size_t)count);
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        uint32_t type;
+        std::array<uint8_t,32> hash;
+        if (!in.ReadU32(type) || !ReadHash(in, hash))
+            return false;
+        if (type != MSG_WITNESS_BLOCK)
+            return false;
+        hashes.push_back(hash);
+    }
+
+    for (const std::array<uint8_t,32>& hash : hashes)
+    {
+        BlockRef block;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            block = FindRecent(hash);
+        }
+        if (!block)
+            continue;
+
+        auto msg = std::make_shared<std::vector<uint8_t>>();
+        block->Serialize(*msg);
+        net.Send(id, "block", msg);
+    }
+
+    return true;
+}
+
+bool CompactBlockRelay::OnBlock(NetReactor::PeerId id, ByteSpan payload)
+{
+    if (payload.size < BlockHeader::SIZE)
+        return false;
+
+    BlockHeader header;
+    if (!header.Deserialize(payload.data))
+        return false;
+
+    const std::array<uint8_t,32> hash = header.GetHash();
+
+    // Only the blocks this relay asked for
+    std::unique_ptr<Pending> pending;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = peerStates.find(id);
+        if (it == peerStates.end() || !it->second.pending ||
+            !it->second.pending->fullBlock || it->second.pending->hash != hash)
+            return false;
+
+        pending = std::move(it->second.pending);
+    }
+
+    std::shared_ptr<Block> block = std::make_shared<Block>();
+    if (!block->Deserialize(payload))
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.invalid++;
+        return true;
+    }
+
+    Complete(id, block, pending->start);
+    return true;
+}
+
+void CompactBlockRelay::RequestFullBlock(NetReactor::PeerId id, const std::array<uint8_t,32>& hash,
+                                         Clock::time_point start)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = peerStates.find(id);
+        if (it == peerStates.end())
+            return;
+
+        std::unique_ptr<Pending> pending(new Pending);
+        pending->hash = hash;
+        pending->fullBlock = true;
+        pending->start = start;
+        it->second.pending = std::move(pending);
+
+        stats.fullBlocks++;
+    }
+
+    auto msg = std::make_shared<std::vector<uint8_t>>();
+    AppendCompactSize(*msg, 1);
+    AppendU32(*msg, MSG_WITNESS_BLOCK);
+    AppendBytes(*msg, hash.data(), 32);
+    net.Send(id, "getdata", msg);
+}
+
+void CompactBlockRelay::Complete(NetReactor::PeerId id, const BlockRef& block, Clock::time_point start)
+{
+    const double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    BlockFn fn;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.lastReconstructMs = ms;
+        stats.totalReconstructMs += ms;
+
+        // Kept so that it can be served on once the node relays it
+        Remember(block->header.GetHash(), block);
+        fn = onBlock;
+    }
+
+    if (fn)
+        fn(id, block);
+}
+
+size_t CompactBlockRelay::RelayBlock(const BlockRef& block)
+{
+    std::vector<NetReactor::PeerId> targets;
+    uint64_t nonce;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Remember(block->header.GetHash(), block);
+
+        for (const auto& kv : peerStates)
+            if (kv.second.announce)
+                targets.push_back(kv.first);
+
+        nonce = rng();
+    }
+
+    if (targets.empty())
+        return 0;
+
+    // One serialization shared by every peer
+    const CompactBlock cmpct(*block, nonce);
+    auto msg = std::make_shared<std::vector<uint8_t>>();
+    cmpct.Serialize(*msg);
+
+    size_t sent = 0;
+    for (NetReactor::PeerId id : targets)
+        if (net.Send(id, "cmpctblock", msg))
+            sent++;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.announced += sent;
+    return sent;
+}
+
+void CompactBlockRelay::AddExtraTransaction(const TransactionRef& tx)
+{
+    if (opts.extraTxns == 0)
+        return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (extra.size() == opts.extraTxns)
+        extra.pop_front();
+    extra.push_back(tx);
+}
+
+void CompactBlockRelay::Remember(const std::array<uint8_t,32>& hash, const BlockRef& block)
+{
+    if (FindRecent(hash))
+        return;
+
+    recent.emplace_back(hash, block);
+    while (recent.size() > opts.recentBlocks)
+        recent.pop_front();
+}
+
+CompactBlockRelay::BlockRef CompactBlockRelay::FindRecent(const std::array<uint8_t,32>& hash) const
+{
+    for (const auto& kv : recent)
+        if (kv.first == hash)
+            return kv.second;
+    return BlockRef();
+}
+
+CompactBlockRelay::Stats CompactBlockRelay::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
@@ -0,0 +1,275 @@
+#ifndef DRACHMA_NETWORK_COMPACTBLOCK_H
+#define DRACHMA_NETWORK_COMPACTBLOCK_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "reactor.h"
+#include "../chain/block.h"
+#include "../tx/mempool.h"
+
+//
+// Compact block relay (BIP152, version 2 / wtxid short IDs)
+// ---------------------------------------------------------------
+//   sendcmpct    u8 announce | u64 version
+//   cmpctblock   header | u64 nonce | ids (6 bytes each) | prefilled
+//   getblocktxn  block hash | differential indexes
+//   blocktxn     block hash | transactions
+//
+//  Short ID = SipHash-2-4(k0, k1, wtxid) & 0xffffffffffff, keys
+//  from SHA256(header || nonce).
+//
+static const uint64_t CMPCT_VERSION = 2;
+static const size_t SHORTTXID_SIZE = 6;
+static const size_t MAX_CMPCT_BLOCK_TXS = 0xFFFF;     // indexes are 16 bit
+
+// getdata inventory type used for the full block fallback
+static const uint32_t MSG_WITNESS_BLOCK = 0x40000002;
+
+struct PrefilledTransaction
+{
+    uint32_t index;                     // absolute position in the block
+    Transaction tx;
+};
+
+class CompactBlock
+{
+public:
+    BlockHeader header;
+    uint64_t nonce;
+    std::vector<uint64_t> shortIds;
+    std::vector<PrefilledTransaction> prefilled;
+
+    CompactBlock();
+
+    // Coinbase prefilled, every other transaction by short ID
+    CompactBlock(const Block& block, uint64_t nonce);
+
+    void Serialize(std::vector<uint8_t>& out) const;
+
+    // Fails on truncation, out-of-range or repeated prefilled indexes
+    bool Deserialize(ByteSpan data);
+
+    size_t GetTxCount() const { return shortIds.size() + prefilled.size(); }
+
+    uint64_t GetShortId(const std::array<uint8_t,32>& wtxid) const;
+
+private:
+    void ComputeKeys();
+
+    uint64_t k0;
+    uint64_t k1;
+};
+
+struct BlockTxnRequest
+{
+    std::array<uint8_t,32> blockHash;
+    std::vector<uint32_t> indexes;      // ascending
+
+    void Serialize(std::vector<uint8_t>& out) const;
+    bool Deserialize(ByteSpan data);
+};
+
+struct BlockTxn
+{
+    std::array<uint8_t,32> blockHash;
+    std::vector<Transaction> txs;
+
+    void Serialize(std::vector<uint8_t>& out) const;
+    bool Deserialize(ByteSpan data);
+};
+
+//
+// ===============================================================
+//  CLASS: PartialBlock
+// ===============================================================
+//
+//  A compact block being filled in. Init() indexes the short IDs
+//  and makes one pass over the mempool (and the extra pool of
+//  recently seen transactions) to claim matches. A short ID hit by
+//  two different transactions is treated as missing and requested
+//  from the peer.
+//
+//  Fill() completes the block with the requested transactions and
+//  checks the merkle root; a mismatch means a short ID collision
+//  picked the wrong transaction and the full block is needed.
+//
+// ===============================================================
+//
+class PartialBlock
+{
+public:
+    enum class Status
+    {
+        OK,
+        INVALID,        // malformed; the peer misbehaved
+        FAILED          // cannot reconstruct; fall back to the full block
+    };
+
+    PartialBlock();
+
+    // Caller serializes mempool access
+    Status Init(const CompactBlock& cmpct, const Mempool& pool,
+                const std::vector<TransactionRef>& extra);
+
+    const BlockHeader& GetHeader() const { return header; }
+
+    bool IsTxAvailable(size_t index) const { return txs[index] != nullptr; }
+    void GetMissing(std::vector<uint32_t>& out) const;
+
+    // `missing` in the order GetMissing() listed them
+    Status Fill(const std::vector<Transaction>& missing, Block& out) const;
+
+    size_t GetPrefilledCount() const { return prefilledCount; }
+    size_t GetMempoolCount() const { return mempoolCount; }
+    size_t GetExtraCount() const { return extraCount; }
+
+private:
+    BlockHeader header;
+    std::vector<TransactionRef> txs;    // null = missing
+
+    size_t prefilledCount;
+    size_t mempoolCount;
+    size_t extraCount;
+};
+
+//
+// ===============================================================
+//  CLASS: CompactBlockRelay
+// ===============================================================
+//
+//  Announces and receives blocks as compact blocks over a
+//  NetReactor. The node forwards its reactor callbacks here:
+//
+//    PeerConnected()    – sends sendcmpct (high-bandwidth mode)
+//    ProcessMessage()   – consumes the compact block messages,
+//                         returns false for anything else
+//    PeerDisconnected() – drops the peer's pending block
+//
+//  Receiving: a cmpctblock is reconstructed from the mempool; if
+//  transactions are missing one getblocktxn round trip fetches
+//  them, and a failed reconstruction falls back to getdata for the
+//  full block. Completed blocks go to the BlockFn, which validates
+//  them; relaying onwards is the node's call (RelayBlock()).
+//
+//  Sending: RelayBlock() serializes the compact block once and
+//  queues the same payload to every peer that asked for
+//  announcements. Recently relayed blocks are kept to answer
+//  getblocktxn / getdata.
+//
+//  Threading: all methods may be called from any thread; the
+//  mempool is only read under `poolMutex`.
+//
+// ===============================================================
+//
+class CompactBlockRelay
+{
+public:
+    typedef std::shared_ptr<const Block> BlockRef;
+    typedef std::function<void(NetReactor::PeerId from, const BlockRef& block)> BlockFn;
+
+    struct Options
+    {
+        size_t recentBlocks;            // kept to serve getblocktxn
+        size_t extraTxns;               // evicted / replaced txs kept for matching
+
+        Options() : recentBlocks(8), extraTxns(100) {}
+    };
+
+    struct Stats
+    {
+        uint64_t announced;             // cmpctblock messages sent
+        uint64_t received;              // cmpctblock messages accepted
+        uint64_t reconstructed;         // complete from the mempool alone
+        uint64_t roundTrips;            // needed getblocktxn
+        uint64_t fullBlocks;            // fell back to the full block
+        uint64_t invalid;
+
+        uint64_t txsPrefilled;
+        uint64_t txsFromMempool;
+        uint64_t txsFromExtra;
+        uint64_t txsRequested;
+
+        double lastReconstructMs;       // cmpctblock in -> block out
+        double totalReconstructMs;
+    };
+
+    CompactBlockRelay(NetReactor& net, Mempool& pool, std::mutex& poolMutex,
+                      const Options& opts = Options());
+
+    CompactBlockRelay(const CompactBlockRelay&) = delete;
+    CompactBlockRelay& operator=(const CompactBlockRelay&) = delete;
+
+    void SetBlockHandler(BlockFn fn);
+
+    void PeerConnected(NetReactor::PeerId id);
+    void PeerDisconnected(NetReactor::PeerId id);
+    bool ProcessMessage(NetReactor::PeerId id, const NetMessage& msg);
+
+    // Announce a validated block; returns the number of peers
+    size_t RelayBlock(const BlockRef& block);
+
+    // Keep a transaction that left (or never entered) the mempool
+    void AddExtraTransaction(const TransactionRef& tx);
+
+    Stats GetStats() const;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Pending
+    {
+        std::array<uint8_t,32> hash;
+        PartialBlock partial;
+        std::vector<uint32_t> missing;
+        bool fullBlock;                 // waiting for `block` instead
+        Clock::time_point start;
+    };
+
+    struct PeerState
+    {
+        bool announce;                  // peer wants cmpctblock announcements
+        std::unique_ptr<Pending> pending;
+
+        PeerState() : announce(false) {}
+    };
+
+    void OnSendCmpct(NetReactor::PeerId id, ByteSpan payload);
+    bool OnCmpctBlock(NetReactor::PeerId id, ByteSpan payload);
+    bool OnGetBlockTxn(NetReactor::PeerId id, ByteSpan payload);
+    bool OnBlockTxn(NetReactor::PeerId id, ByteSpan payload);
+    bool OnGetData(NetReactor::PeerId id, ByteSpan payload);
+    bool OnBlock(NetReactor::PeerId id, ByteSpan payload);
+
+    void RequestFullBlock(NetReactor::PeerId id, const std::array<uint8_t,32>& hash,
+                          Clock::time_point start);
+    void Complete(NetReactor::PeerId id, const BlockRef& block, Clock::time_point start);
+    void Remember(const std::array<uint8_t,32>& hash, const BlockRef& block);
+    BlockRef FindRecent(const std::array<uint8_t,32>& hash) const;
+
+    NetReactor& net;
+    Mempool& pool;
+    std::mutex& poolMutex;
+    Options opts;
+
+    BlockFn onBlock;
+
+    mutable std::mutex mutex;
+    std::unordered_map<NetReactor::PeerId, PeerState> peerStates;
+    std::deque<std::pair<std::array<uint8_t,32>, BlockRef>> recent;
+    std::deque<TransactionRef> extra;
+    std::mt19937_64 rng;
+
+    Stats stats;
+};
+
+#endif // DRACHMA_NETWORK_COMPACTBLOCK_H
@@ -0,0 +1,234 @@
+#include "compactblockbench.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <thread>
+
+typedef std::chrono::steady_clock Clock;
+
+static bool SetReason(std::string* reason, const std::string& text)
+{
+    if (reason)
+        *reason = text;
+    return false;
+}
+
+static double Percentile(const std::vector<double>& sorted, double q)
+{
+    if (sorted.empty())
+        return 0;
+
+    const size_t i = std::min(sorted.size() - 1, (size_t)(q * sorted.size()));
+    return sorted[i];
+}
+
+// One input, one P2WPKH output; the random prevout keeps it unique
+static TransactionRef RandomTransaction(std::mt19937_64& rng)
+{
+    std::shared_ptr<Transaction> tx = std::make_shared<Transaction>();
+    tx->version = 2;
+
+    TxIn in;
+    for (size_t i = 0; i < in.prevout.txid.size(); i += 8)
+    {
+        const uint64_t r = rng();
+        std::memcpy(in.prevout.txid.data() + i, &r, 8);
+    }
+    in.prevout.index = (uint32_t)(rng() % 4);
+    in.witness.push_back(std::vector<uint8_t>(72, 0x30));
+    in.witness.push_back(std::vector<uint8_t>(33, 0x02));
+    tx->vin.push_back(in);
+
+    std::vector<uint8_t> script(22);
+    script[1] = 20;
+    for (size_t i = 2; i < script.size(); ++i)
+        script[i] = (uint8_t)rng();
+    tx->vout.push_back(TxOut((int64_t)(rng() % 100000000) + 1000, script));
+    return tx;
+}
+
+static std::shared_ptr<Block> MakeBlock(std::mt19937_64& rng, const std::vector<TransactionRef>& txs)
+{
+    std::shared_ptr<Block> block = std::make_shared<Block>();
+
+    Transaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig = { 4, (uint8_t)rng(), (uint8_t)rng(), (uint8_t)rng(), (uint8_t)rng() };
+    coinbase.vout.push_back(TxOut(5000000000LL, std::vector<uint8_t>(22, 0x00)));
+    block->vtx.push_back(std::move(coinbase));
+
+    for (const TransactionRef& tx : txs)
+        block->vtx.push_back(*tx);
+
+    block->header.version = 1;
+    block->header.merkleRoot = block->ComputeMerkleRoot();
+    block->header.time = 1700000000;
+    block->header.bits = 0x207fffff;
+    while (!block->header.CheckProofOfWork())
+        block->header.nonce++;
+    return block;
+}
+
+// A NetReactor, its mempool and the relay, wired as a node does
+struct BenchNode
+{
+    NetReactor net;
+    Mempool pool;
+    std::mutex poolMutex;
+    CompactBlockRelay relay;
+
+    explicit BenchNode(const NetReactor::Options& netOpts)
+        : net(netOpts), relay(net, pool, poolMutex)
+    {
+        net.SetHandlers(
+            [this](NetReactor::PeerId id, bool) { relay.PeerConnected(id); },
+            [this](NetReactor::PeerId id, const NetMessage& msg) { relay.ProcessMessage(id, msg); },
+            [this](NetReactor::PeerId id, const std::string&) { relay.PeerDisconnected(id); });
+    }
+};
+
+// Handed from the receiver's BlockFn to the waiting bench
+struct Delivery
+{
+    std::mutex mutex;
+    std::condition_variable cond;
+    CompactBlockRelay::BlockRef block;
+    Clock::time_point at;
+};
+
+static bool RelayBlocks(BenchNode& sender, BenchNode& receiver, Delivery& delivery,
+                        const CompactBlockBenchmark::Options& opts,
+                        std::vector<CompactBlockBenchmark::Report>& reports, std::string* reason)
+{
+    std::mt19937_64 rng(std::random_device{}());
+    const std::chrono::milliseconds timeout(opts.timeoutMs);
+
+    // Until the receiver's sendcmpct arrives there is no one to
+    // announce to
+    const Clock::time_point deadline = Clock::now() + timeout;
+    std::string error;
+
+    for (double share : opts.mempoolShares)
+    {
+        CompactBlockBenchmark::Report report = CompactBlockBenchmark::Report();
+        report.mempoolShare = share;
+
+        const CompactBlockRelay::Stats before = receiver.relay.GetStats();
+        const uint64_t bytesBefore = sender.net.GetStats().bytesOut;
+
+        std::vector<double> latencies;
+        size_t blockBytes = 0;
+
+        for (size_t b = 0; b < opts.blocks; ++b)
+        {
+            std::vector<TransactionRef> txs(opts.txs);
+            for (TransactionRef& tx : txs)
+                tx = RandomTransaction(rng);
+
+            {
+                std::lock_guard<std::mutex> lock(receiver.poolMutex);
+                for (const TransactionRef& tx : txs)
+                {
+                    if ((double)(rng() % 1000000) / 1000000 < share &&
+                        !receiver.pool.AddTx(tx, 1000, 0, 0, 4, &error))
+                        return SetReason(reason, "mempool refused a transaction: " + error);
+                }
+            }
+
+            const std::shared_ptr<Block> block = MakeBlock(rng, txs);
+            std::vector<uint8_t> raw;
+            block->Serialize(raw);
+            blockBytes += raw.size();
+
+            {
+                std::lock_guard<std::mutex> lock(delivery.mutex);
+                delivery.block.reset();
+            }
+
+            Clock::time_point start = Clock::now();
+            while (sender.relay.RelayBlock(block) == 0)
+            {
+                if (Clock::now() > deadline)
+                    return SetReason(reason, "the receiver is not asking for compact blocks");
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                start = Clock::now();
+            }
+
+            {
+                std::unique_lock<std::mutex> lock(delivery.mutex);
+                if (!delivery.cond.wait_for(lock, timeout, [&] { return delivery.block != nullptr; }))
+                    return SetReason(reason, "block not delivered in time");
+                if (delivery.block->header.GetHash() != block->header.GetHash() ||
+                    delivery.block->vtx.size() != block->vtx.size())
+                    return SetReason(reason, "delivered block differs from the one relayed");
+                latencies.push_back(std::chrono::duration<double, std::milli>(delivery.at - start).count());
+            }
+
+            std::lock_guard<std::mutex> lock(receiver.poolMutex);
+            receiver.pool.RemoveForBlock(block->vtx);
+        }
+
+        const CompactBlockRelay::Stats after = receiver.relay.GetStats();
+        const uint64_t had = (after.txsFromMempool - before.txsFromMempool) +
+                             (after.txsFromExtra - before.txsFromExtra);
+
+        report.blocks = opts.blocks;
+        report.hitRate = (double)had / (opts.blocks * opts.txs);
+        report.reconstructed = after.reconstructed - before.reconstructed;
+        report.roundTrips = after.roundTrips - before.roundTrips;
+        report.fullBlocks = after.fullBlocks - before.fullBlocks;
+        report.reconstructMs = (after.totalReconstructMs - before.totalReconstructMs) / opts.blocks;
+        report.wireBytes = (double)(sender.net.GetStats().bytesOut - bytesBefore) / opts.blocks;
+        report.blockBytes = (double)blockBytes / opts.blocks;
+
+        std::sort(latencies.begin(), latencies.end());
+        report.p50Ms = Percentile(latencies, 0.50);
+        report.p90Ms = Percentile(latencies, 0.90);
+        report.maxMs = latencies.back();
+
+        reports.push_back(report);
+    }
+    return true;
+}
+
+bool CompactBlockBenchmark::Run(const Options& opts, std::vector<Report>& reports, std::string* reason)
+{
+    reports.clear();
+
+    if (opts.blocks == 0 || opts.txs == 0 || opts.txs >= MAX_CMPCT_BLOCK_TXS)
+        return SetReason(reason, "blocks and txs must be set, txs below the compact block limit");
+
+    NetReactor::Options netOpts;
+    netOpts.v2Transport = opts.v2Transport;
+
+    BenchNode sender(netOpts);
+    BenchNode receiver(netOpts);
+
+    Delivery delivery;
+    receiver.relay.SetBlockHandler([&](NetReactor::PeerId, const CompactBlockRelay::BlockRef& block) {
+        std::lock_guard<std::mutex> lock(delivery.mutex);
+        delivery.block = block;
+        delivery.at = Clock::now();
+        delivery.cond.notify_all();
+    });
+
+    std::string error;
+    if (!sender.net.Listen("127.0.0.1", 0, &error) || !sender.net.Start(&error) ||
+        !receiver.net.Start(&error))
+    {
+        sender.net.Stop();
+        return SetReason(reason, "cannot start the reactors: " + error);
+    }
+
+    NetReactor::PeerId peer;
+    bool ok;
+    if (!receiver.net.Connect("127.0.0.1", sender.net.GetListenPort(), &peer, &error))
+        ok = SetReason(reason, "cannot connect: " + error);
+    else
+        ok = RelayBlocks(sender, receiver, delivery, opts, reports, reason);
+
+    receiver.net.Stop();
+    sender.net.Stop();
+    return ok;
+}
@@ -0,0 +1,70 @@
+#ifndef DRACHMA_NETWORK_COMPACTBLOCKBENCH_H
+#define DRACHMA_NETWORK_COMPACTBLOCKBENCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "compactblock.h"
+
+//
+// ===============================================================
+//  CLASS: CompactBlockBenchmark
+// ===============================================================
+//
+//  Two in-process nodes, each a NetReactor, a Mempool and a
+//  CompactBlockRelay wired as a node would wire them, connected
+//  over loopback TCP (BIP324 with `v2Transport`). The sender
+//  relays `blocks` blocks of `txs` synthetic transactions; for
+//  every share in `mempoolShares` that fraction of each block's
+//  transactions is put into the receiver's mempool beforehand, so
+//  the rest has to come over getblocktxn. Each delivered block
+//  must match the one relayed and is then removed from the
+//  receiver's mempool.
+//
+//  Report per share: the hit rate (block transactions the
+//  receiver had, prefilled coinbase excluded), how blocks were
+//  completed (from the mempool alone, after one round trip, as a
+//  full block), RelayBlock() to BlockFn latency and the relay's own
+//  reconstruction time, and bytes on the wire per block against
+//  the full block.
+//
+// ===============================================================
+//
+class CompactBlockBenchmark
+{
+public:
+    struct Options
+    {
+        size_t blocks;
+        size_t txs;
+        std::vector<double> mempoolShares;
+        bool v2Transport;
+        unsigned timeoutMs;             // per block
+
+        Options()
+            : blocks(20), txs(2000), mempoolShares({1.0, 0.99, 0.9, 0.5}),
+              v2Transport(false), timeoutMs(10000) {}
+    };
+
+    struct Report
+    {
+        double mempoolShare;
+        size_t blocks;
+        double hitRate;
+        uint64_t reconstructed;         // no round trip
+        uint64_t roundTrips;
+        uint64_t fullBlocks;
+        double p50Ms;                   // RelayBlock() -> BlockFn
+        double p90Ms;
+        double maxMs;
+        double reconstructMs;           // mean, CompactBlockRelay::Stats
+        double wireBytes;               // per block, sender to receiver
+        double blockBytes;              // per block, serialized
+    };
+
+    static bool Run(const Options& opts, std::vector<Report>& reports, std::string* reason = nullptr);
+};
+
+#endif // DRACHMA_NETWORK_COMPACTBLOCKBENCH_H
@@ -0,0 +1,51 @@
+#include "message.h"
+#include "../crypto/hash.h"
+#include "../../common/utils/serialize.h"
+
+#include <cstring>
+
+bool MessageHeader::Parse(const uint8_t* data)
+{
+    magic = ReadLE32(data);
+
+    // Printable ASCII, then only NUL padding
+    bool ended = false;
+    for (size_t i = 0; i < MESSAGE_COMMAND_SIZE; ++i)
+    {
+        const uint8_t c = data[4 + i];
+        if (c == 0)
+            ended = true;
+        else if (ended || c < 0x20 || c > 0x7e)
+            return false;
+        command[i] = (char)c;
+    }
+    command[MESSAGE_COMMAND_SIZE] = 0;
+
+    length = ReadLE32(data + 16);
+    std::memcpy(checksum, data + 20, 4);
+    return true;
+}
+
+bool BuildMessageHeader(uint32_t magic, const std::string& command, ByteSpan payload,
+                        uint8_t out[MESSAGE_HEADER_SIZE])
+{
+    if (command.size() > MESSAGE_COMMAND_SIZE || payload.size > MAX_PROTOCOL_MESSAGE_LENGTH)
+        return false;
+
+    WriteLE32(out, magic);
+    std::memset(out + 4, 0, MESSAGE_COMMAND_SIZE);
+    std::memcpy(out + 4, command.data(), command.size());
+    WriteLE32(out + 16, (uint32_t)payload.size);
+
+    uint8_t hash[32];
+    Hash::SHA256D(payload.data, payload.size, hash);
+    std::memcpy(out + 20, hash, 4);
+    return true;
+}
+
+bool VerifyChecksum(const MessageHeader& header, ByteSpan payload)
+{
+    uint8_t hash[32];
+    Hash::SHA256D(payload.data, payload.size, hash);
+    return std::memcmp(hash, header.checksum, 4) == 0;
+}
@@ -0,0 +1,54 @@
+#ifndef DRACHMA_NETWORK_MESSAGE_H
+#define DRACHMA_NETWORK_MESSAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../../common/utils/span.h"
+
+//
+// Wire framing (Bitcoin-compatible)
+// ---------------------------------------------------------------
+//   magic    u32  network magic
+//   command  12   ASCII, NUL padded
+//   length   u32  payload bytes
+//   checksum u32  first 4 bytes of SHA256D(payload)
+//
+static const size_t MESSAGE_HEADER_SIZE = 24;
+static const size_t MESSAGE_COMMAND_SIZE = 12;
+static const size_t MAX_PROTOCOL_MESSAGE_LENGTH = 4 * 1000 * 1000;
+
+struct MessageHeader
+{
+    uint32_t magic;
+    char command[MESSAGE_COMMAND_SIZE + 1];     // NUL terminated
+    uint32_t length;
+    uint8_t checksum[4];
+
+    // False on a malformed command field
+    bool Parse(const uint8_t* data);
+};
+
+//
+// A received message; `payload` points into the peer's receive
+// ring and is only valid during the message callback
+//
+struct NetMessage
+{
+    const char* command;
+    ByteSpan payload;
+};
+
+// Outgoing payloads are shared, not copied, between peers
+typedef std::shared_ptr<const std::vector<uint8_t>> PayloadRef;
+
+// Header for `payload`; false if the command does not fit
+bool BuildMessageHeader(uint32_t magic, const std::string& command, ByteSpan payload,
+                        uint8_t out[MESSAGE_HEADER_SIZE]);
+
+bool VerifyChecksum(const MessageHeader& header, ByteSpan payload);
+
+#endif // DRACHMA_NETWORK_MESSAGE_H
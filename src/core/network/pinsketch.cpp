@@ -0,0 +1,342 @@
+#include "pinsketch.h"
+#include "../../common/utils/serialize.h"
+
+#include <algorithm>
+
+//
+// GF(2^32) arithmetic
+// ---------------------------------------------------------------
+//
+typedef std::vector<uint32_t> Poly;        // coefficients, low to high
+
+// x^32 = x^7 + x^3 + x^2 + 1
+static inline uint64_t FoldHigh(uint64_t hi)
+{
+    return hi ^ (hi << 2) ^ (hi << 3) ^ (hi << 7);
+}
+
+static inline uint32_t GFReduce(uint64_t r)
+{
+    // The first fold leaves at most 6 bits above bit 31
+    r = (r & 0xffffffffULL) ^ FoldHigh(r >> 32);
+    r = (r & 0xffffffffULL) ^ FoldHigh(r >> 32);
+    return (uint32_t)r;
+}
+
+static inline uint32_t GFMul(uint32_t a, uint32_t b)
+{
+    uint64_t r = 0;
+    const uint64_t wide = a;
+    for (int i = 0; i < 32; ++i)
+        r ^= (wide << i) & (0 - (uint64_t)((b >> i) & 1));
+    return GFReduce(r);
+}
+
+static inline uint32_t GFSqr(uint32_t a)
+{
+    // Squaring spreads the bits to the even positions
+    uint64_t r = 0;
+    for (int i = 0; i < 32; ++i)
+        r |= (uint64_t)((a >> i) & 1) << (2 * i);
+    return GFReduce(r);
+}
+
+static uint32_t GFInv(uint32_t a)
+{
+    // a^(2^32 - 2)
+    uint32_t result = 1;
+    uint32_t power = a;
+    for (int i = 1; i < 32; ++i)
+    {
+        power = GFSqr(power);
+        result = GFMul(result, power);
+    }
+    return result;
+}
+
+//
+// Polynomials over GF(2^32)
+// ---------------------------------------------------------------
+//
+static void Trim(Poly& p)
+{
+    while (!p.empty() && p.back() == 0)
+        p.pop_back();
+}
+
+static void MakeMonic(Poly& p)
+{
+    const uint32_t inv = GFInv(p.back());
+    for (uint32_t& c : p)
+        c = GFMul(c, inv);
+}
+
+// a mod f, f monic
+static void PolyMod(Poly& a, const Poly& f)
+{
+    const size_t df = f.size() - 1;
+    if (a.size() <= df)
+    {
+        Trim(a);
+        return;
+    }
+
+    for (size_t i = a.size() - 1; i >= df; --i)
+    {
+        const uint32_t c = a[i];
+        if (c)
+        {
+            const size_t base = i - df;
+            for (size_t j = 0; j < df; ++j)
+                a[base + j] ^= GFMul(c, f[j]);
+            a[i] = 0;
+        }
+        if (i == df)
+            break;
+    }
+
+    a.resize(df);
+    Trim(a);
+}
+
+// p^2 mod f
+static void PolySqrMod(Poly& p, const Poly& f)
+{
+    if (p.empty())
+        return;
+
+    Poly r(2 * p.size() - 1, 0);
+    for (size_t i = 0; i < p.size(); ++i)
+        r[2 * i] = GFSqr(p[i]);
+
+    PolyMod(r, f);
+    p.swap(r);
+}
+
+// Monic gcd (empty if both are zero)
+static Poly PolyGcd(Poly a, Poly b)
+{
+    Trim(a);
+    Trim(b);
+    while (!b.empty())
+    {
+        MakeMonic(b);
+        PolyMod(a, b);
+        a.swap(b);
+    }
+    if (!a.empty())
+        MakeMonic(a);
+    return a;
+}
+
+// f / h, h monic and dividing f
+static Poly PolyDiv(Poly f, const Poly& h)
+{
+    const size_t dh = h.size() - 1;
+    Poly q(f.size() - dh, 0);
+
+    for (size_t i = f.size() - 1; i >= dh; --i)
+    {
+        const uint32_t c = f[i];
+        q[i - dh] = c;
+        if (c)
+            for (size_t j = 0; j <= dh; ++j)
+                f[i - dh + j] ^= GFMul(c, h[j]);
+        if (i == dh)
+            break;
+    }
+
+    Trim(q);
+    return q;
+}
+
+// True if f (monic) is a product of distinct linear factors,
+// i.e. x^(2^32) = x mod f
+static bool SplitsDistinct(const Poly& f)
+{
+    Poly x = {0, 1};
+    PolyMod(x, f);
+
+    Poly t = x;
+    for (int i = 0; i < 32; ++i)
+        PolySqrMod(t, f);
+
+    if (t.size() < x.size())
+        t.resize(x.size(), 0);
+    for (size_t i = 0; i < x.size(); ++i)
+        t[i] ^= x[i];
+    Trim(t);
+    return t.empty();
+}
+
+static uint32_t NextBeta(uint64_t& state)
+{
+    // splitmix64
+    uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    z ^= z >> 31;
+    return (uint32_t)z | 1;
+}
+
+// Berlekamp trace algorithm: gcd(f, Tr(beta * x)) splits the roots
+// by the trace of beta * root, which a random beta makes a fair
+// coin per root
+static bool FindRoots(const Poly& f, std::vector<uint32_t>& roots, uint64_t& state)
+{
+    const size_t degree = f.size() - 1;
+    if (degree == 0)
+        return true;
+    if (degree == 1)
+    {
+        roots.push_back(f[0]);
+        return true;
+    }
+
+    for (int attempt = 0; attempt < 64; ++attempt)
+    {
+        Poly t = {0, NextBeta(state)};
+        PolyMod(t, f);
+
+        Poly trace = t;
+        for (int i = 1; i < 32; ++i)
+        {
+            PolySqrMod(t, f);
+            if (trace.size() < t.size())
+                trace.resize(t.size(), 0);
+            for (size_t j = 0; j < t.size(); ++j)
+                trace[j] ^= t[j];
+        }
+
+        const Poly h = PolyGcd(f, trace);
+        if (h.size() < 2 || h.size() - 1 >= degree)
+            continue;
+
+        return FindRoots(h, roots, state) && FindRoots(PolyDiv(f, h), roots, state);
+    }
+
+    return false;
+}
+
+//
+// ================================================================
+//  PinSketch
+// ================================================================
+PinSketch::PinSketch(size_t capacity)
+    : syndromes(capacity, 0)
+{
+}
+
+void PinSketch::Add(uint32_t element)
+{
+    const uint32_t square = GFSqr(element);
+    uint32_t power = element;
+    for (size_t i = 0; i < syndromes.size(); ++i)
+    {
+        syndromes[i] ^= power;
+        power = GFMul(power, square);
+    }
+}
+
+bool PinSketch::Merge(const PinSketch& other)
+{
+    if (other.syndromes.size() != syndromes.size())
+        return false;
+
+    for (size_t i = 0; i < syndromes.size(); ++i)
+        syndromes[i] ^= other.syndromes[i];
+    return true;
+}
+
+void PinSketch::Serialize(std::vector<uint8_t>& out) const
+{
+    for (uint32_t s : syndromes)
+        AppendU32(out, s);
+}
+
+bool PinSketch::Deserialize(ByteSpan data)
+{
+    if (data.size % ELEMENT_SIZE)
+        return false;
+
+    syndromes.resize(data.size / ELEMENT_SIZE);
+    for (size_t i = 0; i < syndromes.size(); ++i)
+        syndromes[i] = ReadLE32(data.data + i * ELEMENT_SIZE);
+    return true;
+}
+
+bool PinSketch::Decode(size_t maxElements, std::vector<uint32_t>& out) const
+{
+    out.clear();
+
+    const size_t capacity = syndromes.size();
+    if (std::all_of(syndromes.begin(), syndromes.end(), [](uint32_t s) { return s == 0; }))
+        return true;
+
+    // All power sums s_1..s_2c; the even ones follow from
+    // s_2k = s_k^2 in characteristic 2
+    std::vector<uint32_t> s(2 * capacity);
+    for (size_t i = 0; i < capacity; ++i)
+        s[2 * i] = syndromes[i];
+    for (size_t i = 1; i < 2 * capacity; i += 2)
+        s[i] = GFSqr(s[i / 2]);
+
+    // Berlekamp-Massey: shortest C with sum C_j s_(n-j) = 0
+    Poly c = {1}, b = {1};
+    size_t length = 0;
+    size_t shift = 1;
+    uint32_t lastDiscrepancy = 1;
+
+    for (size_t n = 0; n < s.size(); ++n)
+    {
+        uint32_t d = s[n];
+        for (size_t j = 1; j <= length && j < c.size(); ++j)
+            d ^= GFMul(c[j], s[n - j]);
+
+        if (d == 0)
+        {
+            shift++;
+            continue;
+        }
+
+        const uint32_t coef = GFMul(d, GFInv(lastDiscrepancy));
+        Poly prev = c;
+        if (c.size() < b.size() + shift)
+            c.resize(b.size() + shift, 0);
+        for (size_t j = 0; j < b.size(); ++j)
+            c[j + shift] ^= GFMul(coef, b[j]);
+
+        if (2 * length <= n)
+        {
+            length = n + 1 - length;
+            b.swap(prev);
+            lastDiscrepancy = d;
+            shift = 1;
+        }
+        else
+        {
+            shift++;
+        }
+    }
+
+    Trim(c);
+    if (length > capacity || length > maxElements || c.size() != length + 1)
+        return false;
+
+    // C has the inverses of the elements as roots; reversed, it is
+    // monic with the elements themselves as roots
+    Poly locator(c.rbegin(), c.rend());
+    if (locator[0] == 0 || !SplitsDistinct(locator))
+        return false;
+
+    uint64_t state = ((uint64_t)syndromes[0] << 32) | length;
+    if (!FindRoots(locator, out, state) || out.size() != length)
+        return false;
+
+    // A sketch of more than `capacity` elements can still produce a
+    // plausible locator; only the full syndromes tell
+    PinSketch check(capacity);
+    for (uint32_t e : out)
+        check.Add(e);
+    return check.syndromes == syndromes;
+}
@@ -0,0 +1,66 @@
+#ifndef DRACHMA_NETWORK_PINSKETCH_H
+#define DRACHMA_NETWORK_PINSKETCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "../../common/utils/span.h"
+
+//
+// ===============================================================
+//  CLASS: PinSketch
+// ===============================================================
+//
+//  Set sketch over GF(2^32) (BCH syndromes, as in minisketch):
+//  a sketch of capacity c holds the odd power sums
+//
+//      s_k = sum of x^k over the set,  k = 1, 3, ..., 2c - 1
+//
+//  in 4c bytes, whatever the set size. Sketches of two sets XOR
+//  into the sketch of their symmetric difference, and any
+//  difference of up to c elements can be recovered from it:
+//  Berlekamp-Massey finds the locator polynomial, whose roots
+//  (Berlekamp trace algorithm) are the elements.
+//
+//  Elements are nonzero 32-bit values. Adding an element twice
+//  removes it.
+//
+//  Field: x^32 + x^7 + x^3 + x^2 + 1.
+//
+// ===============================================================
+//
+class PinSketch
+{
+public:
+    static const size_t ELEMENT_SIZE = 4;
+
+    explicit PinSketch(size_t capacity = 0);
+
+    size_t Capacity() const { return syndromes.size(); }
+    size_t SerializedSize() const { return syndromes.size() * ELEMENT_SIZE; }
+
+    void Add(uint32_t element);
+
+    // Symmetric difference; capacities must match
+    bool Merge(const PinSketch& other);
+
+    void Serialize(std::vector<uint8_t>& out) const;
+
+    // Capacity is taken from the size of `data`
+    bool Deserialize(ByteSpan data);
+
+    // The elements of the set the sketch describes, if it has at
+    // most min(maxElements, capacity) of them. False when decoding
+    // fails (difference too large); `out` is then unspecified.
+    //
+    // A larger set can pass for a different one when every syndrome
+    // is used; each one left over (maxElements < capacity) is a
+    // 32-bit check against that.
+    bool Decode(size_t maxElements, std::vector<uint32_t>& out) const;
+
+private:
+    std::vector<uint32_t> syndromes;
+};
+
+#endif // DRACHMA_NETWORK_PINSKETCH_H
@@ -0,0 +1,1004 @@
+#include "reactor.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// Loop the calling thread runs, if any (skips self-wakeups)
+static thread_local const void* currentLoop = nullptr;
+
+static const int MAX_EVENTS = 256;
+static const size_t MAX_IOV_MESSAGES = 64;
+
+static bool SetError(std::string* error, const std::string& what)
+{
+    if (error)
+        *error = what + ": " + std::strerror(errno);
+    return false;
+}
+
+static bool ResolveNumeric(const std::string& address, uint16_t port,
+                           sockaddr_storage& out, socklen_t& len)
+{
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+
+    addrinfo* res = nullptr;
+    if (getaddrinfo(address.c_str(), std::to_string(port).c_str(), &hints, &res) != 0 || !res)
+        return false;
+
+    std::memcpy(&out, res->ai_addr, res->ai_addrlen);
+    len = res->ai_addrlen;
+    freeaddrinfo(res);
+    return true;
+}
+
+NetReactor::NetReactor(const Options& o)
+    : opts(o)
+{
+    if (opts.threads == 0)
+        opts.threads = 1;
+
+    listenFd = -1;
+    listenPort = 0;
+    running = false;
+    nextLoop = 0;
+    nextId = 1;
+
+    statAccepted = 0;
+    statRejected = 0;
+    statOutbound = 0;
+    statClosed = 0;
+    statMessagesIn = 0;
+    statMessagesOut = 0;
+    statBytesIn = 0;
+    statBytesOut = 0;
+    statBadChecksums = 0;
+    statReadCalls = 0;
+    statSendCalls = 0;
+    statRingGrows = 0;
+    statV2Sessions = 0;
+    statV2Failures = 0;
+}
+
+NetReactor::~NetReactor()
+{
+    Stop();
+
+    if (listenFd >= 0)
+        close(listenFd);
+}
+
+void NetReactor::SetHandlers(ConnectFn c, MessageFn m, DisconnectFn d)
+{
+    onConnect = std::move(c);
+    onMessage = std::move(m);
+    onDisconnect = std::move(d);
+}
+
+bool NetReactor::Listen(const std::string& address, uint16_t port, std::string* error)
+{
+    sockaddr_storage addr;
+    socklen_t len;
+    if (!ResolveNumeric(address, port, addr, len))
+    {
+        if (error) *error = "bad listen address " + address;
+        return false;
+    }
+
+    int fd = socket(addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return SetError(error, "socket");
+
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    if (bind(fd, (sockaddr*)&addr, len) != 0 || listen(fd, opts.backlog) != 0)
+    {
+        SetError(error, "bind/listen " + address + ":" + std::to_string(port));
+        close(fd);
+        return false;
+    }
+
+    // Port 0 picks an ephemeral port
+    sockaddr_storage bound;
+    socklen_t boundLen = sizeof(bound);
+    getsockname(fd, (sockaddr*)&bound, &boundLen);
+    listenPort = ntohs(bound.ss_family == AF_INET6 ? ((sockaddr_in6*)&bound)->sin6_port
+                                                   : ((sockaddr_in*)&bound)->sin_port);
+
+    listenFd = fd;
+    return true;
+}
+
+bool NetReactor::Start(std::string* error)
+{
+    if (running)
+        return true;
+
+    for (unsigned i = 0; i < opts.threads; ++i)
+    {
+        std::unique_ptr<Loop> loop(new Loop());
+        loop->index = i;
+        loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+        loop->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (loop->epfd < 0 || loop->wakefd < 0)
+        {
+            if (loop->epfd >= 0) close(loop->epfd);
+            if (loop->wakefd >= 0) close(loop->wakefd);
+            loops.clear();
+            return SetError(error, "epoll/eventfd");
+        }
+
+        // data.ptr: nullptr = wakeup, this = listener, else a Peer
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = nullptr;
+        epoll_ctl(loop->epfd, EPOLL_CTL_ADD, loop->wakefd, &ev);
+
+        loops.push_back(std::move(loop));
+    }
+
+    if (listenFd >= 0)
+    {
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = this;
+        epoll_ctl(loops[0]->epfd, EPOLL_CTL_ADD, listenFd, &ev);
+    }
+
+    running = true;
+    for (auto& loop : loops)
+        loop->thread = std::thread(&NetReactor::Run, this, std::ref(*loop));
+
+    return true;
+}
+
+void NetReactor::Stop()
+{
+    if (!running.exchange(false))
+        return;
+
+    for (auto& loop : loops)
+    {
+        uint64_t one = 1;
+        ssize_t r = write(loop->wakefd, &one, sizeof(one));
+        (void)r;
+    }
+
+    for (auto& loop : loops)
+        loop->thread.join();
+
+    // No callbacks on shutdown
+    {
+        std::lock_guard<std::mutex> lock(peersMutex);
+        for (auto& entry : peers)
+        {
+            if (entry.second->fd >= 0)
+                close(entry.second->fd);
+            entry.second->fd = -1;
+        }
+        peers.clear();
+    }
+
+    for (auto& loop : loops)
+    {
+        close(loop->epfd);
+        close(loop->wakefd);
+    }
+    loops.clear();
+}
+
+NetReactor::Stats NetReactor::GetStats() const
+{
+    Stats s;
+    {
+        std::lock_guard<std::mutex> lock(peersMutex);
+        s.peers = peers.size();
+    }
+    s.accepted = statAccepted;
+    s.rejected = statRejected;
+    s.outbound = statOutbound;
+    s.closed = statClosed;
+    s.messagesIn = statMessagesIn;
+    s.messagesOut = statMessagesOut;
+    s.bytesIn = statBytesIn;
+    s.bytesOut = statBytesOut;
+    s.badChecksums = statBadChecksums;
+    s.readCalls = statReadCalls;
+    s.sendCalls = statSendCalls;
+    s.ringGrows = statRingGrows;
+    s.v2Sessions = statV2Sessions;
+    s.v2Failures = statV2Failures;
+    return s;
+}
+
+NetReactor::PeerRef NetReactor::Find(PeerId id) const
+{
+    std::lock_guard<std::mutex> lock(peersMutex);
+    auto it = peers.find(id);
+    return it == peers.end() ? PeerRef() : it->second;
+}
+
+//
+// ================================================================
+//  Event loop
+// ================================================================
+void NetReactor::Run(Loop& loop)
+{
+    currentLoop = &loop;
+    epoll_event events[MAX_EVENTS];
+
+    while (running)
+    {
+        int n = epoll_wait(loop.epfd, events, MAX_EVENTS, -1);
+        if (n < 0 && errno != EINTR)
+            break;
+
+        for (int i = 0; i < n; ++i)
+        {
+            void* ptr = events[i].data.ptr;
+            const uint32_t ev = events[i].events;
+
+            if (ptr == nullptr)
+            {
+                uint64_t value;
+                while (read(loop.wakefd, &value, sizeof(value)) > 0) {}
+                continue;
+            }
+
+            if (ptr == this)
+            {
+                AcceptAll();
+                continue;
+            }
+
+            Peer* peer = static_cast<Peer*>(ptr);
+            if (peer->fd < 0)
+                continue;                   // closed earlier in this batch
+
+            if (peer->connecting)
+            {
+                if (!(ev & (EPOLLOUT | EPOLLERR | EPOLLHUP)))
+                    continue;
+                FinishConnect(loop, peer);
+                if (peer->fd < 0)
+                    continue;
+
+                // Data may have come with the same edge
+                ReadPeer(loop, peer);
+                continue;
+            }
+
+            if (ev & (EPOLLIN | EPOLLERR | EPOLLHUP | EPOLLRDHUP))
+                ReadPeer(loop, peer);
+
+            if ((ev & EPOLLOUT) && peer->fd >= 0)
+                FlushPeer(loop, peer);
+        }
+
+        ProcessPending(loop);
+        loop.graveyard.clear();
+    }
+
+    currentLoop = nullptr;
+}
+
+void NetReactor::ProcessPending(Loop& loop)
+{
+    std::vector<PeerRef> adopt, flush;
+    std::vector<std::pair<PeerRef, std::string>> closes;
+    {
+        std::lock_guard<std::mutex> lock(loop.mutex);
+        adopt.swap(loop.adopt);
+        flush.swap(loop.flush);
+        closes.swap(loop.close);
+    }
+
+    for (const PeerRef& peer : adopt)
+        Adopt(loop, peer);
+
+    for (const PeerRef& peer : flush)
+    {
+        if (peer->fd >= 0 && !peer->connecting)
+            FlushPeer(loop, peer.get());
+    }
+
+    for (auto& entry : closes)
+        ClosePeer(loop, entry.first.get(), entry.second);
+}
+
+void NetReactor::Post(Loop& loop)
+{
+    // The loop itself drains its lists after the current batch
+    if (currentLoop == &loop)
+        return;
+
+    uint64_t one = 1;
+    ssize_t r = write(loop.wakefd, &one, sizeof(one));
+    (void)r;
+}
+
+//
+// ================================================================
+//  Peers
+// ================================================================
+NetReactor::PeerRef NetReactor::AddPeer(int fd, bool inbound, bool connecting)
+{
+    PeerRef peer = std::make_shared<Peer>();
+    peer->fd = fd;
+    peer->loop = nextLoop++ % loops.size();
+    peer->inbound = inbound;
+    peer->connecting = connecting;
+    peer->queuedBytes = 0;
+    peer->flushPosted = false;
+    peer->closing = false;
+
+    if (!peer->recv.Init(opts.recvBuffer))
+        return PeerRef();
+
+    if (opts.v2Transport)
+    {
+        peer->v2.reset(new V2Transport(!inbound, opts.magic, opts.maxMessageSize));
+        if (!peer->sendRing.Init(opts.recvBuffer))
+            return PeerRef();
+    }
+    peer->ready = !peer->v2;
+
+    {
+        std::lock_guard<std::mutex> lock(peersMutex);
+        peer->id = nextId++;
+        peers[peer->id] = peer;
+    }
+
+    Loop& loop = *loops[peer->loop];
+    {
+        std::lock_guard<std::mutex> lock(loop.mutex);
+        loop.adopt.push_back(peer);
+    }
+    Post(loop);
+
+    return peer;
+}
+
+void NetReactor::Adopt(Loop& loop, const PeerRef& peer)
+{
+    epoll_event ev;
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = peer.get();
+
+    if (epoll_ctl(loop.epfd, EPOLL_CTL_ADD, peer->fd, &ev) != 0)
+    {
+        ClosePeer(loop, peer.get(), std::string("epoll_ctl: ") + std::strerror(errno));
+        return;
+    }
+
+    if (!peer->connecting && peer->ready && onConnect)
+        onConnect(peer->id, peer->inbound);
+}
+
+void NetReactor::AcceptAll()
+{
+    for (;;)
+    {
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;                          // EAGAIN, or out of descriptors
+        }
+
+        size_t count;
+        {
+            std::lock_guard<std::mutex> lock(peersMutex);
+            count = peers.size();
+        }
+        if (count >= opts.maxPeers)
+        {
+            close(fd);
+            statRejected++;
+            continue;
+        }
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        if (!AddPeer(fd, true, false))
+        {
+            close(fd);
+            continue;
+        }
+        statAccepted++;
+    }
+}
+
+bool NetReactor::Connect(const std::string& address, uint16_t port, PeerId* id, std::string* error)
+{
+    if (!running)
+    {
+        if (error) *error = "reactor not running";
+        return false;
+    }
+
+    sockaddr_storage addr;
+    socklen_t len;
+    if (!ResolveNumeric(address, port, addr, len))
+    {
+        if (error) *error = "bad address " + address;
+        return false;
+    }
+
+    int fd = socket(addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return SetError(error, "socket");
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    if (connect(fd, (sockaddr*)&addr, len) != 0 && errno != EINPROGRESS)
+    {
+        SetError(error, "connect " + address + ":" + std::to_string(port));
+        close(fd);
+        return false;
+    }
+
+    PeerRef peer = AddPeer(fd, false, true);
+    if (!peer)
+    {
+        close(fd);
+        if (error) *error = "out of memory for receive buffer";
+        return false;
+    }
+
+    statOutbound++;
+    if (id) *id = peer->id;
+    return true;
+}
+
+void NetReactor::FinishConnect(Loop& loop, Peer* peer)
+{
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (getsockopt(peer->fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0)
+        err = errno;
+
+    if (err != 0)
+    {
+        ClosePeer(loop, peer, std::string("connect: ") + std::strerror(err));
+        return;
+    }
+
+    peer->connecting = false;
+
+    if (peer->v2)
+    {
+        // Our key goes first; the ConnectFn waits for the handshake
+        std::unique_lock<std::mutex> lock(peer->sendMutex);
+        if (!peer->v2->Start() || !DrainHandshake(peer))
+        {
+            lock.unlock();
+            statV2Failures++;
+            ClosePeer(loop, peer, "v2 transport: cannot start handshake");
+            return;
+        }
+    }
+    else if (onConnect)
+    {
+        onConnect(peer->id, false);
+    }
+
+    // Anything queued while connecting
+    if (peer->fd >= 0)
+        FlushPeer(loop, peer);
+}
+
+void NetReactor::Disconnect(PeerId id)
+{
+    PeerRef peer = Find(id);
+    if (peer)
+        RequestClose(peer, "disconnect requested");
+}
+
+void NetReactor::RequestClose(const PeerRef& peer, const std::string& why)
+{
+    if (peer->closing.exchange(true))
+        return;
+
+    Loop& loop = *loops[peer->loop];
+    {
+        std::lock_guard<std::mutex> lock(loop.mutex);
+        loop.close.emplace_back(peer, why);
+    }
+    Post(loop);
+}
+
+void NetReactor::ClosePeer(Loop& loop, Peer* peer, const std::string& why)
+{
+    if (peer->fd < 0)
+        return;
+
+    epoll_ctl(loop.epfd, EPOLL_CTL_DEL, peer->fd, nullptr);
+    close(peer->fd);
+    peer->fd = -1;
+    peer->closing = true;
+
+    // Epoll events already fetched may still point at the peer, so
+    // it lives until the end of the batch
+    {
+        std::lock_guard<std::mutex> lock(peersMutex);
+        auto it = peers.find(peer->id);
+        if (it != peers.end())
+        {
+            loop.graveyard.push_back(it->second);
+            peers.erase(it);
+        }
+    }
+
+    statClosed++;
+    if (onDisconnect)
+        onDisconnect(peer->id, why);
+}
+
+//
+// ================================================================
+//  Receive
+// ================================================================
+void NetReactor::ReadPeer(Loop& loop, Peer* peer)
+{
+    // Edge-triggered: read until the socket is drained
+    for (;;)
+    {
+        ssize_t r = read(peer->fd, peer->recv.WritePtr(), peer->recv.Free());
+        statReadCalls++;
+
+        if (r > 0)
+        {
+            peer->recv.Commit((size_t)r);
+            statBytesIn += (uint64_t)r;
+
+            if (!ParseMessages(loop, peer))
+                return;
+            continue;
+        }
+
+        if (r == 0)
+        {
+            ClosePeer(loop, peer, "connection closed by peer");
+            return;
+        }
+
+        if (errno == EINTR)
+            continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return;
+
+        ClosePeer(loop, peer, std::string("read: ") + std::strerror(errno));
+        return;
+    }
+}
+
+bool NetReactor::ParseMessages(Loop& loop, Peer* peer)
+{
+    if (peer->v2)
+        return ParseV2(loop, peer);
+
+    for (;;)
+    {
+        if (peer->closing)
+            return false;
+
+        ByteSpan data = peer->recv.Readable();
+        if (data.size < MESSAGE_HEADER_SIZE)
+            return true;
+
+        MessageHeader header;
+        if (!header.Parse(data.data))
+        {
+            ClosePeer(loop, peer, "malformed message header");
+            return false;
+        }
+        if (header.magic != opts.magic)
+        {
+            ClosePeer(loop, peer, "wrong network magic");
+            return false;
+        }
+        if (header.length > opts.maxMessageSize)
+        {
+            ClosePeer(loop, peer, "oversized message " + std::string(header.command));
+            return false;
+        }
+
+        const size_t total = MESSAGE_HEADER_SIZE + header.length;
+        if (data.size < total)
+        {
+            // Wait for the rest; make sure it can fit
+            if (peer->recv.Capacity() < total)
+            {
+                if (!peer->recv.Grow(total))
+                {
+                    ClosePeer(loop, peer, "cannot grow receive buffer");
+                    return false;
+                }
+                statRingGrows++;
+            }
+            return true;
+        }
+
+        ByteSpan payload = data.Sub(MESSAGE_HEADER_SIZE, header.length);
+
+        // A bad checksum only drops the message
+        if (!VerifyChecksum(header, payload))
+        {
+            statBadChecksums++;
+        }
+        else
+        {
+            statMessagesIn++;
+            if (onMessage)
+            {
+                NetMessage msg;
+                msg.command = header.command;
+                msg.payload = payload;
+                onMessage(peer->id, msg);
+            }
+        }
+
+        peer->recv.Consume(total);
+    }
+}
+
+bool NetReactor::ParseV2(Loop& loop, Peer* peer)
+{
+    for (;;)
+    {
+        if (peer->closing)
+            return false;
+
+        V2Transport::Event ev;
+        bool handshake = false;
+        {
+            // Until the session is up, receiving also writes the
+            // send side (our terminator and version packet)
+            std::unique_lock<std::mutex> lock(peer->sendMutex, std::defer_lock);
+            if (!peer->v2->IsReady())
+                lock.lock();
+
+            ev = peer->v2->Receive(peer->recv.ReadPtr(), peer->recv.Size());
+
+            if (lock.owns_lock() && !peer->v2->GetOutput().empty())
+            {
+                if (!DrainHandshake(peer))
+                {
+                    lock.unlock();
+                    ClosePeer(loop, peer, "cannot grow send buffer");
+                    return false;
+                }
+                handshake = true;
+            }
+
+            if (ev.kind == V2Transport::Event::V1)
+                peer->v2.reset();
+        }
+
+        if (handshake)
+        {
+            FlushPeer(loop, peer);
+            if (peer->fd < 0)
+                return false;
+        }
+
+        switch (ev.kind)
+        {
+        case V2Transport::Event::NEED_MORE:
+            if (peer->recv.Capacity() < ev.need)
+            {
+                if (!peer->recv.Grow(ev.need))
+                {
+                    ClosePeer(loop, peer, "cannot grow receive buffer");
+                    return false;
+                }
+                statRingGrows++;
+            }
+            return true;
+
+        case V2Transport::Event::PROGRESS:
+            peer->recv.Consume(ev.consume);
+            break;
+
+        case V2Transport::Event::READY:
+            peer->recv.Consume(ev.consume);
+            statV2Sessions++;
+            PeerReady(peer);
+            break;
+
+        case V2Transport::Event::MESSAGE:
+            statMessagesIn++;
+            if (onMessage)
+                onMessage(peer->id, ev.msg);
+            peer->recv.Consume(ev.consume);
+            break;
+
+        case V2Transport::Event::V1:
+            // Plaintext inbound peer: carry on with v1 framing
+            PeerReady(peer);
+            return ParseMessages(loop, peer);
+
+        case V2Transport::Event::FAILED:
+            statV2Failures++;
+            ClosePeer(loop, peer, std::string("v2 transport: ") + ev.error);
+            return false;
+        }
+    }
+}
+
+void NetReactor::PeerReady(Peer* peer)
+{
+    peer->ready = true;
+    if (onConnect)
+        onConnect(peer->id, peer->inbound);
+}
+
+//
+// ================================================================
+//  Send
+// ================================================================
+bool NetReactor::Send(PeerId id, const std::string& command, PayloadRef payload)
+{
+    PeerRef peer = Find(id);
+    if (!peer || peer->closing)
+        return false;
+
+    uint8_t header[MESSAGE_HEADER_SIZE];
+    if (!BuildMessageHeader(opts.magic, command, ByteSpan(*payload), header))
+        return false;
+
+    return Enqueue(peer, header, payload);
+}
+
+size_t NetReactor::Broadcast(const std::string& command, PayloadRef payload)
+{
+    // One header (and checksum) for everybody
+    uint8_t header[MESSAGE_HEADER_SIZE];
+    if (!BuildMessageHeader(opts.magic, command, ByteSpan(*payload), header))
+        return 0;
+
+    std::vector<PeerRef> targets;
+    {
+        std::lock_guard<std::mutex> lock(peersMutex);
+        targets.reserve(peers.size());
+        for (auto& entry : peers)
+            targets.push_back(entry.second);
+    }
+
+    size_t queued = 0;
+    for (const PeerRef& peer : targets)
+    {
+        if (!peer->closing && !peer->connecting && peer->ready && Enqueue(peer, header, payload))
+            queued++;
+    }
+    return queued;
+}
+
+bool NetReactor::Enqueue(const PeerRef& peer, const uint8_t header[MESSAGE_HEADER_SIZE],
+                         const PayloadRef& payload)
+{
+    bool full = false;
+    bool post = false;
+    {
+        std::lock_guard<std::mutex> lock(peer->sendMutex);
+
+        if (peer->v2)
+        {
+            if (!peer->v2->IsReady())
+                return false;
+
+            // Encrypted once, straight into the ring the socket is
+            // fed from
+            const char* cmd = reinterpret_cast<const char*>(header + 4);
+            const std::string command(cmd, strnlen(cmd, MESSAGE_COMMAND_SIZE));
+            const size_t size = peer->v2->GetPacketSize(command, payload->size());
+
+            RingBuffer& ring = peer->sendRing;
+            if (ring.Size() + size > opts.maxSendQueue ||
+                (ring.Free() < size && !ring.Grow(ring.Size() + size)))
+            {
+                full = true;
+            }
+            else
+            {
+                peer->v2->EncryptMessage(command, ByteSpan(*payload), ring.WritePtr());
+                ring.Commit(size);
+                statMessagesOut++;
+            }
+        }
+        else
+        {
+            const size_t size = MESSAGE_HEADER_SIZE + payload->size();
+            if (peer->queuedBytes + size > opts.maxSendQueue)
+            {
+                full = true;
+            }
+            else
+            {
+                OutMessage msg;
+                std::memcpy(msg.header, header, MESSAGE_HEADER_SIZE);
+                msg.payload = payload;
+                msg.offset = 0;
+                peer->sendQueue.push_back(std::move(msg));
+                peer->queuedBytes += size;
+            }
+        }
+
+        // One pending flush per peer is enough
+        if (!full)
+        {
+            post = !peer->flushPosted;
+            peer->flushPosted = true;
+        }
+    }
+
+    if (full)
+    {
+        // Not reading fast enough; let it go
+        RequestClose(peer, "send queue full");
+        return false;
+    }
+
+    if (post)
+    {
+        Loop& loop = *loops[peer->loop];
+        {
+            std::lock_guard<std::mutex> lock(loop.mutex);
+            loop.flush.push_back(peer);
+        }
+        Post(loop);
+    }
+    return true;
+}
+
+bool NetReactor::DrainHandshake(Peer* peer)
+{
+    std::vector<uint8_t>& out = peer->v2->GetOutput();
+    if (out.empty())
+        return true;
+
+    RingBuffer& ring = peer->sendRing;
+    if (ring.Free() < out.size() && !ring.Grow(ring.Size() + out.size()))
+        return false;
+
+    std::memcpy(ring.WritePtr(), out.data(), out.size());
+    ring.Commit(out.size());
+    out.clear();
+    return true;
+}
+
+void NetReactor::FlushPeer(Loop& loop, Peer* peer)
+{
+    std::unique_lock<std::mutex> lock(peer->sendMutex);
+    peer->flushPosted = false;
+
+    if (peer->v2)
+    {
+        FlushV2(loop, peer, lock);
+        return;
+    }
+
+    while (!peer->sendQueue.empty())
+    {
+        // {header, payload} pairs for up to MAX_IOV_MESSAGES messages
+        iovec iov[MAX_IOV_MESSAGES * 2];
+        size_t iovCount = 0;
+
+        for (size_t i = 0; i < peer->sendQueue.size() && i < MAX_IOV_MESSAGES; ++i)
+        {
+            OutMessage& msg = peer->sendQueue[i];
+            const std::vector<uint8_t>& payload = *msg.payload;
+
+            if (msg.offset < MESSAGE_HEADER_SIZE)
+            {
+                iov[iovCount].iov_base = msg.header + msg.offset;
+                iov[iovCount].iov_len = MESSAGE_HEADER_SIZE - msg.offset;
+                iovCount++;
+
+                if (!payload.empty())
+                {
+                    iov[iovCount].iov_base = const_cast<uint8_t*>(payload.data());
+                    iov[iovCount].iov_len = payload.size();
+                    iovCount++;
+                }
+            }
+            else
+            {
+                const size_t done = msg.offset - MESSAGE_HEADER_SIZE;
+                iov[iovCount].iov_base = const_cast<uint8_t*>(payload.data()) + done;
+                iov[iovCount].iov_len = payload.size() - done;
+                iovCount++;
+            }
+        }
+
+        msghdr mh;
+        std::memset(&mh, 0, sizeof(mh));
+        mh.msg_iov = iov;
+        mh.msg_iovlen = iovCount;
+
+        ssize_t r = sendmsg(peer->fd, &mh, MSG_NOSIGNAL | MSG_DONTWAIT);
+        statSendCalls++;
+
+        if (r < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return;                     // EPOLLOUT resumes
+
+            const std::string why = std::string("send: ") + std::strerror(errno);
+            lock.unlock();
+            ClosePeer(loop, peer, why);
+            return;
+        }
+
+        statBytesOut += (uint64_t)r;
+
+        // Retire what went out
+        size_t sent = (size_t)r;
+        while (sent > 0)
+        {
+            OutMessage& msg = peer->sendQueue.front();
+            const size_t size = MESSAGE_HEADER_SIZE + msg.payload->size();
+            const size_t left = size - msg.offset;
+
+            if (sent < left)
+            {
+                msg.offset += sent;
+                break;
+            }
+
+            sent -= left;
+            peer->queuedBytes -= size;
+            peer->sendQueue.pop_front();
+            statMessagesOut++;
+        }
+    }
+}
+
+void NetReactor::FlushV2(Loop& loop, Peer* peer, std::unique_lock<std::mutex>& lock)
+{
+    // Ciphertext is already contiguous in the ring: plain send()s
+    RingBuffer& ring = peer->sendRing;
+    while (ring.Size() > 0)
+    {
+        const ByteSpan data = ring.Readable();
+        ssize_t r = send(peer->fd, data.data, data.size, MSG_NOSIGNAL | MSG_DONTWAIT);
+        statSendCalls++;
+
+        if (r < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return;                     // EPOLLOUT resumes
+
+            const std::string why = std::string("send: ") + std::strerror(errno);
+            lock.unlock();
+            ClosePeer(loop, peer, why);
+            return;
+        }
+
+        statBytesOut += (uint64_t)r;
+        ring.Consume((size_t)r);
+    }
+}
@@ -0,0 +1,230 @@
+#ifndef DRACHMA_NETWORK_REACTOR_H
+#define DRACHMA_NETWORK_REACTOR_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "message.h"
+#include "ringbuffer.h"
+#include "v2transport.h"
+
+//
+// ===============================================================
+//  CLASS: NetReactor
+// ===============================================================
+//
+//  epoll event loops for P2P connections; no thread per peer.
+//
+//  `threads` loops each own an epoll instance and a share of the
+//  peers (assigned round-robin). Loop 0 also accepts. Everything
+//  about one peer – reads, writes, callbacks – happens on its loop,
+//  so a peer's callbacks are never concurrent.
+//
+//  Receive: edge-triggered reads go straight into the peer's
+//  RingBuffer. Complete messages are framed in place: the header
+//  is parsed, SHA256D checks the payload and the MessageFn gets a
+//  view into the ring. Nothing is copied; the ring only grows when
+//  a single message is larger than it.
+//
+//  Send: payloads are shared (PayloadRef) so a broadcast
+//  serializes once. Each peer queues {header, payload} pairs that
+//  are flushed with one sendmsg() scatter/gather call per batch;
+//  a peer whose queue exceeds `maxSendQueue` bytes is dropped.
+//
+//  Encryption (`v2Transport`): outbound peers get a BIP324
+//  handshake, inbound peers are detected as v1 or v2. Packets are
+//  decrypted in place in the receive ring and encrypted straight
+//  into a per-peer send ring; the cipher is the only extra pass
+//  over the data. The ConnectFn fires once the handshake is done.
+//
+//  Send(), Broadcast(), Disconnect() and Connect() may be called
+//  from any thread, including from inside callbacks.
+//
+// ===============================================================
+//
+class NetReactor
+{
+public:
+    typedef uint64_t PeerId;
+
+    typedef std::function<void(PeerId id, bool inbound)> ConnectFn;
+    typedef std::function<void(PeerId id, const NetMessage& msg)> MessageFn;
+    typedef std::function<void(PeerId id, const std::string& why)> DisconnectFn;
+
+    struct Options
+    {
+        uint32_t magic;
+        unsigned threads;               // event loops
+        size_t maxPeers;
+        size_t maxMessageSize;
+        size_t maxSendQueue;            // bytes per peer
+        size_t recvBuffer;              // initial ring size
+        int backlog;
+        bool v2Transport;               // BIP324 out, v1/v2 detection in
+
+        Options()
+            : magic(0xD9B4BEF9), threads(1), maxPeers(1250),
+              maxMessageSize(MAX_PROTOCOL_MESSAGE_LENGTH),
+              maxSendQueue(64 * 1024 * 1024), recvBuffer(64 * 1024),
+              backlog(1024), v2Transport(false) {}
+    };
+
+    struct Stats
+    {
+        size_t peers;
+        uint64_t accepted;
+        uint64_t rejected;              // over maxPeers
+        uint64_t outbound;
+        uint64_t closed;
+        uint64_t messagesIn;
+        uint64_t messagesOut;           // v2: counted when encrypted
+        uint64_t bytesIn;
+        uint64_t bytesOut;
+        uint64_t badChecksums;
+        uint64_t readCalls;
+        uint64_t sendCalls;             // sendmsg() calls
+        uint64_t ringGrows;
+        uint64_t v2Sessions;            // completed BIP324 handshakes
+        uint64_t v2Failures;            // handshake or authentication errors
+    };
+
+    explicit NetReactor(const Options& opts = Options());
+    ~NetReactor();
+
+    NetReactor(const NetReactor&) = delete;
+    NetReactor& operator=(const NetReactor&) = delete;
+
+    // Before Start()
+    void SetHandlers(ConnectFn onConnect, MessageFn onMessage, DisconnectFn onDisconnect);
+    bool Listen(const std::string& address, uint16_t port, std::string* error);
+    uint16_t GetListenPort() const { return listenPort; }
+
+    bool Start(std::string* error);
+    void Stop();
+
+    // Non-blocking; the ConnectFn fires once the connection is up
+    bool Connect(const std::string& address, uint16_t port, PeerId* id, std::string* error);
+
+    bool Send(PeerId id, const std::string& command, PayloadRef payload);
+
+    // To every connected peer; returns the number queued to
+    size_t Broadcast(const std::string& command, PayloadRef payload);
+
+    void Disconnect(PeerId id);
+
+    Stats GetStats() const;
+
+private:
+    struct OutMessage
+    {
+        uint8_t header[MESSAGE_HEADER_SIZE];
+        PayloadRef payload;
+        size_t offset;                  // bytes of header+payload already sent
+    };
+
+    struct Peer
+    {
+        PeerId id;
+        int fd;
+        unsigned loop;
+        bool inbound;
+        std::atomic<bool> connecting;
+        std::atomic<bool> ready;        // ConnectFn fired
+        RingBuffer recv;
+
+        std::mutex sendMutex;
+        std::deque<OutMessage> sendQueue;
+        size_t queuedBytes;
+        bool flushPosted;
+
+        // v2 only (null: plaintext); sendRing holds ciphertext
+        std::unique_ptr<V2Transport> v2;
+        RingBuffer sendRing;
+
+        std::atomic<bool> closing;
+    };
+
+    typedef std::shared_ptr<Peer> PeerRef;
+
+    struct Loop
+    {
+        unsigned index;
+        int epfd;
+        int wakefd;
+        std::thread thread;
+
+        std::mutex mutex;
+        std::vector<PeerRef> adopt;
+        std::vector<PeerRef> flush;
+        std::vector<std::pair<PeerRef, std::string>> close;
+
+        // Closed during the current epoll batch; freed after it
+        std::vector<PeerRef> graveyard;
+    };
+
+    void Run(Loop& loop);
+    void ProcessPending(Loop& loop);
+
+    void AcceptAll();
+    PeerRef AddPeer(int fd, bool inbound, bool connecting);
+    void Adopt(Loop& loop, const PeerRef& peer);
+    void FinishConnect(Loop& loop, Peer* peer);
+
+    void ReadPeer(Loop& loop, Peer* peer);
+    bool ParseMessages(Loop& loop, Peer* peer);
+    bool ParseV2(Loop& loop, Peer* peer);
+    void PeerReady(Peer* peer);
+    void FlushPeer(Loop& loop, Peer* peer);
+    void FlushV2(Loop& loop, Peer* peer, std::unique_lock<std::mutex>& lock);
+    bool DrainHandshake(Peer* peer);
+
+    bool Enqueue(const PeerRef& peer, const uint8_t header[MESSAGE_HEADER_SIZE], const PayloadRef& payload);
+    void Post(Loop& loop);
+    void RequestClose(const PeerRef& peer, const std::string& why);
+    void ClosePeer(Loop& loop, Peer* peer, const std::string& why);
+
+    PeerRef Find(PeerId id) const;
+
+    Options opts;
+
+    ConnectFn onConnect;
+    MessageFn onMessage;
+    DisconnectFn onDisconnect;
+
+    int listenFd;
+    uint16_t listenPort;
+
+    std::vector<std::unique_ptr<Loop>> loops;
+    std::atomic<bool> running;
+    std::atomic<unsigned> nextLoop;
+
+    mutable std::mutex peersMutex;
+    std::unordered_map<PeerId, PeerRef> peers;
+    PeerId nextId;
+
+    std::atomic<uint64_t> statAccepted;
+    std::atomic<uint64_t> statRejected;
+    std::atomic<uint64_t> statOutbound;
+    std::atomic<uint64_t> statClosed;
+    std::atomic<uint64_t> statMessagesIn;
+    std::atomic<uint64_t> statMessagesOut;
+    std::atomic<uint64_t> statBytesIn;
+    std::atomic<uint64_t> statBytesOut;
+    std::atomic<uint64_t> statBadChecksums;
+    std::atomic<uint64_t> statReadCalls;
+    std::atomic<uint64_t> statSendCalls;
+    std::atomic<uint64_t> statRingGrows;
+    std::atomic<uint64_t> statV2Sessions;
+    std::atomic<uint64_t> statV2Failures;
+};
+
+#endif // DRACHMA_NETWORK_REACTOR_H
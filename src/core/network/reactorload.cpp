@@ -0,0 +1,270 @@
+#include "reactorload.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cstring>
+#include <mutex>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <random>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+static bool SetReason(std::string* reason, const std::string& text)
+{
+    if (reason)
+        *reason = text;
+    return false;
+}
+
+static double Percentile(const std::vector<uint64_t>& sorted, double q)
+{
+    if (sorted.empty())
+        return 0;
+
+    const size_t i = std::min(sorted.size() - 1, (size_t)(q * sorted.size()));
+    return sorted[i] / 1000.0;
+}
+
+static bool WriteAll(int fd, const uint8_t* data, size_t len)
+{
+    while (len > 0)
+    {
+        const ssize_t n = write(fd, data, len);
+        if (n <= 0)
+            return false;
+        data += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+static bool ReadAll(int fd, uint8_t* data, size_t len)
+{
+    while (len > 0)
+    {
+        const ssize_t n = read(fd, data, len);
+        if (n <= 0)
+            return false;
+        data += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+static int Dial(uint16_t port)
+{
+    const int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+
+    // Split frames must not wait for the first half's ACK
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Room for both ends of every peer plus some slack
+static bool RaiseFileLimit(size_t need)
+{
+    rlimit lim;
+    if (getrlimit(RLIMIT_NOFILE, &lim) != 0)
+        return false;
+    if (lim.rlim_cur >= need)
+        return true;
+    if (lim.rlim_max != RLIM_INFINITY && lim.rlim_max < need)
+        return false;
+
+    lim.rlim_cur = need;
+    return setrlimit(RLIMIT_NOFILE, &lim) == 0;
+}
+
+// One client's peers, round after round until `deadline`
+static void ClientLoop(const std::vector<int>& fds, const ReactorLoadGenerator::Options& opts,
+                       uint32_t magic, ReactorLoadGenerator::Clock::time_point deadline,
+                       std::vector<uint64_t>& latencies, uint64_t& bytes, uint64_t& failures)
+{
+    typedef ReactorLoadGenerator::Clock Clock;
+
+    std::mt19937_64 rng(std::random_device{}());
+    std::vector<bool> alive(fds.size(), true);
+    std::vector<std::vector<uint8_t>> sent(fds.size());
+    std::vector<Clock::time_point> sentAt(fds.size());
+    std::vector<uint8_t> frame;
+    std::vector<uint8_t> payload;
+
+    while (Clock::now() < deadline)
+    {
+        for (size_t i = 0; i < fds.size(); ++i)
+        {
+            if (!alive[i])
+                continue;
+
+            sent[i].resize(rng() % (opts.maxPayload + 1));
+            for (uint8_t& b : sent[i])
+                b = (uint8_t)rng();
+
+            frame.resize(MESSAGE_HEADER_SIZE);
+            BuildMessageHeader(magic, "ping", ByteSpan(sent[i]), frame.data());
+            frame.insert(frame.end(), sent[i].begin(), sent[i].end());
+
+            sentAt[i] = Clock::now();
+            const size_t cut = opts.splitWrites ? frame.size() / 2 : frame.size();
+            if (!WriteAll(fds[i], frame.data(), cut) ||
+                !WriteAll(fds[i], frame.data() + cut, frame.size() - cut))
+            {
+                alive[i] = false;
+                failures++;
+            }
+        }
+
+        for (size_t i = 0; i < fds.size(); ++i)
+        {
+            if (!alive[i])
+                continue;
+
+            uint8_t head[MESSAGE_HEADER_SIZE];
+            MessageHeader header;
+            if (!ReadAll(fds[i], head, sizeof(head)) || !header.Parse(head) ||
+                header.length > opts.maxPayload)
+            {
+                alive[i] = false;
+                failures++;
+                continue;
+            }
+
+            payload.resize(header.length);
+            if (!ReadAll(fds[i], payload.data(), payload.size()))
+            {
+                alive[i] = false;
+                failures++;
+                continue;
+            }
+
+            latencies.push_back((uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+                Clock::now() - sentAt[i]).count());
+
+            if (std::strcmp(header.command, "pong") != 0 || payload != sent[i] ||
+                !VerifyChecksum(header, ByteSpan(payload)))
+                failures++;
+            else
+                bytes += 2 * payload.size();
+        }
+    }
+}
+
+bool ReactorLoadGenerator::Run(const Options& opts, Report& report, std::string* reason)
+{
+    report = Report();
+
+    if (opts.peers == 0 || opts.clients == 0)
+        return SetReason(reason, "peers and clients must be non-zero");
+    if (opts.net.maxPeers < opts.peers)
+        return SetReason(reason, "net.maxPeers is below peers");
+    if (!RaiseFileLimit(2 * opts.peers + 64))
+        return SetReason(reason, "open file limit too low for that many peers");
+
+    NetReactor server(opts.net);
+    std::atomic<size_t> connected(0);
+
+    server.SetHandlers(
+        [&](NetReactor::PeerId, bool) { connected++; },
+        [&](NetReactor::PeerId id, const NetMessage& msg) {
+            if (std::strcmp(msg.command, "ping") == 0)
+                server.Send(id, "pong", std::make_shared<std::vector<uint8_t>>(msg.payload.ToVector()));
+        },
+        nullptr);
+
+    std::string error;
+    if (!server.Listen("127.0.0.1", 0, &error) || !server.Start(&error))
+        return SetReason(reason, "cannot start the reactor: " + error);
+
+    std::vector<int> fds;
+    fds.reserve(opts.peers);
+    for (size_t i = 0; i < opts.peers; ++i)
+    {
+        const int fd = Dial(server.GetListenPort());
+        if (fd < 0)
+            break;
+        fds.push_back(fd);
+    }
+
+    // Every connection accepted before the clock starts
+    const Clock::time_point waitUntil = Clock::now() + std::chrono::seconds(10);
+    while (connected < fds.size() && Clock::now() < waitUntil)
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+
+    bool ok = fds.size() == opts.peers && connected == fds.size();
+    if (ok)
+    {
+        report.peers = fds.size();
+
+        const unsigned clients = (unsigned)std::min<size_t>(opts.clients, fds.size());
+        std::vector<std::vector<int>> shares(clients);
+        for (size_t i = 0; i < fds.size(); ++i)
+            shares[i % clients].push_back(fds[i]);
+
+        std::vector<std::vector<uint64_t>> latencies(clients);
+        std::vector<uint64_t> bytes(clients, 0);
+        std::vector<uint64_t> failures(clients, 0);
+
+        const NetReactor::Stats before = server.GetStats();
+        const Clock::time_point start = Clock::now();
+        const Clock::time_point deadline = start + opts.duration;
+
+        std::vector<std::thread> threads;
+        for (unsigned c = 0; c < clients; ++c)
+        {
+            threads.emplace_back([&, c] {
+                ClientLoop(shares[c], opts, opts.net.magic, deadline, latencies[c], bytes[c], failures[c]);
+            });
+        }
+        for (std::thread& t : threads)
+            t.join();
+
+        report.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        const NetReactor::Stats after = server.GetStats();
+
+        std::vector<uint64_t> all;
+        for (unsigned c = 0; c < clients; ++c)
+        {
+            all.insert(all.end(), latencies[c].begin(), latencies[c].end());
+            report.bytes += bytes[c];
+            report.failures += failures[c];
+        }
+
+        report.messages = all.size();
+        if (report.messages > 0)
+        {
+            report.readCallsPerMessage = (double)(after.readCalls - before.readCalls) / report.messages;
+            report.sendCallsPerMessage = (double)(after.sendCalls - before.sendCalls) / report.messages;
+        }
+
+        std::sort(all.begin(), all.end());
+        report.p50Ms = Percentile(all, 0.50);
+        report.p90Ms = Percentile(all, 0.90);
+        report.p99Ms = Percentile(all, 0.99);
+        report.maxMs = all.empty() ? 0 : all.back() / 1000.0;
+    }
+
+    for (int fd : fds)
+        close(fd);
+    server.Stop();
+
+    return ok || SetReason(reason, "only " + std::to_string(connected.load()) + " of " +
+                                   std::to_string(opts.peers) + " peers connected");
+}
@@ -0,0 +1,83 @@
+#ifndef DRACHMA_NETWORK_REACTORLOAD_H
+#define DRACHMA_NETWORK_REACTORLOAD_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "reactor.h"
+
+//
+// ===============================================================
+//  CLASS: ReactorLoadGenerator
+// ===============================================================
+//
+//  Loopback load generator for NetReactor: a reactor built from
+//  `net` listens on 127.0.0.1 and echoes every "ping" back as a
+//  "pong" with the same payload. `peers` simulated peers, plain
+//  blocking sockets speaking v1 framing, connect to it and are
+//  split between `clients` threads.
+//
+//  For `duration` each client runs rounds (closed loop): one ping
+//  with a random payload of up to `maxPayload` bytes to each of
+//  its peers, every frame written in two halves when `splitWrites`
+//  so the reactor has to frame across reads, then one pong read
+//  back from each. A pong must carry its ping's payload and a
+//  valid checksum. Latency is per message, from its write to its
+//  pong being read, and so includes waiting behind the rest of
+//  the client's round.
+//
+//  Report: round trips per second, the latency distribution and
+//  the reactor's read and sendmsg() calls per message (how well
+//  reads and scatter/gather writes batch under load).
+//
+//  Each peer is two descriptors in this process; the open file
+//  limit is raised as far as the hard limit allows.
+//
+// ===============================================================
+//
+class ReactorLoadGenerator
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Options
+    {
+        NetReactor::Options net;
+        size_t peers;
+        unsigned clients;
+        size_t maxPayload;
+        bool splitWrites;
+        Clock::duration duration;
+
+        Options()
+            : peers(1200), clients(4), maxPayload(600), splitWrites(true),
+              duration(std::chrono::seconds(5))
+        {
+            net.threads = 2;
+            net.recvBuffer = 4096;
+        }
+    };
+
+    struct Report
+    {
+        size_t peers;                   // connected at the start
+        uint64_t messages;              // round trips completed
+        uint64_t bytes;                 // payload, both directions
+        uint64_t failures;              // wrong or missing pongs
+        double seconds;
+        double p50Ms;
+        double p90Ms;
+        double p99Ms;
+        double maxMs;
+        double readCallsPerMessage;
+        double sendCallsPerMessage;
+
+        double MessagesPerSecond() const { return seconds > 0 ? messages / seconds : 0; }
+    };
+
+    static bool Run(const Options& opts, Report& report, std::string* reason = nullptr);
+};
+
+#endif // DRACHMA_NETWORK_REACTORLOAD_H
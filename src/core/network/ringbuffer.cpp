@@ -0,0 +1,117 @@
+#include "ringbuffer.h"
+
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+
+RingBuffer::RingBuffer()
+{
+    base = nullptr;
+    capacity = 0;
+    mask = 0;
+    head = 0;
+    tail = 0;
+}
+
+RingBuffer::~RingBuffer()
+{
+    Release();
+}
+
+void RingBuffer::Release()
+{
+    if (base)
+        munmap(base, capacity * 2);
+
+    base = nullptr;
+    capacity = 0;
+    mask = 0;
+    head = 0;
+    tail = 0;
+}
+
+bool RingBuffer::Init(size_t want)
+{
+    Release();
+
+    // Power of two (so positions wrap with a mask) and whole pages
+    const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t cap = page;
+    while (cap < want)
+        cap <<= 1;
+
+    int fd = memfd_create("drachma-ring", MFD_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    if (ftruncate(fd, (off_t)cap) != 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    // Reserve both halves, then map the same pages into each
+    void* area = mmap(nullptr, cap * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (area == MAP_FAILED)
+    {
+        close(fd);
+        return false;
+    }
+
+    uint8_t* p = static_cast<uint8_t*>(area);
+    void* lo = mmap(p, cap, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+    void* hi = mmap(p + cap, cap, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+    close(fd);
+
+    if (lo == MAP_FAILED || hi == MAP_FAILED)
+    {
+        munmap(area, cap * 2);
+        return false;
+    }
+
+    base = p;
+    capacity = cap;
+    mask = cap - 1;
+    head = 0;
+    tail = 0;
+    return true;
+}
+
+void RingBuffer::Consume(size_t n)
+{
+    head += n;
+
+    // Empty: restart at the beginning (keeps recv() writes aligned)
+    if (head == tail)
+        head = tail = 0;
+}
+
+void RingBuffer::Commit(size_t n)
+{
+    tail += n;
+}
+
+bool RingBuffer::Grow(size_t want)
+{
+    if (want <= capacity)
+        return true;
+
+    RingBuffer bigger;
+    if (!bigger.Init(want))
+        return false;
+
+    ByteSpan data = Readable();
+    std::memcpy(bigger.WritePtr(), data.data, data.size);
+    bigger.Commit(data.size);
+
+    Release();
+
+    base = bigger.base;
+    capacity = bigger.capacity;
+    mask = bigger.mask;
+    head = bigger.head;
+    tail = bigger.tail;
+
+    bigger.base = nullptr;
+    return true;
+}
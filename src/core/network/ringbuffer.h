@@ -0,0 +1,71 @@
+#ifndef DRACHMA_NETWORK_RINGBUFFER_H
+#define DRACHMA_NETWORK_RINGBUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "../../common/utils/span.h"
+
+//
+// ===============================================================
+//  CLASS: RingBuffer
+// ===============================================================
+//
+//  Byte ring whose storage is mapped twice, back to back, in
+//  virtual memory. Anything up to Capacity() bytes starting at any
+//  position is contiguous, so:
+//
+//    - recv() writes straight into WritePtr() without splitting
+//    - a framed message is a single ByteSpan into the ring even
+//      when it wraps the physical end
+//
+//  Capacity is a multiple of the page size. Grow() moves the
+//  unread bytes into a larger ring (only needed for messages that
+//  do not fit the current one).
+//
+//  Not thread-safe; callers provide the locking (the receive ring
+//  belongs to one reactor thread, the v2 send ring to its peer's
+//  send lock).
+//
+// ===============================================================
+//
+class RingBuffer
+{
+public:
+    RingBuffer();
+    ~RingBuffer();
+
+    RingBuffer(const RingBuffer&) = delete;
+    RingBuffer& operator=(const RingBuffer&) = delete;
+
+    bool Init(size_t capacity);
+
+    size_t Capacity() const { return capacity; }
+    size_t Size() const { return (size_t)(tail - head); }
+    size_t Free() const { return capacity - Size(); }
+
+    // Unread bytes, contiguous
+    ByteSpan Readable() const { return ByteSpan(base + (head & mask), Size()); }
+    void Consume(size_t n);
+
+    // Same bytes, writable: for transforms in place (decryption)
+    uint8_t* ReadPtr() { return base + (head & mask); }
+
+    // Free space, contiguous
+    uint8_t* WritePtr() { return base + (tail & mask); }
+    void Commit(size_t n);
+
+    // Make room for at least `capacity` bytes in total
+    bool Grow(size_t capacity);
+
+private:
+    void Release();
+
+    uint8_t* base;
+    size_t capacity;
+    uint64_t mask;
+    uint64_t head;
+    uint64_t tail;
+};
+
+#endif // DRACHMA_NETWORK_RINGBUFFER_H
@@ -0,0 +1,99 @@
+#include "rollingbloom.h"
+#include "../crypto/siphash.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+RollingBloomFilter::RollingBloomFilter(size_t nElements, double fpRate)
+{
+    std::random_device rd;
+    k0 = ((uint64_t)rd() << 32) | rd();
+    k1 = ((uint64_t)rd() << 32) | rd();
+
+    // Optimal hash count for the rate; the table is sized for the
+    // three generations that can be live at once
+    const double logFpRate = std::log(fpRate);
+    hashFuncs = (uint32_t)std::max(1, std::min((int)std::lround(logFpRate / std::log(0.5)), 50));
+    entriesPerGeneration = (uint32_t)((nElements + 1) / 2);
+    const uint32_t maxElements = entriesPerGeneration * 3;
+    filterBits = (uint32_t)std::ceil(-1.0 * hashFuncs * maxElements /
+                                     std::log(1.0 - std::exp(logFpRate / hashFuncs)));
+
+    data.assign(((filterBits + 63) / 64) << 1, 0);
+    generation = 1;
+    entriesThisGeneration = 0;
+}
+
+uint64_t RollingBloomFilter::Hash(const uint8_t* item, size_t len) const
+{
+    if (len == 32)
+        return SipHashUint256(k0, k1, item);
+    return SipHasher(k0, k1).Write(item, len).Finalize();
+}
+
+uint32_t RollingBloomFilter::Position(uint64_t hash, uint32_t i) const
+{
+    // Enhanced double hashing: h1 + i * h2 + (i^3 - i) / 6
+    const uint32_t h1 = (uint32_t)hash;
+    const uint32_t h2 = (uint32_t)(hash >> 32);
+    const uint32_t h = h1 + i * h2 + (i * i * i - i) / 6;
+
+    // Map onto [0, filterBits) without a division
+    return (uint32_t)(((uint64_t)h * filterBits) >> 32);
+}
+
+void RollingBloomFilter::Insert(const uint8_t* item, size_t len)
+{
+    if (entriesThisGeneration == entriesPerGeneration)
+    {
+        entriesThisGeneration = 0;
+        if (++generation == 4)
+            generation = 1;
+
+        // Clear every position still holding the reused generation
+        const uint64_t gen1 = 0 - (uint64_t)(generation & 1);
+        const uint64_t gen2 = 0 - (uint64_t)(generation >> 1);
+        for (size_t p = 0; p < data.size(); p += 2)
+        {
+            const uint64_t p1 = data[p], p2 = data[p + 1];
+            const uint64_t keep = (p1 ^ gen1) | (p2 ^ gen2);
+            data[p] = p1 & keep;
+            data[p + 1] = p2 & keep;
+        }
+    }
+    entriesThisGeneration++;
+
+    const uint64_t hash = Hash(item, len);
+    for (uint32_t i = 0; i < hashFuncs; ++i)
+    {
+        const uint32_t pos = Position(hash, i);
+        const uint32_t bit = pos & 63;
+        const size_t word = (pos >> 6) * 2;
+
+        data[word] = (data[word] & ~(1ULL << bit)) | ((uint64_t)(generation & 1) << bit);
+        data[word + 1] = (data[word + 1] & ~(1ULL << bit)) | ((uint64_t)(generation >> 1) << bit);
+    }
+}
+
+bool RollingBloomFilter::Contains(const uint8_t* item, size_t len) const
+{
+    const uint64_t hash = Hash(item, len);
+    for (uint32_t i = 0; i < hashFuncs; ++i)
+    {
+        const uint32_t pos = Position(hash, i);
+        const uint32_t bit = pos & 63;
+        const size_t word = (pos >> 6) * 2;
+
+        if (!(((data[word] | data[word + 1]) >> bit) & 1))
+            return false;
+    }
+    return true;
+}
+
+void RollingBloomFilter::Reset()
+{
+    std::fill(data.begin(), data.end(), 0);
+    generation = 1;
+    entriesThisGeneration = 0;
+}
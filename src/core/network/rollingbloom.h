@@ -0,0 +1,69 @@
+#ifndef DRACHMA_NETWORK_ROLLINGBLOOM_H
+#define DRACHMA_NETWORK_ROLLINGBLOOM_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//
+// ===============================================================
+//  CLASS: RollingBloomFilter
+// ===============================================================
+//
+//  Probabilistic set of the most recent ~nElements insertions, in
+//  memory fixed at construction. Items older than that fade out
+//  instead of filling the filter up:
+//
+//    - insertions are counted in generations of nElements / 2
+//    - every bit position holds a 2-bit generation number (1..3,
+//      0 = empty), stored as two parallel bit planes in one pair
+//      of words per 64 positions
+//    - starting a new generation wipes the positions still marked
+//      with the one it reuses, in one pass over the table
+//
+//  So the last nElements items are always present, and at most
+//  1.5 * nElements are, with a false-positive rate of `fpRate`.
+//
+//  Positions come from one salted SipHash-2-4 of the item,
+//  stretched by enhanced double hashing; the salt is random per
+//  filter so peers cannot aim collisions at it.
+//
+//  Not thread-safe.
+//
+// ===============================================================
+//
+class RollingBloomFilter
+{
+public:
+    RollingBloomFilter(size_t nElements, double fpRate);
+
+    void Insert(const uint8_t* data, size_t len);
+    bool Contains(const uint8_t* data, size_t len) const;
+
+    void Insert(const std::array<uint8_t,32>& hash) { Insert(hash.data(), hash.size()); }
+    bool Contains(const std::array<uint8_t,32>& hash) const { return Contains(hash.data(), hash.size()); }
+
+    void Reset();
+
+    size_t MemoryUsage() const { return data.size() * sizeof(uint64_t); }
+
+private:
+    uint64_t Hash(const uint8_t* item, size_t len) const;
+
+    // Bit position of hash function `i`
+    uint32_t Position(uint64_t hash, uint32_t i) const;
+
+    uint64_t k0;
+    uint64_t k1;
+
+    uint32_t hashFuncs;
+    uint32_t entriesPerGeneration;
+    uint32_t entriesThisGeneration;
+    uint32_t generation;
+    uint32_t filterBits;
+
+    std::vector<uint64_t> data;
+};
+
+#endif // DRACHMA_NETWORK_ROLLINGBLOOM_H
@@ -0,0 +1,613 @@
+#include "txrelay.h"
+#include "pinsketch.h"
+#include "../crypto/sha256.h"
+#include "../crypto/siphash.h"
+
+#include <algorithm>
+#include <cstring>
+
+static const char RECON_SALT_TAG[] = "Tx Relay Salting";
+
+static bool IsReconMessage(const char* cmd)
+{
+    return std::strcmp(cmd, "sendtxrcncl") == 0 || std::strcmp(cmd, "reqrecon") == 0 ||
+           std::strcmp(cmd, "sketch") == 0 || std::strcmp(cmd, "reconcildiff") == 0;
+}
+
+// Entries of an inv / getdata; false if any is not a transaction
+static bool ReadWtxInventory(ByteSpan payload, std::vector<std::array<uint8_t,32>>& out)
+{
+    SpanReader in(payload);
+    uint64_t count;
+    if (!in.ReadCompactSize(count) || count > MAX_INV_SZ || count != in.Remaining() / 36 ||
+        in.Remaining() % 36)
+        return false;
+
+    out.resize((size_t)count);
+    for (std::array<uint8_t,32>& hash : out)
+    {
+        uint32_t type;
+        if (!in.ReadU32(type) || type != MSG_WTX || !in.ReadBytes(hash.data(), 32))
+            return false;
+    }
+    return true;
+}
+
+static PayloadRef MakeWtxInventory(const std::array<uint8_t,32>* hashes, size_t count)
+{
+    auto msg = std::make_shared<std::vector<uint8_t>>();
+    msg->reserve(CompactSizeLen(count) + count * 36);
+    AppendCompactSize(*msg, count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        AppendU32(*msg, MSG_WTX);
+        AppendBytes(*msg, hashes[i].data(), 32);
+    }
+    return msg;
+}
+
+//
+// ================================================================
+//  TxRelay
+// ================================================================
+TxRelay::TxRelay(NetReactor& n, const Options& o)
+    : net(n), opts(o)
+{
+    std::random_device rd;
+    rng.seed(((uint64_t)rd() << 32) | rd());
+
+    fanoutK0 = rng();
+    fanoutK1 = rng();
+
+    nextInboundInv = Clock::now() + TrickleDelay(opts.invIntervalInbound);
+
+    std::memset(&stats, 0, sizeof(stats));
+}
+
+void TxRelay::SetTxHandler(TxFn fn)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    onTx = std::move(fn);
+}
+
+void TxRelay::PeerConnected(NetReactor::PeerId id, bool inbound)
+{
+    uint64_t salt;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        PeerState& peer = peerStates[id];
+        peer.inbound = inbound;
+        peer.ourSalt = salt = rng();
+        peer.known.reset(new RollingBloomFilter(opts.knownTxs, opts.knownFpRate));
+
+        const Clock::time_point now = Clock::now();
+        peer.nextInv = now + TrickleDelay(opts.invIntervalOutbound);
+
+        // Spread the first rounds over one interval
+        peer.nextRound = now + opts.reconInterval * (int)(rng() % 1024) / 1024;
+    }
+
+    if (!opts.reconcile)
+        return;
+
+    auto payload = std::make_shared<std::vector<uint8_t>>();
+    AppendU32(*payload, TXRECONCILIATION_VERSION);
+    AppendU64(*payload, salt);
+    Flush({Outgoing{id, "sendtxrcncl", payload}});
+}
+
+void TxRelay::PeerDisconnected(NetReactor::PeerId id)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    peerStates.erase(id);
+
+    // Let another peer's announcement fetch what this one owed us
+    for (auto it = requested.begin(); it != requested.end(); )
+    {
+        if (it->second == id)
+            it = requested.erase(it);
+        else
+            ++it;
+    }
+}
+
+bool TxRelay::ProcessMessage(NetReactor::PeerId id, const NetMessage& msg)
+{
+    const char* cmd = msg.command;
+
+    if (std::strcmp(cmd, "inv") == 0)
+        return OnInv(id, msg.payload);
+    if (std::strcmp(cmd, "getdata") == 0)
+        return OnGetData(id, msg.payload);
+    if (std::strcmp(cmd, "tx") == 0)
+        return OnTx(id, msg.payload);
+
+    if (!IsReconMessage(cmd))
+        return false;
+
+    if (std::strcmp(cmd, "sendtxrcncl") == 0)
+    {
+        OnSendTxRcncl(id, msg.payload);
+        return true;
+    }
+
+    std::vector<Outgoing> out;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (std::strcmp(cmd, "reqrecon") == 0)
+            OnReqRecon(id, msg.payload, out);
+        else if (std::strcmp(cmd, "sketch") == 0)
+            OnSketch(id, msg.payload, out);
+        else
+            OnReconcilDiff(id, msg.payload, out);
+    }
+
+    Flush(out);
+    return true;
+}
+
+void TxRelay::OnSendTxRcncl(NetReactor::PeerId id, ByteSpan payload)
+{
+    SpanReader in(payload);
+    uint32_t version;
+    uint64_t theirSalt;
+    if (!in.ReadU32(version) || !in.ReadU64(theirSalt))
+        return;
+
+    if (!opts.reconcile || version < TXRECONCILIATION_VERSION)
+        return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = peerStates.find(id);
+    if (it == peerStates.end() || it->second.reconciling)
+        return;
+
+    PeerState& peer = it->second;
+
+    // Tagged hash: SHA256(tag hash || tag hash || salts, smaller first)
+    uint8_t tagHash[32];
+    ::SHA256 tag;
+    tag.Update((const uint8_t*)RECON_SALT_TAG, sizeof(RECON_SALT_TAG) - 1);
+    tag.Final(tagHash);
+
+    uint8_t salts[16];
+    WriteLE64(salts, std::min(peer.ourSalt, theirSalt));
+    WriteLE64(salts + 8, std::max(peer.ourSalt, theirSalt));
+
+    uint8_t digest[32];
+    ::SHA256 sha;
+    sha.Update(tagHash, 32);
+    sha.Update(tagHash, 32);
+    sha.Update(salts, sizeof(salts));
+    sha.Final(digest);
+
+    peer.k0 = ReadLE64(digest);
+    peer.k1 = ReadLE64(digest + 8);
+    peer.reconciling = true;
+}
+
+uint32_t TxRelay::ShortId(const PeerState& peer, const Hash256& wtxid)
+{
+    // Never zero: PinSketch elements are nonzero
+    return 1 + (uint32_t)(SipHashUint256(peer.k0, peer.k1, wtxid.data()) % 0xffffffffULL);
+}
+
+void TxRelay::RelayTransaction(const TransactionRef& tx, NetReactor::PeerId from)
+{
+    const Hash256 wtxid = tx->GetWtxid();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.txsRelayed++;
+
+    if (!relayPool.emplace(wtxid, tx).second)
+        return;
+    relayOrder.push_back(wtxid);
+    while (relayOrder.size() > opts.relayTxns)
+    {
+        relayPool.erase(relayOrder.front());
+        relayOrder.pop_front();
+    }
+    requested.erase(wtxid);
+
+    // Outbound reconciling peers that get this one by inv: the
+    // lowest keyed hashes of (peer, wtxid)
+    std::vector<std::pair<uint64_t, NetReactor::PeerId>> fanout;
+    if (opts.floodOutbound)
+    {
+        for (const auto& kv : peerStates)
+        {
+            if (kv.first == from || !kv.second.reconciling || kv.second.inbound)
+                continue;
+            SipHasher hasher(fanoutK0, fanoutK1);
+            hasher.Write(kv.first).Write(wtxid.data(), wtxid.size());
+            fanout.emplace_back(hasher.Finalize(), kv.first);
+        }
+        if (fanout.size() > opts.floodOutbound)
+        {
+            std::partial_sort(fanout.begin(), fanout.begin() + opts.floodOutbound, fanout.end());
+            fanout.resize(opts.floodOutbound);
+        }
+    }
+
+    for (auto& kv : peerStates)
+    {
+        if (kv.first == from)
+            continue;
+
+        PeerState& peer = kv.second;
+        if (peer.known->Contains(wtxid))
+        {
+            stats.invsSuppressed++;
+            continue;
+        }
+
+        bool flood = !peer.reconciling || peer.reconSet.size() >= opts.maxSetSize;
+        for (size_t i = 0; i < fanout.size() && !flood; ++i)
+            flood = fanout[i].second == kv.first;
+
+        if (flood)
+            peer.invQueue.push_back(wtxid);
+        else
+            peer.reconSet.insert(wtxid);
+    }
+}
+
+void TxRelay::Tick(Clock::time_point now)
+{
+    std::vector<Outgoing> out;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        const bool inboundDue = now >= nextInboundInv;
+        if (inboundDue)
+            nextInboundInv = now + TrickleDelay(opts.invIntervalInbound);
+
+        for (auto& kv : peerStates)
+        {
+            PeerState& peer = kv.second;
+
+            bool due = inboundDue;
+            if (!peer.inbound)
+            {
+                due = now >= peer.nextInv;
+                if (due)
+                    peer.nextInv = now + TrickleDelay(opts.invIntervalOutbound);
+            }
+
+            if (due && !peer.invQueue.empty())
+            {
+                // Oldest first; what the peer learned about while
+                // queued is dropped
+                std::vector<Hash256> batch;
+                size_t taken = 0;
+                for (; taken < peer.invQueue.size() && batch.size() < opts.maxInvBatch; ++taken)
+                {
+                    const Hash256& wtxid = peer.invQueue[taken];
+                    if (peer.known->Contains(wtxid))
+                    {
+                        stats.invsSuppressed++;
+                        continue;
+                    }
+                    peer.known->Insert(wtxid);
+                    batch.push_back(wtxid);
+                }
+                peer.invQueue.erase(peer.invQueue.begin(), peer.invQueue.begin() + taken);
+
+                QueueInv(kv.first, batch, false, out);
+            }
+
+            // Rounds are started by the side that opened the connection
+            if (!peer.reconciling || peer.inbound || peer.roundInFlight || now < peer.nextRound)
+                continue;
+
+            auto payload = std::make_shared<std::vector<uint8_t>>();
+            AppendU16(*payload, (uint16_t)std::min<size_t>(peer.reconSet.size(), 0xffff));
+            AppendU16(*payload, (uint16_t)(std::min(std::max(opts.reconQ, 0.0), 1.0) * 32767));
+            out.push_back(Outgoing{kv.first, "reqrecon", payload});
+
+            peer.roundInFlight = true;
+            peer.nextRound = now + opts.reconInterval;
+        }
+    }
+
+    Flush(out);
+}
+
+void TxRelay::OnReqRecon(NetReactor::PeerId id, ByteSpan payload, std::vector<Outgoing>& out)
+{
+    SpanReader in(payload);
+    uint16_t theirSize, q;
+    if (!in.ReadU16(theirSize) || !in.ReadU16(q))
+        return;
+
+    auto it = peerStates.find(id);
+    if (it == peerStates.end())
+        return;
+
+    // Only the initiator asks, one round at a time
+    PeerState& peer = it->second;
+    if (!peer.reconciling || !peer.inbound || peer.sketchSent)
+        return;
+
+    const size_t ourSize = peer.reconSet.size();
+    const size_t difference = ourSize > theirSize ? ourSize - theirSize : theirSize - ourSize;
+    const size_t capacity = std::min(opts.maxSketchCapacity,
+        difference + (size_t)(q / 32767.0 * std::min<size_t>(ourSize, theirSize)) + 1);
+
+    // The set moves into the snapshot; later transactions wait for
+    // the next round
+    PinSketch sketch(capacity);
+    for (const Hash256& wtxid : peer.reconSet)
+    {
+        const uint32_t shortId = ShortId(peer, wtxid);
+        peer.sketched[shortId] = wtxid;
+        sketch.Add(shortId);
+    }
+    peer.reconSet.clear();
+    peer.sketchSent = true;
+
+    auto msg = std::make_shared<std::vector<uint8_t>>();
+    msg->reserve(sketch.SerializedSize());
+    sketch.Serialize(*msg);
+    out.push_back(Outgoing{id, "sketch", msg});
+}
+
+void TxRelay::OnSketch(NetReactor::PeerId id, ByteSpan payload, std::vector<Outgoing>& out)
+{
+    auto it = peerStates.find(id);
+    if (it == peerStates.end())
+        return;
+
+    PeerState& peer = it->second;
+    if (!peer.reconciling || peer.inbound || !peer.roundInFlight)
+        return;
+    peer.roundInFlight = false;
+
+    std::unordered_map<uint32_t, Hash256> ours;
+    ours.reserve(peer.reconSet.size());
+    for (const Hash256& wtxid : peer.reconSet)
+        ours[ShortId(peer, wtxid)] = wtxid;
+    peer.reconSet.clear();
+
+    PinSketch theirs;
+    std::vector<uint32_t> difference;
+    bool ok = theirs.Deserialize(payload) && theirs.Capacity() > 0 &&
+              theirs.Capacity() <= opts.maxSketchCapacity;
+    if (ok)
+    {
+        PinSketch sketch(theirs.Capacity());
+        for (const auto& kv : ours)
+            sketch.Add(kv.first);
+        sketch.Merge(theirs);
+
+        // One syndrome kept back as a check (see PinSketch::Decode)
+        ok = sketch.Decode(theirs.Capacity() - 1, difference);
+    }
+
+    std::vector<Hash256> announce;
+    std::vector<uint32_t> ask;
+    if (ok)
+    {
+        for (uint32_t shortId : difference)
+        {
+            auto found = ours.find(shortId);
+            if (found != ours.end())
+                announce.push_back(found->second);
+            else
+                ask.push_back(shortId);
+        }
+    }
+    else
+    {
+        // Both sides fall back to announcing their whole set
+        for (const auto& kv : ours)
+            announce.push_back(kv.second);
+    }
+
+    for (const Hash256& wtxid : announce)
+        peer.known->Insert(wtxid);
+
+    auto msg = std::make_shared<std::vector<uint8_t>>();
+    AppendU8(*msg, ok ? 1 : 0);
+    AppendCompactSize(*msg, ask.size());
+    for (uint32_t shortId : ask)
+        AppendU32(*msg, shortId);
+    out.push_back(Outgoing{id, "reconcildiff", msg});
+
+    QueueInv(id, announce, true, out);
+
+    stats.reconRounds++;
+    if (ok)
+    {
+        stats.reconSucceeded++;
+        stats.reconDifference += difference.size();
+    }
+    else
+    {
+        stats.reconFailed++;
+    }
+}
+
+void TxRelay::OnReconcilDiff(NetReactor::PeerId id, ByteSpan payload, std::vector<Outgoing>& out)
+{
+    SpanReader in(payload);
+    uint8_t success;
+    uint64_t count;
+    if (!in.ReadU8(success) || !in.ReadCompactSize(count) || count > in.Remaining() / 4)
+        return;
+
+    auto it = peerStates.find(id);
+    if (it == peerStates.end() || !it->second.sketchSent)
+        return;
+
+    PeerState& peer = it->second;
+    std::vector<Hash256> announce;
+    if (success)
+    {
+        for (uint64_t i = 0; i < count; ++i)
+        {
+            uint32_t shortId;
+            if (!in.ReadU32(shortId))
+                break;
+            auto found = peer.sketched.find(shortId);
+            if (found != peer.sketched.end())
+                announce.push_back(found->second);
+        }
+    }
+    else
+    {
+        for (const auto& kv : peer.sketched)
+            announce.push_back(kv.second);
+    }
+
+    peer.sketched.clear();
+    peer.sketchSent = false;
+
+    for (const Hash256& wtxid : announce)
+        peer.known->Insert(wtxid);
+
+    QueueInv(id, announce, true, out);
+}
+
+bool TxRelay::OnInv(NetReactor::PeerId id, ByteSpan payload)
+{
+    std::vector<Hash256> wtxids;
+    if (!ReadWtxInventory(payload, wtxids))
+        return false;
+
+    std::vector<Hash256> fetch;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = peerStates.find(id);
+        if (it == peerStates.end())
+            return true;
+
+        for (const Hash256& wtxid : wtxids)
+        {
+            // The peer has it; no need to announce it to them
+            it->second.known->Insert(wtxid);
+            it->second.reconSet.erase(wtxid);
+
+            if (relayPool.count(wtxid) || !requested.emplace(wtxid, id).second)
+                continue;
+            fetch.push_back(wtxid);
+        }
+    }
+
+    if (!fetch.empty())
+        net.Send(id, "getdata", MakeWtxInventory(fetch.data(), fetch.size()));
+    return true;
+}
+
+bool TxRelay::OnGetData(NetReactor::PeerId id, ByteSpan payload)
+{
+    // Mixed or block requests are left to the node / block relay
+    std::vector<Hash256> wtxids;
+    if (!ReadWtxInventory(payload, wtxids))
+        return false;
+
+    std::vector<TransactionRef> txs;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const Hash256& wtxid : wtxids)
+        {
+            auto found = relayPool.find(wtxid);
+            if (found != relayPool.end())
+                txs.push_back(found->second);
+        }
+    }
+
+    for (const TransactionRef& tx : txs)
+    {
+        auto msg = std::make_shared<std::vector<uint8_t>>();
+        tx->Serialize(*msg, true);
+        net.Send(id, "tx", msg);
+    }
+    return true;
+}
+
+bool TxRelay::OnTx(NetReactor::PeerId id, ByteSpan payload)
+{
+    std::shared_ptr<Transaction> tx = std::make_shared<Transaction>();
+    if (!tx->Deserialize(payload))
+        return true;
+
+    const Hash256 wtxid = tx->GetWtxid();
+
+    TxFn fn;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = peerStates.find(id);
+        if (it == peerStates.end())
+            return true;
+
+        it->second.known->Insert(wtxid);
+        it->second.reconSet.erase(wtxid);
+        requested.erase(wtxid);
+        stats.txsReceived++;
+        fn = onTx;
+    }
+
+    if (fn)
+        fn(id, tx);
+    return true;
+}
+
+TxRelay::Clock::duration TxRelay::TrickleDelay(Clock::duration mean)
+{
+    std::exponential_distribution<double> exp(1.0);
+    return std::chrono::duration_cast<Clock::duration>(mean * exp(rng));
+}
+
+void TxRelay::QueueInv(NetReactor::PeerId id, const std::vector<Hash256>& wtxids, bool reconciled,
+                       std::vector<Outgoing>& out)
+{
+    if (wtxids.empty())
+        return;
+
+    for (size_t i = 0; i < wtxids.size(); i += MAX_INV_SZ)
+    {
+        const size_t n = std::min(MAX_INV_SZ, wtxids.size() - i);
+        out.push_back(Outgoing{id, "inv", MakeWtxInventory(&wtxids[i], n)});
+    }
+
+    if (reconciled)
+        stats.invsReconciled += wtxids.size();
+    else
+        stats.invsFlooded += wtxids.size();
+}
+
+void TxRelay::Flush(const std::vector<Outgoing>& out)
+{
+    uint64_t invMessages = 0, invBytes = 0, reconBytes = 0;
+    for (const Outgoing& o : out)
+    {
+        if (!net.Send(o.id, o.command, o.payload))
+            continue;
+
+        const uint64_t bytes = MESSAGE_HEADER_SIZE + o.payload->size();
+        if (std::strcmp(o.command, "inv") == 0)
+        {
+            invMessages++;
+            invBytes += bytes;
+        }
+        else
+        {
+            reconBytes += bytes;
+        }
+    }
+
+    if (out.empty())
+        return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.invMessages += invMessages;
+    stats.invBytes += invBytes;
+    stats.reconBytes += reconBytes;
+}
+
+TxRelay::Stats TxRelay::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
@@ -0,0 +1,261 @@
+#ifndef DRACHMA_NETWORK_TXRELAY_H
+#define DRACHMA_NETWORK_TXRELAY_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "reactor.h"
+#include "rollingbloom.h"
+#include "../tx/mempool.h"
+
+//
+// Transaction relay (wtxid inventory, BIP330-style reconciliation)
+// ---------------------------------------------------------------
+//   inv, getdata   compact size | (u32 type | 32-byte hash) ...
+//   tx             transaction
+//   sendtxrcncl    u32 version | u64 salt
+//   reqrecon       u16 set size | u16 q * 32767
+//   sketch         PinSketch syndromes (4 bytes each)
+//   reconcildiff   u8 success | compact size | u32 short ids
+//
+//  Short ID = 1 + (SipHash-2-4(k0, k1, wtxid) mod 0xffffffff), keys
+//  from the tagged hash "Tx Relay Salting" of both salts, smaller
+//  first.
+//
+static const uint32_t MSG_WTX = 5;
+static const uint32_t TXRECONCILIATION_VERSION = 1;
+static const size_t MAX_INV_SZ = 50000;
+
+//
+// ===============================================================
+//  CLASS: TxRelay
+// ===============================================================
+//
+//  Announces and fetches transactions over a NetReactor. Flooding
+//  an inv to every peer costs bandwidth proportional to the number
+//  of connections; peers that both send sendtxrcncl reconcile
+//  instead:
+//
+//    - every relayed transaction goes into the peer's
+//      reconciliation set rather than an inv
+//    - the side that opened the connection starts a round every
+//      `reconInterval` (reqrecon with its set size)
+//    - the other side answers with a sketch of its set, sized by
+//      the expected difference |a - b| + q * min(a, b) + 1
+//    - the initiator merges in its own sketch and decodes the
+//      symmetric difference: it announces what only it has and
+//      asks (reconcildiff) for what only the peer has; everything
+//      both sides had cancels out and costs nothing
+//    - a failed decode floods both sets as plain invs
+//
+//  Each transaction is still flooded to `floodOutbound` of the
+//  reconciling outbound peers (picked per transaction) so it
+//  crosses the network at flooding latency; peers without
+//  reconciliation get every announcement as an inv.
+//
+//  Every peer has a rolling bloom filter of the transactions it is
+//  known to have (it announced or sent them, or we announced them
+//  to it), in fixed memory. Known transactions are neither queued
+//  nor reconciled with that peer again.
+//
+//  Invs trickle: they are queued per peer and sent in one batch
+//  when the peer's timer fires, at exponentially distributed
+//  intervals (mean `invIntervalOutbound`). Inbound peers share one
+//  timer with a longer mean so that they cannot time the origin of
+//  a transaction by connecting many times. Tick() fires the timers
+//  and starts the reconciliation rounds that are due; the node
+//  calls it periodically (every 100 ms or so) and forwards its
+//  reactor callbacks:
+//
+//    PeerConnected()    – sends sendtxrcncl
+//    ProcessMessage()   – consumes the messages above, returns
+//                         false for anything else (getdata for
+//                         non-transaction items included)
+//    PeerDisconnected() – drops the peer's sets
+//
+//  Received transactions go to the TxFn, which validates them and
+//  calls RelayTransaction() for the ones it accepts. Recently
+//  relayed transactions are kept to answer getdata.
+//
+//  Threading: all methods may be called from any thread.
+//
+// ===============================================================
+//
+class TxRelay
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+    typedef std::function<void(NetReactor::PeerId from, const TransactionRef& tx)> TxFn;
+
+    // RelayTransaction() source for locally created transactions
+    static const NetReactor::PeerId NO_PEER = 0;
+
+    struct Options
+    {
+        bool reconcile;                 // offer reconciliation
+        size_t floodOutbound;           // reconciling outbound peers flooded per tx
+        Clock::duration reconInterval;  // between rounds, per peer
+        double reconQ;                  // expected difference coefficient
+        size_t maxSketchCapacity;
+        size_t maxSetSize;              // past this, announce by inv
+        size_t relayTxns;               // kept to serve getdata
+
+        Clock::duration invIntervalOutbound;    // mean trickle interval
+        Clock::duration invIntervalInbound;     //   (shared by inbound peers)
+        size_t maxInvBatch;             // per trickle; the rest waits
+
+        size_t knownTxs;                // per-peer known filter
+        double knownFpRate;
+
+        Options()
+            : reconcile(true), floodOutbound(1),
+              reconInterval(std::chrono::seconds(2)), reconQ(0.5),
+              maxSketchCapacity(128), maxSetSize(3000), relayTxns(5000),
+              invIntervalOutbound(std::chrono::seconds(2)),
+              invIntervalInbound(std::chrono::seconds(5)), maxInvBatch(1000),
+              knownTxs(50000), knownFpRate(0.000001) {}
+    };
+
+    struct Stats
+    {
+        uint64_t txsRelayed;            // RelayTransaction() calls
+        uint64_t txsReceived;           // tx messages handed to the TxFn
+
+        uint64_t invsFlooded;           // inv entries sent without reconciling
+        uint64_t invsReconciled;        // inv entries sent after a round
+        uint64_t invsSuppressed;        // not sent: already known to the peer
+        uint64_t invMessages;
+
+        // Announcement bandwidth, message headers included
+        uint64_t invBytes;
+        uint64_t reconBytes;            // sendtxrcncl, reqrecon, sketch, reconcildiff
+
+        uint64_t reconRounds;           // decoded by us as initiator
+        uint64_t reconSucceeded;
+        uint64_t reconFailed;
+        uint64_t reconDifference;       // elements decoded
+    };
+
+    TxRelay(NetReactor& net, const Options& opts = Options());
+
+    TxRelay(const TxRelay&) = delete;
+    TxRelay& operator=(const TxRelay&) = delete;
+
+    void SetTxHandler(TxFn fn);
+
+    void PeerConnected(NetReactor::PeerId id, bool inbound);
+    void PeerDisconnected(NetReactor::PeerId id);
+    bool ProcessMessage(NetReactor::PeerId id, const NetMessage& msg);
+
+    // Announce an accepted transaction to every peer but `from`
+    void RelayTransaction(const TransactionRef& tx, NetReactor::PeerId from);
+
+    // Send queued invs and start due reconciliation rounds
+    void Tick(Clock::time_point now = Clock::now());
+
+    Stats GetStats() const;
+
+private:
+    typedef std::array<uint8_t,32> Hash256;
+
+    struct WtxidHasher
+    {
+        SaltedOutPointHasher salt;
+        size_t operator()(const Hash256& h) const { return salt.Hash(h.data(), 0); }
+    };
+
+    typedef std::unordered_set<Hash256, WtxidHasher> WtxidSet;
+
+    struct PeerState
+    {
+        bool inbound;
+        uint64_t ourSalt;
+
+        bool reconciling;               // both sides sent sendtxrcncl
+        uint64_t k0;
+        uint64_t k1;
+
+        std::unique_ptr<RollingBloomFilter> known;
+
+        std::vector<Hash256> invQueue;  // sent when the trickle timer fires
+        Clock::time_point nextInv;      // outbound only
+        WtxidSet reconSet;              // waiting for the next round
+
+        // Initiator: reqrecon sent, waiting for the sketch
+        bool roundInFlight;
+        Clock::time_point nextRound;
+
+        // Responder: the set our sketch described, by short ID,
+        // until the reconcildiff arrives
+        bool sketchSent;
+        std::unordered_map<uint32_t, Hash256> sketched;
+
+        PeerState()
+            : inbound(false), ourSalt(0), reconciling(false), k0(0), k1(0),
+              roundInFlight(false), sketchSent(false) {}
+    };
+
+    struct Outgoing
+    {
+        NetReactor::PeerId id;
+        const char* command;
+        PayloadRef payload;
+    };
+
+    void OnSendTxRcncl(NetReactor::PeerId id, ByteSpan payload);
+    bool OnInv(NetReactor::PeerId id, ByteSpan payload);
+    bool OnGetData(NetReactor::PeerId id, ByteSpan payload);
+    bool OnTx(NetReactor::PeerId id, ByteSpan payload);
+    void OnReqRecon(NetReactor::PeerId id, ByteSpan payload, std::vector<Outgoing>& out);
+    void OnSketch(NetReactor::PeerId id, ByteSpan payload, std::vector<Outgoing>& out);
+    void OnReconcilDiff(NetReactor::PeerId id, ByteSpan payload, std::vector<Outgoing>& out);
+
+    // Short ID in the peer's salted ID space
+    static uint32_t ShortId(const PeerState& peer, const Hash256& wtxid);
+
+    // Appends inv messages (MAX_INV_SZ entries each) for `wtxids`
+    void QueueInv(NetReactor::PeerId id, const std::vector<Hash256>& wtxids, bool reconciled,
+                  std::vector<Outgoing>& out);
+
+    // Sends and does the byte accounting; called without `mutex`
+    void Flush(const std::vector<Outgoing>& out);
+
+    // Exponentially distributed delay with the given mean
+    Clock::duration TrickleDelay(Clock::duration mean);
+
+    NetReactor& net;
+    Options opts;
+
+    TxFn onTx;
+
+    mutable std::mutex mutex;
+    std::unordered_map<NetReactor::PeerId, PeerState> peerStates;
+
+    // Relayed transactions by wtxid, oldest first in `relayOrder`
+    std::unordered_map<Hash256, TransactionRef, WtxidHasher> relayPool;
+    std::deque<Hash256> relayOrder;
+
+    // getdata sent, by wtxid, so one announcement is fetched once
+    std::unordered_map<Hash256, NetReactor::PeerId, WtxidHasher> requested;
+
+    Clock::time_point nextInboundInv;
+
+    uint64_t fanoutK0;                  // picks the flooded outbound peers
+    uint64_t fanoutK1;
+    std::mt19937_64 rng;
+
+    Stats stats;
+};
+
+#endif // DRACHMA_NETWORK_TXRELAY_H
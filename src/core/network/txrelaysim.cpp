@@ -0,0 +1,244 @@
+#include "txrelaysim.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <set>
+#include <thread>
+
+static bool SetReason(std::string* reason, const std::string& text)
+{
+    if (reason)
+        *reason = text;
+    return false;
+}
+
+// One input, one P2WPKH output; the random prevout keeps it unique
+static TransactionRef RandomTransaction(std::mt19937_64& rng)
+{
+    std::shared_ptr<Transaction> tx = std::make_shared<Transaction>();
+    tx->version = 2;
+
+    TxIn in;
+    for (size_t i = 0; i < in.prevout.txid.size(); i += 8)
+    {
+        const uint64_t r = rng();
+        std::memcpy(in.prevout.txid.data() + i, &r, 8);
+    }
+    in.prevout.index = (uint32_t)(rng() % 4);
+    in.witness.push_back(std::vector<uint8_t>(72, 0x30));
+    in.witness.push_back(std::vector<uint8_t>(33, 0x02));
+    tx->vin.push_back(in);
+
+    std::vector<uint8_t> script(22);
+    script[1] = 20;
+    for (size_t i = 2; i < script.size(); ++i)
+        script[i] = (uint8_t)rng();
+    tx->vout.push_back(TxOut((int64_t)(rng() % 100000000) + 1000, script));
+    return tx;
+}
+
+// A NetReactor and its TxRelay; every new transaction is accepted
+// and relayed onwards
+struct SimNode
+{
+    NetReactor net;
+    TxRelay relay;
+    std::atomic<size_t> connections;
+
+    std::mutex mutex;
+    std::set<std::array<uint8_t,32>> have;
+
+    explicit SimNode(const TxRelay::Options& relayOpts)
+        : net(NetReactor::Options()), relay(net, relayOpts), connections(0)
+    {
+        net.SetHandlers(
+            [this](NetReactor::PeerId id, bool inbound) { relay.PeerConnected(id, inbound); connections++; },
+            [this](NetReactor::PeerId id, const NetMessage& msg) { relay.ProcessMessage(id, msg); },
+            [this](NetReactor::PeerId id, const std::string&) { relay.PeerDisconnected(id); });
+        relay.SetTxHandler([this](NetReactor::PeerId from, const TransactionRef& tx) {
+            if (Accept(tx))
+                relay.RelayTransaction(tx, from);
+        });
+    }
+
+    bool Accept(const TransactionRef& tx)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return have.insert(tx->GetWtxid()).second;
+    }
+
+    size_t Count()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return have.size();
+    }
+};
+
+static bool RunOnce(bool reconcile, const std::vector<std::pair<size_t,size_t>>& edges,
+                    const std::vector<TransactionRef>& txs, const std::vector<size_t>& origins,
+                    const TxRelaySimulation::Options& opts, TxRelaySimulation::Report& report,
+                    std::string* reason)
+{
+    typedef TxRelaySimulation::Clock Clock;
+
+    report = TxRelaySimulation::Report();
+    report.reconcile = reconcile;
+    report.connections = edges.size();
+
+    TxRelay::Options relayOpts;
+    relayOpts.reconcile = reconcile;
+    relayOpts.reconInterval = opts.reconInterval;
+
+    std::vector<std::unique_ptr<SimNode>> nodes;
+    std::string error;
+    for (size_t i = 0; i < opts.nodes; ++i)
+    {
+        nodes.emplace_back(new SimNode(relayOpts));
+        if (!nodes[i]->net.Listen("127.0.0.1", 0, &error) || !nodes[i]->net.Start(&error))
+            break;
+    }
+
+    std::atomic<bool> stop(false);
+    std::thread ticker;
+    bool ok = error.empty();
+
+    if (ok)
+    {
+        for (const auto& edge : edges)
+        {
+            NetReactor::PeerId id;
+            if (!nodes[edge.first]->net.Connect("127.0.0.1", nodes[edge.second]->net.GetListenPort(),
+                                                &id, &error))
+            {
+                ok = false;
+                break;
+            }
+        }
+    }
+
+    // Both ends of every connection up
+    Clock::time_point deadline = Clock::now() + opts.timeout;
+    while (ok)
+    {
+        size_t up = 0;
+        for (const auto& node : nodes)
+            up += node->connections;
+        if (up == 2 * edges.size())
+            break;
+        if (Clock::now() > deadline)
+        {
+            ok = false;
+            error = "connections did not come up";
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+
+    if (ok)
+    {
+        // Let the sendtxrcncl exchanges land before the first tx
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+        ticker = std::thread([&] {
+            while (!stop)
+            {
+                for (const auto& node : nodes)
+                    node->relay.Tick();
+                std::this_thread::sleep_for(opts.tickInterval);
+            }
+        });
+
+        const Clock::time_point start = Clock::now();
+        const std::chrono::duration<double> gap(opts.txRate > 0 ? 1.0 / opts.txRate : 0);
+        for (size_t i = 0; i < txs.size(); ++i)
+        {
+            SimNode& origin = *nodes[origins[i]];
+            origin.Accept(txs[i]);
+            origin.relay.RelayTransaction(txs[i], TxRelay::NO_PEER);
+            std::this_thread::sleep_until(start + std::chrono::duration_cast<Clock::duration>(gap * (i + 1)));
+        }
+
+        deadline = Clock::now() + opts.timeout;
+        for (;;)
+        {
+            report.missing = 0;
+            for (const auto& node : nodes)
+                report.missing += txs.size() - node->Count();
+            if (report.missing == 0 || Clock::now() > deadline)
+                break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        report.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        stop = true;
+        ticker.join();
+
+        for (const auto& node : nodes)
+        {
+            const TxRelay::Stats s = node->relay.GetStats();
+            report.invBytes += s.invBytes;
+            report.reconBytes += s.reconBytes;
+            report.invsFlooded += s.invsFlooded;
+            report.invsReconciled += s.invsReconciled;
+            report.reconRounds += s.reconRounds;
+            report.reconFailed += s.reconFailed;
+            report.reconDifference += s.reconDifference;
+        }
+        if (!txs.empty() && !edges.empty())
+            report.bytesPerTxPerConnection = (double)(report.invBytes + report.reconBytes) /
+                                             txs.size() / edges.size();
+    }
+
+    for (const auto& node : nodes)
+        node->net.Stop();
+
+    return ok || SetReason(reason, "cannot set up the network: " + error);
+}
+
+bool TxRelaySimulation::Run(const Options& opts, std::vector<Report>& reports, std::string* reason)
+{
+    reports.clear();
+
+    if (opts.nodes < 2 || opts.outbound == 0 || opts.outbound >= opts.nodes)
+        return SetReason(reason, "need at least two nodes and fewer outbound connections than nodes");
+
+    std::mt19937_64 rng(std::random_device{}());
+
+    // Topology: each node connects to `outbound` others it is not
+    // connected to yet (fewer if none are left)
+    std::vector<std::pair<size_t,size_t>> edges;
+    std::set<std::pair<size_t,size_t>> linked;
+    for (size_t i = 0; i < opts.nodes; ++i)
+    {
+        std::vector<size_t> candidates;
+        for (size_t j = 0; j < opts.nodes; ++j)
+            if (j != i && !linked.count(std::make_pair(std::min(i, j), std::max(i, j))))
+                candidates.push_back(j);
+        std::shuffle(candidates.begin(), candidates.end(), rng);
+
+        for (size_t k = 0; k < opts.outbound && k < candidates.size(); ++k)
+        {
+            const size_t j = candidates[k];
+            edges.push_back(std::make_pair(i, j));
+            linked.insert(std::make_pair(std::min(i, j), std::max(i, j)));
+        }
+    }
+
+    // Same transactions from the same origins in both runs
+    std::vector<TransactionRef> txs(opts.txs);
+    std::vector<size_t> origins(opts.txs);
+    for (size_t i = 0; i < opts.txs; ++i)
+    {
+        txs[i] = RandomTransaction(rng);
+        origins[i] = (size_t)(rng() % opts.nodes);
+    }
+
+    for (bool reconcile : { false, true })
+    {
+        Report report;
+        if (!RunOnce(reconcile, edges, txs, origins, opts, report, reason))
+            return false;
+        reports.push_back(report);
+    }
+    return true;
+}
@@ -0,0 +1,409 @@
+#include "v2transport.h"
+#include "../crypto/hash.h"
+#include "../../common/utils/serialize.h"
+
+#include <cstring>
+#include <random>
+
+// BIP324 short message IDs (index = ID; 0 means "command follows")
+static const char* const SHORT_IDS[] =
+{
+    "",
+    "addr", "block", "blocktxn", "cmpctblock", "feefilter", "filteradd", "filterclear",
+    "filterload", "getblocks", "getblocktxn", "getdata", "getheaders", "headers", "inv",
+    "mempool", "merkleblock", "notfound", "ping", "pong", "sendcmpct", "tx", "getcfilters",
+    "cfilter", "getcfheaders", "cfheaders", "getcfcheckpt", "cfcheckpt", "addrv2"
+};
+
+static const size_t SHORT_ID_COUNT = sizeof(SHORT_IDS) / sizeof(SHORT_IDS[0]);
+
+static uint8_t FindShortId(const std::string& command)
+{
+    for (size_t i = 1; i < SHORT_ID_COUNT; ++i)
+        if (command == SHORT_IDS[i])
+            return (uint8_t)i;
+    return 0;
+}
+
+static void RandomBytes(uint8_t* out, size_t len)
+{
+    std::random_device rd;
+    for (size_t i = 0; i < len; i += 4)
+    {
+        const uint32_t r = rd();
+        std::memcpy(out + i, &r, len - i < 4 ? len - i : 4);
+    }
+}
+
+//
+// ================================================================
+//  BIP324Cipher
+// ================================================================
+BIP324Cipher::BIP324Cipher()
+{
+    ourPubKey.fill(0);
+    std::memset(sendTerminator, 0, sizeof(sendTerminator));
+    std::memset(recvTerminator, 0, sizeof(recvTerminator));
+    std::memset(sessionId, 0, sizeof(sessionId));
+}
+
+bool BIP324Cipher::GenerateKey()
+{
+    key = PrivateKey::Generate();
+
+    std::array<uint8_t,32> entropy;
+    RandomBytes(entropy.data(), entropy.size());
+    return EllSwift::Encode(key, entropy, ourPubKey);
+}
+
+bool BIP324Cipher::Initialize(const std::array<uint8_t,64>& theirPubKey, bool initiator, uint32_t magic)
+{
+    std::array<uint8_t,32> secret;
+    if (!EllSwift::ECDH(key, ourPubKey, theirPubKey, initiator, secret))
+        return false;
+
+    // HKDF-SHA256: extract with the network-specific salt, then
+    // one 32-byte expand block per label
+    static const char SALT[] = "bitcoin_v2_shared_secret";
+    std::vector<uint8_t> salt(SALT, SALT + sizeof(SALT) - 1);
+    uint8_t m[4];
+    WriteLE32(m, magic);
+    salt.insert(salt.end(), m, m + 4);
+
+    const std::vector<uint8_t> prk =
+        Hash::HMAC_SHA256(salt, std::vector<uint8_t>(secret.begin(), secret.end()));
+
+    auto Expand = [&prk](const char* label) {
+        std::vector<uint8_t> info(label, label + std::strlen(label));
+        info.push_back(0x01);
+        return Hash::HMAC_SHA256(prk, info);
+    };
+
+    const std::vector<uint8_t> initL = Expand("initiator_L");
+    const std::vector<uint8_t> initP = Expand("initiator_P");
+    const std::vector<uint8_t> respL = Expand("responder_L");
+    const std::vector<uint8_t> respP = Expand("responder_P");
+    const std::vector<uint8_t> terminators = Expand("garbage_terminators");
+    const std::vector<uint8_t> session = Expand("session_id");
+
+    sendL.reset(new FSChaCha20((initiator ? initL : respL).data(), V2_REKEY_INTERVAL));
+    sendP.reset(new FSChaCha20Poly1305((initiator ? initP : respP).data(), V2_REKEY_INTERVAL));
+    recvL.reset(new FSChaCha20((initiator ? respL : initL).data(), V2_REKEY_INTERVAL));
+    recvP.reset(new FSChaCha20Poly1305((initiator ? respP : initP).data(), V2_REKEY_INTERVAL));
+
+    // First half is the initiator's terminator, second the responder's
+    const uint8_t* first = terminators.data();
+    const uint8_t* second = terminators.data() + 32 - V2_GARBAGE_TERMINATOR_LEN;
+    std::memcpy(sendTerminator, initiator ? first : second, V2_GARBAGE_TERMINATOR_LEN);
+    std::memcpy(recvTerminator, initiator ? second : first, V2_GARBAGE_TERMINATOR_LEN);
+    std::memcpy(sessionId, session.data(), 32);
+
+    // The ephemeral key has done its job
+    key = PrivateKey();
+    return true;
+}
+
+void BIP324Cipher::Encrypt(uint8_t* packet, size_t contentsLen, const uint8_t* aad, size_t aadLen, bool ignore)
+{
+    uint8_t length[V2_LENGTH_LEN];
+    length[0] = (uint8_t)contentsLen;
+    length[1] = (uint8_t)(contentsLen >> 8);
+    length[2] = (uint8_t)(contentsLen >> 16);
+    sendL->Crypt(length, packet, V2_LENGTH_LEN);
+
+    uint8_t* body = packet + V2_LENGTH_LEN;
+    body[0] = ignore ? V2_IGNORE_BIT : 0;
+    sendP->Encrypt(body, V2_HEADER_LEN + contentsLen, aad, aadLen, body + V2_HEADER_LEN + contentsLen);
+}
+
+uint32_t BIP324Cipher::DecryptLength(uint8_t* length)
+{
+    recvL->Crypt(length, length, V2_LENGTH_LEN);
+    return (uint32_t)length[0] | ((uint32_t)length[1] << 8) | ((uint32_t)length[2] << 16);
+}
+
+bool BIP324Cipher::Decrypt(uint8_t* packet, size_t contentsLen, const uint8_t* aad, size_t aadLen, bool& ignore)
+{
+    uint8_t* body = packet + V2_LENGTH_LEN;
+    if (!recvP->Decrypt(body, V2_HEADER_LEN + contentsLen, aad, aadLen, body + V2_HEADER_LEN + contentsLen))
+        return false;
+
+    ignore = (body[0] & V2_IGNORE_BIT) != 0;
+    return true;
+}
+
+//
+// ================================================================
+//  V2Transport
+// ================================================================
+V2Transport::V2Transport(bool init, uint32_t m, size_t maxMessageSize)
+{
+    initiator = init;
+    magic = m;
+    maxContents = 1 + MESSAGE_COMMAND_SIZE + maxMessageSize;
+    state = init ? State::KEY : State::DETECT;
+    firstPacket = true;
+    haveLength = false;
+    recvLength = 0;
+    std::memset(commandBuf, 0, sizeof(commandBuf));
+}
+
+bool V2Transport::Start()
+{
+    return SendKey();
+}
+
+bool V2Transport::SendKey()
+{
+    if (!cipher.GenerateKey())
+        return false;
+
+    const std::array<uint8_t,64>& pub = cipher.GetOurPubKey();
+    output.insert(output.end(), pub.begin(), pub.end());
+
+    // Random-length garbage hides the handshake's size signature
+    uint8_t len[2];
+    RandomBytes(len, 2);
+    sentGarbage.resize(ReadLE16(len) % (V2_MAX_GARBAGE_LEN + 1));
+    if (!sentGarbage.empty())
+        RandomBytes(sentGarbage.data(), sentGarbage.size());
+
+    output.insert(output.end(), sentGarbage.begin(), sentGarbage.end());
+    return true;
+}
+
+void V2Transport::SendVersion()
+{
+    const uint8_t* term = cipher.GetSendGarbageTerminator();
+    output.insert(output.end(), term, term + V2_GARBAGE_TERMINATOR_LEN);
+
+    // Empty version packet, authenticating the garbage we sent
+    const size_t at = output.size();
+    output.resize(at + V2_EXPANSION);
+    cipher.Encrypt(&output[at], 0, sentGarbage.data(), sentGarbage.size(), false);
+
+    sentGarbage.clear();
+    sentGarbage.shrink_to_fit();
+}
+
+V2Transport::Event V2Transport::Fail(const char* why)
+{
+    Event ev;
+    ev.kind = Event::FAILED;
+    ev.consume = 0;
+    ev.need = 0;
+    ev.error = why;
+    return ev;
+}
+
+V2Transport::Event V2Transport::Receive(uint8_t* data, size_t size)
+{
+    Event ev;
+    ev.kind = Event::NEED_MORE;
+    ev.consume = 0;
+    ev.need = 0;
+    ev.error = nullptr;
+
+    switch (state)
+    {
+    case State::DETECT:
+    {
+        // v1 starts with magic | "version" | NUL padding
+        uint8_t v1[16] = {0};
+        WriteLE32(v1, magic);
+        std::memcpy(v1 + 4, "version", 7);
+
+        const size_t n = size < 16 ? size : 16;
+        if (std::memcmp(data, v1, n) == 0)
+        {
+            if (n < 16)
+            {
+                ev.need = 16;
+                return ev;
+            }
+            ev.kind = Event::V1;
+            return ev;
+        }
+
+        if (!SendKey())
+            return Fail("cannot create session key");
+
+        state = State::KEY;
+        ev.kind = Event::PROGRESS;
+        return ev;
+    }
+
+    case State::KEY:
+    {
+        if (size < V2_ELLSWIFT_LEN)
+        {
+            ev.need = V2_ELLSWIFT_LEN;
+            return ev;
+        }
+
+        std::array<uint8_t,64> theirs;
+        std::memcpy(theirs.data(), data, V2_ELLSWIFT_LEN);
+        if (!cipher.Initialize(theirs, initiator, magic))
+            return Fail("key exchange failed");
+
+        SendVersion();
+        state = State::GARBAGE;
+        ev.kind = Event::PROGRESS;
+        ev.consume = V2_ELLSWIFT_LEN;
+        return ev;
+    }
+
+    case State::GARBAGE:
+    {
+        const uint8_t* term = cipher.GetRecvGarbageTerminator();
+        const size_t limit = V2_MAX_GARBAGE_LEN + V2_GARBAGE_TERMINATOR_LEN;
+        const size_t scan = size < limit ? size : limit;
+
+        for (size_t i = 0; i + V2_GARBAGE_TERMINATOR_LEN <= scan; ++i)
+        {
+            if (std::memcmp(data + i, term, V2_GARBAGE_TERMINATOR_LEN) == 0)
+            {
+                recvGarbage.assign(data, data + i);
+                state = State::VERSION;
+                ev.kind = Event::PROGRESS;
+                ev.consume = i + V2_GARBAGE_TERMINATOR_LEN;
+                return ev;
+            }
+        }
+
+        if (size >= limit)
+            return Fail("missing garbage terminator");
+
+        ev.need = limit;
+        return ev;
+    }
+
+    case State::VERSION:
+    case State::READY:
+        break;
+    }
+
+    // Packets
+    if (!haveLength)
+    {
+        if (size < V2_LENGTH_LEN)
+        {
+            ev.need = V2_LENGTH_LEN;
+            return ev;
+        }
+
+        recvLength = cipher.DecryptLength(data);
+        haveLength = true;
+        if (recvLength > maxContents)
+            return Fail("oversized packet");
+    }
+
+    const size_t total = V2_EXPANSION + recvLength;
+    if (size < total)
+    {
+        ev.need = total;
+        return ev;
+    }
+
+    // Their garbage is authenticated by the first packet only
+    bool ignore;
+    const bool ok = cipher.Decrypt(data, recvLength, recvGarbage.data(), recvGarbage.size(), ignore);
+    if (firstPacket)
+    {
+        firstPacket = false;
+        recvGarbage.clear();
+        recvGarbage.shrink_to_fit();
+    }
+    if (!ok)
+        return Fail("packet authentication failed");
+
+    haveLength = false;
+    ev.consume = total;
+
+    if (ignore)
+    {
+        ev.kind = Event::PROGRESS;
+        return ev;
+    }
+
+    if (state == State::VERSION)
+    {
+        // Contents are reserved for future extensions
+        state = State::READY;
+        ev.kind = Event::READY;
+        return ev;
+    }
+
+    const uint8_t* contents = data + V2_LENGTH_LEN + V2_HEADER_LEN;
+    if (recvLength == 0)
+        return Fail("empty packet");
+
+    const uint8_t id = contents[0];
+    if (id == 0)
+    {
+        if (recvLength < 1 + MESSAGE_COMMAND_SIZE)
+            return Fail("short command");
+
+        // Printable ASCII, then only NUL padding (as in v1)
+        bool ended = false;
+        for (size_t i = 0; i < MESSAGE_COMMAND_SIZE; ++i)
+        {
+            const uint8_t c = contents[1 + i];
+            if (c == 0)
+                ended = true;
+            else if (ended || c < 0x20 || c > 0x7e)
+                return Fail("malformed command");
+            commandBuf[i] = (char)c;
+        }
+        commandBuf[MESSAGE_COMMAND_SIZE] = 0;
+
+        ev.msg.command = commandBuf;
+        ev.msg.payload = ByteSpan(contents + 1 + MESSAGE_COMMAND_SIZE, recvLength - 1 - MESSAGE_COMMAND_SIZE);
+    }
+    else if (id < SHORT_ID_COUNT)
+    {
+        ev.msg.command = SHORT_IDS[id];
+        ev.msg.payload = ByteSpan(contents + 1, recvLength - 1);
+    }
+    else
+    {
+        // Unknown short IDs are skipped, like unknown commands
+        ev.kind = Event::PROGRESS;
+        return ev;
+    }
+
+    ev.kind = Event::MESSAGE;
+    return ev;
+}
+
+size_t V2Transport::GetPacketSize(const std::string& command, size_t payloadSize) const
+{
+    const size_t cmd = FindShortId(command) ? 1 : 1 + MESSAGE_COMMAND_SIZE;
+    return V2_EXPANSION + cmd + payloadSize;
+}
+
+void V2Transport::EncryptMessage(const std::string& command, ByteSpan payload, uint8_t* out)
+{
+    uint8_t* contents = out + V2_LENGTH_LEN + V2_HEADER_LEN;
+    size_t len;
+
+    const uint8_t id = FindShortId(command);
+    if (id)
+    {
+        contents[0] = id;
+        len = 1;
+    }
+    else
+    {
+        contents[0] = 0;
+        std::memset(contents + 1, 0, MESSAGE_COMMAND_SIZE);
+        std::memcpy(contents + 1, command.data(), command.size());
+        len = 1 + MESSAGE_COMMAND_SIZE;
+    }
+
+    if (payload.size)
+        std::memcpy(contents + len, payload.data, payload.size);
+    len += payload.size;
+
+    cipher.Encrypt(out, len, nullptr, 0, false);
+}
@@ -0,0 +1,183 @@
+#ifndef DRACHMA_NETWORK_V2TRANSPORT_H
+#define DRACHMA_NETWORK_V2TRANSPORT_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "message.h"
+#include "../crypto/chacha20poly1305.h"
+#include "../crypto/ecdsa.h"
+
+//
+// BIP324 v2 transport
+// ---------------------------------------------------------------
+//   handshake  ellswift pubkey (64) | garbage (0..4095) |
+//              garbage terminator (16) | version packet
+//   packet     length (3, FSChaCha20) |
+//              header (1) + contents (FSChaCha20Poly1305) | tag (16)
+//   contents   short message id (1)  | payload, or
+//              0x00 | command (12)   | payload
+//
+static const size_t V2_ELLSWIFT_LEN = 64;
+static const size_t V2_GARBAGE_TERMINATOR_LEN = 16;
+static const size_t V2_MAX_GARBAGE_LEN = 4095;
+static const size_t V2_LENGTH_LEN = 3;
+static const size_t V2_HEADER_LEN = 1;
+static const size_t V2_EXPANSION = V2_LENGTH_LEN + V2_HEADER_LEN + FSChaCha20Poly1305::EXPANSION;
+static const uint32_t V2_REKEY_INTERVAL = 224;
+static const uint8_t V2_IGNORE_BIT = 0x80;
+
+//
+// ===============================================================
+//  CLASS: BIP324Cipher
+// ===============================================================
+//
+//  Session keys from the ECDH secret (HKDF-SHA256, salt
+//  "bitcoin_v2_shared_secret" || network magic) and the four
+//  forward-secure ciphers. Packets are encrypted and decrypted in
+//  place; the caller lays out length | header | contents | tag.
+//
+// ===============================================================
+//
+class BIP324Cipher
+{
+public:
+    BIP324Cipher();
+
+    // Fresh ephemeral key and its encoding
+    bool GenerateKey();
+    const std::array<uint8_t,64>& GetOurPubKey() const { return ourPubKey; }
+
+    // ECDH and key schedule
+    bool Initialize(const std::array<uint8_t,64>& theirPubKey, bool initiator, uint32_t magic);
+    bool IsInitialized() const { return sendP != nullptr; }
+
+    const uint8_t* GetSendGarbageTerminator() const { return sendTerminator; }
+    const uint8_t* GetRecvGarbageTerminator() const { return recvTerminator; }
+    const uint8_t* GetSessionId() const { return sessionId; }
+
+    // `packet` holds contentsLen bytes of plaintext at offset
+    // V2_LENGTH_LEN + V2_HEADER_LEN and room for the tag after it
+    void Encrypt(uint8_t* packet, size_t contentsLen, const uint8_t* aad, size_t aadLen, bool ignore);
+
+    // Decrypts the 3 length bytes in place; returns contents length
+    uint32_t DecryptLength(uint8_t* length);
+
+    // `packet` as produced by Encrypt() with the length already
+    // decrypted; false if the tag does not verify
+    bool Decrypt(uint8_t* packet, size_t contentsLen, const uint8_t* aad, size_t aadLen, bool& ignore);
+
+private:
+    PrivateKey key;
+    std::array<uint8_t,64> ourPubKey;
+
+    std::unique_ptr<FSChaCha20> sendL;
+    std::unique_ptr<FSChaCha20Poly1305> sendP;
+    std::unique_ptr<FSChaCha20> recvL;
+    std::unique_ptr<FSChaCha20Poly1305> recvP;
+
+    uint8_t sendTerminator[V2_GARBAGE_TERMINATOR_LEN];
+    uint8_t recvTerminator[V2_GARBAGE_TERMINATOR_LEN];
+    uint8_t sessionId[32];
+};
+
+//
+// ===============================================================
+//  CLASS: V2Transport
+// ===============================================================
+//
+//  One peer's v2 session, independent of sockets. The reactor
+//  feeds it the receive ring's unread bytes (writable: packets are
+//  decrypted where they lie) and gets back one Event at a time;
+//  handshake bytes to send accumulate in GetOutput().
+//
+//  A responder first looks at 16 bytes: a v1 "version" header
+//  means the peer speaks plaintext and the session yields V1.
+//
+//  Threading: Receive() runs on the reactor thread. Until IsReady()
+//  it also writes the send side, so the caller holds the peer's
+//  send lock around it; afterwards only EncryptMessage() (under the
+//  send lock) touches the send cipher.
+//
+// ===============================================================
+//
+class V2Transport
+{
+public:
+    struct Event
+    {
+        enum Kind
+        {
+            NEED_MORE,      // `need` bytes must be buffered to go on
+            PROGRESS,       // handshake step or decoy: drop `consume`
+            READY,          // version packet received; drop `consume`
+            MESSAGE,        // `msg` points into the buffer; then drop `consume`
+            V1,             // plaintext v1 peer; nothing consumed
+            FAILED          // `error` says why
+        };
+
+        Kind kind;
+        size_t consume;
+        size_t need;
+        NetMessage msg;
+        const char* error;
+    };
+
+    V2Transport(bool initiator, uint32_t magic, size_t maxMessageSize);
+
+    // Initiator: key and garbage, once connected
+    bool Start();
+
+    Event Receive(uint8_t* data, size_t size);
+
+    // Handshake bytes to send before any packet; the caller drains it
+    std::vector<uint8_t>& GetOutput() { return output; }
+
+    bool IsReady() const { return state == State::READY; }
+
+    // Encrypted size of a message
+    size_t GetPacketSize(const std::string& command, size_t payloadSize) const;
+
+    // Writes GetPacketSize() bytes to `out`
+    void EncryptMessage(const std::string& command, ByteSpan payload, uint8_t* out);
+
+    const uint8_t* GetSessionId() const { return cipher.GetSessionId(); }
+
+private:
+    enum class State
+    {
+        DETECT,             // responder: v1 or v2?
+        KEY,                // waiting for their ellswift key
+        GARBAGE,            // scanning for their garbage terminator
+        VERSION,            // waiting for their version packet
+        READY
+    };
+
+    bool SendKey();
+    void SendVersion();
+    Event Fail(const char* why);
+
+    bool initiator;
+    uint32_t magic;
+    size_t maxContents;
+    State state;
+
+    BIP324Cipher cipher;
+    std::vector<uint8_t> output;
+    std::vector<uint8_t> sentGarbage;       // AAD of our version packet
+    std::vector<uint8_t> recvGarbage;       // AAD of their first packet
+    bool firstPacket;
+
+    // Length of the packet at the front, once its length bytes are
+    // decrypted (in place, so they must not be decrypted twice)
+    bool haveLength;
+    uint32_t recvLength;
+
+    char commandBuf[MESSAGE_COMMAND_SIZE + 1];
+};
+
+#endif // DRACHMA_NETWORK_V2TRANSPORT_H
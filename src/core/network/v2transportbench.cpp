@@ -0,0 +1,201 @@
+#include "v2transportbench.h"
+#include "ringbuffer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <random>
+
+typedef std::chrono::steady_clock Clock;
+
+static double SecondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static bool SetReason(std::string* reason, const std::string& text)
+{
+    if (reason)
+        *reason = text;
+    return false;
+}
+
+static const char* const COMMAND = "block";
+
+// Feeds `inbox` to `session` until it needs more bytes
+static bool Pump(V2Transport& session, std::vector<uint8_t>& inbox, std::string* reason)
+{
+    while (!inbox.empty())
+    {
+        const V2Transport::Event ev = session.Receive(inbox.data(), inbox.size());
+        switch (ev.kind)
+        {
+        case V2Transport::Event::NEED_MORE:
+            return true;
+        case V2Transport::Event::PROGRESS:
+        case V2Transport::Event::READY:
+            inbox.erase(inbox.begin(), inbox.begin() + ev.consume);
+            break;
+        case V2Transport::Event::FAILED:
+            return SetReason(reason, std::string("handshake failed: ") + ev.error);
+        default:
+            return SetReason(reason, "unexpected event during the handshake");
+        }
+    }
+    return true;
+}
+
+// Both ends of a session, wired back to back in memory
+static bool Handshake(V2Transport& initiator, V2Transport& responder, std::string* reason)
+{
+    if (!initiator.Start())
+        return SetReason(reason, "cannot start the handshake");
+
+    std::vector<uint8_t> toInitiator;
+    std::vector<uint8_t> toResponder;
+
+    for (int round = 0; round < 16; ++round)
+    {
+        std::vector<uint8_t>& out1 = initiator.GetOutput();
+        toResponder.insert(toResponder.end(), out1.begin(), out1.end());
+        out1.clear();
+
+        std::vector<uint8_t>& out2 = responder.GetOutput();
+        toInitiator.insert(toInitiator.end(), out2.begin(), out2.end());
+        out2.clear();
+
+        if (!Pump(responder, toResponder, reason) || !Pump(initiator, toInitiator, reason))
+            return false;
+
+        if (initiator.IsReady() && responder.IsReady())
+            return true;
+    }
+    return SetReason(reason, "handshake did not complete");
+}
+
+// Sends `count` messages of `payload` through `ring` in ring-sized
+// bursts, timing the two sides apart. `send` writes one message at
+// the ring's write pointer and returns its size; `receive` takes
+// one from the read pointer and returns the bytes consumed, 0 on
+// error.
+template <typename SEND, typename RECEIVE>
+static bool Transfer(RingBuffer& ring, size_t count, size_t wireSize, SEND send, RECEIVE receive,
+                     double& sendSeconds, double& recvSeconds, std::string* reason)
+{
+    const size_t burst = std::max<size_t>(1, ring.Capacity() / wireSize);
+    sendSeconds = 0;
+    recvSeconds = 0;
+
+    while (count > 0)
+    {
+        const size_t n = std::min(count, burst);
+
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < n; ++i)
+            ring.Commit(send(ring.WritePtr()));
+        sendSeconds += SecondsSince(start);
+
+        start = Clock::now();
+        for (size_t i = 0; i < n; ++i)
+        {
+            const size_t consumed = receive(ring.ReadPtr(), ring.Size());
+            if (consumed == 0)
+                return SetReason(reason, "message did not come through");
+            ring.Consume(consumed);
+        }
+        recvSeconds += SecondsSince(start);
+
+        count -= n;
+    }
+    return true;
+}
+
+bool V2TransportBenchmark::Run(const Options& opts, Summary& summary, std::string* reason)
+{
+    summary = Summary();
+
+    if (opts.bytes == 0)
+        return SetReason(reason, "bytes must be set");
+
+    const size_t maxPayload = opts.payloads.empty() ? 0
+                              : *std::max_element(opts.payloads.begin(), opts.payloads.end());
+    if (maxPayload > MAX_PROTOCOL_MESSAGE_LENGTH)
+        return SetReason(reason, "payloads must fit a protocol message");
+
+    V2Transport sender(true, opts.magic, MAX_PROTOCOL_MESSAGE_LENGTH);
+    V2Transport receiver(false, opts.magic, MAX_PROTOCOL_MESSAGE_LENGTH);
+
+    const Clock::time_point start = Clock::now();
+    if (!Handshake(sender, receiver, reason))
+        return false;
+    summary.handshakeMicros = SecondsSince(start) * 1e6;
+
+    std::mt19937_64 rng(std::random_device{}());
+
+    RingBuffer ring;
+    if (!ring.Init(std::max<size_t>(4u << 20, 2 * sender.GetPacketSize(COMMAND, maxPayload))))
+        return SetReason(reason, "cannot map the ring buffer");
+
+    for (size_t size : opts.payloads)
+    {
+        std::vector<uint8_t> payload(size);
+        for (uint8_t& b : payload)
+            b = (uint8_t)rng();
+        const ByteSpan span(payload);
+
+        Report report = Report();
+        report.payload = size;
+        report.messages = std::max<size_t>(1, opts.bytes / std::max<size_t>(1, size));
+        report.plainOverhead = MESSAGE_HEADER_SIZE;
+        report.v2Overhead = sender.GetPacketSize(COMMAND, size) - size;
+
+        const double gigabytes = (double)report.messages * size / 1e9;
+        double sendSeconds;
+        double recvSeconds;
+
+        // v1: checksum on both ends, copies into and out of the ring
+        const uint32_t magic = opts.magic;
+        auto plainSend = [&](uint8_t* out) {
+            BuildMessageHeader(magic, COMMAND, span, out);
+            std::memcpy(out + MESSAGE_HEADER_SIZE, payload.data(), size);
+            return MESSAGE_HEADER_SIZE + size;
+        };
+        auto plainReceive = [&](uint8_t* in, size_t avail) -> size_t {
+            MessageHeader header;
+            if (avail < MESSAGE_HEADER_SIZE || !header.Parse(in) || header.magic != magic ||
+                avail < MESSAGE_HEADER_SIZE + header.length)
+                return 0;
+            if (!VerifyChecksum(header, ByteSpan(in + MESSAGE_HEADER_SIZE, header.length)))
+                return 0;
+            return MESSAGE_HEADER_SIZE + header.length;
+        };
+
+        if (!Transfer(ring, report.messages, MESSAGE_HEADER_SIZE + size, plainSend, plainReceive,
+                      sendSeconds, recvSeconds, reason))
+            return false;
+        report.plainSecPerGB = (sendSeconds + recvSeconds) / gigabytes;
+
+        // v2: encrypted and decrypted in place
+        const size_t packetSize = sender.GetPacketSize(COMMAND, size);
+        auto v2Send = [&](uint8_t* out) {
+            sender.EncryptMessage(COMMAND, span, out);
+            return packetSize;
+        };
+        auto v2Receive = [&](uint8_t* in, size_t avail) -> size_t {
+            const V2Transport::Event ev = receiver.Receive(in, avail);
+            if (ev.kind != V2Transport::Event::MESSAGE || ev.msg.payload.size != size)
+                return 0;
+            return ev.consume;
+        };
+
+        if (!Transfer(ring, report.messages, packetSize, v2Send, v2Receive,
+                      sendSeconds, recvSeconds, reason))
+            return false;
+        report.encryptSecPerGB = sendSeconds / gigabytes;
+        report.decryptSecPerGB = recvSeconds / gigabytes;
+        report.v2SecPerGB = report.encryptSecPerGB + report.decryptSecPerGB;
+
+        summary.sizes.push_back(report);
+    }
+    return true;
+}
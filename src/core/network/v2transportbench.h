@@ -0,0 +1,71 @@
+#ifndef DRACHMA_NETWORK_V2TRANSPORTBENCH_H
+#define DRACHMA_NETWORK_V2TRANSPORTBENCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "v2transport.h"
+
+//
+// ===============================================================
+//  CLASS: V2TransportBenchmark
+// ===============================================================
+//
+//  What encryption costs per byte moved. Two V2Transport sessions
+//  complete a handshake in memory (timed: key generation, ECDH and
+//  the key schedule on both ends), then for every size in
+//  `payloads` messages of that size go through a RingBuffer, the
+//  one the reactor would hand the socket, until `bytes` of payload
+//  have passed, twice:
+//
+//    plaintext – v1 framing: BuildMessageHeader() (the SHA256D
+//                checksum), header and payload copied into the
+//                ring; the receiver parses the header and checks
+//                the checksum
+//    v2        – EncryptMessage() straight into the ring; the
+//                receiver's Receive() decrypts where it lies
+//
+//  Report per size: seconds per GB of payload for each framing
+//  (sender and receiver together, and for v2 each side alone) and
+//  the bytes each adds per message.
+//
+// ===============================================================
+//
+class V2TransportBenchmark
+{
+public:
+    struct Options
+    {
+        std::vector<size_t> payloads;
+        size_t bytes;                   // payload per size and framing
+        uint32_t magic;
+
+        Options()
+            : payloads({64, 512, 4096, 65536, 1000000}), bytes(256u << 20),
+              magic(0xD9B4BEF9) {}
+    };
+
+    struct Report
+    {
+        size_t payload;
+        size_t messages;
+        double plainSecPerGB;
+        double v2SecPerGB;
+        double encryptSecPerGB;         // v2 sender only
+        double decryptSecPerGB;         // v2 receiver only
+        size_t plainOverhead;           // bytes per message on the wire
+        size_t v2Overhead;
+    };
+
+    struct Summary
+    {
+        double handshakeMicros;         // both ends, in memory
+        std::vector<Report> sizes;
+    };
+
+    static bool Run(const Options& opts, Summary& summary, std::string* reason = nullptr);
+};
+
+#endif // DRACHMA_NETWORK_V2TRANSPORTBENCH_H
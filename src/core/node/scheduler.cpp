@@ -0,0 +1,329 @@
+#include "scheduler.h"
+
+#include <algorithm>
+
+// Which scheduler's worker the current thread is, if any
+static thread_local const Scheduler* currentScheduler = nullptr;
+static thread_local unsigned currentWorker = 0;
+
+static uint64_t ElapsedNs(Scheduler::Clock::time_point from, Scheduler::Clock::time_point to)
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count();
+}
+
+//
+// ================================================================
+//  WorkDeque
+// ================================================================
+Scheduler::WorkDeque::WorkDeque()
+{
+    top = 0;
+    bottom = 0;
+    arrays.emplace_back(new Array(64));
+    array = arrays.back().get();
+}
+
+Scheduler::WorkDeque::~WorkDeque()
+{
+}
+
+void Scheduler::WorkDeque::Push(Node* node)
+{
+    const int64_t b = bottom.load(std::memory_order_relaxed);
+    const int64_t t = top.load(std::memory_order_acquire);
+    Array* a = array.load(std::memory_order_relaxed);
+
+    if (b - t > a->capacity - 1)
+    {
+        Array* grown = new Array(a->capacity * 2);
+        for (int64_t i = t; i < b; ++i)
+            grown->Put(i, a->Get(i));
+
+        arrays.emplace_back(grown);
+        array.store(grown, std::memory_order_release);
+        a = grown;
+    }
+
+    a->Put(b, node);
+    bottom.store(b + 1, std::memory_order_release);
+}
+
+Scheduler::Node* Scheduler::WorkDeque::Pop()
+{
+    const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    Array* a = array.load(std::memory_order_relaxed);
+    bottom.store(b);
+
+    int64_t t = top.load();
+    if (t > b)
+    {
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    Node* node = a->Get(b);
+    if (t == b)
+    {
+        // Last one: race the thieves for it
+        if (!top.compare_exchange_strong(t, t + 1))
+            node = nullptr;
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return node;
+}
+
+Scheduler::Node* Scheduler::WorkDeque::Steal()
+{
+    int64_t t = top.load();
+    const int64_t b = bottom.load();
+    if (t >= b)
+        return nullptr;
+
+    Node* node = array.load(std::memory_order_acquire)->Get(t);
+    if (!top.compare_exchange_strong(t, t + 1))
+        return nullptr;
+    return node;
+}
+
+//
+// ================================================================
+//  Scheduler
+// ================================================================
+Scheduler::Scheduler(unsigned n)
+{
+    if (n == 0)
+        n = std::max(1u, std::thread::hardware_concurrency());
+
+    pending = 0;
+    stopping = false;
+
+    for (Counters& c : counters)
+    {
+        c.queued = 0;
+        c.submitted = 0;
+        c.completed = 0;
+        c.stolen = 0;
+        c.waitNs = 0;
+        c.maxWaitNs = 0;
+        c.runNs = 0;
+    }
+
+    for (unsigned i = 0; i < n; ++i)
+        workers.emplace_back(new Worker());
+    for (unsigned i = 0; i < n; ++i)
+        threads.emplace_back(&Scheduler::WorkerLoop, this, i);
+}
+
+Scheduler::~Scheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    workCv.notify_all();
+
+    for (std::thread& t : threads)
+        t.join();
+
+    // Anything scheduled while the workers were leaving
+    while (Node* node = Find(TASK_BACKGROUND))
+        Run(node);
+}
+
+Scheduler& Scheduler::Global()
+{
+    static Scheduler instance;
+    return instance;
+}
+
+void Scheduler::Schedule(TaskClass cls, Task fn)
+{
+    Node* node = new Node();
+    node->fn = std::move(fn);
+    node->group = nullptr;
+    node->cls = cls;
+    Push(node);
+}
+
+void Scheduler::Push(Node* node)
+{
+    Counters& c = counters[node->cls];
+    c.submitted.fetch_add(1, std::memory_order_relaxed);
+
+    // Counted before it is visible, so the counts never go negative
+    c.queued.fetch_add(1);
+    pending.fetch_add(1);
+
+    node->queuedAt = Clock::now();
+
+    if (currentScheduler == this)
+    {
+        workers[currentWorker]->deques[node->cls].Push(node);
+    }
+    else
+    {
+        Injection& q = injection[node->cls];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        q.nodes.push_back(node);
+    }
+
+    // Only workers: a waiting group may not be allowed to run it
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    workCv.notify_one();
+}
+
+Scheduler::Node* Scheduler::Find(TaskClass maxClass)
+{
+    const bool isWorker = currentScheduler == this;
+    const size_t self = isWorker ? currentWorker : 0;
+    const size_t n = workers.size();
+
+    for (size_t cls = 0; cls <= (size_t)maxClass; ++cls)
+    {
+        if (counters[cls].queued.load() <= 0)
+            continue;
+
+        if (isWorker)
+            if (Node* node = workers[self]->deques[cls].Pop())
+                return node;
+
+        {
+            Injection& q = injection[cls];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if (!q.nodes.empty())
+            {
+                Node* node = q.nodes.front();
+                q.nodes.pop_front();
+                return node;
+            }
+        }
+
+        for (size_t k = isWorker ? 1 : 0; k < n; ++k)
+        {
+            if (Node* node = workers[(self + k) % n]->deques[cls].Steal())
+            {
+                counters[cls].stolen.fetch_add(1, std::memory_order_relaxed);
+                return node;
+            }
+        }
+    }
+    return nullptr;
+}
+
+void Scheduler::Run(Node* node)
+{
+    Counters& c = counters[node->cls];
+    c.queued.fetch_sub(1);
+    pending.fetch_sub(1);
+
+    const Clock::time_point start = Clock::now();
+    const uint64_t wait = ElapsedNs(node->queuedAt, start);
+    c.waitNs.fetch_add(wait, std::memory_order_relaxed);
+
+    uint64_t max = c.maxWaitNs.load(std::memory_order_relaxed);
+    while (wait > max && !c.maxWaitNs.compare_exchange_weak(max, wait, std::memory_order_relaxed))
+        ;
+
+    node->fn();
+
+    c.runNs.fetch_add(ElapsedNs(start, Clock::now()), std::memory_order_relaxed);
+    c.completed.fetch_add(1, std::memory_order_relaxed);
+
+    TaskGroup* group = node->group;
+    delete node;
+
+    if (group && group->pending.fetch_sub(1) == 1)
+        NotifyDone();
+}
+
+bool Scheduler::RunOne(TaskClass maxClass)
+{
+    Node* node = Find(maxClass);
+    if (!node)
+        return false;
+
+    Run(node);
+    return true;
+}
+
+void Scheduler::NotifyDone()
+{
+    // Taking the lock orders this with a waiter's predicate check
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    doneCv.notify_all();
+}
+
+void Scheduler::WorkerLoop(unsigned id)
+{
+    currentScheduler = this;
+    currentWorker = id;
+
+    for (;;)
+    {
+        if (RunOne(TASK_BACKGROUND))
+            continue;
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        workCv.wait(lock, [this] { return stopping || pending.load() > 0; });
+        if (stopping && pending.load() <= 0)
+            return;
+    }
+}
+
+Scheduler::Stats Scheduler::GetStats() const
+{
+    Stats s;
+    s.workers = Size();
+
+    for (size_t cls = 0; cls < TASK_CLASSES; ++cls)
+    {
+        const Counters& c = counters[cls];
+        ClassStats& out = s.classes[cls];
+
+        out.queued = (uint64_t)std::max<int64_t>(0, c.queued.load());
+        out.submitted = c.submitted.load();
+        out.completed = c.completed.load();
+        out.stolen = c.stolen.load();
+
+        const uint64_t started = out.submitted - out.queued;
+        out.avgWaitMs = started ? c.waitNs.load() / 1e6 / started : 0;
+        out.maxWaitMs = c.maxWaitNs.load() / 1e6;
+        out.avgRunMs = out.completed ? c.runNs.load() / 1e6 / out.completed : 0;
+    }
+    return s;
+}
+
+//
+// ================================================================
+//  TaskGroup
+// ================================================================
+void TaskGroup::Run(Scheduler::Task fn)
+{
+    pending.fetch_add(1);
+
+    Scheduler::Node* node = new Scheduler::Node();
+    node->fn = std::move(fn);
+    node->group = this;
+    node->cls = cls;
+    scheduler.Push(node);
+}
+
+void TaskGroup::Wait()
+{
+    while (pending.load() > 0)
+    {
+        // Help with work at least as urgent as ours
+        if (scheduler.RunOne(cls))
+            continue;
+
+        // Woken when a group finishes; new work is picked up by the
+        // workers, or by us on the next poll
+        std::unique_lock<std::mutex> lock(scheduler.sleepMutex);
+        scheduler.doneCv.wait_for(lock, std::chrono::milliseconds(1),
+                                  [this] { return pending.load() == 0; });
+    }
+}
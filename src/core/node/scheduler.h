@@ -0,0 +1,253 @@
+#ifndef DRACHMA_NODE_SCHEDULER_H
+#define DRACHMA_NODE_SCHEDULER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class TaskGroup;
+
+//
+// Priority classes, most urgent first. A worker always takes the
+// most urgent task it can find anywhere before a less urgent one.
+//
+enum TaskClass : uint8_t
+{
+    TASK_CONSENSUS  = 0,    // block and transaction validation
+    TASK_RPC        = 1,    // request handling
+    TASK_BACKGROUND = 2,    // rescans, snapshots, index building
+};
+
+static const size_t TASK_CLASSES = 3;
+
+//
+// ===============================================================
+//  CLASS: Scheduler
+// ===============================================================
+//
+//  The node's one pool of worker threads (one per core by
+//  default), shared by every subsystem that wants parallelism, so
+//  that validation, RPC and background jobs do not each bring
+//  their own threads and oversubscribe the machine.
+//
+//  Every worker has a lock-free work-stealing deque per class
+//  (Chase-Lev):
+//
+//    - a task scheduled from a worker goes to the bottom of that
+//      worker's own deque, which it pops LIFO (the data is still
+//      in cache)
+//    - idle workers steal from the top of the others' deques,
+//      FIFO, with one CAS
+//    - tasks from threads outside the pool go through a locked
+//      injection queue per class
+//
+//  Blocking I/O does not belong here (it would hold a worker);
+//  subsystems keep their own threads for that and hand the
+//  computation over.
+//
+//  Waiting is done through TaskGroup::Wait(), which runs queued
+//  tasks of the group's class or more urgent ones instead of
+//  blocking, so groups nest freely. Submit() futures are for
+//  threads outside the pool: a worker blocking on get() holds on
+//  to its deque.
+//
+//  GetStats() reports per class the queue depth, throughput,
+//  steals and the time tasks waited in a queue and ran.
+//
+// ===============================================================
+//
+class Scheduler
+{
+public:
+    typedef std::function<void()> Task;
+    typedef std::chrono::steady_clock Clock;
+
+    struct ClassStats
+    {
+        uint64_t queued;            // waiting now
+        uint64_t submitted;
+        uint64_t completed;
+        uint64_t stolen;            // taken from another worker's deque
+        double avgWaitMs;           // queued until started
+        double maxWaitMs;
+        double avgRunMs;
+    };
+
+    struct Stats
+    {
+        unsigned workers;
+        ClassStats classes[TASK_CLASSES];
+    };
+
+    // threads = 0: one per core
+    explicit Scheduler(unsigned threads = 0);
+
+    // Runs what is still queued, then stops the workers
+    ~Scheduler();
+
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    // The node-wide instance, started on first use
+    static Scheduler& Global();
+
+    unsigned Size() const { return (unsigned)workers.size(); }
+
+    // Fire and forget
+    void Schedule(TaskClass cls, Task fn);
+
+    template <typename F>
+    auto Submit(TaskClass cls, F fn) -> std::future<decltype(fn())>
+    {
+        typedef decltype(fn()) Result;
+
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::move(fn));
+        std::future<Result> result = task->get_future();
+        Schedule(cls, [task] { (*task)(); });
+        return result;
+    }
+
+    Stats GetStats() const;
+
+private:
+    friend class TaskGroup;
+
+    struct Node
+    {
+        Task fn;
+        TaskGroup* group;
+        TaskClass cls;
+        Clock::time_point queuedAt;
+    };
+
+    //
+    // Chase-Lev deque of Node pointers (Le et al., "Correct and
+    // efficient work-stealing for weak memory models"), with
+    // sequentially consistent top/bottom accesses in place of the
+    // paper's fences. Arrays replaced by a grow are kept until the
+    // deque goes, since a thief may still be reading one.
+    //
+    class WorkDeque
+    {
+    public:
+        WorkDeque();
+        ~WorkDeque();
+
+        void Push(Node* node);          // owner
+        Node* Pop();                    // owner
+        Node* Steal();                  // anyone
+
+        bool Empty() const { return bottom.load() <= top.load(); }
+
+    private:
+        struct Array
+        {
+            int64_t capacity;
+            std::unique_ptr<std::atomic<Node*>[]> slots;
+
+            explicit Array(int64_t cap) : capacity(cap), slots(new std::atomic<Node*>[cap]) {}
+
+            Node* Get(int64_t i) const { return slots[i & (capacity - 1)].load(std::memory_order_relaxed); }
+            void Put(int64_t i, Node* n) { slots[i & (capacity - 1)].store(n, std::memory_order_relaxed); }
+        };
+
+        std::atomic<int64_t> top;
+        std::atomic<int64_t> bottom;
+        std::atomic<Array*> array;
+        std::vector<std::unique_ptr<Array>> arrays;     // owner only
+    };
+
+    struct Worker
+    {
+        WorkDeque deques[TASK_CLASSES];
+    };
+
+    struct Injection
+    {
+        std::mutex mutex;
+        std::deque<Node*> nodes;
+    };
+
+    struct Counters
+    {
+        std::atomic<int64_t> queued;
+        std::atomic<uint64_t> submitted;
+        std::atomic<uint64_t> completed;
+        std::atomic<uint64_t> stolen;
+        std::atomic<uint64_t> waitNs;
+        std::atomic<uint64_t> maxWaitNs;
+        std::atomic<uint64_t> runNs;
+    };
+
+    void Push(Node* node);
+
+    // Most urgent task of class <= maxClass, or null
+    Node* Find(TaskClass maxClass);
+
+    void Run(Node* node);
+
+    // Runs one task of class <= maxClass; false if there was none
+    bool RunOne(TaskClass maxClass);
+
+    void WorkerLoop(unsigned id);
+
+    // Wakes the group waiters (one has finished)
+    void NotifyDone();
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+    Injection injection[TASK_CLASSES];
+    Counters counters[TASK_CLASSES];
+
+    std::mutex sleepMutex;
+    std::condition_variable workCv;     // workers: work arrived
+    std::condition_variable doneCv;     // TaskGroup::Wait(): a group finished
+    std::atomic<int64_t> pending;       // queued over all classes
+    bool stopping;
+};
+
+//
+// ===============================================================
+//  CLASS: TaskGroup
+// ===============================================================
+//
+//  Tasks of one class that are waited for together. Tasks may add
+//  more tasks to their own group. Wait() returns once all of them
+//  have run, helping with queued work (of the group's class or
+//  more urgent) meanwhile; the destructor waits too.
+//
+// ===============================================================
+//
+class TaskGroup
+{
+public:
+    explicit TaskGroup(Scheduler& scheduler, TaskClass cls = TASK_CONSENSUS)
+        : scheduler(scheduler), cls(cls), pending(0) {}
+    ~TaskGroup() { Wait(); }
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    void Run(Scheduler::Task fn);
+    void Wait();
+
+    size_t Pending() const { return pending.load(); }
+
+private:
+    friend class Scheduler;
+
+    Scheduler& scheduler;
+    TaskClass cls;
+    std::atomic<size_t> pending;
+};
+
+#endif // DRACHMA_NODE_SCHEDULER_H
@@ -0,0 +1,349 @@
+#include "blockchain.h"
+#include "rpcutil.h"
+#include "../chain/block.h"
+#include "../tx/txview.h"
+
+#include <cstdio>
+#include <cstring>
+#include <unordered_set>
+
+//
+// ================================================================
+//  Parameters
+// ================================================================
+
+// Display order (reversed) in, internal byte order out
+static bool ParseHashParam(const JSONValue* v, const char* name, std::array<uint8_t,32>& out,
+                           RPCError& error)
+{
+    std::vector<uint8_t> bytes;
+    if (!v || !v->IsString() || v->GetStr().size() != 64 || !ParseHex(v->GetStr(), bytes))
+    {
+        error = RPCError(RPC_INVALID_PARAMETER, std::string(name) + " must be a 64-character hex string");
+        return false;
+    }
+
+    for (size_t i = 0; i < 32; ++i)
+        out[i] = bytes[31 - i];
+    return true;
+}
+
+//
+// ================================================================
+//  Output
+// ================================================================
+static void WriteHeaderFields(JSONWriter& out, const BlockHeader& header,
+                              const std::array<uint8_t,32>& hash)
+{
+    char bits[9];
+    std::snprintf(bits, sizeof(bits), "%08x", header.bits);
+
+    out.Key("hash").Hash(hash);
+    out.Key("version").Int(header.version);
+    out.Key("merkleroot").Hash(header.merkleRoot);
+    out.Key("time").UInt(header.time);
+    out.Key("nonce").UInt(header.nonce);
+    out.Key("bits").String(bits, 8);
+    if (!header.IsGenesis())
+        out.Key("previousblockhash").Hash(header.prevHash);
+}
+
+static void WriteTransaction(JSONWriter& out, const TransactionView& tx)
+{
+    out.BeginObject();
+    out.Key("txid").Hash(tx.GetTxid());
+    out.Key("hash").Hash(tx.GetWtxid());
+    out.Key("version").Int(tx.GetVersion());
+    out.Key("size").UInt(tx.GetTotalSize());
+    out.Key("vsize").UInt((tx.GetWeight() + 3) / 4);
+    out.Key("weight").UInt(tx.GetWeight());
+    out.Key("locktime").UInt(tx.GetLockTime());
+
+    const bool coinbase = tx.IsCoinbase();
+
+    out.Key("vin").BeginArray();
+    for (uint32_t i = 0; i < tx.Inputs().size(); ++i)
+    {
+        const TxInView& in = tx.Inputs()[i];
+
+        out.BeginObject();
+        if (coinbase)
+        {
+            out.Key("coinbase").Hex(in.scriptSig);
+        }
+        else
+        {
+            std::array<uint8_t,32> prev;
+            std::memcpy(prev.data(), in.prevTxid, 32);
+            out.Key("txid").Hash(prev);
+            out.Key("vout").UInt(in.prevIndex);
+            out.Key("scriptSig").BeginObject().Key("hex").Hex(in.scriptSig).EndObject();
+        }
+
+        if (in.witnessCount)
+        {
+            out.Key("txinwitness").BeginArray();
+            for (uint32_t w = 0; w < in.witnessCount; ++w)
+                out.Hex(tx.GetWitness(i, w));
+            out.EndArray();
+        }
+
+        out.Key("sequence").UInt(in.sequence);
+        out.EndObject();
+    }
+    out.EndArray();
+
+    out.Key("vout").BeginArray();
+    for (uint32_t n = 0; n < tx.Outputs().size(); ++n)
+    {
+        const TxOutView& o = tx.Outputs()[n];
+
+        out.BeginObject();
+        out.Key("value").Amount(o.amount);
+        out.Key("n").UInt(n);
+        out.Key("scriptPubKey").BeginObject().Key("hex").Hex(o.script).EndObject();
+        out.EndObject();
+    }
+    out.EndArray();
+
+    out.EndObject();
+}
+
+//
+// ================================================================
+//  Calls
+// ================================================================
+static bool GetBlock(const BlockStore& blocks, const JSONValue& params, JSONWriter& out,
+                     RPCError& error)
+{
+    std::array<uint8_t,32> hash;
+    if (!ParseHashParam(Param(params, 0, "blockhash"), "blockhash", hash, error))
+        return false;
+
+    int64_t verbosity = 1;
+    if (const JSONValue* v = Param(params, 1, "verbosity"))
+    {
+        if (v->IsBool())
+            verbosity = v->GetBool() ? 1 : 0;
+        else if (!v->GetInt64(verbosity) || verbosity < 0 || verbosity > 2)
+        {
+            error = RPCError(RPC_INVALID_PARAMETER, "verbosity must be 0, 1 or 2");
+            return false;
+        }
+    }
+
+    ByteSpan raw;
+    if (!blocks.ReadBlock(hash, raw))
+    {
+        error = RPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        return false;
+    }
+
+    // Straight from the mapping, a chunk at a time
+    if (verbosity == 0)
+    {
+        out.Hex(raw);
+        return true;
+    }
+
+    BlockView block;
+    if (!block.Parse(raw))
+    {
+        error = RPCError(RPC_DATABASE_ERROR, "Block data is corrupt");
+        return false;
+    }
+
+    size_t stripped = BlockHeader::SIZE + CompactSizeLen(block.vtx.size());
+    for (const TransactionView& tx : block.vtx)
+        stripped += tx.GetBaseSize();
+
+    out.BeginObject();
+    WriteHeaderFields(out, block.header, hash);
+    out.Key("size").UInt(raw.size);
+    out.Key("strippedsize").UInt(stripped);
+    out.Key("weight").UInt(stripped * 3 + raw.size);
+    out.Key("nTx").UInt(block.vtx.size());
+
+    out.Key("tx").BeginArray();
+    for (const TransactionView& tx : block.vtx)
+    {
+        if (out.Failed())
+            break;                          // client went away
+
+        if (verbosity == 1)
+            out.Hash(tx.GetTxid());
+        else
+            WriteTransaction(out, tx);
+    }
+    out.EndArray();
+
+    out.EndObject();
+    return true;
+}
+
+static bool GetBlockHeader(const BlockStore& blocks, const JSONValue& params, JSONWriter& out,
+                           RPCError& error)
+{
+    std::array<uint8_t,32> hash;
+    if (!ParseHashParam(Param(params, 0, "blockhash"), "blockhash", hash, error))
+        return false;
+
+    ByteSpan raw;
+    BlockHeader header;
+    if (!blocks.ReadBlock(hash, raw) || raw.size < BlockHeader::SIZE || !header.Deserialize(raw.data))
+    {
+        error = RPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        return false;
+    }
+
+    out.BeginObject();
+    WriteHeaderFields(out, header, hash);
+    out.EndObject();
+    return true;
+}
+
+static bool GetTxOut(const UTXOStore& utxo, std::shared_mutex& lock, const JSONValue& params,
+                     JSONWriter& out, RPCError& error)
+{
+    OutPoint point;
+    if (!ParseHashParam(Param(params, 0, "txid"), "txid", point.txid, error))
+        return false;
+
+    int64_t n;
+    const JSONValue* v = Param(params, 1, "n");
+    if (!v || !v->GetInt64(n) || n < 0 || n > 0xffffffffLL)
+    {
+        error = RPCError(RPC_INVALID_PARAMETER, "n must be an output index");
+        return false;
+    }
+    point.index = (uint32_t)n;
+
+    Coin coin;
+    std::array<uint8_t,32> best;
+    bool found;
+    {
+        std::shared_lock<std::shared_mutex> read(lock);
+        found = utxo.GetCoin(point, coin);
+        best = utxo.GetBestBlock();
+    }
+
+    if (!found)
+    {
+        out.Null();
+        return true;
+    }
+
+    out.BeginObject();
+    out.Key("bestblock").Hash(best);
+    out.Key("height").UInt(coin.height);
+    out.Key("value").Amount(coin.amount);
+    out.Key("scriptPubKey").BeginObject().Key("hex").Hex(coin.script).EndObject();
+    out.Key("coinbase").Bool(coin.coinbase);
+    out.EndObject();
+    return true;
+}
+
+static bool ScanTxOutSet(const UTXOStore& utxo, std::shared_mutex& lock, const JSONValue& params,
+                         JSONWriter& out, RPCError& error)
+{
+    const JSONValue* action = Param(params, 0, "action");
+    if (!action || !action->IsString() || action->GetStr() != "start")
+    {
+        error = RPCError(RPC_INVALID_PARAMETER, "action must be \"start\"");
+        return false;
+    }
+
+    const JSONValue* objects = Param(params, 1, "scanobjects");
+    if (!objects || !objects->IsArray() || objects->Size() == 0)
+    {
+        error = RPCError(RPC_INVALID_PARAMETER, "scanobjects must be a non-empty array");
+        return false;
+    }
+
+    // Scripts as byte strings, for one hash lookup per coin
+    std::unordered_set<std::string> scripts;
+    for (size_t i = 0; i < objects->Size(); ++i)
+    {
+        const JSONValue& obj = (*objects)[i];
+        std::string hex = obj.IsString() ? obj.GetStr() : std::string();
+        if (hex.size() > 5 && hex.compare(0, 4, "raw(") == 0 && hex.back() == ')')
+            hex = hex.substr(4, hex.size() - 5);
+
+        std::vector<uint8_t> script;
+        if (hex.empty() || !ParseHex(hex, script))
+        {
+            error = RPCError(RPC_INVALID_PARAMETER, "scan object " + std::to_string(i) +
+                             " is not raw(HEX) or a hex script");
+            return false;
+        }
+        scripts.insert(std::string(script.begin(), script.end()));
+    }
+
+    std::shared_lock<std::shared_mutex> read(lock);
+
+    out.BeginObject();
+    out.Key("success").Bool(true);
+    out.Key("bestblock").Hash(utxo.GetBestBlock());
+
+    // Matches go out as they are found
+    uint64_t scanned = 0;
+    uint64_t matched = 0;
+    int64_t total = 0;
+    std::string key;
+
+    out.Key("unspents").BeginArray();
+    const bool walked = utxo.ForEachCoin([&](const OutPoint& point, const Coin& coin) {
+        scanned++;
+        key.assign(coin.script.begin(), coin.script.end());
+        if (!scripts.count(key))
+            return true;
+
+        matched++;
+        total += coin.amount;
+
+        out.BeginObject();
+        out.Key("txid").Hash(point.txid);
+        out.Key("vout").UInt(point.index);
+        out.Key("scriptPubKey").Hex(coin.script);
+        out.Key("amount").Amount(coin.amount);
+        out.Key("coinbase").Bool(coin.coinbase);
+        out.Key("height").UInt(coin.height);
+        out.EndObject();
+
+        return !out.Failed();
+    });
+    out.EndArray();
+
+    if (!walked && !out.Failed())
+    {
+        error = RPCError(RPC_DATABASE_ERROR, "UTXO set has unflushed changes; retry after the next flush");
+        return false;
+    }
+
+    out.Key("txouts").UInt(scanned);
+    out.Key("matched").UInt(matched);
+    out.Key("total_amount").Amount(total);
+    out.EndObject();
+    return true;
+}
+
+void RegisterBlockchainRPCs(RPCServer& server, const BlockStore& blocks, const UTXOStore& utxo,
+                            std::shared_mutex& utxoLock)
+{
+    const BlockStore* b = &blocks;
+    const UTXOStore* u = &utxo;
+    std::shared_mutex* lock = &utxoLock;
+
+    server.Register("getblock", [b](const JSONValue& params, JSONWriter& out, RPCError& error) {
+        return GetBlock(*b, params, out, error);
+    });
+    server.Register("getblockheader", [b](const JSONValue& params, JSONWriter& out, RPCError& error) {
+        return GetBlockHeader(*b, params, out, error);
+    });
+    server.Register("gettxout", [u, lock](const JSONValue& params, JSONWriter& out, RPCError& error) {
+        return GetTxOut(*u, *lock, params, out, error);
+    });
+    server.Register("scantxoutset", [u, lock](const JSONValue& params, JSONWriter& out, RPCError& error) {
+        return ScanTxOutSet(*u, *lock, params, out, error);
+    });
+}
@@ -0,0 +1,35 @@
+#ifndef DRACHMA_RPC_BLOCKCHAIN_H
+#define DRACHMA_RPC_BLOCKCHAIN_H
+
+#include <shared_mutex>
+
+#include "rpcserver.h"
+#include "../storage/blockstore.h"
+#include "../storage/utxostore.h"
+
+//
+// Block and UTXO set calls
+// ---------------------------------------------------------------
+//   getblock "hash" ( verbosity )    0: hex, 1: txids, 2: decoded
+//                                    transactions
+//   getblockheader "hash"
+//   gettxout "txid" n                null when spent or unknown
+//   scantxoutset "start" [ "raw(HEX)" | "HEX", ... ]
+//                                    coins paying to exactly these
+//                                    scriptPubKeys
+//
+//  Nothing is collected before it is written: getblock parses the
+//  block in place from the BlockStore mapping and emits each
+//  transaction as it goes, scantxoutset emits each match as the
+//  walk over the UTXO set finds it. Both run at the speed the
+//  client reads.
+//
+//  UTXO reads hold `utxoLock` shared; whatever modifies the store
+//  (connecting blocks, flushing) holds it exclusively. A scan
+//  holds it for the whole walk and needs a flushed set (see
+//  UTXOStore::ForEachCoin()).
+//
+void RegisterBlockchainRPCs(RPCServer& server, const BlockStore& blocks, const UTXOStore& utxo,
+                            std::shared_mutex& utxoLock);
+
+#endif // DRACHMA_RPC_BLOCKCHAIN_H
@@ -0,0 +1,411 @@
+#include "jsonvalue.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+//
+// ================================================================
+//  Parser
+// ================================================================
+class JSONValue::Parser
+{
+public:
+    Parser(const char* d, size_t n) : p(d), end(d + n) {}
+
+    bool Document(JSONValue& out, std::string* error)
+    {
+        if (!Value(out, 0))
+            return Fail(error);
+
+        SkipSpace();
+        if (p != end)
+        {
+            why = "trailing data";
+            return Fail(error);
+        }
+        return true;
+    }
+
+private:
+    bool Fail(std::string* error)
+    {
+        if (error)
+            *error = why.empty() ? "malformed JSON" : why;
+        return false;
+    }
+
+    void SkipSpace()
+    {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+            ++p;
+    }
+
+    bool Literal(const char* word, size_t len)
+    {
+        if ((size_t)(end - p) < len || std::memcmp(p, word, len) != 0)
+            return false;
+        p += len;
+        return true;
+    }
+
+    bool Value(JSONValue& out, unsigned depth)
+    {
+        SkipSpace();
+        if (p == end)
+        {
+            why = "unexpected end of input";
+            return false;
+        }
+
+        switch (*p)
+        {
+        case '{':
+            return Object(out, depth + 1);
+        case '[':
+            return Array(out, depth + 1);
+        case '"':
+            out.type = JSTRING;
+            return String(out.str);
+        case 't':
+            out.type = JBOOL;
+            out.boolean = true;
+            return Literal("true", 4);
+        case 'f':
+            out.type = JBOOL;
+            out.boolean = false;
+            return Literal("false", 5);
+        case 'n':
+            out.type = JNULL;
+            return Literal("null", 4);
+        default:
+            out.type = JNUMBER;
+            return Number(out.str);
+        }
+    }
+
+    bool Object(JSONValue& out, unsigned depth)
+    {
+        if (depth > MAX_DEPTH)
+        {
+            why = "nesting too deep";
+            return false;
+        }
+
+        out.type = JOBJECT;
+        ++p;
+        SkipSpace();
+        if (p < end && *p == '}')
+        {
+            ++p;
+            return true;
+        }
+
+        for (;;)
+        {
+            SkipSpace();
+            if (p == end || *p != '"')
+                return false;
+
+            out.keys.emplace_back();
+            if (!String(out.keys.back()))
+                return false;
+
+            SkipSpace();
+            if (p == end || *p != ':')
+                return false;
+            ++p;
+
+            out.values.emplace_back();
+            if (!Value(out.values.back(), depth))
+                return false;
+
+            SkipSpace();
+            if (p == end)
+                return false;
+            if (*p == '}')
+            {
+                ++p;
+                return true;
+            }
+            if (*p != ',')
+                return false;
+            ++p;
+        }
+    }
+
+    bool Array(JSONValue& out, unsigned depth)
+    {
+        if (depth > MAX_DEPTH)
+        {
+            why = "nesting too deep";
+            return false;
+        }
+
+        out.type = JARRAY;
+        ++p;
+        SkipSpace();
+        if (p < end && *p == ']')
+        {
+            ++p;
+            return true;
+        }
+
+        for (;;)
+        {
+            out.values.emplace_back();
+            if (!Value(out.values.back(), depth))
+                return false;
+
+            SkipSpace();
+            if (p == end)
+                return false;
+            if (*p == ']')
+            {
+                ++p;
+                return true;
+            }
+            if (*p != ',')
+                return false;
+            ++p;
+        }
+    }
+
+    bool Hex4(uint32_t& out)
+    {
+        if (end - p < 4)
+            return false;
+
+        out = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            const char c = *p++;
+            out <<= 4;
+            if (c >= '0' && c <= '9') out |= (uint32_t)(c - '0');
+            else if (c >= 'a' && c <= 'f') out |= (uint32_t)(c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F') out |= (uint32_t)(c - 'A' + 10);
+            else return false;
+        }
+        return true;
+    }
+
+    static void AppendUTF8(std::string& out, uint32_t cp)
+    {
+        if (cp < 0x80)
+        {
+            out.push_back((char)cp);
+        }
+        else if (cp < 0x800)
+        {
+            out.push_back((char)(0xC0 | (cp >> 6)));
+            out.push_back((char)(0x80 | (cp & 0x3F)));
+        }
+        else if (cp < 0x10000)
+        {
+            out.push_back((char)(0xE0 | (cp >> 12)));
+            out.push_back((char)(0x80 | ((cp >> 6) & 0x3F)));
+            out.push_back((char)(0x80 | (cp & 0x3F)));
+        }
+        else
+        {
+            out.push_back((char)(0xF0 | (cp >> 18)));
+            out.push_back((char)(0x80 | ((cp >> 12) & 0x3F)));
+            out.push_back((char)(0x80 | ((cp >> 6) & 0x3F)));
+            out.push_back((char)(0x80 | (cp & 0x3F)));
+        }
+    }
+
+    bool String(std::string& out)
+    {
+        ++p;                                // opening quote
+        for (;;)
+        {
+            // Runs without escapes in one append
+            const char* run = p;
+            while (p < end && *p != '"' && *p != '\\' && (unsigned char)*p >= 0x20)
+                ++p;
+            out.append(run, (size_t)(p - run));
+
+            if (p == end || (unsigned char)*p < 0x20)
+            {
+                why = "unterminated string";
+                return false;
+            }
+            if (*p == '"')
+            {
+                ++p;
+                return true;
+            }
+
+            // Escape
+            if (++p == end)
+                return false;
+            const char c = *p++;
+            switch (c)
+            {
+            case '"':  out.push_back('"'); break;
+            case '\\': out.push_back('\\'); break;
+            case '/':  out.push_back('/'); break;
+            case 'b':  out.push_back('\b'); break;
+            case 'f':  out.push_back('\f'); break;
+            case 'n':  out.push_back('\n'); break;
+            case 'r':  out.push_back('\r'); break;
+            case 't':  out.push_back('\t'); break;
+            case 'u':
+            {
+                uint32_t cp;
+                if (!Hex4(cp))
+                    return false;
+
+                // Surrogate pair
+                if (cp >= 0xD800 && cp < 0xDC00)
+                {
+                    uint32_t lo;
+                    if (end - p < 6 || p[0] != '\\' || p[1] != 'u')
+                        return false;
+                    p += 2;
+                    if (!Hex4(lo) || lo < 0xDC00 || lo >= 0xE000)
+                        return false;
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                }
+                else if (cp >= 0xDC00 && cp < 0xE000)
+                {
+                    return false;
+                }
+                AppendUTF8(out, cp);
+                break;
+            }
+            default:
+                why = "bad escape";
+                return false;
+            }
+        }
+    }
+
+    static bool Digit(char c) { return c >= '0' && c <= '9'; }
+
+    bool Number(std::string& out)
+    {
+        const char* start = p;
+
+        if (p < end && *p == '-')
+            ++p;
+
+        if (p == end || !Digit(*p))
+        {
+            why = "unexpected character";
+            return false;
+        }
+        if (*p == '0')
+            ++p;
+        else
+            while (p < end && Digit(*p)) ++p;
+
+        if (p < end && *p == '.')
+        {
+            ++p;
+            if (p == end || !Digit(*p))
+                return false;
+            while (p < end && Digit(*p)) ++p;
+        }
+
+        if (p < end && (*p == 'e' || *p == 'E'))
+        {
+            ++p;
+            if (p < end && (*p == '+' || *p == '-'))
+                ++p;
+            if (p == end || !Digit(*p))
+                return false;
+            while (p < end && Digit(*p)) ++p;
+        }
+
+        out.assign(start, (size_t)(p - start));
+        return true;
+    }
+
+    const char* p;
+    const char* end;
+    std::string why;
+};
+
+bool JSONValue::Parse(const char* data, size_t len, std::string* error)
+{
+    *this = JSONValue();
+    Parser parser(data, len);
+    if (!parser.Document(*this, error))
+    {
+        *this = JSONValue();
+        return false;
+    }
+    return true;
+}
+
+//
+// ================================================================
+//  Access
+// ================================================================
+bool JSONValue::GetInt64(int64_t& out) const
+{
+    if (type != JNUMBER || str.empty())
+        return false;
+
+    // Integral only: no fraction or exponent
+    if (str.find_first_of(".eE") != std::string::npos)
+        return false;
+
+    errno = 0;
+    char* endp = nullptr;
+    long long v = std::strtoll(str.c_str(), &endp, 10);
+    if (errno != 0 || endp != str.c_str() + str.size())
+        return false;
+
+    out = (int64_t)v;
+    return true;
+}
+
+const JSONValue* JSONValue::Find(const char* key) const
+{
+    if (type != JOBJECT)
+        return nullptr;
+
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        if (keys[i] == key)
+            return &values[i];
+    }
+    return nullptr;
+}
+
+void JSONValue::Write(JSONWriter& out) const
+{
+    switch (type)
+    {
+    case JNULL:
+        out.Null();
+        break;
+    case JBOOL:
+        out.Bool(boolean);
+        break;
+    case JNUMBER:
+        out.Raw(str.data(), str.size());
+        break;
+    case JSTRING:
+        out.String(str);
+        break;
+    case JARRAY:
+        out.BeginArray();
+        for (const JSONValue& v : values)
+            v.Write(out);
+        out.EndArray();
+        break;
+    case JOBJECT:
+        out.BeginObject();
+        for (size_t i = 0; i < keys.size(); ++i)
+        {
+            out.Key(keys[i]);
+            values[i].Write(out);
+        }
+        out.EndObject();
+        break;
+    }
+}
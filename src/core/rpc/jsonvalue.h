@@ -0,0 +1,82 @@
+#ifndef DRACHMA_RPC_JSONVALUE_H
+#define DRACHMA_RPC_JSONVALUE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "jsonwriter.h"
+
+//
+// ===============================================================
+//  CLASS: JSONValue
+// ===============================================================
+//
+//  Parsed JSON document, for the request side of the RPC server.
+//  Requests are small (a method name and a few parameters), so
+//  they are read into a tree; results never are, they go through
+//  the streaming JSONWriter.
+//
+//  Numbers keep their source text: GetInt64() range-checks it and
+//  an id echoed back by Write() is byte-for-byte what the client
+//  sent. Object members stay in document order; Find() is a
+//  linear search, which is the right trade at this size.
+//
+//  Parse() is strict RFC 8259 (no comments, no trailing commas)
+//  with a nesting limit, so a hostile request cannot recurse the
+//  stack away.
+//
+// ===============================================================
+//
+class JSONValue
+{
+public:
+    enum Type : uint8_t { JNULL, JBOOL, JNUMBER, JSTRING, JARRAY, JOBJECT };
+
+    static constexpr unsigned MAX_DEPTH = 64;
+
+    JSONValue() : type(JNULL), boolean(false) {}
+
+    // Whole document; false with *error set on malformed input
+    bool Parse(const char* data, size_t len, std::string* error = nullptr);
+
+    Type GetType() const { return type; }
+    bool IsNull() const { return type == JNULL; }
+    bool IsBool() const { return type == JBOOL; }
+    bool IsNumber() const { return type == JNUMBER; }
+    bool IsString() const { return type == JSTRING; }
+    bool IsArray() const { return type == JARRAY; }
+    bool IsObject() const { return type == JOBJECT; }
+
+    bool GetBool() const { return boolean; }
+
+    // Integral number in range; false for anything else
+    bool GetInt64(int64_t& out) const;
+
+    // String contents, or a number's source text
+    const std::string& GetStr() const { return str; }
+
+    // Array elements / object member values
+    size_t Size() const { return values.size(); }
+    const JSONValue& operator[](size_t i) const { return values[i]; }
+
+    // Object member by name; nullptr if absent
+    const JSONValue* Find(const char* key) const;
+
+    const std::vector<std::string>& Keys() const { return keys; }
+
+    void Write(JSONWriter& out) const;
+
+private:
+    class Parser;
+
+    Type type;
+    bool boolean;
+    std::string str;
+    std::vector<std::string> keys;          // objects only, parallel to `values`
+    std::vector<JSONValue> values;
+};
+
+#endif // DRACHMA_RPC_JSONVALUE_H
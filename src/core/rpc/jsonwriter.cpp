@@ -0,0 +1,327 @@
+#include "jsonwriter.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+// Characters that are copied as they are
+static inline bool Plain(unsigned char c)
+{
+    return c >= 0x20 && c != '"' && c != '\\';
+}
+
+JSONWriter::JSONWriter(SinkFn s, size_t chunk)
+    : sink(std::move(s)), chunkSize(chunk ? chunk : 1)
+{
+    buf.reserve(chunkSize + 256);
+    afterKey = false;
+    failed = false;
+    flushed = 0;
+}
+
+bool JSONWriter::Flush()
+{
+    if (failed)
+        return false;
+
+    if (!buf.empty())
+    {
+        if (!sink(buf.data(), buf.size()))
+        {
+            failed = true;
+            buf.clear();
+            return false;
+        }
+        flushed += buf.size();
+        buf.clear();
+    }
+    return true;
+}
+
+void JSONWriter::Separator()
+{
+    if (afterKey)
+    {
+        afterKey = false;
+        return;
+    }
+    if (stack.empty())
+        return;
+
+    if (stack.back())
+        buf.push_back(',');
+    stack.back() = 1;
+}
+
+void JSONWriter::Open(char c)
+{
+    Separator();
+    buf.push_back(c);
+    stack.push_back(0);
+}
+
+void JSONWriter::Close(char c)
+{
+    if (!stack.empty())
+        stack.pop_back();
+    buf.push_back(c);
+    MaybeFlush();
+}
+
+JSONWriter& JSONWriter::BeginObject()
+{
+    if (!failed) Open('{');
+    return *this;
+}
+
+JSONWriter& JSONWriter::EndObject()
+{
+    if (!failed) Close('}');
+    return *this;
+}
+
+JSONWriter& JSONWriter::BeginArray()
+{
+    if (!failed) Open('[');
+    return *this;
+}
+
+JSONWriter& JSONWriter::EndArray()
+{
+    if (!failed) Close(']');
+    return *this;
+}
+
+void JSONWriter::Escape(const char* s, size_t len)
+{
+    buf.push_back('"');
+
+    size_t i = 0;
+    while (i < len)
+    {
+        // Runs of plain characters in one append
+        size_t run = i;
+        while (run < len && Plain((unsigned char)s[run]))
+            ++run;
+        buf.append(s + i, run - i);
+        if (run == len)
+            break;
+
+        const unsigned char c = (unsigned char)s[run];
+        switch (c)
+        {
+        case '"':  buf.append("\\\"", 2); break;
+        case '\\': buf.append("\\\\", 2); break;
+        case '\n': buf.append("\\n", 2); break;
+        case '\r': buf.append("\\r", 2); break;
+        case '\t': buf.append("\\t", 2); break;
+        case '\b': buf.append("\\b", 2); break;
+        case '\f': buf.append("\\f", 2); break;
+        default:
+        {
+            char u[6] = {'\\', 'u', '0', '0', HEX_DIGITS[c >> 4], HEX_DIGITS[c & 15]};
+            buf.append(u, 6);
+        }
+        }
+        i = run + 1;
+    }
+
+    buf.push_back('"');
+}
+
+JSONWriter& JSONWriter::Key(const char* key)
+{
+    return KeyString(key, std::strlen(key));
+}
+
+JSONWriter& JSONWriter::KeyString(const char* key, size_t len)
+{
+    if (failed)
+        return *this;
+
+    Separator();
+    Escape(key, len);
+    buf.push_back(':');
+    afterKey = true;
+    return *this;
+}
+
+JSONWriter& JSONWriter::String(const char* s, size_t len)
+{
+    if (failed)
+        return *this;
+
+    Separator();
+    Escape(s, len);
+    MaybeFlush();
+    return *this;
+}
+
+JSONWriter& JSONWriter::String(const char* s)
+{
+    return String(s, std::strlen(s));
+}
+
+void JSONWriter::Digits(uint64_t v)
+{
+    char tmp[20];
+    size_t n = 0;
+    do
+    {
+        tmp[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    while (n)
+        buf.push_back(tmp[--n]);
+}
+
+JSONWriter& JSONWriter::UInt(uint64_t v)
+{
+    if (failed)
+        return *this;
+
+    Separator();
+    Digits(v);
+    MaybeFlush();
+    return *this;
+}
+
+JSONWriter& JSONWriter::Int(int64_t v)
+{
+    if (failed)
+        return *this;
+
+    Separator();
+    if (v < 0)
+        buf.push_back('-');
+    Digits(v < 0 ? 0 - (uint64_t)v : (uint64_t)v);
+    MaybeFlush();
+    return *this;
+}
+
+JSONWriter& JSONWriter::Double(double v)
+{
+    if (failed)
+        return *this;
+
+    if (!std::isfinite(v))
+        return Null();
+
+    Separator();
+    char tmp[32];
+    int n = std::snprintf(tmp, sizeof(tmp), "%.17g", v);
+    buf.append(tmp, (size_t)n);
+    MaybeFlush();
+    return *this;
+}
+
+JSONWriter& JSONWriter::Bool(bool v)
+{
+    if (failed)
+        return *this;
+
+    Separator();
+    if (v)
+        buf.append("true", 4);
+    else
+        buf.append("false", 5);
+    MaybeFlush();
+    return *this;
+}
+
+JSONWriter& JSONWriter::Null()
+{
+    if (failed)
+        return *this;
+
+    Separator();
+    buf.append("null", 4);
+    MaybeFlush();
+    return *this;
+}
+
+JSONWriter& JSONWriter::Amount(int64_t units)
+{
+    if (failed)
+        return *this;
+
+    Separator();
+
+    uint64_t abs = units < 0 ? 0 - (uint64_t)units : (uint64_t)units;
+    char tmp[32];
+    int n = std::snprintf(tmp, sizeof(tmp), "%s%llu.%08llu", units < 0 ? "-" : "",
+                          (unsigned long long)(abs / 100000000),
+                          (unsigned long long)(abs % 100000000));
+    buf.append(tmp, (size_t)n);
+    MaybeFlush();
+    return *this;
+}
+
+JSONWriter& JSONWriter::Hex(const uint8_t* data, size_t len)
+{
+    if (failed)
+        return *this;
+
+    Separator();
+    buf.push_back('"');
+
+    // Large scripts and raw blocks go out a chunk at a time
+    while (len)
+    {
+        const size_t room = chunkSize > buf.size() ? (chunkSize - buf.size() + 1) / 2 : 1;
+        const size_t n = len < room ? len : room;
+
+        const size_t at = buf.size();
+        buf.resize(at + n * 2);
+        char* out = &buf[at];
+        for (size_t i = 0; i < n; ++i)
+        {
+            out[2 * i] = HEX_DIGITS[data[i] >> 4];
+            out[2 * i + 1] = HEX_DIGITS[data[i] & 15];
+        }
+
+        data += n;
+        len -= n;
+        if (len && !Flush())
+            return *this;
+    }
+
+    buf.push_back('"');
+    MaybeFlush();
+    return *this;
+}
+
+JSONWriter& JSONWriter::Hash(const std::array<uint8_t,32>& hash)
+{
+    if (failed)
+        return *this;
+
+    Separator();
+
+    char out[66];
+    out[0] = '"';
+    for (size_t i = 0; i < 32; ++i)
+    {
+        const uint8_t b = hash[31 - i];
+        out[1 + 2 * i] = HEX_DIGITS[b >> 4];
+        out[2 + 2 * i] = HEX_DIGITS[b & 15];
+    }
+    out[65] = '"';
+    buf.append(out, sizeof(out));
+
+    MaybeFlush();
+    return *this;
+}
+
+JSONWriter& JSONWriter::Raw(const char* json, size_t len)
+{
+    if (failed)
+        return *this;
+
+    Separator();
+    buf.append(json, len);
+    MaybeFlush();
+    return *this;
+}
@@ -0,0 +1,120 @@
+#ifndef DRACHMA_RPC_JSONWRITER_H
+#define DRACHMA_RPC_JSONWRITER_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "../../common/utils/span.h"
+
+//
+// ===============================================================
+//  CLASS: JSONWriter
+// ===============================================================
+//
+//  Streaming JSON serializer. Values are appended to a buffer that
+//  is handed to the SinkFn whenever it grows past `chunkSize`, so
+//  a block or a UTXO scan goes out while it is being produced and
+//  memory stays at one chunk whatever the size of the document.
+//
+//  Commas and the nesting are tracked here; the caller only says
+//  what comes next:
+//
+//    w.BeginObject().Key("hash").Hash(h).Key("tx").BeginArray();
+//    for (...) w.Hex(raw);
+//    w.EndArray().EndObject();
+//    w.Flush();
+//
+//  Strings are escaped on the way in; bytes come out as hex
+//  without an intermediate std::string, hashes in the reversed
+//  display order. Amounts are written as fixed-point coins with
+//  eight decimals, never through a double.
+//
+//  A sink returning false (the client went away) fails the writer:
+//  later calls are no-ops and Failed() tells the producer it can
+//  stop. Nothing is flushed on destruction; unflushed output of
+//  an abandoned document is simply dropped.
+//
+//  Not thread-safe.
+//
+// ===============================================================
+//
+class JSONWriter
+{
+public:
+    typedef std::function<bool(const char* data, size_t len)> SinkFn;
+
+    explicit JSONWriter(SinkFn sink, size_t chunkSize = 64 * 1024);
+
+    JSONWriter(const JSONWriter&) = delete;
+    JSONWriter& operator=(const JSONWriter&) = delete;
+
+    JSONWriter& BeginObject();
+    JSONWriter& EndObject();
+    JSONWriter& BeginArray();
+    JSONWriter& EndArray();
+
+    // Object member name; the value follows
+    JSONWriter& Key(const char* key);
+    JSONWriter& Key(const std::string& key) { return KeyString(key.data(), key.size()); }
+
+    JSONWriter& String(const char* s, size_t len);
+    JSONWriter& String(const char* s);
+    JSONWriter& String(const std::string& s) { return String(s.data(), s.size()); }
+    JSONWriter& Int(int64_t v);
+    JSONWriter& UInt(uint64_t v);
+    JSONWriter& Double(double v);               // non-finite: null
+    JSONWriter& Bool(bool v);
+    JSONWriter& Null();
+
+    // 123456789 -> 1.23456789
+    JSONWriter& Amount(int64_t units);
+
+    // Bytes as lowercase hex, in order
+    JSONWriter& Hex(const uint8_t* data, size_t len);
+    JSONWriter& Hex(ByteSpan data) { return Hex(data.data, data.size); }
+    JSONWriter& Hex(const std::vector<uint8_t>& data) { return Hex(data.data(), data.size()); }
+
+    // Internal byte order in, display (reversed) order out
+    JSONWriter& Hash(const std::array<uint8_t,32>& hash);
+
+    // Already serialized JSON value, copied verbatim
+    JSONWriter& Raw(const char* json, size_t len);
+
+    // Hands everything buffered to the sink
+    bool Flush();
+
+    bool Failed() const { return failed; }
+
+    // Handed to the sink so far
+    uint64_t BytesFlushed() const { return flushed; }
+
+    // Open objects and arrays
+    size_t Depth() const { return stack.size(); }
+
+private:
+    JSONWriter& KeyString(const char* key, size_t len);
+
+    // Comma before a value or key where one is due
+    void Separator();
+    void Open(char c);
+    void Close(char c);
+    void Escape(const char* s, size_t len);
+    void Digits(uint64_t v);
+    void MaybeFlush() { if (buf.size() >= chunkSize) Flush(); }
+
+    SinkFn sink;
+    size_t chunkSize;
+    std::string buf;
+
+    // Per level: 0 = nothing written yet, 1 = need a comma
+    std::vector<uint8_t> stack;
+    bool afterKey;
+    bool failed;
+    uint64_t flushed;
+};
+
+#endif // DRACHMA_RPC_JSONWRITER_H
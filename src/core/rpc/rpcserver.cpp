@@ -0,0 +1,1356 @@
+#include "rpcserver.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <strings.h>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+static const int MAX_EVENTS = 256;
+static const size_t MAX_IOV = 64;
+static const size_t READ_SIZE = 64 * 1024;
+
+static bool SetError(std::string* error, const std::string& what)
+{
+    if (error)
+        *error = what + ": " + std::strerror(errno);
+    return false;
+}
+
+static bool ResolveNumeric(const std::string& address, uint16_t port,
+                           sockaddr_storage& out, socklen_t& len)
+{
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+
+    addrinfo* res = nullptr;
+    if (getaddrinfo(address.c_str(), std::to_string(port).c_str(), &hints, &res) != 0 || !res)
+        return false;
+
+    std::memcpy(&out, res->ai_addr, res->ai_addrlen);
+    len = res->ai_addrlen;
+    freeaddrinfo(res);
+    return true;
+}
+
+static std::string EncodeBase64(const std::string& in)
+{
+    static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    std::string out;
+    out.reserve((in.size() + 2) / 3 * 4);
+
+    size_t i = 0;
+    for (; i + 2 < in.size(); i += 3)
+    {
+        const uint32_t v = ((uint8_t)in[i] << 16) | ((uint8_t)in[i + 1] << 8) | (uint8_t)in[i + 2];
+        out.push_back(table[v >> 18]);
+        out.push_back(table[(v >> 12) & 63]);
+        out.push_back(table[(v >> 6) & 63]);
+        out.push_back(table[v & 63]);
+    }
+    if (i < in.size())
+    {
+        uint32_t v = (uint8_t)in[i] << 16;
+        if (i + 1 < in.size())
+            v |= (uint8_t)in[i + 1] << 8;
+        out.push_back(table[v >> 18]);
+        out.push_back(table[(v >> 12) & 63]);
+        out.push_back(i + 1 < in.size() ? table[(v >> 6) & 63] : '=');
+        out.push_back('=');
+    }
+    return out;
+}
+
+// Compare without leaking the position of the first difference
+static bool TimingSafeEqual(const std::string& a, const std::string& b)
+{
+    if (a.size() != b.size())
+        return false;
+
+    uint8_t diff = 0;
+    for (size_t i = 0; i < a.size(); ++i)
+        diff |= (uint8_t)(a[i] ^ b[i]);
+    return diff == 0;
+}
+
+static const char* StatusText(int status)
+{
+    switch (status)
+    {
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 411: return "Length Required";
+    case 413: return "Payload Too Large";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 503: return "Service Unavailable";
+    default:  return "Error";
+    }
+}
+
+// Core's mapping of a failed single call onto the HTTP status
+static int HTTPStatus(const RPCError& error)
+{
+    if (error.code == RPC_INVALID_REQUEST)
+        return 400;
+    if (error.code == RPC_METHOD_NOT_FOUND)
+        return 404;
+    return 500;
+}
+
+// `length` < 0: no Content-Length (chunked or close-delimited)
+static std::string Head(int status, int64_t length, bool chunked, bool keepAlive,
+                        const char* extraHeaders = "")
+{
+    char line[64];
+    std::snprintf(line, sizeof(line), "HTTP/1.1 %d %s\r\n", status, StatusText(status));
+
+    std::string head(line);
+    head += "Content-Type: application/json\r\n";
+    if (length >= 0)
+        head += "Content-Length: " + std::to_string(length) + "\r\n";
+    if (chunked)
+        head += "Transfer-Encoding: chunked\r\n";
+    head += keepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+    head += extraHeaders;
+    head += "\r\n";
+    return head;
+}
+
+//
+// ================================================================
+//  Response – the body of one HTTP response, as it is produced
+// ================================================================
+//
+//  Bytes collect until a chunk is full. If the response ends
+//  before that it goes out in one piece with a Content-Length;
+//  otherwise the status line goes out with the first chunk and the
+//  rest follows chunked (HTTP/1.0: until the connection closes).
+//
+class RPCServer::Response
+{
+public:
+    Response(RPCServer& s, const ConnRef& c, const Request& req)
+        : server(s), conn(c), http10(req.http10), keepAlive(req.keepAlive)
+    {
+        headerSent = false;
+        chunked = false;
+        failed = false;
+    }
+
+    bool Write(const char* data, size_t len)
+    {
+        if (failed)
+            return false;
+
+        pending.append(data, len);
+        if (pending.size() >= server.opts.chunkSize)
+            return SendPending();
+        return true;
+    }
+
+    JSONWriter::SinkFn Sink()
+    {
+        return [this](const char* data, size_t len) { return Write(data, len); };
+    }
+
+    bool Started() const { return headerSent; }
+
+    bool End(int status)
+    {
+        if (failed)
+            return false;
+
+        std::string msg;
+        if (!headerSent)
+        {
+            msg = Head(status, (int64_t)pending.size(), false, keepAlive);
+            msg += pending;
+        }
+        else if (chunked)
+        {
+            AppendChunk(msg);
+            msg += "0\r\n\r\n";
+        }
+        else
+        {
+            msg.swap(pending);
+        }
+        pending.clear();
+
+        return server.Enqueue(conn, std::move(msg), true, !keepAlive, true);
+    }
+
+    // The status line is gone; all the client can be told is that
+    // the response is incomplete
+    void Abort()
+    {
+        failed = true;
+        server.Enqueue(conn, std::string(), true, true, false);
+    }
+
+private:
+    void AppendChunk(std::string& msg)
+    {
+        if (pending.empty())
+            return;
+
+        char size[20];
+        int n = std::snprintf(size, sizeof(size), "%zx\r\n", pending.size());
+        msg.append(size, (size_t)n);
+        msg += pending;
+        msg += "\r\n";
+    }
+
+    bool SendPending()
+    {
+        std::string msg;
+        if (!headerSent)
+        {
+            headerSent = true;
+            chunked = !http10;
+            if (http10)
+                keepAlive = false;
+            msg = Head(200, -1, chunked, keepAlive);
+            server.statStreamed++;
+        }
+
+        if (chunked)
+            AppendChunk(msg);
+        else
+            msg += pending;
+        pending.clear();
+
+        if (!server.Enqueue(conn, std::move(msg), false, false, true))
+            failed = true;
+        return !failed;
+    }
+
+    RPCServer& server;
+    ConnRef conn;
+    bool http10;
+    bool keepAlive;
+    bool headerSent;
+    bool chunked;
+    bool failed;
+    std::string pending;
+};
+
+//
+// One batch request: calls run in parallel, results wait in
+// `results` until every call before them has been sent
+//
+struct RPCServer::Batch
+{
+    ConnRef conn;
+    std::shared_ptr<Request> req;
+    std::shared_ptr<JSONValue> doc;
+    std::unique_ptr<Response> response;
+
+    std::mutex mutex;
+    std::vector<std::string> results;
+    std::vector<uint8_t> ready;
+    size_t next;                        // first result not sent
+    bool emitting;                      // a task is sending results
+};
+
+RPCServer::RPCServer(Scheduler& sched, const Options& o)
+    : scheduler(sched), opts(o)
+{
+    if (opts.chunkSize == 0)
+        opts.chunkSize = 1;
+    if (opts.maxBlockedWriters == 0)
+        opts.maxBlockedWriters = std::max(1u, scheduler.Size() / 4);
+    if (!opts.auth.empty())
+        authHeader = "Basic " + EncodeBase64(opts.auth);
+
+    listenFd = -1;
+    listenPort = 0;
+    epfd = -1;
+    wakefd = -1;
+    running = false;
+    nextId = 1;
+    inFlight = 0;
+    blockedWriters = 0;
+
+    statConnections = 0;
+    statAccepted = 0;
+    statRejected = 0;
+    statRequests = 0;
+    statCalls = 0;
+    statBatches = 0;
+    statOverloaded = 0;
+    statUnauthorized = 0;
+    statStreamed = 0;
+    statCut = 0;
+    statBytesIn = 0;
+    statBytesOut = 0;
+
+    Register("getrpcinfo", [this](const JSONValue& params, JSONWriter& out, RPCError& error) {
+        return GetRPCInfo(params, out, error);
+    });
+}
+
+RPCServer::~RPCServer()
+{
+    Stop();
+
+    if (listenFd >= 0)
+        close(listenFd);
+}
+
+void RPCServer::Register(const std::string& name, RPCMethod fn)
+{
+    std::unique_ptr<Method> m(new Method());
+    m->fn = std::move(fn);
+    m->calls = 0;
+    m->errors = 0;
+    m->micros = 0;
+    m->maxMicros = 0;
+    methods[name] = std::move(m);
+}
+
+bool RPCServer::Listen(const std::string& address, uint16_t port, std::string* error)
+{
+    sockaddr_storage addr;
+    socklen_t len;
+    if (!ResolveNumeric(address, port, addr, len))
+    {
+        if (error) *error = "bad listen address " + address;
+        return false;
+    }
+
+    int fd = socket(addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return SetError(error, "socket");
+
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    if (bind(fd, (sockaddr*)&addr, len) != 0 || listen(fd, opts.backlog) != 0)
+    {
+        SetError(error, "bind/listen " + address + ":" + std::to_string(port));
+        close(fd);
+        return false;
+    }
+
+    // Port 0 picks an ephemeral port
+    sockaddr_storage bound;
+    socklen_t boundLen = sizeof(bound);
+    getsockname(fd, (sockaddr*)&bound, &boundLen);
+    listenPort = ntohs(bound.ss_family == AF_INET6 ? ((sockaddr_in6*)&bound)->sin6_port
+                                                   : ((sockaddr_in*)&bound)->sin_port);
+
+    listenFd = fd;
+    return true;
+}
+
+bool RPCServer::Start(std::string* error)
+{
+    if (running)
+        return true;
+
+    if (listenFd < 0)
+    {
+        if (error) *error = "not listening";
+        return false;
+    }
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epfd < 0 || wakefd < 0)
+    {
+        SetError(error, "epoll/eventfd");
+        if (epfd >= 0) close(epfd);
+        if (wakefd >= 0) close(wakefd);
+        epfd = wakefd = -1;
+        return false;
+    }
+
+    // data.ptr: nullptr = wakeup, this = listener, else a Conn
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, wakefd, &ev);
+
+    ev.events = EPOLLIN;
+    ev.data.ptr = this;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, listenFd, &ev);
+
+    started = Clock::now();
+    running = true;
+    thread = std::thread(&RPCServer::Run, this);
+    return true;
+}
+
+void RPCServer::Stop()
+{
+    if (!running.exchange(false))
+        return;
+
+    uint64_t one = 1;
+    ssize_t r = write(wakefd, &one, sizeof(one));
+    (void)r;
+    thread.join();
+
+    // Workers still writing see their connection closed
+    std::vector<ConnRef> open;
+    for (auto& entry : conns)
+        open.push_back(entry.second);
+    for (const ConnRef& conn : open)
+        CloseConn(conn.get());
+    graveyard.clear();
+
+    {
+        std::unique_lock<std::mutex> lock(idleMutex);
+        idleCv.wait(lock, [this] { return inFlight == 0; });
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        pending.clear();
+    }
+
+    close(epfd);
+    close(wakefd);
+    epfd = wakefd = -1;
+}
+
+RPCServer::Stats RPCServer::GetStats() const
+{
+    Stats s;
+    s.connections = statConnections;
+    s.accepted = statAccepted;
+    s.rejected = statRejected;
+    s.requests = statRequests;
+    s.calls = statCalls;
+    s.batches = statBatches;
+    s.overloaded = statOverloaded;
+    s.unauthorized = statUnauthorized;
+    s.streamed = statStreamed;
+    s.cut = statCut;
+    s.bytesIn = statBytesIn;
+    s.bytesOut = statBytesOut;
+    s.seconds = running ? std::chrono::duration<double>(Clock::now() - started).count() : 0;
+
+    for (auto& entry : methods)
+    {
+        const Method& m = *entry.second;
+
+        MethodStats ms;
+        ms.name = entry.first;
+        ms.calls = m.calls;
+        ms.errors = m.errors;
+        ms.avgMs = ms.calls ? m.micros / 1000.0 / ms.calls : 0;
+        ms.maxMs = m.maxMicros / 1000.0;
+        s.methods.push_back(ms);
+    }
+    return s;
+}
+
+//
+// ================================================================
+//  Event loop
+// ================================================================
+void RPCServer::Run()
+{
+    epoll_event events[MAX_EVENTS];
+    Clock::time_point lastSweep = Clock::now();
+
+    while (running)
+    {
+        int n = epoll_wait(epfd, events, MAX_EVENTS, 1000);
+        if (n < 0 && errno != EINTR)
+            break;
+
+        for (int i = 0; i < n; ++i)
+        {
+            void* ptr = events[i].data.ptr;
+            const uint32_t ev = events[i].events;
+
+            if (ptr == nullptr)
+            {
+                uint64_t value;
+                while (read(wakefd, &value, sizeof(value)) > 0) {}
+                continue;
+            }
+
+            if (ptr == this)
+            {
+                AcceptAll();
+                continue;
+            }
+
+            Conn* conn = static_cast<Conn*>(ptr);
+            if (conn->fd < 0)
+                continue;                   // closed earlier in this batch
+
+            if (ev & (EPOLLIN | EPOLLERR | EPOLLHUP | EPOLLRDHUP))
+                ReadConn(conn);
+
+            if ((ev & EPOLLOUT) && conn->fd >= 0)
+                FlushConn(conn);
+        }
+
+        ProcessPending();
+
+        Clock::time_point now = Clock::now();
+        if (now - lastSweep >= std::chrono::seconds(1))
+        {
+            SweepIdle(now);
+            lastSweep = now;
+        }
+
+        graveyard.clear();
+    }
+}
+
+void RPCServer::ProcessPending()
+{
+    std::vector<ConnRef> flush;
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        flush.swap(pending);
+    }
+
+    for (const ConnRef& conn : flush)
+    {
+        if (conn->fd >= 0)
+            FlushConn(conn.get());
+    }
+}
+
+void RPCServer::Post(const ConnRef& conn)
+{
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        pending.push_back(conn);
+    }
+
+    uint64_t one = 1;
+    ssize_t r = write(wakefd, &one, sizeof(one));
+    (void)r;
+}
+
+void RPCServer::AcceptAll()
+{
+    for (;;)
+    {
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;                          // EAGAIN, or out of descriptors
+        }
+
+        if (conns.size() >= opts.maxConnections)
+        {
+            close(fd);
+            statRejected++;
+            continue;
+        }
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        ConnRef conn = std::make_shared<Conn>();
+        conn->id = nextId++;
+        conn->fd = fd;
+        conn->busy = false;
+        conn->eof = false;
+        conn->continued = false;
+        conn->lastActive = Clock::now();
+        conn->outOffset = 0;
+        conn->outBytes = 0;
+        conn->flushPosted = false;
+        conn->done = false;
+        conn->closeAfter = false;
+        conn->closed = false;
+
+        epoll_event ev;
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = conn.get();
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) != 0)
+        {
+            close(fd);
+            continue;
+        }
+
+        conns[conn->id] = conn;
+        statAccepted++;
+        statConnections++;
+    }
+}
+
+void RPCServer::CloseConn(Conn* conn)
+{
+    if (conn->fd < 0)
+        return;
+
+    epoll_ctl(epfd, EPOLL_CTL_DEL, conn->fd, nullptr);
+    close(conn->fd);
+    conn->fd = -1;
+
+    {
+        std::lock_guard<std::mutex> lock(conn->mutex);
+        conn->closed = true;
+        conn->out.clear();
+        conn->outBytes = 0;
+        conn->drained.notify_all();
+    }
+
+    // Epoll events already fetched may still point at it
+    auto it = conns.find(conn->id);
+    if (it != conns.end())
+    {
+        graveyard.push_back(it->second);
+        conns.erase(it);
+    }
+    statConnections--;
+}
+
+void RPCServer::SweepIdle(Clock::time_point now)
+{
+    std::vector<Conn*> idle;
+    for (auto& entry : conns)
+    {
+        Conn* conn = entry.second.get();
+        if (now - conn->lastActive <= opts.idleTimeout)
+            continue;
+
+        // A busy connection counts as idle only while its client has
+        // stopped reading: a worker is waiting on it
+        bool stalled = false;
+        if (conn->busy)
+        {
+            std::lock_guard<std::mutex> lock(conn->mutex);
+            stalled = conn->outBytes > 0;
+        }
+        if (!conn->busy || stalled)
+            idle.push_back(conn);
+    }
+
+    for (Conn* conn : idle)
+        CloseConn(conn);
+}
+
+void RPCServer::ReadConn(Conn* conn)
+{
+    char buf[READ_SIZE];
+
+    // Edge-triggered: read until the socket is drained
+    for (;;)
+    {
+        ssize_t r = read(conn->fd, buf, sizeof(buf));
+        if (r > 0)
+        {
+            conn->in.append(buf, (size_t)r);
+            statBytesIn += (uint64_t)r;
+
+            // Pipelined requests wait while one is answered, but
+            // only up to one more full request
+            if (conn->in.size() > opts.maxHeaderSize + opts.maxBodySize)
+            {
+                CloseConn(conn);
+                return;
+            }
+            continue;
+        }
+
+        if (r == 0)
+        {
+            conn->eof = true;
+            break;
+        }
+
+        if (errno == EINTR)
+            continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            break;
+
+        CloseConn(conn);
+        return;
+    }
+
+    conn->lastActive = Clock::now();
+
+    if (!conn->busy)
+    {
+        NextRequest(conn);
+        if (!conn->busy && conn->eof)
+            CloseConn(conn);
+    }
+}
+
+void RPCServer::FlushConn(Conn* conn)
+{
+    bool finished = false;
+    bool closeNow = false;
+    bool broken = false;
+
+    {
+        std::lock_guard<std::mutex> lock(conn->mutex);
+        conn->flushPosted = false;
+
+        while (!conn->out.empty())
+        {
+            iovec iov[MAX_IOV];
+            size_t count = 0;
+            for (auto it = conn->out.begin(); it != conn->out.end() && count < MAX_IOV; ++it, ++count)
+            {
+                const size_t skip = count == 0 ? conn->outOffset : 0;
+                iov[count].iov_base = (void*)(it->data() + skip);
+                iov[count].iov_len = it->size() - skip;
+            }
+
+            msghdr msg;
+            std::memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iov;
+            msg.msg_iovlen = count;
+
+            ssize_t n = sendmsg(conn->fd, &msg, MSG_NOSIGNAL);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                    broken = true;
+                break;                      // EPOLLOUT resumes
+            }
+
+            statBytesOut += (uint64_t)n;
+            conn->outBytes -= (size_t)n;
+            conn->lastActive = Clock::now();
+
+            size_t left = (size_t)n;
+            while (left)
+            {
+                const size_t avail = conn->out.front().size() - conn->outOffset;
+                if (left < avail)
+                {
+                    conn->outOffset += left;
+                    break;
+                }
+                left -= avail;
+                conn->out.pop_front();
+                conn->outOffset = 0;
+            }
+        }
+
+        if (conn->outBytes <= opts.maxSendBuffer)
+            conn->drained.notify_all();
+
+        if (conn->out.empty() && conn->done)
+        {
+            conn->done = false;
+            finished = true;
+            closeNow = conn->closeAfter;
+            conn->closeAfter = false;
+        }
+    }
+
+    if (broken)
+    {
+        CloseConn(conn);
+        return;
+    }
+
+    if (!finished)
+        return;
+
+    if (closeNow || conn->eof)
+    {
+        CloseConn(conn);
+        return;
+    }
+
+    // Response out: on to the next pipelined request
+    conn->busy = false;
+    conn->continued = false;
+    conn->lastActive = Clock::now();
+    NextRequest(conn);
+}
+
+bool RPCServer::Enqueue(const ConnRef& conn, std::string data, bool last, bool close, bool wait)
+{
+    bool post = false;
+    {
+        std::unique_lock<std::mutex> lock(conn->mutex);
+
+        if (wait && !conn->closed && conn->outBytes > opts.maxSendBuffer)
+        {
+            if (blockedWriters.fetch_add(1) >= opts.maxBlockedWriters)
+            {
+                // Every wait is taken: drop what the client did not
+                // read and have the loop close the connection
+                blockedWriters--;
+                statCut++;
+
+                conn->out.clear();
+                conn->outOffset = 0;
+                conn->outBytes = 0;
+                conn->done = true;
+                conn->closeAfter = true;
+
+                post = !conn->flushPosted;
+                conn->flushPosted = true;
+                lock.unlock();
+
+                if (post)
+                    Post(conn);
+                return false;
+            }
+
+            conn->drained.wait(lock, [&] {
+                return conn->closed || conn->outBytes <= opts.maxSendBuffer;
+            });
+            blockedWriters--;
+        }
+        if (conn->closed)
+            return false;
+
+        if (!data.empty())
+        {
+            conn->outBytes += data.size();
+            conn->out.push_back(std::move(data));
+        }
+        if (last)
+        {
+            conn->done = true;
+            conn->closeAfter = close;
+        }
+
+        if (!conn->flushPosted)
+        {
+            conn->flushPosted = true;
+            post = true;
+        }
+    }
+
+    if (post)
+        Post(conn);
+    return true;
+}
+
+//
+// ================================================================
+//  HTTP framing (loop)
+// ================================================================
+void RPCServer::Reply(Conn* conn, int status, const std::string& body, bool keepAlive,
+                      const char* extraHeaders)
+{
+    auto it = conns.find(conn->id);
+    if (it == conns.end())
+        return;
+
+    conn->busy = true;
+    std::string msg = Head(status, (int64_t)body.size(), false, keepAlive, extraHeaders);
+    msg += body;
+    Enqueue(it->second, std::move(msg), true, !keepAlive, false);
+}
+
+static void TrimSpace(const char*& begin, const char*& end)
+{
+    while (begin < end && (*begin == ' ' || *begin == '\t'))
+        ++begin;
+    while (end > begin && (end[-1] == ' ' || end[-1] == '\t'))
+        --end;
+}
+
+static bool HeaderIs(const char* name, size_t len, const char* want)
+{
+    return std::strlen(want) == len && strncasecmp(name, want, len) == 0;
+}
+
+bool RPCServer::NextRequest(Conn* conn)
+{
+    const std::string& in = conn->in;
+    if (in.empty())
+        return false;
+
+    const size_t headerEnd = in.find("\r\n\r\n");
+    if (headerEnd == std::string::npos)
+    {
+        if (in.size() > opts.maxHeaderSize)
+            Reply(conn, 431, "", false);
+        return false;
+    }
+    if (headerEnd > opts.maxHeaderSize)
+    {
+        Reply(conn, 431, "", false);
+        return false;
+    }
+
+    // Request line: METHOD SP target SP HTTP/x.y
+    const char* p = in.data();
+    const char* headEnd = p + headerEnd;
+    const char* lineEnd = (const char*)std::memchr(p, '\r', (size_t)(headEnd - p));
+    if (!lineEnd)
+        lineEnd = headEnd;
+
+    const char* sp1 = (const char*)std::memchr(p, ' ', (size_t)(lineEnd - p));
+    const char* sp2 = sp1 ? (const char*)std::memchr(sp1 + 1, ' ', (size_t)(lineEnd - sp1 - 1)) : nullptr;
+    if (!sp1 || !sp2)
+    {
+        Reply(conn, 400, "", false);
+        return false;
+    }
+
+    const std::string method(p, sp1);
+    const std::string version(sp2 + 1, lineEnd);
+    bool http10;
+    if (version == "HTTP/1.1")
+        http10 = false;
+    else if (version == "HTTP/1.0")
+        http10 = true;
+    else
+    {
+        Reply(conn, 400, "", false);
+        return false;
+    }
+
+    int64_t contentLength = -1;
+    bool keepAlive = !http10;
+    bool expectContinue = false;
+    bool chunkedBody = false;
+    std::string authorization;
+
+    // Header lines
+    const char* line = lineEnd < headEnd ? lineEnd + 2 : headEnd;
+    while (line < headEnd)
+    {
+        const char* eol = (const char*)std::memchr(line, '\r', (size_t)(headEnd - line));
+        if (!eol)
+            eol = headEnd;
+
+        const char* colon = (const char*)std::memchr(line, ':', (size_t)(eol - line));
+        if (colon)
+        {
+            const size_t nameLen = (size_t)(colon - line);
+            const char* value = colon + 1;
+            const char* valueEnd = eol;
+            TrimSpace(value, valueEnd);
+            const size_t valueLen = (size_t)(valueEnd - value);
+
+            if (HeaderIs(line, nameLen, "content-length"))
+            {
+                char* endp = nullptr;
+                std::string v(value, valueLen);
+                long long n = std::strtoll(v.c_str(), &endp, 10);
+                if (v.empty() || *endp != '\0' || n < 0)
+                {
+                    Reply(conn, 400, "", false);
+                    return false;
+                }
+                contentLength = n;
+            }
+            else if (HeaderIs(line, nameLen, "connection"))
+            {
+                if (valueLen == 5 && strncasecmp(value, "close", 5) == 0)
+                    keepAlive = false;
+                else if (valueLen == 10 && strncasecmp(value, "keep-alive", 10) == 0)
+                    keepAlive = true;
+            }
+            else if (HeaderIs(line, nameLen, "transfer-encoding"))
+            {
+                chunkedBody = true;
+            }
+            else if (HeaderIs(line, nameLen, "expect"))
+            {
+                expectContinue = valueLen == 12 && strncasecmp(value, "100-continue", 12) == 0;
+            }
+            else if (HeaderIs(line, nameLen, "authorization"))
+            {
+                authorization.assign(value, valueLen);
+            }
+        }
+
+        line = eol + 2;
+    }
+
+    // Errors before the body is known close the connection: there
+    // is no telling where the next request starts
+    if (method != "POST")
+    {
+        Reply(conn, 405, "", false, "Allow: POST\r\n");
+        return false;
+    }
+    if (chunkedBody)
+    {
+        Reply(conn, 501, "", false);
+        return false;
+    }
+    if (contentLength < 0)
+    {
+        Reply(conn, 411, "", false);
+        return false;
+    }
+    if ((uint64_t)contentLength > opts.maxBodySize)
+    {
+        Reply(conn, 413, "", false);
+        return false;
+    }
+
+    const size_t total = headerEnd + 4 + (size_t)contentLength;
+    if (in.size() < total)
+    {
+        if (expectContinue && !conn->continued)
+        {
+            conn->continued = true;
+            auto it = conns.find(conn->id);
+            if (it != conns.end())
+                Enqueue(it->second, "HTTP/1.1 100 Continue\r\n\r\n", false, false, false);
+        }
+        return false;
+    }
+
+    std::shared_ptr<Request> req = std::make_shared<Request>();
+    req->body.assign(in, headerEnd + 4, (size_t)contentLength);
+    req->http10 = http10;
+    req->keepAlive = keepAlive;
+    req->arrived = Clock::now();
+    conn->in.erase(0, total);
+
+    if (!authHeader.empty() && !TimingSafeEqual(authorization, authHeader))
+    {
+        statUnauthorized++;
+        Reply(conn, 401, "", keepAlive, "WWW-Authenticate: Basic realm=\"jsonrpc\"\r\n");
+        return true;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(idleMutex);
+        if (inFlight >= opts.maxInFlight)
+        {
+            statOverloaded++;
+            Reply(conn, 503, "", keepAlive);
+            return true;
+        }
+        inFlight++;
+    }
+
+    auto it = conns.find(conn->id);
+    conn->busy = true;
+    ConnRef ref = it->second;
+    scheduler.Schedule(TASK_RPC, [this, ref, req] { Serve(ref, req); });
+    return true;
+}
+
+//
+// ================================================================
+//  Calls (workers)
+// ================================================================
+void RPCServer::RequestDone()
+{
+    statRequests++;
+
+    std::lock_guard<std::mutex> lock(idleMutex);
+    if (--inFlight == 0)
+        idleCv.notify_all();
+}
+
+bool RPCServer::Call(const JSONValue& request, JSONWriter& out, RPCError& error,
+                     Clock::time_point arrived)
+{
+    statCalls++;
+
+    if (!request.IsObject())
+    {
+        error = RPCError(RPC_INVALID_REQUEST, "Invalid Request object");
+        return false;
+    }
+
+    const JSONValue* name = request.Find("method");
+    if (!name || !name->IsString())
+    {
+        error = RPCError(RPC_INVALID_REQUEST, "Method must be a string");
+        return false;
+    }
+
+    static const JSONValue noParams;
+    const JSONValue* params = request.Find("params");
+    if (!params)
+        params = &noParams;
+    else if (!params->IsArray() && !params->IsObject() && !params->IsNull())
+    {
+        error = RPCError(RPC_INVALID_REQUEST, "Params must be an array or object");
+        return false;
+    }
+
+    auto it = methods.find(name->GetStr());
+    if (it == methods.end())
+    {
+        error = RPCError(RPC_METHOD_NOT_FOUND, "Method not found");
+        return false;
+    }
+    Method& m = *it->second;
+
+    out.BeginObject().Key("result");
+    bool ok = m.fn(*params, out, error);
+    if (ok && out.Depth() != 1)
+    {
+        error = RPCError(RPC_INTERNAL_ERROR, "method left its result unfinished");
+        ok = false;
+    }
+
+    const uint64_t micros = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        Clock::now() - arrived).count();
+    m.calls++;
+    if (!ok)
+        m.errors++;
+    m.micros += micros;
+
+    uint64_t seen = m.maxMicros;
+    while (micros > seen && !m.maxMicros.compare_exchange_weak(seen, micros)) {}
+
+    return ok;
+}
+
+void RPCServer::WriteEnvelopeEnd(JSONWriter& out, const JSONValue& request)
+{
+    const JSONValue* id = request.Find("id");
+
+    out.Key("error").Null().Key("id");
+    if (id)
+        id->Write(out);
+    else
+        out.Null();
+    out.EndObject();
+}
+
+void RPCServer::WriteError(JSONWriter& out, const RPCError& error, const JSONValue* request)
+{
+    const JSONValue* id = request ? request->Find("id") : nullptr;
+
+    out.BeginObject();
+    out.Key("result").Null();
+    out.Key("error").BeginObject();
+    out.Key("code").Int(error.code);
+    out.Key("message").String(error.message);
+    out.EndObject();
+    out.Key("id");
+    if (id)
+        id->Write(out);
+    else
+        out.Null();
+    out.EndObject();
+}
+
+void RPCServer::Serve(const ConnRef& conn, const std::shared_ptr<Request>& req)
+{
+    std::shared_ptr<JSONValue> doc = std::make_shared<JSONValue>();
+    std::string why;
+    const bool parsed = doc->Parse(req->body.data(), req->body.size(), &why);
+
+    if (parsed && doc->IsArray())
+    {
+        ServeBatch(conn, req, doc);
+        return;
+    }
+
+    Response response(*this, conn, *req);
+    RPCError error;
+    bool ok = false;
+
+    if (!parsed)
+    {
+        statCalls++;
+        error = RPCError(RPC_PARSE_ERROR, "Parse error: " + why);
+    }
+    else
+    {
+        JSONWriter out(response.Sink(), opts.chunkSize);
+        ok = Call(*doc, out, error, req->arrived);
+        if (ok)
+        {
+            WriteEnvelopeEnd(out, *doc);
+            out.Flush();
+        }
+    }
+
+    if (ok)
+    {
+        response.End(200);
+    }
+    else if (response.Started())
+    {
+        response.Abort();
+    }
+    else
+    {
+        JSONWriter out(response.Sink(), opts.chunkSize);
+        WriteError(out, error, parsed ? doc.get() : nullptr);
+        out.Flush();
+        response.End(HTTPStatus(error));
+    }
+
+    RequestDone();
+}
+
+void RPCServer::ServeBatch(const ConnRef& conn, const std::shared_ptr<Request>& req,
+                           std::shared_ptr<JSONValue> doc)
+{
+    const size_t n = doc->Size();
+    if (n == 0 || n > opts.maxBatch)
+    {
+        Response response(*this, conn, *req);
+        JSONWriter out(response.Sink(), opts.chunkSize);
+        WriteError(out, RPCError(RPC_INVALID_REQUEST, n ? "Batch too large" : "Empty batch"), nullptr);
+        out.Flush();
+        response.End(400);
+        RequestDone();
+        return;
+    }
+
+    statBatches++;
+
+    std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+    batch->conn = conn;
+    batch->req = req;
+    batch->doc = std::move(doc);
+    batch->response.reset(new Response(*this, conn, *req));
+    batch->results.resize(n);
+    batch->ready.assign(n, 0);
+    batch->next = 0;
+    batch->emitting = false;
+
+    for (size_t i = 1; i < n; ++i)
+        scheduler.Schedule(TASK_RPC, [this, batch, i] { RunBatchCall(batch, i); });
+    RunBatchCall(batch, 0);
+}
+
+void RPCServer::RunBatchCall(const std::shared_ptr<Batch>& batch, size_t i)
+{
+    const JSONValue& request = (*batch->doc)[i];
+
+    // Only this task touches results[i] until it is marked ready
+    std::string& result = batch->results[i];
+    auto sink = [&result](const char* data, size_t len) {
+        result.append(data, len);
+        return true;
+    };
+
+    RPCError error;
+    bool ok;
+    {
+        JSONWriter out(sink, opts.chunkSize);
+        ok = Call(request, out, error, batch->req->arrived);
+        if (ok)
+        {
+            WriteEnvelopeEnd(out, request);
+            out.Flush();
+        }
+    }
+
+    if (!ok)
+    {
+        result.clear();
+        JSONWriter out(sink, opts.chunkSize);
+        WriteError(out, error, &request);
+        out.Flush();
+    }
+
+    EmitBatch(batch, i);
+}
+
+void RPCServer::EmitBatch(const std::shared_ptr<Batch>& batch, size_t i)
+{
+    std::unique_lock<std::mutex> lock(batch->mutex);
+    batch->ready[i] = 1;
+
+    // One task at a time sends; the others leave their result
+    if (batch->emitting)
+        return;
+    batch->emitting = true;
+
+    const size_t n = batch->results.size();
+    for (;;)
+    {
+        const size_t first = batch->next;
+        std::vector<std::string> send;
+        while (batch->next < n && batch->ready[batch->next])
+            send.push_back(std::move(batch->results[batch->next++]));
+
+        if (send.empty())
+            break;
+
+        const bool last = batch->next == n;
+        lock.unlock();
+
+        Response& response = *batch->response;
+        for (size_t k = 0; k < send.size(); ++k)
+        {
+            response.Write(first + k == 0 ? "[" : ",", 1);
+            response.Write(send[k].data(), send[k].size());
+        }
+
+        if (last)
+        {
+            response.Write("]", 1);
+            response.End(200);
+            RequestDone();
+            return;
+        }
+
+        lock.lock();
+    }
+
+    batch->emitting = false;
+}
+
+bool RPCServer::GetRPCInfo(const JSONValue& params, JSONWriter& out, RPCError& error)
+{
+    (void)params;
+    (void)error;
+
+    const Stats s = GetStats();
+
+    out.BeginObject();
+    out.Key("uptime").Double(s.seconds);
+    out.Key("connections").UInt(s.connections);
+    out.Key("requests").UInt(s.requests);
+    out.Key("calls").UInt(s.calls);
+    out.Key("batches").UInt(s.batches);
+    out.Key("requests_per_second").Double(s.RequestsPerSecond());
+    out.Key("calls_per_second").Double(s.CallsPerSecond());
+    out.Key("overloaded").UInt(s.overloaded);
+    out.Key("streamed").UInt(s.streamed);
+    out.Key("cut").UInt(s.cut);
+    out.Key("bytes_in").UInt(s.bytesIn);
+    out.Key("bytes_out").UInt(s.bytesOut);
+
+    out.Key("methods").BeginArray();
+    for (const MethodStats& m : s.methods)
+    {
+        out.BeginObject();
+        out.Key("method").String(m.name);
+        out.Key("calls").UInt(m.calls);
+        out.Key("errors").UInt(m.errors);
+        out.Key("avg_ms").Double(m.avgMs);
+        out.Key("max_ms").Double(m.maxMs);
+        out.EndObject();
+    }
+    out.EndArray();
+
+    out.EndObject();
+    return true;
+}
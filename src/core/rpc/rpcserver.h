@@ -0,0 +1,302 @@
+#ifndef DRACHMA_RPC_RPCSERVER_H
+#define DRACHMA_RPC_RPCSERVER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "jsonvalue.h"
+#include "jsonwriter.h"
+#include "../node/scheduler.h"
+
+//
+// JSON-RPC error codes (Bitcoin Core numbering)
+//
+enum RPCErrorCode
+{
+    RPC_MISC_ERROR              = -1,
+    RPC_TYPE_ERROR              = -3,
+    RPC_INVALID_ADDRESS_OR_KEY  = -5,
+    RPC_OUT_OF_MEMORY           = -7,
+    RPC_INVALID_PARAMETER       = -8,
+    RPC_DATABASE_ERROR          = -20,
+
+    RPC_INVALID_REQUEST         = -32600,
+    RPC_METHOD_NOT_FOUND        = -32601,
+    RPC_INVALID_PARAMS          = -32602,
+    RPC_INTERNAL_ERROR          = -32603,
+    RPC_PARSE_ERROR             = -32700,
+};
+
+struct RPCError
+{
+    int code;
+    std::string message;
+
+    RPCError() : code(0) {}
+    RPCError(int c, std::string m) : code(c), message(std::move(m)) {}
+};
+
+// Writes exactly one JSON value, the result, to `result`; or fills
+// `error` and returns false. `params` is an array, an object, or
+// null when the request had none. Runs on a Scheduler worker,
+// possibly several at once.
+typedef std::function<bool(const JSONValue& params, JSONWriter& result, RPCError& error)> RPCMethod;
+
+//
+// ===============================================================
+//  CLASS: RPCServer
+// ===============================================================
+//
+//  HTTP/1.1 JSON-RPC server on one epoll loop; no thread per
+//  connection and no method ever runs on the loop.
+//
+//  The loop accepts, reads and frames requests (Content-Length
+//  bodies, keep-alive, pipelined requests answered in order) and
+//  writes responses out. Each request becomes a TASK_RPC task on
+//  the Scheduler, which parses the JSON and runs the method; a
+//  batch fans out into one task per call. At most `maxInFlight`
+//  requests are queued or running; past that the loop answers 503
+//  at once, like Core's work queue limit, instead of letting a
+//  backlog build up.
+//
+//  Results are streamed: the method writes into a JSONWriter whose
+//  chunks go straight onto the connection. A response that fits
+//  in one chunk is sent with a Content-Length; a larger one
+//  switches to chunked transfer encoding (HTTP/1.0: close-
+//  delimited) after the first chunk, so a getblock or a UTXO scan
+//  never exists in memory as a whole. A worker whose connection
+//  has more than `maxSendBuffer` bytes unsent waits for the loop
+//  to drain it, but only `maxBlockedWriters` workers wait at once:
+//  past that the response is cut instead, so clients that stop
+//  reading cannot park the Scheduler's workers for `idleTimeout`.
+//  A method failing before its first chunk went out gets an
+//  ordinary error response; after that the status line is gone
+//  and the connection is cut.
+//
+//  Batch calls run in parallel and are buffered one result each;
+//  results are sent in request order as soon as every call before
+//  them is done.
+//
+//  Register() methods before Start(). GetStats() reports per
+//  method calls, errors and latency (request arrival to result
+//  written), and the request rate; the built-in `getrpcinfo`
+//  returns the same over RPC.
+//
+// ===============================================================
+//
+class RPCServer
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Options
+    {
+        std::string auth;               // "user:password"; empty: no authentication
+        size_t maxConnections;
+        size_t maxInFlight;             // requests queued or running
+        size_t maxBatch;                // calls per batch
+        size_t maxHeaderSize;
+        size_t maxBodySize;
+        size_t chunkSize;               // streaming granularity
+        size_t maxSendBuffer;           // unsent bytes per connection before a worker waits
+        size_t maxBlockedWriters;       // workers waiting at once (0: a quarter of the scheduler's)
+        Clock::duration idleTimeout;    // keep-alive connections, and clients not reading
+        int backlog;
+
+        Options()
+            : maxConnections(4096), maxInFlight(4096), maxBatch(10000),
+              maxHeaderSize(8 * 1024), maxBodySize(32u << 20), chunkSize(64 * 1024),
+              maxSendBuffer(4u << 20), maxBlockedWriters(0), idleTimeout(std::chrono::seconds(30)),
+              backlog(1024) {}
+    };
+
+    struct MethodStats
+    {
+        std::string name;
+        uint64_t calls;
+        uint64_t errors;
+        double avgMs;
+        double maxMs;
+    };
+
+    struct Stats
+    {
+        size_t connections;             // open now
+        uint64_t accepted;
+        uint64_t rejected;              // over maxConnections
+        uint64_t requests;              // HTTP requests answered
+        uint64_t calls;                 // JSON-RPC calls, batch members included
+        uint64_t batches;
+        uint64_t overloaded;            // 503: over maxInFlight
+        uint64_t unauthorized;
+        uint64_t streamed;              // responses sent in more than one chunk
+        uint64_t cut;                   // client not reading, every wait taken
+        uint64_t bytesIn;
+        uint64_t bytesOut;
+        double seconds;                 // since Start()
+        std::vector<MethodStats> methods;
+
+        double RequestsPerSecond() const { return seconds > 0 ? requests / seconds : 0; }
+        double CallsPerSecond() const { return seconds > 0 ? calls / seconds : 0; }
+    };
+
+    explicit RPCServer(Scheduler& scheduler, const Options& opts = Options());
+    ~RPCServer();
+
+    RPCServer(const RPCServer&) = delete;
+    RPCServer& operator=(const RPCServer&) = delete;
+
+    // Before Start()
+    void Register(const std::string& name, RPCMethod fn);
+    bool Listen(const std::string& address, uint16_t port, std::string* error);
+    uint16_t GetListenPort() const { return listenPort; }
+
+    bool Start(std::string* error);
+
+    // Closes every connection and waits for running methods
+    void Stop();
+
+    Stats GetStats() const;
+
+private:
+    class Response;
+
+    struct Method
+    {
+        RPCMethod fn;
+        std::atomic<uint64_t> calls;
+        std::atomic<uint64_t> errors;
+        std::atomic<uint64_t> micros;
+        std::atomic<uint64_t> maxMicros;
+    };
+
+    struct Conn
+    {
+        uint64_t id;
+        int fd;
+
+        // Loop only
+        std::string in;                 // received, not yet framed
+        bool busy;                      // a request is being answered
+        bool eof;                       // peer closed its side
+        bool continued;                 // "100 Continue" sent for the current request
+        Clock::time_point lastActive;
+
+        // Shared with workers, under `mutex`
+        std::mutex mutex;
+        std::condition_variable drained;
+        std::deque<std::string> out;
+        size_t outOffset;               // sent of out.front()
+        size_t outBytes;
+        bool flushPosted;
+        bool done;                      // response complete
+        bool closeAfter;                // close once `out` is drained
+        bool closed;
+    };
+
+    typedef std::shared_ptr<Conn> ConnRef;
+
+    struct Request
+    {
+        std::string body;
+        bool http10;
+        bool keepAlive;
+        Clock::time_point arrived;
+    };
+
+    struct Batch;
+
+    void Run();
+    void ProcessPending();
+    void AcceptAll();
+    void ReadConn(Conn* conn);
+    void FlushConn(Conn* conn);
+    void CloseConn(Conn* conn);
+    void SweepIdle(Clock::time_point now);
+
+    // Frames the next request in conn->in; false: wait for more
+    bool NextRequest(Conn* conn);
+    void Reply(Conn* conn, int status, const std::string& body, bool keepAlive,
+               const char* extraHeaders = "");
+
+    // Worker side
+    void Serve(const ConnRef& conn, const std::shared_ptr<Request>& req);
+    void ServeBatch(const ConnRef& conn, const std::shared_ptr<Request>& req,
+                    std::shared_ptr<JSONValue> doc);
+    void RunBatchCall(const std::shared_ptr<Batch>& batch, size_t i);
+    void EmitBatch(const std::shared_ptr<Batch>& batch, size_t i);
+    void RequestDone();
+
+    // Validates and runs one call, writing {"result": and the
+    // result; the caller closes the envelope. On failure the
+    // partial output is the caller's to discard.
+    bool Call(const JSONValue& request, JSONWriter& out, RPCError& error,
+              Clock::time_point arrived);
+    static void WriteEnvelopeEnd(JSONWriter& out, const JSONValue& request);
+    static void WriteError(JSONWriter& out, const RPCError& error, const JSONValue* request);
+
+    // Queues bytes for the loop; `wait` applies the send buffer
+    // limit. False once the connection is closed or cut.
+    bool Enqueue(const ConnRef& conn, std::string data, bool last, bool close, bool wait);
+    void Post(const ConnRef& conn);
+
+    bool GetRPCInfo(const JSONValue& params, JSONWriter& out, RPCError& error);
+
+    Scheduler& scheduler;
+    Options opts;
+    std::string authHeader;             // expected Authorization value
+
+    std::map<std::string, std::unique_ptr<Method>> methods;
+
+    int listenFd;
+    uint16_t listenPort;
+    int epfd;
+    int wakefd;
+    std::thread thread;
+    std::atomic<bool> running;
+
+    // Loop only
+    std::unordered_map<uint64_t, ConnRef> conns;
+    std::vector<ConnRef> graveyard;
+    uint64_t nextId;
+
+    std::mutex pendingMutex;
+    std::vector<ConnRef> pending;       // to flush
+
+    // Requests in the scheduler; Stop() waits for zero
+    std::mutex idleMutex;
+    std::condition_variable idleCv;
+    size_t inFlight;
+
+    // Workers waiting for a connection to drain
+    std::atomic<size_t> blockedWriters;
+
+    Clock::time_point started;
+
+    std::atomic<size_t> statConnections;
+    std::atomic<uint64_t> statAccepted;
+    std::atomic<uint64_t> statRejected;
+    std::atomic<uint64_t> statRequests;
+    std::atomic<uint64_t> statCalls;
+    std::atomic<uint64_t> statBatches;
+    std::atomic<uint64_t> statOverloaded;
+    std::atomic<uint64_t> statUnauthorized;
+    std::atomic<uint64_t> statStreamed;
+    std::atomic<uint64_t> statCut;
+    std::atomic<uint64_t> statBytesIn;
+    std::atomic<uint64_t> statBytesOut;
+};
+
+#endif // DRACHMA_RPC_RPCSERVER_H
@@ -0,0 +1,35 @@
+#include "rpcutil.h"
+
+const JSONValue* Param(const JSONValue& params, size_t index, const char* name)
+{
+    if (params.IsArray())
+        return index < params.Size() && !params[index].IsNull() ? &params[index] : nullptr;
+    if (params.IsObject())
+        return params.Find(name);
+    return nullptr;
+}
+
+static int HexValue(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+bool ParseHex(const std::string& hex, std::vector<uint8_t>& out)
+{
+    if (hex.size() % 2)
+        return false;
+
+    out.resize(hex.size() / 2);
+    for (size_t i = 0; i < out.size(); ++i)
+    {
+        const int hi = HexValue(hex[2 * i]);
+        const int lo = HexValue(hex[2 * i + 1]);
+        if (hi < 0 || lo < 0)
+            return false;
+        out[i] = (uint8_t)(hi << 4 | lo);
+    }
+    return true;
+}
@@ -0,0 +1,21 @@
+#ifndef DRACHMA_RPC_RPCUTIL_H
+#define DRACHMA_RPC_RPCUTIL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "jsonvalue.h"
+
+//
+// Parameter helpers shared by the RPC method files
+//
+
+// Positional or named parameter; nullptr when absent
+const JSONValue* Param(const JSONValue& params, size_t index, const char* name);
+
+// Even-length hex, either case
+bool ParseHex(const std::string& hex, std::vector<uint8_t>& out);
+
+#endif // DRACHMA_RPC_RPCUTIL_H
@@ -0,0 +1,154 @@
+#include "signing.h"
+#include "rpcutil.h"
+
+#include <cstring>
+
+//
+// ================================================================
+//  Parameters
+// ================================================================
+static bool ParseItemHex(const JSONValue& item, const char* name, size_t i,
+                         std::vector<uint8_t>& out, RPCError& error)
+{
+    const JSONValue* v = item.Find(name);
+    if (!v || !v->IsString() || v->GetStr().empty() || !ParseHex(v->GetStr(), out))
+    {
+        error = RPCError(RPC_INVALID_PARAMETER,
+                         "item " + std::to_string(i) + ": " + name + " must be a hex string");
+        return false;
+    }
+    return true;
+}
+
+static bool ParseItemHash(const JSONValue& item, size_t i, std::array<uint8_t,32>& out,
+                          RPCError& error)
+{
+    std::vector<uint8_t> bytes;
+    if (!ParseItemHex(item, "hash", i, bytes, error))
+        return false;
+
+    if (bytes.size() != 32)
+    {
+        error = RPCError(RPC_INVALID_PARAMETER, "item " + std::to_string(i) + ": hash must be 32 bytes");
+        return false;
+    }
+    std::memcpy(out.data(), bytes.data(), 32);
+    return true;
+}
+
+static const JSONValue* ItemsParam(const JSONValue& params, RPCError& error)
+{
+    const JSONValue* items = Param(params, 0, "items");
+    if (!items || !items->IsArray() || items->Size() == 0)
+    {
+        error = RPCError(RPC_INVALID_PARAMETER, "items must be a non-empty array");
+        return nullptr;
+    }
+
+    for (size_t i = 0; i < items->Size(); ++i)
+    {
+        if (!(*items)[i].IsObject())
+        {
+            error = RPCError(RPC_INVALID_PARAMETER, "item " + std::to_string(i) + " must be an object");
+            return nullptr;
+        }
+    }
+    return items;
+}
+
+//
+// ================================================================
+//  Calls
+// ================================================================
+static bool SignMany(SigningService& service, const JSONValue& params, JSONWriter& out,
+                     RPCError& error)
+{
+    const JSONValue* items = ItemsParam(params, error);
+    if (!items)
+        return false;
+
+    SigningService::Format format = SigningService::SIG_DER;
+    if (const JSONValue* v = Param(params, 1, "format"))
+    {
+        if (v->IsString() && v->GetStr() == "compact")
+            format = SigningService::SIG_COMPACT;
+        else if (!v->IsString() || v->GetStr() != "der")
+        {
+            error = RPCError(RPC_INVALID_PARAMETER, "format must be \"der\" or \"compact\"");
+            return false;
+        }
+    }
+
+    std::vector<SigningService::SignItem> work(items->Size());
+    std::vector<uint8_t> key;
+    for (size_t i = 0; i < work.size(); ++i)
+    {
+        const JSONValue& item = (*items)[i];
+        if (!ParseItemHex(item, "key", i, key, error) || !ParseItemHash(item, i, work[i].hash, error))
+            return false;
+
+        if (key.size() == 20)
+            std::memcpy(work[i].key.data(), key.data(), 20);
+        else if (key.size() == 33 || key.size() == 65)
+            work[i].key = SigningService::GetKeyID(key);
+        else
+        {
+            error = RPCError(RPC_INVALID_PARAMETER,
+                             "item " + std::to_string(i) + ": key must be a key ID or a public key");
+            return false;
+        }
+    }
+
+    std::vector<std::vector<uint8_t>> sigs;
+    std::string reason;
+    if (!service.SignMany(work, format, sigs, &reason))
+    {
+        error = RPCError(RPC_INVALID_ADDRESS_OR_KEY, reason);
+        return false;
+    }
+
+    out.BeginArray();
+    for (const std::vector<uint8_t>& sig : sigs)
+        out.Hex(sig);
+    out.EndArray();
+    return true;
+}
+
+static bool VerifyMany(SigningService& service, const JSONValue& params, JSONWriter& out,
+                       RPCError& error)
+{
+    const JSONValue* items = ItemsParam(params, error);
+    if (!items)
+        return false;
+
+    std::vector<SigningService::VerifyItem> work(items->Size());
+    for (size_t i = 0; i < work.size(); ++i)
+    {
+        const JSONValue& item = (*items)[i];
+        if (!ParseItemHex(item, "pubkey", i, work[i].pubkey, error) ||
+            !ParseItemHash(item, i, work[i].hash, error) ||
+            !ParseItemHex(item, "signature", i, work[i].signature, error))
+            return false;
+    }
+
+    std::vector<uint8_t> valid;
+    service.VerifyMany(work, valid);
+
+    out.BeginArray();
+    for (uint8_t v : valid)
+        out.Bool(v != 0);
+    out.EndArray();
+    return true;
+}
+
+void RegisterSigningRPCs(RPCServer& server, SigningService& service)
+{
+    SigningService* s = &service;
+
+    server.Register("signmany", [s](const JSONValue& params, JSONWriter& out, RPCError& error) {
+        return SignMany(*s, params, out, error);
+    });
+    server.Register("verifymany", [s](const JSONValue& params, JSONWriter& out, RPCError& error) {
+        return VerifyMany(*s, params, out, error);
+    });
+}
@@ -0,0 +1,24 @@
+#ifndef DRACHMA_RPC_SIGNING_H
+#define DRACHMA_RPC_SIGNING_H
+
+#include "rpcserver.h"
+#include "../wallet/signingservice.h"
+
+//
+// Batch signing calls
+// ---------------------------------------------------------------
+//   signmany [ {"key": ID, "hash": HEX}, ... ] ( "der" | "compact" )
+//                                    one hex signature per item, in
+//                                    order; ID is the key's Hash160
+//                                    or its public key
+//   verifymany [ {"pubkey": HEX, "hash": HEX, "signature": HEX}, ... ]
+//                                    one bool per item; compact if
+//                                    the signature is 64 bytes
+//
+//  Hashes are the 32 bytes signed, as given (not reversed). A
+//  batch with an unknown key signs nothing and fails with
+//  RPC_INVALID_ADDRESS_OR_KEY.
+//
+void RegisterSigningRPCs(RPCServer& server, SigningService& service);
+
+#endif // DRACHMA_RPC_SIGNING_H
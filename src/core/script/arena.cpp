@@ -0,0 +1,71 @@
+#include "arena.h"
+
+static const size_t ARENA_ALIGN = 16;
+
+ScriptArena::ScriptArena(size_t size)
+{
+    blockSize = size;
+    current = 0;
+    offset = 0;
+    usedBefore = 0;
+}
+
+uint8_t* ScriptArena::Allocate(size_t n)
+{
+    n = (n + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    if (n == 0)
+        n = ARENA_ALIGN;
+
+    while (current < blocks.size())
+    {
+        Block& b = blocks[current];
+        if (b.size - offset >= n)
+        {
+            uint8_t* p = b.data.get() + offset;
+            offset += n;
+            return p;
+        }
+
+        // Move on; the tail of this block is wasted until Reset()
+        usedBefore += b.size;
+        ++current;
+        offset = 0;
+    }
+
+    // Oversized requests get a block of their own
+    Block b;
+    b.size = n > blockSize ? n : blockSize;
+    b.data.reset(new uint8_t[b.size]);
+    blocks.push_back(std::move(b));
+
+    offset = n;
+    return blocks.back().data.get();
+}
+
+uint8_t* ScriptArena::Copy(const uint8_t* data, size_t n)
+{
+    uint8_t* p = Allocate(n);
+    if (n > 0)
+        std::memcpy(p, data, n);
+    return p;
+}
+
+void ScriptArena::Reset()
+{
+    current = 0;
+    offset = 0;
+    usedBefore = 0;
+}
+
+size_t ScriptArena::GetUsed() const
+{
+    return usedBefore + offset;
+}
+
+size_t ScriptArena::GetCapacity() const
+{
+    size_t total = 0;
+    for (const Block& b : blocks)
+        total += b.size;
+    return total;
+}
@@ -0,0 +1,173 @@
+#ifndef DRACHMA_SCRIPT_ARENA_H
+#define DRACHMA_SCRIPT_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+//
+// ===============================================================
+//  CLASS: ScriptArena
+// ===============================================================
+//
+//  Bump allocator for everything one script validation creates:
+//  decoded opcode streams, stack storage, hash and number results.
+//  Nothing is freed individually; Reset() rewinds to the start and
+//  keeps the blocks, so once an arena has seen its largest script
+//  validations run without touching the heap.
+//
+//  Not thread-safe – one arena per checking thread.
+//
+// ===============================================================
+//
+class ScriptArena
+{
+public:
+    explicit ScriptArena(size_t blockSize = 64 * 1024);
+
+    ScriptArena(const ScriptArena&) = delete;
+    ScriptArena& operator=(const ScriptArena&) = delete;
+
+    // Aligned to 16 bytes; never null
+    uint8_t* Allocate(size_t n);
+
+    // Copy `n` bytes into the arena
+    uint8_t* Copy(const uint8_t* data, size_t n);
+
+    void Reset();
+
+    size_t GetUsed() const;                 // bytes handed out since Reset()
+    size_t GetCapacity() const;             // bytes held in blocks
+
+private:
+    struct Block
+    {
+        std::unique_ptr<uint8_t[]> data;
+        size_t size;
+    };
+
+    std::vector<Block> blocks;
+    size_t blockSize;
+    size_t current;                         // block being bumped
+    size_t offset;                          // into blocks[current]
+    size_t usedBefore;                      // full blocks before current
+};
+
+//
+// ===============================================================
+//  CLASS: ArenaVector
+// ===============================================================
+//
+//  Small vector for trivially copyable T: the first N elements live
+//  inline, growth doubles into arena memory. Old storage is simply
+//  abandoned to the arena.
+//
+// ===============================================================
+//
+template <typename T, size_t N>
+class ArenaVector
+{
+    static_assert(std::is_trivially_copyable<T>::value, "ArenaVector needs trivially copyable T");
+
+public:
+    explicit ArenaVector(ScriptArena& a)
+        : arena(&a), items(inlineItems), count(0), capacity(N) {}
+
+    ArenaVector(const ArenaVector& other)
+        : arena(other.arena), items(inlineItems), count(0), capacity(N)
+    {
+        Assign(other);
+    }
+
+    ArenaVector& operator=(const ArenaVector& other)
+    {
+        if (this != &other)
+        {
+            count = 0;
+            Assign(other);
+        }
+        return *this;
+    }
+
+    size_t Size() const { return count; }
+    bool Empty() const { return count == 0; }
+
+    T& operator[](size_t i) { return items[i]; }
+    const T& operator[](size_t i) const { return items[i]; }
+
+    // i = 0 is the last element
+    T& Top(size_t i = 0) { return items[count - 1 - i]; }
+    const T& Top(size_t i = 0) const { return items[count - 1 - i]; }
+
+    const T* begin() const { return items; }
+    const T* end() const { return items + count; }
+
+    void Push(const T& v)
+    {
+        if (count == capacity)
+        {
+            // `v` may live in the old storage
+            T copy = v;
+            Grow(capacity * 2);
+            items[count++] = copy;
+            return;
+        }
+        items[count++] = v;
+    }
+
+    void Pop() { --count; }
+    void Clear() { count = 0; }
+
+    void Shrink(size_t n) { count = n; }
+
+    void Erase(size_t i)
+    {
+        std::memmove(items + i, items + i + 1, (count - i - 1) * sizeof(T));
+        --count;
+    }
+
+    void Insert(size_t i, const T& v)
+    {
+        T copy = v;
+        if (count == capacity)
+            Grow(capacity * 2);
+        std::memmove(items + i + 1, items + i, (count - i) * sizeof(T));
+        items[i] = copy;
+        ++count;
+    }
+
+    void Swap(size_t i, size_t j)
+    {
+        T tmp = items[i];
+        items[i] = items[j];
+        items[j] = tmp;
+    }
+
+private:
+    void Grow(size_t n)
+    {
+        T* p = reinterpret_cast<T*>(arena->Allocate(n * sizeof(T)));
+        std::memcpy(p, items, count * sizeof(T));
+        items = p;
+        capacity = n;
+    }
+
+    void Assign(const ArenaVector& other)
+    {
+        if (other.count > capacity)
+            Grow(other.count);
+        std::memcpy(items, other.items, other.count * sizeof(T));
+        count = other.count;
+    }
+
+    ScriptArena* arena;
+    T* items;
+    size_t count;
+    size_t capacity;
+    T inlineItems[N];
+};
+
+#endif // DRACHMA_SCRIPT_ARENA_H
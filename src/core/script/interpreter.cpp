@@ -0,0 +1,1246 @@
+#include "interpreter.h"
+#include "../crypto/ecdsa.h"
+#include "../crypto/hash.h"
+#include "../crypto/ripemd160.h"
+#include "../crypto/sha1.h"
+#include "../crypto/sha256.h"
+#include "../../common/utils/serialize.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+static const uint8_t TRUE_VALUE[1] = { 1 };
+
+// OP_1NEGATE, OP_RESERVED (unused), OP_1 .. OP_16
+static const uint8_t SMALL_INTS[18] =
+{
+    0x81, 0x00, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16
+};
+
+static const uint32_t LOCKTIME_THRESHOLD = 500000000;
+
+static const uint32_t SEQUENCE_FINAL              = 0xffffffff;
+static const uint32_t SEQUENCE_LOCKTIME_DISABLE   = (1U << 31);
+static const uint32_t SEQUENCE_LOCKTIME_TYPE_FLAG = (1U << 22);
+static const uint32_t SEQUENCE_LOCKTIME_MASK      = 0x0000ffff;
+
+static inline bool SetError(ScriptError* error, ScriptError e)
+{
+    if (error) *error = e;
+    return e == ScriptError::OK;
+}
+
+static bool CastToBool(ByteSpan v)
+{
+    for (size_t i = 0; i < v.size; ++i)
+    {
+        if (v[i] != 0)
+        {
+            // negative zero
+            if (i == v.size - 1 && v[i] == 0x80)
+                return false;
+            return true;
+        }
+    }
+    return false;
+}
+
+static inline ByteSpan BoolValue(bool v)
+{
+    return v ? ByteSpan(TRUE_VALUE, 1) : ByteSpan();
+}
+
+//
+// ================================================================
+//  Script numbers (little-endian sign-magnitude)
+// ================================================================
+static bool ReadNum(ByteSpan v, bool requireMinimal, size_t maxSize, int64_t& out)
+{
+    if (v.size > maxSize)
+        return false;
+
+    if (requireMinimal && v.size > 0)
+    {
+        // A zero top byte (ignoring sign) is only allowed when the
+        // next byte needs its high bit for magnitude
+        if ((v[v.size - 1] & 0x7f) == 0 && (v.size <= 1 || (v[v.size - 2] & 0x80) == 0))
+            return false;
+    }
+
+    if (v.size == 0)
+    {
+        out = 0;
+        return true;
+    }
+
+    int64_t result = 0;
+    for (size_t i = 0; i < v.size; ++i)
+        result |= (int64_t)v[i] << (8 * i);
+
+    if (v[v.size - 1] & 0x80)
+        result = -(int64_t)(result & ~(0x80LL << (8 * (v.size - 1))));
+
+    out = result;
+    return true;
+}
+
+static ByteSpan EncodeNum(int64_t value, ScriptArena& arena)
+{
+    if (value == 0)
+        return ByteSpan();
+
+    uint8_t buf[9];
+    size_t n = 0;
+
+    const bool negative = value < 0;
+    uint64_t abs = negative ? (uint64_t)0 - (uint64_t)value : (uint64_t)value;
+
+    while (abs)
+    {
+        buf[n++] = abs & 0xff;
+        abs >>= 8;
+    }
+
+    if (buf[n - 1] & 0x80)
+        buf[n++] = negative ? 0x80 : 0;
+    else if (negative)
+        buf[n - 1] |= 0x80;
+
+    return ByteSpan(arena.Copy(buf, n), n);
+}
+
+static bool CheckMinimalPush(ByteSpan data, uint8_t opcode)
+{
+    if (data.size == 0)
+        return opcode == OP_0;
+    if (data.size == 1 && data[0] >= 1 && data[0] <= 16)
+        return false;                       // should be OP_1 .. OP_16
+    if (data.size == 1 && data[0] == 0x81)
+        return false;                       // should be OP_1NEGATE
+    if (data.size <= 75)
+        return opcode == data.size;
+    if (data.size <= 255)
+        return opcode == OP_PUSHDATA1;
+    if (data.size <= 65535)
+        return opcode == OP_PUSHDATA2;
+    return true;
+}
+
+//
+// Legacy scriptCode with every push of `sig` (as the canonical push
+// encoding) removed at instruction boundaries. Returns `script`
+// itself when there is nothing to remove.
+//
+static ByteSpan FindAndDelete(ByteSpan script, ByteSpan sig, ScriptArena& arena)
+{
+    uint8_t prefix[5];
+    size_t prefixLen;
+    if (sig.size < OP_PUSHDATA1)
+    {
+        prefix[0] = (uint8_t)sig.size;
+        prefixLen = 1;
+    }
+    else if (sig.size <= 0xff)
+    {
+        prefix[0] = OP_PUSHDATA1;
+        prefix[1] = (uint8_t)sig.size;
+        prefixLen = 2;
+    }
+    else if (sig.size <= 0xffff)
+    {
+        prefix[0] = OP_PUSHDATA2;
+        WriteLE16(prefix + 1, (uint16_t)sig.size);
+        prefixLen = 3;
+    }
+    else
+    {
+        prefix[0] = OP_PUSHDATA4;
+        WriteLE32(prefix + 1, (uint32_t)sig.size);
+        prefixLen = 5;
+    }
+
+    const size_t needleLen = prefixLen + sig.size;
+    if (script.size < needleLen)
+        return script;
+
+    auto matches = [&](size_t pos) {
+        return script.size - pos >= needleLen &&
+               std::memcmp(script.data + pos, prefix, prefixLen) == 0 &&
+               std::memcmp(script.data + pos + prefixLen, sig.data, sig.size) == 0;
+    };
+
+    // Cheap rejection before building a copy
+    bool any = false;
+    for (size_t pos = 0; pos + needleLen <= script.size && !any; ++pos)
+        any = matches(pos);
+    if (!any)
+        return script;
+
+    uint8_t* out = arena.Allocate(script.size);
+    size_t outLen = 0;
+    size_t found = 0;
+
+    size_t pc = 0, pc2 = 0;
+    uint8_t opcode;
+    do
+    {
+        std::memcpy(out + outLen, script.data + pc2, pc - pc2);
+        outLen += pc - pc2;
+
+        while (matches(pc))
+        {
+            pc += needleLen;
+            ++found;
+        }
+        pc2 = pc;
+    }
+    while (GetScriptOp(script, pc, opcode, nullptr));
+
+    if (found == 0)
+        return script;
+
+    std::memcpy(out + outLen, script.data + pc2, script.size - pc2);
+    outLen += script.size - pc2;
+
+    return ByteSpan(out, outLen);
+}
+
+//
+// ================================================================
+//  Signature checkers
+// ================================================================
+bool IsValidSignatureEncoding(ByteSpan sig)
+{
+    // 0x30 <len> 0x02 <lenR> <R> 0x02 <lenS> <S> <hash type>
+    if (sig.size < 9 || sig.size > 73)
+        return false;
+    if (sig[0] != 0x30 || sig[1] != sig.size - 3)
+        return false;
+
+    const size_t lenR = sig[3];
+    if (5 + lenR >= sig.size)
+        return false;
+    const size_t lenS = sig[5 + lenR];
+    if (lenR + lenS + 7 != sig.size)
+        return false;
+
+    // Both integers present, positive and without a zero byte the
+    // next one does not need
+    if (sig[2] != 0x02 || lenR == 0 || (sig[4] & 0x80))
+        return false;
+    if (lenR > 1 && sig[4] == 0x00 && !(sig[5] & 0x80))
+        return false;
+
+    if (sig[lenR + 4] != 0x02 || lenS == 0 || (sig[lenR + 6] & 0x80))
+        return false;
+    if (lenS > 1 && sig[lenR + 6] == 0x00 && !(sig[lenR + 7] & 0x80))
+        return false;
+
+    return true;
+}
+
+// An empty signature is left to fail its check
+static bool CheckSignatureEncoding(ByteSpan sig, uint32_t flags, ScriptError* error)
+{
+    if (!sig.empty() && (flags & SCRIPT_VERIFY_DERSIG) && !IsValidSignatureEncoding(sig))
+        return SetError(error, ScriptError::SIG_DER);
+    return true;
+}
+
+bool SignatureChecker::CheckSig(ByteSpan, ByteSpan, ByteSpan, SigVersion) const
+{
+    return false;
+}
+
+bool SignatureChecker::CheckLockTime(int64_t) const
+{
+    return false;
+}
+
+bool SignatureChecker::CheckSequence(int64_t) const
+{
+    return false;
+}
+
+bool TransactionSignatureChecker::CheckSig(ByteSpan sig, ByteSpan pubkey, ByteSpan scriptCode,
+                                           SigVersion sigversion) const
+{
+    if (sig.empty())
+        return false;
+
+    PublicKey key;
+    if (pubkey.size == 33)
+    {
+        std::array<uint8_t,33> raw;
+        std::memcpy(raw.data(), pubkey.data, 33);
+        key = PublicKey(raw);
+    }
+    else if (pubkey.size == 65)
+    {
+        std::array<uint8_t,65> raw;
+        std::memcpy(raw.data(), pubkey.data, 65);
+        key = PublicKey(raw);
+    }
+    if (!key.IsValid())
+        return false;
+
+    Signature s;
+    if (!Signature::FromDER(sig.data, sig.size - 1, s))
+        return false;
+
+    const uint32_t hashType = sig[sig.size - 1];
+
+    std::array<uint8_t,32> hash;
+    if (!SignatureHash(txdata, input, scriptCode, amount, hashType, sigversion, hash.data()))
+        return false;
+
+    return key.Verify(hash, s);
+}
+
+bool TransactionSignatureChecker::CheckLockTime(int64_t lockTime) const
+{
+    const TransactionView& tx = txdata.GetTx();
+    const int64_t txLockTime = tx.GetLockTime();
+
+    // Same kind (height vs. time) on both sides
+    if (!((txLockTime < LOCKTIME_THRESHOLD && lockTime < LOCKTIME_THRESHOLD) ||
+          (txLockTime >= LOCKTIME_THRESHOLD && lockTime >= LOCKTIME_THRESHOLD)))
+        return false;
+
+    if (lockTime > txLockTime)
+        return false;
+
+    // A final input would disable nLockTime altogether
+    return tx.Inputs()[input].sequence != SEQUENCE_FINAL;
+}
+
+bool TransactionSignatureChecker::CheckSequence(int64_t sequence) const
+{
+    const TransactionView& tx = txdata.GetTx();
+    const int64_t txSequence = tx.Inputs()[input].sequence;
+
+    if ((uint32_t)tx.GetVersion() < 2)
+        return false;
+
+    if (txSequence & SEQUENCE_LOCKTIME_DISABLE)
+        return false;
+
+    const uint32_t mask = SEQUENCE_LOCKTIME_TYPE_FLAG | SEQUENCE_LOCKTIME_MASK;
+    const int64_t txMasked = txSequence & mask;
+    const int64_t masked = sequence & mask;
+
+    if (!((txMasked < SEQUENCE_LOCKTIME_TYPE_FLAG && masked < SEQUENCE_LOCKTIME_TYPE_FLAG) ||
+          (txMasked >= SEQUENCE_LOCKTIME_TYPE_FLAG && masked >= SEQUENCE_LOCKTIME_TYPE_FLAG)))
+        return false;
+
+    return masked <= txMasked;
+}
+
+//
+// ================================================================
+//  EvalScript
+// ================================================================
+bool EvalScript(ScriptStack& stack, const DecodedScript& script, uint32_t flags,
+                const SignatureChecker& checker, SigVersion sigversion,
+                ScriptArena& arena, ScriptError* error)
+{
+    SetError(error, ScriptError::UNKNOWN);
+
+    const bool requireMinimal = (flags & SCRIPT_VERIFY_MINIMALDATA) != 0;
+
+    ScriptStack altstack(arena);
+
+    // IF/ELSE nesting; the script executes while no entry is false
+    ArenaVector<uint8_t, 16> exec(arena);
+    size_t falseCount = 0;
+
+    size_t codeBegin = 0;           // after the last OP_CODESEPARATOR
+    int opCount = 0;
+
+    const ArenaVector<ScriptOp, 32>& ops = script.GetOps();
+    for (size_t k = 0; k < ops.Size(); ++k)
+    {
+        const ScriptOp& op = ops[k];
+        const uint8_t opcode = op.opcode;
+        const bool executing = (falseCount == 0);
+
+        if (opcode > OP_16 && ++opCount > MAX_OPS_PER_SCRIPT)
+            return SetError(error, ScriptError::OP_COUNT);
+
+        if (executing && opcode <= OP_PUSHDATA4)
+        {
+            ByteSpan data = script.GetData(op);
+            if (requireMinimal && !CheckMinimalPush(data, opcode))
+                return SetError(error, ScriptError::MINIMALDATA);
+            stack.Push(data);
+        }
+        else if (executing || (opcode >= OP_IF && opcode <= OP_ENDIF))
+        {
+            switch (opcode)
+            {
+                //
+                // Push value
+                //
+                case OP_1NEGATE:
+                case OP_1: case OP_2: case OP_3: case OP_4:
+                case OP_5: case OP_6: case OP_7: case OP_8:
+                case OP_9: case OP_10: case OP_11: case OP_12:
+                case OP_13: case OP_14: case OP_15: case OP_16:
+                    stack.Push(ByteSpan(&SMALL_INTS[opcode - OP_1NEGATE], 1));
+                    break;
+
+                //
+                // Control
+                //
+                case OP_NOP:
+                case OP_NOP1: case OP_NOP4: case OP_NOP5:
+                case OP_NOP6: case OP_NOP7: case OP_NOP8:
+                case OP_NOP9: case OP_NOP10:
+                    break;
+
+                case OP_CHECKLOCKTIMEVERIFY:
+                {
+                    if (!(flags & SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY))
+                        break;
+                    if (stack.Size() < 1)
+                        return SetError(error, ScriptError::INVALID_STACK_OPERATION);
+
+                    // 5 bytes: lock times go up to 2^32-1
+                    int64_t lockTime;
+                    if (!ReadNum(stack.Top(), requireMinimal, 5, lockTime))
+                        return SetError(error, ScriptError::NUM_OVERFLOW);
+                    if (lockTime < 0)
+                        return SetError(error, ScriptError::NEGATIVE_LOCKTIME);
+                    if (!checker.CheckLockTime(lockTime))
+                        return SetError(error, ScriptError::UNSATISFIED_LOCKTIME);
+                    break;
+                }
+
+                case OP_CHECKSEQUENCEVERIFY:
+                {
+                    if (!(flags & SCRIPT_VERIFY_CHECKSEQUENCEVERIFY))
+                        break;
+                    if (stack.Size() < 1)
+                        return SetError(error, ScriptError::INVALID_STACK_OPERATION);
+
+                    int64_t sequence;
+                    if (!ReadNum(stack.Top(), requireMinimal, 5, sequence))
+                        return SetError(error, ScriptError::NUM_OVERFLOW);
+                    if (sequence < 0)
+                        return SetError(error, ScriptError::NEGATIVE_LOCKTIME);
+
+                    // Disabled relative lock times behave as a NOP
+                    if (sequence & SEQUENCE_LOCKTIME_DISABLE)
+                        break;
+                    if (!checker.CheckSequence(sequence))
+                        return SetError(error, ScriptError::UNSATISFIED_LOCKTIME);
+                    break;
+                }
+
+                case OP_IF:
+                case OP_NOTIF:
+                {
+                    bool value = false;
+                    if (executing)
+                    {
+                        if (stack.Size() < 1)
+                            return SetError(error, ScriptError::UNBALANCED_CONDITIONAL);
+                        value = CastToBool(stack.Top());
+                        if (opcode == OP_NOTIF)
+                            value = !value;
+                        stack.Pop();
+                    }
+                    exec.Push(value ? 1 : 0);
+                    if (!value)
+                        ++falseCount;
+                    break;
+                }
+
+                case OP_ELSE:
+                {
+                    if (exec.Empty())
+                        return SetError(error, ScriptError::UNBALANCED_CONDITIONAL);
+                    uint8_t& top = exec.Top();
+                    if (top)
+                        ++falseCount;
+                    else
+                        --falseCount;
+                    top = !top;
+                    break;
+                }
+
+                case OP_ENDIF:
+                {
+                    if (exec.Empty())
+                        return SetError(error, ScriptError::UNBALANCED_CONDITIONAL);
+                    if (!exec.Top())
+                        --falseCount;
+                    exec.Pop();
+                    break;
+                }
+
+                case OP_VERIFY:
+                {
+                    if (stack.Size() < 1)
+                        return SetError(error, ScriptError::INVALID_STACK_OPERATION);
+                    if (!CastToBool(stack.Top()))
+                        return SetError(error, ScriptError::VERIFY);
+                    stack.Pop();
+                    break;
+                }
+
+                case OP_RETURN:
+                    return SetError(error, ScriptError::OP_RETURN);
+
+                //
+                // Stack ops
+                //
+                case OP_TOALTSTACK:
+                {
+                    if (stack.Size() < 1)
+                        return SetError(error, ScriptError::INVALID_STACK_OPERATION);
+                    altstack.Push(stack.Top());
+                    stack.Pop();
+                    break;
+                }
+
+                case OP_FROMALTSTACK:
+                {
+                    if (altstack.Size() < 1)
+                        return SetError(error, ScriptError::INVALID_ALTSTACK_OPERATION);
+                    stack.Push(altstack.Top());
+                    altstack.Pop();
+                    break;
+                }
+
+                case OP_2DROP:
+                {
+                    if (stack.Size() < 2)
+                        return SetError(error, ScriptError::INVALID_STACK_OPERATION);
+                    stack.Shrink(stack.Size() - 2);
+                    break;
+                }
+
+                case OP_2DUP:
+                {
+                    if (stack.Size() < 2)
+                        return SetError(error, ScriptError::INVALID_STACK_OPERATION);
+                    ByteSpan a = stack.Top(1), b = stack.Top(0);
+                    stack.Push(a);
+                    stack.Push(b);
+                    break;
+                }
+
+                case OP_3DUP:
+                {
+                    if (stack.Size() < 3)
+                        return SetError(error, ScriptError::INVALID_STACK_OPERATION);
+                    ByteSpan a = stack.Top(2), b = stack.Top(1), c = stack.Top(0);
+                    stack.Push(a);
+                    stack.Push(b);
+                    stack.Push(c);
+                    break;
+                }
+
+                case OP_2OVER:
+                {
+                    if (stack.Size() < 4)
+                        return SetError(error, ScriptError::INVALID_STACK_OPERATION);
+                    ByteSpan a = stack.Top(3), b = stack.Top(2);
+                    stack.Push(a);
+                    stack.Push(b);
+                    break;
+                }
+
+                case OP_2ROT:
+                {
+                    if (stack.Size() < 6)
+                        return SetError(error, ScriptError::INVALID_STACK_OPERATION);
+                    ByteSpan a = stack.Top(5), b = stack.Top(4);
+                    stack.Erase(stack.Size() - 6);
+                    stack.Erase(stack.Size() - 5);
+                    stack.Push(a);
+                    stack.Push(b);
+                    break;
+                }
+
+                case OP_2SWAP:
+                {
+                    if (stack.Size() < 4)
+                        return SetError(error, ScriptError::INVALID_STACK_OPERATION);
+                    const size_t n = stack.Size();
+                    stack.Swap(n - 4, n - 2);
+                    stack.Swap(n - 3, n - 1);
+                    break;
+                }
+
+                case OP_IFDUP:
+                {
+                    if (stack.Size() < 1)
+                        return SetError(error, ScriptError::INVALID_STACK_OPERATION);
+                    if (CastToBool(stack.Top()))
+                        stack.Push(stack.Top());
+                    break;
+                }
+
+                case OP_DEPTH:
+                    stack.Push(EncodeNum((int64_t)stack.Size(), arena));
+                    break;
+
+                case OP_DROP:
+                {
+                    if (stack.Size() < 1)
+                        return SetError(error, ScriptError::INVALID_STACK_OPERATION);
+                    stack.Pop();
+                    break;
+                }
+
+                case OP_DUP:
+                {
+                    if (stack.Size() < 1)
+                        return SetError(error, ScriptError::INVALID_STACK_OPERATION);
+                    stack.Push(stack.Top());
+                    break;
+                }
+
+                case OP_NIP:
+                {
+                    if (stack.Size() < 2)
+                        return SetError(error, ScriptError::INVALID_STACK_OPERATION);
+                    stack.Erase(stack.Size() - 2);
+                    break;
+                }
+
+                case OP_OVER:
+                {
+                    if (stack.Size() < 2)
+                        return SetError(error, ScriptError::INVALID_STACK_OPERATION);
+                    stack.Push(stack.Top(1));
+                    break;
+                }
+
+                case OP_PICK:
+                case OP_ROLL:
+                {
+                    if (stack.Size() < 2)
+                        return SetError(error, ScriptError::INVALID_STACK_OPERATION);
+
+                    int64_t n;
+                    if (!ReadNum(stack.Top(), requireMinimal, 4, n))
+                        return SetError(error, ScriptError::NUM_OVERFLOW);
+                    stack.Pop();
+
+                    if (n < 0 || (size_t)n >= stack.Size())
+                        return SetError(error, ScriptError::INVALID_STACK_OPERATION);
+
+                    ByteSpan v = stack.Top((size_t)n);
+                    if (opcode == OP_ROLL)
+                        stack.Erase(stack.Size() - (size_t)n - 1);
+                    stack.Push(v);
+                    break;
+                }
+
+                case OP_ROT:
+                {
+                    // (x1 x2 x3 -- x2 x3 x1)
+                    if (stack.Size() < 3)
+                        return SetError(error, ScriptError::INVALID_STACK_OPERATION);
+                    const size_t n = stack.Size();
+                    stack.Swap(n - 3, n - 2);
+                    stack.Swap(n - 2, n - 1);
+                    break;
+                }
+
+                case OP_SWAP:
+                {
+                    if (stack.Size() < 2)
+                        return SetError(error, ScriptError::INVALID_STACK_OPERATION);
+                    const size_t n = stack.Size();
+                    stack.Swap(n - 2, n - 1);
+                    break;
+                }
+
+                case OP_TUCK:
+                {
+                    // (x1 x2 -- x2 x1 x2)
+                    if (stack.Size() < 2)
+                        return SetError(error, ScriptError::INVALID_STACK_OPERATION);
+                    stack.Insert(stack.Size() - 2, stack.Top());
+                    break;
+                }
+
+                case OP_SIZE:
+                {
+                    if (stack.Size() < 1)
+                        return SetError(error, ScriptError::INVALID_STACK_OPERATION);
+                    stack.Push(EncodeNum((int64_t)stack.Top().size, arena));
+                    break;
+                }
+
+                //
+                // Bitwise logic
+                //
+                case OP_EQUAL:
+                case OP_EQUALVERIFY:
+                {
+                    if (stack.Size() < 2)
+                        return SetError(error, ScriptError::INVALID_STACK_OPERATION);
+                    ByteSpan a = stack.Top(1), b = stack.Top(0);
+                    const bool equal = a.size == b.size &&
+                                       (a.size == 0 || std::memcmp(a.data, b.data, a.size) == 0);
+                    stack.Shrink(stack.Size() - 2);
+                    stack.Push(BoolValue(equal));
+
+                    if (opcode == OP_EQUALVERIFY)
+                    {
+                        if (!equal)
+                            return SetError(error, ScriptError::EQUALVERIFY);
+                        stack.Pop();
+                    }
+                    break;
+                }
+
+                //
+                // Numeric
+                //
+                case OP_1ADD:
+                case OP_1SUB:
+                case OP_NEGATE:
+                case OP_ABS:
+                case OP_NOT:
+                case OP_0NOTEQUAL:
+                {
+                    if (stack.Size() < 1)
+                        return SetError(error, ScriptError::INVALID_STACK_OPERATION);
+
+                    int64_t n;
+                    if (!ReadNum(stack.Top(), requireMinimal, 4, n))
+                        return SetError(error, ScriptError::NUM_OVERFLOW);
+
+                    switch (opcode)
+                    {
+                        case OP_1ADD:       n += 1; break;
+                        case OP_1SUB:       n -= 1; break;
+                        case OP_NEGATE:     n = -n; break;
+                        case OP_ABS:        if (n < 0) n = -n; break;
+                        case OP_NOT:        n = (n == 0); break;
+                        case OP_0NOTEQUAL:  n = (n != 0); break;
+                    }
+
+                    stack.Pop();
+                    stack.Push(EncodeNum(n, arena));
+                    break;
+                }
+
+                case OP_ADD:
+                case OP_SUB:
+                case OP_BOOLAND:
+                case OP_BOOLOR:
+                case OP_NUMEQUAL:
+                case OP_NUMEQUALVERIFY:
+                case OP_NUMNOTEQUAL:
+                case OP_LESSTHAN:
+                case OP_GREATERTHAN:
+                case OP_LESSTHANOREQUAL:
+                case OP_GREATERTHANOREQUAL:
+                case OP_MIN:
+                case OP_MAX:
+                {
+                    if (stack.Size() < 2)
+                        return SetError(error, ScriptError::INVALID_STACK_OPERATION);
+
+                    int64_t a, b;
+                    if (!ReadNum(stack.Top(1), requireMinimal, 4, a) ||
+                        !ReadNum(stack.Top(0), requireMinimal, 4, b))
+                        return SetError(error, ScriptError::NUM_OVERFLOW);
+
+                    int64_t r = 0;
+                    switch (opcode)
+                    {
+                        case OP_ADD:                r = a + b; break;
+                        case OP_SUB:                r = a - b; break;
+                        case OP_BOOLAND:            r = (a != 0 && b != 0); break;
+                        case OP_BOOLOR:             r = (a != 0 || b != 0); break;
+                        case OP_NUMEQUAL:           r = (a == b); break;
+                        case OP_NUMEQUALVERIFY:     r = (a == b); break;
+                        case OP_NUMNOTEQUAL:        r = (a != b); break;
+                        case OP_LESSTHAN:           r = (a < b); break;
+                        case OP_GREATERTHAN:        r = (a > b); break;
+                        case OP_LESSTHANOREQUAL:    r = (a <= b); break;
+                        case OP_GREATERTHANOREQUAL: r = (a >= b); break;
+                        case OP_MIN:                r = std::min(a, b); break;
+                        case OP_MAX:                r = std::max(a, b); break;
+                    }
+
+                    stack.Shrink(stack.Size() - 2);
+                    stack.Push(EncodeNum(r, arena));
+
+                    if (opcode == OP_NUMEQUALVERIFY)
+                    {
+                        if (!CastToBool(stack.Top()))
+                            return SetError(error, ScriptError::NUMEQUALVERIFY);
+                        stack.Pop();
+                    }
+                    break;
+                }
+
+                case OP_WITHIN:
+                {
+                    // (x min max -- min <= x < max)
+                    if (stack.Size() < 3)
+                        return SetError(error, ScriptError::INVALID_STACK_OPERATION);
+
+                    int64_t x, lo, hi;
+                    if (!ReadNum(stack.Top(2), requireMinimal, 4, x) ||
+                        !ReadNum(stack.Top(1), requireMinimal, 4, lo) ||
+                        !ReadNum(stack.Top(0), requireMinimal, 4, hi))
+                        return SetError(error, ScriptError::NUM_OVERFLOW);
+
+                    stack.Shrink(stack.Size() - 3);
+                    stack.Push(BoolValue(lo <= x && x < hi));
+                    break;
+                }
+
+                //
+                // Crypto
+                //
+                case OP_RIPEMD160:
+                case OP_SHA1:
+                case OP_SHA256:
+                case OP_HASH160:
+                case OP_HASH256:
+                {
+                    if (stack.Size() < 1)
+                        return SetError(error, ScriptError::INVALID_STACK_OPERATION);
+
+                    ByteSpan v = stack.Top();
+                    const size_t len = (opcode == OP_SHA256 || opcode == OP_HASH256) ? 32 : 20;
+                    uint8_t* out = arena.Allocate(len);
+
+                    if (opcode == OP_RIPEMD160)
+                    {
+                        RIPEMD160 ctx;
+                        ctx.Update(v.data, v.size);
+                        ctx.Final(out);
+                    }
+                    else if (opcode == OP_SHA1)
+                    {
+                        SHA1 ctx;
+                        ctx.Update(v.data, v.size);
+                        ctx.Final(out);
+                    }
+                    else if (opcode == OP_SHA256)
+                    {
+                        ::SHA256 ctx;
+                        ctx.Update(v.data, v.size);
+                        ctx.Final(out);
+                    }
+                    else if (opcode == OP_HASH160)
+                    {
+                        Hash::Hash160(v.data, v.size, out);
+                    }
+                    else
+                    {
+                        Hash::SHA256D(v.data, v.size, out);
+                    }
+
+                    stack.Pop();
+                    stack.Push(ByteSpan(out, len));
+                    break;
+                }
+
+                case OP_CODESEPARATOR:
+                    codeBegin = op.end;
+                    break;
+
+                case OP_CHECKSIG:
+                case OP_CHECKSIGVERIFY:
+                {
+                    if (stack.Size() < 2)
+                        return SetError(error, ScriptError::INVALID_STACK_OPERATION);
+
+                    ByteSpan sig = stack.Top(1);
+                    ByteSpan pubkey = stack.Top(0);
+
+                    ByteSpan scriptCode = script.GetScript().Sub(codeBegin);
+                    if (sigversion == SigVersion::BASE)
+                        scriptCode = FindAndDelete(scriptCode, sig, arena);
+
+                    if (!CheckSignatureEncoding(sig, flags, error))
+                        return false;
+
+                    const bool success = !sig.empty() &&
+                                         checker.CheckSig(sig, pubkey, scriptCode, sigversion);
+
+                    stack.Shrink(stack.Size() - 2);
+                    stack.Push(BoolValue(success));
+
+                    if (opcode == OP_CHECKSIGVERIFY)
+                    {
+                        if (!success)
+                            return SetError(error, ScriptError::CHECKSIGVERIFY);
+                        stack.Pop();
+                    }
+                    break;
+                }
+
+                case OP_CHECKMULTISIG:
+                case OP_CHECKMULTISIGVERIFY:
+                {
+                    // ([dummy] [sig ...] nSigs [pubkey ...] nKeys -- bool)
+                    size_t i = 1;
+                    if (stack.Size() < i)
+                        return SetError(error, ScriptError::INVALID_STACK_OPERATION);
+
+                    int64_t keys;
+                    if (!ReadNum(stack.Top(i - 1), requireMinimal, 4, keys))
+                        return SetError(error, ScriptError::NUM_OVERFLOW);
+                    if (keys < 0 || keys > MAX_PUBKEYS_PER_MULTISIG)
+                        return SetError(error, ScriptError::PUBKEY_COUNT);
+
+                    opCount += (int)keys;
+                    if (opCount > MAX_OPS_PER_SCRIPT)
+                        return SetError(error, ScriptError::OP_COUNT);
+
+                    size_t ikey = ++i;
+                    i += (size_t)keys;
+                    if (stack.Size() < i)
+                        return SetError(error, ScriptError::INVALID_STACK_OPERATION);
+
+                    int64_t sigs;
+                    if (!ReadNum(stack.Top(i - 1), requireMinimal, 4, sigs))
+                        return SetError(error, ScriptError::NUM_OVERFLOW);
+                    if (sigs < 0 || sigs > keys)
+                        return SetError(error, ScriptError::SIG_COUNT);
+
+                    size_t isig = ++i;
+                    i += (size_t)sigs;
+                    if (stack.Size() < i)
+                        return SetError(error, ScriptError::INVALID_STACK_OPERATION);
+
+                    ByteSpan scriptCode = script.GetScript().Sub(codeBegin);
+                    if (sigversion == SigVersion::BASE)
+                    {
+                        for (int64_t s = 0; s < sigs; ++s)
+                            scriptCode = FindAndDelete(scriptCode, stack.Top(isig - 1 + (size_t)s), arena);
+                    }
+
+                    bool success = true;
+                    while (success && sigs > 0)
+                    {
+                        ByteSpan sig = stack.Top(isig - 1);
+                        ByteSpan pubkey = stack.Top(ikey - 1);
+
+                        if (!CheckSignatureEncoding(sig, flags, error))
+                            return false;
+
+                        if (!sig.empty() && checker.CheckSig(sig, pubkey, scriptCode, sigversion))
+                        {
+                            ++isig;
+                            --sigs;
+                        }
+                        ++ikey;
+                        --keys;
+
+                        // More signatures left than keys to match them
+                        if (sigs > keys)
+                            success = false;
+                    }
+
+                    // Arguments, then the extra element consumed by an
+                    // old off-by-one bug
+                    stack.Shrink(stack.Size() - (i - 1));
+                    if (stack.Size() < 1)
+                        return SetError(error, ScriptError::INVALID_STACK_OPERATION);
+                    if ((flags & SCRIPT_VERIFY_NULLDUMMY) && !stack.Top().empty())
+                        return SetError(error, ScriptError::SIG_NULLDUMMY);
+                    stack.Pop();
+
+                    stack.Push(BoolValue(success));
+
+                    if (opcode == OP_CHECKMULTISIGVERIFY)
+                    {
+                        if (!success)
+                            return SetError(error, ScriptError::CHECKMULTISIGVERIFY);
+                        stack.Pop();
+                    }
+                    break;
+                }
+
+                default:
+                    return SetError(error, ScriptError::BAD_OPCODE);
+            }
+        }
+
+        if (stack.Size() + altstack.Size() > MAX_STACK_SIZE)
+            return SetError(error, ScriptError::STACK_SIZE);
+    }
+
+    if (!exec.Empty())
+        return SetError(error, ScriptError::UNBALANCED_CONDITIONAL);
+
+    return SetError(error, ScriptError::OK);
+}
+
+//
+// ================================================================
+//  VerifyScript
+// ================================================================
+
+// DUP HASH160 <hash> EQUALVERIFY CHECKSIG
+static void BuildPubKeyHashScript(const uint8_t* hash, uint8_t out[25])
+{
+    out[0] = OP_DUP;
+    out[1] = OP_HASH160;
+    out[2] = 20;
+    std::memcpy(out + 3, hash, 20);
+    out[23] = OP_EQUALVERIFY;
+    out[24] = OP_CHECKSIG;
+}
+
+static bool ExecuteWitnessScript(ScriptStack& stack, ByteSpan scriptBytes, uint32_t flags,
+                                 const SignatureChecker& checker, ScriptArena& arena,
+                                 ScriptError* error)
+{
+    for (const ByteSpan& item : stack)
+        if (item.size > MAX_SCRIPT_ELEMENT_SIZE)
+            return SetError(error, ScriptError::PUSH_SIZE);
+
+    DecodedScript script(arena);
+    if (!script.Decode(scriptBytes, error))
+        return false;
+
+    if (!EvalScript(stack, script, flags, checker, SigVersion::WITNESS_V0, arena, error))
+        return false;
+
+    // Witness scripts must leave exactly one true element
+    if (stack.Size() != 1)
+        return SetError(error, ScriptError::CLEANSTACK);
+    if (!CastToBool(stack.Top()))
+        return SetError(error, ScriptError::EVAL_FALSE);
+
+    return true;
+}
+
+static bool VerifyWitnessProgram(const ByteSpan* witness, size_t witnessCount,
+                                 int version, ByteSpan program, uint32_t flags,
+                                 const SignatureChecker& checker, ScriptArena& arena,
+                                 ScriptError* error)
+{
+    // Unknown versions stay spendable for future soft forks
+    if (version != 0)
+        return SetError(error, ScriptError::OK);
+
+    ScriptStack stack(arena);
+
+    if (program.size == 32)
+    {
+        // P2WSH: last item is the script, committed by SHA256
+        if (witnessCount == 0)
+            return SetError(error, ScriptError::WITNESS_PROGRAM_WITNESS_EMPTY);
+
+        ByteSpan scriptBytes = witness[witnessCount - 1];
+
+        uint8_t hash[32];
+        ::SHA256 ctx;
+        ctx.Update(scriptBytes.data, scriptBytes.size);
+        ctx.Final(hash);
+        if (std::memcmp(hash, program.data, 32) != 0)
+            return SetError(error, ScriptError::WITNESS_PROGRAM_MISMATCH);
+
+        for (size_t i = 0; i + 1 < witnessCount; ++i)
+            stack.Push(witness[i]);
+
+        return ExecuteWitnessScript(stack, scriptBytes, flags, checker, arena, error);
+    }
+
+    if (program.size == 20)
+    {
+        // P2WPKH: [sig, pubkey] against the P2PKH template
+        if (witnessCount != 2)
+            return SetError(error, ScriptError::WITNESS_PROGRAM_MISMATCH);
+
+        uint8_t* scriptBytes = arena.Allocate(25);
+        BuildPubKeyHashScript(program.data, scriptBytes);
+
+        stack.Push(witness[0]);
+        stack.Push(witness[1]);
+
+        return ExecuteWitnessScript(stack, ByteSpan(scriptBytes, 25), flags, checker, arena, error);
+    }
+
+    return SetError(error, ScriptError::WITNESS_PROGRAM_WRONG_LENGTH);
+}
+
+//
+// P2PKH: scriptSig of exactly two direct pushes. Skips the fast
+// path where the interpreter could differ: one-byte pushes (minimal
+// encoding rules) and a 20-byte signature (FindAndDelete could hit
+// the hash push in the scriptCode).
+//
+static bool MatchPubKeyHashSpend(ByteSpan scriptSig, ByteSpan& sig, ByteSpan& pubkey)
+{
+    if (scriptSig.size < 2)
+        return false;
+
+    const size_t sigLen = scriptSig[0];
+    if (sigLen < 2 || sigLen >= OP_PUSHDATA1 || sigLen == 20 || scriptSig.size < sigLen + 2)
+        return false;
+
+    const size_t keyLen = scriptSig[sigLen + 1];
+    if (keyLen < 2 || keyLen >= OP_PUSHDATA1 || scriptSig.size != sigLen + keyLen + 2)
+        return false;
+
+    sig = scriptSig.Sub(1, sigLen);
+    pubkey = scriptSig.Sub(sigLen + 2, keyLen);
+    return true;
+}
+
+static bool VerifyPubKeyHash(ByteSpan sig, ByteSpan pubkey, const uint8_t* hash,
+                             ByteSpan scriptCode, SigVersion sigversion, uint32_t flags,
+                             const SignatureChecker& checker, ScriptError* error)
+{
+    uint8_t keyHash[20];
+    Hash::Hash160(pubkey.data, pubkey.size, keyHash);
+    if (std::memcmp(keyHash, hash, 20) != 0)
+        return SetError(error, ScriptError::EQUALVERIFY);
+
+    if (!CheckSignatureEncoding(sig, flags, error))
+        return false;
+
+    if (sig.empty() || !checker.CheckSig(sig, pubkey, scriptCode, sigversion))
+        return SetError(error, ScriptError::EVAL_FALSE);
+
+    return SetError(error, ScriptError::OK);
+}
+
+bool VerifyScript(ByteSpan scriptSig, ByteSpan scriptPubKey,
+                  const ByteSpan* witness, size_t witnessCount,
+                  uint32_t flags, const SignatureChecker& checker,
+                  ScriptArena& arena, ScriptError* error)
+{
+    const bool witnessEnabled = (flags & SCRIPT_VERIFY_WITNESS) != 0;
+
+    //
+    // Fast paths
+    //
+    if (IsPayToPubKeyHash(scriptPubKey) && (witnessCount == 0 || !witnessEnabled))
+    {
+        ByteSpan sig, pubkey;
+        if (MatchPubKeyHashSpend(scriptSig, sig, pubkey))
+            return VerifyPubKeyHash(sig, pubkey, scriptPubKey.data + 3, scriptPubKey,
+                                    SigVersion::BASE, flags, checker, error);
+    }
+
+    if (witnessEnabled && IsPayToWitnessPubKeyHash(scriptPubKey) && scriptSig.empty() &&
+        witnessCount == 2 &&
+        witness[0].size <= MAX_SCRIPT_ELEMENT_SIZE && witness[1].size <= MAX_SCRIPT_ELEMENT_SIZE &&
+        CastToBool(scriptPubKey.Sub(2)))
+    {
+        uint8_t scriptCode[25];
+        BuildPubKeyHashScript(scriptPubKey.data + 2, scriptCode);
+        return VerifyPubKeyHash(witness[0], witness[1], scriptPubKey.data + 2,
+                                ByteSpan(scriptCode, 25), SigVersion::WITNESS_V0, flags, checker, error);
+    }
+
+    //
+    // General case
+    //
+    ScriptStack stack(arena);
+    ScriptStack stackCopy(arena);
+
+    DecodedScript sigScript(arena);
+    if (!sigScript.Decode(scriptSig, error))
+        return false;
+    if (!EvalScript(stack, sigScript, flags, checker, SigVersion::BASE, arena, error))
+        return false;
+
+    if (flags & SCRIPT_VERIFY_P2SH)
+        stackCopy = stack;
+
+    DecodedScript pubKeyScript(arena);
+    if (!pubKeyScript.Decode(scriptPubKey, error))
+        return false;
+    if (!EvalScript(stack, pubKeyScript, flags, checker, SigVersion::BASE, arena, error))
+        return false;
+
+    if (stack.Empty() || !CastToBool(stack.Top()))
+        return SetError(error, ScriptError::EVAL_FALSE);
+
+    bool hadWitness = false;
+    int version;
+    ByteSpan program;
+
+    if (witnessEnabled && IsWitnessProgram(scriptPubKey, version, program))
+    {
+        hadWitness = true;
+
+        // Native witness spends must not carry a scriptSig
+        if (!scriptSig.empty())
+            return SetError(error, ScriptError::WITNESS_MALLEATED);
+
+        if (!VerifyWitnessProgram(witness, witnessCount, version, program, flags, checker, arena, error))
+            return false;
+
+        stack.Shrink(1);
+    }
+
+    if ((flags & SCRIPT_VERIFY_P2SH) && IsPayToScriptHash(scriptPubKey))
+    {
+        if (!sigScript.IsPushOnly())
+            return SetError(error, ScriptError::SIG_PUSHONLY);
+
+        // Non-empty: the HASH160 in scriptPubKey needed an element
+        stack = stackCopy;
+
+        ByteSpan redeemBytes = stack.Top();
+        stack.Pop();
+
+        DecodedScript redeem(arena);
+        if (!redeem.Decode(redeemBytes, error))
+            return false;
+        if (!EvalScript(stack, redeem, flags, checker, SigVersion::BASE, arena, error))
+            return false;
+
+        if (stack.Empty() || !CastToBool(stack.Top()))
+            return SetError(error, ScriptError::EVAL_FALSE);
+
+        if (witnessEnabled && IsWitnessProgram(redeemBytes, version, program))
+        {
+            hadWitness = true;
+
+            // scriptSig must be exactly one push of the redeem script
+            // (at most 42 bytes, so a direct push)
+            if (scriptSig.size != redeemBytes.size + 1 || scriptSig[0] != redeemBytes.size ||
+                std::memcmp(scriptSig.data + 1, redeemBytes.data, redeemBytes.size) != 0)
+                return SetError(error, ScriptError::WITNESS_MALLEATED_P2SH);
+
+            if (!VerifyWitnessProgram(witness, witnessCount, version, program, flags, checker, arena, error))
+                return false;
+
+            stack.Shrink(1);
+        }
+    }
+
+    if (witnessEnabled && !hadWitness && witnessCount > 0)
+        return SetError(error, ScriptError::WITNESS_UNEXPECTED);
+
+    return SetError(error, ScriptError::OK);
+}
+
+bool VerifyInput(const PrecomputedTxData& txdata, uint32_t input,
+                 ByteSpan scriptPubKey, int64_t amount, uint32_t flags,
+                 ScriptArena& arena, ScriptError* error)
+{
+    const TransactionView& tx = txdata.GetTx();
+    if (input >= tx.Inputs().size())
+        return SetError(error, ScriptError::UNKNOWN);
+
+    const TxInView& in = tx.Inputs()[input];
+    TransactionSignatureChecker checker(txdata, input, amount);
+
+    return VerifyScript(in.scriptSig, scriptPubKey,
+                        tx.GetWitnessItems(input), in.witnessCount,
+                        flags, checker, arena, error);
+}
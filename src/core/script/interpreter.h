@@ -0,0 +1,122 @@
+#ifndef DRACHMA_SCRIPT_INTERPRETER_H
+#define DRACHMA_SCRIPT_INTERPRETER_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "arena.h"
+#include "script.h"
+#include "sighash.h"
+#include "../../common/utils/span.h"
+
+enum ScriptVerifyFlags : uint32_t
+{
+    SCRIPT_VERIFY_NONE                = 0,
+    SCRIPT_VERIFY_P2SH                = (1U << 0),    // BIP16
+    SCRIPT_VERIFY_NULLDUMMY           = (1U << 1),    // BIP147
+    SCRIPT_VERIFY_MINIMALDATA         = (1U << 2),
+    SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY = (1U << 3),    // BIP65
+    SCRIPT_VERIFY_CHECKSEQUENCEVERIFY = (1U << 4),    // BIP112
+    SCRIPT_VERIFY_WITNESS             = (1U << 5),    // BIP141/143
+    SCRIPT_VERIFY_DERSIG              = (1U << 6),    // BIP66
+
+    SCRIPT_VERIFY_CONSENSUS = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_NULLDUMMY |
+                              SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY |
+                              SCRIPT_VERIFY_CHECKSEQUENCEVERIFY |
+                              SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_DERSIG
+};
+
+// BIP66: strict DER signature followed by the hash type byte. With
+// SCRIPT_VERIFY_DERSIG any other non-empty signature fails the
+// script (SIG_DER) instead of only failing its check, so a
+// signature cannot be re-encoded without changing the txid's
+// validity.
+bool IsValidSignatureEncoding(ByteSpan sig);
+
+// Stack elements point into scripts, witnesses or the arena
+typedef ArenaVector<ByteSpan, 32> ScriptStack;
+
+//
+// ===============================================================
+//  Signature checkers
+// ===============================================================
+//
+//  The interpreter only sees the checker interface; the base class
+//  rejects everything (for evaluating scripts with no transaction).
+//
+class SignatureChecker
+{
+public:
+    virtual ~SignatureChecker() {}
+
+    // `sig` includes the trailing hash type byte
+    virtual bool CheckSig(ByteSpan sig, ByteSpan pubkey, ByteSpan scriptCode,
+                          SigVersion sigversion) const;
+
+    virtual bool CheckLockTime(int64_t lockTime) const;
+    virtual bool CheckSequence(int64_t sequence) const;
+};
+
+class TransactionSignatureChecker : public SignatureChecker
+{
+public:
+    TransactionSignatureChecker(const PrecomputedTxData& data, uint32_t input, int64_t amount)
+        : txdata(data), input(input), amount(amount) {}
+
+    bool CheckSig(ByteSpan sig, ByteSpan pubkey, ByteSpan scriptCode,
+                  SigVersion sigversion) const override;
+
+    bool CheckLockTime(int64_t lockTime) const override;
+    bool CheckSequence(int64_t sequence) const override;
+
+private:
+    const PrecomputedTxData& txdata;
+    uint32_t input;
+    int64_t amount;
+};
+
+//
+// ===============================================================
+//  Script execution
+// ===============================================================
+//
+//  EvalScript() runs one decoded script against `stack`. All
+//  values it creates (numbers, hashes, stripped scriptCodes) are
+//  carved from `arena`, so a validation does no per-push heap
+//  allocation; reset the arena between validations.
+//
+//  VerifyScript() is the full scriptSig / scriptPubKey / witness
+//  check. Before interpreting it looks for the two templates that
+//  make up most inputs:
+//
+//    P2PKH   scriptSig <sig> <pubkey>, scriptPubKey
+//            DUP HASH160 <h> EQUALVERIFY CHECKSIG
+//    P2WPKH  empty scriptSig, witness [sig, pubkey],
+//            scriptPubKey 0 <h>
+//
+//  and checks them directly (Hash160 compare + one CheckSig) with
+//  the same result the interpreter would give.
+//
+//  Witness versions above 0 are accepted unexecuted (pre-Taproot
+//  rules); this tree has no Schnorr verifier yet.
+//
+// ===============================================================
+//
+bool EvalScript(ScriptStack& stack, const DecodedScript& script, uint32_t flags,
+                const SignatureChecker& checker, SigVersion sigversion,
+                ScriptArena& arena, ScriptError* error);
+
+bool VerifyScript(ByteSpan scriptSig, ByteSpan scriptPubKey,
+                  const ByteSpan* witness, size_t witnessCount,
+                  uint32_t flags, const SignatureChecker& checker,
+                  ScriptArena& arena, ScriptError* error);
+
+//
+// Verify input `input` of the transaction behind `txdata`, spending
+// `scriptPubKey` worth `amount`.
+//
+bool VerifyInput(const PrecomputedTxData& txdata, uint32_t input,
+                 ByteSpan scriptPubKey, int64_t amount, uint32_t flags,
+                 ScriptArena& arena, ScriptError* error);
+
+#endif // DRACHMA_SCRIPT_INTERPRETER_H
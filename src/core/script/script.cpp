@@ -0,0 +1,208 @@
+#include "script.h"
+#include "../../common/utils/serialize.h"
+
+const char* ScriptErrorString(ScriptError error)
+{
+    switch (error)
+    {
+        case ScriptError::OK:                            return "no error";
+        case ScriptError::EVAL_FALSE:                    return "script evaluated without error but finished with a false/empty top stack element";
+        case ScriptError::OP_RETURN:                     return "OP_RETURN was encountered";
+        case ScriptError::SCRIPT_SIZE:                   return "script is too big";
+        case ScriptError::PUSH_SIZE:                     return "push value size limit exceeded";
+        case ScriptError::OP_COUNT:                      return "operation limit exceeded";
+        case ScriptError::STACK_SIZE:                    return "stack size limit exceeded";
+        case ScriptError::SIG_COUNT:                     return "signature count negative or greater than pubkey count";
+        case ScriptError::PUBKEY_COUNT:                  return "pubkey count negative or limit exceeded";
+        case ScriptError::VERIFY:                        return "script failed an OP_VERIFY operation";
+        case ScriptError::EQUALVERIFY:                   return "script failed an OP_EQUALVERIFY operation";
+        case ScriptError::CHECKMULTISIGVERIFY:           return "script failed an OP_CHECKMULTISIGVERIFY operation";
+        case ScriptError::CHECKSIGVERIFY:                return "script failed an OP_CHECKSIGVERIFY operation";
+        case ScriptError::NUMEQUALVERIFY:                return "script failed an OP_NUMEQUALVERIFY operation";
+        case ScriptError::BAD_OPCODE:                    return "opcode missing or not understood";
+        case ScriptError::DISABLED_OPCODE:               return "attempted to use a disabled opcode";
+        case ScriptError::INVALID_STACK_OPERATION:       return "operation not valid with the current stack size";
+        case ScriptError::INVALID_ALTSTACK_OPERATION:    return "operation not valid with the current altstack size";
+        case ScriptError::UNBALANCED_CONDITIONAL:        return "invalid OP_IF construction";
+        case ScriptError::NUM_OVERFLOW:                  return "script number overflow or non-minimal encoding";
+        case ScriptError::MINIMALDATA:                   return "data push larger than necessary";
+        case ScriptError::SIG_PUSHONLY:                  return "only push operators allowed in signatures";
+        case ScriptError::SIG_NULLDUMMY:                 return "dummy CHECKMULTISIG argument must be zero";
+        case ScriptError::SIG_DER:                       return "non-canonical DER signature";
+        case ScriptError::CLEANSTACK:                    return "stack size must be exactly one after execution";
+        case ScriptError::NEGATIVE_LOCKTIME:             return "negative locktime";
+        case ScriptError::UNSATISFIED_LOCKTIME:          return "locktime requirement not satisfied";
+        case ScriptError::WITNESS_PROGRAM_WRONG_LENGTH:  return "witness program has incorrect length";
+        case ScriptError::WITNESS_PROGRAM_WITNESS_EMPTY: return "witness program was passed an empty witness";
+        case ScriptError::WITNESS_PROGRAM_MISMATCH:      return "witness program hash mismatch";
+        case ScriptError::WITNESS_MALLEATED:             return "witness requires empty scriptSig";
+        case ScriptError::WITNESS_MALLEATED_P2SH:        return "witness requires only-redeemscript scriptSig";
+        case ScriptError::WITNESS_UNEXPECTED:            return "witness provided for non-witness script";
+        case ScriptError::UNKNOWN:                       break;
+    }
+    return "unknown error";
+}
+
+bool GetScriptOp(ByteSpan script, size_t& pos, uint8_t& opcode, ByteSpan* data)
+{
+    if (pos >= script.size)
+        return false;
+
+    opcode = script[pos++];
+    if (opcode > OP_PUSHDATA4)
+    {
+        if (data) *data = ByteSpan();
+        return true;
+    }
+
+    size_t size = opcode;
+    if (opcode >= OP_PUSHDATA1)
+    {
+        const size_t width = (opcode == OP_PUSHDATA1) ? 1 : (opcode == OP_PUSHDATA2) ? 2 : 4;
+        if (script.size - pos < width)
+            return false;
+
+        size = (width == 1) ? script[pos]
+             : (width == 2) ? ReadLE16(script.data + pos)
+                            : ReadLE32(script.data + pos);
+        pos += width;
+    }
+
+    if (script.size - pos < size)
+        return false;
+
+    if (data) *data = script.Sub(pos, size);
+    pos += size;
+    return true;
+}
+
+static bool IsDisabled(uint8_t op)
+{
+    switch (op)
+    {
+        case OP_CAT: case OP_SUBSTR: case OP_LEFT: case OP_RIGHT:
+        case OP_INVERT: case OP_AND: case OP_OR: case OP_XOR:
+        case OP_2MUL: case OP_2DIV: case OP_MUL: case OP_DIV:
+        case OP_MOD: case OP_LSHIFT: case OP_RSHIFT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+//
+// ================================================================
+//  DecodedScript
+// ================================================================
+bool DecodedScript::Decode(ByteSpan s, ScriptError* error)
+{
+    script = s;
+    ops.Clear();
+
+    auto fail = [error](ScriptError e) { if (error) *error = e; return false; };
+
+    if (script.size > MAX_SCRIPT_SIZE)
+        return fail(ScriptError::SCRIPT_SIZE);
+
+    int opCount = 0;
+    size_t pos = 0;
+    while (pos < script.size)
+    {
+        ByteSpan data;
+        ScriptOp op;
+        if (!GetScriptOp(script, pos, op.opcode, &data))
+            return fail(ScriptError::BAD_OPCODE);
+
+        if (data.size > MAX_SCRIPT_ELEMENT_SIZE)
+            return fail(ScriptError::PUSH_SIZE);
+
+        if (op.opcode > OP_16 && ++opCount > MAX_OPS_PER_SCRIPT)
+            return fail(ScriptError::OP_COUNT);
+
+        if (IsDisabled(op.opcode))
+            return fail(ScriptError::DISABLED_OPCODE);
+
+        if (op.opcode == OP_VERIF || op.opcode == OP_VERNOTIF)
+            return fail(ScriptError::BAD_OPCODE);
+
+        op.dataSize = (uint16_t)data.size;
+        op.dataOffset = data.size ? (uint32_t)(data.data - script.data) : (uint32_t)pos;
+        op.end = (uint32_t)pos;
+        ops.Push(op);
+    }
+
+    return true;
+}
+
+bool DecodedScript::IsPushOnly() const
+{
+    for (const ScriptOp& op : ops)
+        if (op.opcode > OP_16)
+            return false;
+    return true;
+}
+
+//
+// ================================================================
+//  Templates
+// ================================================================
+bool IsPayToPubKeyHash(ByteSpan s)
+{
+    return s.size == 25 &&
+           s[0] == OP_DUP && s[1] == OP_HASH160 && s[2] == 20 &&
+           s[23] == OP_EQUALVERIFY && s[24] == OP_CHECKSIG;
+}
+
+bool IsPayToScriptHash(ByteSpan s)
+{
+    return s.size == 23 &&
+           s[0] == OP_HASH160 && s[1] == 20 && s[22] == OP_EQUAL;
+}
+
+bool IsPayToWitnessPubKeyHash(ByteSpan s)
+{
+    return s.size == 22 && s[0] == OP_0 && s[1] == 20;
+}
+
+bool IsWitnessProgram(ByteSpan s, int& version, ByteSpan& program)
+{
+    if (s.size < 4 || s.size > 42)
+        return false;
+    if (s[0] != OP_0 && (s[0] < OP_1 || s[0] > OP_16))
+        return false;
+    if ((size_t)s[1] + 2 != s.size)
+        return false;
+
+    version = (s[0] == OP_0) ? 0 : s[0] - (OP_1 - 1);
+    program = s.Sub(2);
+    return true;
+}
+
+//
+// ================================================================
+//  Signature operation counting
+// ================================================================
+unsigned GetSigOpCount(ByteSpan script, bool accurate)
+{
+    unsigned n = 0;
+    uint8_t last = OP_INVALIDOPCODE;
+    uint8_t opcode;
+    size_t pos = 0;
+
+    while (GetScriptOp(script, pos, opcode, nullptr))
+    {
+        if (opcode == OP_CHECKSIG || opcode == OP_CHECKSIGVERIFY)
+        {
+            n++;
+        }
+        else if (opcode == OP_CHECKMULTISIG || opcode == OP_CHECKMULTISIGVERIFY)
+        {
+            if (accurate && last >= OP_1 && last <= OP_16)
+                n += last - (OP_1 - 1);
+            else
+                n += MAX_PUBKEYS_PER_MULTISIG;
+        }
+        last = opcode;
+    }
+    return n;
+}
@@ -0,0 +1,275 @@
+#ifndef DRACHMA_SCRIPT_SCRIPT_H
+#define DRACHMA_SCRIPT_SCRIPT_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "arena.h"
+#include "../../common/utils/span.h"
+
+// Consensus limits
+static const size_t MAX_SCRIPT_SIZE = 10000;
+static const size_t MAX_SCRIPT_ELEMENT_SIZE = 520;
+static const int MAX_OPS_PER_SCRIPT = 201;
+static const int MAX_PUBKEYS_PER_MULTISIG = 20;
+static const size_t MAX_STACK_SIZE = 1000;
+
+enum class ScriptError
+{
+    OK = 0,
+    UNKNOWN,
+    EVAL_FALSE,
+    OP_RETURN,
+
+    // limits
+    SCRIPT_SIZE,
+    PUSH_SIZE,
+    OP_COUNT,
+    STACK_SIZE,
+    SIG_COUNT,
+    PUBKEY_COUNT,
+
+    // failed *VERIFY operations
+    VERIFY,
+    EQUALVERIFY,
+    CHECKMULTISIGVERIFY,
+    CHECKSIGVERIFY,
+    NUMEQUALVERIFY,
+
+    // logical / format / canonical errors
+    BAD_OPCODE,
+    DISABLED_OPCODE,
+    INVALID_STACK_OPERATION,
+    INVALID_ALTSTACK_OPERATION,
+    UNBALANCED_CONDITIONAL,
+    NUM_OVERFLOW,
+    MINIMALDATA,
+    SIG_PUSHONLY,
+    SIG_NULLDUMMY,
+    SIG_DER,
+    CLEANSTACK,
+
+    // locktime
+    NEGATIVE_LOCKTIME,
+    UNSATISFIED_LOCKTIME,
+
+    // segwit
+    WITNESS_PROGRAM_WRONG_LENGTH,
+    WITNESS_PROGRAM_WITNESS_EMPTY,
+    WITNESS_PROGRAM_MISMATCH,
+    WITNESS_MALLEATED,
+    WITNESS_MALLEATED_P2SH,
+    WITNESS_UNEXPECTED
+};
+
+const char* ScriptErrorString(ScriptError error);
+
+enum OpcodeType : uint8_t
+{
+    // push value
+    OP_0 = 0x00,
+    OP_FALSE = OP_0,
+    OP_PUSHDATA1 = 0x4c,
+    OP_PUSHDATA2 = 0x4d,
+    OP_PUSHDATA4 = 0x4e,
+    OP_1NEGATE = 0x4f,
+    OP_RESERVED = 0x50,
+    OP_1 = 0x51,
+    OP_TRUE = OP_1,
+    OP_2 = 0x52,
+    OP_3 = 0x53,
+    OP_4 = 0x54,
+    OP_5 = 0x55,
+    OP_6 = 0x56,
+    OP_7 = 0x57,
+    OP_8 = 0x58,
+    OP_9 = 0x59,
+    OP_10 = 0x5a,
+    OP_11 = 0x5b,
+    OP_12 = 0x5c,
+    OP_13 = 0x5d,
+    OP_14 = 0x5e,
+    OP_15 = 0x5f,
+    OP_16 = 0x60,
+
+    // control
+    OP_NOP = 0x61,
+    OP_VER = 0x62,
+    OP_IF = 0x63,
+    OP_NOTIF = 0x64,
+    OP_VERIF = 0x65,
+    OP_VERNOTIF = 0x66,
+    OP_ELSE = 0x67,
+    OP_ENDIF = 0x68,
+    OP_VERIFY = 0x69,
+    OP_RETURN = 0x6a,
+
+    // stack ops
+    OP_TOALTSTACK = 0x6b,
+    OP_FROMALTSTACK = 0x6c,
+    OP_2DROP = 0x6d,
+    OP_2DUP = 0x6e,
+    OP_3DUP = 0x6f,
+    OP_2OVER = 0x70,
+    OP_2ROT = 0x71,
+    OP_2SWAP = 0x72,
+    OP_IFDUP = 0x73,
+    OP_DEPTH = 0x74,
+    OP_DROP = 0x75,
+    OP_DUP = 0x76,
+    OP_NIP = 0x77,
+    OP_OVER = 0x78,
+    OP_PICK = 0x79,
+    OP_ROLL = 0x7a,
+    OP_ROT = 0x7b,
+    OP_SWAP = 0x7c,
+    OP_TUCK = 0x7d,
+
+    // splice ops
+    OP_CAT = 0x7e,
+    OP_SUBSTR = 0x7f,
+    OP_LEFT = 0x80,
+    OP_RIGHT = 0x81,
+    OP_SIZE = 0x82,
+
+    // bit logic
+    OP_INVERT = 0x83,
+    OP_AND = 0x84,
+    OP_OR = 0x85,
+    OP_XOR = 0x86,
+    OP_EQUAL = 0x87,
+    OP_EQUALVERIFY = 0x88,
+    OP_RESERVED1 = 0x89,
+    OP_RESERVED2 = 0x8a,
+
+    // numeric
+    OP_1ADD = 0x8b,
+    OP_1SUB = 0x8c,
+    OP_2MUL = 0x8d,
+    OP_2DIV = 0x8e,
+    OP_NEGATE = 0x8f,
+    OP_ABS = 0x90,
+    OP_NOT = 0x91,
+    OP_0NOTEQUAL = 0x92,
+
+    OP_ADD = 0x93,
+    OP_SUB = 0x94,
+    OP_MUL = 0x95,
+    OP_DIV = 0x96,
+    OP_MOD = 0x97,
+    OP_LSHIFT = 0x98,
+    OP_RSHIFT = 0x99,
+
+    OP_BOOLAND = 0x9a,
+    OP_BOOLOR = 0x9b,
+    OP_NUMEQUAL = 0x9c,
+    OP_NUMEQUALVERIFY = 0x9d,
+    OP_NUMNOTEQUAL = 0x9e,
+    OP_LESSTHAN = 0x9f,
+    OP_GREATERTHAN = 0xa0,
+    OP_LESSTHANOREQUAL = 0xa1,
+    OP_GREATERTHANOREQUAL = 0xa2,
+    OP_MIN = 0xa3,
+    OP_MAX = 0xa4,
+
+    OP_WITHIN = 0xa5,
+
+    // crypto
+    OP_RIPEMD160 = 0xa6,
+    OP_SHA1 = 0xa7,
+    OP_SHA256 = 0xa8,
+    OP_HASH160 = 0xa9,
+    OP_HASH256 = 0xaa,
+    OP_CODESEPARATOR = 0xab,
+    OP_CHECKSIG = 0xac,
+    OP_CHECKSIGVERIFY = 0xad,
+    OP_CHECKMULTISIG = 0xae,
+    OP_CHECKMULTISIGVERIFY = 0xaf,
+
+    // expansion
+    OP_NOP1 = 0xb0,
+    OP_CHECKLOCKTIMEVERIFY = 0xb1,
+    OP_CHECKSEQUENCEVERIFY = 0xb2,
+    OP_NOP4 = 0xb3,
+    OP_NOP5 = 0xb4,
+    OP_NOP6 = 0xb5,
+    OP_NOP7 = 0xb6,
+    OP_NOP8 = 0xb7,
+    OP_NOP9 = 0xb8,
+    OP_NOP10 = 0xb9,
+
+    OP_INVALIDOPCODE = 0xff
+};
+
+//
+// One decoded instruction. Push data is referenced by offset into
+// the script, not copied.
+//
+struct ScriptOp
+{
+    uint8_t opcode;
+    uint16_t dataSize;              // pushes only (<= MAX_SCRIPT_ELEMENT_SIZE)
+    uint32_t dataOffset;
+    uint32_t end;                   // offset of the next instruction
+};
+
+//
+// Reads one instruction at `pos` the way the interpreter steps
+// through raw bytes. False on a truncated push.
+//
+bool GetScriptOp(ByteSpan script, size_t& pos, uint8_t& opcode, ByteSpan* data);
+
+//
+// ===============================================================
+//  CLASS: DecodedScript
+// ===============================================================
+//
+//  A script split into ScriptOps once, up front, so execution is a
+//  walk over a flat array instead of re-parsing push lengths.
+//
+//  Everything that makes a script fail no matter which branch runs
+//  is caught while decoding: size limit, truncated pushes, pushes
+//  over 520 bytes, more than 201 counted opcodes, disabled opcodes
+//  and OP_VERIF / OP_VERNOTIF.
+//
+// ===============================================================
+//
+class DecodedScript
+{
+public:
+    explicit DecodedScript(ScriptArena& arena) : ops(arena) {}
+
+    // False if the script can never succeed
+    bool Decode(ByteSpan script, ScriptError* error);
+
+    ByteSpan GetScript() const { return script; }
+    const ArenaVector<ScriptOp, 32>& GetOps() const { return ops; }
+
+    ByteSpan GetData(const ScriptOp& op) const { return script.Sub(op.dataOffset, op.dataSize); }
+
+    // Only pushes (opcodes up to OP_16)
+    bool IsPushOnly() const;
+
+private:
+    ByteSpan script;
+    ArenaVector<ScriptOp, 32> ops;
+};
+
+//
+// Standard templates (byte-exact matches)
+//
+bool IsPayToPubKeyHash(ByteSpan script);            // DUP HASH160 <20> EQUALVERIFY CHECKSIG
+bool IsPayToScriptHash(ByteSpan script);            // HASH160 <20> EQUAL
+bool IsPayToWitnessPubKeyHash(ByteSpan script);     // 0 <20>
+
+// Version byte and 2..40 byte program
+bool IsWitnessProgram(ByteSpan script, int& version, ByteSpan& program);
+
+//
+// Signature operations, counted the way Bitcoin's limits do:
+// CHECKMULTISIG counts 20 unless `accurate` and preceded by OP_n.
+// Counting stops at a truncated push.
+//
+unsigned GetSigOpCount(ByteSpan script, bool accurate);
+
+#endif // DRACHMA_SCRIPT_SCRIPT_H
@@ -0,0 +1,261 @@
+#include "sighash.h"
+#include "../../common/utils/serialize.h"
+
+#include <cstring>
+#include <vector>
+
+static const uint8_t OP_CODESEPARATOR = 0xab;
+
+static void HashCompactSize(::SHA256& ctx, uint64_t n)
+{
+    uint8_t buf[9];
+    ctx.Update(buf, WriteCompactSize(buf, n));
+}
+
+static void HashU32(::SHA256& ctx, uint32_t v)
+{
+    uint8_t b[4];
+    WriteLE32(b, v);
+    ctx.Update(b, 4);
+}
+
+static void HashU64(::SHA256& ctx, uint64_t v)
+{
+    uint8_t b[8];
+    WriteLE64(b, v);
+    ctx.Update(b, 8);
+}
+
+static void HashOutput(::SHA256& ctx, const TxOutView& out)
+{
+    HashU64(ctx, (uint64_t)out.amount);
+    HashCompactSize(ctx, out.script.size);
+    ctx.Update(out.script.data, out.script.size);
+}
+
+// Second round of SHA256D
+static void FinishDouble(::SHA256& ctx, uint8_t out[32])
+{
+    ctx.Final(out);
+    ctx.Reset();
+    ctx.Update(out, 32);
+    ctx.Final(out);
+}
+
+//
+// Legacy scriptCode with OP_CODESEPARATORs removed. Bytes after a
+// truncated push are kept as they are.
+//
+static void StripCodeSeparators(ByteSpan script, std::vector<uint8_t>& out)
+{
+    out.clear();
+    size_t i = 0;
+    while (i < script.size)
+    {
+        const size_t start = i;
+        const uint8_t op = script[i++];
+
+        size_t push = 0;
+        if (op >= 0x01 && op <= 0x4b)
+        {
+            push = op;
+        }
+        else if (op >= 0x4c && op <= 0x4e)
+        {
+            const size_t width = (op == 0x4c) ? 1 : (op == 0x4d) ? 2 : 4;
+            if (script.size - i < width)
+                break;
+            push = (width == 1) ? script[i] : (width == 2) ? ReadLE16(script.data + i)
+                                                           : ReadLE32(script.data + i);
+            i += width;
+        }
+
+        if (script.size - i < push)
+        {
+            i = start;
+            break;
+        }
+        i += push;
+
+        if (op != OP_CODESEPARATOR)
+            out.insert(out.end(), script.data + start, script.data + i);
+    }
+
+    out.insert(out.end(), script.data + i, script.data + script.size);
+}
+
+//
+// ================================================================
+//  PrecomputedTxData
+// ================================================================
+PrecomputedTxData::PrecomputedTxData(const TransactionView& t)
+    : tx(t)
+{
+    ::SHA256 prevouts, sequences, outputs;
+
+    for (const TxInView& in : tx.Inputs())
+    {
+        // txid and index are contiguous in the serialized input
+        prevouts.Update(in.prevTxid, 36);
+        HashU32(sequences, in.sequence);
+    }
+
+    for (const TxOutView& out : tx.Outputs())
+        HashOutput(outputs, out);
+
+    FinishDouble(prevouts, hashPrevouts.data());
+    FinishDouble(sequences, hashSequence.data());
+    FinishDouble(outputs, hashOutputs.data());
+
+    static const uint8_t zero[32] = {};
+
+    const uint8_t* prefixes[PREFIX_COUNT][2] =
+    {
+        { hashPrevouts.data(), hashSequence.data() },
+        { hashPrevouts.data(), zero },
+        { zero, zero }
+    };
+
+    // 68 bytes each: one compressed block plus 4 buffered bytes
+    for (int p = 0; p < PREFIX_COUNT; ++p)
+    {
+        HashU32(midstate[p], (uint32_t)tx.GetVersion());
+        midstate[p].Update(prefixes[p][0], 32);
+        midstate[p].Update(prefixes[p][1], 32);
+    }
+}
+
+//
+// ================================================================
+//  SignatureHash
+// ================================================================
+static bool LegacySignatureHash(const TransactionView& tx, uint32_t input, ByteSpan scriptCode,
+                                uint32_t hashType, uint8_t out[32])
+{
+    const std::vector<TxInView>& vin = tx.Inputs();
+    const std::vector<TxOutView>& vout = tx.Outputs();
+
+    const uint32_t base = hashType & 0x1f;
+    const bool anyoneCanPay = (hashType & SIGHASH_ANYONECANPAY) != 0;
+
+    // Historic quirk: SINGLE without a matching output signs "1"
+    if (base == SIGHASH_SINGLE && input >= vout.size())
+    {
+        std::memset(out, 0, 32);
+        out[0] = 1;
+        return true;
+    }
+
+    std::vector<uint8_t> stripped;
+    bool hasSeparator = false;
+    for (uint8_t b : scriptCode)
+        hasSeparator = hasSeparator || b == OP_CODESEPARATOR;
+    if (hasSeparator)
+    {
+        StripCodeSeparators(scriptCode, stripped);
+        scriptCode = ByteSpan(stripped);
+    }
+
+    ::SHA256 ctx;
+    HashU32(ctx, (uint32_t)tx.GetVersion());
+
+    const size_t nIn = anyoneCanPay ? 1 : vin.size();
+    HashCompactSize(ctx, nIn);
+    for (size_t k = 0; k < nIn; ++k)
+    {
+        const size_t i = anyoneCanPay ? input : k;
+        const TxInView& in = vin[i];
+
+        ctx.Update(in.prevTxid, 36);
+
+        if (i == input)
+        {
+            HashCompactSize(ctx, scriptCode.size);
+            ctx.Update(scriptCode.data, scriptCode.size);
+        }
+        else
+        {
+            HashCompactSize(ctx, 0);
+        }
+
+        const bool zeroSequence = i != input && (base == SIGHASH_NONE || base == SIGHASH_SINGLE);
+        HashU32(ctx, zeroSequence ? 0 : in.sequence);
+    }
+
+    const size_t nOut = (base == SIGHASH_NONE) ? 0 : (base == SIGHASH_SINGLE) ? input + 1 : vout.size();
+    HashCompactSize(ctx, nOut);
+    for (size_t k = 0; k < nOut; ++k)
+    {
+        if (base == SIGHASH_SINGLE && k != input)
+        {
+            HashU64(ctx, 0xFFFFFFFFFFFFFFFFULL);
+            HashCompactSize(ctx, 0);
+        }
+        else
+        {
+            HashOutput(ctx, vout[k]);
+        }
+    }
+
+    HashU32(ctx, tx.GetLockTime());
+    HashU32(ctx, hashType);
+
+    FinishDouble(ctx, out);
+    return true;
+}
+
+bool SignatureHash(const PrecomputedTxData& data, uint32_t input, ByteSpan scriptCode,
+                   int64_t amount, uint32_t hashType, SigVersion sigversion,
+                   uint8_t out[32])
+{
+    const TransactionView& tx = data.tx;
+    if (input >= tx.Inputs().size())
+        return false;
+
+    if (sigversion == SigVersion::BASE)
+        return LegacySignatureHash(tx, input, scriptCode, hashType, out);
+
+    const uint32_t base = hashType & 0x1f;
+    const bool anyoneCanPay = (hashType & SIGHASH_ANYONECANPAY) != 0;
+    const bool allOutputs = base != SIGHASH_SINGLE && base != SIGHASH_NONE;
+
+    int prefix = PrecomputedTxData::PREFIX_NONE;
+    if (!anyoneCanPay)
+        prefix = allOutputs ? PrecomputedTxData::PREFIX_ALL : PrecomputedTxData::PREFIX_NO_SEQUENCE;
+
+    // Resume from the cached state instead of rehashing the prefix
+    ::SHA256 ctx = data.midstate[prefix];
+
+    const TxInView& in = tx.Inputs()[input];
+    ctx.Update(in.prevTxid, 36);
+
+    HashCompactSize(ctx, scriptCode.size);
+    ctx.Update(scriptCode.data, scriptCode.size);
+
+    HashU64(ctx, (uint64_t)amount);
+    HashU32(ctx, in.sequence);
+
+    if (allOutputs)
+    {
+        ctx.Update(data.hashOutputs.data(), 32);
+    }
+    else if (base == SIGHASH_SINGLE && input < tx.Outputs().size())
+    {
+        uint8_t single[32];
+        ::SHA256 one;
+        HashOutput(one, tx.Outputs()[input]);
+        FinishDouble(one, single);
+        ctx.Update(single, 32);
+    }
+    else
+    {
+        static const uint8_t zero[32] = {};
+        ctx.Update(zero, 32);
+    }
+
+    HashU32(ctx, tx.GetLockTime());
+    HashU32(ctx, hashType);
+
+    FinishDouble(ctx, out);
+    return true;
+}
@@ -0,0 +1,91 @@
+#ifndef DRACHMA_SCRIPT_SIGHASH_H
+#define DRACHMA_SCRIPT_SIGHASH_H
+
+#include <array>
+#include <cstdint>
+
+#include "../crypto/sha256.h"
+#include "../tx/txview.h"
+#include "../../common/utils/span.h"
+
+enum SigHashType : uint32_t
+{
+    SIGHASH_ALL          = 1,
+    SIGHASH_NONE         = 2,
+    SIGHASH_SINGLE       = 3,
+    SIGHASH_ANYONECANPAY = 0x80
+};
+
+enum class SigVersion
+{
+    BASE,           // legacy serialization
+    WITNESS_V0      // BIP143
+};
+
+//
+// ===============================================================
+//  CLASS: PrecomputedTxData
+// ===============================================================
+//
+//  Per-transaction part of the BIP143 signature hash, built once
+//  and shared by every input (and every checking thread):
+//
+//    hashPrevouts = SHA256D(all outpoints)
+//    hashSequence = SHA256D(all nSequence)
+//    hashOutputs  = SHA256D(all outputs)
+//
+//  The preimage of each input starts with the same 68 bytes
+//  (version | hashPrevouts | hashSequence), so the SHA256 state
+//  after absorbing them is cached too – one midstate for each of
+//  the three combinations the hash type can select. An input's
+//  hash then costs a copy of that state plus its own ~100-200
+//  bytes, independent of the number of inputs.
+//
+//  Legacy (BASE) hashes serialize the whole modified transaction
+//  per input and stay O(size) each; only the raw outpoints are
+//  reused from the buffer.
+//
+// ===============================================================
+//
+class PrecomputedTxData
+{
+public:
+    explicit PrecomputedTxData(const TransactionView& tx);
+
+    const TransactionView& GetTx() const { return tx; }
+
+    const std::array<uint8_t,32>& GetHashPrevouts() const { return hashPrevouts; }
+    const std::array<uint8_t,32>& GetHashSequence() const { return hashSequence; }
+    const std::array<uint8_t,32>& GetHashOutputs() const { return hashOutputs; }
+
+private:
+    friend bool SignatureHash(const PrecomputedTxData& data, uint32_t input, ByteSpan scriptCode,
+                              int64_t amount, uint32_t hashType, SigVersion sigversion,
+                              uint8_t out[32]);
+
+    enum Prefix
+    {
+        PREFIX_ALL = 0,         // hashPrevouts | hashSequence
+        PREFIX_NO_SEQUENCE,     // hashPrevouts | zero
+        PREFIX_NONE,            // zero | zero (ANYONECANPAY)
+        PREFIX_COUNT
+    };
+
+    const TransactionView& tx;
+
+    std::array<uint8_t,32> hashPrevouts;
+    std::array<uint8_t,32> hashSequence;
+    std::array<uint8_t,32> hashOutputs;
+
+    ::SHA256 midstate[PREFIX_COUNT];
+};
+
+//
+// Signature hash of input `input` spending an output of `amount`
+// with `scriptCode`. False if `input` is out of range.
+//
+bool SignatureHash(const PrecomputedTxData& data, uint32_t input, ByteSpan scriptCode,
+                   int64_t amount, uint32_t hashType, SigVersion sigversion,
+                   uint8_t out[32]);
+
+#endif // DRACHMA_SCRIPT_SIGHASH_H
@@ -0,0 +1,167 @@
+#include "sighashbench.h"
+#include "../tx/transaction.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <random>
+
+typedef std::chrono::steady_clock Clock;
+
+static double NanosSince(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+static void RandomBytes(std::mt19937_64& rng, uint8_t* out, size_t len)
+{
+    for (size_t i = 0; i < len; i += 8)
+    {
+        const uint64_t r = rng();
+        std::memcpy(out + i, &r, std::min<size_t>(8, len - i));
+    }
+}
+
+// DUP HASH160 <20> EQUALVERIFY CHECKSIG
+static std::vector<uint8_t> RandomScript(std::mt19937_64& rng)
+{
+    std::vector<uint8_t> s = { 0x76, 0xa9, 20 };
+    s.resize(23);
+    RandomBytes(rng, s.data() + 3, 20);
+    s.push_back(0x88);
+    s.push_back(0xac);
+    return s;
+}
+
+static void MakeTransaction(std::mt19937_64& rng, size_t inputs, size_t outputs,
+                            std::vector<uint8_t>& raw)
+{
+    Transaction tx;
+    tx.version = 2;
+
+    tx.vin.resize(inputs);
+    for (TxIn& in : tx.vin)
+    {
+        RandomBytes(rng, in.prevout.txid.data(), 32);
+        in.prevout.index = (uint32_t)(rng() % 4);
+        in.sequence = 0xFFFFFFFD;
+
+        // A signature-sized scriptSig keeps the legacy hash honest
+        in.scriptSig.resize(107);
+        RandomBytes(rng, in.scriptSig.data(), in.scriptSig.size());
+    }
+
+    for (size_t o = 0; o < outputs; ++o)
+        tx.vout.push_back(TxOut((int64_t)(rng() % 100000000), RandomScript(rng)));
+
+    raw.clear();
+    tx.Serialize(raw, false);
+}
+
+bool SighashBenchmark::Run(const Options& opts, std::vector<Report>& reports, std::string* reason)
+{
+    reports.clear();
+
+    if (opts.minHashes == 0)
+    {
+        if (reason)
+            *reason = "minHashes must be set";
+        return false;
+    }
+
+    std::mt19937_64 rng(std::random_device{}());
+    uint8_t hash[32];
+    volatile uint8_t sink = 0;          // keeps the hashing observable
+
+    for (size_t n : opts.inputs)
+    {
+        if (n == 0)
+            continue;
+
+        std::vector<uint8_t> raw;
+        MakeTransaction(rng, n, opts.outputs, raw);
+
+        TransactionView tx;
+        if (!tx.Parse(ByteSpan(raw)))
+        {
+            if (reason)
+                *reason = "synthetic transaction does not parse";
+            return false;
+        }
+
+        std::vector<std::vector<uint8_t>> scriptCodes(n);
+        std::vector<int64_t> amounts(n);
+        for (size_t j = 0; j < n; ++j)
+        {
+            scriptCodes[j] = RandomScript(rng);
+            amounts[j] = (int64_t)(rng() % 100000000);
+        }
+
+        const size_t rounds = (opts.minHashes + n - 1) / n;
+        const double hashes = (double)rounds * n;
+
+        Report report = Report();
+        report.inputs = n;
+        report.txBytes = raw.size();
+
+        const PrecomputedTxData shared(tx);
+
+        if (n <= opts.legacyMaxInputs)
+        {
+            const Clock::time_point start = Clock::now();
+            for (size_t r = 0; r < rounds; ++r)
+            {
+                for (uint32_t j = 0; j < n; ++j)
+                {
+                    SignatureHash(shared, j, ByteSpan(scriptCodes[j]), amounts[j], SIGHASH_ALL,
+                                  SigVersion::BASE, hash);
+                    sink = sink ^ hash[0];
+                }
+            }
+            report.legacyNs = NanosSince(start) / hashes;
+        }
+
+        {
+            const Clock::time_point start = Clock::now();
+            for (size_t r = 0; r < rounds; ++r)
+            {
+                for (uint32_t j = 0; j < n; ++j)
+                {
+                    const PrecomputedTxData fresh(tx);
+                    SignatureHash(fresh, j, ByteSpan(scriptCodes[j]), amounts[j], SIGHASH_ALL,
+                                  SigVersion::WITNESS_V0, hash);
+                    sink = sink ^ hash[0];
+                }
+            }
+            report.uncachedNs = NanosSince(start) / hashes;
+        }
+
+        {
+            const Clock::time_point start = Clock::now();
+            for (size_t r = 0; r < rounds; ++r)
+            {
+                const PrecomputedTxData setup(tx);
+                sink = sink ^ setup.GetHashOutputs()[0];
+            }
+            report.setupNs = NanosSince(start) / rounds;
+        }
+
+        {
+            const Clock::time_point start = Clock::now();
+            for (size_t r = 0; r < rounds; ++r)
+            {
+                for (uint32_t j = 0; j < n; ++j)
+                {
+                    SignatureHash(shared, j, ByteSpan(scriptCodes[j]), amounts[j], SIGHASH_ALL,
+                                  SigVersion::WITNESS_V0, hash);
+                    sink = sink ^ hash[0];
+                }
+            }
+            report.precomputedNs = NanosSince(start) / hashes;
+        }
+
+        report.txMicros = (report.setupNs + report.precomputedNs * n) / 1000.0;
+        reports.push_back(report);
+    }
+    return true;
+}
@@ -0,0 +1,66 @@
+#ifndef DRACHMA_SCRIPT_SIGHASHBENCH_H
+#define DRACHMA_SCRIPT_SIGHASHBENCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "sighash.h"
+
+//
+// ===============================================================
+//  CLASS: SighashBenchmark
+// ===============================================================
+//
+//  Signature hashing cost against the number of inputs. For every
+//  count in `inputs` a transaction with that many P2PKH-style
+//  inputs and two outputs is hashed, input by input, with
+//  SIGHASH_ALL three ways:
+//
+//    legacy      – SigVersion::BASE, which serializes the whole
+//                  transaction per input (quadratic; skipped above
+//                  `legacyMaxInputs`)
+//    uncached    – BIP143 with a PrecomputedTxData built per input,
+//                  i.e. hashPrevouts / hashSequence / hashOutputs
+//                  redone for each signature
+//    precomputed – BIP143 with one PrecomputedTxData shared by all
+//                  inputs, as IBDPipeline does
+//
+//  Each variant repeats the transaction until at least `minHashes`
+//  hashes were taken. Report per count: nanoseconds per input
+//  hash for each variant and the whole transaction's precomputed
+//  cost (setup included).
+//
+// ===============================================================
+//
+class SighashBenchmark
+{
+public:
+    struct Options
+    {
+        std::vector<size_t> inputs;
+        size_t outputs;
+        size_t minHashes;
+        size_t legacyMaxInputs;
+
+        Options()
+            : inputs({1, 10, 100, 1000, 5000}), outputs(2), minHashes(20000),
+              legacyMaxInputs(1000) {}
+    };
+
+    struct Report
+    {
+        size_t inputs;
+        size_t txBytes;
+        double legacyNs;                // per input; 0 when skipped
+        double uncachedNs;
+        double precomputedNs;
+        double setupNs;                 // one PrecomputedTxData
+        double txMicros;                // setup plus every input, precomputed
+    };
+
+    static bool Run(const Options& opts, std::vector<Report>& reports, std::string* reason = nullptr);
+};
+
+#endif // DRACHMA_SCRIPT_SIGHASHBENCH_H
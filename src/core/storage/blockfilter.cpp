@@ -0,0 +1,569 @@
+#include "blockfilter.h"
+#include "../chain/block.h"
+#include "../chain/undo.h"
+#include "../crypto/hash.h"
+#include "../crypto/siphash.h"
+#include "../../common/utils/serialize.h"
+
+#include <algorithm>
+#include <cstring>
+
+static const uint8_t OP_RETURN = 0x6a;
+
+static bool SetReason(std::string* reason, const std::string& why)
+{
+    if (reason)
+        *reason = why;
+    return false;
+}
+
+//
+// ===============================================================
+//  Golomb-Rice bit streams
+// ===============================================================
+//
+struct BitWriter
+{
+    std::vector<uint8_t>& out;
+    uint64_t acc;
+    int bits;
+
+    explicit BitWriter(std::vector<uint8_t>& o) : out(o), acc(0), bits(0) {}
+
+    // n <= 32
+    void Write(uint64_t v, int n)
+    {
+        acc = (acc << n) | (v & ((1ULL << n) - 1));
+        bits += n;
+        while (bits >= 8)
+        {
+            bits -= 8;
+            out.push_back((uint8_t)(acc >> bits));
+        }
+    }
+
+    void WriteGolomb(uint64_t delta)
+    {
+        uint64_t q = delta >> GCSFilter::P;
+        while (q >= 32)
+        {
+            Write(0xFFFFFFFF, 32);
+            q -= 32;
+        }
+        Write(((1ULL << q) - 1) << 1, (int)q + 1);
+        Write(delta, GCSFilter::P);
+    }
+
+    void Flush()
+    {
+        if (bits > 0)
+            out.push_back((uint8_t)(acc << (8 - bits)));
+        bits = 0;
+    }
+};
+
+struct BitReader
+{
+    const uint8_t* p;
+    const uint8_t* end;
+    uint64_t acc;                       // low `bits` bits are unread
+    int bits;
+
+    BitReader(const uint8_t* b, const uint8_t* e) : p(b), end(e), acc(0), bits(0) {}
+
+    void Refill()
+    {
+        while (bits <= 56 && p < end)
+        {
+            acc = (acc << 8) | *p++;
+            bits += 8;
+        }
+    }
+
+    bool ReadGolomb(uint64_t& delta)
+    {
+        // Unary quotient: ones up to a zero
+        uint64_t q = 0;
+        for (;;)
+        {
+            Refill();
+            if (bits == 0)
+                return false;
+
+            const uint64_t top = acc << (64 - bits);
+            const int ones = ~top ? std::min(__builtin_clzll(~top), bits) : bits;
+            if (ones < bits)
+            {
+                q += ones;
+                bits -= ones + 1;
+                break;
+            }
+            q += ones;
+            bits = 0;
+        }
+
+        Refill();
+        if (bits < GCSFilter::P)
+            return false;
+
+        bits -= GCSFilter::P;
+        delta = (q << GCSFilter::P) | ((acc >> bits) & ((1ULL << GCSFilter::P) - 1));
+        return true;
+    }
+};
+
+// SipHash of every element onto [0, range), sorted
+static void HashElements(const GCSFilter::Hash256& blockHash, uint64_t range,
+                         const std::vector<ByteSpan>& elements, std::vector<uint64_t>& out)
+{
+    const uint64_t k0 = ReadLE64(blockHash.data());
+    const uint64_t k1 = ReadLE64(blockHash.data() + 8);
+
+    out.resize(elements.size());
+    for (size_t i = 0; i < elements.size(); ++i)
+    {
+        const uint64_t h = SipHasher(k0, k1).Write(elements[i].data, elements[i].size).Finalize();
+        out[i] = (uint64_t)(((unsigned __int128)h * range) >> 64);
+    }
+    std::sort(out.begin(), out.end());
+}
+
+//
+// ===============================================================
+//  GCSFilter
+// ===============================================================
+//
+void GCSFilter::Build(const Hash256& blockHash, std::vector<ByteSpan> elements, std::vector<uint8_t>& out)
+{
+    auto less = [](const ByteSpan& a, const ByteSpan& b) {
+        return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end());
+    };
+    auto equal = [](const ByteSpan& a, const ByteSpan& b) {
+        return a.size == b.size && (a.size == 0 || std::memcmp(a.data, b.data, a.size) == 0);
+    };
+    std::sort(elements.begin(), elements.end(), less);
+    elements.erase(std::unique(elements.begin(), elements.end(), equal), elements.end());
+
+    const uint64_t n = elements.size();
+
+    std::vector<uint64_t> values;
+    HashElements(blockHash, n * M, elements, values);
+
+    out.clear();
+    out.reserve(CompactSizeLen(n) + (n * (P + 2) + 7) / 8);
+    AppendCompactSize(out, n);
+
+    BitWriter writer(out);
+    uint64_t last = 0;
+    for (uint64_t v : values)
+    {
+        writer.WriteGolomb(v - last);
+        last = v;
+    }
+    writer.Flush();
+}
+
+bool GCSFilter::GetSize(ByteSpan filter, uint64_t& n)
+{
+    SpanReader in(filter);
+    return in.ReadCompactSize(n, false);
+}
+
+bool GCSFilter::MatchSorted(ByteSpan filter, uint64_t n, const uint64_t* values, size_t count)
+{
+    const size_t header = CompactSizeLen(n);
+    BitReader reader(filter.data + header, filter.end());
+
+    const uint64_t range = n * M;
+    const uint64_t* q = values;
+    const uint64_t* qend = values + count;
+
+    uint64_t value = 0;
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        uint64_t delta;
+        if (!reader.ReadGolomb(delta))
+            return false;
+        value += delta;
+        if (value >= range)
+            return false;
+
+        while (q < qend && *q < value)
+            ++q;
+        if (q == qend)
+            return false;
+        if (*q == value)
+            return true;
+    }
+    return false;
+}
+
+bool GCSFilter::Match(const Hash256& blockHash, ByteSpan filter, ByteSpan element)
+{
+    return MatchAny(blockHash, filter, std::vector<ByteSpan>(1, element));
+}
+
+bool GCSFilter::MatchAny(const Hash256& blockHash, ByteSpan filter, const std::vector<ByteSpan>& elements)
+{
+    uint64_t n;
+    if (!GetSize(filter, n) || n == 0 || elements.empty())
+        return false;
+
+    // A corrupt N cannot claim more elements than it has bits for
+    if (n > (filter.size - CompactSizeLen(n)) * 8 / (P + 1))
+        return false;
+
+    std::vector<uint64_t> values;
+    HashElements(blockHash, n * M, elements, values);
+    return MatchSorted(filter, n, values.data(), values.size());
+}
+
+//
+// ===============================================================
+//  Basic filters
+// ===============================================================
+//
+void GetBasicFilterElements(const BlockView& block, const BlockUndo& undo, std::vector<ByteSpan>& out)
+{
+    out.clear();
+
+    for (const TransactionView& tx : block.vtx)
+    {
+        for (const TxOutView& o : tx.Outputs())
+        {
+            if (o.script.size == 0 || o.script[0] == OP_RETURN)
+                continue;
+            out.push_back(o.script);
+        }
+    }
+
+    for (const TxUndo& tx : undo.txs)
+    {
+        for (const Coin& coin : tx.spent)
+        {
+            if (!coin.script.empty())
+                out.push_back(ByteSpan(coin.script));
+        }
+    }
+}
+
+std::array<uint8_t,32> ComputeFilterHeader(ByteSpan filter, const std::array<uint8_t,32>& prevHeader)
+{
+    uint8_t buf[64];
+    Hash::SHA256D(filter.data, filter.size, buf);
+    std::memcpy(buf + 32, prevHeader.data(), 32);
+
+    std::array<uint8_t,32> out;
+    Hash::SHA256D(buf, sizeof(buf), out.data());
+    return out;
+}
+
+//
+// ===============================================================
+//  BlockFilterIndex
+// ===============================================================
+//
+BlockFilterIndex::BlockFilterIndex(Scheduler& s, const Options& o)
+    : scheduler(s), opts(o)
+{
+    if (opts.rangeBlocks == 0)
+        opts.rangeBlocks = 1;
+    if (opts.batchBlocks < opts.rangeBlocks)
+        opts.batchBlocks = opts.rangeBlocks;
+
+    statFilters = 0;
+    statElements = 0;
+    statFilterBytes = 0;
+    statQueries = 0;
+    statMatches = 0;
+}
+
+bool BlockFilterIndex::Open(const std::string& dir, std::string* reason)
+{
+    if (!store.Open(dir, opts.store))
+        return SetReason(reason, "cannot open the filter store in " + dir);
+    return true;
+}
+
+void BlockFilterIndex::Close()
+{
+    store.Close();
+}
+
+bool BlockFilterIndex::Sync()
+{
+    return store.Sync();
+}
+
+bool BlockFilterIndex::WriteFilter(const Hash256& hash, const Hash256& header, const std::vector<uint8_t>& filter)
+{
+    std::vector<uint8_t> record;
+    record.reserve(32 + filter.size());
+    record.insert(record.end(), header.begin(), header.end());
+    record.insert(record.end(), filter.begin(), filter.end());
+
+    if (!store.WriteBlock(hash, record.data(), record.size()))
+        return false;
+
+    statFilters++;
+    statFilterBytes += filter.size();
+    return true;
+}
+
+bool BlockFilterIndex::BuildRange(const BlockStore& blocks, const BlockStore& undo,
+                                  const std::vector<Hash256>& chain, int base, Range& range,
+                                  std::vector<Built>& out) const
+{
+    BlockView block;
+    BlockUndo blockUndo;
+    std::vector<ByteSpan> elements;
+
+    for (int h = range.begin; h < range.end; ++h)
+    {
+        Built& b = out[h - base];
+
+        b.skip = store.HaveBlock(chain[h]);
+        if (b.skip)
+            continue;
+
+        ByteSpan raw;
+        if (!blocks.ReadBlock(chain[h], raw))
+        {
+            range.error = "block at height " + std::to_string(h) + " not in the block store";
+            return false;
+        }
+        if (!block.Parse(raw))
+        {
+            range.error = "malformed block at height " + std::to_string(h);
+            return false;
+        }
+
+        // Genesis spends nothing and has no undo record
+        blockUndo.txs.clear();
+        if (h > 0)
+        {
+            ByteSpan rawUndo;
+            if (!undo.ReadBlock(chain[h], rawUndo) || !blockUndo.Deserialize(rawUndo))
+            {
+                range.error = "undo data at height " + std::to_string(h) + " missing or corrupt";
+                return false;
+            }
+        }
+
+        GetBasicFilterElements(block, blockUndo, elements);
+        range.elements += elements.size();
+
+        GCSFilter::Build(chain[h], elements, b.filter);
+        Hash::SHA256D(b.filter.data(), b.filter.size(), b.filterHash.data());
+    }
+    return true;
+}
+
+bool BlockFilterIndex::Build(const BlockStore& blocks, const BlockStore& undo, const std::vector<Hash256>& chain,
+                             int fromHeight, std::string* reason)
+{
+    if (fromHeight < 0 || (size_t)fromHeight > chain.size())
+        return SetReason(reason, "start height out of range");
+
+    Hash256 prevHeader = {};
+    if (fromHeight > 0 && !GetFilterHeader(chain[fromHeight - 1], prevHeader))
+        return SetReason(reason, "filter of block at height " + std::to_string(fromHeight - 1) + " missing");
+
+    for (size_t wave = (size_t)fromHeight; wave < chain.size(); wave += opts.batchBlocks)
+    {
+        const int base = (int)wave;
+        const int waveEnd = (int)std::min(wave + opts.batchBlocks, chain.size());
+
+        // 1. Filters, in parallel
+        std::vector<Built> built(waveEnd - base);
+        std::vector<Range> ranges;
+        for (int h = base; h < waveEnd; h += (int)opts.rangeBlocks)
+        {
+            Range r;
+            r.begin = h;
+            r.end = std::min(h + (int)opts.rangeBlocks, waveEnd);
+            r.ok = false;
+            r.elements = 0;
+            ranges.push_back(std::move(r));
+        }
+
+        {
+            TaskGroup group(scheduler, TASK_BACKGROUND);
+            for (Range& r : ranges)
+                group.Run([this, &blocks, &undo, &chain, base, &r, &built] {
+                    r.ok = BuildRange(blocks, undo, chain, base, r, built);
+                });
+            group.Wait();
+        }
+
+        for (const Range& r : ranges)
+        {
+            if (!r.ok)
+                return SetReason(reason, r.error);
+            statElements += r.elements;
+        }
+
+        // 2. Header chain, in height order
+        for (int h = base; h < waveEnd; ++h)
+        {
+            const Built& b = built[h - base];
+            if (b.skip)
+            {
+                if (!GetFilterHeader(chain[h], prevHeader))
+                    return SetReason(reason, "filter store read failed");
+                continue;
+            }
+
+            uint8_t buf[64];
+            std::memcpy(buf, b.filterHash.data(), 32);
+            std::memcpy(buf + 32, prevHeader.data(), 32);
+            Hash::SHA256D(buf, sizeof(buf), prevHeader.data());
+
+            if (!WriteFilter(chain[h], prevHeader, b.filter))
+                return SetReason(reason, "filter store write failed");
+        }
+    }
+    return true;
+}
+
+bool BlockFilterIndex::AddBlock(const Hash256& hash, const BlockView& block, const BlockUndo& undo,
+                                std::string* reason)
+{
+    if (store.HaveBlock(hash))
+        return true;
+
+    std::vector<uint8_t> filter;
+    const uint64_t elements = BuildFilter(hash, block, undo, filter);
+    return AddFilter(hash, block.header.prevHash, filter, elements, reason);
+}
+
+uint64_t BlockFilterIndex::BuildFilter(const Hash256& hash, const BlockView& block, const BlockUndo& undo,
+                                       std::vector<uint8_t>& filter)
+{
+    std::vector<ByteSpan> elements;
+    GetBasicFilterElements(block, undo, elements);
+
+    const uint64_t count = elements.size();
+    GCSFilter::Build(hash, std::move(elements), filter);
+    return count;
+}
+
+bool BlockFilterIndex::AddFilter(const Hash256& hash, const Hash256& prevHash, const std::vector<uint8_t>& filter,
+                                 uint64_t elements, std::string* reason)
+{
+    if (store.HaveBlock(hash))
+        return true;
+
+    Hash256 prevHeader = {};
+    const Hash256 zero = {};
+    if (prevHash != zero && !GetFilterHeader(prevHash, prevHeader))
+        return SetReason(reason, "filter of the parent block missing");
+
+    if (!WriteFilter(hash, ComputeFilterHeader(filter, prevHeader), filter))
+        return SetReason(reason, "filter store write failed");
+
+    statElements += elements;
+    return true;
+}
+
+bool BlockFilterIndex::GetFilter(const Hash256& hash, ByteSpan& filter) const
+{
+    ByteSpan record;
+    if (!store.ReadBlock(hash, record) || record.size < 32)
+        return false;
+
+    filter = record.Sub(32);
+    return true;
+}
+
+bool BlockFilterIndex::GetFilterHeader(const Hash256& hash, Hash256& header) const
+{
+    ByteSpan record;
+    if (!store.ReadBlock(hash, record) || record.size < 32)
+        return false;
+
+    std::memcpy(header.data(), record.data, 32);
+    return true;
+}
+
+bool BlockFilterIndex::Match(const Hash256& hash, const std::vector<ByteSpan>& scripts, bool& matched) const
+{
+    ByteSpan filter;
+    if (!GetFilter(hash, filter))
+        return false;
+
+    matched = GCSFilter::MatchAny(hash, filter, scripts);
+
+    statQueries++;
+    if (matched)
+        statMatches++;
+    return true;
+}
+
+bool BlockFilterIndex::MatchRange(const std::vector<Hash256>& chain, int fromHeight, int toHeight,
+                                  const std::vector<ByteSpan>& scripts, std::vector<int>& heights,
+                                  std::string* reason) const
+{
+    heights.clear();
+
+    if (fromHeight < 0 || toHeight < fromHeight || (size_t)toHeight > chain.size())
+        return SetReason(reason, "height range out of range");
+
+    struct MatchTask
+    {
+        int begin;
+        int end;
+        bool ok;
+        std::vector<int> heights;
+    };
+
+    std::vector<MatchTask> tasks;
+    for (int h = fromHeight; h < toHeight; h += (int)opts.rangeBlocks)
+    {
+        MatchTask t;
+        t.begin = h;
+        t.end = std::min(h + (int)opts.rangeBlocks, toHeight);
+        t.ok = false;
+        tasks.push_back(std::move(t));
+    }
+
+    {
+        TaskGroup group(scheduler, TASK_BACKGROUND);
+        for (MatchTask& t : tasks)
+            group.Run([this, &chain, &scripts, &t] {
+                for (int h = t.begin; h < t.end; ++h)
+                {
+                    bool matched;
+                    if (!Match(chain[h], scripts, matched))
+                        return;
+                    if (matched)
+                        t.heights.push_back(h);
+                }
+                t.ok = true;
+            });
+        group.Wait();
+    }
+
+    for (const MatchTask& t : tasks)
+    {
+        if (!t.ok)
+        {
+            heights.clear();
+            return SetReason(reason, "filter missing in heights " + std::to_string(t.begin) + ".." +
+                             std::to_string(t.end - 1));
+        }
+        heights.insert(heights.end(), t.heights.begin(), t.heights.end());
+    }
+    return true;
+}
+
+BlockFilterIndex::Stats BlockFilterIndex::GetStats() const
+{
+    Stats s;
+    s.filters = statFilters;
+    s.elements = statElements;
+    s.filterBytes = statFilterBytes;
+    s.queries = statQueries.load();
+    s.matches = statMatches.load();
+    return s;
+}
@@ -0,0 +1,222 @@
+#ifndef DRACHMA_STORAGE_BLOCKFILTER_H
+#define DRACHMA_STORAGE_BLOCKFILTER_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "blockstore.h"
+#include "../node/scheduler.h"
+#include "../../common/utils/span.h"
+
+class BlockView;
+class BlockUndo;
+
+//
+// ===============================================================
+//  CLASS: GCSFilter – BIP158 Golomb-coded set
+// ===============================================================
+//
+//  A compact probabilistic set of byte strings, keyed by a block
+//  hash:
+//
+//    - every element is SipHash-2-4'd under the first 16 bytes of
+//      the block hash and mapped onto [0, N*M)
+//    - the sorted values are stored as Golomb-Rice coded deltas
+//      with P low bits (unary quotient, then the remainder)
+//
+//  Encoded: CompactSize N | bit stream, most significant bit
+//  first, zero padded. Basic filters use P = 19, M = 784931 (a
+//  false positive rate of 1/M per element queried).
+//
+//  Filters are never decoded into memory: a query hashes its own
+//  elements, sorts them and walks the bit stream once, so matching
+//  a wallet's script set against a block costs one pass over a
+//  filter of a few kB.
+//
+// ===============================================================
+//
+class GCSFilter
+{
+public:
+    typedef std::array<uint8_t,32> Hash256;
+
+    static constexpr int P = 19;
+    static constexpr uint64_t M = 784931;
+
+    // Duplicate elements are stored once
+    static void Build(const Hash256& blockHash, std::vector<ByteSpan> elements, std::vector<uint8_t>& out);
+
+    // False for a malformed filter as well
+    static bool Match(const Hash256& blockHash, ByteSpan filter, ByteSpan element);
+    static bool MatchAny(const Hash256& blockHash, ByteSpan filter, const std::vector<ByteSpan>& elements);
+
+    // Elements in the filter (its N)
+    static bool GetSize(ByteSpan filter, uint64_t& n);
+
+private:
+    static bool MatchSorted(ByteSpan filter, uint64_t n, const uint64_t* values, size_t count);
+};
+
+//
+// ===============================================================
+//  BIP158 basic filters
+// ===============================================================
+//
+//  A block's basic filter holds every output script it creates
+//  (but empty and OP_RETURN ones) and every script its inputs
+//  spend, taken from the block's undo data. The spans point into
+//  `block` and `undo`.
+//
+void GetBasicFilterElements(const BlockView& block, const BlockUndo& undo, std::vector<ByteSpan>& out);
+
+// SHA256D(SHA256D(filter) | prevHeader); the genesis block's
+// parent header is zero
+std::array<uint8_t,32> ComputeFilterHeader(ByteSpan filter, const std::array<uint8_t,32>& prevHeader);
+
+//
+// ===============================================================
+//  CLASS: BlockFilterIndex
+// ===============================================================
+//
+//  Basic filters and filter headers of the blocks in a BlockStore,
+//  kept in a BlockStore of their own with prefix "flt", next to
+//  the blocks and their undo data. One record per block hash:
+//
+//    filter header[32] | encoded filter
+//
+//  Build() indexes a height range of the chain behind the
+//  connected tip (IBD, or catching up after the index was
+//  enabled), in waves of `batchBlocks` blocks on the Scheduler
+//  (TASK_BACKGROUND), `rangeBlocks` blocks per task:
+//
+//    1. every range parses its blocks and undo data in place from
+//       the mappings, builds the filters and hashes them
+//    2. the wave's headers are chained in height order, one
+//       64-byte SHA256D per block, and the records appended
+//
+//  AddBlock() indexes one block as it is connected (ChainState
+//  calls it once attached; IBDPipeline builds filters in parallel
+//  and writes them with AddFilter()). Blocks of other branches
+//  are kept, so a reorg only indexes the new branch.
+//
+//  Queries read the filters from the mapping without a copy;
+//  MatchRange() spreads a wallet rescan over the Scheduler.
+//
+//  Threading: queries from any number of threads alongside one
+//  writer (Build(), AddBlock(), Sync()).
+//
+// ===============================================================
+//
+class BlockFilterIndex
+{
+public:
+    typedef std::array<uint8_t,32> Hash256;
+
+    struct Options
+    {
+        size_t rangeBlocks;             // blocks per build or match task
+        size_t batchBlocks;             // blocks built before writing
+        BlockStore::Options store;
+
+        Options() : rangeBlocks(64), batchBlocks(4096)
+        {
+            store.segmentSize = 32u << 20;
+            store.filePrefix = "flt";
+        }
+    };
+
+    struct Stats
+    {
+        uint64_t filters;               // built by this instance
+        uint64_t elements;
+        uint64_t filterBytes;
+        uint64_t queries;               // blocks matched against
+        uint64_t matches;
+    };
+
+    explicit BlockFilterIndex(Scheduler& scheduler, const Options& opts = Options());
+
+    BlockFilterIndex(const BlockFilterIndex&) = delete;
+    BlockFilterIndex& operator=(const BlockFilterIndex&) = delete;
+
+    bool Open(const std::string& dir, std::string* reason = nullptr);
+    void Close();
+    bool IsOpen() const { return store.IsOpen(); }
+
+    // Blocks chain[fromHeight .. chain.size()-1], chain[h] being the
+    // hash at height h, with their undo data (none needed for
+    // genesis). chain[fromHeight-1] must be indexed. Blocks already
+    // indexed are skipped.
+    bool Build(const BlockStore& blocks, const BlockStore& undo, const std::vector<Hash256>& chain,
+               int fromHeight, std::string* reason = nullptr);
+
+    // One block whose parent is indexed (or genesis: prevHash zero)
+    bool AddBlock(const Hash256& hash, const BlockView& block, const BlockUndo& undo,
+                  std::string* reason = nullptr);
+
+    // AddBlock() in two steps for callers that build filters on the
+    // Scheduler: BuildFilter() runs on any thread and returns the
+    // element count; AddFilter() chains and writes, as the writer
+    static uint64_t BuildFilter(const Hash256& hash, const BlockView& block, const BlockUndo& undo,
+                                std::vector<uint8_t>& filter);
+    bool AddFilter(const Hash256& hash, const Hash256& prevHash, const std::vector<uint8_t>& filter,
+                   uint64_t elements, std::string* reason = nullptr);
+
+    bool Sync();
+
+    // ---- Queries ----
+    bool HaveFilter(const Hash256& hash) const { return store.HaveBlock(hash); }
+    bool GetFilter(const Hash256& hash, ByteSpan& filter) const;
+    bool GetFilterHeader(const Hash256& hash, Hash256& header) const;
+
+    // Whether the block may touch one of `scripts`; false if it is
+    // not indexed
+    bool Match(const Hash256& hash, const std::vector<ByteSpan>& scripts, bool& matched) const;
+
+    // Heights in [fromHeight, toHeight) of `chain` whose filters
+    // match, ascending
+    bool MatchRange(const std::vector<Hash256>& chain, int fromHeight, int toHeight,
+                    const std::vector<ByteSpan>& scripts, std::vector<int>& heights,
+                    std::string* reason = nullptr) const;
+
+    size_t Size() const { return store.GetBlockCount(); }
+    Stats GetStats() const;
+
+private:
+    struct Built
+    {
+        Hash256 filterHash;
+        std::vector<uint8_t> filter;
+        bool skip;                      // already indexed
+    };
+
+    struct Range
+    {
+        int begin;
+        int end;                        // exclusive
+        bool ok;
+        std::string error;
+        uint64_t elements;
+    };
+
+    bool BuildRange(const BlockStore& blocks, const BlockStore& undo, const std::vector<Hash256>& chain,
+                    int base, Range& range, std::vector<Built>& out) const;
+    bool WriteFilter(const Hash256& hash, const Hash256& header, const std::vector<uint8_t>& filter);
+
+    Scheduler& scheduler;
+    Options opts;
+
+    BlockStore store;
+
+    uint64_t statFilters;
+    uint64_t statElements;
+    uint64_t statFilterBytes;
+    mutable std::atomic<uint64_t> statQueries;
+    mutable std::atomic<uint64_t> statMatches;
+};
+
+#endif // DRACHMA_STORAGE_BLOCKFILTER_H
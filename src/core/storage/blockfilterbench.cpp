@@ -0,0 +1,254 @@
+#include "blockfilterbench.h"
+#include "../chain/block.h"
+#include "../chain/undo.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <set>
+
+typedef std::chrono::steady_clock Clock;
+
+static double SecondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static double Percentile(const std::vector<uint64_t>& sorted, double q)
+{
+    if (sorted.empty())
+        return 0;
+
+    const size_t i = std::min(sorted.size() - 1, (size_t)(q * sorted.size()));
+    return sorted[i] / 1000.0;
+}
+
+// A BlockStore's files under `prefix`
+static void RemoveStore(const std::string& dir, const std::string& prefix)
+{
+    unlink((dir + "/" + prefix + "index.dat").c_str());
+
+    for (uint32_t f = 0;; ++f)
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%05u.dat", f);
+        if (unlink((dir + "/" + prefix + name).c_str()) != 0)
+            break;
+    }
+}
+
+static void RandomBytes(std::mt19937_64& rng, uint8_t* out, size_t len)
+{
+    for (size_t i = 0; i < len; i += 8)
+    {
+        const uint64_t r = rng();
+        std::memcpy(out + i, &r, std::min<size_t>(8, len - i));
+    }
+}
+
+// P2WPKH, one in four P2TR
+static std::vector<uint8_t> RandomScript(std::mt19937_64& rng)
+{
+    const bool taproot = rng() % 4 == 0;
+
+    std::vector<uint8_t> s(taproot ? 34 : 22);
+    s[0] = taproot ? 0x51 : 0x00;
+    s[1] = taproot ? 32 : 20;
+    RandomBytes(rng, s.data() + 2, s.size() - 2);
+    return s;
+}
+
+static void MakeBlock(std::mt19937_64& rng, const BlockFilterBenchmark::Options& opts,
+                      const std::array<uint8_t,32>& prevHash, Block& block, BlockUndo& undo)
+{
+    block.header = BlockHeader();
+    block.header.version = 1;
+    block.header.prevHash = prevHash;
+    RandomBytes(rng, block.header.merkleRoot.data(), 32);
+    block.header.time = (uint32_t)rng();
+
+    block.vtx.assign(1 + opts.txs, Transaction());
+    undo.txs.assign(opts.txs, TxUndo());
+
+    Transaction& coinbase = block.vtx[0];
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig.assign(8, 0);
+    RandomBytes(rng, coinbase.vin[0].scriptSig.data(), 8);
+    coinbase.vout.push_back(TxOut(625000000, RandomScript(rng)));
+    coinbase.vout.push_back(TxOut(0, std::vector<uint8_t>{ 0x6a, 0x24, 0xaa, 0x21, 0xa9, 0xed }));
+
+    for (size_t t = 1; t <= opts.txs; ++t)
+    {
+        Transaction& tx = block.vtx[t];
+        tx.version = 2;
+        tx.vin.resize(opts.inputs);
+        for (TxIn& in : tx.vin)
+        {
+            RandomBytes(rng, in.prevout.txid.data(), 32);
+            in.prevout.index = (uint32_t)(rng() % 4);
+            in.witness.assign(2, std::vector<uint8_t>());
+            in.witness[0].resize(72);
+            in.witness[1].resize(33);
+            RandomBytes(rng, in.witness[0].data(), 72);
+            RandomBytes(rng, in.witness[1].data(), 33);
+
+            undo.txs[t - 1].spent.push_back(Coin((int64_t)(rng() % 100000000), 1, false, RandomScript(rng)));
+        }
+        for (size_t o = 0; o < opts.outputs; ++o)
+            tx.vout.push_back(TxOut((int64_t)(rng() % 100000000), RandomScript(rng)));
+    }
+}
+
+bool BlockFilterBenchmark::Run(Scheduler& scheduler, const Options& opts, Report& report,
+                               std::string* reason)
+{
+    report = Report();
+
+    if (opts.dir.empty() || opts.blocks == 0 || opts.txs == 0 || opts.walletHits > opts.walletScripts)
+    {
+        if (reason)
+            *reason = "dir and blocks must be set, walletHits at most walletScripts";
+        return false;
+    }
+
+    for (const char* prefix : { "blk", "rev", "flt" })
+        RemoveStore(opts.dir, prefix);
+
+    std::mt19937_64 rng(std::random_device{}());
+
+    // Blocks that pay the wallet
+    std::set<int> hitHeights;
+    while (hitHeights.size() < std::min(opts.walletHits, opts.blocks))
+        hitHeights.insert((int)(rng() % opts.blocks));
+
+    std::vector<std::vector<uint8_t>> wallet;
+
+    // The chain
+    BlockStore blocks;
+    BlockStore undoStore;
+    BlockStore::Options undoOpts;
+    undoOpts.filePrefix = "rev";
+
+    if (!blocks.Open(opts.dir) || !undoStore.Open(opts.dir, undoOpts))
+    {
+        if (reason)
+            *reason = "cannot open the block stores in " + opts.dir;
+        return false;
+    }
+
+    std::vector<std::array<uint8_t,32>> chain;
+    chain.reserve(opts.blocks);
+    {
+        Block block;
+        BlockUndo undo;
+        std::vector<uint8_t> raw;
+        std::array<uint8_t,32> prev = {};
+
+        for (size_t h = 0; h < opts.blocks; ++h)
+        {
+            MakeBlock(rng, opts, prev, block, undo);
+
+            if (hitHeights.count((int)h))
+                wallet.push_back(block.vtx[1 + rng() % opts.txs].vout[0].script);
+
+            const std::array<uint8_t,32> hash = block.header.GetHash();
+            raw.clear();
+            block.Serialize(raw);
+            if (!blocks.WriteBlock(hash, raw.data(), raw.size()))
+            {
+                if (reason)
+                    *reason = "block write failed";
+                return false;
+            }
+
+            if (h > 0)
+            {
+                raw.clear();
+                undo.Serialize(raw);
+                if (!undoStore.WriteBlock(hash, raw.data(), raw.size()))
+                {
+                    if (reason)
+                        *reason = "undo write failed";
+                    return false;
+                }
+            }
+
+            chain.push_back(hash);
+            prev = hash;
+        }
+    }
+
+    while (wallet.size() < opts.walletScripts)
+        wallet.push_back(RandomScript(rng));
+
+    std::vector<ByteSpan> scripts(wallet.begin(), wallet.end());
+
+    // Build
+    BlockFilterIndex index(scheduler, opts.index);
+    if (!index.Open(opts.dir, reason))
+        return false;
+
+    const Clock::time_point start = Clock::now();
+    if (!index.Build(blocks, undoStore, chain, 0, reason) || !index.Sync())
+        return false;
+    report.buildSeconds = SecondsSince(start);
+
+    const BlockFilterIndex::Stats stats = index.GetStats();
+    report.blocks = stats.filters;
+    report.elements = stats.elements;
+    report.blocksPerSecond = report.buildSeconds > 0 ? stats.filters / report.buildSeconds : 0;
+    report.elementsPerSecond = report.buildSeconds > 0 ? stats.elements / report.buildSeconds : 0;
+    report.filterBytesPerBlock = stats.filters ? (double)stats.filterBytes / stats.filters : 0;
+    report.bitsPerElement = stats.elements ? 8.0 * stats.filterBytes / stats.elements : 0;
+
+    // Queries, block by block
+    std::vector<uint64_t> latencies;
+    latencies.reserve(chain.size());
+    for (const std::array<uint8_t,32>& hash : chain)
+    {
+        bool matched;
+        const Clock::time_point t = Clock::now();
+        if (!index.Match(hash, scripts, matched))
+        {
+            if (reason)
+                *reason = "filter missing after build";
+            return false;
+        }
+        latencies.push_back((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Clock::now() - t).count());
+    }
+    std::sort(latencies.begin(), latencies.end());
+    report.matchP50Micros = Percentile(latencies, 0.50);
+    report.matchP99Micros = Percentile(latencies, 0.99);
+
+    // Rescan
+    std::vector<int> heights;
+    const Clock::time_point rescan = Clock::now();
+    if (!index.MatchRange(chain, 0, (int)chain.size(), scripts, heights, reason))
+        return false;
+    const double seconds = SecondsSince(rescan);
+    report.rescanBlocksPerSecond = seconds > 0 ? chain.size() / seconds : 0;
+
+    report.matchedBlocks = heights.size();
+    for (int h : heights)
+    {
+        if (!hitHeights.count(h))
+            report.falsePositives++;
+    }
+
+    // Every paying block has to match
+    for (int h : hitHeights)
+    {
+        if (!std::binary_search(heights.begin(), heights.end(), h))
+        {
+            if (reason)
+                *reason = "block at height " + std::to_string(h) + " pays the wallet but did not match";
+            return false;
+        }
+    }
+    return true;
+}
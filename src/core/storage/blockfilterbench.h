@@ -0,0 +1,71 @@
+#ifndef DRACHMA_STORAGE_BLOCKFILTERBENCH_H
+#define DRACHMA_STORAGE_BLOCKFILTERBENCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "blockfilter.h"
+
+//
+// ===============================================================
+//  CLASS: BlockFilterBenchmark
+// ===============================================================
+//
+//  Builds a synthetic chain of `blocks` blocks in `dir` (its blk,
+//  rev and flt files are replaced): `txs` transactions a block,
+//  each spending `inputs` coins and creating `outputs` P2WPKH and
+//  P2TR outputs, with matching undo data. Then:
+//
+//    - Build() indexes the whole chain (timed)
+//    - a wallet of `walletScripts` scripts, `walletHits` of them
+//      taken from random block outputs, is matched against every
+//      block with Match() (latency per block) and with
+//      MatchRange() (rescan throughput)
+//
+//  Report: build throughput, filter size, query latency and the
+//  blocks matched that hold none of the wallet's scripts (false
+//  positives; expected about blocks * walletScripts / M).
+//
+// ===============================================================
+//
+class BlockFilterBenchmark
+{
+public:
+    struct Options
+    {
+        std::string dir;
+        size_t blocks;
+        size_t txs;
+        size_t inputs;
+        size_t outputs;
+        size_t walletScripts;
+        size_t walletHits;
+        BlockFilterIndex::Options index;
+
+        Options()
+            : blocks(1000), txs(1000), inputs(2), outputs(2), walletScripts(1000),
+              walletHits(20) {}
+    };
+
+    struct Report
+    {
+        uint64_t blocks;
+        uint64_t elements;
+        double buildSeconds;
+        double blocksPerSecond;
+        double elementsPerSecond;
+        double filterBytesPerBlock;
+        double bitsPerElement;
+        double matchP50Micros;          // one block, Match()
+        double matchP99Micros;
+        double rescanBlocksPerSecond;   // MatchRange() over the chain
+        uint64_t matchedBlocks;
+        uint64_t falsePositives;
+    };
+
+    static bool Run(Scheduler& scheduler, const Options& opts, Report& report,
+                    std::string* reason = nullptr);
+};
+
+#endif // DRACHMA_STORAGE_BLOCKFILTERBENCH_H
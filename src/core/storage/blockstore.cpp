@@ -0,0 +1,565 @@
+#include "blockstore.h"
+#include "../crypto/hash.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
+static const uint32_t BLOCK_MAGIC   = 0x4B4C4244;   // "DBLK"
+static const uint32_t INDEX_MAGIC   = 0x58444942;   // "BIDX"
+static const uint32_t INDEX_VERSION = 1;
+
+static const size_t INDEX_HEADER_SIZE = 4096;
+static const size_t INDEX_GROW = 1u << 16;          // records per index extension
+static const size_t MIN_TABLE = 1u << 16;
+
+struct RecordHeader
+{
+    uint32_t magic;
+    uint32_t length;
+    uint32_t checksum;
+    uint32_t reserved;
+    uint8_t hash[32];
+};
+
+static_assert(sizeof(RecordHeader) == BlockStore::RECORD_HEADER_SIZE, "record header layout changed");
+
+static uint32_t Checksum(const uint8_t* data, size_t len)
+{
+    uint8_t h[32];
+    Hash::SHA256D(data, len, h);
+
+    uint32_t out;
+    std::memcpy(&out, h, 4);
+    return out;
+}
+
+static inline uint64_t TableHash(const uint8_t* hash)
+{
+    // Block hashes carry their PoW zeroes at one end; fold all four
+    // words so both ends contribute.
+    uint64_t w[4];
+    std::memcpy(w, hash, 32);
+
+    uint64_t x = w[0] ^ w[1] ^ w[2] ^ w[3];
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static bool FileExists(const std::string& path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) == 0;
+}
+
+//
+// ================================================================
+//  Construction / Open
+// ================================================================
+BlockStore::BlockStore()
+{
+    writeFile = 0;
+    writePos = 0;
+    syncFile = 0;
+    recordCount = 0;
+}
+
+BlockStore::~BlockStore()
+{
+    Close();
+}
+
+std::string BlockStore::SegmentPath(uint32_t file) const
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%05u.dat", file);
+    return dir + "/" + opts.filePrefix + name;
+}
+
+bool BlockStore::Open(const std::string& d, const Options& o)
+{
+    Close();
+
+    std::unique_lock<std::shared_mutex> lock(mutex);
+
+    dir = d;
+    opts = o;
+
+    const std::string indexPath = dir + "/" + opts.filePrefix + "index.dat";
+    bool fresh = !FileExists(indexPath);
+
+    if (!index.Open(indexPath, MappedFile::READ_WRITE, INDEX_HEADER_SIZE + INDEX_GROW * sizeof(IndexRecord)))
+        return false;
+
+    IndexHeader* hdr = (IndexHeader*)index.Data();
+    if (fresh)
+    {
+        hdr->magic = INDEX_MAGIC;
+        hdr->version = INDEX_VERSION;
+        hdr->syncedCount = 0;
+
+        if (!index.Sync(0, INDEX_HEADER_SIZE) || !MappedFile::SyncDirectory(dir))
+        {
+            index.Close();
+            return false;
+        }
+    }
+
+    if (hdr->magic != INDEX_MAGIC || hdr->version != INDEX_VERSION)
+    {
+        index.Close();
+        return false;
+    }
+
+    for (uint32_t f = 0; FileExists(SegmentPath(f)); ++f)
+    {
+        if (!OpenSegment(f, false))
+        {
+            segments.clear();
+            index.Close();
+            return false;
+        }
+    }
+
+    if (!LoadIndex())
+    {
+        segments.clear();
+        index.Close();
+        return false;
+    }
+
+    syncFile = writeFile;
+    return true;
+}
+
+void BlockStore::Close()
+{
+    std::unique_lock<std::shared_mutex> lock(mutex);
+
+    segments.clear();
+    index.Close();
+    table.clear();
+
+    writeFile = 0;
+    writePos = 0;
+    syncFile = 0;
+    recordCount = 0;
+}
+
+bool BlockStore::OpenSegment(uint32_t file, bool create)
+{
+    std::unique_ptr<MappedFile> seg(new MappedFile());
+
+    if (!seg->Open(SegmentPath(file), MappedFile::READ_WRITE, create ? opts.segmentSize : 0))
+        return false;
+
+    if (create && !MappedFile::SyncDirectory(dir))
+        return false;
+
+    seg->Advise(MappedFile::ACCESS_SEQUENTIAL);
+    segments.push_back(std::move(seg));
+    return true;
+}
+
+//
+// ================================================================
+//  Index
+// ================================================================
+const BlockStore::IndexRecord* BlockStore::RecordAt(uint64_t n) const
+{
+    return (const IndexRecord*)(index.Data() + INDEX_HEADER_SIZE) + n;
+}
+
+bool BlockStore::ValidRecordAt(const IndexRecord& rec) const
+{
+    if (rec.file >= segments.size() || rec.offset < RECORD_HEADER_SIZE)
+        return false;
+
+    const MappedFile& seg = *segments[rec.file];
+    if ((uint64_t)rec.offset + rec.length > seg.Size())
+        return false;
+
+    RecordHeader rh;
+    std::memcpy(&rh, seg.Data() + rec.offset - RECORD_HEADER_SIZE, sizeof(rh));
+
+    // The header can be durable while the payload behind it is torn
+    return rh.magic == BLOCK_MAGIC && rh.length == rec.length &&
+           std::memcmp(rh.hash, rec.hash, 32) == 0 &&
+           Checksum(seg.Data() + rec.offset, rec.length) == rh.checksum;
+}
+
+bool BlockStore::LoadIndex()
+{
+    const IndexHeader* hdr = (const IndexHeader*)index.Data();
+    const uint64_t capacity = (index.Size() - INDEX_HEADER_SIZE) / sizeof(IndexRecord);
+
+    recordCount = 0;
+    writeFile = segments.empty() ? 0 : (uint32_t)(segments.size() - 1);
+    writePos = 0;
+
+    // Records stop at the first one that fails its check. Records
+    // newer than the last Sync() may point at block data that never
+    // reached the disk, so those are matched against the segments
+    // and their payloads checksummed.
+    while (recordCount < capacity)
+    {
+        const IndexRecord* rec = RecordAt(recordCount);
+
+        if (Checksum((const uint8_t*)rec, sizeof(IndexRecord) - 4) != rec->check)
+            break;
+
+        if (recordCount >= hdr->syncedCount && !ValidRecordAt(*rec))
+            break;
+
+        if (rec->file == writeFile && (uint64_t)rec->offset + rec->length > writePos)
+            writePos = (uint64_t)rec->offset + rec->length;
+
+        recordCount++;
+    }
+
+    // Clear a half-written or orphaned tail so it cannot resurface
+    if (recordCount < capacity)
+    {
+        uint8_t* tail = (uint8_t*)RecordAt(recordCount);
+        std::memset(tail, 0, (capacity - recordCount) * sizeof(IndexRecord));
+    }
+
+    uint64_t cap = MIN_TABLE;
+    while (cap < recordCount * 2)
+        cap <<= 1;
+
+    RebuildTable(cap);
+    return true;
+}
+
+void BlockStore::RebuildTable(uint64_t capacity)
+{
+    table.assign(capacity, 0);
+    for (uint64_t n = 0; n < recordCount; ++n)
+        InsertSlot((uint32_t)n);
+}
+
+void BlockStore::InsertSlot(uint32_t recordNo)
+{
+    const uint64_t mask = table.size() - 1;
+    uint64_t pos = TableHash(RecordAt(recordNo)->hash) & mask;
+
+    while (table[pos] != 0)
+        pos = (pos + 1) & mask;
+
+    table[pos] = recordNo + 1;
+}
+
+bool BlockStore::Lookup(const uint8_t* hash, BlockPos& pos) const
+{
+    if (table.empty())
+        return false;
+
+    const uint64_t mask = table.size() - 1;
+    uint64_t i = TableHash(hash) & mask;
+
+    while (table[i] != 0)
+    {
+        const IndexRecord* rec = RecordAt(table[i] - 1);
+        if (std::memcmp(rec->hash, hash, 32) == 0)
+        {
+            pos = BlockPos(rec->file, rec->offset, rec->length);
+            return true;
+        }
+        i = (i + 1) & mask;
+    }
+
+    return false;
+}
+
+bool BlockStore::AppendIndex(const std::array<uint8_t,32>& hash, const BlockPos& pos)
+{
+    size_t need = INDEX_HEADER_SIZE + (recordCount + 1) * sizeof(IndexRecord);
+    if (need > index.Size())
+    {
+        if (!index.Resize(index.Size() + INDEX_GROW * sizeof(IndexRecord)))
+            return false;
+    }
+
+    IndexRecord rec;
+    std::memcpy(rec.hash, hash.data(), 32);
+    rec.file = pos.file;
+    rec.offset = pos.offset;
+    rec.length = pos.length;
+    rec.check = Checksum((const uint8_t*)&rec, sizeof(IndexRecord) - 4);
+
+    std::memcpy((uint8_t*)RecordAt(recordCount), &rec, sizeof(rec));
+    recordCount++;
+
+    if (recordCount * 2 > table.size())
+        RebuildTable(table.size() * 2);
+    else
+        InsertSlot((uint32_t)(recordCount - 1));
+
+    return true;
+}
+
+//
+// ================================================================
+//  Write
+// ================================================================
+bool BlockStore::WriteBlock(const std::array<uint8_t,32>& hash,
+                            const uint8_t* data, size_t len,
+                            BlockPos* posOut)
+{
+    std::unique_lock<std::shared_mutex> lock(mutex);
+
+    if (!index.IsOpen())
+        return false;
+
+    BlockPos pos;
+    if (Lookup(hash.data(), pos))
+    {
+        if (posOut) *posOut = pos;
+        return true;
+    }
+
+    const uint64_t need = RECORD_HEADER_SIZE + (uint64_t)len;
+    if (len == 0 || need > opts.segmentSize)
+        return false;
+
+    if (segments.empty())
+    {
+        if (!OpenSegment(0, true))
+            return false;
+        writeFile = 0;
+        writePos = 0;
+    }
+
+    if (writePos + need > segments[writeFile]->Size())
+    {
+        if (!OpenSegment(writeFile + 1, true))
+            return false;
+        writeFile++;
+        writePos = 0;
+    }
+
+    RecordHeader rh;
+    rh.magic = BLOCK_MAGIC;
+    rh.length = (uint32_t)len;
+    rh.checksum = Checksum(data, len);
+    rh.reserved = 0;
+    std::memcpy(rh.hash, hash.data(), 32);
+
+    uint8_t* dst = segments[writeFile]->Data() + writePos;
+    std::memcpy(dst, &rh, sizeof(rh));
+    std::memcpy(dst + sizeof(rh), data, len);
+
+    pos = BlockPos(writeFile, (uint32_t)(writePos + RECORD_HEADER_SIZE), (uint32_t)len);
+    writePos += need;
+
+    if (!AppendIndex(hash, pos))
+        return false;
+
+    if (posOut) *posOut = pos;
+    return true;
+}
+
+bool BlockStore::Sync()
+{
+    std::unique_lock<std::shared_mutex> lock(mutex);
+
+    if (!index.IsOpen())
+        return false;
+
+    // Block data before the index records that point at it
+    for (uint32_t f = syncFile; f < segments.size(); ++f)
+    {
+        uint64_t len = (f == writeFile) ? writePos : segments[f]->Size();
+        if (len > 0 && !segments[f]->Sync(0, len))
+            return false;
+    }
+
+    IndexHeader* hdr = (IndexHeader*)index.Data();
+
+    if (recordCount > hdr->syncedCount)
+    {
+        size_t off = INDEX_HEADER_SIZE + hdr->syncedCount * sizeof(IndexRecord);
+        size_t len = (recordCount - hdr->syncedCount) * sizeof(IndexRecord);
+        if (!index.Sync(off, len))
+            return false;
+    }
+
+    hdr->syncedCount = recordCount;
+    if (!index.Sync(0, INDEX_HEADER_SIZE))
+        return false;
+
+    syncFile = writeFile;
+    return true;
+}
+
+//
+// ================================================================
+//  Read
+// ================================================================
+bool BlockStore::HaveBlock(const std::array<uint8_t,32>& hash) const
+{
+    BlockPos pos;
+    return FindBlock(hash, pos);
+}
+
+bool BlockStore::FindBlock(const std::array<uint8_t,32>& hash, BlockPos& pos) const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return Lookup(hash.data(), pos);
+}
+
+bool BlockStore::ReadBlock(const std::array<uint8_t,32>& hash, ByteSpan& out, bool verify) const
+{
+    BlockPos pos;
+    if (!FindBlock(hash, pos))
+        return false;
+
+    return ReadBlock(pos, out, verify);
+}
+
+bool BlockStore::ReadBlock(const BlockPos& pos, ByteSpan& out, bool verify) const
+{
+    const MappedFile* seg = nullptr;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        if (pos.file >= segments.size())
+            return false;
+        seg = segments[pos.file].get();
+    }
+
+    if (pos.offset < RECORD_HEADER_SIZE || (uint64_t)pos.offset + pos.length > seg->Size())
+        return false;
+
+    RecordHeader rh;
+    std::memcpy(&rh, seg->Data() + pos.offset - RECORD_HEADER_SIZE, sizeof(rh));
+
+    if (rh.magic != BLOCK_MAGIC || rh.length != pos.length)
+        return false;
+
+    const uint8_t* data = seg->Data() + pos.offset;
+    if (verify && Checksum(data, pos.length) != rh.checksum)
+        return false;
+
+    out = ByteSpan(data, pos.length);
+    return true;
+}
+
+bool BlockStore::ScanSegment(const MappedFile& seg, uint32_t file, uint64_t limit,
+                             const RecordFn& fn, bool verify, uint64_t* endOut)
+{
+    uint64_t pos = 0;
+    bool more = true;
+
+    while (more && pos + RECORD_HEADER_SIZE <= limit)
+    {
+        RecordHeader rh;
+        std::memcpy(&rh, seg.Data() + pos, sizeof(rh));
+
+        if (rh.magic != BLOCK_MAGIC || rh.length == 0 ||
+            pos + RECORD_HEADER_SIZE + rh.length > limit)
+            break;
+
+        const uint8_t* data = seg.Data() + pos + RECORD_HEADER_SIZE;
+        if (verify && Checksum(data, rh.length) != rh.checksum)
+            break;
+
+        std::array<uint8_t,32> hash;
+        std::memcpy(hash.data(), rh.hash, 32);
+
+        BlockPos bp(file, (uint32_t)(pos + RECORD_HEADER_SIZE), rh.length);
+        more = fn(hash, bp, ByteSpan(data, rh.length));
+
+        pos += RECORD_HEADER_SIZE + rh.length;
+    }
+
+    if (endOut)
+        *endOut = pos;
+
+    return true;
+}
+
+bool BlockStore::ScanFile(uint32_t file, const RecordFn& fn, bool verify) const
+{
+    const MappedFile* seg = nullptr;
+    uint64_t limit = 0;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        if (file >= segments.size())
+            return false;
+
+        seg = segments[file].get();
+        limit = (file == writeFile) ? writePos : seg->Size();
+    }
+
+    // No lock held while the callback runs; mappings stay put until Close()
+    return ScanSegment(*seg, file, limit, fn, verify, nullptr);
+}
+
+//
+// ================================================================
+//  Reindex
+// ================================================================
+bool BlockStore::Reindex()
+{
+    std::unique_lock<std::shared_mutex> lock(mutex);
+
+    if (!index.IsOpen())
+        return false;
+
+    const uint64_t oldCount = recordCount;
+
+    recordCount = 0;
+    table.assign(MIN_TABLE, 0);
+
+    IndexHeader* hdr = (IndexHeader*)index.Data();
+    hdr->syncedCount = 0;
+
+    bool ok = true;
+    RecordFn add = [this, &ok](const std::array<uint8_t,32>& hash, const BlockPos& pos, ByteSpan)
+    {
+        BlockPos existing;
+        if (!Lookup(hash.data(), existing))
+            ok = AppendIndex(hash, pos);
+        return ok;
+    };
+
+    for (uint32_t f = 0; f < segments.size() && ok; ++f)
+    {
+        uint64_t end = 0;
+        ScanSegment(*segments[f], f, segments[f]->Size(), add, true, &end);
+
+        writeFile = f;
+        writePos = end;
+    }
+
+    if (!ok)
+        return false;
+
+    if (oldCount > recordCount)
+        std::memset((uint8_t*)RecordAt(recordCount), 0, (oldCount - recordCount) * sizeof(IndexRecord));
+
+    if (!index.Sync())
+        return false;
+
+    hdr->syncedCount = recordCount;
+    syncFile = writeFile;
+    return index.Sync(0, INDEX_HEADER_SIZE);
+}
+
+size_t BlockStore::GetBlockCount() const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return recordCount;
+}
+
+uint32_t BlockStore::GetFileCount() const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return (uint32_t)segments.size();
+}
@@ -0,0 +1,163 @@
+#ifndef DRACHMA_STORAGE_BLOCKSTORE_H
+#define DRACHMA_STORAGE_BLOCKSTORE_H
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+#include "mmapfile.h"
+#include "../../common/utils/span.h"
+
+//
+// Position of a block payload inside the segmented block files
+//
+struct BlockPos
+{
+    uint32_t file;
+    uint32_t offset;    // first payload byte
+    uint32_t length;
+
+    BlockPos() : file(0), offset(0), length(0) {}
+    BlockPos(uint32_t f, uint32_t o, uint32_t l) : file(f), offset(o), length(l) {}
+
+    bool IsNull() const { return length == 0; }
+};
+
+//
+// ===============================================================
+//  CLASS: BlockStore
+// ===============================================================
+//
+//  Append-only raw block storage.
+//
+//  The same format holds per-block undo data, keyed by block
+//  hash, with the file prefix "rev" (revNNNNN.dat, revindex.dat)
+//  in the directory of the blocks.
+//
+//  On disk (one directory):
+//    blkNNNNN.dat  – segments, preallocated to segmentSize and
+//                    mapped once. Each record:
+//                      u32 magic | u32 length | u32 checksum |
+//                      u32 reserved | hash[32] | payload
+//                    checksum = first 4 bytes of SHA256D(payload)
+//    blkindex.dat  – compact index: page header + fixed 48-byte
+//                    records { hash, file, offset, length, check }
+//
+//  In memory only a u32 open-addressing table over the mapped
+//  index records is kept (~5 bytes per block at load 1/2).
+//
+//  Reads return ByteSpans into the mapping (no copy). They stay
+//  valid until Close(). Writes are visible to readers at once and
+//  durable after Sync(). Index records past the last Sync() are
+//  checked against the segment record headers and payload
+//  checksums on Open().
+//
+//  Threading: any number of readers alongside one writer.
+//
+// ===============================================================
+//
+class BlockStore
+{
+public:
+    static constexpr size_t RECORD_HEADER_SIZE = 48;
+
+    struct Options
+    {
+        size_t segmentSize;         // bytes per blkNNNNN.dat
+        std::string filePrefix;     // "blk"; undo data uses "rev"
+
+        Options() : segmentSize(128u << 20), filePrefix("blk") {}
+    };
+
+    BlockStore();
+    ~BlockStore();
+
+    BlockStore(const BlockStore&) = delete;
+    BlockStore& operator=(const BlockStore&) = delete;
+
+    bool Open(const std::string& dir, const Options& opts = Options());
+    void Close();
+    bool IsOpen() const { return index.IsOpen(); }
+
+    // ---- Write ----
+    // Appends a block. Writing an already stored hash is a no-op that
+    // returns the existing position.
+    bool WriteBlock(const std::array<uint8_t,32>& hash,
+                    const uint8_t* data, size_t len,
+                    BlockPos* posOut = nullptr);
+
+    // Make everything written so far durable
+    bool Sync();
+
+    // ---- Read (zero-copy) ----
+    bool HaveBlock(const std::array<uint8_t,32>& hash) const;
+    bool FindBlock(const std::array<uint8_t,32>& hash, BlockPos& pos) const;
+    bool ReadBlock(const std::array<uint8_t,32>& hash, ByteSpan& out, bool verify = false) const;
+    bool ReadBlock(const BlockPos& pos, ByteSpan& out, bool verify = false) const;
+
+    // Walk the records of one segment in file order. The callback
+    // returns false to stop early.
+    typedef std::function<bool(const std::array<uint8_t,32>& hash,
+                               const BlockPos& pos, ByteSpan data)> RecordFn;
+    bool ScanFile(uint32_t file, const RecordFn& fn, bool verify = true) const;
+
+    // Rebuild blkindex.dat from the segments
+    bool Reindex();
+
+    size_t GetBlockCount() const;
+    uint32_t GetFileCount() const;
+
+private:
+    struct IndexHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t syncedCount;   // records known to be durable
+    };
+
+    struct IndexRecord
+    {
+        uint8_t hash[32];
+        uint32_t file;
+        uint32_t offset;
+        uint32_t length;
+        uint32_t check;
+    };
+
+    static_assert(sizeof(IndexRecord) == 48, "block index record layout changed");
+
+    static bool ScanSegment(const MappedFile& seg, uint32_t file, uint64_t limit,
+                            const RecordFn& fn, bool verify, uint64_t* endOut);
+
+    std::string SegmentPath(uint32_t file) const;
+    bool OpenSegment(uint32_t file, bool create);
+    bool LoadIndex();
+    bool AppendIndex(const std::array<uint8_t,32>& hash, const BlockPos& pos);
+    bool ValidRecordAt(const IndexRecord& rec) const;
+
+    const IndexRecord* RecordAt(uint64_t n) const;
+    bool Lookup(const uint8_t* hash, BlockPos& pos) const;
+    void InsertSlot(uint32_t recordNo);
+    void RebuildTable(uint64_t capacity);
+
+    Options opts;
+    std::string dir;
+
+    mutable std::shared_mutex mutex;
+
+    std::vector<std::unique_ptr<MappedFile>> segments;
+    uint32_t writeFile;
+    uint64_t writePos;
+    uint32_t syncFile;              // first segment with unsynced data
+
+    MappedFile index;
+    uint64_t recordCount;
+    std::vector<uint32_t> table;    // recordNo + 1, 0 = empty
+};
+
+#endif // DRACHMA_STORAGE_BLOCKSTORE_H
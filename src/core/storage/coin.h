@@ -0,0 +1,39 @@
+#ifndef DRACHMA_STORAGE_COIN_H
+#define DRACHMA_STORAGE_COIN_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+//
+// Coin – an unspent transaction output as kept in the UTXO set
+// ---------------------------------------------------------------
+//   amount   : value in base units (-1 marks a spent/null coin)
+//   height   : height of the block that created the output
+//   coinbase : output belongs to a coinbase transaction
+//   script   : scriptPubKey
+//
+struct Coin
+{
+    int64_t amount;
+    uint32_t height;
+    bool coinbase;
+    std::vector<uint8_t> script;
+
+    Coin() : amount(-1), height(0), coinbase(false) {}
+
+    Coin(int64_t a, uint32_t h, bool cb, std::vector<uint8_t> s)
+        : amount(a), height(h), coinbase(cb), script(std::move(s)) {}
+
+    bool IsSpent() const { return amount < 0; }
+
+    void Clear()
+    {
+        amount = -1;
+        height = 0;
+        coinbase = false;
+        script.clear();
+    }
+};
+
+#endif // DRACHMA_STORAGE_COIN_H
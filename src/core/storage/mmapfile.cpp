@@ -0,0 +1,239 @@
+#include "mmapfile.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <utility>
+
+MappedFile::MappedFile()
+{
+    fd = -1;
+    mode = READ_ONLY;
+    base = nullptr;
+    size = 0;
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+{
+    fd = other.fd;
+    mode = other.mode;
+    base = other.base;
+    size = other.size;
+    path = std::move(other.path);
+
+    other.fd = -1;
+    other.base = nullptr;
+    other.size = 0;
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if (this != &other)
+    {
+        Close();
+
+        fd = other.fd;
+        mode = other.mode;
+        base = other.base;
+        size = other.size;
+        path = std::move(other.path);
+
+        other.fd = -1;
+        other.base = nullptr;
+        other.size = 0;
+    }
+    return *this;
+}
+
+size_t MappedFile::PageSize()
+{
+    static const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    return page;
+}
+
+// Extends the file to `to` with its blocks allocated. A sparse
+// extension (ftruncate) only fails later, as SIGBUS on the first
+// store through the mapping once the disk is full; this fails here,
+// before the range is mapped. posix_fallocate() returns the error
+// instead of setting errno. Filesystems that cannot allocate
+// (EOPNOTSUPP, EINVAL) keep the old sparse extension.
+static bool Reserve(int fd, size_t from, size_t to)
+{
+    int err = posix_fallocate(fd, (off_t)from, (off_t)(to - from));
+    if (err == EOPNOTSUPP || err == EINVAL)
+        return ftruncate(fd, (off_t)to) == 0;
+    if (err != 0)
+    {
+        // Give back whatever was allocated before it ran out; the
+        // reservation failed either way
+        int rc = ftruncate(fd, (off_t)from);
+        (void)rc;
+        errno = err;
+        return false;
+    }
+    return true;
+}
+
+bool MappedFile::SyncDirectory(const std::string& dir)
+{
+    int dfd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd < 0)
+        return false;
+
+    bool ok = (fsync(dfd) == 0);
+    ::close(dfd);
+    return ok;
+}
+
+//
+// ================================================================
+//  Open / Close
+// ================================================================
+bool MappedFile::Open(const std::string& p, Mode m, size_t minSize)
+{
+    Close();
+
+    int flags = (m == READ_WRITE) ? (O_RDWR | O_CREAT) : O_RDONLY;
+    fd = ::open(p.c_str(), flags | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        Close();
+        return false;
+    }
+
+    mode = m;
+    path = p;
+    size = (size_t)st.st_size;
+
+    if (size < minSize)
+    {
+        if (m != READ_WRITE || !Reserve(fd, size, minSize))
+        {
+            Close();
+            return false;
+        }
+        size = minSize;
+    }
+
+    if (!Map())
+    {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void MappedFile::Close()
+{
+    Unmap();
+
+    if (fd >= 0)
+        ::close(fd);
+
+    fd = -1;
+    size = 0;
+    path.clear();
+}
+
+//
+// ================================================================
+//  Mapping
+// ================================================================
+bool MappedFile::Map()
+{
+    // mmap() of a zero-length file fails; an empty file simply has
+    // no view until it is resized.
+    if (size == 0)
+        return true;
+
+    int prot = (mode == READ_WRITE) ? (PROT_READ | PROT_WRITE) : PROT_READ;
+    void* p = mmap(nullptr, size, prot, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+        return false;
+
+    base = (uint8_t*)p;
+    return true;
+}
+
+void MappedFile::Unmap()
+{
+    if (base)
+        munmap(base, size);
+    base = nullptr;
+}
+
+bool MappedFile::Resize(size_t newSize)
+{
+    if (fd < 0 || mode != READ_WRITE)
+        return false;
+
+    if (newSize == size)
+        return true;
+
+    // Growing reserves the new range before it is mapped; on failure
+    // the file and the current view are left as they were
+    if (newSize > size ? !Reserve(fd, size, newSize) : ftruncate(fd, (off_t)newSize) != 0)
+        return false;
+
+#ifdef __linux__
+    if (base && newSize > 0)
+    {
+        void* p = mremap(base, size, newSize, MREMAP_MAYMOVE);
+        if (p == MAP_FAILED)
+            return false;
+        base = (uint8_t*)p;
+        size = newSize;
+        return true;
+    }
+#endif
+
+    Unmap();
+    size = newSize;
+    return Map();
+}
+
+bool MappedFile::Sync(size_t offset, size_t len)
+{
+    if (!base)
+        return fd >= 0;
+
+    if (len == 0)
+        len = size - offset;
+
+    // msync() wants a page-aligned start address
+    size_t page = PageSize();
+    size_t aligned = offset & ~(page - 1);
+    len += offset - aligned;
+
+    return msync(base + aligned, len, MS_SYNC) == 0;
+}
+
+void MappedFile::Advise(Access access)
+{
+    if (!base)
+        return;
+
+    int advice = MADV_NORMAL;
+    switch (access)
+    {
+        case ACCESS_RANDOM:     advice = MADV_RANDOM;     break;
+        case ACCESS_SEQUENTIAL: advice = MADV_SEQUENTIAL; break;
+        case ACCESS_WILLNEED:   advice = MADV_WILLNEED;   break;
+        default: break;
+    }
+
+    madvise(base, size, advice);
+}
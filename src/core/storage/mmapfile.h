@@ -0,0 +1,96 @@
+#ifndef DRACHMA_STORAGE_MMAPFILE_H
+#define DRACHMA_STORAGE_MMAPFILE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+//
+// ===============================================================
+//  CLASS: MappedFile
+// ===============================================================
+//
+//  Thin RAII wrapper around a POSIX file + mmap() view.
+//
+//  Notes:
+//    • Read-only or read/write (MAP_SHARED) mappings
+//    • Resize() grows/shrinks the file and remaps it; any pointer
+//      previously returned by Data() is invalid afterwards
+//    • Growth is allocated (posix_fallocate) before it is mapped, so
+//      a full disk fails Open()/Resize() rather than raising SIGBUS
+//      on a later store
+//    • Sync() is msync(MS_SYNC) – data is durable on return
+//    • Not thread-safe for Resize(); concurrent reads are fine
+//
+// ===============================================================
+//
+class MappedFile
+{
+public:
+    enum Mode
+    {
+        READ_ONLY,
+        READ_WRITE
+    };
+
+    enum Access
+    {
+        ACCESS_NORMAL,
+        ACCESS_RANDOM,
+        ACCESS_SEQUENTIAL,
+        ACCESS_WILLNEED
+    };
+
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    // Open (and for READ_WRITE create) a file. If the file is shorter
+    // than minSize it is extended with zeroes first; fails if the disk
+    // cannot hold the extension.
+    bool Open(const std::string& path, Mode mode, size_t minSize = 0);
+    void Close();
+
+    bool IsOpen() const { return fd >= 0; }
+    bool IsWritable() const { return mode == READ_WRITE; }
+
+    uint8_t* Data() { return base; }
+    const uint8_t* Data() const { return base; }
+    size_t Size() const { return size; }
+    const std::string& Path() const { return path; }
+
+    // Change file length and remap. A failed grow leaves the file
+    // and the current view as they were.
+    bool Resize(size_t newSize);
+
+    // Flush a byte range (or the whole map) to disk
+    bool Sync(size_t offset = 0, size_t len = 0);
+
+    // madvise() hint for the whole mapping
+    void Advise(Access access);
+
+    // Raw descriptor, for pwrite()/fsync() style appends
+    int Descriptor() const { return fd; }
+
+    static size_t PageSize();
+
+    // fsync() a directory so renames/creations inside it are durable
+    static bool SyncDirectory(const std::string& dir);
+
+private:
+    bool Map();
+    void Unmap();
+
+    int fd;
+    Mode mode;
+    uint8_t* base;
+    size_t size;
+    std::string path;
+};
+
+#endif // DRACHMA_STORAGE_MMAPFILE_H
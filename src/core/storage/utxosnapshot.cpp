@@ -0,0 +1,478 @@
+#include "utxosnapshot.h"
+#include "../crypto/hash.h"
+#include "../node/scheduler.h"
+#include "../../common/utils/serialize.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+static const uint32_t SNAPSHOT_MAGIC   = 0x4E535244;   // "DRSN"
+static const uint32_t SNAPSHOT_VERSION = 1;
+static const uint32_t SNAPSHOT_CHUNKS  = 256;
+
+static const size_t HEADER_SIZE  = 64;
+static const size_t ENTRY_SIZE   = 56;
+static const size_t TRAILER_SIZE = 16;
+
+enum SnapshotScript : uint8_t
+{
+    SCRIPT_P2PKH  = 0,
+    SCRIPT_P2SH   = 1,
+    SCRIPT_P2WPKH = 2,
+    SCRIPT_RAW    = 3       // + script length
+};
+
+namespace
+{
+    struct ChunkEntry
+    {
+        uint64_t offset;
+        uint64_t size;
+        uint64_t coins;
+        uint8_t hash[32];
+    };
+
+    typedef std::function<bool(const uint8_t* data, size_t len)> SinkFn;
+}
+
+//
+// ================================================================
+//  Encoding
+// ================================================================
+static void EncodeHeader(const SnapshotInfo& info, uint8_t out[HEADER_SIZE])
+{
+    std::memset(out, 0, HEADER_SIZE);
+    WriteLE32(out, SNAPSHOT_MAGIC);
+    WriteLE32(out + 4, SNAPSHOT_VERSION);
+    std::memcpy(out + 8, info.bestBlock.data(), 32);
+    WriteLE32(out + 40, info.height);
+    WriteLE64(out + 48, info.coins);
+    WriteLE32(out + 56, info.chunks);
+}
+
+static bool DecodeHeader(const uint8_t* p, SnapshotInfo& info)
+{
+    if (ReadLE32(p) != SNAPSHOT_MAGIC || ReadLE32(p + 4) != SNAPSHOT_VERSION)
+        return false;
+
+    std::memcpy(info.bestBlock.data(), p + 8, 32);
+    info.height = ReadLE32(p + 40);
+    info.coins = ReadLE64(p + 48);
+    info.chunks = ReadLE32(p + 56);
+    return info.chunks == SNAPSHOT_CHUNKS;
+}
+
+static void EncodeEntry(const ChunkEntry& e, std::vector<uint8_t>& out)
+{
+    AppendU64(out, e.offset);
+    AppendU64(out, e.size);
+    AppendU64(out, e.coins);
+    AppendBytes(out, e.hash, 32);
+}
+
+static void DecodeEntry(const uint8_t* p, ChunkEntry& e)
+{
+    e.offset = ReadLE64(p);
+    e.size = ReadLE64(p + 8);
+    e.coins = ReadLE64(p + 16);
+    std::memcpy(e.hash, p + 24, 32);
+}
+
+// SHA256D(header | chunk hashes)
+static void ContentHash(const uint8_t header[HEADER_SIZE], const std::vector<ChunkEntry>& table,
+                        std::array<uint8_t,32>& out)
+{
+    std::vector<uint8_t> buf(header, header + HEADER_SIZE);
+    for (const ChunkEntry& e : table)
+        AppendBytes(buf, e.hash, 32);
+
+    Hash::SHA256D(buf.data(), buf.size(), out.data());
+}
+
+static void EncodeCoin(const OutPoint& out, const Coin& coin, std::vector<uint8_t>& buf)
+{
+    const std::vector<uint8_t>& s = coin.script;
+
+    AppendBytes(buf, out.txid.data(), 32);
+    AppendVarInt(buf, out.index);
+    AppendVarInt(buf, (uint64_t)coin.height * 2 + (coin.coinbase ? 1 : 0));
+    AppendVarInt(buf, (uint64_t)coin.amount);
+
+    if (s.size() == 25 && s[0] == 0x76 && s[1] == 0xa9 && s[2] == 0x14 &&
+        s[23] == 0x88 && s[24] == 0xac)
+    {
+        AppendVarInt(buf, SCRIPT_P2PKH);
+        AppendBytes(buf, &s[3], 20);
+    }
+    else if (s.size() == 23 && s[0] == 0xa9 && s[1] == 0x14 && s[22] == 0x87)
+    {
+        AppendVarInt(buf, SCRIPT_P2SH);
+        AppendBytes(buf, &s[2], 20);
+    }
+    else if (s.size() == 22 && s[0] == 0x00 && s[1] == 0x14)
+    {
+        AppendVarInt(buf, SCRIPT_P2WPKH);
+        AppendBytes(buf, &s[2], 20);
+    }
+    else
+    {
+        AppendVarInt(buf, SCRIPT_RAW + (uint64_t)s.size());
+        AppendBytes(buf, s.data(), s.size());
+    }
+}
+
+static bool DecodeCoin(SpanReader& r, OutPoint& out, Coin& coin)
+{
+    uint64_t index, code, amount, kind;
+
+    if (!r.ReadBytes(out.txid.data(), 32) ||
+        !r.ReadVarInt(index) || index > UINT32_MAX ||
+        !r.ReadVarInt(code) || (code >> 1) > UINT32_MAX ||
+        !r.ReadVarInt(amount) || amount > (uint64_t)INT64_MAX ||
+        !r.ReadVarInt(kind))
+        return false;
+
+    out.index = (uint32_t)index;
+    coin.height = (uint32_t)(code >> 1);
+    coin.coinbase = (code & 1) != 0;
+    coin.amount = (int64_t)amount;
+
+    std::vector<uint8_t>& s = coin.script;
+    uint8_t h[20];
+
+    switch (kind)
+    {
+        case SCRIPT_P2PKH:
+            if (!r.ReadBytes(h, 20)) return false;
+            s.assign({ 0x76, 0xa9, 0x14 });
+            s.insert(s.end(), h, h + 20);
+            s.push_back(0x88);
+            s.push_back(0xac);
+            return true;
+
+        case SCRIPT_P2SH:
+            if (!r.ReadBytes(h, 20)) return false;
+            s.assign({ 0xa9, 0x14 });
+            s.insert(s.end(), h, h + 20);
+            s.push_back(0x87);
+            return true;
+
+        case SCRIPT_P2WPKH:
+            if (!r.ReadBytes(h, 20)) return false;
+            s.assign({ 0x00, 0x14 });
+            s.insert(s.end(), h, h + 20);
+            return true;
+    }
+
+    if (kind - SCRIPT_RAW > MAX_SERIALIZED_SIZE)
+        return false;
+
+    ByteSpan raw;
+    if (!r.ReadSpan((size_t)(kind - SCRIPT_RAW), raw))
+        return false;
+
+    s.assign(raw.begin(), raw.end());
+    return true;
+}
+
+//
+// Canonical chunk stream of a store; shared by Export() and
+// ComputeContentHash(). `sink` receives the header and each
+// finished chunk in file order.
+//
+static bool StreamSet(const UTXOStore& store, uint32_t height, const SinkFn& sink,
+                      SnapshotInfo& info, std::vector<ChunkEntry>& table)
+{
+    if (!store.IsOpen())
+        return false;
+
+    info.bestBlock = store.GetBestBlock();
+    info.height = height;
+    info.coins = store.GetStats().coins;
+    info.chunks = SNAPSHOT_CHUNKS;
+
+    uint8_t header[HEADER_SIZE];
+    EncodeHeader(info, header);
+    if (!sink(header, HEADER_SIZE))
+        return false;
+
+    table.assign(SNAPSHOT_CHUNKS, ChunkEntry());
+
+    std::vector<uint8_t> buf;
+    uint64_t offset = HEADER_SIZE;
+    uint64_t total = 0;
+    uint32_t cur = 0;
+    bool ok = true;
+
+    auto finish = [&](uint32_t i)
+    {
+        ChunkEntry& e = table[i];
+        e.offset = offset;
+        e.size = buf.size();
+        Hash::SHA256D(buf.data(), buf.size(), e.hash);
+
+        ok = ok && sink(buf.data(), buf.size());
+        offset += buf.size();
+        total += e.coins;
+        buf.clear();
+    };
+
+    bool walked = store.ForEachCoin([&](const OutPoint& out, const Coin& coin)
+    {
+        while (cur < out.txid[0])
+            finish(cur++);
+
+        EncodeCoin(out, coin, buf);
+        table[cur].coins++;
+        return ok;
+    }, true);
+
+    if (!walked)
+        return false;
+
+    while (cur < SNAPSHOT_CHUNKS)
+        finish(cur++);
+
+    if (!ok || total != info.coins)
+        return false;
+
+    ContentHash(header, table, info.contentHash);
+    return true;
+}
+
+static bool WriteAll(int fd, const uint8_t* data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = ::write(fd, data, len);
+        if (n <= 0)
+            return false;
+        data += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+// Runs fn(0..n-1) as up to `threads` tasks on the node scheduler,
+// this thread included; false if any call failed
+static bool ParallelFor(unsigned threads, uint32_t n, const std::function<bool(uint32_t)>& fn)
+{
+    Scheduler& scheduler = Scheduler::Global();
+    if (threads == 0)
+        threads = scheduler.Size();
+
+    std::atomic<uint32_t> next(0);
+    std::atomic<bool> failed(false);
+
+    auto worker = [&]()
+    {
+        for (;;)
+        {
+            uint32_t i = next.fetch_add(1);
+            if (i >= n || failed.load())
+                return;
+            if (!fn(i))
+                failed = true;
+        }
+    };
+
+    TaskGroup group(scheduler, TASK_BACKGROUND);
+    for (unsigned t = 1; t < threads && t < n; ++t)
+        group.Run(worker);
+
+    worker();
+    group.Wait();
+
+    return !failed.load();
+}
+
+//
+// ================================================================
+//  Export
+// ================================================================
+bool UTXOSnapshot::Export(const UTXOStore& store, uint32_t height,
+                          const std::string& path, SnapshotInfo* infoOut)
+{
+    const std::string tmp = path + ".tmp";
+
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return false;
+
+    SnapshotInfo info;
+    std::vector<ChunkEntry> table;
+
+    bool ok = StreamSet(store, height, [fd](const uint8_t* data, size_t len)
+    {
+        return WriteAll(fd, data, len);
+    }, info, table);
+
+    if (ok)
+    {
+        uint64_t tableOffset = HEADER_SIZE;
+        for (const ChunkEntry& e : table)
+            tableOffset += e.size;
+
+        std::vector<uint8_t> tail;
+        tail.reserve(table.size() * ENTRY_SIZE + 32 + TRAILER_SIZE);
+        for (const ChunkEntry& e : table)
+            EncodeEntry(e, tail);
+        AppendBytes(tail, info.contentHash.data(), 32);
+        AppendU64(tail, tableOffset);
+        AppendU32(tail, SNAPSHOT_MAGIC);
+        AppendU32(tail, 0);
+
+        ok = WriteAll(fd, tail.data(), tail.size()) && fsync(fd) == 0;
+    }
+
+    ok = (::close(fd) == 0) && ok;
+
+    std::string dir = ".";
+    size_t slash = path.find_last_of('/');
+    if (slash != std::string::npos)
+        dir = slash ? path.substr(0, slash) : "/";
+
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0 || !MappedFile::SyncDirectory(dir))
+    {
+        unlink(tmp.c_str());
+        return false;
+    }
+
+    if (infoOut)
+        *infoOut = info;
+    return true;
+}
+
+bool UTXOSnapshot::ComputeContentHash(const UTXOStore& store, uint32_t height, SnapshotInfo& info)
+{
+    std::vector<ChunkEntry> table;
+    return StreamSet(store, height, [](const uint8_t*, size_t) { return true; }, info, table);
+}
+
+//
+// ================================================================
+//  Reading
+// ================================================================
+static bool OpenSnapshot(const std::string& path, MappedFile& file,
+                         SnapshotInfo& info, std::vector<ChunkEntry>& table)
+{
+    if (!file.Open(path, MappedFile::READ_ONLY))
+        return false;
+
+    const size_t tailSize = SNAPSHOT_CHUNKS * ENTRY_SIZE + 32 + TRAILER_SIZE;
+    const size_t size = file.Size();
+    if (size < HEADER_SIZE + tailSize)
+        return false;
+
+    const uint8_t* base = file.Data();
+    const uint8_t* trailer = base + size - TRAILER_SIZE;
+
+    uint64_t tableOffset = ReadLE64(trailer);
+    if (ReadLE32(trailer + 8) != SNAPSHOT_MAGIC || tableOffset != size - tailSize)
+        return false;
+
+    if (!DecodeHeader(base, info))
+        return false;
+
+    // Chunks must tile the space between header and table exactly
+    table.resize(SNAPSHOT_CHUNKS);
+    uint64_t offset = HEADER_SIZE;
+    uint64_t coins = 0;
+    for (uint32_t i = 0; i < SNAPSHOT_CHUNKS; ++i)
+    {
+        DecodeEntry(base + tableOffset + i * ENTRY_SIZE, table[i]);
+        if (table[i].offset != offset || table[i].size > tableOffset - offset)
+            return false;
+        offset += table[i].size;
+        coins += table[i].coins;
+    }
+
+    if (offset != tableOffset || coins != info.coins)
+        return false;
+
+    std::memcpy(info.contentHash.data(), base + tableOffset + SNAPSHOT_CHUNKS * ENTRY_SIZE, 32);
+
+    std::array<uint8_t,32> check;
+    ContentHash(base, table, check);
+    return check == info.contentHash;
+}
+
+bool UTXOSnapshot::ReadInfo(const std::string& path, SnapshotInfo& info)
+{
+    MappedFile file;
+    std::vector<ChunkEntry> table;
+    return OpenSnapshot(path, file, info, table);
+}
+
+bool UTXOSnapshot::Load(const std::string& path, const std::array<uint8_t,32>& expectedHash,
+                        UTXOStore& store, unsigned threads, SnapshotInfo* infoOut)
+{
+    MappedFile file;
+    SnapshotInfo info;
+    std::vector<ChunkEntry> table;
+
+    if (!OpenSnapshot(path, file, info, table) || info.contentHash != expectedHash)
+        return false;
+
+    file.Advise(MappedFile::ACCESS_WILLNEED);
+    const uint8_t* base = file.Data();
+
+    // 1. Chunk checksums, before the store is touched
+    bool ok = ParallelFor(threads, SNAPSHOT_CHUNKS, [&](uint32_t i)
+    {
+        uint8_t hash[32];
+        Hash::SHA256D(base + table[i].offset, (size_t)table[i].size, hash);
+        return std::memcmp(hash, table[i].hash, 32) == 0;
+    });
+
+    if (!ok || !store.BeginBulkLoad(info.coins))
+        return false;
+
+    // 2. Decode in parallel, insert under one lock. Coins have to be
+    //    in canonical order so a snapshot has exactly one encoding.
+    std::mutex insertMutex;
+
+    ok = ParallelFor(threads, SNAPSHOT_CHUNKS, [&](uint32_t i)
+    {
+        SpanReader r(ByteSpan(base + table[i].offset, (size_t)table[i].size));
+
+        std::vector<std::pair<OutPoint, Coin>> coins;
+        coins.reserve((size_t)std::min<uint64_t>(table[i].coins, table[i].size / 36));
+
+        for (uint64_t n = 0; n < table[i].coins; ++n)
+        {
+            OutPoint out;
+            Coin coin;
+            if (!DecodeCoin(r, out, coin) || out.txid[0] != i)
+                return false;
+            if (!coins.empty() && !(coins.back().first < out))
+                return false;
+            coins.emplace_back(out, std::move(coin));
+        }
+
+        if (!r.Empty())
+            return false;
+
+        std::lock_guard<std::mutex> lock(insertMutex);
+        for (const auto& c : coins)
+            if (!store.BulkInsert(c.first, c.second))
+                return false;
+        return true;
+    });
+
+    if (!ok || !store.EndBulkLoad(info.bestBlock))
+        return false;
+
+    if (infoOut)
+        *infoOut = info;
+    return true;
+}
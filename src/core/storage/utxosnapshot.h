@@ -0,0 +1,76 @@
+#ifndef DRACHMA_STORAGE_UTXOSNAPSHOT_H
+#define DRACHMA_STORAGE_UTXOSNAPSHOT_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+#include "utxostore.h"
+
+//
+// Summary of a snapshot file (or of a live coin set)
+//
+struct SnapshotInfo
+{
+    std::array<uint8_t,32> bestBlock;
+    uint32_t height;
+    uint64_t coins;
+    uint32_t chunks;
+    std::array<uint8_t,32> contentHash;
+};
+
+//
+// ===============================================================
+//  CLASS: UTXOSnapshot
+// ===============================================================
+//
+//  Compact, chunked dump of a whole UTXO set, used to bootstrap a
+//  node without replaying the chain.
+//
+//  File layout:
+//    header  – magic "DRSN", version, best block, height, coin
+//              count, chunk count (64 bytes)
+//    chunks  – 256 of them; chunk i holds the coins whose txid
+//              starts with byte i, in (txid, index) order:
+//                txid[32] | VARINT index | VARINT height*2+coinbase
+//                | VARINT amount | VARINT kind | script
+//              kind 0/1/2 = P2PKH/P2SH/P2WPKH followed by the
+//              20-byte hash, kind n >= 3 = raw script of n-3 bytes
+//    table   – per chunk { u64 offset, u64 size, u64 coins,
+//              SHA256D(chunk) }
+//    content – SHA256D(header | chunk hashes)
+//    trailer – u64 table offset, u32 magic, u32 reserved
+//
+//  The encoding is canonical, so equal coin sets at equal heights
+//  always give the same content hash. That is what a node checks
+//  against a trusted value before using a snapshot, and what the
+//  background validation of the history compares with once it
+//  reaches the snapshot height (ComputeContentHash()).
+//
+// ===============================================================
+//
+class UTXOSnapshot
+{
+public:
+    // Write the flushed coin set of `store` to `path` (atomically,
+    // via a temporary file). The store must have no unflushed changes.
+    static bool Export(const UTXOStore& store, uint32_t height,
+                       const std::string& path, SnapshotInfo* info = nullptr);
+
+    // Header / content hash only; chunks are not read
+    static bool ReadInfo(const std::string& path, SnapshotInfo& info);
+
+    // Fill an empty store from a snapshot whose content hash must
+    // equal `expectedHash`. The file is mapped; chunk checksums are
+    // verified and chunks decoded as up to `threads` background
+    // tasks on the node Scheduler (0 = one per worker). On failure the store is left half-loaded and is wiped
+    // by its next Open().
+    static bool Load(const std::string& path, const std::array<uint8_t,32>& expectedHash,
+                     UTXOStore& store, unsigned threads = 0, SnapshotInfo* info = nullptr);
+
+    // Content hash `store` would export to at `height`, without
+    // writing anything
+    static bool ComputeContentHash(const UTXOStore& store, uint32_t height, SnapshotInfo& info);
+};
+
+#endif // DRACHMA_STORAGE_UTXOSNAPSHOT_H
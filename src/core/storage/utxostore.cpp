@@ -0,0 +1,1121 @@
+#include "utxostore.h"
+#include "../crypto/hash.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+static const uint32_t TABLE_MAGIC   = 0x4F545855;   // "UXTO"
+static const uint32_t JOURNAL_MAGIC = 0x4A4F5855;   // "UXOJ"
+static const uint32_t TABLE_VERSION = 2;
+
+static const size_t HEADER_SIZE = 4096;             // slots start page-aligned
+static const uint64_t MIN_CAPACITY = 1024;
+
+// Keep the table at most 3/4 full so probe sequences stay short
+static const uint64_t LOAD_NUM = 3;
+static const uint64_t LOAD_DEN = 4;
+
+enum SlotFlags : uint8_t
+{
+    SLOT_USED     = 1,
+    SLOT_COINBASE = 2
+};
+
+enum ScriptKind : uint8_t
+{
+    KIND_P2PKH    = 1,      // 76 a9 14 <20> 88 ac
+    KIND_P2SH     = 2,      // a9 14 <20> 87
+    KIND_P2WPKH   = 3,      // 00 14 <20>
+    KIND_OVERFLOW = 4       // payload = { u64 offset, u32 length }
+};
+
+//
+// ================================================================
+//  Salted outpoint hash
+// ================================================================
+static inline uint64_t Mix64(uint64_t x)
+{
+    // murmur3 / splitmix finalizer
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+SaltedOutPointHasher::SaltedOutPointHasher()
+{
+    std::random_device rd;
+    k0 = ((uint64_t)rd() << 32) | rd();
+    k1 = ((uint64_t)rd() << 32) | rd();
+}
+
+uint64_t SaltedOutPointHasher::Hash(const uint8_t* txid, uint32_t index) const
+{
+    // txids are already uniformly distributed; 128 bits of it mixed
+    // with the secret salt is plenty for bucket selection.
+    uint64_t a, b;
+    std::memcpy(&a, txid, 8);
+    std::memcpy(&b, txid + 8, 8);
+
+    uint64_t h = Mix64(a ^ k0);
+    h = Mix64(h ^ b ^ k1);
+    return Mix64(h ^ index);
+}
+
+//
+// ================================================================
+//  Script compression
+// ================================================================
+static uint8_t CompressScript(const std::vector<uint8_t>& s, uint8_t out[20])
+{
+    if (s.size() == 25 && s[0] == 0x76 && s[1] == 0xa9 && s[2] == 0x14 &&
+        s[23] == 0x88 && s[24] == 0xac)
+    {
+        std::memcpy(out, &s[3], 20);
+        return KIND_P2PKH;
+    }
+
+    if (s.size() == 23 && s[0] == 0xa9 && s[1] == 0x14 && s[22] == 0x87)
+    {
+        std::memcpy(out, &s[2], 20);
+        return KIND_P2SH;
+    }
+
+    if (s.size() == 22 && s[0] == 0x00 && s[1] == 0x14)
+    {
+        std::memcpy(out, &s[2], 20);
+        return KIND_P2WPKH;
+    }
+
+    return KIND_OVERFLOW;
+}
+
+static void DecompressScript(uint8_t kind, const uint8_t h[20], std::vector<uint8_t>& s)
+{
+    switch (kind)
+    {
+        case KIND_P2PKH:
+            s.resize(25);
+            s[0] = 0x76; s[1] = 0xa9; s[2] = 0x14;
+            std::memcpy(&s[3], h, 20);
+            s[23] = 0x88; s[24] = 0xac;
+            break;
+
+        case KIND_P2SH:
+            s.resize(23);
+            s[0] = 0xa9; s[1] = 0x14;
+            std::memcpy(&s[2], h, 20);
+            s[22] = 0x87;
+            break;
+
+        case KIND_P2WPKH:
+            s.resize(22);
+            s[0] = 0x00; s[1] = 0x14;
+            std::memcpy(&s[2], h, 20);
+            break;
+    }
+}
+
+static bool WriteAll(int fd, const uint8_t* data, size_t len, uint64_t offset)
+{
+    while (len > 0)
+    {
+        ssize_t n = pwrite(fd, data, len, (off_t)offset);
+        if (n <= 0)
+            return false;
+        data += n;
+        len -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+    return true;
+}
+
+static bool ReadAll(int fd, uint8_t* data, size_t len, uint64_t offset)
+{
+    while (len > 0)
+    {
+        ssize_t n = pread(fd, data, len, (off_t)offset);
+        if (n <= 0)
+            return false;
+        data += n;
+        len -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+    return true;
+}
+
+//
+// ================================================================
+//  Construction / Open
+// ================================================================
+UTXOStore::UTXOStore()
+{
+    overflowFd = -1;
+    journalFd = -1;
+    cacheScriptBytes = 0;
+    bulkLoading = false;
+    flushCount = 0;
+    lastFlushSlots = 0;
+    std::memset(&pendingHeader, 0, sizeof(pendingHeader));
+}
+
+UTXOStore::~UTXOStore()
+{
+    Close();
+}
+
+std::string UTXOStore::OverflowPath(uint64_t gen) const
+{
+    return dir + "/utxo.ovf." + std::to_string(gen);
+}
+
+bool UTXOStore::Open(const std::string& d, const Options& o)
+{
+    Close();
+
+    dir = d;
+    opts = o;
+
+    const std::string tblPath = dir + "/utxo.tbl";
+
+    // Leftover of a grow that never reached its rename
+    unlink((tblPath + ".new").c_str());
+
+    if (!table.Open(tblPath, MappedFile::READ_WRITE))
+        return false;
+
+    if (table.Size() == 0)
+    {
+        uint64_t cap = MIN_CAPACITY;
+        while (cap < opts.initialCapacity)
+            cap <<= 1;
+
+        if (!table.Resize(HEADER_SIZE + cap * sizeof(Slot)))
+        {
+            Close();
+            return false;
+        }
+
+        SaltedOutPointHasher salt;
+
+        Header* h = GetHeader();
+        std::memset(h, 0, sizeof(Header));
+        h->magic = TABLE_MAGIC;
+        h->version = TABLE_VERSION;
+        h->salt0 = salt.k0;
+        h->salt1 = salt.k1;
+        h->capacity = cap;
+
+        if (!table.Sync() || !MappedFile::SyncDirectory(dir))
+        {
+            Close();
+            return false;
+        }
+    }
+
+    const Header* h = GetHeader();
+    if (table.Size() < HEADER_SIZE || h->magic != TABLE_MAGIC || h->version != TABLE_VERSION ||
+        (h->capacity & (h->capacity - 1)) != 0 ||
+        table.Size() != HEADER_SIZE + h->capacity * sizeof(Slot))
+    {
+        Close();
+        return false;
+    }
+
+    hasher = SaltedOutPointHasher(h->salt0, h->salt1);
+    cache = CacheMap(0, hasher);
+
+    // An interrupted bulk load leaves an unusable partial set
+    if (h->loading && !ResetTable())
+    {
+        Close();
+        return false;
+    }
+
+    journalFd = ::open((dir + "/utxo.log").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (journalFd < 0 || !MappedFile::SyncDirectory(dir))
+    {
+        Close();
+        return false;
+    }
+
+    if (!OpenOverflow() || !ReplayJournal())
+    {
+        Close();
+        return false;
+    }
+
+    // Anything past overflowSize belongs to a commit that never made
+    // it into the journal.
+    if (ftruncate(overflowFd, (off_t)GetHeader()->overflowSize) != 0)
+    {
+        Close();
+        return false;
+    }
+
+    table.Advise(MappedFile::ACCESS_RANDOM);
+    return true;
+}
+
+bool UTXOStore::OpenOverflow()
+{
+    uint64_t gen = GetHeader()->overflowGen;
+
+    // Files of an interrupted (gen + 1) or completed (gen - 1) grow
+    unlink(OverflowPath(gen + 1).c_str());
+    if (gen > 0)
+        unlink(OverflowPath(gen - 1).c_str());
+
+    overflowFd = ::open(OverflowPath(gen).c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    return overflowFd >= 0;
+}
+
+void UTXOStore::Close()
+{
+    if (overflowFd >= 0)
+        ::close(overflowFd);
+    if (journalFd >= 0)
+        ::close(journalFd);
+
+    overflowFd = -1;
+    journalFd = -1;
+
+    table.Close();
+
+    cache.clear();
+    cacheScriptBytes = 0;
+    pending.clear();
+    overflowAppend.clear();
+    bulkLoading = false;
+}
+
+bool UTXOStore::ResetTable()
+{
+    const uint64_t cap = GetHeader()->capacity;
+    const size_t size = table.Size();
+
+    // Shrinking to the header and back punches out every slot
+    if (!table.Resize(HEADER_SIZE) || !table.Resize(size))
+        return false;
+
+    Header* h = GetHeader();
+    h->capacity = cap;
+    h->count = 0;
+    h->overflowSize = 0;
+    h->loading = 0;
+    std::memset(h->bestBlock, 0, 32);
+
+    return table.Sync();
+}
+
+//
+// ================================================================
+//  Table access
+// ================================================================
+UTXOStore::Slot* UTXOStore::SlotAt(uint64_t i) const
+{
+    return (Slot*)(table.Data() + HEADER_SIZE) + i;
+}
+
+bool UTXOStore::FindSlot(const OutPoint& out, uint64_t& pos) const
+{
+    const Header* h = GetHeader();
+    const uint64_t mask = h->capacity - 1;
+
+    pos = hasher.Hash(out.txid.data(), out.index) & mask;
+
+    for (;;)
+    {
+        const Slot* s = SlotAt(pos);
+
+        if (!(s->flags & SLOT_USED))
+            return false;
+
+        if (s->index == out.index && std::memcmp(s->txid, out.txid.data(), 32) == 0)
+            return true;
+
+        pos = (pos + 1) & mask;
+    }
+}
+
+bool UTXOStore::ReadOverflow(uint64_t offset, uint32_t len, std::vector<uint8_t>& out) const
+{
+    out.resize(len);
+    return ReadAll(overflowFd, out.data(), len, offset);
+}
+
+bool UTXOStore::DecodeSlot(const Slot& s, Coin& coin) const
+{
+    coin.amount = s.amount;
+    coin.height = s.height;
+    coin.coinbase = (s.flags & SLOT_COINBASE) != 0;
+
+    if (s.kind != KIND_OVERFLOW)
+    {
+        DecompressScript(s.kind, s.payload, coin.script);
+        return true;
+    }
+
+    uint64_t offset;
+    uint32_t len;
+    std::memcpy(&offset, s.payload, 8);
+    std::memcpy(&len, s.payload + 8, 4);
+
+    return ReadOverflow(offset, len, coin.script);
+}
+
+//
+// ================================================================
+//  Lookups
+// ================================================================
+bool UTXOStore::GetCoin(const OutPoint& out, Coin& coin) const
+{
+    auto it = cache.find(out);
+    if (it != cache.end())
+    {
+        if (it->second.coin.IsSpent())
+            return false;
+        coin = it->second.coin;
+        return true;
+    }
+
+    uint64_t pos;
+    if (!FindSlot(out, pos))
+        return false;
+
+    return DecodeSlot(*SlotAt(pos), coin);
+}
+
+bool UTXOStore::HaveCoin(const OutPoint& out) const
+{
+    auto it = cache.find(out);
+    if (it != cache.end())
+        return !it->second.coin.IsSpent();
+
+    uint64_t pos;
+    return FindSlot(out, pos);
+}
+
+//
+// ================================================================
+//  Modifications
+// ================================================================
+void UTXOStore::AddCoin(const OutPoint& out, Coin coin, bool possibleOverwrite)
+{
+    size_t scriptBytes = coin.script.capacity();
+
+    auto it = cache.find(out);
+    if (it == cache.end())
+    {
+        CacheEntry e;
+        e.coin = std::move(coin);
+        e.flags = DIRTY | (possibleOverwrite ? 0 : FRESH);
+        cache.emplace(out, std::move(e));
+    }
+    else
+    {
+        // Spent-but-cached entries are never FRESH (those are erased
+        // on spend), so the disk copy still has to be overwritten.
+        CacheEntry& e = it->second;
+        cacheScriptBytes -= e.coin.script.capacity();
+        e.coin = std::move(coin);
+        e.flags |= DIRTY;
+    }
+
+    cacheScriptBytes += scriptBytes;
+}
+
+bool UTXOStore::SpendCoin(const OutPoint& out, Coin* moveTo)
+{
+    auto it = cache.find(out);
+    if (it == cache.end())
+    {
+        uint64_t pos;
+        if (!FindSlot(out, pos))
+            return false;
+
+        if (moveTo && !DecodeSlot(*SlotAt(pos), *moveTo))
+            return false;
+
+        CacheEntry e;
+        e.flags = DIRTY;
+        cache.emplace(out, std::move(e));
+        return true;
+    }
+
+    CacheEntry& e = it->second;
+    if (e.coin.IsSpent())
+        return false;
+
+    cacheScriptBytes -= e.coin.script.capacity();
+
+    if (moveTo)
+        *moveTo = std::move(e.coin);
+
+    if (e.flags & FRESH)
+    {
+        // Created and spent between two flushes – disk never sees it
+        cache.erase(it);
+    }
+    else
+    {
+        e.coin = Coin();
+        e.flags |= DIRTY;
+    }
+
+    return true;
+}
+
+void UTXOStore::DiscardCache()
+{
+    cache.clear();
+    cacheScriptBytes = 0;
+}
+
+size_t UTXOStore::CacheUsage() const
+{
+    const size_t node = sizeof(CacheMap::value_type) + 2 * sizeof(void*);
+    return cacheScriptBytes + cache.size() * node + cache.bucket_count() * sizeof(void*);
+}
+
+std::array<uint8_t,32> UTXOStore::GetBestBlock() const
+{
+    std::array<uint8_t,32> out;
+    out.fill(0);
+    if (IsOpen())
+        std::memcpy(out.data(), GetHeader()->bestBlock, 32);
+    return out;
+}
+
+UTXOStore::Stats UTXOStore::GetStats() const
+{
+    Stats s;
+    std::memset(&s, 0, sizeof(s));
+
+    if (IsOpen())
+    {
+        s.coins = GetHeader()->count;
+        s.capacity = GetHeader()->capacity;
+        s.overflowBytes = GetHeader()->overflowSize;
+    }
+
+    s.cacheEntries = cache.size();
+    s.cacheUsage = CacheUsage();
+    s.flushes = flushCount;
+    s.lastFlushSlots = lastFlushSlots;
+    return s;
+}
+
+//
+// ================================================================
+//  Commit batch construction
+// ================================================================
+const UTXOStore::Slot& UTXOStore::ReadSlot(uint64_t i) const
+{
+    auto it = pending.find(i);
+    if (it != pending.end())
+        return it->second;
+    return *SlotAt(i);
+}
+
+void UTXOStore::WriteSlot(uint64_t i, const Slot& s)
+{
+    pending[i] = s;
+}
+
+void UTXOStore::PendingPut(const OutPoint& out, const Coin& coin)
+{
+    const uint64_t mask = pendingHeader.capacity - 1;
+    uint64_t pos = hasher.Hash(out.txid.data(), out.index) & mask;
+
+    bool exists = false;
+    for (;;)
+    {
+        const Slot& s = ReadSlot(pos);
+        if (!(s.flags & SLOT_USED))
+            break;
+        if (s.index == out.index && std::memcmp(s.txid, out.txid.data(), 32) == 0)
+        {
+            exists = true;
+            break;
+        }
+        pos = (pos + 1) & mask;
+    }
+
+    Slot s;
+    EncodeSlot(out, coin, s);
+
+    if (!exists)
+        pendingHeader.count++;
+
+    WriteSlot(pos, s);
+}
+
+void UTXOStore::EncodeSlot(const OutPoint& out, const Coin& coin, Slot& s)
+{
+    std::memset(&s, 0, sizeof(s));
+    std::memcpy(s.txid, out.txid.data(), 32);
+    s.index = out.index;
+    s.height = coin.height;
+    s.amount = coin.amount;
+    s.flags = SLOT_USED | (coin.coinbase ? SLOT_COINBASE : 0);
+    s.kind = CompressScript(coin.script, s.payload);
+
+    // Scripts that do not compress are queued for the overflow area
+    if (s.kind == KIND_OVERFLOW)
+    {
+        uint64_t offset = GetHeader()->overflowSize + overflowAppend.size();
+        uint32_t len = (uint32_t)coin.script.size();
+        std::memcpy(s.payload, &offset, 8);
+        std::memcpy(s.payload + 8, &len, 4);
+        overflowAppend.insert(overflowAppend.end(), coin.script.begin(), coin.script.end());
+    }
+}
+
+void UTXOStore::PendingErase(const OutPoint& out)
+{
+    const uint64_t mask = pendingHeader.capacity - 1;
+    uint64_t pos = hasher.Hash(out.txid.data(), out.index) & mask;
+
+    for (;;)
+    {
+        const Slot& s = ReadSlot(pos);
+        if (!(s.flags & SLOT_USED))
+            return;
+        if (s.index == out.index && std::memcmp(s.txid, out.txid.data(), 32) == 0)
+            break;
+        pos = (pos + 1) & mask;
+    }
+
+    pendingHeader.count--;
+
+    // Backward-shift deletion: pull later members of the cluster
+    // into the hole so no tombstones are needed.
+    uint64_t hole = pos;
+    uint64_t j = pos;
+    for (;;)
+    {
+        j = (j + 1) & mask;
+
+        Slot s = ReadSlot(j);
+        if (!(s.flags & SLOT_USED))
+            break;
+
+        uint64_t home = hasher.Hash(s.txid, s.index) & mask;
+
+        // Entry must stay if its home lies cyclically in (hole, j]
+        bool stays = (hole <= j) ? (hole < home && home <= j)
+                                 : (hole < home || home <= j);
+        if (stays)
+            continue;
+
+        WriteSlot(hole, s);
+        hole = j;
+    }
+
+    Slot empty;
+    std::memset(&empty, 0, sizeof(empty));
+    WriteSlot(hole, empty);
+}
+
+//
+// ================================================================
+//  Flush / Commit
+// ================================================================
+bool UTXOStore::Flush(const std::array<uint8_t,32>& bestBlock)
+{
+    if (!IsOpen() || bulkLoading)
+        return false;
+
+    uint64_t puts = 0;
+    for (const auto& kv : cache)
+        if ((kv.second.flags & DIRTY) && !kv.second.coin.IsSpent())
+            puts++;
+
+    const Header* h = GetHeader();
+    if ((h->count + puts) * LOAD_DEN > h->capacity * LOAD_NUM)
+    {
+        uint64_t cap = h->capacity;
+        while ((h->count + puts) * LOAD_DEN > cap * LOAD_NUM)
+            cap <<= 1;
+
+        if (!Grow(cap))
+            return false;
+    }
+
+    pendingHeader = *GetHeader();
+    pending.clear();
+    overflowAppend.clear();
+
+    for (const auto& kv : cache)
+    {
+        if (!(kv.second.flags & DIRTY))
+            continue;
+
+        if (kv.second.coin.IsSpent())
+            PendingErase(kv.first);
+        else
+            PendingPut(kv.first, kv.second.coin);
+    }
+
+    pendingHeader.overflowSize += overflowAppend.size();
+    std::memcpy(pendingHeader.bestBlock, bestBlock.data(), 32);
+
+    bool ok = Commit();
+
+    lastFlushSlots = pending.size();
+    pending.clear();
+    overflowAppend.clear();
+    overflowAppend.shrink_to_fit();
+
+    if (!ok)
+        return false;
+
+    cache.clear();
+    cacheScriptBytes = 0;
+    flushCount++;
+    return true;
+}
+
+bool UTXOStore::Commit()
+{
+    std::vector<std::pair<uint64_t, Slot>> images(pending.begin(), pending.end());
+    std::sort(images.begin(), images.end(),
+              [](const std::pair<uint64_t, Slot>& a, const std::pair<uint64_t, Slot>& b)
+              { return a.first < b.first; });
+
+    // 1. Overflow data first; it is only referenced once the header
+    //    in the journal says so.
+    if (!overflowAppend.empty())
+    {
+        if (!WriteAll(overflowFd, overflowAppend.data(), overflowAppend.size(),
+                      GetHeader()->overflowSize) ||
+            fdatasync(overflowFd) != 0)
+            return false;
+    }
+
+    // 2. Redo journal: header image + slot images + checksum
+    std::vector<uint8_t> buf;
+    buf.reserve(16 + sizeof(Header) + images.size() * (8 + sizeof(Slot)) + 32);
+
+    auto put = [&buf](const void* p, size_t n)
+    {
+        const uint8_t* b = (const uint8_t*)p;
+        buf.insert(buf.end(), b, b + n);
+    };
+
+    uint64_t n = images.size();
+    put(&JOURNAL_MAGIC, 4);
+    put(&TABLE_VERSION, 4);
+    put(&pendingHeader, sizeof(Header));
+    put(&n, 8);
+    for (const auto& img : images)
+    {
+        put(&img.first, 8);
+        put(&img.second, sizeof(Slot));
+    }
+
+    std::vector<uint8_t> check = Hash::SHA256D(buf);
+    buf.insert(buf.end(), check.begin(), check.end());
+
+    if (!WriteAll(journalFd, buf.data(), buf.size(), 0) || fdatasync(journalFd) != 0)
+        return false;
+
+    // 3. Apply in place
+    if (!ApplyImages(pendingHeader, images))
+        return false;
+
+    // 4. Retire the journal
+    return ftruncate(journalFd, 0) == 0 && fdatasync(journalFd) == 0;
+}
+
+bool UTXOStore::ApplyImages(const Header& hdr, const std::vector<std::pair<uint64_t, Slot>>& images)
+{
+    const size_t page = MappedFile::PageSize();
+
+    std::vector<size_t> pages;
+    pages.reserve(images.size() * 2 + 1);
+    pages.push_back(0);
+
+    for (const auto& img : images)
+    {
+        size_t off = HEADER_SIZE + img.first * sizeof(Slot);
+        std::memcpy(table.Data() + off, &img.second, sizeof(Slot));
+
+        pages.push_back(off / page);
+        pages.push_back((off + sizeof(Slot) - 1) / page);
+    }
+
+    std::memcpy(GetHeader(), &hdr, sizeof(Header));
+
+    // msync() runs of touched pages only
+    std::sort(pages.begin(), pages.end());
+    pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+
+    size_t i = 0;
+    while (i < pages.size())
+    {
+        size_t j = i;
+        while (j + 1 < pages.size() && pages[j + 1] == pages[j] + 1)
+            j++;
+
+        if (!table.Sync(pages[i] * page, (pages[j] - pages[i] + 1) * page))
+            return false;
+
+        i = j + 1;
+    }
+
+    return true;
+}
+
+bool UTXOStore::ReplayJournal()
+{
+    struct stat st;
+    if (fstat(journalFd, &st) != 0)
+        return false;
+
+    if (st.st_size == 0)
+        return true;
+
+    std::vector<uint8_t> buf((size_t)st.st_size);
+    if (!ReadAll(journalFd, buf.data(), buf.size(), 0))
+        return false;
+
+    const size_t fixed = 8 + sizeof(Header) + 8;
+    bool valid = buf.size() >= fixed + 32;
+
+    uint32_t magic = 0, version = 0;
+    Header hdr;
+    uint64_t n = 0;
+
+    if (valid)
+    {
+        std::memcpy(&magic, &buf[0], 4);
+        std::memcpy(&version, &buf[4], 4);
+        std::memcpy(&hdr, &buf[8], sizeof(Header));
+        std::memcpy(&n, &buf[8 + sizeof(Header)], 8);
+
+        valid = magic == JOURNAL_MAGIC && version == TABLE_VERSION &&
+                n <= (buf.size() - fixed - 32) / (8 + sizeof(Slot)) &&
+                buf.size() == fixed + n * (8 + sizeof(Slot)) + 32 &&
+                hdr.capacity == GetHeader()->capacity &&
+                hdr.overflowGen == GetHeader()->overflowGen;
+    }
+
+    if (valid)
+    {
+        std::vector<uint8_t> body(buf.begin(), buf.end() - 32);
+        std::vector<uint8_t> check = Hash::SHA256D(body);
+        valid = std::memcmp(check.data(), &buf[buf.size() - 32], 32) == 0;
+    }
+
+    // A torn journal means the crash hit before anything was applied
+    if (valid)
+    {
+        std::vector<std::pair<uint64_t, Slot>> images(n);
+        const uint8_t* p = &buf[fixed];
+        for (uint64_t i = 0; i < n; ++i)
+        {
+            std::memcpy(&images[i].first, p, 8);
+            std::memcpy(&images[i].second, p + 8, sizeof(Slot));
+            p += 8 + sizeof(Slot);
+
+            if (images[i].first >= hdr.capacity)
+                return false;
+        }
+
+        if (!ApplyImages(hdr, images))
+            return false;
+    }
+
+    return ftruncate(journalFd, 0) == 0 && fdatasync(journalFd) == 0;
+}
+
+//
+// ================================================================
+//  Grow – rehash into a new table (and compact the overflow area)
+// ================================================================
+bool UTXOStore::Grow(uint64_t newCapacity)
+{
+    const std::string tblPath = dir + "/utxo.tbl";
+    const std::string newPath = tblPath + ".new";
+
+    const Header old = *GetHeader();
+    const uint64_t gen = old.overflowGen + 1;
+
+    MappedFile next;
+    if (!next.Open(newPath, MappedFile::READ_WRITE, HEADER_SIZE + newCapacity * sizeof(Slot)))
+        return false;
+
+    int ovf = ::open(OverflowPath(gen).c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (ovf < 0)
+    {
+        unlink(newPath.c_str());
+        return false;
+    }
+
+    Header* h = (Header*)next.Data();
+    *h = old;
+    h->capacity = newCapacity;
+    h->overflowSize = 0;
+    h->overflowGen = gen;
+
+    const uint64_t mask = newCapacity - 1;
+    Slot* slots = (Slot*)(next.Data() + HEADER_SIZE);
+
+    std::vector<uint8_t> ovfBuf;
+    std::vector<uint8_t> script;
+    bool ok = true;
+
+    for (uint64_t i = 0; i < old.capacity && ok; ++i)
+    {
+        Slot s = *SlotAt(i);
+        if (!(s.flags & SLOT_USED))
+            continue;
+
+        if (s.kind == KIND_OVERFLOW)
+        {
+            uint64_t offset;
+            uint32_t len;
+            std::memcpy(&offset, s.payload, 8);
+            std::memcpy(&len, s.payload + 8, 4);
+
+            if (!ReadOverflow(offset, len, script))
+            {
+                ok = false;
+                break;
+            }
+
+            offset = h->overflowSize + ovfBuf.size();
+            std::memcpy(s.payload, &offset, 8);
+            ovfBuf.insert(ovfBuf.end(), script.begin(), script.end());
+
+            if (ovfBuf.size() >= (4u << 20))
+            {
+                ok = WriteAll(ovf, ovfBuf.data(), ovfBuf.size(), h->overflowSize);
+                h->overflowSize += ovfBuf.size();
+                ovfBuf.clear();
+            }
+        }
+
+        uint64_t pos = hasher.Hash(s.txid, s.index) & mask;
+        while (slots[pos].flags & SLOT_USED)
+            pos = (pos + 1) & mask;
+        slots[pos] = s;
+    }
+
+    if (ok && !ovfBuf.empty())
+    {
+        ok = WriteAll(ovf, ovfBuf.data(), ovfBuf.size(), h->overflowSize);
+        h->overflowSize += ovfBuf.size();
+    }
+
+    ok = ok && fdatasync(ovf) == 0 && next.Sync();
+    next.Close();
+
+    // The rename is the commit point of the grow
+    if (!ok || rename(newPath.c_str(), tblPath.c_str()) != 0 || !MappedFile::SyncDirectory(dir))
+    {
+        ::close(ovf);
+        unlink(newPath.c_str());
+        unlink(OverflowPath(gen).c_str());
+        return false;
+    }
+
+    ::close(overflowFd);
+    overflowFd = ovf;
+    unlink(OverflowPath(gen - 1).c_str());
+
+    if (!table.Open(tblPath, MappedFile::READ_WRITE))
+        return false;
+
+    table.Advise(MappedFile::ACCESS_RANDOM);
+    return true;
+}
+
+//
+// ================================================================
+//  Whole-set iteration
+// ================================================================
+bool UTXOStore::ForEachCoin(const CoinFn& fn, bool sorted) const
+{
+    if (!IsOpen() || !cache.empty() || bulkLoading)
+        return false;
+
+    const uint64_t cap = GetHeader()->capacity;
+    Coin coin;
+    OutPoint out;
+
+    if (!sorted)
+    {
+        for (uint64_t i = 0; i < cap; ++i)
+        {
+            const Slot* s = SlotAt(i);
+            if (!(s->flags & SLOT_USED))
+                continue;
+
+            std::memcpy(out.txid.data(), s->txid, 32);
+            out.index = s->index;
+            if (!DecodeSlot(*s, coin) || !fn(out, coin))
+                return false;
+        }
+        return true;
+    }
+
+    if (cap > UINT32_MAX)
+        return false;
+
+    // One sequential pass spreads slot numbers over 256 buckets by
+    // the first txid byte; each bucket is then sorted on its own so
+    // only a small working set is hot at a time.
+    std::vector<std::vector<uint32_t>> buckets(256);
+    for (uint64_t i = 0; i < cap; ++i)
+    {
+        const Slot* s = SlotAt(i);
+        if (s->flags & SLOT_USED)
+            buckets[s->txid[0]].push_back((uint32_t)i);
+    }
+
+    for (std::vector<uint32_t>& b : buckets)
+    {
+        std::sort(b.begin(), b.end(), [this](uint32_t x, uint32_t y)
+        {
+            const Slot* a = SlotAt(x);
+            const Slot* c = SlotAt(y);
+            int r = std::memcmp(a->txid, c->txid, 32);
+            return r < 0 || (r == 0 && a->index < c->index);
+        });
+
+        for (uint32_t i : b)
+        {
+            const Slot* s = SlotAt(i);
+            std::memcpy(out.txid.data(), s->txid, 32);
+            out.index = s->index;
+            if (!DecodeSlot(*s, coin) || !fn(out, coin))
+                return false;
+        }
+
+        std::vector<uint32_t>().swap(b);
+    }
+
+    return true;
+}
+
+//
+// ================================================================
+//  Bulk load – straight into the mapping, no journal
+// ================================================================
+bool UTXOStore::BeginBulkLoad(uint64_t expectedCoins)
+{
+    if (!IsOpen() || bulkLoading || !cache.empty() || GetHeader()->count != 0)
+        return false;
+
+    uint64_t cap = GetHeader()->capacity;
+    while (expectedCoins * LOAD_DEN > cap * LOAD_NUM)
+        cap <<= 1;
+
+    if (cap != GetHeader()->capacity && !Grow(cap))
+        return false;
+
+    // Marked before the first slot is written; cleared by
+    // EndBulkLoad() only after everything is on disk.
+    GetHeader()->loading = 1;
+    if (!table.Sync(0, HEADER_SIZE))
+        return false;
+
+    overflowAppend.clear();
+    bulkLoading = true;
+    return true;
+}
+
+bool UTXOStore::BulkInsert(const OutPoint& out, const Coin& coin)
+{
+    if (!bulkLoading)
+        return false;
+
+    Header* h = GetHeader();
+    if ((h->count + 1) * LOAD_DEN > h->capacity * LOAD_NUM)
+    {
+        // Estimate was short. Grow() reads overflow scripts back from
+        // the file, so the buffered ones go out first.
+        if (!overflowAppend.empty())
+        {
+            if (!WriteAll(overflowFd, overflowAppend.data(), overflowAppend.size(), h->overflowSize))
+                return false;
+            h->overflowSize += overflowAppend.size();
+            overflowAppend.clear();
+        }
+
+        if (!Grow(h->capacity << 1))
+            return false;
+        h = GetHeader();
+    }
+
+    const uint64_t mask = h->capacity - 1;
+    uint64_t pos = hasher.Hash(out.txid.data(), out.index) & mask;
+
+    bool exists = false;
+    for (;;)
+    {
+        const Slot* s = SlotAt(pos);
+        if (!(s->flags & SLOT_USED))
+            break;
+        if (s->index == out.index && std::memcmp(s->txid, out.txid.data(), 32) == 0)
+        {
+            exists = true;
+            break;
+        }
+        pos = (pos + 1) & mask;
+    }
+
+    EncodeSlot(out, coin, *SlotAt(pos));
+    if (!exists)
+        h->count++;
+
+    if (overflowAppend.size() >= (4u << 20))
+    {
+        if (!WriteAll(overflowFd, overflowAppend.data(), overflowAppend.size(), h->overflowSize))
+            return false;
+        h->overflowSize += overflowAppend.size();
+        overflowAppend.clear();
+    }
+
+    return true;
+}
+
+bool UTXOStore::EndBulkLoad(const std::array<uint8_t,32>& bestBlock)
+{
+    if (!bulkLoading)
+        return false;
+
+    Header* h = GetHeader();
+    if (!overflowAppend.empty())
+    {
+        if (!WriteAll(overflowFd, overflowAppend.data(), overflowAppend.size(), h->overflowSize))
+            return false;
+        h->overflowSize += overflowAppend.size();
+    }
+
+    overflowAppend.clear();
+    overflowAppend.shrink_to_fit();
+
+    if (fdatasync(overflowFd) != 0 || !table.Sync())
+        return false;
+
+    // Clearing the flag is the commit point of the load
+    std::memcpy(h->bestBlock, bestBlock.data(), 32);
+    h->loading = 0;
+    if (!table.Sync(0, HEADER_SIZE))
+        return false;
+
+    bulkLoading = false;
+    return true;
+}
@@ -0,0 +1,233 @@
+#ifndef DRACHMA_STORAGE_UTXOSTORE_H
+#define DRACHMA_STORAGE_UTXOSTORE_H
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "coin.h"
+#include "mmapfile.h"
+#include "../tx/outpoint.h"
+
+//
+// ===============================================================
+//  SaltedOutPointHasher
+// ===============================================================
+//
+//  64-bit keyed hash of an outpoint. The salt is secret per node
+//  (and persisted per UTXO table) so peers cannot grind txids that
+//  pile up in one probe sequence.
+//
+struct SaltedOutPointHasher
+{
+    uint64_t k0;
+    uint64_t k1;
+
+    SaltedOutPointHasher();                     // random salt
+    SaltedOutPointHasher(uint64_t a, uint64_t b) : k0(a), k1(b) {}
+
+    size_t operator()(const OutPoint& out) const { return Hash(out.txid.data(), out.index); }
+    uint64_t Hash(const uint8_t* txid, uint32_t index) const;
+};
+
+//
+// ===============================================================
+//  CLASS: UTXOStore
+// ===============================================================
+//
+//  Memory-mapped, flat UTXO set.
+//
+//  On disk (one directory):
+//    utxo.tbl      – 4 KiB header + open-addressing table of fixed
+//                    72-byte slots, linear probing, power-of-two size
+//    utxo.ovf.<N>  – append-only overflow area for scripts that do
+//                    not fit a slot (N = generation, bumped on grow)
+//    utxo.log      – redo journal of the last in-flight commit
+//
+//  Slots keep the whole outpoint, amount, height and a 20-byte
+//  payload. P2PKH / P2SH / P2WPKH scripts are stored as their
+//  Hash160 only; anything else goes to the overflow area.
+//
+//  Writes go to an in-memory write-back cache. Flush() turns all
+//  dirty entries into one batch of physical slot images, writes
+//  them to the journal (fsync), applies them to the mapping and
+//  msync()s the touched pages. A crash at any point leaves either
+//  the old state or a complete journal that Open() replays.
+//
+//  Threading: GetCoin()/HaveCoin() may run concurrently with each
+//  other; anything that modifies the store needs exclusive access.
+//
+// ===============================================================
+//
+class UTXOStore
+{
+public:
+    struct Options
+    {
+        size_t cacheLimit;          // bytes of dirty cache before NeedsFlush()
+        uint64_t initialCapacity;   // slots for a freshly created table
+
+        Options() : cacheLimit(256u << 20), initialCapacity(1u << 20) {}
+    };
+
+    struct Stats
+    {
+        uint64_t coins;             // coins in the on-disk table
+        uint64_t capacity;          // table slots
+        size_t cacheEntries;
+        size_t cacheUsage;          // approx. bytes
+        uint64_t overflowBytes;
+        uint64_t flushes;
+        uint64_t lastFlushSlots;    // slot images written by the last flush
+    };
+
+    UTXOStore();
+    ~UTXOStore();
+
+    UTXOStore(const UTXOStore&) = delete;
+    UTXOStore& operator=(const UTXOStore&) = delete;
+
+    // Open or create the store in `dir` (must exist). Replays an
+    // unfinished commit if one is found.
+    bool Open(const std::string& dir, const Options& opts = Options());
+
+    // Drops unflushed changes.
+    void Close();
+
+    bool IsOpen() const { return table.IsOpen(); }
+
+    // ---- Lookups ----
+    bool GetCoin(const OutPoint& out, Coin& coin) const;
+    bool HaveCoin(const OutPoint& out) const;
+
+    // ---- Modifications (cached until Flush) ----
+    // possibleOverwrite must be set when the outpoint may already
+    // exist on disk (e.g. duplicate coinbase txids).
+    void AddCoin(const OutPoint& out, Coin coin, bool possibleOverwrite = false);
+
+    // Returns false if the coin does not exist. The spent coin is
+    // moved to *moveTo when given (undo data).
+    bool SpendCoin(const OutPoint& out, Coin* moveTo = nullptr);
+
+    // ---- Commit ----
+    bool NeedsFlush() const { return CacheUsage() > opts.cacheLimit; }
+    bool Flush(const std::array<uint8_t,32>& bestBlock);
+
+    // Forget everything cached since the last Flush(); the store is
+    // back at its flushed best block.
+    void DiscardCache();
+
+    std::array<uint8_t,32> GetBestBlock() const;
+    void SetCacheLimit(size_t bytes) { opts.cacheLimit = bytes; }
+
+    size_t CacheUsage() const;
+    Stats GetStats() const;
+
+    // ---- Whole-set access (snapshots) ----
+    // Walks the flushed coin set; fails while unflushed changes are
+    // cached. `sorted` yields coins in (txid, index) order at the
+    // cost of 4 bytes of memory per coin.
+    typedef std::function<bool(const OutPoint& out, const Coin& coin)> CoinFn;
+    bool ForEachCoin(const CoinFn& fn, bool sorted = false) const;
+
+    // Fill an empty store without the journal. A store left with an
+    // unfinished bulk load is wiped by the next Open().
+    bool BeginBulkLoad(uint64_t expectedCoins);
+    bool BulkInsert(const OutPoint& out, const Coin& coin);
+    bool EndBulkLoad(const std::array<uint8_t,32>& bestBlock);
+
+private:
+    //
+    // Persistent layout (little-endian host, written with memcpy)
+    //
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t salt0;
+        uint64_t salt1;
+        uint64_t capacity;
+        uint64_t count;
+        uint64_t overflowSize;
+        uint64_t overflowGen;
+        uint8_t bestBlock[32];
+        uint32_t loading;       // bulk load in progress
+        uint32_t reserved;
+    };
+
+    struct Slot
+    {
+        uint8_t txid[32];
+        uint32_t index;
+        uint32_t height;
+        int64_t amount;
+        uint8_t flags;
+        uint8_t kind;
+        uint16_t reserved;
+        uint8_t payload[20];
+    };
+
+    static_assert(sizeof(Slot) == 72, "UTXO slot layout changed");
+
+    enum CacheFlags : uint8_t
+    {
+        DIRTY = 1,
+        FRESH = 2     // not on disk – can be dropped when spent
+    };
+
+    struct CacheEntry
+    {
+        Coin coin;
+        uint8_t flags;
+    };
+
+    typedef std::unordered_map<OutPoint, CacheEntry, SaltedOutPointHasher> CacheMap;
+
+    // ---- table access ----
+    Header* GetHeader() const { return (Header*)table.Data(); }
+    Slot* SlotAt(uint64_t i) const;
+    bool FindSlot(const OutPoint& out, uint64_t& pos) const;
+    bool DecodeSlot(const Slot& s, Coin& coin) const;
+    void EncodeSlot(const OutPoint& out, const Coin& coin, Slot& s);
+
+    // ---- commit helpers (operate on the pending overlay) ----
+    const Slot& ReadSlot(uint64_t i) const;
+    void WriteSlot(uint64_t i, const Slot& s);
+    void PendingPut(const OutPoint& out, const Coin& coin);
+    void PendingErase(const OutPoint& out);
+    bool Commit();
+    bool ApplyImages(const Header& hdr, const std::vector<std::pair<uint64_t, Slot>>& images);
+    bool ReplayJournal();
+    bool Grow(uint64_t newCapacity);
+    bool ResetTable();
+
+    std::string OverflowPath(uint64_t gen) const;
+    bool OpenOverflow();
+    bool ReadOverflow(uint64_t offset, uint32_t len, std::vector<uint8_t>& out) const;
+
+    Options opts;
+    std::string dir;
+
+    MappedFile table;
+    int overflowFd;
+    int journalFd;
+
+    SaltedOutPointHasher hasher;
+    CacheMap cache;
+    size_t cacheScriptBytes;
+
+    // Overlay used while building a commit batch
+    Header pendingHeader;
+    std::unordered_map<uint64_t, Slot> pending;
+    std::vector<uint8_t> overflowAppend;
+    bool bulkLoading;
+
+    uint64_t flushCount;
+    uint64_t lastFlushSlots;
+};
+
+#endif // DRACHMA_STORAGE_UTXOSTORE_H
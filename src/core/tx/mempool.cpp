@@ -0,0 +1,434 @@
+#include "mempool.h"
+
+#include <algorithm>
+#include <unordered_set>
+
+//
+// ================================================================
+//  Score orders
+// ================================================================
+bool AncestorScoreOrder::operator()(const MempoolEntry* a, const MempoolEntry* b) const
+{
+    // A package is only as good as its weakest part: use the lower
+    // of the own and the ancestor-package fee rate.
+    int64_t fa = a->GetFee(), fb = b->GetFee();
+    uint64_t sa = a->GetVSize(), sb = b->GetVSize();
+
+    if (FeeRateLess(a->GetFeesWithAncestors(), a->GetVSizeWithAncestors(), fa, sa))
+    {
+        fa = a->GetFeesWithAncestors();
+        sa = a->GetVSizeWithAncestors();
+    }
+    if (FeeRateLess(b->GetFeesWithAncestors(), b->GetVSizeWithAncestors(), fb, sb))
+    {
+        fb = b->GetFeesWithAncestors();
+        sb = b->GetVSizeWithAncestors();
+    }
+
+    if (FeeRateLess(fb, sb, fa, sa)) return true;
+    if (FeeRateLess(fa, sa, fb, sb)) return false;
+    return a->GetTxid() < b->GetTxid();
+}
+
+bool DescendantScoreOrder::operator()(const MempoolEntry* a, const MempoolEntry* b) const
+{
+    // A transaction is worth keeping if it or its descendants pay
+    // well: use the higher of the own and the package fee rate.
+    int64_t fa = a->GetFee(), fb = b->GetFee();
+    uint64_t sa = a->GetVSize(), sb = b->GetVSize();
+
+    if (FeeRateLess(fa, sa, a->GetFeesWithDescendants(), a->GetVSizeWithDescendants()))
+    {
+        fa = a->GetFeesWithDescendants();
+        sa = a->GetVSizeWithDescendants();
+    }
+    if (FeeRateLess(fb, sb, b->GetFeesWithDescendants(), b->GetVSizeWithDescendants()))
+    {
+        fb = b->GetFeesWithDescendants();
+        sb = b->GetVSizeWithDescendants();
+    }
+
+    if (FeeRateLess(fa, sa, fb, sb)) return true;
+    if (FeeRateLess(fb, sb, fa, sa)) return false;
+    return a->GetTxid() < b->GetTxid();
+}
+
+//
+// ================================================================
+//  Construction
+// ================================================================
+Mempool::Mempool(const Options& o)
+    : opts(o)
+{
+    epoch = 0;
+    totalVSize = 0;
+    totalFees = 0;
+    usage = 0;
+    statAdded = 0;
+    statRemoved = 0;
+    statEvicted = 0;
+}
+
+Mempool::~Mempool()
+{
+}
+
+Mempool::Stats Mempool::GetStats() const
+{
+    Stats s;
+    s.txs = entries.size();
+    s.vsize = totalVSize;
+    s.usage = usage;
+    s.fees = totalFees;
+    s.added = statAdded;
+    s.removed = statRemoved;
+    s.evicted = statEvicted;
+    return s;
+}
+
+void Mempool::SetNotifications(AddedFn added, RemovedFn removed)
+{
+    addedFn = std::move(added);
+    removedFn = std::move(removed);
+}
+
+//
+// ================================================================
+//  Lookups / graph walks
+// ================================================================
+const MempoolEntry* Mempool::Get(const std::array<uint8_t,32>& txid) const
+{
+    auto it = entries.find(txid);
+    return it == entries.end() ? nullptr : it->second.get();
+}
+
+const MempoolEntry* Mempool::GetSpender(const OutPoint& out) const
+{
+    auto it = spenders.find(out);
+    return it == spenders.end() ? nullptr : it->second;
+}
+
+void Mempool::Ancestors(const MempoolEntry* e, std::vector<MempoolEntry*>& out) const
+{
+    const uint64_t mark = NextEpoch();
+    e->epoch = mark;
+
+    std::vector<MempoolEntry*> stack(e->parents.begin(), e->parents.end());
+    while (!stack.empty())
+    {
+        MempoolEntry* a = stack.back();
+        stack.pop_back();
+
+        if (a->epoch == mark)
+            continue;
+        a->epoch = mark;
+        out.push_back(a);
+
+        for (MempoolEntry* p : a->parents)
+            if (p->epoch != mark)
+                stack.push_back(p);
+    }
+}
+
+void Mempool::Descendants(const MempoolEntry* e, std::vector<MempoolEntry*>& out) const
+{
+    const uint64_t mark = NextEpoch();
+    e->epoch = mark;
+
+    std::vector<MempoolEntry*> stack(e->children.begin(), e->children.end());
+    while (!stack.empty())
+    {
+        MempoolEntry* d = stack.back();
+        stack.pop_back();
+
+        if (d->epoch == mark)
+            continue;
+        d->epoch = mark;
+        out.push_back(d);
+
+        for (MempoolEntry* c : d->children)
+            if (c->epoch != mark)
+                stack.push_back(c);
+    }
+}
+
+void Mempool::CalculateAncestors(const MempoolEntry* entry, std::vector<const MempoolEntry*>& out) const
+{
+    std::vector<MempoolEntry*> tmp;
+    Ancestors(entry, tmp);
+    out.assign(tmp.begin(), tmp.end());
+}
+
+void Mempool::CalculateDescendants(const MempoolEntry* entry, std::vector<const MempoolEntry*>& out) const
+{
+    std::vector<MempoolEntry*> tmp;
+    Descendants(entry, tmp);
+    out.assign(tmp.begin(), tmp.end());
+}
+
+//
+// ================================================================
+//  Add
+// ================================================================
+bool Mempool::AddTx(const TransactionRef& tx, int64_t fee, int64_t time, uint32_t height,
+                    int64_t sigOpCost, std::string* reason)
+{
+    auto fail = [reason](const char* why)
+    {
+        if (reason)
+            *reason = why;
+        return false;
+    };
+
+    if (!tx || tx->IsCoinbase())
+        return fail("coinbase");
+
+    if (!MoneyRange(fee))
+        return fail("bad-fee");
+
+    std::unique_ptr<MempoolEntry> owned(new MempoolEntry());
+    MempoolEntry* e = owned.get();
+
+    e->tx = tx;
+    e->txid = tx->GetTxid();
+
+    if (entries.count(e->txid))
+        return fail("txn-already-in-mempool");
+
+    for (const TxIn& in : tx->vin)
+        if (spenders.count(in.prevout))
+            return fail("txn-mempool-conflict");
+
+    std::vector<uint8_t> buf;
+    tx->Serialize(buf, false);
+    const size_t baseSize = buf.size();
+    buf.clear();
+    tx->Serialize(buf, true);
+    const size_t totalSize = buf.size();
+
+    e->wtxid = tx->HasWitness() ? tx->GetWtxid() : e->txid;
+    e->fee = fee;
+    e->weight = baseSize * 3 + totalSize;
+    e->vsize = (e->weight + 3) / 4;
+    e->sigOpCost = sigOpCost;
+    e->time = time;
+    e->height = height;
+    e->epoch = 0;
+
+    // Transaction + entry + one node in each index and per spend
+    e->usage = sizeof(MempoolEntry) + sizeof(Transaction) + totalSize +
+               tx->vin.size() * (sizeof(TxIn) + sizeof(SpendMap::value_type) + 2 * sizeof(void*)) +
+               tx->vout.size() * sizeof(TxOut) + 4 * 4 * sizeof(void*);
+
+    for (const TxIn& in : tx->vin)
+    {
+        auto it = entries.find(in.prevout.txid);
+        if (it == entries.end())
+            continue;
+
+        MempoolEntry* p = it->second.get();
+        if (std::find(e->parents.begin(), e->parents.end(), p) == e->parents.end())
+            e->parents.push_back(p);
+    }
+
+    std::vector<MempoolEntry*> ancestors;
+    Ancestors(e, ancestors);
+
+    e->ancCount = 1;
+    e->ancVSize = e->vsize;
+    e->ancFees = e->fee;
+    for (const MempoolEntry* a : ancestors)
+    {
+        e->ancCount++;
+        e->ancVSize += a->vsize;
+        e->ancFees += a->fee;
+    }
+
+    if (e->ancCount > opts.maxAncestors || e->ancVSize > opts.maxAncestorVSize)
+        return fail("too-long-mempool-chain");
+
+    for (const MempoolEntry* a : ancestors)
+        if (a->descCount + 1 > opts.maxDescendants || a->descVSize + e->vsize > opts.maxDescendantVSize)
+            return fail("too-long-mempool-chain");
+
+    e->descCount = 1;
+    e->descVSize = e->vsize;
+    e->descFees = e->fee;
+
+    // Ancestors gain a descendant; their ancestor scores do not move
+    for (MempoolEntry* a : ancestors)
+    {
+        byDescendant.erase(a);
+        a->descCount++;
+        a->descVSize += e->vsize;
+        a->descFees += e->fee;
+        byDescendant.insert(a);
+    }
+
+    for (MempoolEntry* p : e->parents)
+        p->children.push_back(e);
+
+    for (const TxIn& in : tx->vin)
+        spenders[in.prevout] = e;
+
+    byAncestor.insert(e);
+    byDescendant.insert(e);
+
+    totalVSize += e->vsize;
+    totalFees += e->fee;
+    usage += e->usage;
+    statAdded++;
+
+    const std::array<uint8_t,32> txid = e->txid;
+    entries.emplace(txid, std::move(owned));
+
+    if (addedFn)
+        addedFn(*e);
+
+    if (usage > opts.maxUsage)
+    {
+        TrimToSize(opts.maxUsage);
+        if (!entries.count(txid))
+            return fail("mempool-full");
+    }
+
+    return true;
+}
+
+//
+// ================================================================
+//  Remove
+// ================================================================
+void Mempool::RemoveStaged(const std::vector<MempoolEntry*>& stage, bool keepDescendants,
+                           MempoolRemoval why)
+{
+    std::unordered_set<const MempoolEntry*> staged(stage.begin(), stage.end());
+    std::vector<MempoolEntry*> related;
+
+    // First fix the aggregates of everything that stays, while the
+    // links are still intact. Entries in the stage keep their keys
+    // untouched so the index erases below find them.
+    for (MempoolEntry* e : stage)
+    {
+        related.clear();
+        Ancestors(e, related);
+        for (MempoolEntry* a : related)
+        {
+            if (staged.count(a))
+                continue;
+            byDescendant.erase(a);
+            a->descCount--;
+            a->descVSize -= e->vsize;
+            a->descFees -= e->fee;
+            byDescendant.insert(a);
+        }
+
+        if (!keepDescendants)
+            continue;
+
+        related.clear();
+        Descendants(e, related);
+        for (MempoolEntry* d : related)
+        {
+            if (staged.count(d))
+                continue;
+            byAncestor.erase(d);
+            d->ancCount--;
+            d->ancVSize -= e->vsize;
+            d->ancFees -= e->fee;
+            byAncestor.insert(d);
+        }
+    }
+
+    for (MempoolEntry* e : stage)
+        Unlink(e, why);
+}
+
+void Mempool::Unlink(MempoolEntry* e, MempoolRemoval why)
+{
+    if (removedFn)
+        removedFn(*e, why);
+
+    byAncestor.erase(e);
+    byDescendant.erase(e);
+
+    for (MempoolEntry* p : e->parents)
+        p->children.erase(std::find(p->children.begin(), p->children.end(), e));
+    for (MempoolEntry* c : e->children)
+        c->parents.erase(std::find(c->parents.begin(), c->parents.end(), e));
+
+    for (const TxIn& in : e->tx->vin)
+        spenders.erase(in.prevout);
+
+    totalVSize -= e->vsize;
+    totalFees -= e->fee;
+    usage -= e->usage;
+
+    entries.erase(e->txid);
+}
+
+size_t Mempool::RemoveRecursive(const std::array<uint8_t,32>& txid)
+{
+    return RemoveTree(txid, MempoolRemoval::EXPLICIT);
+}
+
+size_t Mempool::RemoveTree(const std::array<uint8_t,32>& txid, MempoolRemoval why)
+{
+    auto it = entries.find(txid);
+    if (it == entries.end())
+        return 0;
+
+    std::vector<MempoolEntry*> stage;
+    Descendants(it->second.get(), stage);
+    stage.push_back(it->second.get());
+
+    RemoveStaged(stage, false, why);
+    statRemoved += stage.size();
+    return stage.size();
+}
+
+void Mempool::RemoveForBlock(const std::vector<Transaction>& vtx)
+{
+    for (const Transaction& tx : vtx)
+    {
+        auto it = entries.find(tx.GetTxid());
+        if (it != entries.end())
+        {
+            std::vector<MempoolEntry*> stage(1, it->second.get());
+            RemoveStaged(stage, true, MempoolRemoval::BLOCK);
+            statRemoved++;
+        }
+
+        // Whatever else spent the same coins is now invalid
+        for (const TxIn& in : tx.vin)
+        {
+            auto sp = spenders.find(in.prevout);
+            if (sp != spenders.end())
+            {
+                const std::array<uint8_t,32> conflict = sp->second->txid;
+                RemoveTree(conflict, MempoolRemoval::CONFLICT);
+            }
+        }
+    }
+}
+
+size_t Mempool::TrimToSize(size_t maxUsage)
+{
+    size_t removed = 0;
+    std::vector<MempoolEntry*> stage;
+
+    while (usage > maxUsage && !byDescendant.empty())
+    {
+        MempoolEntry* worst = *byDescendant.begin();
+
+        stage.clear();
+        Descendants(worst, stage);
+        stage.push_back(worst);
+
+        RemoveStaged(stage, false, MempoolRemoval::EVICTED);
+        removed += stage.size();
+    }
+
+    statEvicted += removed;
+    return removed;
+}
@@ -0,0 +1,267 @@
+#ifndef DRACHMA_TX_MEMPOOL_H
+#define DRACHMA_TX_MEMPOOL_H
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "outpoint.h"
+#include "transaction.h"
+#include "../storage/utxostore.h"
+
+typedef std::shared_ptr<const Transaction> TransactionRef;
+
+class Mempool;
+
+// Why an entry left the pool
+enum class MempoolRemoval
+{
+    EXPLICIT,       // RemoveRecursive()
+    BLOCK,          // included in a connected block
+    CONFLICT,       // spends the same coin as a block transaction
+    EVICTED         // trimmed for space
+};
+
+//
+// ===============================================================
+//  CLASS: MempoolEntry
+// ===============================================================
+//
+//  One pooled transaction plus the aggregates the score indices
+//  are keyed on. "WithAncestors" / "WithDescendants" totals include
+//  the entry itself and are maintained by Mempool on every add and
+//  remove; they are never recomputed from scratch.
+//
+class MempoolEntry
+{
+public:
+    const TransactionRef& GetTx() const { return tx; }
+    const std::array<uint8_t,32>& GetTxid() const { return txid; }
+    const std::array<uint8_t,32>& GetWtxid() const { return wtxid; }
+
+    int64_t GetFee() const { return fee; }
+    uint64_t GetVSize() const { return vsize; }
+    uint64_t GetWeight() const { return weight; }
+    int64_t GetSigOpCost() const { return sigOpCost; }
+    int64_t GetTime() const { return time; }
+    uint32_t GetHeight() const { return height; }
+
+    uint64_t GetCountWithAncestors() const { return ancCount; }
+    uint64_t GetVSizeWithAncestors() const { return ancVSize; }
+    int64_t GetFeesWithAncestors() const { return ancFees; }
+
+    uint64_t GetCountWithDescendants() const { return descCount; }
+    uint64_t GetVSizeWithDescendants() const { return descVSize; }
+    int64_t GetFeesWithDescendants() const { return descFees; }
+
+    // In-pool parents / children (direct links only)
+    const std::vector<MempoolEntry*>& GetParents() const { return parents; }
+    const std::vector<MempoolEntry*>& GetChildren() const { return children; }
+
+private:
+    friend class Mempool;
+
+    TransactionRef tx;
+    std::array<uint8_t,32> txid;
+    std::array<uint8_t,32> wtxid;
+    int64_t fee;
+    uint64_t vsize;
+    uint64_t weight;
+    int64_t sigOpCost;
+    size_t usage;
+    int64_t time;
+    uint32_t height;
+
+    uint64_t ancCount;
+    uint64_t ancVSize;
+    int64_t ancFees;
+
+    uint64_t descCount;
+    uint64_t descVSize;
+    int64_t descFees;
+
+    std::vector<MempoolEntry*> parents;
+    std::vector<MempoolEntry*> children;
+
+    // Scratch mark for graph walks (epoch of the walk that saw it)
+    mutable uint64_t epoch;
+};
+
+// true if fee rate a (fees / vsize) is lower than b
+inline bool FeeRateLess(int64_t feeA, uint64_t sizeA, int64_t feeB, uint64_t sizeB)
+{
+    return (double)feeA * (double)sizeB < (double)feeB * (double)sizeA;
+}
+
+//
+// Best first: min(own rate, ancestor package rate), then txid.
+// Mining order – the head is the next package worth including.
+//
+struct AncestorScoreOrder
+{
+    bool operator()(const MempoolEntry* a, const MempoolEntry* b) const;
+};
+
+//
+// Worst first: max(own rate, descendant package rate), then txid.
+// Eviction order – the head is the cheapest package to drop.
+//
+struct DescendantScoreOrder
+{
+    bool operator()(const MempoolEntry* a, const MempoolEntry* b) const;
+};
+
+//
+// ===============================================================
+//  CLASS: Mempool
+// ===============================================================
+//
+//  Unconfirmed transactions with four indices:
+//
+//    by txid            – hash map (salted)
+//    by spent outpoint  – hash map, finds spenders / conflicts
+//    by ancestor score  – ordered set, for block templates
+//    by descendant score– ordered set, for eviction
+//
+//  Adding a transaction touches only its ancestors (bounded by the
+//  package limits); removing one touches only its ancestors and
+//  descendants. Each touched entry is re-keyed in the ordered sets,
+//  so every operation is O(package * log n).
+//
+//  The pool does not validate scripts or look up coins; callers
+//  hand in transactions that passed policy / consensus checks, their
+//  fee and their signature operation cost (GetTransactionSigOpCost
+//  needs the spent coins).
+//
+//  Threading: not synchronized; callers serialize access (as for
+//  UTXOStore).
+//
+// ===============================================================
+//
+class Mempool
+{
+public:
+    struct Options
+    {
+        uint64_t maxAncestors;          // package limits (count / vbytes,
+        uint64_t maxAncestorVSize;      //   including the transaction)
+        uint64_t maxDescendants;
+        uint64_t maxDescendantVSize;
+        size_t maxUsage;                // bytes before eviction kicks in
+
+        Options()
+            : maxAncestors(25), maxAncestorVSize(101000),
+              maxDescendants(25), maxDescendantVSize(101000),
+              maxUsage(300u << 20) {}
+    };
+
+    struct Stats
+    {
+        size_t txs;
+        uint64_t vsize;
+        size_t usage;                   // approx. bytes
+        int64_t fees;
+        uint64_t added;
+        uint64_t removed;               // block inclusion / conflicts / explicit
+        uint64_t evicted;               // trimmed for space
+    };
+
+    typedef std::set<MempoolEntry*, AncestorScoreOrder> AncestorIndex;
+    typedef std::set<MempoolEntry*, DescendantScoreOrder> DescendantIndex;
+
+    // Called once an entry is fully indexed / right before it goes
+    typedef std::function<void(const MempoolEntry& entry)> AddedFn;
+    typedef std::function<void(const MempoolEntry& entry, MempoolRemoval why)> RemovedFn;
+
+    explicit Mempool(const Options& opts = Options());
+    ~Mempool();
+
+    Mempool(const Mempool&) = delete;
+    Mempool& operator=(const Mempool&) = delete;
+
+    // Fails on duplicates, conflicts with pooled spends, package
+    // limit violations, or when the pool is full and the new
+    // transaction is the cheapest package in it.
+    bool AddTx(const TransactionRef& tx, int64_t fee, int64_t time, uint32_t height,
+               int64_t sigOpCost, std::string* reason = nullptr);
+
+    // Remove a transaction and everything that spends it
+    size_t RemoveRecursive(const std::array<uint8_t,32>& txid);
+
+    // Block connected: drop its transactions (descendants stay and
+    // lose an ancestor) and anything conflicting with it.
+    void RemoveForBlock(const std::vector<Transaction>& vtx);
+
+    // Evict lowest descendant-score packages until usage <= maxUsage
+    size_t TrimToSize(size_t maxUsage);
+
+    // ---- Lookups ----
+    const MempoolEntry* Get(const std::array<uint8_t,32>& txid) const;
+    bool Exists(const std::array<uint8_t,32>& txid) const { return Get(txid) != nullptr; }
+
+    // Pooled transaction spending `out`, if any
+    const MempoolEntry* GetSpender(const OutPoint& out) const;
+
+    // Transitive in-pool ancestors / descendants (entry excluded)
+    void CalculateAncestors(const MempoolEntry* entry, std::vector<const MempoolEntry*>& out) const;
+    void CalculateDescendants(const MempoolEntry* entry, std::vector<const MempoolEntry*>& out) const;
+
+    const AncestorIndex& ByAncestorScore() const { return byAncestor; }
+    const DescendantIndex& ByDescendantScore() const { return byDescendant; }
+
+    size_t Size() const { return entries.size(); }
+    size_t Usage() const { return usage; }
+    Stats GetStats() const;
+
+    // Single subscriber (e.g. the block template builder); pass
+    // empty functions to detach.
+    void SetNotifications(AddedFn added, RemovedFn removed);
+
+private:
+    struct TxidHasher
+    {
+        SaltedOutPointHasher salt;
+        size_t operator()(const std::array<uint8_t,32>& h) const { return salt.Hash(h.data(), 0); }
+    };
+
+    typedef std::unordered_map<std::array<uint8_t,32>, std::unique_ptr<MempoolEntry>, TxidHasher> TxMap;
+    typedef std::unordered_map<OutPoint, MempoolEntry*, SaltedOutPointHasher> SpendMap;
+
+    // Graph walks; results exclude the start entry
+    void Ancestors(const MempoolEntry* e, std::vector<MempoolEntry*>& out) const;
+    void Descendants(const MempoolEntry* e, std::vector<MempoolEntry*>& out) const;
+    uint64_t NextEpoch() const { return ++epoch; }
+
+    // Remove a set closed under descendants (if e is in, so are
+    // all of its descendants unless `keepDescendants`).
+    void RemoveStaged(const std::vector<MempoolEntry*>& stage, bool keepDescendants, MempoolRemoval why);
+    size_t RemoveTree(const std::array<uint8_t,32>& txid, MempoolRemoval why);
+    void Unlink(MempoolEntry* e, MempoolRemoval why);
+
+    Options opts;
+    AddedFn addedFn;
+    RemovedFn removedFn;
+
+    TxMap entries;
+    SpendMap spenders;
+    AncestorIndex byAncestor;
+    DescendantIndex byDescendant;
+
+    mutable uint64_t epoch;
+
+    uint64_t totalVSize;
+    int64_t totalFees;
+    size_t usage;
+
+    uint64_t statAdded;
+    uint64_t statRemoved;
+    uint64_t statEvicted;
+};
+
+#endif // DRACHMA_TX_MEMPOOL_H
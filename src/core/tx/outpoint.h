@@ -0,0 +1,46 @@
+#ifndef DRACHMA_TX_OUTPOINT_H
+#define DRACHMA_TX_OUTPOINT_H
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+//
+// OutPoint – reference to a single transaction output (txid, vout)
+// ---------------------------------------------------------------
+// Same concept as Bitcoin's COutPoint. The txid is stored in
+// internal byte order (raw SHA256D output, not reversed hex).
+//
+struct OutPoint
+{
+    static constexpr uint32_t NULL_INDEX = 0xFFFFFFFF;
+
+    std::array<uint8_t, 32> txid;
+    uint32_t index;
+
+    OutPoint() : index(NULL_INDEX) { txid.fill(0); }
+    OutPoint(const std::array<uint8_t, 32>& h, uint32_t n) : txid(h), index(n) {}
+
+    bool IsNull() const
+    {
+        if (index != NULL_INDEX) return false;
+        for (uint8_t b : txid)
+            if (b != 0) return false;
+        return true;
+    }
+
+    bool operator==(const OutPoint& o) const
+    {
+        return index == o.index && std::memcmp(txid.data(), o.txid.data(), 32) == 0;
+    }
+
+    bool operator!=(const OutPoint& o) const { return !(*this == o); }
+
+    bool operator<(const OutPoint& o) const
+    {
+        int c = std::memcmp(txid.data(), o.txid.data(), 32);
+        return c < 0 || (c == 0 && index < o.index);
+    }
+};
+
+#endif // DRACHMA_TX_OUTPOINT_H
@@ -0,0 +1,172 @@
+#include "transaction.h"
+#include "../crypto/hash.h"
+
+bool Transaction::HasWitness() const
+{
+    for (const TxIn& in : vin)
+        if (!in.witness.empty())
+            return true;
+    return false;
+}
+
+//
+// ================================================================
+//  Serialization
+// ================================================================
+void Transaction::Serialize(std::vector<uint8_t>& out, bool withWitness) const
+{
+    const bool witness = withWitness && HasWitness();
+
+    AppendU32(out, (uint32_t)version);
+
+    if (witness)
+    {
+        out.push_back(0x00);   // marker
+        out.push_back(0x01);   // flag
+    }
+
+    AppendCompactSize(out, vin.size());
+    for (const TxIn& in : vin)
+    {
+        AppendBytes(out, in.prevout.txid.data(), 32);
+        AppendU32(out, in.prevout.index);
+        AppendVarBytes(out, in.scriptSig.data(), in.scriptSig.size());
+        AppendU32(out, in.sequence);
+    }
+
+    AppendCompactSize(out, vout.size());
+    for (const TxOut& o : vout)
+    {
+        AppendU64(out, (uint64_t)o.amount);
+        AppendVarBytes(out, o.script.data(), o.script.size());
+    }
+
+    if (witness)
+    {
+        for (const TxIn& in : vin)
+        {
+            AppendCompactSize(out, in.witness.size());
+            for (const auto& item : in.witness)
+                AppendVarBytes(out, item.data(), item.size());
+        }
+    }
+
+    AppendU32(out, lockTime);
+}
+
+bool Transaction::Deserialize(ByteSpan data)
+{
+    SpanReader in(data);
+    return Deserialize(in) && in.Empty();
+}
+
+bool Transaction::Deserialize(SpanReader& in)
+{
+    vin.clear();
+    vout.clear();
+
+    if (!in.ReadI32(version))
+        return false;
+
+    uint64_t nIn;
+    if (!in.ReadCompactSize(nIn))
+        return false;
+
+    // An empty vin is the BIP144 marker; the flag must follow
+    bool witness = false;
+    if (nIn == 0)
+    {
+        uint8_t flag;
+        if (!in.ReadU8(flag) || flag != 0x01)
+            return false;
+        witness = true;
+
+        if (!in.ReadCompactSize(nIn))
+            return false;
+    }
+
+    // Every input takes at least 41 bytes; keeps a bogus count from
+    // reserving gigabytes.
+    if (nIn > in.Remaining() / 41)
+        return false;
+
+    vin.resize((size_t)nIn);
+    for (TxIn& txin : vin)
+    {
+        if (!in.ReadBytes(txin.prevout.txid.data(), 32) ||
+            !in.ReadU32(txin.prevout.index) ||
+            !in.ReadVarBytes(txin.scriptSig) ||
+            !in.ReadU32(txin.sequence))
+            return false;
+    }
+
+    uint64_t nOut;
+    if (!in.ReadCompactSize(nOut) || nOut > in.Remaining() / 9)
+        return false;
+
+    vout.resize((size_t)nOut);
+    for (TxOut& o : vout)
+    {
+        if (!in.ReadI64(o.amount) || !in.ReadVarBytes(o.script))
+            return false;
+    }
+
+    if (witness)
+    {
+        for (TxIn& txin : vin)
+        {
+            uint64_t nItems;
+            if (!in.ReadCompactSize(nItems) || nItems > in.Remaining())
+                return false;
+
+            txin.witness.resize((size_t)nItems);
+            for (auto& item : txin.witness)
+                if (!in.ReadVarBytes(item))
+                    return false;
+        }
+
+        // Witness flag with no witness data is non-canonical
+        if (!HasWitness())
+            return false;
+    }
+
+    return in.ReadU32(lockTime);
+}
+
+//
+// ================================================================
+//  Identity
+// ================================================================
+std::array<uint8_t,32> Transaction::GetTxid() const
+{
+    std::vector<uint8_t> buf;
+    Serialize(buf, false);
+
+    std::array<uint8_t,32> out;
+    Hash::SHA256D(buf.data(), buf.size(), out.data());
+    return out;
+}
+
+std::array<uint8_t,32> Transaction::GetWtxid() const
+{
+    std::vector<uint8_t> buf;
+    Serialize(buf, true);
+
+    std::array<uint8_t,32> out;
+    Hash::SHA256D(buf.data(), buf.size(), out.data());
+    return out;
+}
+
+int64_t Transaction::GetValueOut() const
+{
+    int64_t total = 0;
+    for (const TxOut& o : vout)
+    {
+        if (!MoneyRange(o.amount))
+            return -1;
+        total += o.amount;
+        if (!MoneyRange(total))
+            return -1;
+    }
+    return total;
+}
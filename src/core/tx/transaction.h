@@ -0,0 +1,76 @@
+#ifndef DRACHMA_TX_TRANSACTION_H
+#define DRACHMA_TX_TRANSACTION_H
+
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "outpoint.h"
+#include "../../common/utils/serialize.h"
+
+//
+// ===============================================================
+//  Transaction – owning, Bitcoin-compatible transaction
+// ===============================================================
+//
+//  Serialization matches Bitcoin (BIP144 for witness data):
+//    version | [0x00 0x01] | vin | vout | [witness] | lockTime
+//
+//  txid  = SHA256D(serialization without witness)
+//  wtxid = SHA256D(full serialization)
+//
+// ===============================================================
+//
+
+struct TxIn
+{
+    OutPoint prevout;
+    std::vector<uint8_t> scriptSig;
+    uint32_t sequence;
+    std::vector<std::vector<uint8_t>> witness;
+
+    TxIn() : sequence(0xFFFFFFFF) {}
+};
+
+struct TxOut
+{
+    int64_t amount;
+    std::vector<uint8_t> script;
+
+    TxOut() : amount(-1) {}
+    TxOut(int64_t a, std::vector<uint8_t> s) : amount(a), script(std::move(s)) {}
+};
+
+class Transaction
+{
+public:
+    int32_t version;
+    std::vector<TxIn> vin;
+    std::vector<TxOut> vout;
+    uint32_t lockTime;
+
+    Transaction() : version(1), lockTime(0) {}
+
+    bool IsCoinbase() const { return vin.size() == 1 && vin[0].prevout.IsNull(); }
+    bool HasWitness() const;
+
+    // ---- Serialization ----
+    void Serialize(std::vector<uint8_t>& out, bool withWitness = true) const;
+    bool Deserialize(SpanReader& in);
+    bool Deserialize(ByteSpan data);
+
+    // ---- Identity ----
+    std::array<uint8_t,32> GetTxid() const;
+    std::array<uint8_t,32> GetWtxid() const;
+
+    // Sum of output amounts, -1 on overflow / negative value
+    int64_t GetValueOut() const;
+};
+
+// Largest amount that may ever exist, in base units
+static const int64_t MAX_MONEY = 21000000LL * 100000000LL;
+
+inline bool MoneyRange(int64_t v) { return v >= 0 && v <= MAX_MONEY; }
+
+#endif // DRACHMA_TX_TRANSACTION_H
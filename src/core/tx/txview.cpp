@@ -0,0 +1,222 @@
+#include "txview.h"
+#include "../crypto/sha256.h"
+#include "../crypto/hash.h"
+
+TransactionView::TransactionView()
+{
+    version = 0;
+    lockTime = 0;
+    witness = false;
+    bodyBegin = 0;
+    bodyEnd = 0;
+    haveTxid = false;
+    haveWtxid = false;
+}
+
+bool TransactionView::Parse(ByteSpan data)
+{
+    SpanReader in(data);
+    return Parse(in) && in.Empty();
+}
+
+//
+// Same grammar and limits as Transaction::Deserialize()
+//
+bool TransactionView::Parse(SpanReader& in)
+{
+    const uint8_t* start = in.Cursor();
+    const size_t startPos = in.Position();
+
+    vin.clear();
+    vout.clear();
+    witnessItems.clear();
+    witness = false;
+    haveTxid = false;
+    haveWtxid = false;
+
+    if (!in.ReadI32(version))
+        return false;
+
+    bodyBegin = in.Position() - startPos;
+
+    uint64_t nIn;
+    if (!in.ReadCompactSize(nIn))
+        return false;
+
+    if (nIn == 0)
+    {
+        uint8_t flag;
+        if (!in.ReadU8(flag) || flag != 0x01)
+            return false;
+        witness = true;
+
+        bodyBegin = in.Position() - startPos;
+        if (!in.ReadCompactSize(nIn))
+            return false;
+    }
+
+    if (nIn > in.Remaining() / 41)
+        return false;
+
+    vin.resize((size_t)nIn);
+    for (TxInView& txin : vin)
+    {
+        ByteSpan prev;
+        if (!in.ReadSpan(32, prev) ||
+            !in.ReadU32(txin.prevIndex) ||
+            !in.ReadVarSpan(txin.scriptSig) ||
+            !in.ReadU32(txin.sequence))
+            return false;
+
+        txin.prevTxid = prev.data;
+        txin.witnessBegin = 0;
+        txin.witnessCount = 0;
+    }
+
+    uint64_t nOut;
+    if (!in.ReadCompactSize(nOut) || nOut > in.Remaining() / 9)
+        return false;
+
+    vout.resize((size_t)nOut);
+    for (TxOutView& o : vout)
+    {
+        if (!in.ReadI64(o.amount) || !in.ReadVarSpan(o.script))
+            return false;
+    }
+
+    bodyEnd = in.Position() - startPos;
+
+    if (witness)
+    {
+        bool any = false;
+        for (TxInView& txin : vin)
+        {
+            uint64_t nItems;
+            if (!in.ReadCompactSize(nItems) || nItems > in.Remaining())
+                return false;
+
+            txin.witnessBegin = (uint32_t)witnessItems.size();
+            txin.witnessCount = (uint32_t)nItems;
+            any = any || nItems > 0;
+
+            for (uint64_t k = 0; k < nItems; ++k)
+            {
+                ByteSpan item;
+                if (!in.ReadVarSpan(item))
+                    return false;
+                witnessItems.push_back(item);
+            }
+        }
+
+        // Witness flag with no witness data is non-canonical
+        if (!any)
+            return false;
+    }
+
+    if (!in.ReadU32(lockTime))
+        return false;
+
+    raw = ByteSpan(start, in.Position() - startPos);
+    return true;
+}
+
+bool TransactionView::IsCoinbase() const
+{
+    if (vin.size() != 1 || vin[0].prevIndex != OutPoint::NULL_INDEX)
+        return false;
+
+    for (size_t i = 0; i < 32; ++i)
+        if (vin[0].prevTxid[i] != 0)
+            return false;
+    return true;
+}
+
+size_t TransactionView::GetBaseSize() const
+{
+    return 4 + (bodyEnd - bodyBegin) + 4;
+}
+
+//
+// ================================================================
+//  Identity
+// ================================================================
+const std::array<uint8_t,32>& TransactionView::GetTxid() const
+{
+    if (!haveTxid)
+    {
+        if (!witness)
+        {
+            Hash::SHA256D(raw.data, raw.size, txid.data());
+        }
+        else
+        {
+            // version | body | lockTime, hashed in place
+            ::SHA256 ctx;
+            ctx.Update(raw.data, 4);
+            ctx.Update(raw.data + bodyBegin, bodyEnd - bodyBegin);
+            ctx.Update(raw.data + raw.size - 4, 4);
+
+            uint8_t first[32];
+            ctx.Final(first);
+
+            ::SHA256 outer;
+            outer.Update(first, 32);
+            outer.Final(txid.data());
+        }
+        haveTxid = true;
+    }
+    return txid;
+}
+
+const std::array<uint8_t,32>& TransactionView::GetWtxid() const
+{
+    if (!witness)
+        return GetTxid();
+
+    if (!haveWtxid)
+    {
+        Hash::SHA256D(raw.data, raw.size, wtxid.data());
+        haveWtxid = true;
+    }
+    return wtxid;
+}
+
+int64_t TransactionView::GetValueOut() const
+{
+    int64_t total = 0;
+    for (const TxOutView& o : vout)
+    {
+        if (!MoneyRange(o.amount))
+            return -1;
+        total += o.amount;
+        if (!MoneyRange(total))
+            return -1;
+    }
+    return total;
+}
+
+void TransactionView::ToTransaction(Transaction& tx) const
+{
+    tx.version = version;
+    tx.lockTime = lockTime;
+
+    tx.vin.resize(vin.size());
+    for (size_t i = 0; i < vin.size(); ++i)
+    {
+        TxIn& in = tx.vin[i];
+        in.prevout = vin[i].GetPrevout();
+        in.scriptSig = vin[i].scriptSig.ToVector();
+        in.sequence = vin[i].sequence;
+
+        in.witness.resize(vin[i].witnessCount);
+        for (uint32_t k = 0; k < vin[i].witnessCount; ++k)
+            in.witness[k] = witnessItems[vin[i].witnessBegin + k].ToVector();
+    }
+
+    tx.vout.resize(vout.size());
+    for (size_t i = 0; i < vout.size(); ++i)
+    {
+        tx.vout[i].amount = vout[i].amount;
+        tx.vout[i].script = vout[i].script.ToVector();
+    }
+}
@@ -0,0 +1,130 @@
+#ifndef DRACHMA_TX_TXVIEW_H
+#define DRACHMA_TX_TXVIEW_H
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include "outpoint.h"
+#include "transaction.h"
+#include "../../common/utils/serialize.h"
+#include "../../common/utils/span.h"
+
+//
+// Input / output views – point into the parsed buffer
+//
+struct TxInView
+{
+    const uint8_t* prevTxid;        // 32 bytes
+    uint32_t prevIndex;
+    ByteSpan scriptSig;
+    uint32_t sequence;
+    uint32_t witnessBegin;          // into TransactionView's witness items
+    uint32_t witnessCount;
+
+    OutPoint GetPrevout() const
+    {
+        OutPoint out;
+        std::memcpy(out.txid.data(), prevTxid, 32);
+        out.index = prevIndex;
+        return out;
+    }
+};
+
+struct TxOutView
+{
+    int64_t amount;
+    ByteSpan script;
+};
+
+//
+// ===============================================================
+//  CLASS: TransactionView
+// ===============================================================
+//
+//  Parses a serialized transaction in place. Scripts and witness
+//  items are ByteSpans into the source buffer, which must outlive
+//  the view (a BlockStore mapping, a network receive buffer, ...).
+//  Only the small per-input / per-output records are allocated.
+//
+//  txid and wtxid are hashed straight from the buffer on first use
+//  and cached. The txid skips the witness parts of a BIP144
+//  serialization instead of re-serializing.
+//
+//  ToTransaction() builds an owning Transaction for the places
+//  that have to keep one (mempool, wallet).
+//
+//  Threading: const access is safe from several threads once the
+//  ids have been computed; the first GetTxid()/GetWtxid() is not
+//  synchronized.
+//
+// ===============================================================
+//
+class TransactionView
+{
+public:
+    TransactionView();
+
+    bool Parse(SpanReader& in);
+    bool Parse(ByteSpan data);
+
+    int32_t GetVersion() const { return version; }
+    uint32_t GetLockTime() const { return lockTime; }
+
+    const std::vector<TxInView>& Inputs() const { return vin; }
+    const std::vector<TxOutView>& Outputs() const { return vout; }
+
+    size_t GetWitnessCount(uint32_t input) const { return vin[input].witnessCount; }
+    ByteSpan GetWitness(uint32_t input, uint32_t item) const
+    {
+        return witnessItems[vin[input].witnessBegin + item];
+    }
+
+    // All witness items of one input, contiguous
+    const ByteSpan* GetWitnessItems(uint32_t input) const
+    {
+        return witnessItems.data() + vin[input].witnessBegin;
+    }
+
+    bool IsCoinbase() const;
+    bool HasWitness() const { return witness; }
+
+    // The whole serialization this view was parsed from
+    ByteSpan GetRaw() const { return raw; }
+
+    size_t GetTotalSize() const { return raw.size; }
+    size_t GetBaseSize() const;                 // without witness
+    size_t GetWeight() const { return GetBaseSize() * 3 + GetTotalSize(); }
+
+    const std::array<uint8_t,32>& GetTxid() const;
+    const std::array<uint8_t,32>& GetWtxid() const;
+
+    // Sum of output amounts, -1 on overflow / negative value
+    int64_t GetValueOut() const;
+
+    void ToTransaction(Transaction& tx) const;
+
+private:
+    ByteSpan raw;
+    int32_t version;
+    uint32_t lockTime;
+    bool witness;
+
+    // vin count .. last output, i.e. the part shared by both
+    // serializations
+    size_t bodyBegin;
+    size_t bodyEnd;
+
+    std::vector<TxInView> vin;
+    std::vector<TxOutView> vout;
+    std::vector<ByteSpan> witnessItems;
+
+    mutable bool haveTxid;
+    mutable bool haveWtxid;
+    mutable std::array<uint8_t,32> txid;
+    mutable std::array<uint8_t,32> wtxid;
+};
+
+#endif // DRACHMA_TX_TXVIEW_H
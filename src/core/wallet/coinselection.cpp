@@ -0,0 +1,584 @@
+#include "coinselection.h"
+#include "../script/script.h"
+
+#include <algorithm>
+#include <limits>
+#include <random>
+
+static const size_t ASSIGN_FILL = CoinIndex::BLOCK_MAX * 3 / 4;     // entries per block on Assign()
+
+// The smallest input there is: outpoint, empty scriptSig, sequence
+static const uint32_t MIN_INPUT_VBYTES = 41;
+
+//
+// ================================================================
+//  CoinIndex
+// ================================================================
+CoinIndex::CoinIndex()
+{
+    buckets.resize(BUCKETS);
+    count = 0;
+    total = 0;
+}
+
+size_t CoinIndex::BucketOf(int64_t amount)
+{
+    if (amount < 1)
+        return 0;
+
+    // Four buckets per power of two, by the two bits after the top one
+    const unsigned octave = 63 - (unsigned)__builtin_clzll((uint64_t)amount);
+    const size_t sub = octave >= 2 ? (size_t)(amount >> (octave - 2)) & 3 : (size_t)(amount & 1) << 1;
+    return octave * 4 + sub;
+}
+
+size_t CoinIndex::FindBlock(const Bucket& bucket, const Entry& key)
+{
+    // First block whose last entry is not below the key
+    size_t lo = 0, hi = bucket.blocks.size();
+    while (lo < hi)
+    {
+        const size_t mid = (lo + hi) / 2;
+        if (bucket.blocks[mid].back() < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+bool CoinIndex::Add(const OutPoint& out, int64_t amount, uint32_t inputVBytes)
+{
+    if (amount <= 0)
+        return false;
+
+    Entry entry;
+    entry.amount = amount;
+    entry.out = out;
+    entry.inputVBytes = inputVBytes;
+
+    Bucket& bucket = buckets[BucketOf(amount)];
+    if (bucket.blocks.empty())
+    {
+        bucket.blocks.emplace_back(1, entry);
+    }
+    else
+    {
+        size_t k = FindBlock(bucket, entry);
+        if (k == bucket.blocks.size())
+            k--;
+
+        std::vector<Entry>& block = bucket.blocks[k];
+        auto it = std::lower_bound(block.begin(), block.end(), entry);
+        if (it != block.end() && !(entry < *it))
+            return false;
+
+        block.insert(it, entry);
+
+        if (block.size() > BLOCK_MAX)
+        {
+            std::vector<Entry> upper(block.begin() + block.size() / 2, block.end());
+            block.resize(block.size() / 2);
+            bucket.blocks.insert(bucket.blocks.begin() + k + 1, std::move(upper));
+        }
+    }
+
+    count++;
+    total += amount;
+    return true;
+}
+
+bool CoinIndex::Remove(const OutPoint& out, int64_t amount)
+{
+    if (amount <= 0)
+        return false;
+
+    Entry key;
+    key.amount = amount;
+    key.out = out;
+    key.inputVBytes = 0;
+
+    Bucket& bucket = buckets[BucketOf(amount)];
+    const size_t k = FindBlock(bucket, key);
+    if (k == bucket.blocks.size())
+        return false;
+
+    std::vector<Entry>& block = bucket.blocks[k];
+    auto it = std::lower_bound(block.begin(), block.end(), key);
+    if (it == block.end() || key < *it)
+        return false;
+
+    block.erase(it);
+    if (block.empty())
+        bucket.blocks.erase(bucket.blocks.begin() + k);
+
+    count--;
+    total -= amount;
+    return true;
+}
+
+void CoinIndex::Apply(const WalletScanner::Event& event)
+{
+    if (event.type == WalletScanner::Event::CREDIT)
+        Add(event.coin, event.data.amount, InputVBytes(ByteSpan(event.data.script)));
+    else
+        Remove(event.coin, event.data.amount);
+}
+
+void CoinIndex::Assign(std::vector<Entry> entries)
+{
+    Clear();
+
+    std::sort(entries.begin(), entries.end());
+
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        const Entry& e = entries[i];
+        if (e.amount <= 0 || (i > 0 && !(entries[i - 1] < e)))
+            continue;
+
+        Bucket& bucket = buckets[BucketOf(e.amount)];
+        if (bucket.blocks.empty() || bucket.blocks.back().size() >= ASSIGN_FILL)
+        {
+            bucket.blocks.emplace_back();
+            bucket.blocks.back().reserve(ASSIGN_FILL);
+        }
+
+        bucket.blocks.back().push_back(e);
+        count++;
+        total += e.amount;
+    }
+}
+
+void CoinIndex::Clear()
+{
+    for (Bucket& bucket : buckets)
+        bucket = Bucket();
+
+    count = 0;
+    total = 0;
+}
+
+size_t CoinIndex::MemoryUsage() const
+{
+    size_t bytes = buckets.capacity() * sizeof(Bucket);
+    for (const Bucket& bucket : buckets)
+    {
+        bytes += bucket.blocks.capacity() * sizeof(std::vector<Entry>);
+        for (const std::vector<Entry>& block : bucket.blocks)
+            bytes += block.capacity() * sizeof(Entry);
+    }
+    return bytes;
+}
+
+//
+// ================================================================
+//  Ordered access
+// ================================================================
+CoinIndex::Cursor CoinIndex::End() const
+{
+    Cursor c;
+    c.bucket = BUCKETS;
+    c.block = 0;
+    c.pos = 0;
+    return c;
+}
+
+void CoinIndex::SkipForward(Cursor& c) const
+{
+    while (c.bucket < BUCKETS && c.block >= buckets[c.bucket].blocks.size())
+    {
+        c.bucket++;
+        c.block = 0;
+        c.pos = 0;
+    }
+}
+
+CoinIndex::Cursor CoinIndex::LowerBound(int64_t amount) const
+{
+    Entry key;
+    key.amount = amount;
+    key.out = OutPoint(std::array<uint8_t,32>(), 0);
+    key.inputVBytes = 0;
+
+    Cursor c;
+    c.bucket = BucketOf(amount);
+    c.block = FindBlock(buckets[c.bucket], key);
+    c.pos = 0;
+
+    if (c.block < buckets[c.bucket].blocks.size())
+    {
+        const std::vector<Entry>& block = buckets[c.bucket].blocks[c.block];
+        c.pos = (size_t)(std::lower_bound(block.begin(), block.end(), key) - block.begin());
+    }
+
+    SkipForward(c);
+    return c;
+}
+
+void CoinIndex::Next(Cursor& c) const
+{
+    if (IsEnd(c))
+        return;
+
+    if (++c.pos == buckets[c.bucket].blocks[c.block].size())
+    {
+        c.block++;
+        c.pos = 0;
+        SkipForward(c);
+    }
+}
+
+void CoinIndex::Prev(Cursor& c) const
+{
+    if (!IsEnd(c))
+    {
+        if (c.pos > 0)
+        {
+            c.pos--;
+            return;
+        }
+        if (c.block > 0)
+        {
+            c.block--;
+            c.pos = buckets[c.bucket].blocks[c.block].size() - 1;
+            return;
+        }
+    }
+
+    // Last coin of the nearest non-empty bucket below
+    size_t b = c.bucket;
+    while (b > 0)
+    {
+        const Bucket& bucket = buckets[--b];
+        if (!bucket.blocks.empty())
+        {
+            c.bucket = b;
+            c.block = bucket.blocks.size() - 1;
+            c.pos = bucket.blocks.back().size() - 1;
+            return;
+        }
+    }
+    c = End();
+}
+
+uint32_t CoinIndex::InputVBytes(ByteSpan script)
+{
+    int version;
+    ByteSpan program;
+
+    if (IsPayToWitnessPubKeyHash(script))
+        return 68;
+    if (IsWitnessProgram(script, version, program))
+    {
+        if (version == 1 && program.size == 32)
+            return 58;                  // taproot key path
+        return 105;                     // P2WSH, assumed 2-of-3 multisig
+    }
+    if (IsPayToScriptHash(script))
+        return 91;                      // assumed P2SH-P2WPKH
+    if (script.size == 35)
+        return 114;                     // P2PK, compressed
+    return 148;                         // P2PKH and anything else
+}
+
+//
+// ================================================================
+//  CoinSelector
+// ================================================================
+struct Candidate
+{
+    const CoinIndex::Entry* entry;
+    int64_t value;                      // effective
+    int64_t fee;
+    int64_t longTermFee;
+};
+
+static int64_t InputFee(uint32_t vbytes, int64_t feePerKvB)
+{
+    return ((int64_t)vbytes * feePerKvB + 999) / 1000;
+}
+
+static Candidate MakeCandidate(const CoinIndex::Entry& e, const CoinSelector::Params& params)
+{
+    Candidate c;
+    c.entry = &e;
+    c.fee = InputFee(e.inputVBytes, params.feePerKvB);
+    c.longTermFee = InputFee(e.inputVBytes, params.longTermFeePerKvB);
+    c.value = e.amount - c.fee;
+    return c;
+}
+
+// Bitcoin Core's SelectCoinsBnB: depth first over include/omit,
+// largest first, pruned by what is still available, by overshooting
+// target + changeCost and (at fee rates above the long-term one) by
+// waste. `pool` sorted by value, descending.
+static bool BranchAndBound(const std::vector<Candidate>& pool, const CoinSelector::Params& params,
+                           std::vector<size_t>& best)
+{
+    const int64_t target = params.target;
+    const int64_t upper = params.target + params.changeCost;
+    const bool pruneWaste = params.feePerKvB > params.longTermFeePerKvB;
+
+    int64_t available = 0;
+    for (const Candidate& c : pool)
+        available += c.value;
+    if (available < target)
+        return false;
+
+    std::vector<size_t> selection;
+    int64_t value = 0;
+    int64_t waste = 0;
+    int64_t bestWaste = std::numeric_limits<int64_t>::max();
+    best.clear();
+
+    size_t i = 0;
+    for (size_t tries = 0; tries < params.bnbTries; ++tries, ++i)
+    {
+        bool backtrack = false;
+        if (value + available < target || value > upper || selection.size() > params.maxInputs ||
+            (pruneWaste && waste > bestWaste))
+        {
+            backtrack = true;
+        }
+        else if (value >= target)
+        {
+            const int64_t total = waste + (value - target);
+            if (total <= bestWaste)
+            {
+                best = selection;
+                bestWaste = total;
+            }
+            backtrack = true;
+        }
+
+        if (backtrack)
+        {
+            if (selection.empty())
+                break;
+
+            // Put the omitted ones back into the lookahead, then take
+            // the omission branch of the last one included
+            for (--i; i > selection.back(); --i)
+                available += pool[i].value;
+
+            value -= pool[i].value;
+            waste -= pool[i].fee - pool[i].longTermFee;
+            selection.pop_back();
+        }
+        else
+        {
+            const Candidate& c = pool[i];
+            available -= c.value;
+
+            // Omitting an equivalent of the one just omitted again
+            // would only repeat that branch
+            if (selection.empty() || selection.back() + 1 == i ||
+                c.value != pool[i - 1].value || c.fee != pool[i - 1].fee)
+            {
+                selection.push_back(i);
+                value += c.value;
+                waste += c.fee - c.longTermFee;
+            }
+        }
+    }
+
+    return !best.empty();
+}
+
+// Bitcoin Core's ApproximateBestSubset: random subsets topped up to
+// the target, keeping the smallest sum that reaches it
+static int64_t ApproximateBestSubset(const std::vector<Candidate>& pool, int64_t sum, int64_t target,
+                                     size_t rounds, std::vector<uint8_t>& best)
+{
+    std::mt19937_64 rng(std::random_device{}());
+
+    best.assign(pool.size(), 1);
+    int64_t bestValue = sum;
+
+    std::vector<uint8_t> included;
+    for (size_t r = 0; r < rounds && bestValue != target; ++r)
+    {
+        included.assign(pool.size(), 0);
+        int64_t value = 0;
+        bool reached = false;
+
+        for (int pass = 0; pass < 2 && !reached; ++pass)
+        {
+            uint64_t bits = 0;
+            for (size_t i = 0; i < pool.size(); ++i)
+            {
+                if (pass == 0 && (i & 63) == 0)
+                    bits = rng();
+
+                const bool take = pass == 0 ? ((bits >> (i & 63)) & 1) : !included[i];
+                if (!take)
+                    continue;
+
+                value += pool[i].value;
+                included[i] = 1;
+                if (value >= target)
+                {
+                    reached = true;
+                    if (value < bestValue)
+                    {
+                        bestValue = value;
+                        best = included;
+                    }
+                    value -= pool[i].value;
+                    included[i] = 0;
+                }
+            }
+        }
+    }
+    return bestValue;
+}
+
+bool CoinSelector::Select(const CoinIndex& index, const Params& params, Result& result,
+                          std::string* reason)
+{
+    result = Result();
+
+    if (params.target <= 0 || params.maxInputs == 0 || params.maxCandidates == 0)
+    {
+        if (reason)
+            *reason = "target, maxInputs and maxCandidates must be positive";
+        return false;
+    }
+    if (index.Total() < params.target)
+    {
+        if (reason)
+            *reason = "insufficient funds";
+        return false;
+    }
+
+    // What a selection with change needs
+    const int64_t need = params.target + params.changeFee + params.minChange;
+
+    // Candidates: the largest coins below `need`, walking down until
+    // coins are worth less than the fee of spending them
+    std::vector<Candidate> pool;
+    const int64_t dust = InputFee(MIN_INPUT_VBYTES, params.feePerKvB);
+
+    CoinIndex::Cursor top = index.LowerBound(need);
+    CoinIndex::Cursor c = top;
+    for (index.Prev(c); !index.IsEnd(c) && pool.size() < params.maxCandidates; index.Prev(c))
+    {
+        const CoinIndex::Entry& e = index.Get(c);
+        if (e.amount <= dust)
+            break;
+
+        const Candidate cand = MakeCandidate(e, params);
+        if (cand.value > 0)
+            pool.push_back(cand);
+    }
+
+    // The smallest coin covering `need` on its own; coins just above
+    // it may fall short once their fee is taken
+    Candidate larger;
+    larger.entry = nullptr;
+    c = top;
+    for (size_t n = 0; !index.IsEnd(c) && n < params.maxCandidates; ++n, index.Next(c))
+    {
+        const Candidate cand = MakeCandidate(index.Get(c), params);
+        if (cand.value >= need)
+        {
+            larger = cand;
+            break;
+        }
+        if (cand.value > 0 && pool.size() < params.maxCandidates)
+            pool.push_back(cand);
+    }
+
+    std::sort(pool.begin(), pool.end(), [](const Candidate& a, const Candidate& b) {
+        return a.value != b.value ? a.value > b.value : a.fee < b.fee;
+    });
+
+    std::vector<const Candidate*> chosen;
+    int64_t poolSum = 0;
+    for (const Candidate& cand : pool)
+        poolSum += cand.value;
+
+    // 1. Changeless
+    std::vector<size_t> bnb;
+    std::vector<Candidate> bnbPool(pool);
+    if (larger.entry && larger.value <= params.target + params.changeCost)
+        bnbPool.insert(bnbPool.begin(), larger);
+
+    if (BranchAndBound(bnbPool, params, bnb))
+    {
+        result.algorithm = SELECT_BNB;
+        for (size_t i : bnb)
+        {
+            result.coins.push_back(*bnbPool[i].entry);
+            result.amount += bnbPool[i].entry->amount;
+            result.inputFee += bnbPool[i].fee;
+        }
+        return true;
+    }
+
+    // 2. Knapsack against the smallest larger coin
+    if (poolSum >= need)
+    {
+        std::vector<uint8_t> best(pool.size(), 1);
+        int64_t bestValue = poolSum;
+        if (poolSum != need)
+            bestValue = ApproximateBestSubset(pool, poolSum, need, params.knapsackRounds, best);
+
+        const size_t inputs = (size_t)std::count(best.begin(), best.end(), 1);
+        if (larger.entry && (larger.value <= bestValue || inputs > params.maxInputs))
+        {
+            chosen.push_back(&larger);
+        }
+        else
+        {
+            for (size_t i = 0; i < pool.size(); ++i)
+            {
+                if (best[i])
+                    chosen.push_back(&pool[i]);
+            }
+        }
+        result.algorithm = SELECT_KNAPSACK;
+    }
+    else if (larger.entry)
+    {
+        chosen.push_back(&larger);
+        result.algorithm = SELECT_KNAPSACK;
+    }
+    else
+    {
+        // 3. Everything below `need` is too little: largest first,
+        //    as far as the target at least
+        int64_t value = 0;
+        for (size_t i = 0; i < pool.size() && value < need; ++i)
+        {
+            chosen.push_back(&pool[i]);
+            value += pool[i].value;
+        }
+        if (value < params.target)
+            chosen.clear();
+        result.algorithm = SELECT_LARGEST;
+    }
+
+    if (chosen.empty() || chosen.size() > params.maxInputs)
+    {
+        if (reason)
+            *reason = chosen.empty() ? std::string("insufficient funds")
+                                     : "payment needs more than " + std::to_string(params.maxInputs) + " inputs";
+        return false;
+    }
+
+    int64_t value = 0;
+    for (const Candidate* cand : chosen)
+    {
+        result.coins.push_back(*cand->entry);
+        result.amount += cand->entry->amount;
+        result.inputFee += cand->fee;
+        value += cand->value;
+    }
+
+    // Change too small to be worth an output goes to fees
+    const int64_t change = value - params.target - params.changeFee;
+    result.change = change >= params.minChange ? change : 0;
+    return true;
+}
@@ -0,0 +1,173 @@
+#ifndef DRACHMA_WALLET_COINSELECTION_H
+#define DRACHMA_WALLET_COINSELECTION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "walletscanner.h"
+#include "../tx/outpoint.h"
+
+//
+// ===============================================================
+//  CLASS: CoinIndex
+// ===============================================================
+//
+//  A wallet's spendable coins ordered by (amount, outpoint), for
+//  coin selection over millions of them.
+//
+//  Coins are split into 256 buckets by amount, four per power of
+//  two; every bucket is a list of sorted blocks of at most 512
+//  entries. Add() and Remove() cost a binary search and a move
+//  within one block; a Cursor walks the coins in amount order from
+//  any LowerBound().
+//
+//  Removing a coin takes its amount, which is part of the key: the
+//  wallet knows it (WalletScanner debit events carry the coin), and
+//  it saves an outpoint map as large as the index itself.
+//
+//  Not thread-safe.
+//
+// ===============================================================
+//
+class CoinIndex
+{
+public:
+    struct Entry
+    {
+        int64_t amount;
+        OutPoint out;
+        uint32_t inputVBytes;           // to spend it
+
+        bool operator<(const Entry& o) const
+        {
+            return amount != o.amount ? amount < o.amount : out < o.out;
+        }
+    };
+
+    // Position in amount order; `bucket` == BUCKETS at the end
+    struct Cursor
+    {
+        size_t bucket;
+        size_t block;
+        size_t pos;
+    };
+
+    static constexpr size_t BUCKETS = 256;
+    static constexpr size_t BLOCK_MAX = 512;
+
+    CoinIndex();
+
+    // False if present or not a positive amount
+    bool Add(const OutPoint& out, int64_t amount, uint32_t inputVBytes);
+    bool Remove(const OutPoint& out, int64_t amount);
+
+    // A WalletScanner event: credits add, debits remove
+    void Apply(const WalletScanner::Event& event);
+
+    // Replaces the contents (wallet load); duplicates are dropped
+    void Assign(std::vector<Entry> entries);
+    void Clear();
+
+    size_t Size() const { return count; }
+    int64_t Total() const { return total; }
+    size_t MemoryUsage() const;
+
+    // ---- Ordered access ----
+    Cursor LowerBound(int64_t amount) const;        // first coin >= amount
+    Cursor End() const;
+    bool IsEnd(const Cursor& c) const { return c.bucket == BUCKETS; }
+    const Entry& Get(const Cursor& c) const { return buckets[c.bucket].blocks[c.block][c.pos]; }
+    void Next(Cursor& c) const;
+    void Prev(Cursor& c) const;                     // End() before the first, the last after it
+
+    // vbytes an input spending `script` adds to a transaction
+    static uint32_t InputVBytes(ByteSpan script);
+
+private:
+    struct Bucket
+    {
+        std::vector<std::vector<Entry>> blocks;
+    };
+
+    static size_t BucketOf(int64_t amount);
+    static size_t FindBlock(const Bucket& bucket, const Entry& key);
+
+    void SkipForward(Cursor& c) const;
+
+    std::vector<Bucket> buckets;
+    size_t count;
+    int64_t total;
+};
+
+//
+// ===============================================================
+//  CLASS: CoinSelector
+// ===============================================================
+//
+//  Picks the coins of a CoinIndex to fund a payment, in bounded
+//  time at any wallet size: only the `maxCandidates` largest coins
+//  below what the payment needs with change are considered, plus
+//  the smallest coin that covers it alone. Reaching them is a
+//  LowerBound() and a short walk.
+//
+//  Coins count by effective value (amount less the fee of spending
+//  them at `feePerKvB`). In order:
+//
+//    1. branch and bound (Bitcoin Core's): a changeless selection
+//       within [target, target + changeCost], least waste, at most
+//       `bnbTries` steps
+//    2. knapsack: the best of `knapsackRounds` randomized subset
+//       sums of the candidates reaching target + changeFee +
+//       minChange, or the smallest coin covering it if that is
+//       better
+//    3. largest first, when the candidates do not add up
+//
+//  Selections over `maxInputs` inputs fail.
+//
+// ===============================================================
+//
+class CoinSelector
+{
+public:
+    enum Algorithm : uint8_t
+    {
+        SELECT_BNB,
+        SELECT_KNAPSACK,
+        SELECT_LARGEST,
+    };
+
+    struct Params
+    {
+        int64_t target;                 // outputs plus the transaction's own fee
+        int64_t feePerKvB;
+        int64_t longTermFeePerKvB;      // for waste: inputs spent now vs later
+        int64_t changeFee;              // adding the change output
+        int64_t changeCost;             // changeFee plus spending it later
+        int64_t minChange;
+        size_t maxInputs;
+        size_t maxCandidates;
+        size_t bnbTries;
+        size_t knapsackRounds;
+
+        Params()
+            : target(0), feePerKvB(1000), longTermFeePerKvB(1000), changeFee(31),
+              changeCost(99), minChange(50000), maxInputs(500), maxCandidates(1000),
+              bnbTries(100000), knapsackRounds(1000) {}
+    };
+
+    struct Result
+    {
+        Algorithm algorithm;
+        std::vector<CoinIndex::Entry> coins;
+        int64_t amount;                 // of the coins
+        int64_t inputFee;
+        int64_t change;                 // 0: none, the excess goes to fees
+    };
+
+    static bool Select(const CoinIndex& index, const Params& params, Result& result,
+                       std::string* reason = nullptr);
+};
+
+#endif // DRACHMA_WALLET_COINSELECTION_H
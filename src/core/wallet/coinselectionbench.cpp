@@ -0,0 +1,141 @@
+#include "coinselectionbench.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+typedef std::chrono::steady_clock Clock;
+
+static double Percentile(const std::vector<uint64_t>& sorted, double q)
+{
+    if (sorted.empty())
+        return 0;
+
+    const size_t i = std::min(sorted.size() - 1, (size_t)(q * sorted.size()));
+    return sorted[i] / 1000.0;
+}
+
+static int64_t LogUniform(std::mt19937_64& rng, int64_t lo, int64_t hi)
+{
+    std::uniform_real_distribution<double> dist(std::log((double)lo), std::log((double)hi));
+    return (int64_t)std::exp(dist(rng));
+}
+
+static CoinIndex::Entry RandomCoin(std::mt19937_64& rng, const CoinSelectionBenchmark::Options& opts)
+{
+    // Mostly P2WPKH, some taproot, P2SH-P2WPKH and legacy
+    static const uint32_t VBYTES[8] = { 68, 68, 68, 68, 58, 58, 91, 148 };
+
+    CoinIndex::Entry e;
+    for (size_t i = 0; i < 32; i += 8)
+    {
+        const uint64_t r = rng();
+        std::memcpy(e.out.txid.data() + i, &r, 8);
+    }
+    e.out.index = (uint32_t)(rng() % 4);
+    e.amount = LogUniform(rng, opts.minAmount, opts.maxAmount);
+    e.inputVBytes = VBYTES[rng() % 8];
+    return e;
+}
+
+bool CoinSelectionBenchmark::Run(const Options& opts, std::vector<Report>& reports, std::string* reason)
+{
+    reports.clear();
+
+    if (opts.minAmount <= 0 || opts.maxAmount < opts.minAmount ||
+        opts.minPayment <= 0 || opts.maxPayment < opts.minPayment)
+    {
+        if (reason)
+            *reason = "amount ranges must be positive and ordered";
+        return false;
+    }
+
+    std::mt19937_64 rng(std::random_device{}());
+
+    for (size_t size : opts.sizes)
+    {
+        Report report = Report();
+
+        // Load
+        CoinIndex index;
+        {
+            std::vector<CoinIndex::Entry> coins(size);
+            for (CoinIndex::Entry& e : coins)
+                e = RandomCoin(rng, opts);
+
+            const Clock::time_point start = Clock::now();
+            index.Assign(std::move(coins));
+            report.loadSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+        }
+        report.coins = index.Size();
+        report.bytesPerCoin = index.Size() ? (double)index.MemoryUsage() / index.Size() : 0;
+
+        // Single updates: add a batch, then remove it again
+        {
+            std::vector<CoinIndex::Entry> batch(opts.updates);
+            for (CoinIndex::Entry& e : batch)
+                e = RandomCoin(rng, opts);
+
+            const Clock::time_point start = Clock::now();
+            for (const CoinIndex::Entry& e : batch)
+                index.Add(e.out, e.amount, e.inputVBytes);
+            for (const CoinIndex::Entry& e : batch)
+                index.Remove(e.out, e.amount);
+
+            const double micros = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+            report.updateMicros = opts.updates ? micros / (2.0 * opts.updates) : 0;
+        }
+
+        // Payments
+        std::vector<uint64_t> latencies;
+        latencies.reserve(opts.payments);
+
+        CoinSelector::Params params = opts.params;
+        CoinSelector::Result result;
+
+        for (size_t p = 0; p < opts.payments; ++p)
+        {
+            params.target = LogUniform(rng, opts.minPayment, opts.maxPayment);
+
+            const Clock::time_point start = Clock::now();
+            const bool ok = CoinSelector::Select(index, params, result);
+            latencies.push_back((uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+                Clock::now() - start).count());
+
+            if (!ok)
+            {
+                report.failed++;
+                continue;
+            }
+
+            switch (result.algorithm)
+            {
+            case CoinSelector::SELECT_BNB:      report.bnb++; break;
+            case CoinSelector::SELECT_KNAPSACK: report.knapsack++; break;
+            case CoinSelector::SELECT_LARGEST:  report.largest++; break;
+            }
+
+            for (const CoinIndex::Entry& e : result.coins)
+                index.Remove(e.out, e.amount);
+
+            if (result.change > 0)
+            {
+                CoinIndex::Entry change = RandomCoin(rng, opts);
+                index.Add(change.out, result.change, 68);
+            }
+
+            const CoinIndex::Entry deposit = RandomCoin(rng, opts);
+            index.Add(deposit.out, deposit.amount, deposit.inputVBytes);
+        }
+
+        std::sort(latencies.begin(), latencies.end());
+        report.p50Ms = Percentile(latencies, 0.50);
+        report.p99Ms = Percentile(latencies, 0.99);
+        report.maxMs = latencies.empty() ? 0 : latencies.back() / 1000.0;
+
+        reports.push_back(report);
+    }
+    return true;
+}
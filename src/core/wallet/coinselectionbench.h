@@ -0,0 +1,69 @@
+#ifndef DRACHMA_WALLET_COINSELECTIONBENCH_H
+#define DRACHMA_WALLET_COINSELECTIONBENCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "coinselection.h"
+
+//
+// ===============================================================
+//  CLASS: CoinSelectionBenchmark
+// ===============================================================
+//
+//  Coin selection on synthetic wallets of every size in `sizes`:
+//  coins with log-uniform amounts in [minAmount, maxAmount] and a
+//  mix of input types are loaded with CoinIndex::Assign(), then
+//  `updates` random coins are added and removed one at a time,
+//  then `payments` log-uniform payments in [minPayment,
+//  maxPayment] are selected one after the other, each one's coins
+//  spent and its change and one deposit added to the index, as a
+//  busy wallet would.
+//
+//  Report per size: load time, index bytes per coin, the cost of
+//  an update, the selection latency distribution and how the
+//  payments were funded.
+//
+// ===============================================================
+//
+class CoinSelectionBenchmark
+{
+public:
+    struct Options
+    {
+        std::vector<size_t> sizes;
+        size_t updates;
+        size_t payments;
+        int64_t minAmount;
+        int64_t maxAmount;
+        int64_t minPayment;
+        int64_t maxPayment;
+        CoinSelector::Params params;    // target is set per payment
+
+        Options()
+            : sizes({10000, 100000, 1000000, 10000000}), updates(100000), payments(1000),
+              minAmount(10000), maxAmount(1000000000), minPayment(100000),
+              maxPayment(10000000000LL) {}
+    };
+
+    struct Report
+    {
+        size_t coins;
+        double loadSeconds;
+        double bytesPerCoin;
+        double updateMicros;            // one Add() or Remove()
+        double p50Ms;
+        double p99Ms;
+        double maxMs;
+        uint64_t bnb;
+        uint64_t knapsack;
+        uint64_t largest;
+        uint64_t failed;
+    };
+
+    static bool Run(const Options& opts, std::vector<Report>& reports, std::string* reason = nullptr);
+};
+
+#endif // DRACHMA_WALLET_COINSELECTIONBENCH_H
@@ -0,0 +1,903 @@
+#include "keystore.h"
+#include "../crypto/chacha20poly1305.h"
+#include "../crypto/hash.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+static const uint32_t KEYSTORE_MAGIC   = 0x534B5744;    // "DWKS"
+static const uint32_t KEYSTORE_VERSION = 1;
+
+static const size_t HEADER_SIZE = 4096;
+static const size_t GROW_RECORDS = 1u << 16;            // records per file extension
+static const size_t MIN_PART_SIZE = 16;
+static const size_t COPY_RECORDS = 4096;                // records per compaction chunk
+
+static const uint8_t RECORD_KEY   = 1;
+static const uint8_t RECORD_ERASE = 2;
+
+// Bytes of a record covered by the AEAD tag as associated data:
+// key id, public key, padding and metadata
+static const size_t AAD_OFFSET = 16;
+static const size_t AAD_SIZE = 80;
+
+typedef std::chrono::steady_clock Clock;
+
+static inline uint64_t Mix64(uint64_t x)
+{
+    // murmur3 / splitmix finalizer
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static uint32_t Checksum(const uint8_t* record)
+{
+    uint8_t h[32];
+    Hash::SHA256D(record + 4, KeyStore::RECORD_SIZE - 4, h);
+
+    uint32_t out;
+    std::memcpy(&out, h, 4);
+    return out;
+}
+
+static bool IsZero(const uint8_t* p, size_t len)
+{
+    for (size_t i = 0; i < len; ++i)
+    {
+        if (p[i])
+            return false;
+    }
+    return true;
+}
+
+static void Wipe(uint8_t* p, size_t len)
+{
+    volatile uint8_t* v = p;
+    for (size_t i = 0; i < len; ++i)
+        v[i] = 0;
+}
+
+static bool FileExists(const std::string& path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) == 0;
+}
+
+static std::string DirOf(const std::string& path)
+{
+    size_t slash = path.find_last_of('/');
+    if (slash == std::string::npos)
+        return ".";
+    return slash ? path.substr(0, slash) : "/";
+}
+
+static bool WriteAll(int fd, const uint8_t* data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = ::write(fd, data, len);
+        if (n < 0)
+            return false;
+        data += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+static double MillisSince(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+//
+// ================================================================
+//  Construction / Open
+// ================================================================
+KeyStore::KeyStore(Scheduler& sched)
+    : scheduler(sched), compacting(false)
+{
+    masterKey.fill(0);
+    recordCount = 0;
+    nextSeq = 1;
+    k0 = 0;
+    k1 = 0;
+    partitionBits = 0;
+    partSize = 0;
+    statCompactions = 0;
+    statLoadMs = 0;
+    statCompactMs = 0;
+}
+
+KeyStore::~KeyStore()
+{
+    Close();
+}
+
+KeyStore::KeyID KeyStore::GetKeyID(const std::vector<uint8_t>& pubkey)
+{
+    KeyID id;
+    Hash::Hash160(pubkey.data(), pubkey.size(), id.data());
+    return id;
+}
+
+bool KeyStore::Open(const std::string& p, const uint8_t key[MASTER_KEY_SIZE],
+                    const Options& o, std::string* reason)
+{
+    Close();
+
+    if (o.partitions == 0 || (o.partitions & (o.partitions - 1)) != 0 || o.rangeRecords == 0)
+    {
+        if (reason)
+            *reason = "partitions must be a power of two, rangeRecords non-zero";
+        return false;
+    }
+
+    const Clock::time_point start = Clock::now();
+    std::unique_lock<std::shared_mutex> lock(mutex);
+
+    path = p;
+    opts = o;
+    std::memcpy(masterKey.data(), key, MASTER_KEY_SIZE);
+
+    partitionBits = 0;
+    while (((size_t)1 << partitionBits) < opts.partitions)
+        partitionBits++;
+
+    std::random_device rd;
+    k0 = ((uint64_t)rd() << 32) | rd();
+    k1 = ((uint64_t)rd() << 32) | rd();
+
+    const bool fresh = !FileExists(path);
+    if (!file.Open(path, MappedFile::READ_WRITE, HEADER_SIZE + GROW_RECORDS * RECORD_SIZE))
+    {
+        if (reason)
+            *reason = "cannot open " + path;
+        return false;
+    }
+
+    if (fresh)
+    {
+        Header* hdr = GetHeader();
+        hdr->magic = KEYSTORE_MAGIC;
+        hdr->version = KEYSTORE_VERSION;
+        hdr->syncedCount = 0;
+        hdr->nextSeq = 1;
+        hdr->recordSize = RECORD_SIZE;
+        hdr->reserved = 0;
+
+        AEADChaCha20Poly1305 aead(masterKey.data());
+        std::memset(hdr->check, 0, sizeof(hdr->check));
+        aead.Encrypt(hdr->check, sizeof(hdr->check), nullptr, 0, 1, 0, hdr->checkTag);
+
+        if (!file.Sync(0, HEADER_SIZE) || !MappedFile::SyncDirectory(DirOf(path)))
+        {
+            file.Close();
+            if (reason)
+                *reason = "cannot create " + path;
+            return false;
+        }
+    }
+
+    file.Advise(MappedFile::ACCESS_WILLNEED);
+    if (!Load(reason))
+    {
+        file.Close();
+        table.clear();
+        partCount.clear();
+        recordCount = 0;
+        return false;
+    }
+    file.Advise(MappedFile::ACCESS_RANDOM);
+
+    statLoadMs = MillisSince(start);
+    return true;
+}
+
+void KeyStore::Close()
+{
+    // Not under the lock: a running compaction needs it to finish
+    if (compactor.joinable())
+        compactor.join();
+
+    std::unique_lock<std::shared_mutex> lock(mutex);
+
+    file.Close();
+    table.clear();
+    table.shrink_to_fit();
+    partCount.clear();
+    recordCount = 0;
+    nextSeq = 1;
+    partSize = 0;
+    Wipe(masterKey.data(), masterKey.size());
+}
+
+//
+// ================================================================
+//  Index
+// ================================================================
+const KeyStore::Record* KeyStore::RecordAt(uint64_t n) const
+{
+    return (const Record*)(file.Data() + HEADER_SIZE) + n;
+}
+
+uint64_t KeyStore::Hash(const uint8_t* keyid) const
+{
+    uint64_t a, b;
+    uint32_t c;
+    std::memcpy(&a, keyid, 8);
+    std::memcpy(&b, keyid + 8, 8);
+    std::memcpy(&c, keyid + 16, 4);
+
+    uint64_t h = Mix64(a ^ k0);
+    h = Mix64(h ^ b ^ k1);
+    return Mix64(h ^ c);
+}
+
+size_t KeyStore::FindSlot(size_t part, uint64_t h, const uint8_t* keyid) const
+{
+    const uint32_t* slots = Part(part);
+    const size_t mask = partSize - 1;
+
+    size_t i = (size_t)h & mask;
+    while (slots[i] != 0)
+    {
+        if (std::memcmp(RecordAt(slots[i] - 1)->keyid, keyid, 20) == 0)
+            return i;
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+void KeyStore::RemoveSlot(size_t part, size_t slot)
+{
+    // Backward shift: pull later entries of the run into the hole
+    // unless their home lies cyclically in (hole, entry]
+    uint32_t* slots = Part(part);
+    const size_t mask = partSize - 1;
+
+    size_t hole = slot;
+    for (size_t j = (slot + 1) & mask; slots[j] != 0; j = (j + 1) & mask)
+    {
+        const size_t home = (size_t)Hash(RecordAt(slots[j] - 1)->keyid) & mask;
+        if (((j - home) & mask) >= ((j - hole) & mask))
+        {
+            slots[hole] = slots[j];
+            hole = j;
+        }
+    }
+    slots[hole] = 0;
+}
+
+void KeyStore::Replay(size_t part, uint32_t recordNo, uint64_t h)
+{
+    const Record* rec = RecordAt(recordNo);
+    const size_t slot = FindSlot(part, h, rec->keyid);
+    uint32_t* slots = Part(part);
+
+    if (rec->type == RECORD_KEY)
+    {
+        if (slots[slot] == 0)
+            partCount[part]++;
+        slots[slot] = recordNo + 1;
+    }
+    else if (slots[slot] != 0)
+    {
+        RemoveSlot(part, slot);
+        partCount[part]--;
+    }
+}
+
+bool KeyStore::Lookup(const KeyID& id, const Record*& rec) const
+{
+    if (table.empty())
+        return false;
+
+    const uint64_t h = Hash(id.data());
+    const size_t part = PartitionOf(h);
+    const uint32_t v = Part(part)[FindSlot(part, h, id.data())];
+    if (v == 0)
+        return false;
+
+    rec = RecordAt(v - 1);
+    return true;
+}
+
+void KeyStore::ResizeTable(size_t newPartSize)
+{
+    const size_t oldSize = partSize;
+    std::vector<uint32_t> old;
+    old.swap(table);
+
+    partSize = newPartSize;
+    table.assign(opts.partitions * partSize, 0);
+
+    TaskGroup group(scheduler, TASK_BACKGROUND);
+    for (size_t p = 0; p < opts.partitions; ++p)
+    {
+        group.Run([this, &old, oldSize, p] {
+            const uint32_t* from = old.data() + p * oldSize;
+            uint32_t* to = Part(p);
+            const size_t mask = partSize - 1;
+
+            for (size_t i = 0; i < oldSize; ++i)
+            {
+                if (from[i] == 0)
+                    continue;
+
+                size_t j = (size_t)Hash(RecordAt(from[i] - 1)->keyid) & mask;
+                while (to[j] != 0)
+                    j = (j + 1) & mask;
+                to[j] = from[i];
+            }
+        });
+    }
+    group.Wait();
+}
+
+//
+// ================================================================
+//  Load
+// ================================================================
+bool KeyStore::Load(std::string* reason)
+{
+    const Header* hdr = GetHeader();
+    if (hdr->magic != KEYSTORE_MAGIC || hdr->version != KEYSTORE_VERSION ||
+        hdr->recordSize != RECORD_SIZE)
+    {
+        if (reason)
+            *reason = path + " is not a key store";
+        return false;
+    }
+
+    {
+        uint8_t check[sizeof(hdr->check)];
+        std::memcpy(check, hdr->check, sizeof(check));
+
+        AEADChaCha20Poly1305 aead(masterKey.data());
+        if (!aead.Decrypt(check, sizeof(check), nullptr, 0, 1, 0, hdr->checkTag) ||
+            !IsZero(check, sizeof(check)))
+        {
+            if (reason)
+                *reason = "wrong master key";
+            return false;
+        }
+    }
+
+    const uint64_t capacity = (file.Size() - HEADER_SIZE) / RECORD_SIZE;
+    const uint64_t synced = std::min<uint64_t>(hdr->syncedCount, capacity);
+
+    // Records newer than the last Sync() may be torn: they count up
+    // to the first one that fails its checksum
+    recordCount = synced;
+    while (recordCount < capacity)
+    {
+        const Record* rec = RecordAt(recordCount);
+        if ((rec->type != RECORD_KEY && rec->type != RECORD_ERASE) ||
+            Checksum((const uint8_t*)rec) != rec->checksum)
+            break;
+        recordCount++;
+    }
+
+    // Clear the rest so it cannot resurface; untouched pages stay holes
+    for (uint64_t n = recordCount; n < capacity; ++n)
+    {
+        uint8_t* rec = file.Data() + HEADER_SIZE + n * RECORD_SIZE;
+        if (!IsZero(rec, RECORD_SIZE))
+            std::memset(rec, 0, RECORD_SIZE);
+    }
+
+    // 1. Ranges of records, bucketed by partition in file order
+    struct Range
+    {
+        uint64_t begin;
+        uint64_t end;
+        uint64_t maxSeq;
+        uint64_t bad;                   // first corrupt record, or end
+        std::vector<std::vector<uint32_t>> buckets;
+    };
+
+    std::vector<Range> ranges;
+    for (uint64_t n = 0; n < recordCount; n += opts.rangeRecords)
+    {
+        Range r;
+        r.begin = n;
+        r.end = std::min<uint64_t>(n + opts.rangeRecords, recordCount);
+        r.maxSeq = 0;
+        r.bad = r.end;
+        ranges.push_back(std::move(r));
+    }
+
+    {
+        TaskGroup group(scheduler, TASK_BACKGROUND);
+        for (Range& r : ranges)
+        {
+            group.Run([this, &r, synced] {
+                r.buckets.resize(opts.partitions);
+                for (uint64_t n = r.begin; n < r.end; ++n)
+                {
+                    const Record* rec = RecordAt(n);
+                    if ((rec->type != RECORD_KEY && rec->type != RECORD_ERASE) ||
+                        (opts.verifyOnLoad && n < synced && Checksum((const uint8_t*)rec) != rec->checksum))
+                    {
+                        r.bad = n;
+                        return;
+                    }
+
+                    r.buckets[PartitionOf(Hash(rec->keyid))].push_back((uint32_t)n);
+                    r.maxSeq = std::max(r.maxSeq, rec->seq);
+                }
+            });
+        }
+        group.Wait();
+    }
+
+    nextSeq = std::max<uint64_t>(hdr->nextSeq, 1);
+    size_t most = 0;
+    std::vector<size_t> perPart(opts.partitions, 0);
+
+    for (const Range& r : ranges)
+    {
+        if (r.bad != r.end)
+        {
+            if (reason)
+                *reason = "corrupt record " + std::to_string(r.bad) + " in " + path;
+            return false;
+        }
+        nextSeq = std::max(nextSeq, r.maxSeq + 1);
+
+        for (size_t p = 0; p < opts.partitions; ++p)
+        {
+            perPart[p] += r.buckets[p].size();
+            most = std::max(most, perPart[p]);
+        }
+    }
+
+    // 2. Every partition replays its records, sized for all of them
+    //    being live
+    partSize = MIN_PART_SIZE;
+    while (partSize < most * 2)
+        partSize <<= 1;
+
+    table.assign(opts.partitions * partSize, 0);
+    partCount.assign(opts.partitions, 0);
+
+    TaskGroup group(scheduler, TASK_BACKGROUND);
+    for (size_t p = 0; p < opts.partitions; ++p)
+    {
+        group.Run([this, &ranges, p] {
+            for (const Range& r : ranges)
+            {
+                for (uint32_t n : r.buckets[p])
+                    Replay(p, n, Hash(RecordAt(n)->keyid));
+            }
+        });
+    }
+    group.Wait();
+
+    // Replaced and erased keys leave it emptier than sized for
+    const size_t live = *std::max_element(partCount.begin(), partCount.end());
+    size_t want = partSize;
+    while (want > MIN_PART_SIZE && live * 4 <= want)
+        want >>= 1;
+
+    if (want != partSize)
+        ResizeTable(want);
+    return true;
+}
+
+//
+// ================================================================
+//  Write
+// ================================================================
+void KeyStore::Seal(Record& rec, const uint8_t secret[32])
+{
+    static_assert(offsetof(Record, keyid) == AAD_OFFSET &&
+                  offsetof(Record, secret) == AAD_OFFSET + AAD_SIZE, "key record layout changed");
+
+    rec.seq = nextSeq++;
+    std::memcpy(rec.secret, secret, 32);
+
+    AEADChaCha20Poly1305 aead(masterKey.data());
+    aead.Encrypt(rec.secret, 32, (const uint8_t*)&rec + AAD_OFFSET, AAD_SIZE, 0, rec.seq, rec.tag);
+}
+
+bool KeyStore::Append(Record& rec)
+{
+    const size_t need = HEADER_SIZE + (recordCount + 1) * RECORD_SIZE;
+    if (need > file.Size())
+    {
+        if (!file.Resize(file.Size() + GROW_RECORDS * RECORD_SIZE))
+            return false;
+    }
+
+    const uint64_t h = Hash(rec.keyid);
+    const size_t part = PartitionOf(h);
+    if (rec.type == RECORD_KEY && (partCount[part] + 1) * 2 > partSize)
+        ResizeTable(partSize * 2);
+
+    rec.checksum = Checksum((const uint8_t*)&rec);
+    std::memcpy(file.Data() + HEADER_SIZE + recordCount * RECORD_SIZE, &rec, RECORD_SIZE);
+
+    Replay(part, (uint32_t)recordCount, h);
+    recordCount++;
+    return true;
+}
+
+bool KeyStore::AddKey(const PrivateKey& key, const Metadata& meta, KeyID* idOut,
+                      std::string* reason)
+{
+    if (!key.IsValid() || !key.IsCompressed())
+    {
+        if (reason)
+            *reason = key.IsValid() ? "uncompressed keys are not stored" : "invalid key";
+        return false;
+    }
+
+    const std::vector<uint8_t> pub = key.GetPublicKey().GetBytes();
+    const KeyID id = GetKeyID(pub);
+    if (idOut)
+        *idOut = id;
+
+    std::unique_lock<std::shared_mutex> lock(mutex);
+
+    if (!file.IsOpen())
+    {
+        if (reason)
+            *reason = "key store not open";
+        return false;
+    }
+
+    const Record* found;
+    if (Lookup(id, found))
+        return true;
+
+    Record rec = Record();
+    rec.type = RECORD_KEY;
+    std::memcpy(rec.keyid, id.data(), 20);
+    std::memcpy(rec.pubkey, pub.data(), 33);
+    rec.meta = meta;
+    Seal(rec, key.GetBytes().data());
+
+    if (!Append(rec))
+    {
+        if (reason)
+            *reason = "cannot extend " + path;
+        return false;
+    }
+    return true;
+}
+
+bool KeyStore::SetMetadata(const KeyID& id, const Metadata& meta, std::string* reason)
+{
+    std::unique_lock<std::shared_mutex> lock(mutex);
+
+    const Record* found;
+    if (!file.IsOpen() || !Lookup(id, found))
+    {
+        if (reason)
+            *reason = "unknown key";
+        return false;
+    }
+
+    Record rec;
+    std::memcpy(&rec, found, sizeof(rec));
+
+    AEADChaCha20Poly1305 aead(masterKey.data());
+    if (!aead.Decrypt(rec.secret, 32, (const uint8_t*)&rec + AAD_OFFSET, AAD_SIZE, 0, rec.seq, rec.tag))
+    {
+        if (reason)
+            *reason = "key record does not decrypt";
+        return false;
+    }
+
+    uint8_t secret[32];
+    std::memcpy(secret, rec.secret, 32);
+    rec.meta = meta;
+    Seal(rec, secret);
+    Wipe(secret, sizeof(secret));
+
+    if (!Append(rec))
+    {
+        if (reason)
+            *reason = "cannot extend " + path;
+        return false;
+    }
+
+    MaybeCompact();
+    return true;
+}
+
+bool KeyStore::EraseKey(const KeyID& id)
+{
+    std::unique_lock<std::shared_mutex> lock(mutex);
+
+    const Record* found;
+    if (!file.IsOpen() || !Lookup(id, found))
+        return false;
+
+    Record rec = Record();
+    rec.type = RECORD_ERASE;
+    rec.seq = nextSeq++;
+    std::memcpy(rec.keyid, id.data(), 20);
+
+    if (!Append(rec))
+        return false;
+
+    MaybeCompact();
+    return true;
+}
+
+bool KeyStore::Sync()
+{
+    std::unique_lock<std::shared_mutex> lock(mutex);
+
+    if (!file.IsOpen())
+        return false;
+
+    // Records before the header that counts them
+    Header* hdr = GetHeader();
+    if (recordCount > hdr->syncedCount)
+    {
+        const size_t off = HEADER_SIZE + hdr->syncedCount * RECORD_SIZE;
+        const size_t len = (recordCount - hdr->syncedCount) * RECORD_SIZE;
+        if (!file.Sync(off, len))
+            return false;
+    }
+
+    hdr->syncedCount = recordCount;
+    hdr->nextSeq = nextSeq;
+    return file.Sync(0, HEADER_SIZE);
+}
+
+//
+// ================================================================
+//  Compaction
+// ================================================================
+void KeyStore::MaybeCompact()
+{
+    // Under the write lock
+    const uint64_t keys = LiveCount();
+    const uint64_t dead = recordCount - keys;
+    if (dead < opts.compactMinDead || dead <= keys * opts.compactRatio)
+        return;
+
+    if (compacting.exchange(true))
+        return;
+
+    // The last compaction has released the lock already; its thread
+    // is at most on the way out
+    if (compactor.joinable())
+        compactor.join();
+
+    compactor = std::thread([this] {
+        Compact();
+        compacting = false;
+    });
+}
+
+bool KeyStore::Compact(std::string* reason)
+{
+    std::lock_guard<std::mutex> serial(compactMutex);
+    const Clock::time_point start = Clock::now();
+
+    // 1. The live records as of now, in file order
+    uint64_t end;
+    std::vector<uint32_t> live;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        if (!file.IsOpen())
+        {
+            if (reason)
+                *reason = "key store not open";
+            return false;
+        }
+
+        end = recordCount;
+        live.reserve(LiveCount());
+        for (uint32_t v : table)
+        {
+            if (v != 0)
+                live.push_back(v - 1);
+        }
+    }
+    std::sort(live.begin(), live.end());
+
+    // 2. Copy them out, a chunk at a time so writers keep going
+    const std::string tmp = path + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0)
+    {
+        if (reason)
+            *reason = "cannot create " + tmp;
+        return false;
+    }
+
+    std::vector<uint8_t> buf(HEADER_SIZE, 0);
+    bool ok = WriteAll(fd, buf.data(), buf.size());
+
+    for (size_t i = 0; ok && i < live.size(); i += COPY_RECORDS)
+    {
+        const size_t n = std::min(COPY_RECORDS, live.size() - i);
+        buf.resize(n * RECORD_SIZE);
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            for (size_t j = 0; j < n; ++j)
+                std::memcpy(buf.data() + j * RECORD_SIZE, RecordAt(live[i + j]), RECORD_SIZE);
+        }
+        ok = WriteAll(fd, buf.data(), buf.size());
+    }
+    ok = ok && fdatasync(fd) == 0;
+
+    // 3. Records written meanwhile go after them as they are, then
+    //    the new file replaces the old
+    std::unique_lock<std::shared_mutex> lock(mutex);
+
+    const uint64_t tail = recordCount - end;
+    const uint64_t total = live.size() + tail;
+
+    if (ok && tail > 0)
+        ok = WriteAll(fd, file.Data() + HEADER_SIZE + end * RECORD_SIZE, tail * RECORD_SIZE);
+
+    if (ok)
+    {
+        Header hdr;
+        std::memcpy(&hdr, GetHeader(), sizeof(hdr));
+        hdr.syncedCount = total;
+        hdr.nextSeq = nextSeq;
+        ok = ::pwrite(fd, &hdr, sizeof(hdr), 0) == (ssize_t)sizeof(hdr) && fsync(fd) == 0;
+    }
+
+    ok = (::close(fd) == 0) && ok;
+
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0 || !MappedFile::SyncDirectory(DirOf(path)))
+    {
+        unlink(tmp.c_str());
+        if (reason)
+            *reason = "cannot write " + tmp;
+        return false;
+    }
+
+    file.Close();
+    if (!file.Open(path, MappedFile::READ_WRITE, HEADER_SIZE + (total + GROW_RECORDS) * RECORD_SIZE))
+    {
+        table.clear();
+        partCount.clear();
+        recordCount = 0;
+        if (reason)
+            *reason = "cannot reopen " + path + " after compaction";
+        return false;
+    }
+    file.Advise(MappedFile::ACCESS_RANDOM);
+
+    // Same key ids, same slots: only the record numbers move
+    for (uint32_t& v : table)
+    {
+        if (v == 0)
+            continue;
+
+        const uint32_t n = v - 1;
+        if (n >= end)
+            v = (uint32_t)(live.size() + (n - end)) + 1;
+        else
+            v = (uint32_t)(std::lower_bound(live.begin(), live.end(), n) - live.begin()) + 1;
+    }
+    recordCount = total;
+
+    statCompactions++;
+    statCompactMs = MillisSince(start);
+    return true;
+}
+
+//
+// ================================================================
+//  Read
+// ================================================================
+bool KeyStore::HaveKey(const KeyID& id) const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex);
+
+    const Record* rec;
+    return Lookup(id, rec);
+}
+
+bool KeyStore::GetPublicKey(const KeyID& id, PublicKey& out, Metadata* meta) const
+{
+    std::array<uint8_t,33> pub;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+
+        const Record* rec;
+        if (!Lookup(id, rec))
+            return false;
+
+        std::memcpy(pub.data(), rec->pubkey, 33);
+        if (meta)
+            *meta = rec->meta;
+    }
+
+    out = PublicKey(pub);
+    return out.IsValid();
+}
+
+bool KeyStore::GetSecret(const KeyID& id, PrivateKey& out) const
+{
+    Record rec;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+
+        const Record* found;
+        if (!Lookup(id, found))
+            return false;
+        std::memcpy(&rec, found, sizeof(rec));
+    }
+
+    AEADChaCha20Poly1305 aead(masterKey.data());
+    if (!aead.Decrypt(rec.secret, 32, (const uint8_t*)&rec + AAD_OFFSET, AAD_SIZE, 0, rec.seq, rec.tag))
+        return false;
+
+    std::array<uint8_t,32> secret;
+    std::memcpy(secret.data(), rec.secret, 32);
+    out = PrivateKey(secret);
+
+    Wipe(secret.data(), secret.size());
+    Wipe(rec.secret, sizeof(rec.secret));
+    return out.IsValid();
+}
+
+void KeyStore::ForEachKey(const KeyFn& fn) const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex);
+
+    KeyID id;
+    for (uint32_t v : table)
+    {
+        if (v == 0)
+            continue;
+
+        const Record* rec = RecordAt(v - 1);
+        std::memcpy(id.data(), rec->keyid, 20);
+        if (!fn(id, rec->meta))
+            return;
+    }
+}
+
+size_t KeyStore::Size() const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return LiveCount();
+}
+
+size_t KeyStore::LiveCount() const
+{
+    size_t n = 0;
+    for (uint32_t c : partCount)
+        n += c;
+    return n;
+}
+
+KeyStore::Stats KeyStore::GetStats() const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex);
+
+    Stats s;
+    s.keys = LiveCount();
+    s.records = recordCount;
+    s.fileBytes = HEADER_SIZE + recordCount * RECORD_SIZE;
+    s.tableBytes = table.capacity() * sizeof(uint32_t) + partCount.capacity() * sizeof(uint32_t);
+    s.compactions = statCompactions;
+    s.loadMs = statLoadMs;
+    s.compactMs = statCompactMs;
+    return s;
+}
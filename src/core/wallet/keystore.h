@@ -0,0 +1,229 @@
+#ifndef DRACHMA_WALLET_KEYSTORE_H
+#define DRACHMA_WALLET_KEYSTORE_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../crypto/ecdsa.h"
+#include "../node/scheduler.h"
+#include "../storage/mmapfile.h"
+
+//
+// ===============================================================
+//  CLASS: KeyStore
+// ===============================================================
+//
+//  The wallet's keys in one append-only file, built for millions
+//  of them: opening it maps the file and indexes the records in
+//  place, nothing is deserialized or copied.
+//
+//  On disk:
+//    header page – magic, version, syncedCount, nextSeq and a
+//                  check block encrypted under the master key
+//    records     – fixed 144 bytes, appended in order:
+//                    u32 checksum | u8 type | u8 0[3] |
+//                    u64 seq | keyid[20] | pubkey[33] | pad[3] |
+//                    metadata[24] | secret[32] | tag[16]
+//                  checksum = first 4 bytes of SHA256D(rest)
+//
+//  A KEY record adds a key or replaces an earlier record for the
+//  same key id (new metadata); an ERASE record removes it. The
+//  secret is ChaCha20-Poly1305 under the master key, the record's
+//  seq as nonce and the key id, public key and metadata as
+//  associated data, so neither can be moved to another key. Seqs
+//  never repeat for one file, compaction included.
+//
+//  In memory only a u32 table of record numbers is kept (~8 bytes
+//  per key at load 1/2), split into `partitions` independent
+//  open-addressing tables by the top bits of a salted hash of the
+//  key id. Open() builds it on the Scheduler (TASK_BACKGROUND):
+//  ranges of records are bucketed by partition, then every
+//  partition replays its records in file order.
+//
+//  Records past the last Sync() are checked against their
+//  checksum on Open() and a torn tail is cut off; older ones only
+//  with `verifyOnLoad`.
+//
+//  Replaced and erased records stay in the file until compaction
+//  rewrites the live ones to a new file and renames it over the
+//  old. It runs on its own thread once the dead records exceed
+//  `compactRatio` per live key (and `compactMinDead`), or through
+//  Compact(); reads and writes carry on meanwhile.
+//
+//  Only compressed keys are stored.
+//
+//  Threading: any number of readers alongside one writer.
+//
+// ===============================================================
+//
+class KeyStore
+{
+public:
+    typedef std::array<uint8_t,20> KeyID;
+
+    static constexpr size_t RECORD_SIZE = 144;
+    static constexpr size_t MASTER_KEY_SIZE = 32;
+
+    struct Options
+    {
+        size_t partitions;              // power of two
+        size_t rangeRecords;            // records per load task
+        double compactRatio;            // dead records per live key
+        uint64_t compactMinDead;
+        bool verifyOnLoad;              // checksum every record
+
+        Options()
+            : partitions(64), rangeRecords(1u << 16), compactRatio(0.5),
+              compactMinDead(1u << 14), verifyOnLoad(false) {}
+    };
+
+    struct Metadata
+    {
+        int64_t createTime;
+        uint32_t account;               // HD path, if derived
+        uint32_t index;
+        uint32_t flags;                 // the wallet's
+        uint32_t reserved;
+
+        Metadata() : createTime(0), account(0), index(0), flags(0), reserved(0) {}
+    };
+
+    struct Stats
+    {
+        size_t keys;
+        uint64_t records;               // in the file, dead ones included
+        uint64_t fileBytes;
+        size_t tableBytes;              // the in-memory index
+        uint64_t compactions;
+        double loadMs;                  // last Open()
+        double compactMs;               // last compaction
+    };
+
+    explicit KeyStore(Scheduler& scheduler);
+    ~KeyStore();
+
+    KeyStore(const KeyStore&) = delete;
+    KeyStore& operator=(const KeyStore&) = delete;
+
+    // Opens or creates the file. A wrong master key fails.
+    bool Open(const std::string& path, const uint8_t masterKey[MASTER_KEY_SIZE],
+              const Options& opts = Options(), std::string* reason = nullptr);
+    void Close();
+    bool IsOpen() const { return file.IsOpen(); }
+
+    // ---- Write ----
+    // Adding a stored key again is a no-op
+    bool AddKey(const PrivateKey& key, const Metadata& meta, KeyID* idOut = nullptr,
+                std::string* reason = nullptr);
+    bool SetMetadata(const KeyID& id, const Metadata& meta, std::string* reason = nullptr);
+    bool EraseKey(const KeyID& id);
+
+    // Make everything written so far durable
+    bool Sync();
+
+    // Rewrite the file with only the live records
+    bool Compact(std::string* reason = nullptr);
+
+    // ---- Read ----
+    bool HaveKey(const KeyID& id) const;
+    bool GetPublicKey(const KeyID& id, PublicKey& out, Metadata* meta = nullptr) const;
+    bool GetSecret(const KeyID& id, PrivateKey& out) const;
+
+    // Every key in no particular order; return false to stop. `fn`
+    // must not write to the store.
+    typedef std::function<bool(const KeyID& id, const Metadata& meta)> KeyFn;
+    void ForEachKey(const KeyFn& fn) const;
+
+    size_t Size() const;
+    Stats GetStats() const;
+
+    static KeyID GetKeyID(const std::vector<uint8_t>& pubkey);
+
+private:
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t syncedCount;           // records known to be durable
+        uint64_t nextSeq;
+        uint32_t recordSize;
+        uint32_t reserved;
+        uint8_t check[32];              // zeroes, encrypted
+        uint8_t checkTag[16];
+    };
+
+    struct Record
+    {
+        uint32_t checksum;
+        uint8_t type;
+        uint8_t reserved[3];
+        uint64_t seq;
+        uint8_t keyid[20];
+        uint8_t pubkey[33];
+        uint8_t pad[3];
+        Metadata meta;
+        uint8_t secret[32];
+        uint8_t tag[16];
+    };
+
+    static_assert(sizeof(Record) == RECORD_SIZE, "key record layout changed");
+
+    Header* GetHeader() const { return (Header*)file.Data(); }
+    const Record* RecordAt(uint64_t n) const;
+
+    uint64_t Hash(const uint8_t* keyid) const;
+    size_t PartitionOf(uint64_t h) const { return partitionBits ? (size_t)(h >> (64 - partitionBits)) : 0; }
+
+    // Index of one partition's table
+    uint32_t* Part(size_t p) { return table.data() + p * partSize; }
+    const uint32_t* Part(size_t p) const { return table.data() + p * partSize; }
+    // The key's slot, or the empty slot ending its probe run
+    size_t FindSlot(size_t part, uint64_t h, const uint8_t* keyid) const;
+    void RemoveSlot(size_t part, size_t slot);
+    // Applies one record to the partition's table
+    void Replay(size_t part, uint32_t recordNo, uint64_t h);
+    bool Lookup(const KeyID& id, const Record*& rec) const;
+    void ResizeTable(size_t newPartSize);
+    size_t LiveCount() const;
+
+    bool Load(std::string* reason);
+    void Seal(Record& rec, const uint8_t secret[32]);
+    bool Append(Record& rec);
+    void MaybeCompact();
+
+    Scheduler& scheduler;
+    Options opts;
+    std::string path;
+    std::array<uint8_t, MASTER_KEY_SIZE> masterKey;
+
+    mutable std::shared_mutex mutex;
+
+    MappedFile file;
+    uint64_t recordCount;
+    uint64_t nextSeq;
+
+    uint64_t k0;
+    uint64_t k1;
+    unsigned partitionBits;
+    size_t partSize;                    // slots per partition, power of two
+    std::vector<uint32_t> table;        // recordNo + 1, 0 = empty
+    std::vector<uint32_t> partCount;    // live keys per partition
+
+    std::mutex compactMutex;            // one compaction at a time
+    std::thread compactor;
+    std::atomic<bool> compacting;
+
+    uint64_t statCompactions;
+    double statLoadMs;
+    double statCompactMs;
+};
+
+#endif // DRACHMA_WALLET_KEYSTORE_H
@@ -0,0 +1,135 @@
+#include "keystorebench.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <limits>
+#include <random>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static double SecondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Drop the (synced, so clean) pages of a file from the page cache
+static void Evict(const std::string& path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+}
+
+static bool Reopen(KeyStore& store, const KeyStoreBenchmark::Options& opts, const uint8_t* masterKey,
+                   std::string* reason)
+{
+    store.Close();
+    if (opts.cold)
+        Evict(opts.path);
+
+    return store.Open(opts.path, masterKey, opts.store, reason);
+}
+
+bool KeyStoreBenchmark::Run(Scheduler& scheduler, const Options& opts, Report& report,
+                            std::string* reason)
+{
+    report = Report();
+
+    if (opts.path.empty() || opts.keys == 0)
+    {
+        if (reason)
+            *reason = "path and keys must be set";
+        return false;
+    }
+
+    unlink(opts.path.c_str());
+
+    std::random_device rd;
+    uint8_t masterKey[KeyStore::MASTER_KEY_SIZE];
+    for (uint8_t& b : masterKey)
+        b = (uint8_t)rd();
+
+    // Fill without compacting, so the first Open() sees the dead records
+    KeyStore::Options fillOpts = opts.store;
+    fillOpts.compactMinDead = std::numeric_limits<uint64_t>::max();
+
+    KeyStore store(scheduler);
+    if (!store.Open(opts.path, masterKey, fillOpts, reason))
+        return false;
+
+    std::vector<KeyStore::KeyID> ids(opts.keys);
+    const Clock::time_point fillStart = Clock::now();
+
+    KeyStore::Metadata meta;
+    for (size_t i = 0; i < opts.keys; ++i)
+    {
+        meta.createTime = (int64_t)i;
+        meta.index = (uint32_t)i;
+        if (!store.AddKey(PrivateKey::Generate(), meta, &ids[i], reason))
+            return false;
+    }
+
+    meta.flags = 1;
+    const size_t rewrites = (size_t)(opts.keys * opts.rewrite);
+    for (size_t i = 0; i < rewrites && i < opts.keys; ++i)
+    {
+        if (!store.SetMetadata(ids[i], meta, reason))
+            return false;
+    }
+
+    if (!store.Sync())
+    {
+        if (reason)
+            *reason = "sync failed";
+        return false;
+    }
+    report.fillSeconds = SecondsSince(fillStart);
+    report.records = store.GetStats().records;
+
+    // Startup with the dead records
+    if (!Reopen(store, opts, masterKey, reason))
+        return false;
+
+    KeyStore::Stats stats = store.GetStats();
+    report.keys = stats.keys;
+    report.openMs = stats.loadMs;
+    report.tableBytesPerKey = (double)stats.tableBytes / stats.keys;
+
+    if (!store.Compact(reason))
+        return false;
+    report.compactMs = store.GetStats().compactMs;
+
+    // Startup after compaction
+    if (!Reopen(store, opts, masterKey, reason))
+        return false;
+
+    stats = store.GetStats();
+    report.openCompactedMs = stats.loadMs;
+    report.fileBytesPerKey = (double)stats.fileBytes / stats.keys;
+
+    std::mt19937_64 rng(rd());
+    size_t found = 0;
+    const Clock::time_point lookupStart = Clock::now();
+    for (size_t i = 0; i < opts.lookups; ++i)
+        found += store.HaveKey(ids[rng() % ids.size()]);
+
+    const double seconds = SecondsSince(lookupStart);
+    report.lookupsPerSecond = seconds > 0 ? opts.lookups / seconds : 0;
+
+    store.Close();
+    unlink(opts.path.c_str());
+
+    if (found != opts.lookups || report.keys != opts.keys)
+    {
+        if (reason)
+            *reason = "keys missing after reopening";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,60 @@
+#ifndef DRACHMA_WALLET_KEYSTOREBENCH_H
+#define DRACHMA_WALLET_KEYSTOREBENCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "keystore.h"
+
+//
+// ===============================================================
+//  CLASS: KeyStoreBenchmark
+// ===============================================================
+//
+//  What a wallet of `keys` keys costs at startup: fills a fresh
+//  KeyStore at `path` (removed first) with generated keys,
+//  rewrites the metadata of a `rewrite` fraction of them, syncs,
+//  drops the file from the page cache (`cold`) and times the
+//  Open() that follows, then compacts and times a second Open().
+//
+//  Report: startup time, bytes of memory and of file per key,
+//  compaction time and random lookups per second. Filling the
+//  store is dominated by deriving the public keys and reported
+//  separately.
+//
+// ===============================================================
+//
+class KeyStoreBenchmark
+{
+public:
+    struct Options
+    {
+        std::string path;
+        size_t keys;
+        double rewrite;                 // fraction of keys given new metadata
+        bool cold;                      // evict the file before opening
+        size_t lookups;
+        KeyStore::Options store;
+
+        Options() : keys(1000000), rewrite(0.5), cold(true), lookups(1000000) {}
+    };
+
+    struct Report
+    {
+        uint64_t keys;
+        uint64_t records;               // before compaction
+        double fillSeconds;
+        double openMs;                  // keys plus dead records
+        double compactMs;
+        double openCompactedMs;
+        double tableBytesPerKey;
+        double fileBytesPerKey;         // after compaction
+        double lookupsPerSecond;
+    };
+
+    static bool Run(Scheduler& scheduler, const Options& opts, Report& report,
+                    std::string* reason = nullptr);
+};
+
+#endif // DRACHMA_WALLET_KEYSTOREBENCH_H
@@ -0,0 +1,133 @@
+#include "signingload.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+static double Percentile(const std::vector<uint64_t>& sorted, double q)
+{
+    if (sorted.empty())
+        return 0;
+
+    const size_t i = std::min(sorted.size() - 1, (size_t)(q * sorted.size()));
+    return sorted[i] / 1000.0;
+}
+
+bool SigningLoadGenerator::Run(SigningService& service, const Options& opts, Report& report,
+                               std::string* reason)
+{
+    report = Report();
+
+    if (opts.clients == 0 || opts.batchSize == 0 || opts.keys == 0)
+    {
+        if (reason)
+            *reason = "clients, batchSize and keys must be non-zero";
+        return false;
+    }
+
+    std::vector<SigningService::KeyID> ids(opts.keys);
+    std::vector<std::vector<uint8_t>> pubkeys(opts.keys);
+    for (size_t i = 0; i < opts.keys; ++i)
+    {
+        const PrivateKey key = PrivateKey::Generate();
+        if (!service.AddKey(key, &ids[i]))
+        {
+            if (reason)
+                *reason = "could not add key";
+            return false;
+        }
+        pubkeys[i] = key.GetPublicKey().GetBytes();
+    }
+
+    // One batch of work per client, reused every round
+    std::mt19937_64 rng(std::random_device{}());
+    std::vector<std::vector<SigningService::SignItem>> signWork(opts.clients);
+    std::vector<std::vector<SigningService::VerifyItem>> verifyWork(opts.clients);
+    for (unsigned c = 0; c < opts.clients; ++c)
+    {
+        signWork[c].resize(opts.batchSize);
+        for (size_t i = 0; i < opts.batchSize; ++i)
+        {
+            SigningService::SignItem& item = signWork[c][i];
+            item.key = ids[(c * opts.batchSize + i) % opts.keys];
+            for (size_t j = 0; j < item.hash.size(); j += 8)
+            {
+                const uint64_t r = rng();
+                std::memcpy(item.hash.data() + j, &r, 8);
+            }
+        }
+
+        if (!opts.verify)
+            continue;
+
+        std::vector<std::vector<uint8_t>> sigs;
+        if (!service.SignMany(signWork[c], opts.format, sigs, reason))
+            return false;
+
+        verifyWork[c].resize(opts.batchSize);
+        for (size_t i = 0; i < opts.batchSize; ++i)
+        {
+            SigningService::VerifyItem& item = verifyWork[c][i];
+            item.pubkey = pubkeys[(c * opts.batchSize + i) % opts.keys];
+            item.hash = signWork[c][i].hash;
+            item.signature = std::move(sigs[i]);
+        }
+    }
+
+    std::mutex mutex;
+    std::vector<uint64_t> latencies;        // micros per batch
+    std::atomic<uint64_t> failures(0);
+
+    const Clock::time_point start = Clock::now();
+    const Clock::time_point deadline = start + opts.duration;
+
+    std::vector<std::thread> clients;
+    for (unsigned c = 0; c < opts.clients; ++c)
+    {
+        clients.emplace_back([&, c] {
+            std::vector<uint64_t> mine;
+            std::vector<std::vector<uint8_t>> sigs;
+            std::vector<uint8_t> valid;
+
+            while (Clock::now() < deadline)
+            {
+                const Clock::time_point t0 = Clock::now();
+                if (opts.verify)
+                {
+                    service.VerifyMany(verifyWork[c], valid);
+                    failures += (uint64_t)std::count(valid.begin(), valid.end(), 0);
+                }
+                else if (!service.SignMany(signWork[c], opts.format, sigs))
+                {
+                    failures++;
+                }
+
+                mine.push_back((uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+                    Clock::now() - t0).count());
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            latencies.insert(latencies.end(), mine.begin(), mine.end());
+        });
+    }
+
+    for (std::thread& t : clients)
+        t.join();
+
+    report.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    report.batches = latencies.size();
+    report.items = report.batches * opts.batchSize;
+    report.failures = failures;
+
+    std::sort(latencies.begin(), latencies.end());
+    report.p50Ms = Percentile(latencies, 0.50);
+    report.p90Ms = Percentile(latencies, 0.90);
+    report.p99Ms = Percentile(latencies, 0.99);
+    report.p999Ms = Percentile(latencies, 0.999);
+    report.maxMs = latencies.empty() ? 0 : latencies.back() / 1000.0;
+    return true;
+}
@@ -0,0 +1,69 @@
+#ifndef DRACHMA_WALLET_SIGNINGLOAD_H
+#define DRACHMA_WALLET_SIGNINGLOAD_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "signingservice.h"
+
+//
+// ===============================================================
+//  CLASS: SigningLoadGenerator
+// ===============================================================
+//
+//  Local load generator for a SigningService: `clients` threads
+//  each submit batch after batch (closed loop) for `duration`,
+//  with `keys` freshly generated keys and random hashes, and the
+//  latency of every batch is kept.
+//
+//  With `verify` the clients submit VerifyMany() batches of
+//  signatures made up front instead; every one of them must
+//  verify.
+//
+//  Report: items per second over the whole run and the batch
+//  latency distribution, which is what a burst of withdrawals
+//  sees as its tail.
+//
+// ===============================================================
+//
+class SigningLoadGenerator
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Options
+    {
+        unsigned clients;
+        size_t batchSize;
+        size_t keys;
+        Clock::duration duration;
+        SigningService::Format format;
+        bool verify;
+
+        Options()
+            : clients(4), batchSize(256), keys(64), duration(std::chrono::seconds(5)),
+              format(SigningService::SIG_DER), verify(false) {}
+    };
+
+    struct Report
+    {
+        uint64_t batches;
+        uint64_t items;
+        uint64_t failures;              // batches refused, signatures that did not verify
+        double seconds;
+        double p50Ms;
+        double p90Ms;
+        double p99Ms;
+        double p999Ms;
+        double maxMs;
+
+        double ItemsPerSecond() const { return seconds > 0 ? items / seconds : 0; }
+    };
+
+    static bool Run(SigningService& service, const Options& opts, Report& report,
+                    std::string* reason = nullptr);
+};
+
+#endif // DRACHMA_WALLET_SIGNINGLOAD_H
@@ -0,0 +1,304 @@
+#include "signingservice.h"
+#include "../crypto/hash.h"
+
+#include "secp256k1/secp256k1.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <random>
+
+//
+// ================================================================
+//  Per-thread contexts
+// ================================================================
+namespace {
+
+struct ThreadContext
+{
+    secp256k1_context* ctx;
+    uint64_t signatures;                // since the last randomization
+
+    ThreadContext() : ctx(nullptr), signatures(0) {}
+
+    ~ThreadContext()
+    {
+        if (ctx)
+            secp256k1_context_destroy(ctx);
+    }
+};
+
+thread_local ThreadContext threadContext;
+
+void Randomize(secp256k1_context* ctx)
+{
+    std::random_device rd;
+    std::array<uint8_t,32> seed;
+    for (size_t i = 0; i < seed.size(); i += 4)
+    {
+        const uint32_t r = rd();
+        std::memcpy(seed.data() + i, &r, 4);
+    }
+
+    secp256k1_context_randomize(ctx, seed.data());
+    std::memset(seed.data(), 0, seed.size());
+}
+
+} // namespace
+
+secp256k1_context* SigningService::Context()
+{
+    ThreadContext& tc = threadContext;
+    if (!tc.ctx)
+    {
+        tc.ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN | SECP256K1_CONTEXT_VERIFY);
+        Randomize(tc.ctx);
+    }
+    else if (tc.signatures >= opts.rerandomizeEvery)
+    {
+        Randomize(tc.ctx);
+        tc.signatures = 0;
+    }
+    return tc.ctx;
+}
+
+//
+// ================================================================
+//  SigningService
+// ================================================================
+size_t SigningService::KeyIDHasher::operator()(const KeyID& id) const
+{
+    uint64_t h;
+    std::memcpy(&h, id.data(), sizeof(h));
+    return (size_t)h;
+}
+
+SigningService::SigningService(Scheduler& sched, const Options& o)
+    : scheduler(sched), opts(o)
+{
+    if (opts.chunkSize == 0)
+        opts.chunkSize = 1;
+    if (opts.rerandomizeEvery == 0)
+        opts.rerandomizeEvery = 1;
+
+    statBatches = 0;
+    statSignatures = 0;
+    statVerifications = 0;
+    statInvalid = 0;
+    statBatchMicros = 0;
+    statMaxBatchMicros = 0;
+}
+
+SigningService::KeyEntry::~KeyEntry()
+{
+    volatile uint8_t* p = secret.data();
+    for (size_t i = 0; i < secret.size(); ++i)
+        p[i] = 0;
+}
+
+SigningService::KeyID SigningService::GetKeyID(const std::vector<uint8_t>& pubkey)
+{
+    KeyID id;
+    Hash::Hash160(pubkey.data(), pubkey.size(), id.data());
+    return id;
+}
+
+bool SigningService::AddKey(const PrivateKey& key, KeyID* id)
+{
+    if (!key.IsValid())
+        return false;
+
+    const KeyID keyId = GetKeyID(key.GetPublicKey().GetBytes());
+
+    std::shared_ptr<KeyEntry> entry = std::make_shared<KeyEntry>();
+    entry->secret = key.GetBytes();
+
+    {
+        std::unique_lock<std::shared_mutex> lock(keysMutex);
+        keys[keyId] = std::move(entry);
+    }
+
+    if (id)
+        *id = keyId;
+    return true;
+}
+
+bool SigningService::HaveKey(const KeyID& id) const
+{
+    std::shared_lock<std::shared_mutex> lock(keysMutex);
+    return keys.count(id) != 0;
+}
+
+bool SigningService::SignMany(const std::vector<SignItem>& items, Format format,
+                              std::vector<std::vector<uint8_t>>& sigs, std::string* reason)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    sigs.assign(items.size(), std::vector<uint8_t>());
+
+    // The lock covers the lookups only: waiting for the tasks below
+    // may run other requests on this thread
+    std::vector<KeyRef> entries(items.size());
+    {
+        std::shared_lock<std::shared_mutex> lock(keysMutex);
+        for (size_t i = 0; i < items.size(); ++i)
+        {
+            auto it = keys.find(items[i].key);
+            if (it == keys.end())
+            {
+                if (reason)
+                    *reason = "unknown key in item " + std::to_string(i);
+                return false;
+            }
+            entries[i] = it->second;
+        }
+    }
+
+    if (items.size() <= opts.chunkSize)
+    {
+        SignRange(entries, items, format, sigs, 0, items.size());
+    }
+    else
+    {
+        TaskGroup group(scheduler, TASK_RPC);
+        for (size_t begin = opts.chunkSize; begin < items.size(); begin += opts.chunkSize)
+        {
+            const size_t end = std::min(begin + opts.chunkSize, items.size());
+            group.Run([this, &entries, &items, format, &sigs, begin, end] {
+                SignRange(entries, items, format, sigs, begin, end);
+            });
+        }
+
+        // The first run here, then help with the rest
+        SignRange(entries, items, format, sigs, 0, opts.chunkSize);
+        group.Wait();
+    }
+
+    statSignatures += items.size();
+    RecordBatch((uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count());
+    return true;
+}
+
+void SigningService::SignRange(const std::vector<KeyRef>& entries,
+                               const std::vector<SignItem>& items, Format format,
+                               std::vector<std::vector<uint8_t>>& sigs, size_t begin, size_t end)
+{
+    secp256k1_context* ctx = Context();
+
+    for (size_t i = begin; i < end; ++i)
+    {
+        // Low-S already; RFC 6979 nonce
+        secp256k1_ecdsa_signature sig;
+        secp256k1_ecdsa_sign(ctx, &sig, items[i].hash.data(), entries[i]->secret.data(),
+                             nullptr, nullptr);
+
+        std::vector<uint8_t>& out = sigs[i];
+        if (format == SIG_COMPACT)
+        {
+            out.resize(64);
+            secp256k1_ecdsa_signature_serialize_compact(ctx, out.data(), &sig);
+        }
+        else
+        {
+            size_t len = 72;
+            out.resize(len);
+            secp256k1_ecdsa_signature_serialize_der(ctx, out.data(), &len, &sig);
+            out.resize(len);
+        }
+    }
+
+    threadContext.signatures += end - begin;
+}
+
+void SigningService::VerifyMany(const std::vector<VerifyItem>& items, std::vector<uint8_t>& valid)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    valid.assign(items.size(), 0);
+
+    size_t good;
+    if (items.size() <= opts.chunkSize)
+    {
+        good = VerifyRange(items, valid, 0, items.size());
+    }
+    else
+    {
+        std::atomic<size_t> total(0);
+        TaskGroup group(scheduler, TASK_RPC);
+        for (size_t begin = opts.chunkSize; begin < items.size(); begin += opts.chunkSize)
+        {
+            const size_t end = std::min(begin + opts.chunkSize, items.size());
+            group.Run([this, &items, &valid, &total, begin, end] {
+                total += VerifyRange(items, valid, begin, end);
+            });
+        }
+
+        total += VerifyRange(items, valid, 0, opts.chunkSize);
+        group.Wait();
+        good = total;
+    }
+
+    statVerifications += items.size();
+    statInvalid += items.size() - good;
+    RecordBatch((uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count());
+}
+
+size_t SigningService::VerifyRange(const std::vector<VerifyItem>& items, std::vector<uint8_t>& valid,
+                                   size_t begin, size_t end)
+{
+    // Verification uses no secrets, so the context is only read
+    secp256k1_context* ctx = Context();
+
+    size_t good = 0;
+    for (size_t i = begin; i < end; ++i)
+    {
+        const VerifyItem& item = items[i];
+
+        secp256k1_pubkey pub;
+        if (!secp256k1_ec_pubkey_parse(ctx, &pub, item.pubkey.data(), item.pubkey.size()))
+            continue;
+
+        secp256k1_ecdsa_signature sig;
+        const bool parsed = item.signature.size() == 64
+            ? secp256k1_ecdsa_signature_parse_compact(ctx, &sig, item.signature.data())
+            : secp256k1_ecdsa_signature_parse_der(ctx, &sig, item.signature.data(), item.signature.size());
+        if (!parsed)
+            continue;
+
+        secp256k1_ecdsa_signature_normalize(ctx, &sig, &sig);
+        if (secp256k1_ecdsa_verify(ctx, &sig, item.hash.data(), &pub))
+        {
+            valid[i] = 1;
+            ++good;
+        }
+    }
+    return good;
+}
+
+void SigningService::RecordBatch(uint64_t micros)
+{
+    statBatches++;
+    statBatchMicros += micros;
+
+    uint64_t seen = statMaxBatchMicros;
+    while (micros > seen && !statMaxBatchMicros.compare_exchange_weak(seen, micros)) {}
+}
+
+SigningService::Stats SigningService::GetStats() const
+{
+    Stats s;
+    {
+        std::shared_lock<std::shared_mutex> lock(keysMutex);
+        s.keys = keys.size();
+    }
+    s.batches = statBatches;
+    s.signatures = statSignatures;
+    s.verifications = statVerifications;
+    s.invalid = statInvalid;
+    s.avgBatchMs = s.batches ? statBatchMicros / 1000.0 / s.batches : 0;
+    s.maxBatchMs = statMaxBatchMicros / 1000.0;
+    return s;
+}
@@ -0,0 +1,153 @@
+#ifndef DRACHMA_WALLET_SIGNINGSERVICE_H
+#define DRACHMA_WALLET_SIGNINGSERVICE_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../crypto/ecdsa.h"
+#include "../node/scheduler.h"
+
+struct secp256k1_context_struct;
+
+//
+// ===============================================================
+//  CLASS: SigningService
+// ===============================================================
+//
+//  Signs and verifies ECDSA signatures in batches, spread over the
+//  Scheduler's workers.
+//
+//  Keys are held by the service and referred to by their key ID,
+//  Hash160 of the serialized public key, so a request never
+//  carries secret material. A batch is cut into runs of
+//  `chunkSize` items, one task each; results come back in the
+//  order of the request.
+//
+//  Every worker thread signs with a secp256k1 context of its own
+//  instead of the process-wide one in ecdsa.cpp. A context is
+//  randomized (blinding of the secret-dependent multiplications)
+//  when it is created and again every `rerandomizeEvery`
+//  signatures; randomizing writes to the context, which a shared
+//  one could not do while other threads sign with it.
+//
+//  Signatures are low-S, RFC 6979, as PrivateKey::Sign(); compact
+//  means the 64-byte r || s. Verification accepts high-S, like
+//  PublicKey::Verify(), and strict DER.
+//
+//  All calls are thread-safe; AddKey() may run alongside batches.
+//
+// ===============================================================
+//
+class SigningService
+{
+public:
+    typedef std::array<uint8_t,20> KeyID;
+    typedef std::array<uint8_t,32> Hash256;
+
+    enum Format
+    {
+        SIG_DER,
+        SIG_COMPACT,
+    };
+
+    struct Options
+    {
+        size_t chunkSize;               // items per task
+        uint64_t rerandomizeEvery;      // signatures per context between randomizations
+
+        Options() : chunkSize(64), rerandomizeEvery(1024) {}
+    };
+
+    struct SignItem
+    {
+        KeyID key;
+        Hash256 hash;
+    };
+
+    struct VerifyItem
+    {
+        std::vector<uint8_t> pubkey;    // 33 or 65 bytes
+        Hash256 hash;
+        std::vector<uint8_t> signature; // DER, or 64 bytes compact
+    };
+
+    struct Stats
+    {
+        size_t keys;
+        uint64_t batches;
+        uint64_t signatures;
+        uint64_t verifications;
+        uint64_t invalid;               // signatures that did not verify
+        double avgBatchMs;
+        double maxBatchMs;
+    };
+
+    explicit SigningService(Scheduler& scheduler, const Options& opts = Options());
+
+    SigningService(const SigningService&) = delete;
+    SigningService& operator=(const SigningService&) = delete;
+
+    bool AddKey(const PrivateKey& key, KeyID* id = nullptr);
+    bool HaveKey(const KeyID& id) const;
+
+    static KeyID GetKeyID(const std::vector<uint8_t>& pubkey);
+
+    // One signature per item, in order. Fails, signing nothing,
+    // when a key is unknown; `reason` names the first such item.
+    bool SignMany(const std::vector<SignItem>& items, Format format,
+                  std::vector<std::vector<uint8_t>>& sigs, std::string* reason = nullptr);
+
+    // One flag per item: 1 if the signature is valid
+    void VerifyMany(const std::vector<VerifyItem>& items, std::vector<uint8_t>& valid);
+
+    Stats GetStats() const;
+
+private:
+    struct KeyIDHasher
+    {
+        // Key IDs are hash outputs already
+        size_t operator()(const KeyID& id) const;
+    };
+
+    // Immutable once added; a batch keeps the entries it uses
+    struct KeyEntry
+    {
+        std::array<uint8_t,32> secret;
+
+        ~KeyEntry();
+    };
+
+    typedef std::shared_ptr<const KeyEntry> KeyRef;
+
+    // The calling thread's context
+    secp256k1_context_struct* Context();
+
+    void SignRange(const std::vector<KeyRef>& keys, const std::vector<SignItem>& items,
+                   Format format, std::vector<std::vector<uint8_t>>& sigs, size_t begin, size_t end);
+    size_t VerifyRange(const std::vector<VerifyItem>& items, std::vector<uint8_t>& valid,
+                       size_t begin, size_t end);
+
+    void RecordBatch(uint64_t micros);
+
+    Scheduler& scheduler;
+    Options opts;
+
+    mutable std::shared_mutex keysMutex;
+    std::unordered_map<KeyID, KeyRef, KeyIDHasher> keys;
+
+    std::atomic<uint64_t> statBatches;
+    std::atomic<uint64_t> statSignatures;
+    std::atomic<uint64_t> statVerifications;
+    std::atomic<uint64_t> statInvalid;
+    std::atomic<uint64_t> statBatchMicros;
+    std::atomic<uint64_t> statMaxBatchMicros;
+};
+
+#endif // DRACHMA_WALLET_SIGNINGSERVICE_H
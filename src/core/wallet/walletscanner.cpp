@@ -0,0 +1,331 @@
+#include "walletscanner.h"
+#include "../chain/block.h"
+
+#include <algorithm>
+
+//
+// ================================================================
+//  Events
+// ================================================================
+
+// Chain order; a transaction's inputs before its outputs
+static bool EventBefore(const WalletScanner::Event& a, const WalletScanner::Event& b)
+{
+    if (a.height != b.height)
+        return a.height < b.height;
+    if (a.txIndex != b.txIndex)
+        return a.txIndex < b.txIndex;
+    if (a.type != b.type)
+        return a.type == WalletScanner::Event::DEBIT;
+    return a.n < b.n;
+}
+
+static void MergeEvents(std::vector<WalletScanner::Event>& credits,
+                        std::vector<WalletScanner::Event>& debits,
+                        std::vector<WalletScanner::Event>& out)
+{
+    out.reserve(out.size() + credits.size() + debits.size());
+
+    size_t c = 0, d = 0;
+    while (c < credits.size() || d < debits.size())
+    {
+        if (d == debits.size() || (c < credits.size() && EventBefore(credits[c], debits[d])))
+            out.push_back(std::move(credits[c++]));
+        else
+            out.push_back(std::move(debits[d++]));
+    }
+}
+
+//
+// ================================================================
+//  WalletScanner
+// ================================================================
+WalletScanner::WalletScanner(const WatchSet& w, Scheduler& sched, const Options& o)
+    : watch(w), scheduler(sched), opts(o)
+{
+    if (opts.rangeBlocks == 0)
+        opts.rangeBlocks = 1;
+
+    balance = 0;
+    statCredits = 0;
+    statDebits = 0;
+}
+
+void WalletScanner::FindCredits(const BlockView& block, int height, std::vector<Event>& out,
+                                Counters& counters) const
+{
+    WatchSet::Hash160 hash;
+
+    for (uint32_t t = 0; t < block.vtx.size(); ++t)
+    {
+        const TransactionView& tx = block.vtx[t];
+        const std::vector<TxOutView>& outputs = tx.Outputs();
+
+        for (uint32_t n = 0; n < outputs.size(); ++n)
+        {
+            if (!WatchSet::ExtractHash(outputs[n].script, hash) || !watch.MayContain(hash.data()))
+                continue;
+
+            counters.filterHits++;
+            if (!watch.Contains(hash))
+                continue;
+
+            Event ev;
+            ev.type = Event::CREDIT;
+            ev.height = height;
+            ev.txIndex = t;
+            ev.n = n;
+            ev.txid = tx.GetTxid();
+            ev.coin = OutPoint(ev.txid, n);
+            ev.data = Coin(outputs[n].amount, (uint32_t)height, t == 0, outputs[n].script.ToVector());
+            out.push_back(std::move(ev));
+        }
+
+        counters.outputs += outputs.size();
+    }
+
+    counters.transactions += block.vtx.size();
+}
+
+void WalletScanner::FindDebits(const BlockView& block, int height, const CoinMap& spendable,
+                               const CoinMap* more, std::vector<Event>& out, Counters* counters)
+{
+    // The coinbase spends nothing
+    for (uint32_t t = 1; t < block.vtx.size(); ++t)
+    {
+        const TransactionView& tx = block.vtx[t];
+        const std::vector<TxInView>& inputs = tx.Inputs();
+
+        for (uint32_t n = 0; n < inputs.size(); ++n)
+        {
+            const OutPoint prevout = inputs[n].GetPrevout();
+            auto it = spendable.find(prevout);
+            if (it == spendable.end())
+            {
+                if (!more || (it = more->find(prevout)) == more->end())
+                    continue;
+            }
+
+            Event ev;
+            ev.type = Event::DEBIT;
+            ev.height = height;
+            ev.txIndex = t;
+            ev.n = n;
+            ev.txid = tx.GetTxid();
+            ev.coin = it->first;
+            ev.data = it->second;
+            out.push_back(std::move(ev));
+        }
+
+        if (counters)
+            counters->inputs += inputs.size();
+    }
+}
+
+void WalletScanner::Apply(const Event& event)
+{
+    if (event.type == Event::CREDIT)
+    {
+        statCredits++;
+        if (coins.emplace(event.coin, event.data).second)
+            balance += event.data.amount;
+    }
+    else
+    {
+        statDebits++;
+        auto it = coins.find(event.coin);
+        if (it != coins.end())
+        {
+            balance -= it->second.amount;
+            coins.erase(it);
+        }
+    }
+}
+
+bool WalletScanner::ScanBlock(ByteSpan data, int height, std::vector<Event>* events,
+                              std::string* reason)
+{
+    BlockView block;
+    if (!block.Parse(data))
+    {
+        if (reason)
+            *reason = "malformed block at height " + std::to_string(height);
+        return false;
+    }
+
+    std::vector<Event> credits;
+    FindCredits(block, height, credits, counters);
+    counters.blocks++;
+
+    // Coins created and spent in this block count as spendable too
+    CoinMap created;
+    for (const Event& ev : credits)
+        created.emplace(ev.coin, ev.data);
+
+    std::vector<Event> debits;
+    if (!coins.empty() || !created.empty())
+        FindDebits(block, height, coins, &created, debits, &counters);
+
+    std::vector<Event> merged;
+    MergeEvents(credits, debits, merged);
+    for (const Event& ev : merged)
+        Apply(ev);
+
+    if (events)
+        events->insert(events->end(), merged.begin(), merged.end());
+    return true;
+}
+
+bool WalletScanner::ScanRange(const BlockStore& blocks, const std::vector<Hash256>& chain,
+                              Range& range, const CoinMap* spendable) const
+{
+    BlockView block;
+
+    for (int h = range.begin; h < range.end; ++h)
+    {
+        ByteSpan raw;
+        if (!blocks.ReadBlock(chain[h], raw))
+        {
+            range.error = "block at height " + std::to_string(h) + " not in the block store";
+            return false;
+        }
+        if (!block.Parse(raw))
+        {
+            range.error = "malformed block at height " + std::to_string(h);
+            return false;
+        }
+
+        if (spendable)
+        {
+            FindDebits(block, h, *spendable, nullptr, range.debits, &range.counters);
+        }
+        else
+        {
+            FindCredits(block, h, range.credits, range.counters);
+            range.counters.blocks++;
+        }
+    }
+    return true;
+}
+
+bool WalletScanner::Rescan(const BlockStore& blocks, const std::vector<Hash256>& chain, int fromHeight,
+                           std::vector<Event>* events, std::string* reason)
+{
+    if (fromHeight < 0 || (size_t)fromHeight > chain.size())
+    {
+        if (reason)
+            *reason = "start height out of range";
+        return false;
+    }
+
+    std::vector<Range> ranges;
+    for (size_t h = (size_t)fromHeight; h < chain.size(); h += opts.rangeBlocks)
+    {
+        Range r;
+        r.begin = (int)h;
+        r.end = (int)std::min(h + opts.rangeBlocks, chain.size());
+        r.ok = false;
+        ranges.push_back(std::move(r));
+    }
+
+    // 1. Credits
+    {
+        TaskGroup group(scheduler, TASK_BACKGROUND);
+        for (Range& r : ranges)
+            group.Run([this, &blocks, &chain, &r] { r.ok = ScanRange(blocks, chain, r, nullptr); });
+        group.Wait();
+    }
+
+    int firstCredit = -1;
+    for (const Range& r : ranges)
+    {
+        if (!r.ok)
+        {
+            if (reason)
+                *reason = r.error;
+            return false;
+        }
+        if (firstCredit < 0 && !r.credits.empty())
+            firstCredit = r.credits.front().height;
+    }
+
+    // 2. Debits, from the first height a wallet coin exists at
+    CoinMap spendable(coins);
+    for (const Range& r : ranges)
+    {
+        for (const Event& ev : r.credits)
+            spendable.emplace(ev.coin, ev.data);
+    }
+
+    if (!spendable.empty())
+    {
+        const int first = coins.empty() ? firstCredit : fromHeight;
+
+        TaskGroup group(scheduler, TASK_BACKGROUND);
+        for (Range& r : ranges)
+        {
+            if (r.end <= first)
+                continue;
+            group.Run([this, &blocks, &chain, &r, &spendable] {
+                r.ok = ScanRange(blocks, chain, r, &spendable);
+            });
+        }
+        group.Wait();
+
+        for (const Range& r : ranges)
+        {
+            if (!r.ok)
+            {
+                if (reason)
+                    *reason = r.error;
+                return false;
+            }
+        }
+    }
+
+    // 3. Merge in chain order
+    for (Range& r : ranges)
+    {
+        std::vector<Event> merged;
+        MergeEvents(r.credits, r.debits, merged);
+        for (const Event& ev : merged)
+            Apply(ev);
+
+        if (events)
+            events->insert(events->end(), std::make_move_iterator(merged.begin()),
+                           std::make_move_iterator(merged.end()));
+
+        counters.blocks += r.counters.blocks;
+        counters.transactions += r.counters.transactions;
+        counters.outputs += r.counters.outputs;
+        counters.inputs += r.counters.inputs;
+        counters.filterHits += r.counters.filterHits;
+    }
+    return true;
+}
+
+void WalletScanner::GetChain(const HeaderIndex& index, HeaderIndex::Pos tip, std::vector<Hash256>& out)
+{
+    out.clear();
+    if (tip == HeaderIndex::NONE)
+        return;
+
+    out.resize((size_t)index.GetHeight(tip) + 1);
+    for (HeaderIndex::Pos pos = tip; pos != HeaderIndex::NONE; pos = index.GetParent(pos))
+        out[(size_t)index.GetHeight(pos)] = index.GetBlockHash(pos);
+}
+
+WalletScanner::Stats WalletScanner::GetStats() const
+{
+    Stats s;
+    s.blocks = counters.blocks;
+    s.transactions = counters.transactions;
+    s.outputs = counters.outputs;
+    s.inputs = counters.inputs;
+    s.filterHits = counters.filterHits;
+    s.credits = statCredits;
+    s.debits = statDebits;
+    s.coins = coins.size();
+    s.balance = balance;
+    return s;
+}
@@ -0,0 +1,160 @@
+#ifndef DRACHMA_WALLET_WALLETSCANNER_H
+#define DRACHMA_WALLET_WALLETSCANNER_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "watchset.h"
+#include "../chain/headerindex.h"
+#include "../node/scheduler.h"
+#include "../storage/blockstore.h"
+#include "../storage/coin.h"
+#include "../storage/utxostore.h"
+#include "../tx/outpoint.h"
+
+class BlockView;
+
+//
+// ===============================================================
+//  CLASS: WalletScanner
+// ===============================================================
+//
+//  Finds a wallet's transactions in blocks: outputs paying to a
+//  watched hash (credits, see WatchSet::ExtractHash()) and inputs
+//  spending one of the wallet's coins (debits). Keeps the
+//  resulting unspent coins and balance.
+//
+//  ScanBlock() takes blocks one at a time in chain order, as they
+//  are connected.
+//
+//  Rescan() walks a height range of the local BlockStore on the
+//  Scheduler (TASK_BACKGROUND), `rangeBlocks` blocks per task,
+//  blocks parsed in place from the mapping:
+//
+//    1. every range looks for credits
+//    2. once all credits are known, the ranges from the first
+//       height a wallet coin can be spent at look for debits
+//       (skipped when the wallet has no coins)
+//    3. the events are merged in chain order and applied
+//
+//  Outputs are checked against the WatchSet prefilter first, so a
+//  block costs little more than parsing it; debits need the
+//  second pass because a range cannot know the coins created in
+//  the ranges before it.
+//
+//  The WatchSet must not change during a Rescan(). Not
+//  thread-safe otherwise.
+//
+// ===============================================================
+//
+class WalletScanner
+{
+public:
+    typedef std::array<uint8_t,32> Hash256;
+
+    struct Options
+    {
+        size_t rangeBlocks;             // blocks per rescan task
+
+        Options() : rangeBlocks(128) {}
+    };
+
+    struct Event
+    {
+        enum Type : uint8_t { CREDIT, DEBIT };
+
+        Type type;
+        int height;
+        uint32_t txIndex;               // in the block
+        uint32_t n;                     // output (credit) or input (debit)
+        Hash256 txid;
+        OutPoint coin;                  // created / spent
+        Coin data;                      // the coin's amount, script, ...
+    };
+
+    struct Stats
+    {
+        uint64_t blocks;
+        uint64_t transactions;
+        uint64_t outputs;
+        uint64_t inputs;
+        uint64_t filterHits;            // outputs past the prefilter
+        uint64_t credits;
+        uint64_t debits;
+        size_t coins;                   // unspent now
+        int64_t balance;
+    };
+
+    typedef std::unordered_map<OutPoint, Coin, SaltedOutPointHasher> CoinMap;
+
+    WalletScanner(const WatchSet& watch, Scheduler& scheduler, const Options& opts = Options());
+
+    // One block, the next in chain order. Events are appended to
+    // `events` if given.
+    bool ScanBlock(ByteSpan block, int height, std::vector<Event>* events = nullptr,
+                   std::string* reason = nullptr);
+
+    // Blocks chain[fromHeight .. chain.size()-1], chain[h] being the
+    // hash at height h. Fails without changing anything if a block
+    // is missing or malformed.
+    bool Rescan(const BlockStore& blocks, const std::vector<Hash256>& chain, int fromHeight,
+                std::vector<Event>* events = nullptr, std::string* reason = nullptr);
+
+    // Hashes of the chain ending in `tip`, by height
+    static void GetChain(const HeaderIndex& index, HeaderIndex::Pos tip, std::vector<Hash256>& out);
+
+    const CoinMap& GetCoins() const { return coins; }
+    int64_t GetBalance() const { return balance; }
+
+    Stats GetStats() const;
+
+private:
+    struct Counters
+    {
+        uint64_t blocks;
+        uint64_t transactions;
+        uint64_t outputs;
+        uint64_t inputs;
+        uint64_t filterHits;
+
+        Counters() : blocks(0), transactions(0), outputs(0), inputs(0), filterHits(0) {}
+    };
+
+    struct Range
+    {
+        int begin;
+        int end;                        // exclusive
+        bool ok;
+        std::string error;
+        std::vector<Event> credits;
+        std::vector<Event> debits;
+        Counters counters;
+    };
+
+    void FindCredits(const BlockView& block, int height, std::vector<Event>& out,
+                     Counters& counters) const;
+    static void FindDebits(const BlockView& block, int height, const CoinMap& spendable,
+                           const CoinMap* more, std::vector<Event>& out, Counters* counters);
+
+    bool ScanRange(const BlockStore& blocks, const std::vector<Hash256>& chain, Range& range,
+                   const CoinMap* spendable) const;
+
+    void Apply(const Event& event);
+
+    const WatchSet& watch;
+    Scheduler& scheduler;
+    Options opts;
+
+    CoinMap coins;
+    int64_t balance;
+
+    Counters counters;
+    uint64_t statCredits;
+    uint64_t statDebits;
+};
+
+#endif // DRACHMA_WALLET_WALLETSCANNER_H
@@ -0,0 +1,192 @@
+#include "watchset.h"
+#include "../crypto/hash.h"
+#include "../script/script.h"
+
+#include <cstring>
+#include <random>
+
+static inline uint64_t Mix64(uint64_t x)
+{
+    // murmur3 / splitmix finalizer
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// One odd multiplier per filter word (bit = top 5 bits of the product)
+static const uint32_t FILTER_SALT[8] = {
+    0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+    0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U,
+};
+
+WatchSet::WatchSet()
+{
+    std::random_device rd;
+    k0 = ((uint64_t)rd() << 32) | rd();
+    k1 = ((uint64_t)rd() << 32) | rd();
+
+    count = 0;
+    Rebuild(64);
+}
+
+uint64_t WatchSet::Hash(const uint8_t* hash) const
+{
+    uint64_t a, b;
+    uint32_t c;
+    std::memcpy(&a, hash, 8);
+    std::memcpy(&b, hash + 8, 8);
+    std::memcpy(&c, hash + 16, 4);
+
+    uint64_t h = Mix64(a ^ k0);
+    h = Mix64(h ^ b ^ k1);
+    return Mix64(h ^ c);
+}
+
+//
+// ================================================================
+//  Prefilter
+// ================================================================
+void WatchSet::FilterAdd(uint64_t h)
+{
+    FilterBlock& block = filter[(size_t)(((h >> 32) * filter.size()) >> 32)];
+    const uint32_t lo = (uint32_t)h;
+    for (int i = 0; i < 8; ++i)
+        block.words[i] |= 1u << ((lo * FILTER_SALT[i]) >> 27);
+}
+
+bool WatchSet::FilterHas(uint64_t h) const
+{
+    const FilterBlock& block = filter[(size_t)(((h >> 32) * filter.size()) >> 32)];
+    const uint32_t lo = (uint32_t)h;
+
+    // Branch-free over the eight words
+    uint32_t missing = 0;
+    for (int i = 0; i < 8; ++i)
+        missing |= ~block.words[i] & (1u << ((lo * FILTER_SALT[i]) >> 27));
+    return missing == 0;
+}
+
+bool WatchSet::MayContain(const uint8_t* hash) const
+{
+    return FilterHas(Hash(hash));
+}
+
+//
+// ================================================================
+//  Exact set
+// ================================================================
+void WatchSet::InsertSlot(uint64_t h, const uint8_t* hash)
+{
+    const size_t mask = slots.size() - 1;
+    size_t i = (size_t)h & mask;
+    while (slots[i].tag != 0)
+        i = (i + 1) & mask;
+
+    slots[i].tag = Tag(h);
+    std::memcpy(slots[i].hash, hash, 20);
+}
+
+void WatchSet::Rebuild(size_t slotCount)
+{
+    std::vector<Slot> old;
+    old.swap(slots);
+
+    Slot empty;
+    std::memset(&empty, 0, sizeof(empty));
+    slots.assign(slotCount, empty);
+
+    // Filter sized for the most entries this table takes
+    const size_t blocks = (slotCount / 2 * FILTER_BITS_PER_ENTRY + 255) / 256;
+    FilterBlock clear;
+    std::memset(&clear, 0, sizeof(clear));
+    filter.assign(blocks ? blocks : 1, clear);
+
+    for (const Slot& slot : old)
+    {
+        if (slot.tag == 0)
+            continue;
+
+        const uint64_t h = Hash(slot.hash);
+        InsertSlot(h, slot.hash);
+        FilterAdd(h);
+    }
+}
+
+void WatchSet::Reserve(size_t entries)
+{
+    size_t want = slots.size();
+    while (want / 2 < entries)
+        want *= 2;
+
+    if (want != slots.size())
+        Rebuild(want);
+}
+
+bool WatchSet::Insert(const Hash160& hash)
+{
+    if (Contains(hash))
+        return false;
+
+    if (count + 1 > slots.size() / 2)
+        Rebuild(slots.size() * 2);
+
+    const uint64_t h = Hash(hash.data());
+    InsertSlot(h, hash.data());
+    FilterAdd(h);
+    ++count;
+    return true;
+}
+
+bool WatchSet::Contains(const uint8_t* hash) const
+{
+    const uint64_t h = Hash(hash);
+    if (!FilterHas(h))
+        return false;
+
+    const uint32_t tag = Tag(h);
+    const size_t mask = slots.size() - 1;
+
+    for (size_t i = (size_t)h & mask; slots[i].tag != 0; i = (i + 1) & mask)
+    {
+        if (slots[i].tag == tag && std::memcmp(slots[i].hash, hash, 20) == 0)
+            return true;
+    }
+    return false;
+}
+
+size_t WatchSet::MemoryUsage() const
+{
+    return slots.capacity() * sizeof(Slot) + filter.capacity() * sizeof(FilterBlock);
+}
+
+bool WatchSet::ExtractHash(ByteSpan script, Hash160& out)
+{
+    if (IsPayToWitnessPubKeyHash(script))
+    {
+        std::memcpy(out.data(), script.data + 2, 20);
+        return true;
+    }
+    if (IsPayToPubKeyHash(script))
+    {
+        std::memcpy(out.data(), script.data + 3, 20);
+        return true;
+    }
+    if (IsPayToScriptHash(script))
+    {
+        std::memcpy(out.data(), script.data + 2, 20);
+        return true;
+    }
+
+    // P2PK: <33 or 65 byte key> CHECKSIG
+    if ((script.size == 35 && script[0] == 33) || (script.size == 67 && script[0] == 65))
+    {
+        if (script[script.size - 1] != OP_CHECKSIG)
+            return false;
+        Hash::Hash160(script.data + 1, script[0], out.data());
+        return true;
+    }
+    return false;
+}
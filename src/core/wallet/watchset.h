@@ -0,0 +1,95 @@
+#ifndef DRACHMA_WALLET_WATCHSET_H
+#define DRACHMA_WALLET_WATCHSET_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "../../common/utils/span.h"
+
+//
+// ===============================================================
+//  CLASS: WatchSet
+// ===============================================================
+//
+//  The 20-byte hashes a wallet watches: key IDs (Hash160 of a
+//  public key, as PubKeyID) and script hashes. Sized for millions
+//  of entries and for being asked about every output of every
+//  block, nearly always with "no".
+//
+//  Two levels:
+//
+//    - a split block Bloom filter, 16 bits per entry: every entry
+//      sets one bit in each 32-bit word of one 256-bit block, so a
+//      lookup reads a single cache line, and misses ~0.1% of the
+//      time. A few MB for millions of entries, so it mostly stays
+//      in cache.
+//    - behind it, the exact set: open addressing, linear probing,
+//      24-byte slots (32-bit tag + hash), load at most 1/2.
+//
+//  Both are indexed by a salted 64-bit mix of the hash; the salt
+//  is random per set, so outputs cannot be ground to collide in
+//  it.
+//
+//  Lookups are safe from any number of threads while nothing is
+//  inserted.
+//
+// ===============================================================
+//
+class WatchSet
+{
+public:
+    typedef std::array<uint8_t,20> Hash160;
+
+    WatchSet();
+
+    void Reserve(size_t entries);
+
+    // False if already present
+    bool Insert(const Hash160& hash);
+
+    // Prefilter only: false means absent
+    bool MayContain(const uint8_t* hash) const;
+    bool Contains(const uint8_t* hash) const;
+    bool Contains(const Hash160& hash) const { return Contains(hash.data()); }
+
+    size_t Size() const { return count; }
+    size_t MemoryUsage() const;
+
+    // The watched value a scriptPubKey pays to: the hash of P2PKH,
+    // P2WPKH and P2SH, Hash160 of the key of P2PK
+    static bool ExtractHash(ByteSpan script, Hash160& out);
+
+private:
+    static constexpr size_t FILTER_BITS_PER_ENTRY = 16;
+
+    struct Slot
+    {
+        uint32_t tag;                   // 0: empty
+        uint8_t hash[20];
+    };
+
+    struct alignas(32) FilterBlock
+    {
+        uint32_t words[8];
+    };
+
+    uint64_t Hash(const uint8_t* hash) const;
+    static uint32_t Tag(uint64_t h) { return (uint32_t)h | 1; }
+
+    void InsertSlot(uint64_t h, const uint8_t* hash);
+    void FilterAdd(uint64_t h);
+    bool FilterHas(uint64_t h) const;
+    void Rebuild(size_t slotCount);
+
+    uint64_t k0;
+    uint64_t k1;
+
+    std::vector<Slot> slots;            // power of two
+    size_t count;
+
+    std::vector<FilterBlock> filter;
+};
+
+#endif // DRACHMA_WALLET_WATCHSET_H